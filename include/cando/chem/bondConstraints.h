@@ -0,0 +1,104 @@
+/*
+    File: bondConstraints.h
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+
+
+/*
+ *	bondConstraints.h
+ *
+ *	Hold bond lengths fixed during dynamics with SHAKE, RATTLE and SETTLE
+ */
+
+#ifndef BondConstraints_H
+#define	BondConstraints_H
+
+#include <clasp/core/common.h>
+#include <cando/chem/chemPackage.h>
+#include <cando/chem/nVector.h>
+
+namespace       chem
+{
+
+FORWARD(EnergyFunction);
+
+/*! A set of bond length constraints split into independent clusters.
+ *
+ *  Rigid waters (an oxygen bonded to two hydrogens and nothing else) are solved
+ *  analytically with SETTLE (Miyamoto and Kollman) for positions and an exact 3x3 solve for
+ *  velocities.  Every other cluster of constraints that share atoms is solved iteratively
+ *  with SHAKE for positions and RATTLE for velocities.  Clusters are independent so they are
+ *  solved in parallel.
+ *
+ *  Atom indices are indices into the atom table, not into the coordinate vector.
+ *  Inverse masses are passed in by the integrator and a zero inverse mass keeps an atom fixed. */
+SMART(BondConstraints);
+class BondConstraints_O : public core::CxxObject_O
+{
+  LISP_CLASS(chem,ChemPkg,BondConstraints_O,"BondConstraints",core::CxxObject_O);
+public:
+  bool fieldsp() const { return true; };
+  void fields(core::Record_sp node);
+public:
+  // Constraints solved with SHAKE/RATTLE sorted by cluster
+  core::SimpleVector_int32_t_sp _Atom1;
+  core::SimpleVector_int32_t_sp _Atom2;
+  NVector_sp                    _Distance;
+  core::SimpleVector_int32_t_sp _ClusterStart;   // constraints of cluster i are [start[i],start[i+1])
+  // Rigid waters solved with SETTLE - three atoms (oxygen hydrogen hydrogen) per water
+  core::SimpleVector_int32_t_sp _Waters;
+  NVector_sp                    _WaterOH;
+  NVector_sp                    _WaterHH;
+  double                        _Tolerance;      // relative tolerance on the squared distance
+  size_t                        _MaxIterations;
+public:
+  static BondConstraints_sp make(EnergyFunction_sp energyFunction, core::Symbol_sp bonds, bool rigidWater);
+public:
+  CL_LISPIFY_NAME("bond-constraints-number-of-constraints");
+  CL_DEFMETHOD size_t numberOfConstraints() const;
+  CL_LISPIFY_NAME("bond-constraints-number-of-waters");
+  CL_DEFMETHOD size_t numberOfWaters() const { return this->_Waters->length()/3; };
+  CL_LISPIFY_NAME("bond-constraints-set-tolerance");
+  CL_DEFMETHOD void setTolerance(double tolerance, size_t maxIterations);
+  /*! Return the number of constraints that remove a degree of freedom - those with a moving atom */
+  size_t numberOfActiveConstraints(NVector_sp inverseMasses) const;
+
+  /*! Move pos so that every constraint is satisfied.  The corrections are directed along
+   *  the bonds of reference, the positions at the start of the step. */
+  CL_LISPIFY_NAME("bond-constraints-apply-to-positions");
+  CL_DEFMETHOD void applyToPositions(NVector_sp reference, NVector_sp pos, NVector_sp inverseMasses);
+  /*! Remove the components of vel that would change a constrained distance at pos */
+  CL_LISPIFY_NAME("bond-constraints-apply-to-velocities");
+  CL_DEFMETHOD void applyToVelocities(NVector_sp pos, NVector_sp vel, NVector_sp inverseMasses);
+  /*! Return the largest relative deviation of a constrained distance at pos */
+  CL_LISPIFY_NAME("bond-constraints-maximum-deviation");
+  CL_DEFMETHOD double maximumDeviation(NVector_sp pos) const;
+private:
+  [[noreturn]] void notConverged(const char* method, size_t failed) const;
+public:
+  BondConstraints_O() : _Tolerance(1.0e-8), _MaxIterations(1000) {};
+};
+
+};
+
+#endif
@@ -0,0 +1,93 @@
+/*
+    File: canonicalSmiles.h
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+
+
+/*
+ *	canonicalSmiles.h
+ *
+ *	Canonical atom ranking, canonical SMILES and canonical hashes of molecules
+ */
+
+#ifndef CanonicalSmiles_H
+#define	CanonicalSmiles_H
+
+#include <string>
+#include <vector>
+#include <clasp/core/common.h>
+#include <cando/chem/chemPackage.h>
+
+namespace       chem
+{
+
+FORWARD(Atom);
+FORWARD(Molecule);
+
+typedef enum { canonicalSingleBond=1, canonicalDoubleBond=2, canonicalTripleBond=3, canonicalAromaticBond=4 } CanonicalBond;
+
+/*! The graph of one molecule with everything canonicalization looks at, pulled out of a
+ *  MatterGraph of the molecule once so that many molecules can be ranked and written in
+ *  parallel without touching Lisp objects.
+ *
+ *  Hydrogens bonded to other atoms are folded into the _Hydrogens count of their neighbor.
+ *  The neighbors of atom i are _Neighbors[_NeighborStart[i],_NeighborStart[i+1]) and
+ *  _BondCodes holds the code of every half edge (see CanonicalBond).  Stereocenters are
+ *  found from CIP priorities and _Chirality holds the R/S label computed from the
+ *  coordinates (0 means no stereocenter, 1 is R and 2 is S).  _BondStereo holds the E/Z
+ *  label of every half edge of a stereogenic double bond from the coordinates of the
+ *  highest CIP priority substituent on each end (0 means not stereogenic, 1 is Z and 2 is E). */
+struct CanonicalGraph {
+  std::vector<std::string>  _Symbols;
+  std::vector<uint8_t>      _AtomicNumbers;
+  std::vector<int8_t>       _Charges;
+  std::vector<uint8_t>      _Hydrogens;
+  std::vector<uint8_t>      _Aromatic;
+  std::vector<uint8_t>      _Chirality;
+  std::vector<double>       _Positions;          // x,y,z of every atom
+  std::vector<double>       _HydrogenPositions;  // x,y,z of the first folded hydrogen of every atom
+  std::vector<uint32_t>     _NeighborStart;      // size is the number of atoms + 1
+  std::vector<uint32_t>     _Neighbors;
+  std::vector<uint8_t>      _BondCodes;          // a CanonicalBond for every half edge
+  std::vector<uint8_t>      _BondStereo;         // E/Z label of every half edge
+  bool                      _ImplicitHydrogens;  // the molecule has no hydrogen atoms at all
+
+  size_t numberOfAtoms() const { return this->_Symbols.size(); };
+  /*! Fill the graph from molecule and put the atom of every graph index into atoms.
+   *  Aromatic atoms are taken from chem:*current-aromaticity-information* when it is bound.
+   *  CIP priorities are only calculated when stereo is true. */
+  void extract(Molecule_sp molecule, bool stereo, gctools::Vec0<Atom_sp>& atoms);
+  /*! Give every atom a distinct canonical rank 0..N-1 by iterative refinement of atom invariants
+   *  and the E/Z labels of the bonds with tie breaking.  Doesn't allocate Lisp objects. */
+  void rank(std::vector<uint32_t>& ranks) const;
+  /*! Write the SMILES string of the graph walking it in the order of ranks. Doesn't allocate Lisp objects.
+   *  unwrittenStereo is set to the number of stereogenic double bonds that couldn't be written with / and \. */
+  std::string smiles(const std::vector<uint32_t>& ranks, size_t& unwrittenStereo) const;
+};
+
+/*! 64 bit FNV-1a hash of a canonical SMILES string */
+uint64_t canonical_smiles_hash(const std::string& smiles);
+
+};
+
+#endif
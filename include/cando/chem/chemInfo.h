@@ -432,8 +432,12 @@ public:
 
 
 
+bool    is_aromatic(Atom_sp a1);
+bool    aromatic_information_available_p();
 bool    _matchInAromaticBond(Atom_sp a1, Atom_sp a2);
 bool    _matchBondTypes(BondEnum be, chem::BondOrder bo, Atom_sp a1, Atom_sp a2);
+/*! Like _matchBondTypes but the caller has already worked out if the bond is in an aromatic ring */
+bool    _matchBondTypesGivenAromaticity(BondEnum be, chem::BondOrder bo, bool inAromaticBond);
 
 FORWARD(BondMatcher);
 
@@ -646,11 +650,12 @@ DECLARE_ENUM_SYMBOL_TRANSLATOR(chem::AtomTestEnum,chem::_sym_STARAtomTestEnumCon
 
 
 namespace chem {
+class CompiledChemInfo_O;
 SMART(AtomTest);
 class AtomTest_O : public AtomOrBondMatchNode_O
 {
   LISP_CLASS(chem,ChemPkg,AtomTest_O,"AtomTest",AtomOrBondMatchNode_O);
-  
+  friend class CompiledChemInfo_O;
 public:
   void initialize();
   bool fieldsp() const { return true; };
@@ -802,6 +807,7 @@ SMART(AntechamberFocusAtomMatch);
 class AntechamberFocusAtomMatch_O : public AtomOrBondMatchNode_O
 {
   LISP_CLASS(chem,ChemPkg,AntechamberFocusAtomMatch_O,"AntechamberFocusAtomMatch",AtomOrBondMatchNode_O);
+  friend class CompiledChemInfo_O;
 
 public:
   void initialize();
@@ -1319,6 +1325,7 @@ public:
   gctools::Vec0<ChemInfoNode_sp> _atomNodes;
   gctools::Vec0<BondToAtomTest_sp> _bondNodes;
   ChemInfoGraphType*     _chemInfoGraph;
+  core::T_sp             _Compiled;  // nil until chem:boost-graph-vf2 compiles it
 public:
 
   ChemInfoGraph_O(Root_sp);
@@ -1340,6 +1347,8 @@ public:
 
 namespace chem {
 core::T_mv chem__chem_info_match(Root_sp testRoot, Atom_sp atom);
+ChemInfoGraph_sp chem__make_chem_info_graph(Root_sp pattern);
+MoleculeGraph_sp chem__make_molecule_graph_from_molecule(Matter_sp matter, bool exclude_hydrogens);
 SmartsRoot_sp chem__compile_smarts(const string& smarts, core::List_sp tests);
 AntechamberRoot_mv chem__compile_antechamber(const string& smarts,WildElementDict_sp xpdict);
 };
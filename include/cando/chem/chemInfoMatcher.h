@@ -0,0 +1,200 @@
+/*
+    File: chemInfoMatcher.h
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ 
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+/* -^- */
+
+//
+//	chemInfoMatcher.h
+//
+//      A compiled form of a ChemInfoGraph that is matched against
+//      per-atom invariants that are precomputed once per molecule.
+//
+#ifndef	CHEM_INFO_MATCHER_H
+#define	CHEM_INFO_MATCHER_H
+
+#include <vector>
+#include <algorithm>
+#include <clasp/core/common.h>
+#include <cando/chem/chemPackage.h>
+#include <cando/chem/chemInfo.h>
+
+
+namespace chem {
+
+/*! Bits of the per-atom invariant word.
+    Counts are one-hot encoded and the last bit of each field means "that many or more". */
+namespace invariant {
+  constexpr uint64_t Aromatic = 1ull<<0;
+  constexpr uint64_t InRing = 1ull<<1;
+  constexpr int      DegreeShift = 2;           // degree 0..7
+  constexpr int      DegreeMax = 7;
+  constexpr int      HCountShift = 10;          // total hydrogen count 0..4
+  constexpr int      HCountMax = 4;
+  constexpr int      RingCountShift = 15;       // ring membership count 0..3
+  constexpr int      RingCountMax = 3;
+  constexpr int      RingSizeShift = 19;        // member of a ring of size 3..10
+  constexpr int      RingSizeMin = 3;
+  constexpr int      RingSizeMax = 10;
+  constexpr uint64_t Electronegative = 1ull<<27;
+  inline uint64_t degree(int d) { return 1ull<<(DegreeShift+std::min(d,DegreeMax)); };
+  inline uint64_t hcount(int h) { return 1ull<<(HCountShift+std::min(h,HCountMax)); };
+  inline uint64_t ringCount(int c) { return 1ull<<(RingCountShift+std::min(c,RingCountMax)); };
+  inline uint64_t ringSize(int s) { return 1ull<<(RingSizeShift+s-RingSizeMin); };
+};
+
+struct AtomInvariants {
+  Atom_sp         _Atom;
+  core::Symbol_sp _Element;
+  Element         _ElementEnum;
+  uint64_t        _Bits;
+  int             _AtomicNumber;
+  int             _AtomicMass;
+  int             _HCount;
+  int             _Degree;
+  int             _Ionization;
+  int             _Valence;
+  int             _RingCount;
+  uint64_t        _RingSizes;  // bit n set if the atom is in a ring of size n (n<64)
+  AtomInvariants(Atom_sp atom) : _Atom(atom), _Element(nil<core::Symbol_O>()), _ElementEnum(element_Undefined), _Bits(0), _AtomicNumber(0), _AtomicMass(0),
+                                 _HCount(0), _Degree(0), _Ionization(0), _Valence(0), _RingCount(0), _RingSizes(0) {};
+};
+
+struct InvariantEdge {
+  size_t    _Neighbor;
+  BondOrder _Order;
+  bool      _InAromaticBond;
+  bool      _SameRing;
+  InvariantEdge(size_t n, BondOrder bo, bool ar, bool sr) : _Neighbor(n), _Order(bo), _InAromaticBond(ar), _SameRing(sr) {};
+};
+
+/*! Everything that the SMARTS atom and bond primitives look at, computed once per molecule.
+    The rings and aromaticity information are captured from chem:*current-rings* and
+    chem:*current-aromaticity-information* when the object is made - the same atom indices
+    as the MoleculeGraph are used. */
+FORWARD(MoleculeInvariants);
+class MoleculeInvariants_O : public core::CxxObject_O
+{
+  LISP_CLASS(chem,ChemPkg,MoleculeInvariants_O,"MoleculeInvariants",core::CxxObject_O);
+public:
+  MoleculeGraph_sp              _MoleculeGraph;
+  gctools::Vec0<AtomInvariants> _Atoms;
+  gctools::Vec0<size_t>         _NeighborStart; // CSR adjacency, size is number of atoms + 1
+  gctools::Vec0<InvariantEdge>  _Neighbors;
+  bool                          _RingsAvailable;
+  bool                          _AromaticityAvailable;
+public:
+  static MoleculeInvariants_sp make(MoleculeGraph_sp graph);
+public:
+  size_t numberOfAtoms() const { return this->_Atoms.size(); };
+  /*! Return the edge from a1 to a2 or NULL if they are not bonded */
+  const InvariantEdge* edge(size_t a1, size_t a2) const;
+  MoleculeInvariants_O(MoleculeGraph_sp graph) : _MoleculeGraph(graph), _RingsAvailable(false), _AromaticityAvailable(false) {};
+};
+
+
+struct CompiledChemInfoVertex {
+  ChemInfoNode_sp  _Node;
+  uint64_t         _Required;
+  uint64_t         _Forbidden;
+  core::Symbol_sp  _Element;  // nil if any element
+  int              _Selectivity;
+  CompiledChemInfoVertex(ChemInfoNode_sp node) : _Node(node), _Required(0), _Forbidden(0), _Element(nil<core::Symbol_O>()), _Selectivity(0) {};
+};
+
+struct CompiledChemInfoEdge {
+  size_t            _Vertex1;
+  size_t            _Vertex2;
+  BondToAtomTest_sp _Bond;
+  CompiledChemInfoEdge(size_t v1, size_t v2, BondToAtomTest_sp b) : _Vertex1(v1), _Vertex2(v2), _Bond(b) {};
+};
+
+/*! A ChemInfoGraph compiled for fast matching.
+    Every vertex gets bit masks that are tested against the AtomInvariants
+    before the full atom test is evaluated and the search order is planned
+    so that the most selective vertices are matched first. */
+FORWARD(CompiledChemInfo);
+class CompiledChemInfo_O : public core::CxxObject_O
+{
+  LISP_CLASS(chem,ChemPkg,CompiledChemInfo_O,"CompiledChemInfo",core::CxxObject_O);
+public:
+  ChemInfoGraph_sp      _ChemInfoGraph;
+  Root_sp               _Root;
+  size_t                _RootVertex;  // The vertex that chem:chem-info-match pins to its atom
+  gctools::Vec0<CompiledChemInfoVertex> _Vertices;
+  gctools::Vec0<CompiledChemInfoEdge> _Edges;
+  gctools::Vec0<size_t> _EdgeStart;   // CSR of edge indices per vertex
+  gctools::Vec0<size_t> _VertexEdges;
+  bool                  _Pure;        // every atom and bond test is decided by the invariants alone
+  bool                  _NeedsRings;  // ... as long as the invariants have the rings
+public:
+  static CompiledChemInfo_sp make(ChemInfoGraph_sp graph);
+  /*! Return the compiled form of graph - it is compiled the first time and kept with the graph */
+  static CompiledChemInfo_sp compiledGraph(ChemInfoGraph_sp graph);
+  /*! Compile a pattern that is matched one atom at a time, return nil if it can't be compiled.
+      Antechamber type rules match walks over the bonds rather than embeddings (an atom can be
+      visited twice) so they compile to a single vertex that tests the focus atom against the
+      invariants and then runs the original matcher.  Rules with after match tests are not compiled. */
+  static core::T_sp compileRoot(Root_sp root);
+  /*! Match root with its first atom on atom using compiled if it isn't nil and
+      chem:chem-info-match otherwise. */
+  static bool matchesAtom(Root_sp root, core::T_sp compiled, MoleculeInvariants_sp invariants, Atom_sp atom);
+private:
+  static void compileVertexConstraints(core::T_sp tnode, CompiledChemInfoVertex& vertex);
+  /*! Return false if evaluating tnode could call back into lisp or allocate */
+  static bool pureNode(core::T_sp tnode, bool& needsRings);
+  static bool pureBond(BondEnum bond, bool& needsRings);
+public:
+  size_t numberOfVertices() const { return this->_Vertices.size(); };
+  /*! The cheap test - only the invariant bits and element */
+  bool prefilter(size_t vertex, const AtomInvariants& atom) const {
+    const CompiledChemInfoVertex& v = this->_Vertices[vertex];
+    return ((atom._Bits & v._Required) == v._Required)
+      && ((atom._Bits & v._Forbidden) == 0)
+      && (v._Element.nilp() || v._Element == atom._Element);
+  }
+  /*! The full atom test evaluated against the invariants.
+      If tags is not NULL then the atom map tags that are hit are pushed onto it. */
+  bool evaluate(core::T_sp node, MoleculeInvariants_sp invariants, size_t atom, std::vector<int>* tags) const;
+  bool matchEdge(const CompiledChemInfoEdge& edge, MoleculeInvariants_sp invariants, size_t atom1, const InvariantEdge& iedge) const;
+  /*! Search for embeddings of the pattern in the molecule.
+      If rootAtom >= 0 then the root vertex is pinned to that atom.
+      If firstOnly is true then the search stops at the first match.
+      Returns a list of tag vectors like chem:boost-graph-vf2 */
+  core::List_sp search(MoleculeInvariants_sp invariants, int rootAtom, bool induced, bool firstOnly) const;
+  /*! True if matchExists can be used on the invariants */
+  bool pureFor(const MoleculeInvariants_O& invariants) const {
+    return this->_Pure && (!this->_NeedsRings || invariants._RingsAvailable);
+  }
+  /*! Return true if the pattern has an embedding in the molecule.
+      Only for patterns that are pureFor the invariants - nothing here allocates lisp memory
+      or binds special variables so it can run on threads that lisp doesn't know about. */
+  bool matchExists(MoleculeInvariants_sp invariants, bool induced) const;
+
+  CompiledChemInfo_O(ChemInfoGraph_sp graph);
+  CompiledChemInfo_O(Root_sp root);
+};
+
+};
+
+#endif
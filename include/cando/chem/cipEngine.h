@@ -0,0 +1,141 @@
+/*
+    File: cipEngine.h
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+
+
+/*
+ *	cipEngine.h
+ *
+ *	CIP priorities on a flat bond graph with cached per stereocenter decisions
+ */
+
+#ifndef CipEngine_H
+#define	CipEngine_H
+
+#include <functional>
+#include <vector>
+#include <clasp/core/common.h>
+#include <cando/chem/chemPackage.h>
+#include <cando/chem/matterGraph.h>
+
+namespace       chem
+{
+
+FORWARD(Atom);
+FORWARD(Matter);
+
+/*! The bonds of a molecule or aggregate as flat arrays for CIP prioritization.
+ *  Every neighbor of atom i appears in _Neighbors[_Start[i],_Start[i+1]) once per
+ *  unit of bond multiplicity (twice for a double bond) like the s(i) lists of Labute's
+ *  algorithm (see cipPrioritizer.cc).  _BondNeighbors has each bonded atom only once
+ *  in the order of the atom's bonds.  Atom indices are those of the MatterGraph it is
+ *  extracted from. */
+struct CipGraph {
+  gctools::Vec0<uint32_t> _AtomicNumbers;
+  gctools::Vec0<uint32_t> _Start;
+  gctools::Vec0<uint32_t> _Neighbors;
+  gctools::Vec0<uint32_t> _BondStart;
+  gctools::Vec0<uint32_t> _BondNeighbors;
+
+  size_t numberOfAtoms() const { return this->_AtomicNumbers.size(); };
+  size_t numberOfBonds(size_t index) const { return this->_BondStart[index+1]-this->_BondStart[index]; };
+  /*! Fill the graph from a MatterGraph made without the virtual atoms */
+  void extract(MatterGraph_sp graph);
+  /*! Run Labute's partition refinement starting from the atomic numbers.  After every level,
+   *  p holds for each atom the position of the first atom of its class in priority order, so
+   *  p(i)<p(j) iff atom i has lower priority than j given the spheres up to that level.
+   *  onLevel (if given) is called with the level and p after level 0 and every level that
+   *  split a class.  Stops after maxLevels levels that split or when nothing splits.
+   *  Returns the number of levels that split - fewer than maxLevels means p is final. */
+  size_t refine(size_t maxLevels, std::vector<uint32_t>& p,
+                const std::function<void(size_t,const std::vector<uint32_t>&)>& onLevel = nullptr) const;
+  /*! Turn the class positions from refine into class numbers 0,1,2... */
+  void classNumbers(const std::vector<uint32_t>& p, std::vector<uint32_t>& classes) const;
+};
+
+/*! Where the ranks of the neighbors of a center were decided */
+#define CIP_RADIUS_NOT_A_CENTER 0
+#define CIP_RADIUS_UNBOUNDED    0xFFFFFFFF
+
+/*! Cached CIP information for the atoms of a molecule or aggregate.
+ *
+ *  For every atom with four bonds the engine keeps the relative ranks of its neighbors and
+ *  the decision radius - the bond distance from the center out to which the hierarchical
+ *  digraph had to be expanded to rank the neighbors.  When the matter is edited,
+ *  cip-engine-update takes a new snapshot of the bonds, finds the atoms whose element or
+ *  bonds changed and re-ranks only the centers that have a changed atom within their
+ *  decision radius by refining a ball of atoms around each of them.  Centers with neighbors
+ *  that are tied because they are equivalent (other than identical terminal atoms) have an
+ *  unbounded radius and are re-ranked when anything in their molecule changes.
+ *  Changing coordinates or configurations doesn't change any ranks, so enumerating
+ *  stereoisomers only calls cip-engine-configurations.  The priorities of all atoms are
+ *  refined again only when they are asked for after the bonds changed. */
+SMART(CipEngine);
+class CipEngine_O : public core::CxxObject_O
+{
+  LISP_CLASS(chem,ChemPkg,CipEngine_O,"CipEngine",core::CxxObject_O);
+public:
+  Matter_sp               _Matter;
+  MatterGraph_sp          _MatterGraph;     // the atoms and their indices
+  CipGraph                _Graph;
+  gctools::Vec0<uint32_t> _NameRank;        // order of the atom names - breaks ties in configurations
+  gctools::Vec0<uint32_t> _CenterRadius;    // CIP_RADIUS_NOT_A_CENTER unless the atom has four bonds
+  gctools::Vec0<uint8_t>  _CenterRanks;     // four per atom - rank of each bonded neighbor, 3 is highest
+  gctools::Vec0<uint32_t> _Priorities;
+  bool                    _PrioritiesValid;
+public:
+  static CipEngine_sp make(Matter_sp matter);
+public:
+  CL_LISPIFY_NAME("cip-engine-number-of-atoms");
+  CL_DEFMETHOD size_t numberOfAtoms() const { return this->_Graph.numberOfAtoms(); };
+  CL_LISPIFY_NAME("cip-engine-atoms");
+  CL_DEFMETHOD core::SimpleVector_sp atomsAsVector() const;
+  CL_LISPIFY_NAME("cip-engine-atom-index");
+  CL_DEFMETHOD core::T_sp atomIndex(Atom_sp atom) const;
+  CL_LISPIFY_NAME("cip-engine-update");
+  CL_DEFMETHOD size_t update();
+  CL_LISPIFY_NAME("cip-engine-priorities");
+  CL_DEFMETHOD core::SimpleVector_int32_t_sp prioritiesAsVector();
+  CL_LISPIFY_NAME("cip-engine-stereochemistry-types");
+  CL_DEFMETHOD core::SimpleVector_sp stereochemistryTypes() const;
+  CL_LISPIFY_NAME("cip-engine-configurations");
+  CL_DEFMETHOD core::SimpleVector_sp configurations() const;
+  CL_LISPIFY_NAME("cip-engine-neighbors-by-priority");
+  CL_DEFMETHOD core::List_sp neighborsByPriority(size_t index) const;
+  CL_LISPIFY_NAME("cip-engine-decision-radius");
+  CL_DEFMETHOD core::T_sp decisionRadius(size_t index) const;
+
+  /*! Rank the neighbors of every center from one refinement of the whole graph */
+  void rankAllCenters();
+  /*! The bonded neighbors of center from highest to lowest priority, ties broken by name */
+  void orderedNeighbors(size_t center, uint32_t order[4]) const;
+  void ensurePriorities();
+  void snapshot();
+public:
+  CipEngine_O() : _PrioritiesValid(false) {};
+};
+
+};
+
+#endif
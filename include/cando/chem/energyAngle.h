@@ -168,6 +168,17 @@ public:
 public: // instance variables
     gctools::Vec0<TermType>	_Terms;
     gctools::Vec0<TermType>	_BeyondThresholdTerms;
+    /*! Structure-of-arrays copy of _Terms that evaluateAllComponent runs over.
+        The entries are sorted by coordinate index and _CompiledTermIndex maps each
+        one back to the _Terms entry that holds its atoms for reporting.
+        compileTerms rebuilds them whenever _CompiledTermsValid is false. */
+    bool                          _CompiledTermsValid;
+    core::SimpleVector_float_sp   _CompiledKt;
+    core::SimpleVector_float_sp   _CompiledT0;
+    core::SimpleVector_int32_t_sp _CompiledI1;
+    core::SimpleVector_int32_t_sp _CompiledI2;
+    core::SimpleVector_int32_t_sp _CompiledI3;
+    core::SimpleVector_int32_t_sp _CompiledTermIndex;
 public:	
     typedef gctools::Vec0<TermType>::iterator iterator;
     iterator begin() { return this->_Terms.begin(); };
@@ -193,6 +204,11 @@ public:	// Creation class functions
 
 public:
     void addTerm(const TermType& term);
+    void invalidateCompiledTerms() { this->_CompiledTermsValid = false; };
+    void compileTerms();
+    void ensureCompiledTerms() {
+      if (!this->_CompiledTermsValid || this->_CompiledTermIndex->length() != this->_Terms.size()) this->compileTerms();
+    };
     virtual void dumpTerms(core::HashTable_sp atomTypes);
 
     virtual core::List_sp extract_vectors_as_alist() const;
@@ -233,7 +249,7 @@ public:
 
     EnergyAngle_O( const EnergyAngle_O& ss ); //!< Copy constructor
 
-  EnergyAngle_O() : EnergyComponent_O() {};
+  EnergyAngle_O() : EnergyComponent_O(), _CompiledTermsValid(false) {};
 };
 
 
@@ -42,6 +42,7 @@ This is an open source license for the CANDO software from Temple University, bu
 #include <string>
 #include <vector>
 #include <set>
+#include <thread>
 #include <clasp/core/common.h>
 #include <cando/geom/vector3.h>
 #include <cando/adapt/quickDom.h>
@@ -82,6 +83,8 @@ public:
   KahanSummation() : sum(0.0), c(0.0) {}
 
       // Adds a new value to the running total using Kahan summation algorithm.
+      // Single precision term energies are widened so the total is kept in double precision.
+  void add(float input) { this->add((double)input); }
   void add(double input) {
     double y = input - c;
     double t = sum + y;
@@ -103,6 +106,46 @@ namespace       chem {
   auto bitvectorActiveAtomMask = gc::As_unsafe<core::SimpleBitVector_sp>(activeAtomMask);
 #define MAYBE_SETUP_DEBUG_INTERACTIONS(dbgint) bool doDebugInteractions = dbgint;
 
+/*! Counters bumped by the term code while a single component is evaluated.
+ *  They are thread local so that the accumulate and atom mask macros can reach them
+ *  from the free evaluation functions.  EnergyFunction_O::evaluateAll clears them
+ *  before each component and folds them into that component's profile afterwards.
+ *  Components that evaluate on worker threads use energyTermsParallel so that the
+ *  workers' counts end up in the calling thread's counters.
+ */
+struct EnergyTermCounters {
+  size_t _TermsSkipped;
+  size_t _HessianElements;
+  void reset() { this->_TermsSkipped = 0; this->_HessianElements = 0; };
+  void add(const EnergyTermCounters& other) {
+    this->_TermsSkipped += other._TermsSkipped;
+    this->_HessianElements += other._HessianElements;
+  };
+};
+extern thread_local EnergyTermCounters energyTermCounters;
+
+/*! Run fn(tid) on numThreads threads - the calling thread runs tid 0.  The counters the
+ *  worker threads bump are added to the calling thread's counters when they are joined. */
+template <typename Fn>
+void energyTermsParallel(size_t numThreads, Fn&& fn) {
+  std::vector<EnergyTermCounters> counters(numThreads,EnergyTermCounters{0,0});
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads-1);
+  for ( size_t tid=1; tid<numThreads; ++tid ) {
+    threads.emplace_back([&fn,&counters,tid] () {
+      energyTermCounters.reset();
+      fn(tid);
+      counters[tid] = energyTermCounters;
+    });
+  }
+  fn(0);
+  for ( auto& thread : threads ) thread.join();
+  for ( size_t tid=1; tid<numThreads; ++tid ) energyTermCounters.add(counters[tid]);
+}
+
+#define ENERGY_COUNT_SKIPPED_TERMS(num) (chem::energyTermCounters._TermsSkipped += (num))
+#define ENERGY_COUNT_SKIPPED_TERM() ENERGY_COUNT_SKIPPED_TERMS(1)
+
 SMART(QDomNode);
 SMART(AbstractLargeSquareMatrix);
 FORWARD(EnergyFunction);
@@ -213,6 +256,7 @@ inline string	atomLabel(Atom_sp a)
 #define	OffDiagHessAcc(i1,o1,i2,o2,v) {\
     if ( hasHessian ) {\
       hessian->addToElement((i1)+(o1),(i2)+(o2),v);\
+      ++chem::energyTermCounters._HessianElements;\
     }\
     if ( hasHdAndD ) {\
       auto v22 = v*dvec->element((i2)+(o2));\
@@ -228,6 +272,7 @@ inline string	atomLabel(Atom_sp a)
 #define	DiagHessAcc(i1,o1,i2,o2,v) {\
     if ( hasHessian ) {\
       hessian->addToElement((i1)+(o1),(i2)+(o2),v);\
+      ++chem::energyTermCounters._HessianElements;\
     }\
     if ( hasHdAndD ) {\
       auto vd = v*dvec->element((i1)+(o1));\
@@ -299,8 +344,19 @@ class EnergyComponent_O : public core::CxxObject_O
   bool		_DebugEnergy;
   int		_Debug_NumberOfTermsToCalculate;
   core::StringOutputStream_sp 	_DebugLog;
+  bool          _SinglePrecision; // Evaluate energy and force in float - not saved
 public:
   size_t        _Evaluations;
+  // Profile of the calls made through EnergyFunction_O::evaluateAll - not saved
+  size_t        _ProfileCalls;
+  double        _ProfileSeconds;
+  size_t        _ProfileTermsEvaluated;
+  size_t        _ProfileTermsSkipped;
+  size_t        _ProfileHessianElements;
+  double        _ProfileLastSeconds;
+  size_t        _ProfileLastTermsEvaluated;
+  size_t        _ProfileLastTermsSkipped;
+  size_t        _ProfileLastHessianElements;
 //protected:		// Define these in subclasses
 //	vector<TermClass>	_Terms;
 //	vector<TermClass>	_BeyondThresholdTerms;
@@ -328,6 +384,13 @@ public:
   CL_DEFMETHOD 	void	setErrorThreshold(double tr) { this->_ErrorThreshold = tr; };
   CL_LISPIFY_NAME("getErrorThreshold");
   CL_DEFMETHOD 	double	getErrorThreshold() { return this->_ErrorThreshold; };
+  CL_DOCSTRING(R"dx(Evaluate the energy and force of this component in single precision when on is true.
+Energies are summed and forces accumulated in double precision.  Hessian evaluations and
+components without a single precision path always use double precision.)dx");
+  CL_LISPIFY_NAME("energy-component-set-single-precision");
+  CL_DEFMETHOD 	void	setSinglePrecision(bool on) { this->_SinglePrecision = on; };
+  CL_LISPIFY_NAME("energy-component-single-precision-p");
+  CL_DEFMETHOD 	bool	singlePrecisionp() const { return this->_SinglePrecision; };
 
   CL_DOCSTRING("Some energy-components are restraints - and should be disabled to calculate conformational energies");
   CL_DEFMETHOD
@@ -337,6 +400,16 @@ public:
   CL_DEFMETHOD 	size_t	evaluations() const { return this->_Evaluations; };
 
   CL_DEFMETHOD virtual core::List_sp extract_vectors_as_alist() const { SUBCLASS_MUST_IMPLEMENT(); };
+
+  /*! Return the number of terms one evaluation visits before the active atom mask and
+   *  cutoff are applied.  Used to work out the terms evaluated for the profile. */
+  virtual size_t profileTermCount() { return this->numberOfTerms(); };
+  /*! Fold the wall time and term counters of one evaluation into the profile */
+  void profileRecord(double seconds, const EnergyTermCounters& counters);
+  CL_LISPIFY_NAME("energy-component-profile-reset");
+  CL_DEFMETHOD void profileReset();
+  CL_LISPIFY_NAME("energy-component-profile");
+  CL_DEFMETHOD core::List_sp profileAsPlist();
  
   string enabledAsString();
   string debugLogAsString();
@@ -369,7 +442,11 @@ public:
 
   EnergyComponent_O() : _Enabled(true),
                         _Scale(1.0),
-                        _DebugEnergy(false), _Evaluations(0) {};
+                        _DebugEnergy(false), _SinglePrecision(false), _Evaluations(0),
+                        _ProfileCalls(0), _ProfileSeconds(0.0),
+                        _ProfileTermsEvaluated(0), _ProfileTermsSkipped(0), _ProfileHessianElements(0),
+                        _ProfileLastSeconds(0.0),
+                        _ProfileLastTermsEvaluated(0), _ProfileLastTermsSkipped(0), _ProfileLastHessianElements(0) {};
 };
 template <typename SP>
 SP safe_alist_lookup(core::List_sp list, core::T_sp key) {
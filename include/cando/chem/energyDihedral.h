@@ -195,6 +195,25 @@ public:
 public: // instance variables
   gctools::Vec0<TermType>	_Terms;
   gctools::Vec0<TermType>	_BeyondThresholdTerms;
+  /*! Structure-of-arrays copy of _Terms that evaluateAllComponent runs over.
+      The entries are sorted by their four coordinate indexes so the terms of a
+      dihedral with several multiplicities are adjacent, and _CompiledTermIndex
+      maps each one back to the _Terms entry that holds its atoms for reporting.
+      Terms [_CompiledGroupStart[g],_CompiledGroupStart[g+1]) share one atom quadruple
+      and are evaluated together from one dihedral geometry.
+      compileTerms rebuilds them whenever _CompiledTermsValid is false. */
+  bool                          _CompiledTermsValid;
+  core::SimpleVector_float_sp   _CompiledSinPhase;
+  core::SimpleVector_float_sp   _CompiledCosPhase;
+  core::SimpleVector_float_sp   _CompiledV;
+  core::SimpleVector_float_sp   _CompiledDN;
+  core::SimpleVector_int32_t_sp _CompiledIN;
+  core::SimpleVector_int32_t_sp _CompiledI1;
+  core::SimpleVector_int32_t_sp _CompiledI2;
+  core::SimpleVector_int32_t_sp _CompiledI3;
+  core::SimpleVector_int32_t_sp _CompiledI4;
+  core::SimpleVector_int32_t_sp _CompiledTermIndex;
+  core::SimpleVector_int32_t_sp _CompiledGroupStart;
 
 public:	// Creation class functions
   typedef gctools::Vec0<TermType>::iterator iterator;
@@ -207,6 +226,11 @@ public:
 
 public:
   void addTerm(const TermType& term);
+  void invalidateCompiledTerms() { this->_CompiledTermsValid = false; };
+  void compileTerms();
+  void ensureCompiledTerms() {
+    if (!this->_CompiledTermsValid || this->_CompiledTermIndex->length() != this->_Terms.size()) this->compileTerms();
+  };
   virtual void dumpTerms(core::HashTable_sp atomTypes);
 
   CL_DEFMETHOD core::T_mv safe_amber_energy_dihedral_term(size_t index) {
@@ -245,9 +269,10 @@ public:
                                          core::T_sp activeAtomMask,
                                          core::T_sp debugInteractions );
 
+  size_t numberOfCompiledGroups() const { return this->_CompiledGroupStart->length()-1; };
   virtual double evaluateAllComponentSingle(
-      gctools::Vec0<EnergyDihedral>::iterator di_start,
-      gctools::Vec0<EnergyDihedral>::iterator di_end,
+      size_t groupStart,
+      size_t groupEnd,
       ScoringFunction_sp scorer,
       NVector_sp 	pos,
       bool 		calcForce,
@@ -262,46 +287,28 @@ public:
 
 #ifndef _TARGET_OS_DARWIN
   virtual double evaluateAllComponentSimd8(
-      gctools::Vec0<EnergyDihedral>::iterator di_start8,
-      gctools::Vec0<EnergyDihedral>::iterator di_end8,
-      ScoringFunction_sp scorer,
+      size_t groupStart,
+      size_t groupEnd,
       NVector_sp 	pos,
       bool 		calcForce,
       gc::Nilable<NVector_sp> 	force,
-      bool		calcDiagonalHessian,
-      bool		calcOffDiagonalHessian,
-      gc::Nilable<AbstractLargeSquareMatrix_sp>	hessian,
-      gc::Nilable<NVector_sp>	hdvec,
-      gc::Nilable<NVector_sp> dvec,
-      core::T_sp activeAtomMask );
+      bool&             linear );
 
   virtual double evaluateAllComponentSimd4(
-      gctools::Vec0<EnergyDihedral>::iterator di_start4,
-      gctools::Vec0<EnergyDihedral>::iterator di_end4,
-      ScoringFunction_sp scorer,
+      size_t groupStart,
+      size_t groupEnd,
       NVector_sp 	pos,
       bool 		calcForce,
       gc::Nilable<NVector_sp> 	force,
-      bool		calcDiagonalHessian,
-      bool		calcOffDiagonalHessian,
-      gc::Nilable<AbstractLargeSquareMatrix_sp>	hessian,
-      gc::Nilable<NVector_sp>	hdvec,
-      gc::Nilable<NVector_sp> dvec,
-      core::T_sp activeAtomMask );
+      bool&             linear );
 
   virtual double evaluateAllComponentSimd2(
-      gctools::Vec0<EnergyDihedral>::iterator di_start2,
-      gctools::Vec0<EnergyDihedral>::iterator di_end2,
-      ScoringFunction_sp scorer,
+      size_t groupStart,
+      size_t groupEnd,
       NVector_sp 	pos,
       bool 		calcForce,
       gc::Nilable<NVector_sp> 	force,
-      bool		calcDiagonalHessian,
-      bool		calcOffDiagonalHessian,
-      gc::Nilable<AbstractLargeSquareMatrix_sp>	hessian,
-      gc::Nilable<NVector_sp>	hdvec,
-      gc::Nilable<NVector_sp> dvec,
-      core::T_sp activeAtomMask );
+      bool&             linear );
 #endif
 
   
@@ -321,7 +328,7 @@ public:
 public:
   EnergyDihedral_O( const EnergyDihedral_O& ss ); //!< Copy constructor
 
-  EnergyDihedral_O() : EnergyComponent_O() {};
+  EnergyDihedral_O() : EnergyComponent_O(), _CompiledTermsValid(false) {};
 };
 
 
@@ -228,8 +228,10 @@ namespace chem {
 
     core::List_sp allEnergyComponents() const;
     
-    core::List_sp otherEnergyComponents() const;
-    void          pushOtherEnergyComponent(EnergyComponent_sp component);
+    CL_LISPIFY_NAME("energy-function-other-energy-components");
+    CL_DEFMETHOD core::List_sp otherEnergyComponents() const;
+    CL_LISPIFY_NAME("push-other-energy-component");
+    CL_DEFMETHOD void          pushOtherEnergyComponent(EnergyComponent_sp component);
 
 
     CL_DEFMETHOD bool hasMissingParameters();
@@ -244,6 +246,9 @@ namespace chem {
     /*! Disable debugging on all energy components
      */
     void	disableDebug();
+    /*! Set single precision evaluation on all energy components
+     */
+    void	setSinglePrecision(bool on);
 
     void	summarizeTerms();
     void	dumpTerms();
@@ -290,6 +295,27 @@ namespace chem {
                             gc::Nilable<NVector_sp> dvec,
                             core::T_sp activeAtomMask,
                             core::T_sp debugInteractions );
+    /*! Evaluate one component for evaluateAll and record its wall time and term counters */
+    double	evaluateComponentProfiled(EnergyComponent_sp component,
+                                          NVector_sp pos,
+                                          core::T_sp energyScale,
+                                          core::T_sp componentEnergy,
+                                          bool calcForce,
+                                          gc::Nilable<NVector_sp> force,
+                                          bool calcDiagonalHessian,
+                                          bool calcOffDiagonalHessian,
+                                          gc::Nilable<AbstractLargeSquareMatrix_sp>	hessian,
+                                          gc::Nilable<NVector_sp> hdvec,
+                                          gc::Nilable<NVector_sp> dvec,
+                                          core::T_sp activeAtomMask,
+                                          core::T_sp debugInteractions );
+    /*! Evaluate the energy and force of only the enabled components in components */
+    CL_LISPIFY_NAME("energy-function-evaluate-components");
+    CL_DEFMETHOD double evaluateComponentsEnergyForce(core::List_sp components, NVector_sp pos, gc::Nilable<NVector_sp> force, core::T_sp activeAtomMask);
+    CL_LISPIFY_NAME("energy-function-profile-reset");
+    CL_DEFMETHOD void profileReset();
+    CL_LISPIFY_NAME("energy-function-profile-snapshot");
+    CL_DEFMETHOD core::List_sp profileSnapshot();
 
     string	summarizeBeyondThresholdInteractionsAsString();
     string	summarizeEnergyAsString();
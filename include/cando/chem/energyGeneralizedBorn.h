@@ -0,0 +1,139 @@
+/*
+    File: energyGeneralizedBorn.h
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+
+
+/*
+ *	energyGeneralizedBorn.h
+ *
+ *	Generalized Born implicit solvent energy component
+ */
+
+#ifndef EnergyGeneralizedBorn_H  //[
+#define	EnergyGeneralizedBorn_H
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <clasp/core/common.h>
+#include <cando/chem/energyComponent.h>
+#include <cando/chem/energyGeneralizedBorn.fwd.h>
+
+
+namespace chem
+{
+
+/*! Intrinsic radius and screening factor used for the generalized Born radii of an element.
+ *  These are the same Bondi radii and screening factors that prepare-generalized-born
+ *  writes into Amber topology files. */
+double generalizedBornIntrinsicRadius(int atomicNumber);
+double generalizedBornScreen(int atomicNumber);
+
+FORWARD(EnergyFunction);
+
+/*! Polarization energy of the solute in a continuum solvent.
+ *
+ *  Effective Born radii are calculated from the pairwise descreening integrals of
+ *  Hawkins, Cramer and Truhlar and optionally rescaled as described by Onufriev, Bashford
+ *  and Case.  The energy is
+ *      -1/2 (1/eps_solute - 1/eps_solvent) sum_ij qi qj / fGB(rij,Ri,Rj)
+ *  over every pair of atoms including i=j and the excluded atoms of the nonbond component.
+ *  Charges and atomic numbers are shared with the EnergyNonbond_O of the energy-function
+ *  so the component must be added to an energy-function built with excluded atoms.
+ *  The Hessian and Hessian-vector products are finite differences of the analytic forces
+ *  so the component can be minimized with truncated Newton. */
+class EnergyGeneralizedBorn_O : public EnergyComponent_O
+{
+  LISP_CLASS(chem,ChemPkg,EnergyGeneralizedBorn_O,"EnergyGeneralizedBorn",EnergyComponent_O);
+public:
+  bool fieldsp() const { return true; };
+  void fields(core::Record_sp node);
+public: // virtual functions inherited from Object
+  void	initialize();
+public: // instance variables
+  NVector_sp        _IntrinsicRadii;
+  NVector_sp        _Screen;
+  core::Symbol_sp   _Model;           // :hct, :obc1 or :obc2
+  double            _Alpha;
+  double            _Beta;
+  double            _Gamma;
+  double            _Offset;          // subtracted from the intrinsic radii
+  double            _SoluteDielectric;
+  double            _SolventDielectric;
+  double            _Cutoff;          // 0.0 means every pair of atoms
+public:
+  static EnergyGeneralizedBorn_sp make(EnergyFunction_sp energyFunction, double cutoff, core::Symbol_sp model);
+public:
+  CL_DEFMETHOD virtual size_t numberOfTerms() { return this->_IntrinsicRadii.boundp() ? this->_IntrinsicRadii->length() : 0; };
+  virtual size_t profileTermCount();
+
+  CL_LISPIFY_NAME("energy-generalized-born-set-model");
+  CL_DEFMETHOD void setModel(core::Symbol_sp model);
+  CL_LISPIFY_NAME("energy-generalized-born-model");
+  CL_DEFMETHOD core::Symbol_sp model() const { return this->_Model; };
+  CL_LISPIFY_NAME("energy-generalized-born-set-cutoff");
+  CL_DEFMETHOD void setCutoff(double cutoff);
+  CL_LISPIFY_NAME("energy-generalized-born-cutoff");
+  CL_DEFMETHOD double cutoff() const { return this->_Cutoff; };
+  CL_LISPIFY_NAME("energy-generalized-born-set-dielectrics");
+  CL_DEFMETHOD void setDielectrics(double solute, double solvent);
+  CL_LISPIFY_NAME("energy-generalized-born-set-radii-and-screen");
+  CL_DEFMETHOD void setRadiiAndScreen(NVector_sp radii, NVector_sp screen);
+  CL_LISPIFY_NAME("energy-generalized-born-radii");
+  CL_DEFMETHOD NVector_sp bornRadii(NVector_sp pos);
+
+  virtual core::List_sp extract_vectors_as_alist() const;
+  virtual EnergyComponent_sp filterCopyComponent(core::T_sp keepInteractionFactory);
+
+  virtual double evaluateAllComponent( ScoringFunction_sp scorer,
+                                       NVector_sp 	pos,
+                                       core::T_sp energyScale,
+                                       core::T_sp componentEnergy,
+                                       bool 		calcForce,
+                                       gc::Nilable<NVector_sp> 	force,
+                                       bool		calcDiagonalHessian,
+                                       bool		calcOffDiagonalHessian,
+                                       gc::Nilable<AbstractLargeSquareMatrix_sp>	hessian,
+                                       gc::Nilable<NVector_sp>	hdvec,
+                                       gc::Nilable<NVector_sp> dvec,
+                                       core::T_sp activeAtomMask,
+                                       core::T_sp debugInteractions );
+
+  virtual	void	compareAnalyticalAndNumericalForceAndHessianTermByTerm(NVector_sp pos ) {IMPLEMENT_ME();};
+
+public:
+  EnergyGeneralizedBorn_O() :
+      _Model(nil<core::Symbol_O>()),
+      _Alpha(1.0),
+      _Beta(0.8),
+      _Gamma(4.85),
+      _Offset(0.09),
+      _SoluteDielectric(1.0),
+      _SolventDielectric(78.5),
+      _Cutoff(0.0)
+  {};
+};
+
+};
+
+#endif //]
@@ -191,6 +191,7 @@ class EnergyNonbond_O : public EnergyComponent_O
   // Excluded atom table
   core::SimpleVector_int32_t_sp   _NumberOfExcludedAtomIndexes;
   core::SimpleVector_int32_t_sp   _ExcludedAtomIndexes;
+  size_t _ExcludedPairs;           // pairs in _ExcludedAtomIndexes - counted when it is set
   size_t _InteractionsKept;
   size_t _InteractionsDiscarded;
  public:	
@@ -201,6 +202,8 @@ class EnergyNonbond_O : public EnergyComponent_O
  public:
   //core::List_sp termAtIndex(size_t index) const;
   virtual size_t numberOfTerms() { return this->_Terms.size();};
+  virtual size_t profileTermCount();
+  void countExcludedPairs();
  public:
 
   CL_DEFMETHOD core::SimpleVector_int32_t_sp number_excluded_atoms() const { return this->_NumberOfExcludedAtomIndexes;}
@@ -278,6 +281,7 @@ class EnergyNonbond_O : public EnergyComponent_O
   EnergyNonbond_O() :
       _UsesExcludedAtoms(true),
       _FFNonbondDb(nil<core::T_O>()),
+      _ExcludedPairs(0),
       _InteractionsKept(0),
       _InteractionsDiscarded(0)
   {};
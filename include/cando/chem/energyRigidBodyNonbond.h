@@ -154,6 +154,8 @@ public:
   double		_ScaleElectrostatic;
   double		_EnergyVdw;
   double		_EnergyElectrostatic;
+  //! When positive only sphere pairs closer than this are evaluated, see evaluateSpatiallyPruned
+  double		_SpatialCutoff;
   core::SimpleVector_byte32_t_sp    _RigidBodyEndAtom;
   gctools::Vec0<RigidBodyAtomInfo>  _AtomInfoTable;
   size_t               _NumberOfTypes;
@@ -169,6 +171,11 @@ public:
   void	setElectrostaticScale(double d) { this->_ScaleElectrostatic = d; };
   double	getElectrostaticScale()	{return this->_ScaleElectrostatic; };
 
+  CL_LISPIFY_NAME("energy-rigid-body-nonbond-set-spatial-cutoff");
+  CL_DEFMETHOD void	setSpatialCutoff(double d) { this->_SpatialCutoff = d; };
+  CL_LISPIFY_NAME("energy-rigid-body-nonbond-spatial-cutoff");
+  CL_DEFMETHOD double	getSpatialCutoff() { return this->_SpatialCutoff; };
+
   double	getVdwEnergy() { return this->_EnergyVdw; };
   double	getElectrostaticEnergy() { return this->_EnergyElectrostatic; };
   void resizeNonbondAtomInfoTable(size_t index) { this->_AtomInfoTable.resize(index); };
@@ -196,6 +203,13 @@ public:
                                          core::T_sp debugInteractions );
 
 
+  double evaluateSpatiallyPruned( NVector_sp pos,
+                                  const Vector3& widths,
+                                  const Vector3& rwidths,
+                                  num_real electrostaticScale,
+                                  bool calcForce,
+                                  gc::Nilable<NVector_sp> force );
+
   virtual	void	compareAnalyticalAndNumericalForceAndHessianTermByTerm(
                                                                                NVector_sp pos );
 
@@ -210,7 +224,7 @@ public:
   core::ComplexVector_sp write_nonbond_atoms_to_complex_vector(core::ComplexVector_sp parts);
   size_t number_of_nonbond_atoms() const;
  public:
- EnergyRigidBodyNonbond_O(core::SimpleVector_byte32_t_sp end_atoms) : _RigidBodyEndAtom(end_atoms) {
+ EnergyRigidBodyNonbond_O(core::SimpleVector_byte32_t_sp end_atoms) : _SpatialCutoff(0.0), _RigidBodyEndAtom(end_atoms) {
     this->resizeNonbondAtomInfoTable((*end_atoms)[end_atoms->length()-1]);
   }
 };
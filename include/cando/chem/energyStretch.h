@@ -160,6 +160,16 @@ public:
 public: // instance variables
     gctools::Vec0<TermType>	_Terms;
     gctools::Vec0<TermType>	_BeyondThresholdTerms;
+    /*! Structure-of-arrays copy of _Terms that evaluateAllComponent runs over.
+        The entries are sorted by coordinate index and _CompiledTermIndex maps each
+        one back to the _Terms entry that holds its atoms for reporting.
+        compileTerms rebuilds them whenever _CompiledTermsValid is false. */
+    bool                          _CompiledTermsValid;
+    core::SimpleVector_float_sp   _CompiledKb;
+    core::SimpleVector_float_sp   _CompiledR0;
+    core::SimpleVector_int32_t_sp _CompiledI1;
+    core::SimpleVector_int32_t_sp _CompiledI2;
+    core::SimpleVector_int32_t_sp _CompiledTermIndex;
 public:	
     typedef gctools::Vec0<TermType>::iterator iterator;
     iterator begin() { return this->_Terms.begin(); };
@@ -168,6 +178,11 @@ public:
 public:
     virtual size_t numberOfTerms() { return this->_Terms.size();};
     void addTerm(const TermType& term);
+    void invalidateCompiledTerms() { this->_CompiledTermsValid = false; };
+    void compileTerms();
+    void ensureCompiledTerms() {
+      if (!this->_CompiledTermsValid || this->_CompiledTermIndex->length() != this->_Terms.size()) this->compileTerms();
+    };
     virtual void dumpTerms(core::HashTable_sp atomTypes);
 
     CL_DEFMETHOD core::T_mv safe_amber_energy_stretch_term(size_t index) {
@@ -225,7 +240,7 @@ public:
 public:
     EnergyStretch_O( const EnergyStretch_O& ss ); //!< Copy constructor
 
-  EnergyStretch_O() : EnergyComponent_O() {};
+  EnergyStretch_O() : EnergyComponent_O(), _CompiledTermsValid(false) {};
 };
 
 };
@@ -50,6 +50,7 @@ This is an open source license for the CANDO software from Temple University, bu
 #include <cando/chem/atom.h>
 #include <cando/chem/residue.h>
 #include <cando/chem/chemInfo.h>
+#include <cando/chem/chemInfoMatcher.h>
 #include <cando/chem/ffBaseDb.h>
 
 
@@ -73,12 +74,15 @@ public:
 public:
   Root_sp        _Test;
   core::T_sp     _Type;
+  core::T_sp     _Compiled;  // unbound until the first match, nil if _Test can't be compiled
 public:
   string __repr__() const;
-  FFTypeRule_O(Root_sp test, core::T_sp type) : _Test(test), _Type(type) {};
-  FFTypeRule_O() : _Test(unbound<Root_O>()), _Type(nil<core::T_O>()) {};
+  FFTypeRule_O(Root_sp test, core::T_sp type) : _Test(test), _Type(type), _Compiled(unbound<core::T_O>()) {};
+  FFTypeRule_O() : _Test(unbound<Root_O>()), _Type(nil<core::T_O>()), _Compiled(unbound<core::T_O>()) {};
   Root_sp getTest() const;
   core::T_sp getType() const;
+  /*! Match the rule against atom with the compiled matcher */
+  bool matches(Atom_sp atom, MoleculeInvariants_sp invariants);
 };
   
 
@@ -124,6 +128,9 @@ CL_DEFMETHOD     int	numberOfRules() { return this->_TypeAssignmentRules.size();
     
   core::HashTable_sp assignTypes( chem::Matter_sp matter, core::HashTable_sp atom_types );
   core::Symbol_sp    assignType( chem::Atom_sp atom );
+  /*! Like assignType but the rules are matched with the compiled matcher against
+      invariants that are made once for all of the atoms being typed */
+  core::T_sp         assignTypeUsingInvariants( chem::Atom_sp atom, MoleculeInvariants_sp invariants );
     void	initialize();
 
     DEFAULT_CTOR_DTOR(FFTypesDb_O);
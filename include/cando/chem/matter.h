@@ -137,6 +137,8 @@ protected:
  public:
 	/*! Adjust the size of the contents array */
   void resizeContents(int sz);
+	/*! Make room for sz children without changing the contents */
+  void reserveContents(size_t sz) { this->_Contents.reserve(sz); };
 	/*! Put a child at a particular content index */
   void putMatter( int index, Matter_sp matter );
 
@@ -0,0 +1,115 @@
+/*
+    File: matterGraph.h
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+
+
+/*
+ *	matterGraph.h
+ *
+ *	An immutable compressed sparse row snapshot of the bonds of a molecule or aggregate
+ */
+
+#ifndef MatterGraph_H
+#define	MatterGraph_H
+
+#include <vector>
+#include <clasp/core/common.h>
+#include <clasp/core/hashTableEq.h>
+#include <cando/chem/chemPackage.h>
+#include <cando/chem/bond.fwd.h>
+
+namespace       chem
+{
+
+FORWARD(Atom);
+FORWARD(Matter);
+
+/*! The bond graph of a Matter_O taken once so that graph algorithms walk flat arrays
+ *  instead of the Bond_O objects of every atom.
+ *
+ *  Atoms get dense indices 0..N-1 in the order of a Loop over the atoms of the matter.
+ *  The neighbors of atom i are _Neighbors[_NeighborStart[i],_NeighborStart[i+1]) and the
+ *  bond order of each half edge is in _BondOrders at the same position.  Bonds to atoms
+ *  outside of the matter (or to hydrogens or virtual atoms when they are excluded) are left out.
+ *  The snapshot does not follow later changes to the bonds - make a new one. */
+SMART(MatterGraph);
+class MatterGraph_O : public core::CxxObject_O
+{
+  LISP_CLASS(chem,ChemPkg,MatterGraph_O,"MatterGraph",core::CxxObject_O);
+public:
+  gctools::Vec0<Atom_sp>  _Atoms;
+  core::HashTableEq_sp    _AtomToIndex;
+  gctools::Vec0<uint32_t> _NeighborStart;   // size is the number of atoms + 1
+  gctools::Vec0<uint32_t> _Neighbors;
+  gctools::Vec0<uint8_t>  _BondOrders;      // a BondOrder for every half edge
+  gctools::Vec0<uint8_t>  _AtomicNumbers;
+public:
+  static MatterGraph_sp make(Matter_sp matter, bool excludeHydrogens, bool excludeVirtualAtoms);
+public:
+  CL_LISPIFY_NAME("matter-graph-number-of-atoms");
+  CL_DEFMETHOD size_t numberOfAtoms() const { return this->_Atoms.size(); };
+  CL_LISPIFY_NAME("matter-graph-number-of-bonds");
+  CL_DEFMETHOD size_t numberOfBonds() const { return this->_Neighbors.size()/2; };
+  CL_LISPIFY_NAME("matter-graph-atom");
+  CL_DEFMETHOD Atom_sp atom(size_t index) const;
+  CL_LISPIFY_NAME("matter-graph-atom-index");
+  CL_DEFMETHOD core::T_sp atomIndex(Atom_sp atom) const;
+  CL_LISPIFY_NAME("matter-graph-atomic-number");
+  CL_DEFMETHOD int atomicNumber(size_t index) const;
+  CL_LISPIFY_NAME("matter-graph-neighbors");
+  CL_DEFMETHOD core::List_sp neighborsAsList(size_t index) const;
+  CL_LISPIFY_NAME("matter-graph-map-bonds");
+  CL_DEFMETHOD void mapBonds(core::T_sp function) const;
+  CL_LISPIFY_NAME("matter-graph-connected-components");
+  CL_DEFMETHOD core::T_mv connectedComponentsAsVector() const;
+  CL_LISPIFY_NAME("matter-graph-distances");
+  CL_DEFMETHOD core::SimpleVector_int32_t_sp distancesAsVector(size_t root) const;
+  CL_LISPIFY_NAME("matter-graph-spanning-tree");
+  CL_DEFMETHOD core::T_mv spanningTree(size_t root, core::T_sp maxDepth) const;
+  CL_LISPIFY_NAME("matter-graph-rings");
+  CL_DEFMETHOD core::List_sp rings(bool relevant) const;
+
+  size_t degree(size_t index) const { return this->_NeighborStart[index+1]-this->_NeighborStart[index]; };
+  const uint32_t* neighborsBegin(size_t index) const { return this->_Neighbors.data()+this->_NeighborStart[index]; };
+  const uint32_t* neighborsEnd(size_t index) const { return this->_Neighbors.data()+this->_NeighborStart[index+1]; };
+  BondOrder bondOrder(size_t halfEdge) const { return (BondOrder)this->_BondOrders[halfEdge]; };
+  /*! 2 for a double bond, 3 for a triple bond and 1 for anything else */
+  int bondMultiplicity(size_t halfEdge) const {
+    BondOrder order = this->bondOrder(halfEdge);
+    return (order == doubleBond) ? 2 : (order == tripleBond) ? 3 : 1;
+  };
+  /*! Label every atom with the index of its connected component and return the number of components */
+  size_t connectedComponents(std::vector<uint32_t>& component) const;
+  /*! Breadth first search from root - distance is -1 for atoms that can't be reached.
+   *  order receives the atoms in the order they were reached and parent the atom each
+   *  was reached from (root is its own parent).  Atoms beyond maxDepth are not visited. */
+  void breadthFirst(size_t root, size_t maxDepth, std::vector<int32_t>& distance,
+                    std::vector<uint32_t>& order, std::vector<uint32_t>& parent) const;
+public:
+  MatterGraph_O() {};
+};
+
+};
+
+#endif
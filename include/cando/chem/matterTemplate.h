@@ -0,0 +1,100 @@
+/*
+    File: matterTemplate.h
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+
+
+/*
+ *	matterTemplate.h
+ *
+ *	Capture a molecule once and stamp out many copies of it
+ */
+
+#ifndef MatterTemplate_H
+#define	MatterTemplate_H
+
+#include <clasp/core/common.h>
+#include <cando/geom/vector3.h>
+#include <cando/geom/matrix.h>
+#include <cando/chem/chemPackage.h>
+#include <cando/chem/nVector.fwd.h>
+
+namespace       chem
+{
+
+FORWARD(Atom);
+FORWARD(Bond);
+FORWARD(Residue);
+FORWARD(Molecule);
+FORWARD(Aggregate);
+
+/*! A molecule flattened into arrays so that copies of it can be made without walking
+ *  the matter tree, building a new_to_old map or redirecting bonds.
+ *
+ *  The template keeps a private copy of the molecule.  The atoms of residue r are
+ *  _Atoms[_ResidueStart[r],_ResidueStart[r+1]) and bond b joins the atoms with indices
+ *  _BondAtoms[2*b] and _BondAtoms[2*b+1].  The bonds of atom i, in the order the prototype
+ *  atom lists them, are _AtomBonds[_AtomBondStart[i],_AtomBondStart[i+1]).  An instance copies every prototype object
+ *  shallowly and wires the bonds up from the index pairs.  Molecules with restraints
+ *  are instantiated with Molecule_O::copy because restraints have to be redirected. */
+SMART(MatterTemplate);
+class MatterTemplate_O : public core::CxxObject_O
+{
+  LISP_CLASS(chem,ChemPkg,MatterTemplate_O,"MatterTemplate",core::CxxObject_O);
+public:
+  Molecule_sp               _Molecule;
+  gctools::Vec0<Residue_sp> _Residues;
+  gctools::Vec0<uint32_t>   _ResidueStart;   // size is the number of residues + 1
+  gctools::Vec0<Atom_sp>    _Atoms;
+  gctools::Vec0<double>     _Coordinates;    // x,y,z of every atom - transformed to place the copies
+  gctools::Vec0<Bond_sp>    _Bonds;
+  gctools::Vec0<uint32_t>   _BondAtoms;      // two atom indices for every bond
+  gctools::Vec0<uint32_t>   _AtomBondStart;  // size is the number of atoms + 1
+  gctools::Vec0<uint32_t>   _AtomBonds;      // the bonds of every atom in their original order
+  bool                      _HasRestraints;
+public:
+  static MatterTemplate_sp make(Molecule_sp molecule);
+public:
+  CL_LISPIFY_NAME("matter-template-number-of-atoms");
+  CL_DEFMETHOD size_t numberOfAtoms() const { return this->_Atoms.size(); };
+  CL_LISPIFY_NAME("matter-template-number-of-residues");
+  CL_DEFMETHOD size_t numberOfResidues() const { return this->_Residues.size(); };
+  CL_LISPIFY_NAME("matter-template-number-of-bonds");
+  CL_DEFMETHOD size_t numberOfBonds() const { return this->_Bonds.size(); };
+  CL_LISPIFY_NAME("matter-template-instantiate");
+  CL_DEFMETHOD Molecule_sp instantiateWithTransform(core::T_sp transform) const;
+  CL_LISPIFY_NAME("matter-template-instantiate-into");
+  CL_DEFMETHOD core::List_sp instantiateInto(Aggregate_sp aggregate, core::T_sp placements) const;
+
+  /*! Make one copy.  If coordinates is not NULL it holds x,y,z for every atom in template
+   *  order, otherwise the template positions are used - moved by transform if it is not NULL. */
+  Molecule_sp instantiate(const Matrix* transform, const Vector_real* coordinates) const;
+  /*! Make one copy with the template positions moved by offset */
+  Molecule_sp instantiateTranslated(const Vector3& offset) const;
+public:
+  MatterTemplate_O() : _HasRestraints(false) {};
+};
+
+};
+
+#endif
@@ -141,6 +141,11 @@ struct RestartMinimizer {};
     double		_TruncatedNewtonTolerance;
     PreconditionerType	_TruncatedNewtonPreconditioner;
 
+    int			_NumberOfSinglePrecisionSteps;
+    double		_SinglePrecisionTolerance;
+
+    bool		_FiniteDifferenceHessianVectorProduct;
+
 	// status
     bool		_DebugOn;
     MinimizerLog_sp	_Log;
@@ -155,6 +160,7 @@ struct RestartMinimizer {};
     bool		_ShowElapsedTime;
     double		_MinGradientMean;
     double		_RMSForce;
+    bool		_QuietlyStopConjugateGradient; // Return rather than signal when CG runs out of steps or gets stuck
     NVector_sp		nvP1DSearchTemp1;
     NVector_sp		nvP1DSearchTemp2;
     NVector_sp		nvP1DSearchOrigin;
@@ -242,6 +248,14 @@ struct RestartMinimizer {};
 				  double rmsGradientTol,
                                   core::T_sp activeAtomMask,
                                   core::T_sp callback );
+        /*! Run conjugate gradients with the scoring function in single precision.
+         *  Running out of steps or getting stuck just ends the stage. */
+    void	_singlePrecisionConjugateGradient( int numSteps,
+                                                   NVector_sp p,
+                                                   core::T_sp energyScale,
+                                                   double rmsGradientTol,
+                                                   core::T_sp activeAtomMask,
+                                                   core::T_sp callback );
 
 
     void	_evaluateEnergyAndForceManyTimes( int numSteps,
@@ -283,8 +297,20 @@ struct RestartMinimizer {};
                                    NVector_sp			dj,
                                    NVector_sp			zj,
                                    NVector_sp			qj,
+                                   NVector_sp			xTemp,
+                                   NVector_sp			forceTemp,
                                    bool& failedInnerLoop,
                                    core::T_sp activeAtomMask );
+        /*! Put the product of the Hessian at xk with dj into qj.
+         *  force must be the force at xk, xTemp and forceTemp are scratch vectors. */
+    void _hessianVectorProduct( NVector_sp xk,
+                                core::T_sp energyScale,
+                                NVector_sp force,
+                                NVector_sp dj,
+                                NVector_sp qj,
+                                NVector_sp xTemp,
+                                NVector_sp forceTemp,
+                                core::T_sp activeAtomMask );
 
 
 
@@ -331,6 +357,17 @@ takes a single argument, the NVECTOR position of the atoms.)dx");
     CL_LISPIFY_NAME("setTruncatedNewtonTolerance");
     CL_DEFMETHOD 	void	setTruncatedNewtonTolerance(double m) {this->_TruncatedNewtonTolerance = m;};
     void	setTruncatedNewtonPreconditioner(PreconditionerType m) {this->_TruncatedNewtonPreconditioner = m;};
+    CL_LISPIFY_NAME("minimizer-set-single-precision");
+    CL_DOCSTRING(R"dx(Run up to steps conjugate gradient steps with the scoring function evaluated in single precision
+before the double precision stages.  The single precision stage stops when the rms force drops below
+tolerance, it runs out of steps or it stops making progress.  Set steps to 0 to turn it off.)dx");
+    CL_DEFMETHOD 	void	setSinglePrecision(int steps, double tolerance) {this->_NumberOfSinglePrecisionSteps = steps; this->_SinglePrecisionTolerance = tolerance;};
+    CL_LISPIFY_NAME("minimizer-set-finite-difference-hessian-vector-product");
+    CL_DOCSTRING(R"dx(When on is true the truncated Newton inner loop forms Hessian-vector products from
+a finite difference of forces rather than by evaluating the second derivatives of every term.
+Each product then costs one energy and force evaluation.  The preconditioner is always the
+sparse Hessian of the bonded terms and restraints.)dx");
+    CL_DEFMETHOD 	void	setFiniteDifferenceHessianVectorProduct(bool on) {this->_FiniteDifferenceHessianVectorProduct = on;};
 
 
     void	setEnergyFunction(ScoringFunction_sp ef);
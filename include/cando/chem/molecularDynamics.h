@@ -0,0 +1,204 @@
+/*
+    File: molecularDynamics.h
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+
+
+/*
+ *	molecularDynamics.h
+ *
+ *	Run molecular dynamics on a ScoringFunction
+ */
+
+#ifndef MolecularDynamics_H
+#define	MolecularDynamics_H
+
+#include <random>
+#include <vector>
+#include <clasp/core/common.h>
+#include <cando/chem/chemPackage.h>
+#include <cando/chem/nVector.h>
+#include <cando/chem/scoringFunction.h>
+#include <cando/chem/bondConstraints.h>
+#include <cando/chem/monteCarloBarostat.h>
+
+namespace       chem
+{
+
+/*! Integrate the equations of motion of the atoms of a ScoringFunction_O for many steps
+ *  without returning to Lisp.
+ *
+ *  Positions are in angstroms, time in picoseconds, energies in kcal/mol and masses in
+ *  atomic mass units.  The thermostat is one of
+ *    :langevin - the BAOAB splitting of Leimkuhler and Matthews with friction in 1/ps
+ *    :andersen - velocity verlet with velocities resampled at the collision frequency in 1/ps
+ *    :none     - velocity verlet at constant energy
+ *  Frozen atoms (those not set in the unfrozen bit vector) never move.
+ *  With BondConstraints_O the positions are constrained with SHAKE/SETTLE after every drift
+ *  and the velocities with RATTLE after every kick and thermostat update.
+ *  With r-RESPA levels (Tuckerman, Berne and Martyna) the components of an EnergyFunction_O are
+ *  split into levels from cheap (innermost) to expensive (outermost) and each level is
+ *  evaluated substeps times less often than the level inside it.  The timestep is the outer
+ *  timestep and the thermostat acts at the innermost level.
+ *  With a MonteCarloBarostat_O a volume move is attempted every frequency steps for
+ *  constant pressure dynamics in a periodic box.
+ *  Reporters are called every stride steps and the trajectory sinks are vectors with
+ *  fill pointers that frames are pushed onto. */
+SMART(MolecularDynamics);
+class MolecularDynamics_O : public core::CxxObject_O
+{
+  LISP_CLASS(chem,ChemPkg,MolecularDynamics_O,"MolecularDynamics",core::CxxObject_O);
+public:
+  bool fieldsp() const { return true; };
+  void fields(core::Record_sp node);
+public:
+  ScoringFunction_sp  _ScoringFunction;
+  NVector_sp          _Position;
+  NVector_sp          _Velocity;
+  NVector_sp          _Force;
+  NVector_sp          _Masses;
+  NVector_sp          _InverseMasses;     // zero for frozen atoms
+  core::T_sp          _Unfrozen;          // nil or a simple-bit-vector
+  core::Symbol_sp     _Thermostat;
+  double              _Timestep;
+  double              _Temperature;
+  double              _Friction;
+  double              _CollisionFrequency;
+  size_t              _Seed;
+  size_t              _Step;
+  double              _PotentialEnergy;
+  core::List_sp       _Reporters;         // list of (stride . function)
+  size_t              _TrajectoryStride;
+  core::T_sp          _CoordinateSink;
+  core::T_sp          _EnergySink;
+  core::T_sp          _Constraints;       // nil or a BondConstraints
+  NVector_sp          _Reference;         // positions before a drift - used by SHAKE
+  core::List_sp       _RespaLevels;       // nil or lists of components - innermost first
+  core::List_sp       _RespaSubsteps;     // steps of the level inside each level
+  core::List_sp       _RespaForces;       // the force of each level
+  core::T_sp          _Barostat;          // nil or a MonteCarloBarostat
+  dont_expose<std::mt19937_64> _Rng;      // Not saved - reseeded from _Seed
+public:
+  static MolecularDynamics_sp make(ScoringFunction_sp scoringFunction,
+                                   core::T_sp masses,
+                                   double timestep,
+                                   double temperature,
+                                   core::Symbol_sp thermostat,
+                                   double friction,
+                                   double collisionFrequency,
+                                   size_t seed,
+                                   core::T_sp unfrozen);
+public:
+  void setUnfrozen(core::T_sp unfrozen);
+  void setThermostat(core::Symbol_sp thermostat);
+  CL_LISPIFY_NAME("molecular-dynamics-set-temperature");
+  CL_DEFMETHOD void setTemperature(double temperature);
+  CL_LISPIFY_NAME("molecular-dynamics-set-seed");
+  CL_DEFMETHOD void setSeed(size_t seed);
+  CL_LISPIFY_NAME("molecular-dynamics-initialize-velocities");
+  CL_DEFMETHOD void initializeVelocities(core::T_sp temperature);
+  CL_LISPIFY_NAME("molecular-dynamics-add-reporter");
+  CL_DEFMETHOD void addReporter(size_t stride, core::T_sp function);
+  CL_LISPIFY_NAME("molecular-dynamics-set-trajectory");
+  CL_DEFMETHOD void setTrajectory(size_t stride, core::T_sp coordinates, core::T_sp energies);
+  CL_LISPIFY_NAME("molecular-dynamics-set-constraints");
+  CL_DEFMETHOD void setConstraints(core::T_sp constraints);
+  CL_LISPIFY_NAME("molecular-dynamics-constraints");
+  CL_DEFMETHOD core::T_sp constraints() const { return this->_Constraints; };
+  CL_LISPIFY_NAME("molecular-dynamics-set-respa");
+  CL_DEFMETHOD void setRespa(core::List_sp levels, core::T_sp substeps);
+  CL_LISPIFY_NAME("molecular-dynamics-respa-levels");
+  CL_DEFMETHOD core::List_sp respaLevels() const { return this->_RespaLevels; };
+  CL_LISPIFY_NAME("molecular-dynamics-set-barostat");
+  CL_DEFMETHOD void setBarostat(core::T_sp barostat);
+  CL_LISPIFY_NAME("molecular-dynamics-barostat");
+  CL_DEFMETHOD core::T_sp barostat() const { return this->_Barostat; };
+  CL_LISPIFY_NAME("molecular-dynamics-run");
+  CL_DEFMETHOD double run(size_t steps);
+  CL_LISPIFY_NAME("molecular-dynamics-save-coordinates");
+  CL_DEFMETHOD void saveCoordinates();
+
+  CL_LISPIFY_NAME("molecular-dynamics-step");
+  CL_DEFMETHOD size_t step() const { return this->_Step; };
+  CL_LISPIFY_NAME("molecular-dynamics-time");
+  CL_DEFMETHOD double time() const { return this->_Step*this->_Timestep; };
+  CL_LISPIFY_NAME("molecular-dynamics-potential-energy");
+  CL_DEFMETHOD double potentialEnergy() const { return this->_PotentialEnergy; };
+  CL_LISPIFY_NAME("molecular-dynamics-kinetic-energy");
+  CL_DEFMETHOD double kineticEnergy() const;
+  CL_LISPIFY_NAME("molecular-dynamics-degrees-of-freedom");
+  CL_DEFMETHOD size_t degreesOfFreedom() const;
+  CL_LISPIFY_NAME("molecular-dynamics-temperature");
+  CL_DEFMETHOD double temperature() const;
+  CL_LISPIFY_NAME("molecular-dynamics-position");
+  CL_DEFMETHOD NVector_sp position() const { return this->_Position; };
+  CL_LISPIFY_NAME("molecular-dynamics-velocity");
+  CL_DEFMETHOD NVector_sp velocity() const { return this->_Velocity; };
+  CL_LISPIFY_NAME("molecular-dynamics-scoring-function");
+  CL_DEFMETHOD ScoringFunction_sp scoringFunction() const { return this->_ScoringFunction; };
+private:
+  struct RespaLevel {
+    core::List_sp _Components;
+    size_t        _Substeps;
+    NVector_sp    _Force;
+    double        _Energy;
+  };
+  double evaluateForce();
+  double evaluateRespaLevels();
+  void kick(NVector_sp force, double dt);
+  void drift(double dt);
+  void ornsteinUhlenbeck(double dt);
+  void constrainVelocities();
+  bool conservesMomentum() const;
+  void langevinStep();
+  void verletStep();
+  void respaStep(std::vector<RespaLevel>& levels, size_t level, double dt, bool langevin);
+  void barostatStep();
+  void andersenCollisions();
+  void report();
+public:
+  MolecularDynamics_O() :
+      _Unfrozen(nil<core::T_O>()),
+      _Thermostat(nil<core::Symbol_O>()),
+      _Timestep(0.001),
+      _Temperature(300.0),
+      _Friction(1.0),
+      _CollisionFrequency(10.0),
+      _Seed(0),
+      _Step(0),
+      _PotentialEnergy(0.0),
+      _Reporters(nil<core::T_O>()),
+      _TrajectoryStride(0),
+      _CoordinateSink(nil<core::T_O>()),
+      _EnergySink(nil<core::T_O>()),
+      _Constraints(nil<core::T_O>()),
+      _RespaLevels(nil<core::T_O>()),
+      _RespaSubsteps(nil<core::T_O>()),
+      _RespaForces(nil<core::T_O>()),
+      _Barostat(nil<core::T_O>())
+  {};
+};
+
+};
+
+#endif
@@ -0,0 +1,122 @@
+/*
+    File: monteCarloBarostat.h
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+
+
+/*
+ *	monteCarloBarostat.h
+ *
+ *	Monte Carlo volume moves for constant pressure dynamics in a periodic box
+ */
+
+#ifndef MonteCarloBarostat_H
+#define	MonteCarloBarostat_H
+
+#include <random>
+#include <clasp/core/common.h>
+#include <cando/chem/chemPackage.h>
+#include <cando/chem/nVector.h>
+
+namespace       chem
+{
+
+FORWARD(EnergyFunction);
+
+/*! A Monte Carlo barostat for an EnergyFunction_O with a cuboid bounding box.
+ *
+ *  Every attempt picks a random volume change, scales the box (all three widths for
+ *  :isotropic, one random width for :anisotropic) and moves the center of every molecule
+ *  with it.  Each molecule moves rigidly so only the energy between molecules changes.  That
+ *  is the energy of the components in _Components - every component except stretch, angle
+ *  and dihedral - and it is evaluated without forces.  The move is accepted with the
+ *  probability min(1,exp(-(dE + P dV - N kT ln(V'/V))/kT)) where N is the number of molecules.
+ *  A move that would make a width of the box no more than twice the nonbond cutoff is
+ *  rejected without evaluating it, so the minimum image convention always holds.
+ *  The largest volume change adapts to keep the acceptance between 25% and 75%. */
+SMART(MonteCarloBarostat);
+class MonteCarloBarostat_O : public core::CxxObject_O
+{
+  LISP_CLASS(chem,ChemPkg,MonteCarloBarostat_O,"MonteCarloBarostat",core::CxxObject_O);
+public:
+  bool fieldsp() const { return true; };
+  void fields(core::Record_sp node);
+public:
+  EnergyFunction_sp             _EnergyFunction;
+  core::List_sp                 _Components;      // components that change when molecules move apart
+  core::SimpleVector_int32_t_sp _MoleculeStart;   // atoms of molecule i are _MoleculeAtoms[start[i],start[i+1])
+  core::SimpleVector_int32_t_sp _MoleculeAtoms;
+  double                        _Pressure;        // bar
+  size_t                        _Frequency;       // steps between attempts
+  core::Symbol_sp               _Mode;            // :isotropic or :anisotropic
+  double                        _VolumeScale;     // largest volume change in cubic angstroms
+  double                        _Cutoff;          // nonbond cutoff - every width must stay above twice it
+  size_t                        _Attempts;        // since the volume scale was last adapted
+  size_t                        _Accepted;
+  size_t                        _TotalAttempts;
+  size_t                        _TotalAccepted;
+public:
+  static MonteCarloBarostat_sp make(EnergyFunction_sp energyFunction, double pressure, size_t frequency, core::Symbol_sp mode, core::T_sp volumeScale, core::T_sp cutoff);
+public:
+  CL_LISPIFY_NAME("monte-carlo-barostat-set-pressure");
+  CL_DEFMETHOD void setPressure(double pressure);
+  CL_LISPIFY_NAME("monte-carlo-barostat-pressure");
+  CL_DEFMETHOD double pressure() const { return this->_Pressure; };
+  CL_LISPIFY_NAME("monte-carlo-barostat-cutoff");
+  CL_DEFMETHOD double cutoff() const { return this->_Cutoff; };
+  CL_LISPIFY_NAME("monte-carlo-barostat-frequency");
+  CL_DEFMETHOD size_t frequency() const { return this->_Frequency; };
+  CL_LISPIFY_NAME("monte-carlo-barostat-number-of-molecules");
+  CL_DEFMETHOD size_t numberOfMolecules() const { return this->_MoleculeStart->length()-1; };
+  CL_LISPIFY_NAME("monte-carlo-barostat-volume");
+  CL_DEFMETHOD double volume() const;
+  CL_LISPIFY_NAME("monte-carlo-barostat-acceptance");
+  CL_DEFMETHOD core::T_mv acceptance() const;
+
+  /*! Attempt one volume move of the coordinates pos at the temperature kT (kcal/mol).
+   *  Return true if it was accepted - pos and the bounding box of the energy-function are
+   *  then changed and the caller must recalculate forces. */
+  bool attempt(NVector_sp pos, core::T_sp activeAtomMask, double kT, std::mt19937_64& rng);
+  CL_LISPIFY_NAME("monte-carlo-barostat-attempt");
+  CL_DEFMETHOD bool attemptWithSeed(NVector_sp pos, double temperature, size_t seed, core::T_sp activeAtomMask);
+private:
+  bool minimumImage(double xWidth, double yWidth, double zWidth) const;
+  void scaleBox(NVector_sp pos, double sx, double sy, double sz);
+public:
+  MonteCarloBarostat_O() :
+      _Components(nil<core::T_O>()),
+      _Pressure(1.0),
+      _Frequency(25),
+      _Mode(nil<core::Symbol_O>()),
+      _VolumeScale(0.0),
+      _Cutoff(0.0),
+      _Attempts(0),
+      _Accepted(0),
+      _TotalAttempts(0),
+      _TotalAccepted(0)
+  {};
+};
+
+};
+
+#endif
@@ -56,6 +56,8 @@ public:
   int iAtoms;
   gctools::Vec0<Atom_sp> PaAtomList;
   gctools::Vec0<float> _PfCharges; /* float to save space */
+  gctools::Vec0<double> _PdCompOkCutDists; /* cut distances with cached solute exclusion tests - not saved */
+  gctools::Vec0<char> _PcCompOk;    /* the tests of every point for each of _PdCompOkCutDists in turn - not saved */
   OctNode_sp PonChildren[8];
   OctNode_O()
       : iDepth(0), iAtoms(0),
@@ -102,6 +104,7 @@ public:
   core::HashTableEq_sp atomsToResidues;
   core::HashTableEq_sp residuesToMolecules;
   OctNode_sp onHead;
+  double _dChargeTreeTheta; /* opening angle of the far field approximation in OctreeInitCharges */
 
 public:
   static AddIonOctree_sp make(Aggregate_sp uUnit, AddIonOctreeEnum iType, double dGridSpace, double dAddExtent, double dShellExtent,
@@ -132,7 +135,10 @@ public:
   // static int OctNodeDeleteSphere( OctNode_sp PonNode );
   // static void OctNodeUpdateCharge( OctNode_sp *PonNode, int iParentAtoms, Atom_sp *PaParentAtoms );
   // static int OctNodeCheckSolvent( OctNode_sp PonNode );
-  void OctNodeInitCharges(OctNode_sp PonNode, int iDistanceCharge);
+  void OctNodeCollectIncluded(OctNode_sp PonNode, gctools::Vec0<OctNode_sp> &vaLeaves);
+  void OctNodeCollectIncludedWithAtoms(OctNode_sp PonNode, int iParentAtoms, gctools::Vec0<Atom_sp> &PaParentAtoms,
+                                       gctools::Vec0<OctNode_sp> &vaLeaves, std::vector<Vector3> &vAtomPositions,
+                                       std::vector<double> &dAtomTemps, std::vector<size_t> &iLeafAtomStart);
   void OctNodePrintGrid(OctNode_sp PonNode, int iColor);
   void SplitIncludedNode(OctNode_sp PonNode);
   int OctNodeDeleteSphere(OctNode_sp PonNode, double dDeleteRadius);
@@ -145,8 +151,9 @@ public:
   void OctreeDeleteSphere(/*AddIonOctree_sp octTree, */ Vector3 vPoint, double dRadius);
   core::T_mv OctreeUpdateCharge(/*AddIonOctree_sp octTree,*/ Vector3 vNewPoint, float fCharge, double dCutDist);
   core::T_sp rOctreeCheckSolvent(/*AddIonOctree_sp octTree,*/ Vector3 vPoint);
+  void setChargeTreeTheta(double theta);
 
-  AddIonOctree_O() : _BoundingBox(unbound<BoundingBox_O>()){};
+  AddIonOctree_O() : _BoundingBox(unbound<BoundingBox_O>()), _dChargeTreeTheta(0.5){};
   //  void OctreePrintGrid(AddIonOctree_sp octTree, core::T_sp stream, int iColor);
 };
 
@@ -0,0 +1,78 @@
+/*
+    File: ringPerception.h
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ 
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+/* -^- */
+
+//
+//	ringPerception.h
+//
+//      Smallest set of smallest rings (SSSR) and relevant cycles over a
+//      flat integer adjacency graph.
+//
+#ifndef RING_PERCEPTION_H
+#define RING_PERCEPTION_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace chem {
+
+/*! Ring perception over a graph with vertices 0..N-1.
+
+    Vertices that cannot be in a ring are stripped, the rest are split into
+    biconnected components and each component is searched with Vismara's
+    prototype/family construction - candidates come from shortest paths
+    out of every vertex (only through lower numbered vertices) and are
+    accepted by Gaussian elimination on packed edge bitsets.
+
+    The SSSR is a minimum cycle basis.  The relevant cycles are the union of
+    all minimum cycle bases - it is unique, unlike the SSSR. */
+class RingPerception {
+public:
+  typedef std::vector<size_t> Cycle; // vertices in ring order
+private:
+  size_t                           _NumVertices;
+  std::vector<std::vector<size_t>> _Adjacency;
+  size_t                           _MaximumFamilySize;
+  std::vector<Cycle>               _SSSR;
+  std::vector<Cycle>               _RelevantCycles;
+public:
+  RingPerception(size_t numVertices) : _NumVertices(numVertices), _Adjacency(numVertices), _MaximumFamilySize(1024) {};
+  void addEdge(size_t v1, size_t v2);
+  /*! Relevant cycle families can grow combinatorially in cage compounds - limit the size of each family */
+  void setMaximumFamilySize(size_t size) { this->_MaximumFamilySize = size; };
+  /*! Find the SSSR and, if relevant is true, the relevant cycles */
+  void perceive(bool relevant);
+  const std::vector<Cycle>& sssr() const { return this->_SSSR; };
+  const std::vector<Cycle>& relevantCycles() const { return this->_RelevantCycles; };
+private:
+  void stripAcyclic_(std::vector<bool>& alive) const;
+  void biconnectedComponents_(const std::vector<bool>& alive, std::vector<std::vector<std::pair<size_t,size_t>>>& components) const;
+  void perceiveComponent_(const std::vector<std::pair<size_t,size_t>>& edges, bool relevant);
+};
+
+};
+
+#endif
@@ -182,6 +182,10 @@ public:
      */ 
   CL_LISPIFY_NAME("disableDebug");
   CL_DEFMETHOD virtual void	disableDebug() = 0;
+    /*! Evaluate the energy and force in single precision where the scoring function supports it.
+     */
+  CL_LISPIFY_NAME("scoring-function-set-single-precision");
+  CL_DEFMETHOD virtual void	setSinglePrecision(bool on) {};
 
 
 //    virtual void	summarizeTerms() = 0;
@@ -0,0 +1,104 @@
+/*
+    File: sdfFile.h
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+
+
+/*
+ *	sdfFile.h
+ *
+ *	Memory mapped, indexed reader and buffered writer for MDL SD files
+ */
+
+#ifndef SdfFile_H
+#define	SdfFile_H
+
+#include <string>
+#include <vector>
+#include <clasp/core/common.h>
+#include <cando/chem/chemPackage.h>
+
+namespace       chem
+{
+
+FORWARD(Molecule);
+
+/*! One connection table pulled out of an SD file record as plain data so that records can
+ *  be parsed on threads that don't touch Lisp objects.  Atom indices are 0 based. */
+struct SdfRecord {
+  std::string               _Name;
+  std::vector<std::string>  _Symbols;
+  std::vector<uint8_t>      _AtomicNumbers;   // 0 for labels that aren't elements ("R#", "A", "*" ...)
+  std::vector<double>       _Coordinates;     // x,y,z of every atom
+  std::vector<int8_t>       _Charges;
+  std::vector<uint32_t>     _Bonds;           // atom1, atom2 for every bond
+  std::vector<uint8_t>      _BondOrders;      // MDL bond type 1,2,3 or 4 (aromatic)
+  std::vector<std::pair<std::string,std::string>> _Data;
+  std::string               _Error;           // set instead of signaling when the record can't be parsed
+};
+
+/*! An SD file (V2000 or V3000 records separated by $$$$ lines) mapped into memory.
+ *  The record boundaries are found once when the file is opened so any record can be
+ *  read by number.  The bytes of record i are [_RecordStart[i],_RecordStart[i+1]). */
+SMART(SdfFile);
+class SdfFile_O : public core::CxxObject_O
+{
+  LISP_CLASS(chem,ChemPkg,SdfFile_O,"SdfFile",core::CxxObject_O);
+public:
+  std::string             _Filename;
+  int                     _FileDescriptor;
+  const char*             _Data;
+  size_t                  _Size;
+  gctools::Vec0<uint64_t> _RecordStart;       // size is the number of records + 1
+public:
+  static SdfFile_sp make(const std::string& filename);
+public:
+  CL_LISPIFY_NAME("sdf-file-number-of-records");
+  CL_DEFMETHOD size_t numberOfRecords() const { return this->_RecordStart.size()-1; };
+  CL_LISPIFY_NAME("sdf-file-filename");
+  CL_DEFMETHOD std::string filename() const { return this->_Filename; };
+  CL_LISPIFY_NAME("sdf-file-record-text");
+  CL_DEFMETHOD std::string recordText(size_t index) const;
+  CL_LISPIFY_NAME("sdf-file-read-molecule");
+  CL_DEFMETHOD Molecule_sp readMolecule(size_t index) const;
+  CL_LISPIFY_NAME("sdf-file-read-molecules");
+  CL_DEFMETHOD core::SimpleVector_sp readMolecules(size_t start, core::T_sp end) const;
+  CL_LISPIFY_NAME("sdf-file-read-arrays");
+  CL_DEFMETHOD core::T_mv readArrays(size_t start, core::T_sp end) const;
+  CL_LISPIFY_NAME("sdf-file-close");
+  CL_DEFMETHOD void close();
+
+  /*! Parse records [start,end) in parallel */
+  void parseRecords(size_t start, size_t end, std::vector<SdfRecord>& records) const;
+  size_t recordEnd(core::T_sp end) const;
+public:
+  SdfFile_O() : _FileDescriptor(-1), _Data(NULL), _Size(0) {};
+  virtual ~SdfFile_O();
+};
+
+/*! Parse the text of one SD file record into record. */
+void parse_sdf_record(const char* begin, const char* end, SdfRecord& record);
+
+};
+
+#endif
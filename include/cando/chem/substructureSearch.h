@@ -0,0 +1,75 @@
+/*
+    File: substructureSearch.h
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ 
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+/* -^- */
+
+//
+//	substructureSearch.h
+//
+//      Screen a library of molecules against a set of compiled chem-info
+//      patterns using hashed feature fingerprints.
+//
+#ifndef	SUBSTRUCTURE_SEARCH_H
+#define	SUBSTRUCTURE_SEARCH_H
+
+#include <clasp/core/common.h>
+#include <cando/chem/chemPackage.h>
+#include <cando/chem/chemInfoMatcher.h>
+
+
+namespace chem {
+
+/*! A fixed width hashed feature fingerprint.
+    Every feature set in the fingerprint of a pattern is guaranteed to be
+    set in the fingerprint of every molecule that the pattern matches - so
+    a pattern can only match a molecule if its bits are a subset. */
+struct Fingerprint {
+  static constexpr size_t Words = 16;
+  static constexpr size_t Bits = Words*64;
+  uint64_t _Words[Words];
+  Fingerprint() { for ( size_t ii=0; ii<Words; ++ii ) this->_Words[ii] = 0; };
+  void setFeature(uint64_t hash) { size_t bit = hash % Bits; this->_Words[bit/64] |= (1ull<<(bit%64)); };
+  bool subsetOf(const Fingerprint& other) const {
+    for ( size_t ii=0; ii<Words; ++ii ) {
+      if ((this->_Words[ii] & other._Words[ii]) != this->_Words[ii]) return false;
+    }
+    return true;
+  }
+  size_t count() const {
+    size_t cnt = 0;
+    for ( size_t ii=0; ii<Words; ++ii ) cnt += __builtin_popcountll(this->_Words[ii]);
+    return cnt;
+  }
+};
+
+/*! Fingerprint the atoms, element counts, bonds and two bond paths of a molecule */
+Fingerprint moleculeFingerprint(const MoleculeInvariants_O& invariants);
+
+/*! Fingerprint only what every match of the pattern must contain - vertices with a definite
+    element and edges with a definite bond type */
+Fingerprint patternFingerprint(const CompiledChemInfo_O& compiled);
+
+};
+
+#endif
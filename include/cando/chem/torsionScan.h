@@ -0,0 +1,119 @@
+/*
+    File: torsionScan.h
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+
+
+/*
+ *	torsionScan.h
+ *
+ *	Systematic enumeration of torsion angle combinations over a flattened torsion tree
+ */
+
+#ifndef TorsionScan_H
+#define	TorsionScan_H
+
+#include <vector>
+#include <clasp/core/common.h>
+#include <cando/chem/chemPackage.h>
+#include <cando/chem/matterGraph.h>
+
+namespace       chem
+{
+
+FORWARD(Atom);
+FORWARD(Matter);
+
+/*! Everything the enumeration needs as flat arrays outside of the Lisp heap so that it
+ *  can be read by threads that aren't known to the garbage collector.
+ *
+ *  Cutting the driven bonds splits the atoms into rigid fragments that form a tree.  The
+ *  largest fragment of each tree never moves.  Torsions are in depth first order of the
+ *  tree so the fragment moved by torsion i is placed once torsions 0..i have angles and
+ *  nothing placed before it moves again - a clash found at torsion i prunes every
+ *  combination of the torsions after it.  Each torsion's transform is its parent's
+ *  transform times the rotation for its angle about the fixed->moving bond in the
+ *  starting coordinates. */
+struct TorsionScanPlan {
+  double                _ClashDistance;
+  std::vector<double>   _Coordinates;      // starting x,y,z of every atom
+  std::vector<uint8_t>  _ClashAtom;        // 1 if the atom is checked for clashes
+  std::vector<uint32_t> _TorsionFixed;
+  std::vector<uint32_t> _TorsionMoving;
+  std::vector<int32_t>  _TorsionParent;    // -1 if the fixed atom is in a fragment that never moves
+  std::vector<uint32_t> _AngleStart;       // angles of torsion i are [_AngleStart[i],_AngleStart[i+1])
+  std::vector<double>   _AngleTransforms;  // 12 per angle - 3x3 rotation (row major) then translation
+  std::vector<uint32_t> _FragmentStart;    // atoms of the fragment moved by torsion i
+  std::vector<uint32_t> _FragmentAtoms;
+  std::vector<uint32_t> _ExcludedStart;    // sorted atoms within the bond separation of each atom
+  std::vector<uint32_t> _Excluded;
+  // Grid with cells of _ClashDistance holding the clash atoms that never move
+  double                _GridOrigin[3];
+  int32_t               _GridDimensions[3];
+  std::vector<uint32_t> _GridCellStart;
+  std::vector<uint32_t> _GridAtoms;
+
+  size_t numberOfAtoms() const { return this->_Coordinates.size()/3; };
+  size_t numberOfTorsions() const { return this->_TorsionFixed.size(); };
+  size_t numberOfAngles(size_t torsion) const { return this->_AngleStart[torsion+1]-this->_AngleStart[torsion]; };
+  void buildGrid(const std::vector<uint32_t>& fixedAtoms);
+  /*! Append the coordinates and angle indices of every combination that doesn't clash and
+   *  starts with the angle indices in prefix.  If resume isn't NULL start after the
+   *  combination with those angle indices.  Stop after limit combinations.
+   *  Returns the number of combinations appended. */
+  size_t enumerate(const std::vector<uint32_t>& prefix, const std::vector<int32_t>* resume, size_t limit,
+                   std::vector<double>& coordinates, std::vector<int32_t>& indices) const;
+};
+
+/*! Enumerate combinations of angles for a set of rotatable bonds of a molecule or aggregate.
+ *  The coordinates of the matter are read once when the scan is made. */
+SMART(TorsionScan);
+class TorsionScan_O : public core::CxxObject_O
+{
+  LISP_CLASS(chem,ChemPkg,TorsionScan_O,"TorsionScan",core::CxxObject_O);
+public:
+  Matter_sp               _Matter;
+  MatterGraph_sp          _Graph;            // the atoms and bonds - atom indices are graph indices
+  TorsionScanPlan         _Plan;
+public:
+  static TorsionScan_sp make(Matter_sp matter, core::List_sp torsions, double clashDistance, size_t bondSeparation, bool hydrogens);
+public:
+  CL_LISPIFY_NAME("torsion-scan-number-of-atoms");
+  CL_DEFMETHOD size_t numberOfAtoms() const { return this->_Graph->numberOfAtoms(); };
+  CL_LISPIFY_NAME("torsion-scan-number-of-torsions");
+  CL_DEFMETHOD size_t numberOfTorsions() const { return this->_Plan.numberOfTorsions(); };
+  CL_LISPIFY_NAME("torsion-scan-number-of-combinations");
+  CL_DEFMETHOD core::Integer_sp numberOfCombinations() const;
+  CL_LISPIFY_NAME("torsion-scan-atoms");
+  CL_DEFMETHOD core::SimpleVector_sp atomsAsVector() const;
+  CL_LISPIFY_NAME("torsion-scan-enumerate");
+  CL_DEFMETHOD core::T_mv enumerate(core::T_sp callback, size_t blockSize, core::T_sp maxConformations) const;
+  CL_LISPIFY_NAME("torsion-scan-set-positions");
+  CL_DEFMETHOD void setPositions(core::T_sp coordinates, size_t index) const;
+public:
+  TorsionScan_O() {};
+};
+
+};
+
+#endif
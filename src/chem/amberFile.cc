@@ -0,0 +1,338 @@
+/*
+    File: amberFile.cc
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+/* -^- */
+#define	DEBUG_LEVEL_NONE
+
+//
+// Fixed width Fortran formatted I/O for AMBER topology (prmtop) and
+// coordinate (inpcrd/rst7) files.
+// topology.lisp builds the sections and the energy function - the code here
+// does the per value formatting and parsing that dominates for large systems.
+//
+
+#include <fstream>
+#include <sstream>
+#include <clasp/core/common.h>
+#include <clasp/core/array.h>
+#include <clasp/core/symbolTable.h>
+#include <clasp/core/hashTableEqual.h>
+#include <cando/chem/nVector.h>
+#include <clasp/core/wrappers.h>
+
+namespace chem {
+
+// Write the formatted text to the stream in chunks of about this many characters
+#define FORTRAN_WRITE_CHUNK (1<<20)
+
+/*! Append one value formatted with the fmt style FORMAT ("{:8d}", "{:16.8e}", "{:<4s}" ...)
+ *  Integers are written as reals if the format is a real format.
+ */
+static void fortranFormatValue(std::string& out, const std::string& format, bool realFormat, core::T_sp value)
+{
+  try {
+    if (value.fixnump() && realFormat) {
+      double dval = value.unsafe_fixnum();
+      out += fmt::vformat(format,fmt::make_format_args(dval));
+    } else if (value.fixnump()) {
+      int64_t ival = value.unsafe_fixnum();
+      out += fmt::vformat(format,fmt::make_format_args(ival));
+    } else if (gc::IsA<core::Number_sp>(value)) {
+      double dval = core::clasp_to_double(gc::As_unsafe<core::Number_sp>(value));
+      out += fmt::vformat(format,fmt::make_format_args(dval));
+    } else if (gc::IsA<core::String_sp>(value)) {
+      std::string sval = gc::As_unsafe<core::String_sp>(value)->get_std_string();
+      out += fmt::vformat(format,fmt::make_format_args(sval));
+    } else if (gc::IsA<core::Symbol_sp>(value)) {
+      std::string sval = gc::As_unsafe<core::Symbol_sp>(value)->symbolNameAsString();
+      out += fmt::vformat(format,fmt::make_format_args(sval));
+    } else {
+      SIMPLE_ERROR("Cannot write {} to a fortran file", _rep_(value));
+    }
+  } catch (fmt::format_error& err) {
+    SIMPLE_ERROR("Could not format {} using {} - {}", _rep_(value), format, err.what());
+  }
+}
+
+CL_DOCSTRING(R"dx(Write the elements of the vectors in COLUMNS interleaved (row 0 of every column, then row 1 ...)
+to STREAM using the fmt style FORMAT with PER-LINE values on each line.
+NUMBER-ON-LINE is the number of values already on the current line. Return the number of values on the last line.
+All of the vectors must have the same length.)dx");
+CL_LAMBDA(stream per-line format columns number-on-line);
+DOCGROUP(cando);
+CL_DEFUN size_t chem__fortran_write_columns(core::T_sp stream, size_t perLine, const std::string& format, core::List_sp columns, size_t numberOnLine)
+{
+  if (perLine==0) SIMPLE_ERROR("per-line must be > 0");
+  std::vector<core::Array_sp> vectors;
+  for ( auto cur : columns ) {
+    core::Array_sp column = gc::As<core::Array_sp>(CONS_CAR(cur));
+    if (vectors.size()>0 && column->length()!=vectors[0]->length()) {
+      SIMPLE_ERROR("All columns must have the same length - {} and {}", vectors[0]->length(), column->length());
+    }
+    vectors.push_back(column);
+  }
+  if (vectors.size()==0) return numberOnLine;
+  size_t rows = vectors[0]->length();
+  char presentation = (format.size()>=2) ? format[format.size()-2] : ' ';
+  bool realFormat = (strchr("eEfFgG",presentation)!=NULL);
+  std::string out;
+  out.reserve(FORTRAN_WRITE_CHUNK+256);
+  for ( size_t row=0; row<rows; row++ ) {
+    for ( auto& column : vectors ) {
+      fortranFormatValue(out,format,realFormat,column->rowMajorAref(row));
+      if (++numberOnLine >= perLine) {
+        out += '\n';
+        numberOnLine = 0;
+      }
+    }
+    if (out.size()>=FORTRAN_WRITE_CHUNK) {
+      core::clasp_write_string(out,stream);
+      out.clear();
+    }
+  }
+  core::clasp_write_string(out,stream);
+  return numberOnLine;
+}
+
+/*! Parse a %FORMAT line like "%FORMAT(10I8)" or "%FORMAT(5E16.8)" */
+static void parseFortranFormat(const std::string& line, size_t& perLine, char& formatChar, size_t& width)
+{
+  size_t open = line.find('(');
+  size_t close = line.find(')',open);
+  if (open==std::string::npos || close==std::string::npos) {
+    SIMPLE_ERROR("Not a %FORMAT line -> {}", line);
+  }
+  std::string spec = line.substr(open+1,close-open-1);
+  size_t pos = 0;
+  while (pos<spec.size() && isdigit(spec[pos])) pos++;
+  if (pos==spec.size()) SIMPLE_ERROR("Could not parse the format {}", line);
+  perLine = (pos==0) ? 1 : std::stoul(spec.substr(0,pos));
+  formatChar = toupper(spec[pos]);
+  size_t wstart = pos+1;
+  size_t wend = wstart;
+  while (wend<spec.size() && isdigit(spec[wend])) wend++;
+  if (wend==wstart) SIMPLE_ERROR("Could not parse the width in the format {}", line);
+  width = std::stoul(spec.substr(wstart,wend-wstart));
+}
+
+static bool blankField(const char* start, size_t len)
+{
+  for ( size_t ii=0; ii<len; ii++ ) if (start[ii]!=' ' && start[ii]!='\t') return false;
+  return true;
+}
+
+/*! Parse a fixed width real - Fortran allows D as the exponent character */
+static double parseFortranReal(const char* start, size_t len)
+{
+  char buffer[64];
+  if (len>=sizeof(buffer)) len = sizeof(buffer)-1;
+  for ( size_t ii=0; ii<len; ii++ ) buffer[ii] = (start[ii]=='D'||start[ii]=='d') ? 'E' : start[ii];
+  buffer[len] = '\0';
+  char* end;
+  double val = strtod(buffer,&end);
+  if (end==buffer) SIMPLE_ERROR("Could not parse a real number from [{}]", std::string(start,len));
+  return val;
+}
+
+static int32_t parseFortranInteger(const char* start, size_t len)
+{
+  char buffer[32];
+  if (len>=sizeof(buffer)) len = sizeof(buffer)-1;
+  memcpy(buffer,start,len);
+  buffer[len] = '\0';
+  char* end;
+  long val = strtol(buffer,&end,10);
+  if (end==buffer) SIMPLE_ERROR("Could not parse an integer from [{}]", std::string(start,len));
+  return (int32_t)val;
+}
+
+/*! Read the whole file and split it into lines - '\r' and debugging lines starting with "=-" are dropped */
+static std::vector<std::string> readFortranLines(const std::string& filename)
+{
+  std::ifstream fin(filename, std::ios::in | std::ios::binary);
+  if (!fin.is_open()) SIMPLE_ERROR("Could not open {}", filename);
+  std::stringstream buffer;
+  buffer << fin.rdbuf();
+  const std::string& contents = buffer.str();
+  std::vector<std::string> lines;
+  size_t start = 0;
+  while (start<contents.size()) {
+    size_t end = contents.find('\n',start);
+    if (end==std::string::npos) end = contents.size();
+    size_t lineEnd = end;
+    if (lineEnd>start && contents[lineEnd-1]=='\r') lineEnd--;
+    if (!(lineEnd-start>=2 && contents[start]=='=' && contents[start+1]=='-')) {
+      lines.emplace_back(contents,start,lineEnd-start);
+    }
+    start = end+1;
+  }
+  return lines;
+}
+
+CL_DOCSTRING(R"dx(Read the AMBER topology file FILENAME and return (values sections version-line).
+SECTIONS is an equal hash-table that maps each %FLAG name (eg: "POINTERS") to a vector of its values -
+(signed-byte 32) for I formats, vecreal for E, F and D formats and strings for A formats.
+Strings have their leading spaces removed.)dx");
+CL_LAMBDA(filename);
+DOCGROUP(cando);
+CL_DEFUN core::T_mv chem__read_fortran_sections(const std::string& filename)
+{
+  std::vector<std::string> lines = readFortranLines(filename);
+  core::HashTableEqual_sp sections = core::HashTableEqual_O::create_default();
+  std::string version = (lines.size()>0) ? lines[0] : "";
+  size_t cur = 1;
+  while (cur<lines.size()) {
+    const std::string& flagLine = lines[cur];
+    if (flagLine.compare(0,5,"%FLAG")!=0) {
+      SIMPLE_ERROR("Expected a %FLAG line at line {} of {} - saw {}", cur+1, filename, flagLine);
+    }
+    std::string flag = flagLine.substr(5);
+    flag.erase(0,flag.find_first_not_of(" \t"));
+    flag.erase(flag.find_last_not_of(" \t")+1);
+    cur++;
+    while (cur<lines.size() && lines[cur].compare(0,8,"%COMMENT")==0) cur++;
+    if (cur>=lines.size() || lines[cur].compare(0,7,"%FORMAT")!=0) {
+      SIMPLE_ERROR("Expected a %FORMAT line after {} in {}", flagLine, filename);
+    }
+    size_t perLine, width;
+    char formatChar;
+    parseFortranFormat(lines[cur],perLine,formatChar,width);
+    cur++;
+    std::vector<int32_t> ints;
+    std::vector<double> reals;
+    std::vector<std::string> strings;
+    for ( ; cur<lines.size() && (lines[cur].size()==0 || lines[cur][0]!='%'); cur++ ) {
+      const std::string& line = lines[cur];
+      for ( size_t start=0; start<line.size(); start+=width ) {
+        size_t len = std::min(width,line.size()-start);
+        const char* field = line.data()+start;
+        switch (formatChar) {
+        case 'I':
+            if (len<width || blankField(field,len)) continue;
+            ints.push_back(parseFortranInteger(field,len));
+            break;
+        case 'E':
+        case 'F':
+        case 'D':
+            if (len<width || blankField(field,len)) continue;
+            reals.push_back(parseFortranReal(field,len));
+            break;
+        case 'A':
+            if (len<width && blankField(field,len)) continue;
+            {
+              size_t first = 0;
+              while (first<len && field[first]==' ') first++;
+              strings.emplace_back(field+first,len-first);
+            }
+            break;
+        default:
+            SIMPLE_ERROR("Handle format character {} for %FLAG {}", formatChar, flag);
+        }
+      }
+    }
+    core::T_sp values;
+    if (formatChar=='I') {
+      core::SimpleVector_int32_t_sp vec = core::SimpleVector_int32_t_O::make(ints.size());
+      for ( size_t ii=0; ii<ints.size(); ii++ ) (*vec)[ii] = ints[ii];
+      values = vec;
+    } else if (formatChar=='A') {
+      core::SimpleVector_sp vec = core::SimpleVector_O::make(strings.size());
+      for ( size_t ii=0; ii<strings.size(); ii++ ) (*vec)[ii] = core::SimpleBaseString_O::make(strings[ii]);
+      values = vec;
+    } else {
+      NVector_sp vec = NVector_O::make(reals.size());
+      for ( size_t ii=0; ii<reals.size(); ii++ ) (*vec)[ii] = reals[ii];
+      values = vec;
+    }
+    sections->setf_gethash(core::SimpleBaseString_O::make(flag),values);
+  }
+  return Values(sections,core::SimpleBaseString_O::make(version));
+}
+
+/*! Parse 12 character wide reals from lines[cur] onwards into values */
+static void readRestartReals(const std::vector<std::string>& lines, size_t& cur, std::vector<double>& values)
+{
+  for ( ; cur<lines.size(); cur++ ) {
+    const std::string& line = lines[cur];
+    if (line.size()>0 && line[0]=='%') break;
+    for ( size_t start=0; start+12<=line.size(); start+=12 ) {
+      if (blankField(line.data()+start,12)) continue;
+      values.push_back(parseFortranReal(line.data()+start,12));
+    }
+  }
+}
+
+CL_DOCSTRING(R"dx(Read the AMBER ascii coordinate/restart file (inpcrd or rst7) FILENAME.
+Return (values number-of-atoms coordinates bounding-box-or-nil velocities-or-nil).
+The velocities are recognized by the number of values in the file - 3N + 6 or 3N mean
+the file has velocities (and a box), 6 means it only has a box.  With two atoms 6 extra
+values are either velocities or a box and are taken as a box if they look like three
+positive lengths followed by three angles between 30 and 150 degrees.)dx");
+CL_LAMBDA(filename &key read-velocities (read-bounding-box t));
+DOCGROUP(cando);
+CL_DEFUN core::T_mv chem__read_amber_ascii_restart(const std::string& filename, bool readVelocities, bool readBoundingBox)
+{
+  std::vector<std::string> lines = readFortranLines(filename);
+  if (lines.size()<2) SIMPLE_ERROR("The file {} is too short to be an AMBER coordinate file", filename);
+  // FORMAT(I5,5E15.7) NATOM,TIME,TEMP - more than 99999 atoms widens the I5 so read the first integer
+  char* end;
+  long natoms = strtol(lines[1].c_str(),&end,10);
+  if (end==lines[1].c_str() || natoms<0) SIMPLE_ERROR("Could not read the number of atoms from {}", lines[1]);
+  std::vector<double> values;
+  size_t cur = 2;
+  readRestartReals(lines,cur,values);
+  size_t ncoords = natoms*3;
+  if (values.size()<ncoords) {
+    SIMPLE_ERROR("The file {} has {} values but {} atoms need {}", filename, values.size(), natoms, ncoords);
+  }
+  size_t extra = values.size()-ncoords;
+  bool hasVelocities = (extra>=ncoords && ncoords>0 && (extra==ncoords || extra==ncoords+6));
+  bool hasBox = (extra==6 || (hasVelocities && extra==ncoords+6));
+  if (hasVelocities && hasBox && extra==6) {
+    // Two atoms - a box line is three lengths and three cell angles while velocities are
+    // well below one in AMBER units
+    const double* tail = &values[ncoords];
+    bool looksLikeBox = true;
+    for ( size_t ii=0; ii<3; ii++ ) {
+      if (!(tail[ii]>0.0) || !(tail[3+ii]>=30.0 && tail[3+ii]<=150.0)) looksLikeBox = false;
+    }
+    if (looksLikeBox) hasVelocities = false;
+    else hasBox = false;
+  }
+  NVector_sp coordinates = NVector_O::make(ncoords);
+  for ( size_t ii=0; ii<ncoords; ii++ ) (*coordinates)[ii] = values[ii];
+  core::T_sp velocities = nil<core::T_O>();
+  if (readVelocities && hasVelocities) {
+    NVector_sp vel = NVector_O::make(ncoords);
+    for ( size_t ii=0; ii<ncoords; ii++ ) (*vel)[ii] = values[ncoords+ii];
+    velocities = vel;
+  }
+  ql::list box;
+  if (readBoundingBox && hasBox) {
+    for ( size_t ii=values.size()-6; ii<values.size(); ii++ ) box << core::clasp_make_double_float(values[ii]);
+  }
+  return Values(core::make_fixnum(natoms),coordinates,box.cons(),velocities);
+}
+
+};
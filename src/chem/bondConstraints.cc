@@ -0,0 +1,572 @@
+/*
+    File: bondConstraints.cc
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+#define	DEBUG_LEVEL_NONE
+
+#include <clasp/core/foundation.h>
+#include <clasp/core/array.h>
+#include <cando/chem/bondConstraints.h>
+#include <cando/chem/energyFunction.h>
+#include <cando/chem/energyAtomTable.h>
+#include <cando/chem/energyStretch.h>
+#include <cando/chem/energyAngle.h>
+#include <clasp/core/wrappers.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <numeric>
+#include <thread>
+
+namespace chem {
+
+SYMBOL_EXPORT_SC_(KeywordPkg,hydrogens);
+SYMBOL_EXPORT_SC_(KeywordPkg,all_bonds);
+
+namespace {
+
+/*! Split work over the available cores - small systems are solved on the calling thread */
+size_t bondConstraintsNumberOfThreads(size_t work) {
+  size_t numThreads = std::max(1U,std::thread::hardware_concurrency());
+  return std::max((size_t)1,std::min(numThreads,work/256));
+}
+
+template <typename Fn>
+void bondConstraintsParallel(size_t numThreads, Fn&& fn) {
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads-1);
+  for ( size_t tid=1; tid<numThreads; ++tid ) threads.emplace_back(fn,tid);
+  fn(0);
+  for ( auto& thread : threads ) thread.join();
+}
+
+/*! SHAKE - correct the constraints one after another along the bond vectors of reference
+ *  until every squared distance is within tolerance.  Return false if it doesn't converge. */
+bool shakeConstraints(size_t num, const int32_t* atom1, const int32_t* atom2, const double* distance,
+                      const double* reference, double* pos, const double* inverseMasses,
+                      double tolerance, size_t maxIterations)
+{
+  for ( size_t iteration=0; iteration<maxIterations; ++iteration ) {
+    bool converged = true;
+    for ( size_t ii=0; ii<num; ++ii ) {
+      size_t ia = atom1[ii]*3, ib = atom2[ii]*3;
+      double invMassA = inverseMasses[atom1[ii]], invMassB = inverseMasses[atom2[ii]];
+      if (invMassA+invMassB == 0.0) continue;
+      double dx = pos[ia+0]-pos[ib+0], dy = pos[ia+1]-pos[ib+1], dz = pos[ia+2]-pos[ib+2];
+      double d02 = distance[ii]*distance[ii];
+      double diff = d02-(dx*dx+dy*dy+dz*dz);
+      if (std::fabs(diff) <= 2.0*tolerance*d02) continue;
+      converged = false;
+      double rx = reference[ia+0]-reference[ib+0], ry = reference[ia+1]-reference[ib+1], rz = reference[ia+2]-reference[ib+2];
+      double rdotd = rx*dx+ry*dy+rz*dz;
+      // The bond rotated by nearly 90 degrees in one step - the timestep is far too large
+      if (rdotd < 1.0e-6*d02) return false;
+      double gg = diff/(2.0*rdotd*(invMassA+invMassB));
+      pos[ia+0] += gg*invMassA*rx; pos[ia+1] += gg*invMassA*ry; pos[ia+2] += gg*invMassA*rz;
+      pos[ib+0] -= gg*invMassB*rx; pos[ib+1] -= gg*invMassB*ry; pos[ib+2] -= gg*invMassB*rz;
+    }
+    if (converged) return true;
+  }
+  return false;
+}
+
+/*! RATTLE - remove the relative velocity along each constraint one after another until
+ *  no constrained distance is changing.  Return false if it doesn't converge. */
+bool rattleConstraints(size_t num, const int32_t* atom1, const int32_t* atom2,
+                       const double* pos, double* vel, const double* inverseMasses,
+                       double tolerance, size_t maxIterations)
+{
+  for ( size_t iteration=0; iteration<maxIterations; ++iteration ) {
+    bool converged = true;
+    for ( size_t ii=0; ii<num; ++ii ) {
+      size_t ia = atom1[ii]*3, ib = atom2[ii]*3;
+      double invMassA = inverseMasses[atom1[ii]], invMassB = inverseMasses[atom2[ii]];
+      if (invMassA+invMassB == 0.0) continue;
+      double rx = pos[ia+0]-pos[ib+0], ry = pos[ia+1]-pos[ib+1], rz = pos[ia+2]-pos[ib+2];
+      double r2 = rx*rx+ry*ry+rz*rz;
+      double rdotv = rx*(vel[ia+0]-vel[ib+0])+ry*(vel[ia+1]-vel[ib+1])+rz*(vel[ia+2]-vel[ib+2]);
+      if (std::fabs(rdotv) <= tolerance*r2) continue;
+      converged = false;
+      double gg = -rdotv/(r2*(invMassA+invMassB));
+      vel[ia+0] += gg*invMassA*rx; vel[ia+1] += gg*invMassA*ry; vel[ia+2] += gg*invMassA*rz;
+      vel[ib+0] -= gg*invMassB*rx; vel[ib+1] -= gg*invMassB*ry; vel[ib+2] -= gg*invMassB*rz;
+    }
+    if (converged) return true;
+  }
+  return false;
+}
+
+struct BondConstraintsUnionFind {
+  std::vector<size_t> _Parent;
+  BondConstraintsUnionFind(size_t num) : _Parent(num) { std::iota(this->_Parent.begin(),this->_Parent.end(),0); };
+  size_t find(size_t ii) {
+    while (this->_Parent[ii] != ii) ii = this->_Parent[ii] = this->_Parent[this->_Parent[ii]];
+    return ii;
+  }
+  void join(size_t ii, size_t jj) { this->_Parent[this->find(ii)] = this->find(jj); };
+};
+
+void copyToStd(core::SimpleVector_int32_t_sp from, std::vector<int32_t>& to) {
+  to.resize(from->length());
+  for ( size_t ii=0; ii<to.size(); ++ii ) to[ii] = (*from)[ii];
+}
+
+void copyToStd(NVector_sp from, std::vector<double>& to) {
+  to.resize(from->length());
+  for ( size_t ii=0; ii<to.size(); ++ii ) to[ii] = (*from)[ii];
+}
+
+void copyFromStd(const std::vector<double>& from, NVector_sp to) {
+  for ( size_t ii=0; ii<from.size(); ++ii ) (*to)[ii] = from[ii];
+}
+
+/*! Plain copies of the constraint tables - the worker threads read only these and
+ *  never the Lisp vectors of the BondConstraints_O */
+struct BondConstraintsTables {
+  std::vector<int32_t> _Atom1;
+  std::vector<int32_t> _Atom2;
+  std::vector<double>  _Distance;
+  std::vector<int32_t> _ClusterStart;
+  std::vector<int32_t> _Waters;
+  std::vector<double>  _WaterOH;
+  std::vector<double>  _WaterHH;
+  double               _Tolerance;
+  size_t               _MaxIterations;
+  BondConstraintsTables(const BondConstraints_O& constraints) : _Tolerance(constraints._Tolerance), _MaxIterations(constraints._MaxIterations) {
+    copyToStd(constraints._Atom1,this->_Atom1);
+    copyToStd(constraints._Atom2,this->_Atom2);
+    copyToStd(constraints._Distance,this->_Distance);
+    copyToStd(constraints._ClusterStart,this->_ClusterStart);
+    copyToStd(constraints._Waters,this->_Waters);
+    copyToStd(constraints._WaterOH,this->_WaterOH);
+    copyToStd(constraints._WaterHH,this->_WaterHH);
+  };
+  size_t numberOfClusters() const { return this->_ClusterStart.size()-1; };
+  size_t numberOfWaters() const { return this->_Waters.size()/3; };
+};
+
+bool shakeCluster(const BondConstraintsTables& tables, size_t cluster, const double* reference, double* pos, const double* inverseMasses)
+{
+  size_t start = tables._ClusterStart[cluster];
+  size_t num = tables._ClusterStart[cluster+1]-start;
+  return shakeConstraints(num,tables._Atom1.data()+start,tables._Atom2.data()+start,tables._Distance.data()+start,
+                          reference,pos,inverseMasses,tables._Tolerance,tables._MaxIterations);
+}
+
+bool rattleCluster(const BondConstraintsTables& tables, size_t cluster, const double* pos, double* vel, const double* inverseMasses)
+{
+  size_t start = tables._ClusterStart[cluster];
+  size_t num = tables._ClusterStart[cluster+1]-start;
+  return rattleConstraints(num,tables._Atom1.data()+start,tables._Atom2.data()+start,
+                           pos,vel,inverseMasses,tables._Tolerance,tables._MaxIterations);
+}
+
+};
+
+void BondConstraints_O::fields(core::Record_sp node)
+{
+  node->field(INTERN_(kw,Atom1),this->_Atom1);
+  node->field(INTERN_(kw,Atom2),this->_Atom2);
+  node->field(INTERN_(kw,Distance),this->_Distance);
+  node->field(INTERN_(kw,ClusterStart),this->_ClusterStart);
+  node->field(INTERN_(kw,Waters),this->_Waters);
+  node->field(INTERN_(kw,WaterOH),this->_WaterOH);
+  node->field(INTERN_(kw,WaterHH),this->_WaterHH);
+  node->field(INTERN_(kw,Tolerance),this->_Tolerance);
+  node->field(INTERN_(kw,MaxIterations),this->_MaxIterations);
+}
+
+CL_LAMBDA(energy-function &key (bonds :hydrogens) (rigid-water t));
+CL_DOCSTRING(R"dx(Make bond-constraints that hold the stretch terms of energy-function at their
+equilibrium lengths.
+: bonds - :hydrogens constrains only the bonds to hydrogen and :all-bonds constrains every stretch term.
+: rigid-water - when true every water (an oxygen bonded to two hydrogens and nothing else) is made
+fully rigid and solved analytically with SETTLE.  The H-H distance comes from the H-O-H angle term.)dx");
+CL_LISPIFY_NAME(make_bond_constraints);
+CL_DEF_CLASS_METHOD BondConstraints_sp BondConstraints_O::make(EnergyFunction_sp energyFunction, core::Symbol_sp bonds, bool rigidWater)
+{
+  if (bonds != kw::_sym_hydrogens && bonds != kw::_sym_all_bonds) {
+    SIMPLE_ERROR("Unknown bonds {} - must be one of :hydrogens :all-bonds", _rep_(bonds));
+  }
+  AtomTable_sp atomTable = energyFunction->atomTable();
+  size_t numAtoms = energyFunction->getNVectorSize()/3;
+  EnergyStretch_sp stretch = energyFunction->getStretchComponent();
+  struct Bond { size_t _Atom1; size_t _Atom2; double _Distance; };
+  std::vector<Bond> allBonds;
+  std::vector<std::vector<size_t>> partners(numAtoms);
+  for ( auto& term : stretch->_Terms ) {
+    size_t a1 = term.term.I1/3, a2 = term.term.I2/3;
+    allBonds.push_back(Bond{a1,a2,term.term.r0});
+    partners[a1].push_back(allBonds.size()-1);
+    partners[a2].push_back(allBonds.size()-1);
+  }
+  auto hydrogen = [&atomTable] (size_t atom) { return atomTable->elt_atomic_number(atom) == 1; };
+  // Find the rigid waters and the equilibrium H-O-H angle of each
+  std::vector<bool> inWater(numAtoms,false);
+  std::vector<size_t> waters;
+  std::vector<double> waterOH, waterHH;
+  if (rigidWater) {
+    std::map<std::pair<size_t,size_t>,double> angleOfCenter;   // (oxygen,hydrogen) -> t0 for either end hydrogen
+    for ( auto& term : energyFunction->getAngleComponent()->_Terms ) {
+      angleOfCenter[std::make_pair((size_t)term.term.I2/3,(size_t)term.term.I1/3)] = term.term.t0;
+      angleOfCenter[std::make_pair((size_t)term.term.I2/3,(size_t)term.term.I3/3)] = term.term.t0;
+    }
+    for ( size_t oxygen=0; oxygen<numAtoms; ++oxygen ) {
+      if (atomTable->elt_atomic_number(oxygen) != 8 || partners[oxygen].size() != 2) continue;
+      const Bond& b1 = allBonds[partners[oxygen][0]];
+      const Bond& b2 = allBonds[partners[oxygen][1]];
+      size_t h1 = (b1._Atom1 == oxygen) ? b1._Atom2 : b1._Atom1;
+      size_t h2 = (b2._Atom1 == oxygen) ? b2._Atom2 : b2._Atom1;
+      if (h1 == h2 || !hydrogen(h1) || !hydrogen(h2) || partners[h1].size() != 1 || partners[h2].size() != 1) continue;
+      // SETTLE needs both O-H bonds the same length
+      if (std::fabs(b1._Distance-b2._Distance) > 1.0e-6*b1._Distance) continue;
+      auto angle = angleOfCenter.find(std::make_pair(oxygen,h1));
+      if (angle == angleOfCenter.end()) continue;
+      waters.push_back(oxygen);
+      waters.push_back(h1);
+      waters.push_back(h2);
+      waterOH.push_back(b1._Distance);
+      waterHH.push_back(2.0*b1._Distance*std::sin(0.5*angle->second));
+      inWater[oxygen] = inWater[h1] = inWater[h2] = true;
+    }
+  }
+  // Everything else is grouped into clusters of constraints that share atoms
+  std::vector<size_t> constrained;
+  BondConstraintsUnionFind clusters(numAtoms);
+  for ( size_t ii=0; ii<allBonds.size(); ++ii ) {
+    const Bond& bond = allBonds[ii];
+    if (inWater[bond._Atom1]) continue;
+    if (bonds == kw::_sym_hydrogens && !hydrogen(bond._Atom1) && !hydrogen(bond._Atom2)) continue;
+    constrained.push_back(ii);
+    clusters.join(bond._Atom1,bond._Atom2);
+  }
+  std::stable_sort(constrained.begin(),constrained.end(), [&] (size_t ii, size_t jj) {
+    return clusters.find(allBonds[ii]._Atom1) < clusters.find(allBonds[jj]._Atom1);
+  });
+  auto me = gctools::GC<BondConstraints_O>::allocate_with_default_constructor();
+  me->_Atom1 = core::SimpleVector_int32_t_O::make(constrained.size());
+  me->_Atom2 = core::SimpleVector_int32_t_O::make(constrained.size());
+  me->_Distance = NVector_O::make(constrained.size());
+  std::vector<int32_t> starts;
+  for ( size_t ii=0; ii<constrained.size(); ++ii ) {
+    const Bond& bond = allBonds[constrained[ii]];
+    if (ii == 0 || clusters.find(bond._Atom1) != clusters.find(allBonds[constrained[ii-1]]._Atom1)) starts.push_back(ii);
+    (*me->_Atom1)[ii] = bond._Atom1;
+    (*me->_Atom2)[ii] = bond._Atom2;
+    (*me->_Distance)[ii] = bond._Distance;
+  }
+  starts.push_back(constrained.size());
+  me->_ClusterStart = core::SimpleVector_int32_t_O::make(starts.size());
+  for ( size_t ii=0; ii<starts.size(); ++ii ) (*me->_ClusterStart)[ii] = starts[ii];
+  me->_Waters = core::SimpleVector_int32_t_O::make(waters.size());
+  for ( size_t ii=0; ii<waters.size(); ++ii ) (*me->_Waters)[ii] = waters[ii];
+  me->_WaterOH = NVector_O::make(waterOH.size());
+  me->_WaterHH = NVector_O::make(waterHH.size());
+  for ( size_t ii=0; ii<waterOH.size(); ++ii ) {
+    (*me->_WaterOH)[ii] = waterOH[ii];
+    (*me->_WaterHH)[ii] = waterHH[ii];
+  }
+  return me;
+}
+
+CL_DOCSTRING(R"dx(Return the total number of constraints - three for every rigid water.)dx");
+CL_DEFMETHOD size_t BondConstraints_O::numberOfConstraints() const
+{
+  return this->_Atom1->length()+this->_Waters->length();
+}
+
+CL_DOCSTRING(R"dx(Set the relative tolerance on the constrained squared distances and the maximum
+number of SHAKE and RATTLE iterations before an error is signaled.)dx");
+CL_DEFMETHOD void BondConstraints_O::setTolerance(double tolerance, size_t maxIterations)
+{
+  if (tolerance <= 0.0) SIMPLE_ERROR("The tolerance must be positive - it is {}", tolerance);
+  if (maxIterations == 0) SIMPLE_ERROR("maxIterations must be positive");
+  this->_Tolerance = tolerance;
+  this->_MaxIterations = maxIterations;
+}
+
+size_t BondConstraints_O::numberOfActiveConstraints(NVector_sp inverseMasses) const
+{
+  const NVector_O& invMass = *inverseMasses;
+  size_t count = 0;
+  for ( size_t ii=0; ii<this->_Atom1->length(); ++ii ) {
+    if (invMass[(*this->_Atom1)[ii]]+invMass[(*this->_Atom2)[ii]] != 0.0) ++count;
+  }
+  for ( size_t ww=0; ww<this->_Waters->length(); ww+=3 ) {
+    double o = invMass[(*this->_Waters)[ww]], h1 = invMass[(*this->_Waters)[ww+1]], h2 = invMass[(*this->_Waters)[ww+2]];
+    count += (o+h1 != 0.0) + (o+h2 != 0.0) + (h1+h2 != 0.0);
+  }
+  return count;
+}
+
+namespace {
+
+/*! SETTLE of Miyamoto and Kollman (J. Comput. Chem. 13, 952 (1992)) following the
+ *  formulation of the OpenMM reference platform.  The water is placed in a frame built from
+ *  the reference geometry, the rigid triangle is rotated onto the unconstrained positions
+ *  and moved back - the center of mass of the water is unchanged. */
+bool settleWaterPositions(const BondConstraintsTables& tables, size_t water, const double* ref, double* cur, const double* inverseMasses)
+{
+  size_t iO = tables._Waters[water*3]*3, iH1 = tables._Waters[water*3+1]*3, iH2 = tables._Waters[water*3+2]*3;
+  double d01 = tables._WaterOH[water];
+  double d12 = tables._WaterHH[water];
+  double invMassO = inverseMasses[iO/3], invMassH1 = inverseMasses[iH1/3], invMassH2 = inverseMasses[iH2/3];
+  if (invMassO == 0.0 || invMassH1 == 0.0 || invMassH2 == 0.0) {
+    // A partially frozen water is not a rigid body that can move freely - use SHAKE
+    int32_t atom1[3] = {(int32_t)(iO/3),(int32_t)(iO/3),(int32_t)(iH1/3)};
+    int32_t atom2[3] = {(int32_t)(iH1/3),(int32_t)(iH2/3),(int32_t)(iH2/3)};
+    double distance[3] = {d01,d01,d12};
+    return shakeConstraints(3,atom1,atom2,distance,ref,cur,inverseMasses,tables._Tolerance,tables._MaxIterations);
+  }
+  double m0 = 1.0/invMassO, m1 = 1.0/invMassH1, m2 = 1.0/invMassH2;
+  double invTotalMass = 1.0/(m0+m1+m2);
+  double xb0 = ref[iH1+0]-ref[iO+0], yb0 = ref[iH1+1]-ref[iO+1], zb0 = ref[iH1+2]-ref[iO+2];
+  double xc0 = ref[iH2+0]-ref[iO+0], yc0 = ref[iH2+1]-ref[iO+1], zc0 = ref[iH2+2]-ref[iO+2];
+  // The displacements of the atoms relative to the reference oxygen
+  double pa[3], pb[3], pc[3], com[3];
+  for ( size_t cc=0; cc<3; ++cc ) {
+    pa[cc] = cur[iO+cc]-ref[iO+cc];
+    pb[cc] = cur[iH1+cc]-ref[iO+cc];
+    pc[cc] = cur[iH2+cc]-ref[iO+cc];
+    com[cc] = (pa[cc]*m0+pb[cc]*m1+pc[cc]*m2)*invTotalMass;
+  }
+  double xa1 = pa[0]-com[0], ya1 = pa[1]-com[1], za1 = pa[2]-com[2];
+  double xb1 = pb[0]-com[0], yb1 = pb[1]-com[1], zb1 = pb[2]-com[2];
+  double xc1 = pc[0]-com[0], yc1 = pc[1]-com[1], zc1 = pc[2]-com[2];
+  // The frame - z is normal to the reference plane and x is perpendicular to the new oxygen
+  double xaksZ = yb0*zc0-zb0*yc0, yaksZ = zb0*xc0-xb0*zc0, zaksZ = xb0*yc0-yb0*xc0;
+  double xaksX = ya1*zaksZ-za1*yaksZ, yaksX = za1*xaksZ-xa1*zaksZ, zaksX = xa1*yaksZ-ya1*xaksZ;
+  double xaksY = yaksZ*zaksX-zaksZ*yaksX, yaksY = zaksZ*xaksX-xaksZ*zaksX, zaksY = xaksZ*yaksX-yaksZ*xaksX;
+  double axlng = std::sqrt(xaksX*xaksX+yaksX*yaksX+zaksX*zaksX);
+  double aylng = std::sqrt(xaksY*xaksY+yaksY*yaksY+zaksY*zaksY);
+  double azlng = std::sqrt(xaksZ*xaksZ+yaksZ*yaksZ+zaksZ*zaksZ);
+  double trns11 = xaksX/axlng, trns21 = yaksX/axlng, trns31 = zaksX/axlng;
+  double trns12 = xaksY/aylng, trns22 = yaksY/aylng, trns32 = zaksY/aylng;
+  double trns13 = xaksZ/azlng, trns23 = yaksZ/azlng, trns33 = zaksZ/azlng;
+  double xb0d = trns11*xb0+trns21*yb0+trns31*zb0, yb0d = trns12*xb0+trns22*yb0+trns32*zb0;
+  double xc0d = trns11*xc0+trns21*yc0+trns31*zc0, yc0d = trns12*xc0+trns22*yc0+trns32*zc0;
+  double za1d = trns13*xa1+trns23*ya1+trns33*za1;
+  double xb1d = trns11*xb1+trns21*yb1+trns31*zb1, yb1d = trns12*xb1+trns22*yb1+trns32*zb1;
+  double zb1d = trns13*xb1+trns23*yb1+trns33*zb1;
+  double xc1d = trns11*xc1+trns21*yc1+trns31*zc1, yc1d = trns12*xc1+trns22*yc1+trns32*zc1;
+  double zc1d = trns13*xc1+trns23*yc1+trns33*zc1;
+  // The canonical triangle with its center of mass at the origin
+  double rc = 0.5*d12;
+  double rb = std::sqrt(d01*d01-rc*rc);
+  double ra = rb*(m1+m2)*invTotalMass;
+  rb -= ra;
+  double sinphi = std::clamp(za1d/ra,-1.0,1.0);
+  double cosphi = std::sqrt(1.0-sinphi*sinphi);
+  double sinpsi = std::clamp((zb1d-zc1d)/(2.0*rc*cosphi),-1.0,1.0);
+  double cospsi = std::sqrt(1.0-sinpsi*sinpsi);
+  double ya2d = ra*cosphi;
+  double xb2d = -rc*cospsi;
+  double yb2d = -rb*cosphi-rc*sinpsi*sinphi;
+  double yc2d = -rb*cosphi+rc*sinpsi*sinphi;
+  double xb2d2 = xb2d*xb2d;
+  double hh2 = 4.0*xb2d2+(yb2d-yc2d)*(yb2d-yc2d)+(zb1d-zc1d)*(zb1d-zc1d);
+  double deltx = 2.0*xb2d+std::sqrt(std::max(0.0,4.0*xb2d2-hh2+d12*d12));
+  xb2d -= deltx*0.5;
+  // Rotate about z so that the triangle matches the new positions
+  double alpha = xb2d*(xb0d-xc0d)+yb0d*yb2d+yc0d*yc2d;
+  double beta = xb2d*(yc0d-yb0d)+xb0d*yb2d+xc0d*yc2d;
+  double gamma = xb0d*yb1d-xb1d*yb0d+xc0d*yc1d-xc1d*yc0d;
+  double al2be2 = alpha*alpha+beta*beta;
+  double sinthe = (alpha*gamma-beta*std::sqrt(std::max(0.0,al2be2-gamma*gamma)))/al2be2;
+  double costhe = std::sqrt(1.0-sinthe*sinthe);
+  double xa3d = -ya2d*sinthe, ya3d = ya2d*costhe, za3d = za1d;
+  double xb3d = xb2d*costhe-yb2d*sinthe, yb3d = xb2d*sinthe+yb2d*costhe, zb3d = zb1d;
+  double xc3d = -xb2d*costhe-yc2d*sinthe, yc3d = -xb2d*sinthe+yc2d*costhe, zc3d = zc1d;
+  // Back to the lab frame
+  double oxygen[3] = {trns11*xa3d+trns12*ya3d+trns13*za3d, trns21*xa3d+trns22*ya3d+trns23*za3d, trns31*xa3d+trns32*ya3d+trns33*za3d};
+  double hydrogen1[3] = {trns11*xb3d+trns12*yb3d+trns13*zb3d, trns21*xb3d+trns22*yb3d+trns23*zb3d, trns31*xb3d+trns32*yb3d+trns33*zb3d};
+  double hydrogen2[3] = {trns11*xc3d+trns12*yc3d+trns13*zc3d, trns21*xc3d+trns22*yc3d+trns23*zc3d, trns31*xc3d+trns32*yc3d+trns33*zc3d};
+  for ( size_t cc=0; cc<3; ++cc ) {
+    double origin = ref[iO+cc]+com[cc];
+    cur[iO+cc] = origin+oxygen[cc];
+    cur[iH1+cc] = origin+hydrogen1[cc];
+    cur[iH2+cc] = origin+hydrogen2[cc];
+  }
+  return true;
+}
+
+/*! Remove the relative velocities along the three sides of a water exactly by solving
+ *  the 3x3 linear system for the constraint impulses. */
+bool settleWaterVelocities(const BondConstraintsTables& tables, size_t water, const double* pos, double* vel, const double* inverseMasses)
+{
+  size_t atoms[3] = {(size_t)tables._Waters[water*3], (size_t)tables._Waters[water*3+1], (size_t)tables._Waters[water*3+2]};
+  double invMass[3] = {inverseMasses[atoms[0]], inverseMasses[atoms[1]], inverseMasses[atoms[2]]};
+  const size_t sides[3][2] = {{0,1},{0,2},{1,2}};
+  if (invMass[0] == 0.0 || invMass[1] == 0.0 || invMass[2] == 0.0) {
+    int32_t atom1[3], atom2[3];
+    for ( size_t kk=0; kk<3; ++kk ) {
+      atom1[kk] = atoms[sides[kk][0]];
+      atom2[kk] = atoms[sides[kk][1]];
+    }
+    return rattleConstraints(3,atom1,atom2,pos,vel,inverseMasses,tables._Tolerance,tables._MaxIterations);
+  }
+  double side[3][3], rhs[3], matrix[3][3];
+  for ( size_t kk=0; kk<3; ++kk ) {
+    size_t ia = atoms[sides[kk][0]]*3, ib = atoms[sides[kk][1]]*3;
+    rhs[kk] = 0.0;
+    for ( size_t cc=0; cc<3; ++cc ) {
+      side[kk][cc] = pos[ia+cc]-pos[ib+cc];
+      rhs[kk] -= side[kk][cc]*(vel[ia+cc]-vel[ib+cc]);
+    }
+  }
+  // An impulse lambda along side l changes the relative velocity of side k by lambda*coefficient*side[l]
+  for ( size_t kk=0; kk<3; ++kk ) {
+    for ( size_t ll=0; ll<3; ++ll ) {
+      double coefficient = 0.0;
+      for ( size_t end=0; end<2; ++end ) {
+        size_t atom = sides[kk][end];
+        double sign = (atom == sides[ll][0]) ? 1.0 : ((atom == sides[ll][1]) ? -1.0 : 0.0);
+        coefficient += (end == 0 ? 1.0 : -1.0)*sign*invMass[atom];
+      }
+      matrix[kk][ll] = coefficient*(side[kk][0]*side[ll][0]+side[kk][1]*side[ll][1]+side[kk][2]*side[ll][2]);
+    }
+  }
+  double det = matrix[0][0]*(matrix[1][1]*matrix[2][2]-matrix[1][2]*matrix[2][1])
+    - matrix[0][1]*(matrix[1][0]*matrix[2][2]-matrix[1][2]*matrix[2][0])
+    + matrix[0][2]*(matrix[1][0]*matrix[2][1]-matrix[1][1]*matrix[2][0]);
+  double lambda[3];
+  for ( size_t col=0; col<3; ++col ) {
+    double replaced[3][3];
+    for ( size_t rr=0; rr<3; ++rr ) for ( size_t cc=0; cc<3; ++cc ) replaced[rr][cc] = (cc == col) ? rhs[rr] : matrix[rr][cc];
+    lambda[col] = (replaced[0][0]*(replaced[1][1]*replaced[2][2]-replaced[1][2]*replaced[2][1])
+                   - replaced[0][1]*(replaced[1][0]*replaced[2][2]-replaced[1][2]*replaced[2][0])
+                   + replaced[0][2]*(replaced[1][0]*replaced[2][1]-replaced[1][1]*replaced[2][0]))/det;
+  }
+  for ( size_t kk=0; kk<3; ++kk ) {
+    size_t ia = atoms[sides[kk][0]]*3, ib = atoms[sides[kk][1]]*3;
+    for ( size_t cc=0; cc<3; ++cc ) {
+      vel[ia+cc] += lambda[kk]*invMass[sides[kk][0]]*side[kk][cc];
+      vel[ib+cc] -= lambda[kk]*invMass[sides[kk][1]]*side[kk][cc];
+    }
+  }
+  return true;
+}
+
+};
+
+/*! Signal an error naming the first atoms of the cluster or water that failed to converge */
+void BondConstraints_O::notConverged(const char* method, size_t failed) const
+{
+  size_t numClusters = this->_ClusterStart->length()-1;
+  if (failed<numClusters) {
+    size_t start = (*this->_ClusterStart)[failed];
+    SIMPLE_ERROR("{} did not converge in {} iterations for the cluster of constraints starting with atoms {} and {}",
+                 method, this->_MaxIterations, (*this->_Atom1)[start], (*this->_Atom2)[start]);
+  }
+  SIMPLE_ERROR("{} did not converge in {} iterations for the water with oxygen atom {}",
+               method, this->_MaxIterations, (*this->_Waters)[(failed-numClusters)*3]);
+}
+
+CL_DOCSTRING(R"dx(Move the coordinates pos so that every constraint is satisfied.  The corrections are
+directed along the bonds of reference, the coordinates before the step, and are weighted by
+inverse-masses (one per atom, zero for an atom that must not move).)dx");
+CL_DEFMETHOD void BondConstraints_O::applyToPositions(NVector_sp reference, NVector_sp pos, NVector_sp inverseMasses)
+{
+  if (reference->length() != pos->length() || inverseMasses->length()*3 != pos->length()) {
+    SIMPLE_ERROR("Mismatched lengths - reference {} pos {} inverse-masses {}", reference->length(), pos->length(), inverseMasses->length());
+  }
+  BondConstraintsTables tables(*this);
+  std::vector<double> referencePositions, positions, invMasses;
+  copyToStd(reference,referencePositions);
+  copyToStd(pos,positions);
+  copyToStd(inverseMasses,invMasses);
+  size_t numClusters = tables.numberOfClusters();
+  size_t work = numClusters+tables.numberOfWaters();
+  size_t numThreads = bondConstraintsNumberOfThreads(work);
+  std::atomic<size_t> failed(work);
+  bondConstraintsParallel(numThreads, [&] (size_t tid) {
+    for ( size_t ii=tid; ii<work; ii+=numThreads ) {
+      bool converged = (ii<numClusters)
+        ? shakeCluster(tables,ii,referencePositions.data(),positions.data(),invMasses.data())
+        : settleWaterPositions(tables,ii-numClusters,referencePositions.data(),positions.data(),invMasses.data());
+      if (!converged) {
+        size_t previous = failed;
+        while (ii<previous && !failed.compare_exchange_weak(previous,ii));
+      }
+    }
+  });
+  copyFromStd(positions,pos);
+  if (failed<work) this->notConverged("SHAKE",failed);
+}
+
+CL_DOCSTRING(R"dx(Remove the components of the velocities vel that would change a constrained
+distance at the coordinates pos.  inverse-masses has one entry per atom and is zero for an atom
+that must not move.)dx");
+CL_DEFMETHOD void BondConstraints_O::applyToVelocities(NVector_sp pos, NVector_sp vel, NVector_sp inverseMasses)
+{
+  if (vel->length() != pos->length() || inverseMasses->length()*3 != pos->length()) {
+    SIMPLE_ERROR("Mismatched lengths - pos {} vel {} inverse-masses {}", pos->length(), vel->length(), inverseMasses->length());
+  }
+  BondConstraintsTables tables(*this);
+  std::vector<double> positions, velocities, invMasses;
+  copyToStd(pos,positions);
+  copyToStd(vel,velocities);
+  copyToStd(inverseMasses,invMasses);
+  size_t numClusters = tables.numberOfClusters();
+  size_t work = numClusters+tables.numberOfWaters();
+  size_t numThreads = bondConstraintsNumberOfThreads(work);
+  std::atomic<size_t> failed(work);
+  bondConstraintsParallel(numThreads, [&] (size_t tid) {
+    for ( size_t ii=tid; ii<work; ii+=numThreads ) {
+      bool converged = (ii<numClusters)
+        ? rattleCluster(tables,ii,positions.data(),velocities.data(),invMasses.data())
+        : settleWaterVelocities(tables,ii-numClusters,positions.data(),velocities.data(),invMasses.data());
+      if (!converged) {
+        size_t previous = failed;
+        while (ii<previous && !failed.compare_exchange_weak(previous,ii));
+      }
+    }
+  });
+  copyFromStd(velocities,vel);
+  if (failed<work) this->notConverged("RATTLE",failed);
+}
+
+CL_DOCSTRING(R"dx(Return the largest relative deviation of a constrained distance from its
+equilibrium value at the coordinates pos.)dx");
+CL_DEFMETHOD double BondConstraints_O::maximumDeviation(NVector_sp pos) const
+{
+  const NVector_O& cur = *pos;
+  auto deviation = [&cur] (size_t a1, size_t a2, double distance) {
+    double dx = cur[a1*3+0]-cur[a2*3+0], dy = cur[a1*3+1]-cur[a2*3+1], dz = cur[a1*3+2]-cur[a2*3+2];
+    return std::fabs(std::sqrt(dx*dx+dy*dy+dz*dz)-distance)/distance;
+  };
+  double worst = 0.0;
+  for ( size_t ii=0; ii<this->_Atom1->length(); ++ii ) {
+    worst = std::max(worst,deviation((*this->_Atom1)[ii],(*this->_Atom2)[ii],(*this->_Distance)[ii]));
+  }
+  for ( size_t ww=0; ww<this->numberOfWaters(); ++ww ) {
+    size_t o = (*this->_Waters)[ww*3], h1 = (*this->_Waters)[ww*3+1], h2 = (*this->_Waters)[ww*3+2];
+    worst = std::max(worst,deviation(o,h1,(*this->_WaterOH)[ww]));
+    worst = std::max(worst,deviation(o,h2,(*this->_WaterOH)[ww]));
+    worst = std::max(worst,deviation(h1,h2,(*this->_WaterHH)[ww]));
+  }
+  return worst;
+}
+
+};
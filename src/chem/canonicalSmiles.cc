@@ -0,0 +1,726 @@
+/*
+    File: canonicalSmiles.cc
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+/* -^- */
+#define	DEBUG_LEVEL_NONE
+
+#include <clasp/core/foundation.h>
+#include <clasp/core/common.h>
+#include <clasp/core/array.h>
+#include <clasp/core/evaluator.h>
+#include <clasp/core/hashTableEq.h>
+#include <clasp/core/numbers.h>
+#include <cando/chem/canonicalSmiles.h>
+#include <cando/chem/cipPrioritizer.h>
+#include <cando/chem/matterGraph.h>
+#include <cando/chem/aggregate.h>
+#include <cando/chem/molecule.h>
+#include <cando/chem/atom.h>
+#include <cando/chem/bond.h>
+#include <cando/chem/elements.h>
+#include <clasp/core/wrappers.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+#include <thread>
+
+namespace chem {
+
+SYMBOL_EXPORT_SC_(ChemPkg, STARcurrent_aromaticity_informationSTAR);
+
+// Below this many molecules per thread the molecules are canonicalized on fewer threads
+#define CANONICAL_SMILES_MOLECULES_PER_THREAD 16
+
+/*! Find the substituent with the highest CIP priority on the end center of a double bond to partner.
+ *  Return false if that end can't make the double bond stereogenic - no substituents, more than two,
+ *  two with the same priority or a substituent that isn't singly bonded (like the middle of an allene). */
+static bool double_bond_reference(MatterGraph_sp graph, uint32_t center, uint32_t partner, core::HashTable_sp cip, uint32_t& reference)
+{
+  uint32_t substituents[2];
+  int num = 0;
+  for ( uint32_t edge=graph->_NeighborStart[center]; edge<graph->_NeighborStart[center+1]; ++edge ) {
+    uint32_t other = graph->_Neighbors[edge];
+    if (other == partner) continue;
+    if (num == 2 || !Bond_O::singleBondP(graph->bondOrder(edge))) return false;
+    substituents[num++] = other;
+  }
+  if (num == 0) return false;
+  reference = substituents[0];
+  if (num == 1) return true;
+  int priority0 = graph->_Atoms[substituents[0]]->getRelativePriority(cip);
+  int priority1 = graph->_Atoms[substituents[1]]->getRelativePriority(cip);
+  if (priority0 == priority1) return false;
+  if (priority1 > priority0) reference = substituents[1];
+  return true;
+}
+
+/*! Return the cosine-like measure of the dihedral ref1-atom1=atom2-ref2 - positive when the
+ *  references are on the same side of the double bond and zero when that can't be told. */
+static double double_bond_side(const Vector3& ref1, const Vector3& atom1, const Vector3& atom2, const Vector3& ref2)
+{
+  Vector3 axis = atom2-atom1;
+  double side = (ref1-atom1).crossProduct(axis).dotProduct((ref2-atom2).crossProduct(axis));
+  if (!std::isfinite(side) || fabs(side) < 1.0e-6) return 0.0;
+  return side;
+}
+
+/*! True if atom1 and atom2 are joined by a path of fewer than maxRing-1 other bonds - so the
+ *  bond between them is in a ring with fewer than maxRing atoms. */
+static bool in_small_ring(const CanonicalGraph& graph, uint32_t atom1, uint32_t atom2, int maxRing)
+{
+  std::vector<std::pair<uint32_t,int>> queue;
+  queue.emplace_back(atom1,0);
+  for ( size_t head=0; head<queue.size(); ++head ) {
+    uint32_t atom = queue[head].first;
+    int depth = queue[head].second;
+    if (depth+2 >= maxRing) continue;
+    for ( uint32_t edge=graph._NeighborStart[atom]; edge<graph._NeighborStart[atom+1]; ++edge ) {
+      uint32_t other = graph._Neighbors[edge];
+      if (atom == atom1 && other == atom2) continue;
+      if (other == atom2) return true;
+      bool seen = false;
+      for ( auto& entry : queue ) {
+        if (entry.first == other) {
+          seen = true;
+          break;
+        }
+      }
+      if (!seen) queue.emplace_back(other,depth+1);
+    }
+  }
+  return false;
+}
+
+void CanonicalGraph::extract(Molecule_sp molecule, bool stereo, gctools::Vec0<Atom_sp>& atoms)
+{
+  core::T_sp aromaticity = nil<core::T_O>();
+  if (_sym_STARcurrent_aromaticity_informationSTAR->boundP()) {
+    core::T_sp info = _sym_STARcurrent_aromaticity_informationSTAR->symbolValue();
+    if (gc::IsA<core::HashTable_sp>(info)) aromaticity = info;
+  }
+  core::T_sp cip = nil<core::T_O>();
+  if (stereo) cip = CipPrioritizer_O::assignPrioritiesHashTable(molecule);
+  MatterGraph_sp graph = MatterGraph_O::make(molecule,false,false);
+  size_t numGraphAtoms = graph->numberOfAtoms();
+  // Hydrogens are folded into their neighbor unless they have no other neighbor than hydrogen
+  atoms.clear();
+  std::vector<int32_t> index(numGraphAtoms,-1);
+  std::vector<uint32_t> graphIndex;
+  this->_ImplicitHydrogens = true;
+  for ( size_t gi=0; gi<numGraphAtoms; ++gi ) {
+    if (graph->_Atoms[gi]->getElement() == element_H) {
+      this->_ImplicitHydrogens = false;
+      bool fold = false;
+      for ( const uint32_t* cur=graph->neighborsBegin(gi); cur!=graph->neighborsEnd(gi); ++cur ) {
+        if (graph->_Atoms[*cur]->getElement() != element_H) {
+          fold = true;
+          break;
+        }
+      }
+      if (fold) continue;
+    }
+    index[gi] = atoms.size();
+    atoms.push_back(graph->_Atoms[gi]);
+    graphIndex.push_back(gi);
+  }
+  size_t numAtoms = atoms.size();
+  this->_Symbols.resize(numAtoms);
+  this->_AtomicNumbers.assign(numAtoms,0);
+  this->_Charges.assign(numAtoms,0);
+  this->_Hydrogens.assign(numAtoms,0);
+  this->_Aromatic.assign(numAtoms,0);
+  this->_Chirality.assign(numAtoms,0);
+  this->_Positions.assign(numAtoms*3,0.0);
+  this->_HydrogenPositions.assign(numAtoms*3,0.0);
+  this->_NeighborStart.assign(1,0);
+  this->_Neighbors.clear();
+  this->_BondCodes.clear();
+  for ( size_t ai=0; ai<numAtoms; ++ai ) {
+    Atom_sp atom = atoms[ai];
+    uint32_t gi = graphIndex[ai];
+    this->_Symbols[ai] = atomicSymbolFromElement(atom->getElement())->symbolNameAsString();
+    this->_AtomicNumbers[ai] = graph->_AtomicNumbers[gi];
+    this->_Charges[ai] = std::max(-100,std::min(100,atom->getIonization()));
+    if (aromaticity.notnilp() && gc::As_unsafe<core::HashTable_sp>(aromaticity)->gethash(atom).notnilp()) {
+      this->_Aromatic[ai] = 1;
+    }
+    Vector3 pos = atom->getPosition();
+    this->_Positions[ai*3] = pos.getX();
+    this->_Positions[ai*3+1] = pos.getY();
+    this->_Positions[ai*3+2] = pos.getZ();
+    for ( uint32_t edge=graph->_NeighborStart[gi]; edge<graph->_NeighborStart[gi+1]; ++edge ) {
+      uint32_t other = graph->_Neighbors[edge];
+      if (index[other] < 0) {
+        if (this->_Hydrogens[ai] == 0) {
+          Vector3 hpos = graph->_Atoms[other]->getPosition();
+          this->_HydrogenPositions[ai*3] = hpos.getX();
+          this->_HydrogenPositions[ai*3+1] = hpos.getY();
+          this->_HydrogenPositions[ai*3+2] = hpos.getZ();
+        }
+        this->_Hydrogens[ai]++;
+        continue;
+      }
+      BondOrder order = graph->bondOrder(edge);
+      uint8_t code = canonicalSingleBond;
+      if (order == doubleBond || order == dashedDoubleBond) code = canonicalDoubleBond;
+      else if (order == tripleBond) code = canonicalTripleBond;
+      else if (order == aromaticBond) {
+        code = canonicalAromaticBond;
+        this->_Aromatic[ai] = 1;
+      }
+      this->_Neighbors.push_back(index[other]);
+      this->_BondCodes.push_back(code);
+    }
+    this->_NeighborStart.push_back(this->_Neighbors.size());
+    if (stereo && graph->degree(gi) == 4) {
+      core::HashTable_sp cipTable = gc::As_unsafe<core::HashTable_sp>(cip);
+      int priorities[4];
+      const uint32_t* neighbors = graph->neighborsBegin(gi);
+      for ( int bi=0; bi<4; ++bi ) priorities[bi] = graph->_Atoms[neighbors[bi]]->getRelativePriority(cipTable);
+      std::sort(priorities,priorities+4);
+      if (std::adjacent_find(priorities,priorities+4) == priorities+4) {
+        ConfigurationEnum config = atom->calculateStereochemicalConfiguration(cipTable);
+        if (config == R_Configuration) this->_Chirality[ai] = 1;
+        else if (config == S_Configuration) this->_Chirality[ai] = 2;
+      }
+    }
+  }
+  // Bonds between aromatic atoms are aromatic unless they are bridges (like the bond of biphenyl)
+  size_t numEdges = this->_Neighbors.size();
+  std::vector<uint8_t> ringEdge(numEdges,1);
+  std::vector<int32_t> discovered(numAtoms,-1), low(numAtoms,0);
+  struct Frame { uint32_t _Atom; int32_t _Parent; uint32_t _Next; };
+  std::vector<Frame> stack;
+  int32_t time = 0;
+  for ( size_t root=0; root<numAtoms; ++root ) {
+    if (discovered[root] >= 0) continue;
+    discovered[root] = low[root] = time++;
+    stack.push_back(Frame{(uint32_t)root,-1,this->_NeighborStart[root]});
+    while (!stack.empty()) {
+      size_t top = stack.size()-1;
+      uint32_t atom = stack[top]._Atom;
+      if (stack[top]._Next < this->_NeighborStart[atom+1]) {
+        uint32_t other = this->_Neighbors[stack[top]._Next++];
+        if (discovered[other] < 0) {
+          discovered[other] = low[other] = time++;
+          stack.push_back(Frame{other,(int32_t)atom,this->_NeighborStart[other]});
+        } else if ((int32_t)other != stack[top]._Parent) {
+          low[atom] = std::min(low[atom],discovered[other]);
+        }
+        continue;
+      }
+      int32_t parent = stack[top]._Parent;
+      stack.pop_back();
+      if (parent < 0) continue;
+      low[parent] = std::min(low[parent],low[atom]);
+      if (low[atom] > discovered[parent]) {
+        for ( uint32_t edge=this->_NeighborStart[atom]; edge<this->_NeighborStart[atom+1]; ++edge ) {
+          if ((int32_t)this->_Neighbors[edge] == parent) ringEdge[edge] = 0;
+        }
+        for ( uint32_t edge=this->_NeighborStart[parent]; edge<this->_NeighborStart[parent+1]; ++edge ) {
+          if (this->_Neighbors[edge] == atom) ringEdge[edge] = 0;
+        }
+      }
+    }
+  }
+  for ( size_t ai=0; ai<numAtoms; ++ai ) {
+    if (!this->_Aromatic[ai]) continue;
+    for ( uint32_t edge=this->_NeighborStart[ai]; edge<this->_NeighborStart[ai+1]; ++edge ) {
+      if (ringEdge[edge] && this->_Aromatic[this->_Neighbors[edge]] && this->_BondCodes[edge] <= canonicalDoubleBond) {
+        this->_BondCodes[edge] = canonicalAromaticBond;
+      }
+    }
+  }
+  // E/Z of the double bonds that are left - double bonds in rings of fewer than 8 atoms can't be E
+  this->_BondStereo.assign(numEdges,0);
+  if (!stereo) return;
+  core::HashTable_sp cipTable = gc::As_unsafe<core::HashTable_sp>(cip);
+  for ( size_t ai=0; ai<numAtoms; ++ai ) {
+    for ( uint32_t edge=this->_NeighborStart[ai]; edge<this->_NeighborStart[ai+1]; ++edge ) {
+      uint32_t aj = this->_Neighbors[edge];
+      if (aj < ai || this->_BondCodes[edge] != canonicalDoubleBond) continue;
+      uint32_t gi = graphIndex[ai];
+      uint32_t gj = graphIndex[aj];
+      uint32_t ref1, ref2;
+      if (!double_bond_reference(graph,gi,gj,cipTable,ref1) || !double_bond_reference(graph,gj,gi,cipTable,ref2)) continue;
+      if (ringEdge[edge] && in_small_ring(*this,ai,aj,8)) continue;
+      double side = double_bond_side(graph->_Atoms[ref1]->getPosition(),atoms[ai]->getPosition(),
+                                     atoms[aj]->getPosition(),graph->_Atoms[ref2]->getPosition());
+      if (side == 0.0) continue;
+      uint8_t label = (side > 0.0) ? 1 : 2;
+      this->_BondStereo[edge] = label;
+      for ( uint32_t back=this->_NeighborStart[aj]; back<this->_NeighborStart[aj+1]; ++back ) {
+        if (this->_Neighbors[back] == ai) this->_BondStereo[back] = label;
+      }
+    }
+  }
+}
+
+void CanonicalGraph::rank(std::vector<uint32_t>& ranks) const
+{
+  size_t numAtoms = this->numberOfAtoms();
+  ranks.assign(numAtoms,0);
+  if (numAtoms == 0) return;
+  // Initial invariants - degree, element, bonds, charge, hydrogens, aromaticity and CIP label
+  std::vector<uint64_t> invariant(numAtoms);
+  for ( size_t ai=0; ai<numAtoms; ++ai ) {
+    uint64_t degree = this->_NeighborStart[ai+1]-this->_NeighborStart[ai];
+    uint64_t bondSum = 0;
+    for ( uint32_t edge=this->_NeighborStart[ai]; edge<this->_NeighborStart[ai+1]; ++edge ) bondSum += this->_BondCodes[edge];
+    invariant[ai] = (std::min(degree,(uint64_t)255)<<56)
+      | ((uint64_t)this->_AtomicNumbers[ai]<<48)
+      | (std::min(bondSum,(uint64_t)255)<<40)
+      | ((uint64_t)(this->_Charges[ai]+128)<<32)
+      | ((uint64_t)this->_Hydrogens[ai]<<24)
+      | ((uint64_t)this->_Aromatic[ai]<<16)
+      | ((uint64_t)this->_Chirality[ai]<<8);
+  }
+  std::vector<uint32_t> order(numAtoms);
+  std::iota(order.begin(),order.end(),0);
+  std::sort(order.begin(),order.end(),[&invariant] (uint32_t a, uint32_t b) { return invariant[a]<invariant[b]; });
+  uint32_t cls = 0;
+  for ( size_t ii=0; ii<numAtoms; ++ii ) {
+    if (ii>0 && invariant[order[ii]] != invariant[order[ii-1]]) ++cls;
+    ranks[order[ii]] = cls;
+  }
+  // Split classes by the ranks and bonds of their neighbors until nothing changes
+  std::vector<std::vector<uint32_t>> signature(numAtoms);
+  std::vector<uint32_t> newRanks(numAtoms);
+  auto refine = [&] () -> size_t {
+    std::vector<uint32_t> distinct(ranks);
+    std::sort(distinct.begin(),distinct.end());
+    size_t classes = std::unique(distinct.begin(),distinct.end())-distinct.begin();
+    while (true) {
+      for ( size_t ai=0; ai<numAtoms; ++ai ) {
+        signature[ai].clear();
+        for ( uint32_t edge=this->_NeighborStart[ai]; edge<this->_NeighborStart[ai+1]; ++edge ) {
+          signature[ai].push_back((ranks[this->_Neighbors[edge]]*8+this->_BondCodes[edge])*4+this->_BondStereo[edge]);
+        }
+        std::sort(signature[ai].begin(),signature[ai].end());
+      }
+      std::sort(order.begin(),order.end(),[&] (uint32_t a, uint32_t b) {
+        if (ranks[a] != ranks[b]) return ranks[a]<ranks[b];
+        return signature[a]<signature[b];
+      });
+      uint32_t cls = 0;
+      for ( size_t ii=0; ii<numAtoms; ++ii ) {
+        uint32_t cur = order[ii];
+        if (ii>0) {
+          uint32_t prev = order[ii-1];
+          if (ranks[cur] != ranks[prev] || signature[cur] != signature[prev]) ++cls;
+        }
+        newRanks[cur] = cls;
+      }
+      ranks.swap(newRanks);
+      if (cls+1 == classes) return classes;
+      classes = cls+1;
+    }
+  };
+  // Break ties as in Weininger's CANON - split the lowest tied class by
+  // promoting one of its atoms and refine again until every rank is distinct.
+  std::vector<uint32_t> counts;
+  while (refine() < numAtoms) {
+    counts.assign(numAtoms,0);
+    for ( size_t ai=0; ai<numAtoms; ++ai ) counts[ranks[ai]]++;
+    uint32_t tied = 0;
+    while (counts[tied] < 2) ++tied;
+    size_t chosen = 0;
+    while (ranks[chosen] != tied) ++chosen;
+    // Odd ranks keep the order of the classes and leave room below the tied class
+    // for the chosen atom even when the tied class is rank 0
+    for ( size_t ai=0; ai<numAtoms; ++ai ) ranks[ai] = ranks[ai]*2+1;
+    ranks[chosen] -= 1;
+  }
+}
+
+static int default_valence(const std::string& symbol, int bondSum)
+{
+  static const int valencesB[] = {3,-1}, valencesC[] = {4,-1}, valencesN[] = {3,5,-1}, valencesO[] = {2,-1};
+  static const int valencesP[] = {3,5,-1}, valencesS[] = {2,4,6,-1}, valencesX[] = {1,-1};
+  const int* valences = NULL;
+  if (symbol == "B") valences = valencesB;
+  else if (symbol == "C") valences = valencesC;
+  else if (symbol == "N") valences = valencesN;
+  else if (symbol == "O") valences = valencesO;
+  else if (symbol == "P") valences = valencesP;
+  else if (symbol == "S") valences = valencesS;
+  else if (symbol == "F" || symbol == "Cl" || symbol == "Br" || symbol == "I") valences = valencesX;
+  if (!valences) return -1;
+  for ( const int* cur=valences; *cur>=0; ++cur ) {
+    if (*cur >= bondSum) return *cur;
+  }
+  return bondSum;
+}
+
+std::string CanonicalGraph::smiles(const std::vector<uint32_t>& ranks, size_t& unwrittenStereo) const
+{
+  size_t numAtoms = this->numberOfAtoms();
+  std::string out;
+  unwrittenStereo = 0;
+  if (numAtoms == 0) return out;
+  // The half edges of every atom ordered by the rank of the neighbor
+  std::vector<uint32_t> sortedEdges(this->_Neighbors.size());
+  std::iota(sortedEdges.begin(),sortedEdges.end(),0);
+  for ( size_t ai=0; ai<numAtoms; ++ai ) {
+    std::sort(sortedEdges.begin()+this->_NeighborStart[ai],sortedEdges.begin()+this->_NeighborStart[ai+1],
+              [&] (uint32_t a, uint32_t b) { return ranks[this->_Neighbors[a]]<ranks[this->_Neighbors[b]]; });
+  }
+  std::vector<uint32_t> reverseEdge(this->_Neighbors.size());
+  for ( size_t ai=0; ai<numAtoms; ++ai ) {
+    for ( uint32_t edge=this->_NeighborStart[ai]; edge<this->_NeighborStart[ai+1]; ++edge ) {
+      uint32_t other = this->_Neighbors[edge];
+      for ( uint32_t back=this->_NeighborStart[other]; back<this->_NeighborStart[other+1]; ++back ) {
+        if (this->_Neighbors[back] == ai) reverseEdge[edge] = back;
+      }
+    }
+  }
+  std::vector<uint32_t> atomsByRank(numAtoms);
+  for ( size_t ai=0; ai<numAtoms; ++ai ) atomsByRank[ranks[ai]] = ai;
+  // Depth first search from the lowest ranked atom of every component visiting neighbors in
+  // rank order.  Edges back to atoms already seen become ring closures.
+  std::vector<int32_t> parent(numAtoms,-1);
+  std::vector<uint8_t> seen(numAtoms,0), edgeDone(this->_Neighbors.size(),0);
+  std::vector<std::vector<uint32_t>> children(numAtoms);   // half edges to the children
+  std::vector<std::vector<uint32_t>> closures(numAtoms);   // ring closure ids
+  std::vector<uint32_t> closureEdge;                       // the half edge from the opening atom
+  std::vector<uint32_t> roots;
+  std::vector<std::pair<uint32_t,uint32_t>> stack;
+  for ( uint32_t root : atomsByRank ) {
+    if (seen[root]) continue;
+    roots.push_back(root);
+    seen[root] = 1;
+    stack.emplace_back(root,this->_NeighborStart[root]);
+    while (!stack.empty()) {
+      uint32_t atom = stack.back().first;
+      uint32_t pos = stack.back().second;
+      if (pos == this->_NeighborStart[atom+1]) {
+        stack.pop_back();
+        continue;
+      }
+      stack.back().second++;
+      uint32_t edge = sortedEdges[pos];
+      if (edgeDone[edge]) continue;
+      edgeDone[edge] = edgeDone[reverseEdge[edge]] = 1;
+      uint32_t other = this->_Neighbors[edge];
+      if (!seen[other]) {
+        seen[other] = 1;
+        parent[other] = atom;
+        children[atom].push_back(edge);
+        stack.emplace_back(other,this->_NeighborStart[other]);
+      } else {
+        // other is an ancestor of atom and is written first so the ring opens there
+        closures[other].push_back(closureEdge.size());
+        closures[atom].push_back(closureEdge.size());
+        closureEdge.push_back(reverseEdge[edge]);
+      }
+    }
+  }
+  // Single bonds next to stereogenic double bonds get / or \.  A bond is written from its parent
+  // or from the atom that opens its ring closure and direction holds 1 for / and -1 for \ on that
+  // half edge.  side(edge) is 1 if the far atom of edge is above the atom it starts from, -1 if it
+  // is below and 0 if the bond has no direction.
+  std::vector<int32_t> writtenEdge(this->_Neighbors.size(),-1);
+  for ( size_t ai=0; ai<numAtoms; ++ai ) {
+    for ( uint32_t edge : children[ai] ) writtenEdge[edge] = writtenEdge[reverseEdge[edge]] = edge;
+  }
+  for ( uint32_t edge : closureEdge ) writtenEdge[edge] = writtenEdge[reverseEdge[edge]] = edge;
+  std::vector<int8_t> direction(this->_Neighbors.size(),0);
+  auto side = [&] (uint32_t edge) -> int {
+    uint32_t written = writtenEdge[edge];
+    return (written == edge) ? direction[written] : -direction[written];
+  };
+  auto setSide = [&] (uint32_t edge, int up) {
+    uint32_t written = writtenEdge[edge];
+    direction[written] = (written == edge) ? up : -up;
+  };
+  for ( uint32_t atom : atomsByRank ) {
+    for ( uint32_t pos=this->_NeighborStart[atom]; pos<this->_NeighborStart[atom+1]; ++pos ) {
+      uint32_t bond = sortedEdges[pos];
+      uint32_t partner = this->_Neighbors[bond];
+      if (!this->_BondStereo[bond] || ranks[partner] < ranks[atom]) continue;
+      // On each end use a single bond that already has a direction if there is one
+      uint32_t ends[2] = {atom,partner};
+      int32_t chosen[2] = {-1,-1};
+      for ( int end=0; end<2; ++end ) {
+        for ( uint32_t epos=this->_NeighborStart[ends[end]]; epos<this->_NeighborStart[ends[end]+1]; ++epos ) {
+          uint32_t edge = sortedEdges[epos];
+          if (this->_Neighbors[edge] == ends[1-end] || this->_BondCodes[edge] != canonicalSingleBond) continue;
+          if (chosen[end] < 0 || (side(chosen[end]) == 0 && side(edge) != 0)) chosen[end] = edge;
+        }
+      }
+      if (chosen[0] < 0 || chosen[1] < 0) {
+        // Only hydrogens that were folded into the atom are on one end
+        unwrittenStereo++;
+        continue;
+      }
+      const double* xyz[4] = {&this->_Positions[this->_Neighbors[chosen[0]]*3],&this->_Positions[atom*3],
+                              &this->_Positions[partner*3],&this->_Positions[this->_Neighbors[chosen[1]]*3]};
+      double same = double_bond_side(Vector3(xyz[0][0],xyz[0][1],xyz[0][2]),Vector3(xyz[1][0],xyz[1][1],xyz[1][2]),
+                                     Vector3(xyz[2][0],xyz[2][1],xyz[2][2]),Vector3(xyz[3][0],xyz[3][1],xyz[3][2]));
+      int relation = (same > 0.0) ? 1 : -1;
+      int side0 = side(chosen[0]);
+      int side1 = side(chosen[1]);
+      if (same == 0.0 || (side0 != 0 && side1 != 0 && side0*side1 != relation)) {
+        // Collinear substituents or both directions already fixed the wrong way by other double bonds
+        unwrittenStereo++;
+        continue;
+      }
+      if (side0 == 0 && side1 == 0) {
+        setSide(chosen[0],1);
+        side0 = 1;
+      }
+      if (side0 != 0) setSide(chosen[1],side0*relation);
+      else setSide(chosen[0],side1*relation);
+    }
+  }
+  auto bondSymbol = [&] (uint32_t edge) -> const char* {
+    switch (this->_BondCodes[edge]) {
+    case canonicalDoubleBond: return "=";
+    case canonicalTripleBond: return "#";
+    case canonicalAromaticBond: return "";
+    default:
+        break;
+    }
+    if (direction[edge] != 0) return (direction[edge] > 0) ? "/" : "\\";
+    uint32_t from = this->_Neighbors[reverseEdge[edge]];
+    return (this->_Aromatic[from] && this->_Aromatic[this->_Neighbors[edge]]) ? "-" : "";
+  };
+  std::vector<int32_t> closureDigit(closureEdge.size(),-1);
+  std::vector<uint8_t> digitUsed;
+  auto writeAtom = [&] (uint32_t atom) {
+    // Neighbor order for @/@@ - the atom before, the implicit hydrogen, ring closures then children
+    int32_t neighborOrder[4];
+    int numNeighbors = 0;
+    bool withHydrogen = false;
+    auto addNeighbor = [&] (int32_t index) {
+      if (numNeighbors<4) neighborOrder[numNeighbors] = index;
+      numNeighbors++;
+    };
+    if (parent[atom] >= 0) addNeighbor(parent[atom]);
+    if (this->_Chirality[atom] && this->_Hydrogens[atom] == 1) {
+      addNeighbor(-1);
+      withHydrogen = true;
+    }
+    // Ring closures are written closing ones first
+    for ( uint32_t cid : closures[atom] ) {
+      if (closureDigit[cid] >= 0) addNeighbor(this->_Neighbors[reverseEdge[closureEdge[cid]]]);
+    }
+    for ( uint32_t cid : closures[atom] ) {
+      if (closureDigit[cid] < 0) addNeighbor(this->_Neighbors[closureEdge[cid]]);
+    }
+    for ( uint32_t edge : children[atom] ) addNeighbor(this->_Neighbors[edge]);
+    const char* chirality = "";
+    if (this->_Chirality[atom] && numNeighbors == 4 && this->_Hydrogens[atom] == (withHydrogen ? 1 : 0)) {
+      Vector3 center(this->_Positions[atom*3],this->_Positions[atom*3+1],this->_Positions[atom*3+2]);
+      Vector3 pos[4];
+      for ( int ii=0; ii<4; ++ii ) {
+        const double* xyz = (neighborOrder[ii]<0) ? &this->_HydrogenPositions[atom*3] : &this->_Positions[neighborOrder[ii]*3];
+        pos[ii] = Vector3(xyz[0],xyz[1],xyz[2]);
+      }
+      // Looking from the first neighbor the other three are anticlockwise for @
+      double volume = (pos[1]-pos[0]).dotProduct((pos[2]-pos[0]).crossProduct(pos[3]-pos[0]));
+      if (std::isfinite(volume) && fabs(volume) > 1.0e-6) chirality = (volume < 0.0) ? "@" : "@@";
+    }
+    const std::string& element = this->_Symbols[atom];
+    std::string symbol = element;
+    if (this->_Aromatic[atom]) std::transform(symbol.begin(),symbol.end(),symbol.begin(),::tolower);
+    int bondSum = this->_Aromatic[atom] ? 1 : 0;
+    for ( uint32_t edge=this->_NeighborStart[atom]; edge<this->_NeighborStart[atom+1]; ++edge ) {
+      bondSum += (this->_BondCodes[edge] == canonicalAromaticBond) ? 1 : this->_BondCodes[edge];
+    }
+    int valence = default_valence(element,bondSum);
+    bool organic = (valence >= 0) && (!this->_Aromatic[atom] || element == "B" || element == "C" || element == "N"
+                                      || element == "O" || element == "P" || element == "S");
+    int implied = organic ? valence-bondSum : 0;
+    int hydrogens = this->_ImplicitHydrogens ? implied : this->_Hydrogens[atom];
+    int charge = this->_Charges[atom];
+    if (organic && charge == 0 && chirality[0] == '\0' && hydrogens == implied) {
+      out += symbol;
+    } else {
+      out += '[';
+      out += symbol;
+      out += chirality;
+      if (hydrogens > 0) {
+        out += 'H';
+        if (hydrogens > 1) out += std::to_string(hydrogens);
+      }
+      if (charge != 0) {
+        out += (charge > 0) ? '+' : '-';
+        if (std::abs(charge) > 1) out += std::to_string(std::abs(charge));
+      }
+      out += ']';
+    }
+    // Close rings first, then open new ones with the lowest free digits
+    std::vector<uint32_t> freed;
+    for ( uint32_t cid : closures[atom] ) {
+      if (closureDigit[cid] < 0) continue;
+      int32_t digit = closureDigit[cid];
+      out += (digit < 10) ? std::to_string(digit) : "%" + std::to_string(digit);
+      freed.push_back(digit);
+    }
+    for ( uint32_t cid : closures[atom] ) {
+      if (closureDigit[cid] >= 0) continue;
+      int32_t digit = 1;
+      while (digit < (int32_t)digitUsed.size() && digitUsed[digit]) ++digit;
+      if (digit >= (int32_t)digitUsed.size()) digitUsed.resize(digit+1,0);
+      digitUsed[digit] = 1;
+      closureDigit[cid] = digit;
+      out += bondSymbol(closureEdge[cid]);
+      out += (digit < 10) ? std::to_string(digit) : "%" + std::to_string(digit);
+    }
+    for ( uint32_t digit : freed ) digitUsed[digit] = 0;
+  };
+  // Write every tree with a stack - a branch is pushed as (child, edge, paren) then ')'
+  struct Item { uint32_t _Atom; int32_t _Edge; int8_t _Kind; };   // _Kind 0 atom, 1 branch, 2 close
+  std::vector<Item> items;
+  for ( size_t ri=0; ri<roots.size(); ++ri ) {
+    if (ri>0) out += '.';
+    items.push_back(Item{roots[ri],-1,0});
+    while (!items.empty()) {
+      Item item = items.back();
+      items.pop_back();
+      if (item._Kind == 2) {
+        out += ')';
+        continue;
+      }
+      if (item._Kind == 1) out += '(';
+      if (item._Edge >= 0) out += bondSymbol(item._Edge);
+      writeAtom(item._Atom);
+      const std::vector<uint32_t>& kids = children[item._Atom];
+      if (kids.empty()) continue;
+      items.push_back(Item{this->_Neighbors[kids.back()],(int32_t)kids.back(),0});
+      for ( size_t ki=kids.size()-1; ki-->0; ) {
+        items.push_back(Item{0,-1,2});
+        items.push_back(Item{this->_Neighbors[kids[ki]],(int32_t)kids[ki],1});
+      }
+    }
+  }
+  return out;
+}
+
+uint64_t canonical_smiles_hash(const std::string& smiles)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for ( unsigned char ch : smiles ) {
+    hash ^= ch;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+CL_LAMBDA(molecule &key (stereo t));
+CL_DOCSTRING(R"dx(Return a hash table that maps the atoms of molecule to their canonical ranks starting at 1.
+Hydrogens bonded to other atoms are not ranked.  Atoms are ranked by iterative refinement of atom
+invariants (degree, element, bonds, charge, hydrogens, aromaticity and - if stereo is true - the R/S
+label of CIP stereocenters and the E/Z label of double bonds) with ties broken as in Weininger's CANON.  Aromatic atoms are taken from
+chem:*current-aromaticity-information* when it is bound.)dx");
+DOCGROUP(cando);
+CL_DEFUN core::HashTable_sp chem__canonical_atom_ranks(Molecule_sp molecule, bool stereo)
+{
+  CanonicalGraph graph;
+  gctools::Vec0<Atom_sp> atoms;
+  graph.extract(molecule,stereo,atoms);
+  std::vector<uint32_t> ranks;
+  graph.rank(ranks);
+  core::HashTable_sp result = core::HashTableEq_O::create_default();
+  for ( size_t ai=0; ai<atoms.size(); ++ai ) result->setf_gethash(atoms[ai],core::make_fixnum(ranks[ai]+1));
+  return result;
+}
+
+CL_LAMBDA(molecules &key (stereo t));
+CL_DOCSTRING(R"dx(Return the canonical SMILES string and 64 bit canonical hash of one or more molecules.
+molecules is a molecule, an aggregate or a list or simple-vector of molecules.  For one molecule
+return (values smiles hash), otherwise return (values smiles-vector hash-vector) in the order of
+the molecules.  The molecules are pulled into flat graphs one after the other and then ranked and
+written in parallel.  Aromatic atoms are taken from chem:*current-aromaticity-information* when it
+is bound (see smiles:canonical-smiles) and bonds with the :aromatic-bond order are always aromatic.
+When stereo is true CIP stereocenters are written with @/@@ and stereogenic double bonds with / and \
+from the coordinates.  A warning is signaled for every molecule with a stereogenic double bond that can't
+be written that way (one end has only hydrogens or the bond directions conflict).)dx");
+DOCGROUP(cando);
+CL_DEFUN core::T_mv chem__canonical_smiles(core::T_sp molecules, bool stereo)
+{
+  gctools::Vec0<Molecule_sp> mols;
+  bool single = false;
+  if (gc::IsA<Molecule_sp>(molecules)) {
+    mols.push_back(gc::As_unsafe<Molecule_sp>(molecules));
+    single = true;
+  } else if (gc::IsA<Aggregate_sp>(molecules)) {
+    Aggregate_sp agg = gc::As_unsafe<Aggregate_sp>(molecules);
+    for ( size_t mi=0, endMi(agg->contentSize()); mi<endMi; ++mi ) mols.push_back(gc::As<Molecule_sp>(agg->contentAt(mi)));
+  } else if (gc::IsA<core::SimpleVector_sp>(molecules)) {
+    core::SimpleVector_sp vec = gc::As_unsafe<core::SimpleVector_sp>(molecules);
+    for ( size_t mi=0; mi<vec->length(); ++mi ) mols.push_back(gc::As<Molecule_sp>((*vec)[mi]));
+  } else if (molecules.consp() || molecules.nilp()) {
+    for ( auto cur : gc::As<core::List_sp>(molecules) ) mols.push_back(gc::As<Molecule_sp>(CONS_CAR(cur)));
+  } else {
+    SIMPLE_ERROR("molecules must be a molecule, an aggregate or a list or simple-vector of molecules - got {}", _rep_(molecules));
+  }
+  size_t numMolecules = mols.size();
+  std::vector<CanonicalGraph> graphs(numMolecules);
+  gctools::Vec0<Atom_sp> atoms;
+  for ( size_t mi=0; mi<numMolecules; ++mi ) {
+    graphs[mi].extract(mols[mi],stereo,atoms);
+    gctools::handle_all_queued_interrupts();
+  }
+  std::vector<std::string> smiles(numMolecules);
+  std::vector<uint64_t> hashes(numMolecules);
+  std::vector<size_t> unwrittenStereo(numMolecules);
+  std::atomic<size_t> next(0);
+  auto worker = [&] () {
+    std::vector<uint32_t> ranks;
+    for ( size_t mi=next++; mi<numMolecules; mi=next++ ) {
+      graphs[mi].rank(ranks);
+      smiles[mi] = graphs[mi].smiles(ranks,unwrittenStereo[mi]);
+      hashes[mi] = canonical_smiles_hash(smiles[mi]);
+    }
+  };
+  size_t numThreads = std::max(1U,std::thread::hardware_concurrency());
+  numThreads = std::max((size_t)1,std::min(numThreads,numMolecules/CANONICAL_SMILES_MOLECULES_PER_THREAD));
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads-1);
+  for ( size_t tid=1; tid<numThreads; ++tid ) threads.emplace_back(worker);
+  worker();
+  for ( auto& thread : threads ) thread.join();
+  for ( size_t mi=0; mi<numMolecules; ++mi ) {
+    if (unwrittenStereo[mi] == 0) continue;
+    core::eval::funcall(cl::_sym_warn,
+                        core::Str_O::create("The E/Z configuration of ~a double bond~:p of ~a could not be written in the canonical SMILES"),
+                        core::make_fixnum(unwrittenStereo[mi]),
+                        mols[mi]);
+  }
+  if (single) {
+    return Values(core::SimpleBaseString_O::make(smiles[0]),core::Integer_O::create(hashes[0]));
+  }
+  core::SimpleVector_sp smilesVector = core::SimpleVector_O::make(numMolecules);
+  core::SimpleVector_sp hashVector = core::SimpleVector_O::make(numMolecules);
+  for ( size_t mi=0; mi<numMolecules; ++mi ) {
+    (*smilesVector)[mi] = core::SimpleBaseString_O::make(smiles[mi]);
+    (*hashVector)[mi] = core::Integer_O::create(hashes[mi]);
+  }
+  return Values(smilesVector,hashVector);
+}
+
+};
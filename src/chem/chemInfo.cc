@@ -47,6 +47,7 @@ at mailto:techtransfer@temple.edu if you would like a different license.
 #include <clasp/core/designators.h>
 #include <cando/chem/loop.h>
 #include <cando/chem/chemInfo.h>
+#include <cando/chem/chemInfoMatcher.h>
 #include <clasp/core/hashTableEqual.h>
 #include <clasp/core/hashTableEql.h>
 //#include "core/archiveNode.h"
@@ -870,48 +871,51 @@ CL_DEFUN bool chem__in_aromatic_bond(Atom_sp a1, Atom_sp a2) {
   return _matchInAromaticBond(a1, a2);
 }
 
-bool _matchBondTypes(BondEnum be, chem::BondOrder bo, Atom_sp a1, Atom_sp a2) {
+/*! Match the BondEnum against the bond order.  (inAromaticBond) is only called for
+    the BondEnums that care about aromaticity so that the ring search stays lazy. */
+template <typename AromaticTest>
+bool _matchBondTypesImpl(BondEnum be, chem::BondOrder bo, AromaticTest inAromaticBond) {
   LOG("bondOrder = {}", bondOrderToString(bo).c_str());
   switch (be) {
   case SABSingleBond:
     LOG("SMARTS BondEnum = SABSingleBond");
     if (!Bond_O::singleBondP(bo))
       goto nomatch;
-    if (_matchInAromaticBond(a1, a2))
+    if (inAromaticBond())
       goto nomatch;
     break;
   case SABSingleOrAromaticBond:
     LOG("SMARTS BondEnum = SABSingleOrAromaticBond");
-    if (!(Bond_O::singleBondP(bo) || bo == chem::aromaticBond || _matchInAromaticBond(a1, a2)))
+    if (!(Bond_O::singleBondP(bo) || bo == chem::aromaticBond || inAromaticBond()))
       goto nomatch;
     break;
   case SABDoubleOrAromaticBond:
     LOG("SMARTS BondEnum = SABDoubleOrAromaticBond");
-    if (!(bo == chem::doubleBond || bo == chem::aromaticBond || _matchInAromaticBond(a1, a2)))
+    if (!(bo == chem::doubleBond || bo == chem::aromaticBond || inAromaticBond()))
       goto nomatch;
     break;
   case SABTripleOrAromaticBond:
     LOG("SMARTS BondEnum = SABTripleOrAromaticBond");
-    if (!(bo == chem::tripleBond || bo == chem::aromaticBond || _matchInAromaticBond(a1, a2)))
+    if (!(bo == chem::tripleBond || bo == chem::aromaticBond || inAromaticBond()))
       goto nomatch;
     break;
   case SABDoubleBond:
     LOG("SMARTS BondEnum = SABDoubleBond");
     if (bo != chem::doubleBond)
       goto nomatch;
-    if (_matchInAromaticBond(a1, a2))
+    if (inAromaticBond())
       goto nomatch;
     break;
   case SABTripleBond:
     LOG("SMARTS BondEnum = SABTriple");
     if (bo != chem::tripleBond)
       goto nomatch;
-    if (_matchInAromaticBond(a1, a2))
+    if (inAromaticBond())
       goto nomatch;
     break;
   case SABAromaticBond:
     LOG("SMARTS BondEnum = SABAromaticBond");
-    if (!(bo == chem::aromaticBond || _matchInAromaticBond(a1, a2)))
+    if (!(bo == chem::aromaticBond || inAromaticBond()))
       goto nomatch;
     break;
   case SABAnyBond:
@@ -938,6 +942,14 @@ nomatch:
   return false;
 }
 
+bool _matchBondTypes(BondEnum be, chem::BondOrder bo, Atom_sp a1, Atom_sp a2) {
+  return _matchBondTypesImpl(be, bo, [&a1, &a2]() { return _matchInAromaticBond(a1, a2); });
+}
+
+bool _matchBondTypesGivenAromaticity(BondEnum be, chem::BondOrder bo, bool inAromaticBond) {
+  return _matchBondTypesImpl(be, bo, [inAromaticBond]() { return inAromaticBond; });
+}
+
 SYMBOL_EXPORT_SC_(ChemPkg, STARcurrent_ringsSTAR);
 SYMBOL_EXPORT_SC_(ChemPkg, make_rings);
 SYMBOL_EXPORT_SC_(ChemPkg, rings_rings);
@@ -2702,7 +2714,7 @@ CL_DEFUN MoleculeGraph_sp chem__make_molecule_graph() {
 
 CL_LAMBDA(matter &optional (exclude_hydrogens nil));
 DOCGROUP(cando);
-CL_DEFUN MoleculeGraph_sp chem__make_molecule_graph_from_molecule(Molecule_sp matter, bool exclude_hydrogens) {
+CL_DEFUN MoleculeGraph_sp chem__make_molecule_graph_from_molecule(Matter_sp matter, bool exclude_hydrogens) {
   auto graph = gctools::GC<MoleculeGraph_O>::allocate(matter);
   Loop lMol;
   Loop lAtoms;
@@ -2731,9 +2743,12 @@ CL_DEFUN MoleculeGraph_sp chem__make_molecule_graph_from_molecule(Molecule_sp ma
     Atom_sp a2 = lbonds.getAtom2();
     if (!exclude_hydrogens || (exclude_hydrogens && (a1->getAtomicNumber() != 1) && (a2->getAtomicNumber() != 1))) {
       BondOrder bo = lbonds.getBondOrder();
-      int atom1_index = graph->_nodes_to_index->gethash(a1).unsafe_fixnum();
-      int atom2_index = graph->_nodes_to_index->gethash(a2).unsafe_fixnum();
-      boost::add_edge(atom1_index, atom2_index, bo, *graph->_moleculeGraph);
+      core::T_sp index1 = graph->_nodes_to_index->gethash(a1);
+      core::T_sp index2 = graph->_nodes_to_index->gethash(a2);
+      // The bonds of a residue include the ones that leave it
+      if (!index1.fixnump() || !index2.fixnump())
+        continue;
+      boost::add_edge(index1.unsafe_fixnum(), index2.unsafe_fixnum(), bo, *graph->_moleculeGraph);
     }
   }
   return graph;
@@ -2757,7 +2772,7 @@ CL_DEFUN void chem__molecule_graph_dump(MoleculeGraph_sp graph) {
   }
 }
 
-ChemInfoGraph_O::ChemInfoGraph_O(Root_sp root) : _Root(root), _chemInfoGraph(nullptr){};
+ChemInfoGraph_O::ChemInfoGraph_O(Root_sp root) : _Root(root), _chemInfoGraph(nullptr), _Compiled(nil<core::T_O>()){};
 ChemInfoGraph_O::~ChemInfoGraph_O() {
   if (this->_chemInfoGraph) {
     delete this->_chemInfoGraph;
@@ -2788,6 +2803,7 @@ void ChemInfoGraph_O::buildFromRoot_() {
   this->_atomNodes.clear();
   this->_bondNodes.clear();
   this->_chemInfoGraph = NULL;
+  this->_Compiled = nil<core::T_O>();
   ChemInfoGraph_sp graph = this->asSmartPtr();
   Root_sp pattern = graph->_Root;
   std::vector<RingClosers> closers;
@@ -3192,8 +3208,24 @@ struct MatchCallback {
 
 #endif
 
+CL_DOCSTRING(R"dx(Return a list of tag vectors, one for every induced subgraph of the molecule-graph that matches the chem-info-graph.
+The pattern is compiled the first time and matched with the compiled matcher - pass molecule-invariants made by
+chem:make-molecule-invariants from the molecule-graph to share them between patterns.)dx");
+CL_LAMBDA(chem-info-graph molecule-graph &optional molecule-invariants);
+DOCGROUP(cando);
+CL_DEFUN core::List_sp chem__boost_graph_vf2(ChemInfoGraph_sp chemInfoGraph, MoleculeGraph_sp moleculeGraph, core::T_sp moleculeInvariants) {
+  MoleculeInvariants_sp invariants = moleculeInvariants.notnilp()
+    ? gc::As<MoleculeInvariants_sp>(moleculeInvariants)
+    : MoleculeInvariants_O::make(moleculeGraph);
+  if (invariants->_MoleculeGraph != moleculeGraph)
+    SIMPLE_ERROR("The molecule-invariants {} were not made from the molecule-graph {}", _rep_(invariants), _rep_(moleculeGraph));
+  return CompiledChemInfo_O::compiledGraph(chemInfoGraph)->search(invariants, -1, true, false);
+}
+
+CL_DOCSTRING(R"dx(Match the chem-info-graph against the molecule-graph with boost::vf2_subgraph_iso and the original atom and bond tests.
+This is what chem:boost-graph-vf2 did before it used the compiled matcher and it is kept to check the compiled matcher against.)dx");
 DOCGROUP(cando);
-CL_DEFUN core::List_sp chem__boost_graph_vf2(ChemInfoGraph_sp chemInfoGraph, MoleculeGraph_sp moleculeGraph) {
+CL_DEFUN core::List_sp chem__boost_graph_vf2_uncompiled(ChemInfoGraph_sp chemInfoGraph, MoleculeGraph_sp moleculeGraph) {
   if (boost::num_vertices(*chemInfoGraph->_chemInfoGraph) > boost::num_vertices(*moleculeGraph->_moleculeGraph)) {
     return nil<core::T_O>();
   }
@@ -0,0 +1,832 @@
+/*
+    File: chemInfoMatcher.cc
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University
+at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+/* -^- */
+#define DEBUG_LEVEL_NONE
+
+//
+// Compiled chem-info matching
+//
+// A ChemInfoGraph is compiled into a CompiledChemInfo once and a molecule is
+// turned into MoleculeInvariants once.  The per-atom properties that the SMARTS
+// primitives look at (aromaticity, ring membership and sizes, degree, hydrogen count ...)
+// are computed up front so the inner loop of the subgraph search compares integers
+// and bit masks rather than walking the ring lists and hash tables for every test.
+//
+
+#include <clasp/core/common.h>
+#include <clasp/core/hashTableEq.h>
+#include <clasp/core/hashTableEql.h>
+#include <clasp/core/evaluator.h>
+#include <cando/chem/chemInfo.h>
+#include <cando/chem/chemInfoMatcher.h>
+#include <cando/chem/atom.h>
+#include <cando/chem/bond.h>
+#include <cando/chem/elements.h>
+#include <clasp/core/wrappers.h>
+
+namespace chem {
+
+SYMBOL_EXPORT_SC_(ChemPkg, STARcurrent_ringsSTAR);
+SYMBOL_EXPORT_SC_(ChemPkg, STARcurrent_aromaticity_informationSTAR);
+SYMBOL_EXPORT_SC_(ChemPkg, STARcurrent_matchSTAR);
+
+MoleculeInvariants_sp MoleculeInvariants_O::make(MoleculeGraph_sp graph) {
+  auto inv = gctools::GC<MoleculeInvariants_O>::allocate(graph);
+  size_t numAtoms = graph->num_vertices();
+  inv->_RingsAvailable = _sym_STARcurrent_ringsSTAR->boundP();
+  inv->_AromaticityAvailable = aromatic_information_available_p();
+  inv->_Atoms.reserve(numAtoms);
+  for (size_t ai = 0; ai < numAtoms; ++ai) {
+    Atom_sp atom = gc::As<Atom_sp>(graph->get_vertex(ai));
+    AtomInvariants ainv(atom);
+    ainv._Element = atom->getElementAsSymbol();
+    ainv._ElementEnum = atom->getElement();
+    ainv._AtomicNumber = atom->getAtomicNumber();
+    ainv._AtomicMass = atom->getIntegerAtomicMass();
+    ainv._HCount = atom->getBondedHydrogenCount();
+    ainv._Degree = atom->numberOfBonds();
+    ainv._Ionization = atom->getIonization();
+    ainv._Valence = atom->getValence();
+    if (is_aromatic(atom)) ainv._Bits |= invariant::Aromatic;
+    if (atom->isInRing()) ainv._Bits |= invariant::InRing;
+    Element el = ainv._ElementEnum;
+    if (el == element_O || el == element_N || el == element_F || el == element_Cl || el == element_Br)
+      ainv._Bits |= invariant::Electronegative;
+    ainv._Bits |= invariant::degree(ainv._Degree);
+    ainv._Bits |= invariant::hcount(ainv._HCount);
+    inv->_Atoms.push_back(ainv);
+  }
+  // Ring membership - each atom gets the indices of the rings that it is in
+  std::vector<std::vector<size_t>> atomRings(numAtoms);
+  if (inv->_RingsAvailable) {
+    core::List_sp rings = _sym_STARcurrent_ringsSTAR->symbolValue();
+    size_t ringIndex = 0;
+    for (auto ring_cur : rings) {
+      core::T_sp ring = CONS_CAR(ring_cur);
+      if (!ring.consp()) continue;
+      size_t ringSize = core::cl__length(ring);
+      for (auto atom_cur : (core::List_sp)ring) {
+        core::T_sp index = graph->_nodes_to_index->gethash(CONS_CAR(atom_cur));
+        if (!index.fixnump()) continue;
+        size_t ai = index.unsafe_fixnum();
+        inv->_Atoms[ai]._RingCount++;
+        if (ringSize < 64) inv->_Atoms[ai]._RingSizes |= (1ull << ringSize);
+        atomRings[ai].push_back(ringIndex);
+      }
+      ringIndex++;
+    }
+  }
+  for (size_t ai = 0; ai < numAtoms; ++ai) {
+    AtomInvariants& ainv = inv->_Atoms[ai];
+    ainv._Bits |= invariant::ringCount(ainv._RingCount);
+    for (int size = invariant::RingSizeMin; size <= invariant::RingSizeMax; ++size) {
+      if (ainv._RingSizes & (1ull << size)) ainv._Bits |= invariant::ringSize(size);
+    }
+  }
+  // Build the CSR adjacency from the edges of the molecule graph
+  std::vector<std::vector<std::pair<size_t, BondOrder>>> adjacency(numAtoms);
+  boost::property_map<MoleculeGraphType, boost::edge_weight_t>::type weights =
+      boost::get(boost::edge_weight_t(), *graph->_moleculeGraph);
+  boost::graph_traits<MoleculeGraphType>::edge_iterator ei, ei_end;
+  for (boost::tie(ei, ei_end) = boost::edges(*graph->_moleculeGraph); ei != ei_end; ++ei) {
+    size_t a1 = boost::source(*ei, *graph->_moleculeGraph);
+    size_t a2 = boost::target(*ei, *graph->_moleculeGraph);
+    BondOrder bo = weights[*ei];
+    adjacency[a1].emplace_back(a2, bo);
+    adjacency[a2].emplace_back(a1, bo);
+  }
+  auto share_ring = [&atomRings](size_t a1, size_t a2) {
+    for (size_t r1 : atomRings[a1])
+      for (size_t r2 : atomRings[a2])
+        if (r1 == r2) return true;
+    return false;
+  };
+  inv->_NeighborStart.reserve(numAtoms + 1);
+  for (size_t ai = 0; ai < numAtoms; ++ai) {
+    inv->_NeighborStart.push_back(inv->_Neighbors.size());
+    for (auto& nb : adjacency[ai]) {
+      bool sameRing = share_ring(ai, nb.first);
+      bool inAromaticBond = inv->_AromaticityAvailable && sameRing && (inv->_Atoms[ai]._Bits & invariant::Aromatic) &&
+                            (inv->_Atoms[nb.first]._Bits & invariant::Aromatic);
+      inv->_Neighbors.push_back(InvariantEdge(nb.first, nb.second, inAromaticBond, sameRing));
+    }
+  }
+  inv->_NeighborStart.push_back(inv->_Neighbors.size());
+  return inv;
+}
+
+const InvariantEdge* MoleculeInvariants_O::edge(size_t a1, size_t a2) const {
+  for (size_t ei = this->_NeighborStart[a1]; ei < this->_NeighborStart[a1 + 1]; ++ei) {
+    if (this->_Neighbors[ei]._Neighbor == a2)
+      return &this->_Neighbors[ei];
+  }
+  return NULL;
+}
+
+/*! Collect the constraints that must hold for the node to match.
+    Only the conjunctive part of the test is looked at - anything under an OR or NOT
+    is left to the full evaluation. */
+void CompiledChemInfo_O::compileVertexConstraints(core::T_sp tnode, CompiledChemInfoVertex& vertex) {
+  if (tnode.nilp())
+    return;
+  if (gc::IsA<Chain_sp>(tnode)) {
+    // The head of an antechamber rule is the focus atom
+    compileVertexConstraints(gc::As_unsafe<Chain_sp>(tnode)->_Head, vertex);
+    return;
+  }
+  if (gc::IsA<AntechamberFocusAtomMatch_sp>(tnode)) {
+    AntechamberFocusAtomMatch_sp focus = gc::As_unsafe<AntechamberFocusAtomMatch_sp>(tnode);
+    if (focus->_AtomicNumber > 0) {
+      vertex._Element = symbolFromElement(elementForAtomicNumber(focus->_AtomicNumber));
+      vertex._Selectivity += 8;
+    }
+    if (focus->_NumberOfAttachedAtoms >= 0 && focus->_NumberOfAttachedAtoms < invariant::DegreeMax) {
+      vertex._Required |= invariant::degree(focus->_NumberOfAttachedAtoms);
+      vertex._Selectivity += 3;
+    }
+    if (focus->_NumberOfAttachedHydrogens >= 0 && focus->_NumberOfAttachedHydrogens < invariant::HCountMax) {
+      vertex._Required |= invariant::hcount(focus->_NumberOfAttachedHydrogens);
+      vertex._Selectivity += 3;
+    }
+    return;
+  }
+  if (gc::IsA<Logical_sp>(tnode)) {
+    Logical_sp logical = gc::As_unsafe<Logical_sp>(tnode);
+    switch (logical->_Operator) {
+    case logIdentity:
+      compileVertexConstraints(logical->_Left, vertex);
+      break;
+    case logHighPrecedenceAnd:
+    case logLowPrecedenceAnd:
+      compileVertexConstraints(logical->_Left, vertex);
+      compileVertexConstraints(logical->_Right, vertex);
+      break;
+    default:
+      break;
+    }
+    return;
+  }
+  if (!gc::IsA<AtomTest_sp>(tnode))
+    return;
+  AtomTest_sp test = gc::As_unsafe<AtomTest_sp>(tnode);
+  int arg = test->getIntArg();
+  switch (test->_Test) {
+  case SAPElement:
+    vertex._Element = test->getSymbolArg();
+    vertex._Selectivity += 8;
+    break;
+  case SAPAromaticElement:
+    vertex._Element = test->getSymbolArg();
+    vertex._Required |= invariant::Aromatic;
+    vertex._Selectivity += 10;
+    break;
+  case SAPAromatic:
+    vertex._Required |= invariant::Aromatic;
+    vertex._Selectivity += 2;
+    break;
+  case SAPAliphatic:
+    vertex._Forbidden |= invariant::Aromatic;
+    vertex._Selectivity += 1;
+    break;
+  case SAPNoRing:
+    vertex._Forbidden |= invariant::InRing;
+    vertex._Selectivity += 1;
+    break;
+  case SAPElectronegativeElement:
+    vertex._Required |= invariant::Electronegative;
+    vertex._Selectivity += 4;
+    break;
+  case SAPConnectivity:
+  case SAPDegree:
+    if (arg >= 0 && arg < invariant::DegreeMax) {
+      vertex._Required |= invariant::degree(arg);
+      vertex._Selectivity += 3;
+    }
+    break;
+  case SAPTotalHCount:
+    if (arg >= 0 && arg < invariant::HCountMax) {
+      vertex._Required |= invariant::hcount(arg);
+      vertex._Selectivity += 3;
+    }
+    break;
+  case SAPRingConnectivity:
+  case SAPRingMembershipCount:
+    if (arg >= 0 && arg < invariant::RingCountMax) {
+      vertex._Required |= invariant::ringCount(arg);
+      vertex._Selectivity += 2;
+    }
+    break;
+  case SAPRingSize:
+    if (arg >= invariant::RingSizeMin && arg <= invariant::RingSizeMax) {
+      vertex._Required |= invariant::ringSize(arg);
+      vertex._Selectivity += 3;
+    }
+    break;
+  case SAPAtomicNumber:
+  case SAPAtomicMass:
+    vertex._Selectivity += 8;
+    break;
+  default:
+    break;
+  }
+}
+
+bool CompiledChemInfo_O::pureBond(BondEnum bond, bool& needsRings) {
+  switch (bond) {
+  case SABSingleBond:
+  case SABSingleOrAromaticBond:
+  case SABDoubleOrAromaticBond:
+  case SABTripleOrAromaticBond:
+  case SABDoubleBond:
+  case SABTripleBond:
+  case SABAromaticBond:
+  case SABAnyBond:
+  case SABDelocalizedBond:
+    return true;
+  case SABSameRingBond:
+    needsRings = true;
+    return true;
+  default:
+    // Bond matchers and directional bonds
+    return false;
+  }
+}
+
+bool CompiledChemInfo_O::pureNode(core::T_sp tnode, bool& needsRings) {
+  if (tnode.nilp())
+    return true;
+  if (gc::IsA<Logical_sp>(tnode)) {
+    Logical_sp logical = gc::As_unsafe<Logical_sp>(tnode);
+    switch (logical->_Operator) {
+    case logAlwaysTrue:
+      return true;
+    case logIdentity:
+    case logNot:
+      return pureNode(logical->_Left, needsRings);
+    case logHighPrecedenceAnd:
+    case logLowPrecedenceAnd:
+    case logOr:
+      return pureNode(logical->_Left, needsRings) && pureNode(logical->_Right, needsRings);
+    default:
+      return false;
+    }
+  }
+  if (!gc::IsA<AtomTest_sp>(tnode))
+    return false;
+  AtomTest_sp test = gc::As_unsafe<AtomTest_sp>(tnode);
+  switch (test->_Test) {
+  case SAPWildCard:
+  case SAPAromaticElement:
+  case SAPElement:
+  case SAPAliphatic:
+  case SAPAromatic:
+  case SAPAtomicNumber:
+  case SAPAtomicMass:
+  case SAPTotalHCount:
+  case SAPNegativeCharge:
+  case SAPPositiveCharge:
+  case SAPNegativeFormalCharge:
+  case SAPPositiveFormalCharge:
+  case SAPValence:
+  case SAPAtomMap:
+  case SAPConnectivity:
+  case SAPDegree:
+  case SAPNoRing:
+  case SAPElectronegativeElement:
+    return true;
+  case SAPRingConnectivity:
+  case SAPRingMembershipCount:
+    needsRings = true;
+    return true;
+  case SAPRingSize:
+    needsRings = true;
+    return test->_IntArg >= 0 && test->_IntArg < 64;
+  case SAPInBond:
+    return pureBond((BondEnum)test->_IntArg, needsRings);
+  default:
+    return false;
+  }
+}
+
+CompiledChemInfo_O::CompiledChemInfo_O(ChemInfoGraph_sp graph)
+    : _ChemInfoGraph(graph), _Root(graph->_Root), _RootVertex(0), _Pure(false), _NeedsRings(false) {};
+
+CompiledChemInfo_O::CompiledChemInfo_O(Root_sp root)
+    : _ChemInfoGraph(unbound<ChemInfoGraph_O>()), _Root(root), _RootVertex(0), _Pure(false), _NeedsRings(false) {};
+
+CompiledChemInfo_sp CompiledChemInfo_O::make(ChemInfoGraph_sp graph) {
+  auto compiled = gctools::GC<CompiledChemInfo_O>::allocate(graph);
+  if (graph->_chemInfoGraph == NULL) {
+    SIMPLE_ERROR("The chem-info-graph {} has not been built", _rep_(graph));
+  }
+  ChemInfoGraphType& cig = *graph->_chemInfoGraph;
+  size_t numVertices = boost::num_vertices(cig);
+  compiled->_Vertices.reserve(numVertices);
+  for (size_t vi = 0; vi < numVertices; ++vi) {
+    size_t nodeIndex = graph->_nodeOrder[vi];
+    if (nodeIndex == 0) compiled->_RootVertex = vi;
+    CompiledChemInfoVertex vertex(graph->_atomNodes[nodeIndex]);
+    compileVertexConstraints(vertex._Node, vertex);
+    compiled->_Vertices.push_back(vertex);
+  }
+  boost::property_map<ChemInfoGraphType, boost::edge_index_t>::type edgeIndex = boost::get(boost::edge_index_t(), cig);
+  std::vector<std::vector<size_t>> vertexEdges(numVertices);
+  boost::graph_traits<ChemInfoGraphType>::edge_iterator ei, ei_end;
+  for (boost::tie(ei, ei_end) = boost::edges(cig); ei != ei_end; ++ei) {
+    size_t v1 = boost::source(*ei, cig);
+    size_t v2 = boost::target(*ei, cig);
+    BondToAtomTest_sp bond = graph->_bondNodes[edgeIndex[*ei]];
+    vertexEdges[v1].push_back(compiled->_Edges.size());
+    vertexEdges[v2].push_back(compiled->_Edges.size());
+    compiled->_Edges.push_back(CompiledChemInfoEdge(v1, v2, bond));
+  }
+  for (size_t vi = 0; vi < numVertices; ++vi) {
+    compiled->_EdgeStart.push_back(compiled->_VertexEdges.size());
+    for (size_t edge : vertexEdges[vi])
+      compiled->_VertexEdges.push_back(edge);
+  }
+  compiled->_EdgeStart.push_back(compiled->_VertexEdges.size());
+  bool pure = true;
+  bool needsRings = false;
+  for (auto& vertex : compiled->_Vertices)
+    pure = pure && pureNode(vertex._Node, needsRings);
+  for (auto& edge : compiled->_Edges)
+    pure = pure && pureBond(edge._Bond->_Bond, needsRings);
+  compiled->_Pure = pure;
+  compiled->_NeedsRings = needsRings;
+  return compiled;
+}
+
+CompiledChemInfo_sp CompiledChemInfo_O::compiledGraph(ChemInfoGraph_sp graph) {
+  if (graph->_Compiled.nilp()) {
+    graph->_Compiled = CompiledChemInfo_O::make(graph);
+  }
+  return gc::As_unsafe<CompiledChemInfo_sp>(graph->_Compiled);
+}
+
+core::T_sp CompiledChemInfo_O::compileRoot(Root_sp root) {
+  if (root->_Node.nilp())
+    return nil<core::T_O>();
+  if (gc::IsA<AntechamberRoot_sp>(root)) {
+    if (gc::As_unsafe<AntechamberRoot_sp>(root)->_AfterMatchTests.notnilp())
+      return nil<core::T_O>();
+    auto compiled = gctools::GC<CompiledChemInfo_O>::allocate(root);
+    CompiledChemInfoVertex vertex(root->_Node);
+    compileVertexConstraints(vertex._Node, vertex);
+    compiled->_Vertices.push_back(vertex);
+    compiled->_EdgeStart.push_back(0);
+    compiled->_EdgeStart.push_back(0);
+    return compiled;
+  }
+  // Anything else must be made of the nodes that the chem-info-graph is built from
+  bool smarts = true;
+  walk_nodes(root->_Node, [&smarts](ChemInfoNode_sp node) {
+    if (gc::IsA<AntechamberBondToAtomTest_sp>(node) || gc::IsA<AntechamberFocusAtomMatch_sp>(node) ||
+        gc::IsA<RootMatchNode_sp>(node))
+      smarts = false;
+  });
+  if (!smarts)
+    return nil<core::T_O>();
+  return compiledGraph(chem__make_chem_info_graph(root));
+}
+
+bool CompiledChemInfo_O::matchesAtom(Root_sp root, core::T_sp compiled, MoleculeInvariants_sp invariants, Atom_sp atom) {
+  if (compiled.notnilp()) {
+    core::T_sp index = invariants->_MoleculeGraph->_nodes_to_index->gethash(atom);
+    if (index.fixnump())
+      return gc::As_unsafe<CompiledChemInfo_sp>(compiled)->search(invariants, index.unsafe_fixnum(), false, true).notnilp();
+  }
+  return chem__chem_info_match(root, atom).notnilp();
+}
+
+bool CompiledChemInfo_O::evaluate(core::T_sp tnode, MoleculeInvariants_sp invariants, size_t ai, std::vector<int>* tags) const {
+  if (tnode.nilp())
+    return true;
+  if (gc::IsA<Logical_sp>(tnode)) {
+    Logical_sp logical = gc::As_unsafe<Logical_sp>(tnode);
+    switch (logical->_Operator) {
+    case logAlwaysTrue:
+      return true;
+    case logIdentity:
+      return this->evaluate(logical->_Left, invariants, ai, tags);
+    case logNot:
+      // Tags under a NOT are never defined by a successful match
+      return !this->evaluate(logical->_Left, invariants, ai, NULL);
+    case logHighPrecedenceAnd:
+    case logLowPrecedenceAnd:
+      return this->evaluate(logical->_Left, invariants, ai, tags) && this->evaluate(logical->_Right, invariants, ai, tags);
+    case logOr:
+      return this->evaluate(logical->_Left, invariants, ai, tags) || this->evaluate(logical->_Right, invariants, ai, tags);
+    default:
+      SIMPLE_ERROR("Unknown logical operator({})", (int)logical->_Operator);
+    }
+  }
+  const AtomInvariants& atom = invariants->_Atoms[ai];
+  if (!gc::IsA<AtomTest_sp>(tnode)) {
+    // Anything else (eg: AntechamberFocusAtomMatch) is evaluated the slow way
+    return gc::As<ChemInfoNode_sp>(tnode)->matches_Atom(this->_Root, atom._Atom);
+  }
+  AtomTest_sp test = gc::As_unsafe<AtomTest_sp>(tnode);
+  int arg = test->_IntArg;
+  switch (test->_Test) {
+  case SAPWildCard:
+    return true;
+  case SAPAromaticElement:
+    return (test->_SymbolArg == atom._Element) && (atom._Bits & invariant::Aromatic);
+  case SAPElement:
+    return test->_SymbolArg == atom._Element;
+  case SAPAliphatic:
+    return !(atom._Bits & invariant::Aromatic);
+  case SAPAromatic:
+    return (atom._Bits & invariant::Aromatic);
+  case SAPAtomicNumber:
+    return arg == atom._AtomicNumber;
+  case SAPAtomicMass:
+    return arg == atom._AtomicMass;
+  case SAPTotalHCount:
+    return arg == atom._HCount;
+  case SAPNegativeCharge:
+  case SAPPositiveCharge:
+  case SAPNegativeFormalCharge:
+  case SAPPositiveFormalCharge:
+    return arg == atom._Ionization;
+  case SAPRingConnectivity:
+  case SAPRingMembershipCount:
+    if (!invariants->_RingsAvailable)
+      return test->matches_Atom(this->_Root, atom._Atom); // warns
+    return arg == atom._RingCount;
+  case SAPRingSize:
+    if (!invariants->_RingsAvailable || arg < 0 || arg >= 64)
+      return test->matches_Atom(this->_Root, atom._Atom);
+    return (atom._RingSizes & (1ull << arg)) != 0;
+  case SAPValence:
+    return arg == atom._Valence;
+  case SAPAtomMap:
+    if (tags) tags->push_back(arg);
+    return true;
+  case SAPConnectivity:
+  case SAPDegree:
+    return arg == atom._Degree;
+  case SAPInBond: {
+    int cnt = 0;
+    for (size_t ei = invariants->_NeighborStart[ai]; ei < invariants->_NeighborStart[ai + 1]; ++ei) {
+      const InvariantEdge& edge = invariants->_Neighbors[ei];
+      if (_matchBondTypesGivenAromaticity((BondEnum)arg, edge._Order, edge._InAromaticBond))
+        cnt++;
+    }
+    return cnt == test->_NumArg;
+  }
+  case SAPNoRing:
+    return !(atom._Bits & invariant::InRing);
+  case SAPElectronegativeElement:
+    return (atom._Bits & invariant::Electronegative);
+  default:
+    // SAPPredicateName, SAPArLevel, SAPResidueTest ... use the original test
+    return test->matches_Atom(this->_Root, atom._Atom);
+  }
+}
+
+bool CompiledChemInfo_O::matchEdge(const CompiledChemInfoEdge& edge, MoleculeInvariants_sp invariants, size_t atom1,
+                                   const InvariantEdge& iedge) const {
+  BondToAtomTest_sp bta = edge._Bond;
+  switch (bta->_Bond) {
+  case SABUseBondMatcher: {
+    Atom_sp from = invariants->_Atoms[atom1]._Atom;
+    Atom_sp to = invariants->_Atoms[iedge._Neighbor]._Atom;
+    Bond_sp bond = from->getBondTo(to);
+    BondMatcher_sp bondMatcher = gc::As<BondMatcher_sp>(bta->_BondMatcher);
+    return bondMatcher->matches_Bond(this->_Root, from, bond);
+  }
+  case SABSameRingBond:
+    if (!invariants->_RingsAvailable)
+      SIMPLE_ERROR("The same-ring bond test needs chem:*current-rings* to be bound when the molecule invariants are made");
+    return iedge._SameRing;
+  default:
+    return _matchBondTypesGivenAromaticity(bta->_Bond, iedge._Order, iedge._InAromaticBond);
+  }
+}
+
+/*! State of one search - kept out of the CompiledChemInfo so that it can be shared between threads */
+struct CompiledSearch {
+  const CompiledChemInfo_O*  _Compiled;
+  MoleculeInvariants_sp      _Invariants;
+  bool                       _Induced;
+  bool                       _FirstOnly;
+  size_t                     _NumAtoms;
+  std::vector<size_t>        _Order;       // vertices in the order they are matched
+  std::vector<int>           _Anchor;      // for each position, an already matched neighbor vertex or -1
+  bool                       _Dense;       // false when matching one atom - nothing may cost O(atoms)
+  std::vector<int8_t>        _Cache;       // vertex*numAtoms -> -1 unknown, 0 no, 1 yes
+  std::vector<int>           _VertexToAtom;
+  std::vector<bool>          _AtomUsed;
+  bool                       _ExistsOnly;  // only note that there is a match - no tag vectors are made
+  bool                       _Found;
+  core::List_sp              _Results;
+  bool                       _Done;
+
+  CompiledSearch(const CompiledChemInfo_O* compiled, MoleculeInvariants_sp invariants, bool induced, bool firstOnly, bool dense,
+                 bool existsOnly = false)
+      : _Compiled(compiled), _Invariants(invariants), _Induced(induced), _FirstOnly(firstOnly),
+        _NumAtoms(invariants->numberOfAtoms()), _Dense(dense), _ExistsOnly(existsOnly), _Found(false),
+        _Results(nil<core::T_O>()), _Done(false) {
+    size_t nv = compiled->numberOfVertices();
+    if (dense) {
+      this->_Cache.assign(nv * this->_NumAtoms, -1);
+      this->_AtomUsed.assign(this->_NumAtoms, false);
+    }
+    this->_VertexToAtom.assign(nv, -1);
+  }
+
+  bool atomUsed(size_t ai) const {
+    if (this->_Dense) return this->_AtomUsed[ai];
+    return std::find(this->_VertexToAtom.begin(), this->_VertexToAtom.end(), (int)ai) != this->_VertexToAtom.end();
+  }
+
+  bool vertexMatches(size_t vi, size_t ai) {
+    if (!this->_Dense) {
+      return this->_Compiled->prefilter(vi, this->_Invariants->_Atoms[ai]) &&
+             this->_Compiled->evaluate(this->_Compiled->_Vertices[vi]._Node, this->_Invariants, ai, NULL);
+    }
+    int8_t& cached = this->_Cache[vi * this->_NumAtoms + ai];
+    if (cached < 0) {
+      const AtomInvariants& atom = this->_Invariants->_Atoms[ai];
+      cached = (this->_Compiled->prefilter(vi, atom) &&
+                this->_Compiled->evaluate(this->_Compiled->_Vertices[vi]._Node, this->_Invariants, ai, NULL))
+                   ? 1
+                   : 0;
+    }
+    return cached;
+  }
+
+  /*! Choose the order that vertices are matched.  Start from the given vertex and
+      then repeatedly take the unordered vertex with the most edges back into the
+      ordered set, breaking ties with the fewest candidate atoms. */
+  void planOrder(size_t start, const std::vector<size_t>& candidates) {
+    const CompiledChemInfo_O* c = this->_Compiled;
+    size_t nv = c->numberOfVertices();
+    std::vector<bool> ordered(nv, false);
+    std::vector<int> backEdges(nv, 0);
+    size_t next = start;
+    while (true) {
+      ordered[next] = true;
+      int anchor = -1;
+      for (size_t ei = c->_EdgeStart[next]; ei < c->_EdgeStart[next + 1]; ++ei) {
+        const CompiledChemInfoEdge& edge = c->_Edges[c->_VertexEdges[ei]];
+        size_t other = (edge._Vertex1 == next) ? edge._Vertex2 : edge._Vertex1;
+        if (ordered[other]) {
+          if (other != next && anchor < 0) anchor = other;
+        } else {
+          backEdges[other]++;
+        }
+      }
+      this->_Order.push_back(next);
+      this->_Anchor.push_back(anchor);
+      if (this->_Order.size() == nv) break;
+      bool found = false;
+      size_t best = 0;
+      for (size_t vi = 0; vi < nv; ++vi) {
+        if (ordered[vi]) continue;
+        if (!found ||
+            backEdges[vi] > backEdges[best] ||
+            (backEdges[vi] == backEdges[best] && candidates[vi] < candidates[best])) {
+          best = vi;
+          found = true;
+        }
+      }
+      next = best;
+    }
+  }
+
+  /*! Plan an unpinned search starting from the vertex with the fewest candidates for its selectivity.
+      Return false if some vertex has no candidate atom at all. */
+  bool planUnpinned() {
+    const CompiledChemInfo_O* c = this->_Compiled;
+    size_t nv = c->numberOfVertices();
+    std::vector<size_t> candidates(nv, 0);
+    // Count the atoms that pass the cheap test for every vertex
+    for (size_t vi = 0; vi < nv; ++vi) {
+      for (size_t ai = 0; ai < this->_NumAtoms; ++ai) {
+        if (c->prefilter(vi, this->_Invariants->_Atoms[ai])) candidates[vi]++;
+      }
+      if (candidates[vi] == 0)
+        return false;
+    }
+    size_t start = 0;
+    for (size_t vi = 1; vi < nv; ++vi) {
+      if (candidates[vi] * (c->_Vertices[start]._Selectivity + 1) <
+          candidates[start] * (c->_Vertices[vi]._Selectivity + 1))
+        start = vi;
+    }
+    this->planOrder(start, candidates);
+    return true;
+  }
+
+  void reportMatch() {
+    if (this->_ExistsOnly) {
+      this->_Found = true;
+      this->_Done = true;
+      return;
+    }
+    const CompiledChemInfo_O* c = this->_Compiled;
+    size_t tagsLength = c->_Root->_MaxTag + 1;
+    core::SimpleVector_sp tagVector = core::SimpleVector_O::make(tagsLength);
+    std::vector<int> tags;
+    for (size_t vi = 0; vi < c->numberOfVertices(); ++vi) {
+      core::T_sp node = c->_Vertices[vi]._Node;
+      // Only atom map tests define tags - don't run an antechamber rule a second time
+      if (!gc::IsA<AtomTest_sp>(node) && !gc::IsA<Logical_sp>(node)) continue;
+      size_t ai = this->_VertexToAtom[vi];
+      tags.clear();
+      c->evaluate(node, this->_Invariants, ai, &tags);
+      for (int tag : tags) {
+        if (tag < 0 || (size_t)tag >= tagsLength)
+          SIMPLE_ERROR("The tag {} is an illegal index into the tag vector {}", tag, _rep_(tagVector));
+        tagVector->rowMajorAset(tag, this->_Invariants->_Atoms[ai]._Atom);
+      }
+    }
+    this->_Results = core::Cons_O::create(tagVector, this->_Results);
+    if (this->_FirstOnly) this->_Done = true;
+  }
+
+  bool edgesMatch(size_t vi, size_t ai) {
+    const CompiledChemInfo_O* c = this->_Compiled;
+    for (size_t ei = c->_EdgeStart[vi]; ei < c->_EdgeStart[vi + 1]; ++ei) {
+      const CompiledChemInfoEdge& edge = c->_Edges[c->_VertexEdges[ei]];
+      size_t other = (edge._Vertex1 == vi) ? edge._Vertex2 : edge._Vertex1;
+      int otherAtom = this->_VertexToAtom[other];
+      if (otherAtom < 0) continue;
+      const InvariantEdge* iedge = this->_Invariants->edge(ai, otherAtom);
+      if (!iedge || !c->matchEdge(edge, this->_Invariants, ai, *iedge))
+        return false;
+    }
+    if (this->_Induced) {
+      // Every bond between matched atoms must correspond to an edge of the pattern
+      for (size_t ni = this->_Invariants->_NeighborStart[ai]; ni < this->_Invariants->_NeighborStart[ai + 1]; ++ni) {
+        size_t nai = this->_Invariants->_Neighbors[ni]._Neighbor;
+        if (!this->atomUsed(nai)) continue;
+        bool inPattern = false;
+        for (size_t ei = c->_EdgeStart[vi]; ei < c->_EdgeStart[vi + 1]; ++ei) {
+          const CompiledChemInfoEdge& edge = c->_Edges[c->_VertexEdges[ei]];
+          size_t other = (edge._Vertex1 == vi) ? edge._Vertex2 : edge._Vertex1;
+          if (this->_VertexToAtom[other] == (int)nai) {
+            inPattern = true;
+            break;
+          }
+        }
+        if (!inPattern) return false;
+      }
+    }
+    return true;
+  }
+
+  bool tryAtom(size_t depth, size_t vi, size_t ai) {
+    if (this->atomUsed(ai) || !this->vertexMatches(vi, ai) || !this->edgesMatch(vi, ai))
+      return false;
+    this->_VertexToAtom[vi] = ai;
+    if (this->_Dense) this->_AtomUsed[ai] = true;
+    this->extend(depth + 1);
+    if (this->_Dense) this->_AtomUsed[ai] = false;
+    this->_VertexToAtom[vi] = -1;
+    return true;
+  }
+
+  void extend(size_t depth) {
+    if (this->_Done) return;
+    if (depth == this->_Order.size()) {
+      this->reportMatch();
+      return;
+    }
+    size_t vi = this->_Order[depth];
+    int anchor = this->_Anchor[depth];
+    if (anchor >= 0) {
+      size_t anchorAtom = this->_VertexToAtom[anchor];
+      for (size_t ni = this->_Invariants->_NeighborStart[anchorAtom];
+           ni < this->_Invariants->_NeighborStart[anchorAtom + 1] && !this->_Done; ++ni) {
+        this->tryAtom(depth, vi, this->_Invariants->_Neighbors[ni]._Neighbor);
+      }
+    } else {
+      for (size_t ai = 0; ai < this->_NumAtoms && !this->_Done; ++ai) {
+        this->tryAtom(depth, vi, ai);
+      }
+    }
+  }
+};
+
+core::List_sp CompiledChemInfo_O::search(MoleculeInvariants_sp invariants, int rootAtom, bool induced, bool firstOnly) const {
+  size_t nv = this->numberOfVertices();
+  if (nv == 0 || nv > invariants->numberOfAtoms())
+    return nil<core::T_O>();
+  if (rootAtom >= 0) {
+    if ((size_t)rootAtom >= invariants->numberOfAtoms())
+      SIMPLE_ERROR("The root atom index {} is out of range", rootAtom);
+    // Atom typing asks about every atom so most calls end here
+    if (!this->prefilter(this->_RootVertex, invariants->_Atoms[rootAtom]))
+      return nil<core::T_O>();
+  }
+  // Atom tests that fall back to the original code may need a current match
+  core::HashTableEql_sp ringHashTable = core::HashTableEql_O::create_default();
+  ChemInfoMatch_sp current_match = ChemInfoMatch_O::make(this->_Root, this->_Root->_MaxTag, ringHashTable);
+  core::DynamicScopeManager scope(_sym_STARcurrent_matchSTAR, current_match);
+  CompiledSearch search(this, invariants, induced, firstOnly, rootAtom < 0);
+  if (rootAtom >= 0) {
+    // Only the neighborhood of the root atom is searched so the order is planned from the
+    // selectivity of the vertices rather than by counting candidates over the whole molecule
+    std::vector<size_t> candidates(nv, 0);
+    for (size_t vi = 0; vi < nv; ++vi)
+      candidates[vi] = invariants->numberOfAtoms() / (this->_Vertices[vi]._Selectivity + 1);
+    search.planOrder(this->_RootVertex, candidates);
+    search.tryAtom(0, this->_RootVertex, rootAtom);
+  } else {
+    if (!search.planUnpinned())
+      return nil<core::T_O>();
+    search.extend(0);
+  }
+  return search._Results;
+}
+
+bool CompiledChemInfo_O::matchExists(MoleculeInvariants_sp invariants, bool induced) const {
+  // No current match is bound - a pure pattern never falls back to the original atom tests
+  size_t nv = this->numberOfVertices();
+  if (nv == 0 || nv > invariants->numberOfAtoms())
+    return false;
+  CompiledSearch search(this, invariants, induced, true, true, true);
+  if (!search.planUnpinned())
+    return false;
+  search.extend(0);
+  return search._Found;
+}
+
+CL_DOCSTRING(R"dx(Precompute the per-atom invariants of the atoms in a molecule-graph for chem:compiled-chem-info-matches.
+The rings and aromaticity information are taken from chem:*current-rings* and chem:*current-aromaticity-information*
+at the time this is called.)dx");
+DOCGROUP(cando);
+CL_DEFUN MoleculeInvariants_sp chem__make_molecule_invariants(MoleculeGraph_sp moleculeGraph) {
+  return MoleculeInvariants_O::make(moleculeGraph);
+}
+
+CL_DOCSTRING(R"dx(Compile a chem-info-graph for chem:compiled-chem-info-matches.)dx");
+DOCGROUP(cando);
+CL_DEFUN CompiledChemInfo_sp chem__compile_chem_info_graph(ChemInfoGraph_sp chemInfoGraph) {
+  return CompiledChemInfo_O::make(chemInfoGraph);
+}
+
+CL_DOCSTRING(R"dx(Return a list of tag vectors, one for every embedding of the compiled pattern in the molecule.
+This returns the same thing as chem:boost-graph-vf2 but by default matches SMARTS style (bonds between matched atoms
+that are not in the pattern are allowed) - pass :induced t to get the induced subgraph matching that vf2 does.)dx");
+CL_LAMBDA(compiled-chem-info molecule-invariants &key induced);
+DOCGROUP(cando);
+CL_DEFUN core::List_sp chem__compiled_chem_info_matches(CompiledChemInfo_sp compiled, MoleculeInvariants_sp invariants, bool induced) {
+  return compiled->search(invariants, -1, induced, false);
+}
+
+CL_DOCSTRING(R"dx(Match the compiled pattern with its first atom on atom.
+Return (values matchp chem-info-match) like chem:chem-info-match.)dx");
+DOCGROUP(cando);
+CL_DEFUN core::T_mv chem__compiled_chem_info_match(CompiledChemInfo_sp compiled, MoleculeInvariants_sp invariants, Atom_sp atom) {
+  core::T_sp index = invariants->_MoleculeGraph->_nodes_to_index->gethash(atom);
+  core::HashTableEql_sp ringHashTable = core::HashTableEql_O::create_default();
+  ChemInfoMatch_sp match = ChemInfoMatch_O::make(compiled->_Root, compiled->_Root->_MaxTag, ringHashTable);
+  if (!index.fixnump()) {
+    return Values(nil<core::T_O>(), match);
+  }
+  core::List_sp results = compiled->search(invariants, index.unsafe_fixnum(), false, true);
+  if (results.nilp()) {
+    return Values(nil<core::T_O>(), match);
+  }
+  match->_TagLookup = gc::As<core::SimpleVector_sp>(CONS_CAR(results));
+  match->_TagHistory = results;
+  match->setMatches(true);
+  return Values(_lisp->_boolean(true), match);
+}
+
+CL_DOCSTRING(R"dx(Match the chem-info-graph with its first atom on atom - like chem:chem-info-match on the root of the
+chem-info-graph but with the compiled matcher and molecule-invariants that are made once for the molecule.)dx");
+DOCGROUP(cando);
+CL_DEFUN core::T_mv chem__chem_info_graph_match(ChemInfoGraph_sp chemInfoGraph, MoleculeInvariants_sp invariants, Atom_sp atom) {
+  return chem__compiled_chem_info_match(CompiledChemInfo_O::compiledGraph(chemInfoGraph), invariants, atom);
+}
+
+};
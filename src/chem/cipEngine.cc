@@ -0,0 +1,579 @@
+/*
+    File: cipEngine.cc
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+/* -^- */
+#define	DEBUG_LEVEL_NONE
+
+#include <clasp/core/foundation.h>
+#include <clasp/core/common.h>
+#include <clasp/core/array.h>
+#include <clasp/core/numbers.h>
+#include <cando/chem/cipEngine.h>
+#include <cando/chem/matter.h>
+#include <cando/chem/aggregate.h>
+#include <cando/chem/molecule.h>
+#include <cando/chem/atom.h>
+#include <cando/chem/bond.h>
+#include <clasp/core/wrappers.h>
+#include <algorithm>
+#include <numeric>
+
+namespace chem {
+
+// If more than one in this many centers have to be re-ranked, refine the whole graph instead
+#define CIP_ENGINE_LOCAL_UPDATE_FRACTION 4
+
+void CipGraph::extract(MatterGraph_sp graph)
+{
+  size_t numAtoms = graph->numberOfAtoms();
+  this->_AtomicNumbers.assign(graph->_AtomicNumbers.begin(),graph->_AtomicNumbers.end());
+  this->_BondStart.assign(graph->_NeighborStart.begin(),graph->_NeighborStart.end());
+  this->_BondNeighbors.assign(graph->_Neighbors.begin(),graph->_Neighbors.end());
+  this->_Start.clear();
+  this->_Neighbors.clear();
+  for ( size_t ai=0; ai<numAtoms; ++ai ) {
+    this->_Start.push_back(this->_Neighbors.size());
+    for ( uint32_t edge=graph->_NeighborStart[ai]; edge<graph->_NeighborStart[ai+1]; ++edge ) {
+      for ( int mi=0, multiplicity=graph->bondMultiplicity(edge); mi<multiplicity; ++mi ) {
+        this->_Neighbors.push_back(graph->_Neighbors[edge]);
+      }
+    }
+  }
+  this->_Start.push_back(this->_Neighbors.size());
+}
+
+size_t CipGraph::refine(size_t maxLevels, std::vector<uint32_t>& p,
+                        const std::function<void(size_t,const std::vector<uint32_t>&)>& onLevel) const
+{
+  size_t numAtoms = this->numberOfAtoms();
+  std::vector<uint32_t> order(numAtoms);
+  std::iota(order.begin(),order.end(),0);
+  std::sort(order.begin(),order.end(),[this] (uint32_t x, uint32_t y) {
+    return this->_AtomicNumbers[x] < this->_AtomicNumbers[y];
+  });
+  // The atoms of the class starting at position pos of order are order[pos,classEnd[pos])
+  std::vector<uint32_t> classEnd(numAtoms);
+  p.resize(numAtoms);
+  for ( size_t pos=0; pos<numAtoms; ) {
+    size_t end = pos+1;
+    while (end<numAtoms && this->_AtomicNumbers[order[end]]==this->_AtomicNumbers[order[pos]]) ++end;
+    for ( size_t qi=pos; qi<end; ++qi ) p[order[qi]] = pos;
+    classEnd[pos] = end;
+    pos = end;
+  }
+  if (onLevel) onLevel(0,p);
+  // Only a class with an atom whose neighbors moved to new classes in the last level can split
+  std::vector<uint8_t> touched(numAtoms,1);
+  std::vector<uint32_t> newP, changed, classAtoms, members, sStart, sValues;
+  auto compareS = [&] (uint32_t x, uint32_t y) -> int {
+    uint32_t xi = sStart[x], xe = sStart[x+1], yi = sStart[y], ye = sStart[y+1];
+    for ( ; xi<xe && yi<ye; ++xi, ++yi ) {
+      if (sValues[xi]!=sValues[yi]) return sValues[xi]<sValues[yi] ? -1 : 1;
+    }
+    if (xi==xe && yi==ye) return 0;
+    return xi==xe ? -1 : 1;
+  };
+  size_t levels = 0;
+  while (levels<maxLevels) {
+    newP = p;
+    changed.clear();
+    bool split = false;
+    for ( size_t pos=0; pos<numAtoms; ) {
+      size_t end = classEnd[pos];
+      size_t count = end-pos;
+      bool candidate = false;
+      if (count>1) {
+        for ( size_t qi=pos; qi<end; ++qi ) {
+          if (touched[order[qi]]) {
+            candidate = true;
+            break;
+          }
+        }
+      }
+      if (candidate) {
+        // s(i) is the list of the p of the neighbors of i in decreasing order
+        classAtoms.assign(order.begin()+pos,order.begin()+end);
+        sStart.clear();
+        sValues.clear();
+        for ( uint32_t atom : classAtoms ) {
+          sStart.push_back(sValues.size());
+          for ( uint32_t ni=this->_Start[atom]; ni<this->_Start[atom+1]; ++ni ) sValues.push_back(p[this->_Neighbors[ni]]);
+          std::sort(sValues.begin()+sStart.back(),sValues.end(),std::greater<uint32_t>());
+        }
+        sStart.push_back(sValues.size());
+        members.resize(count);
+        std::iota(members.begin(),members.end(),0);
+        std::sort(members.begin(),members.end(),[&] (uint32_t x, uint32_t y) { return compareS(x,y)<0; });
+        size_t subStart = pos;
+        for ( size_t mi=0; mi<count; ++mi ) {
+          if (mi>0 && compareS(members[mi-1],members[mi])!=0) {
+            classEnd[subStart] = pos+mi;
+            subStart = pos+mi;
+            split = true;
+          }
+          uint32_t atom = classAtoms[members[mi]];
+          order[pos+mi] = atom;
+          newP[atom] = subStart;
+          if (subStart!=p[atom]) changed.push_back(atom);
+        }
+        classEnd[subStart] = end;
+      }
+      pos = end;
+    }
+    if (!split) break;
+    ++levels;
+    p.swap(newP);
+    std::fill(touched.begin(),touched.end(),0);
+    for ( uint32_t atom : changed ) {
+      for ( uint32_t ni=this->_Start[atom]; ni<this->_Start[atom+1]; ++ni ) touched[this->_Neighbors[ni]] = 1;
+    }
+    if (onLevel) onLevel(levels,p);
+  }
+  return levels;
+}
+
+void CipGraph::classNumbers(const std::vector<uint32_t>& p, std::vector<uint32_t>& classes) const
+{
+  std::vector<uint32_t> starts(p.begin(),p.end());
+  std::sort(starts.begin(),starts.end());
+  starts.erase(std::unique(starts.begin(),starts.end()),starts.end());
+  classes.resize(p.size());
+  for ( size_t ai=0; ai<p.size(); ++ai ) classes[ai] = std::lower_bound(starts.begin(),starts.end(),p[ai])-starts.begin();
+}
+
+/*! Rank the four bonded neighbors of center from p.  lastSplit is the last level at which
+ *  neighbors of the center were told apart.  Neighbors that are still tied are only known to
+ *  stay tied if they are identical terminal atoms or if p is final for the whole molecule
+ *  (complete).  Return false if that isn't known yet. */
+static bool cip_center_ranks(const CipGraph& graph, size_t center, const std::vector<uint32_t>& p,
+                             size_t lastSplit, bool complete, uint8_t* ranks, uint32_t& radius)
+{
+  const uint32_t* neighbors = &graph._BondNeighbors[graph._BondStart[center]];
+  bool terminalTies = true;
+  for ( size_t ji=0; ji<4; ++ji ) {
+    uint8_t rank = 0;
+    for ( size_t ki=0; ki<4; ++ki ) {
+      if (p[neighbors[ki]]<p[neighbors[ji]]) {
+        // count each lower priority once
+        bool first = true;
+        for ( size_t li=0; li<ki; ++li ) if (p[neighbors[li]]==p[neighbors[ki]]) first = false;
+        if (first) ++rank;
+      } else if (ki!=ji && p[neighbors[ki]]==p[neighbors[ji]]) {
+        if (graph.numberOfBonds(neighbors[ki])!=1 || graph.numberOfBonds(neighbors[ji])!=1) terminalTies = false;
+      }
+    }
+    ranks[ji] = rank;
+  }
+  if (terminalTies) {
+    radius = std::max((uint32_t)1,(uint32_t)lastSplit+1);
+    return true;
+  }
+  if (complete) {
+    radius = CIP_RADIUS_UNBOUNDED;
+    return true;
+  }
+  return false;
+}
+
+/*! Track the last level at which the neighbors of centers were told apart during a refinement */
+struct CipSplitTracker {
+  const CipGraph&       _Graph;
+  std::vector<uint32_t> _Centers;
+  std::vector<uint8_t>  _Distinct;
+  std::vector<uint32_t> _LastSplit;
+  CipSplitTracker(const CipGraph& graph) : _Graph(graph) {};
+  void add(uint32_t center) {
+    this->_Centers.push_back(center);
+    this->_Distinct.push_back(0);
+    this->_LastSplit.push_back(0);
+  }
+  void operator()(size_t level, const std::vector<uint32_t>& p) {
+    for ( size_t ci=0; ci<this->_Centers.size(); ++ci ) {
+      if (this->_Distinct[ci]==4) continue;
+      const uint32_t* neighbors = &this->_Graph._BondNeighbors[this->_Graph._BondStart[this->_Centers[ci]]];
+      uint32_t values[4] = { p[neighbors[0]], p[neighbors[1]], p[neighbors[2]], p[neighbors[3]] };
+      std::sort(values,values+4);
+      uint8_t distinct = std::unique(values,values+4)-values;
+      if (distinct>this->_Distinct[ci]) {
+        this->_Distinct[ci] = distinct;
+        this->_LastSplit[ci] = level;
+      }
+    }
+  }
+};
+
+/*! Rank the neighbors of every atom with four bonds with one refinement of the whole graph.
+ *  Return the final p. */
+static void cip_rank_all_centers(const CipGraph& graph, gctools::Vec0<uint32_t>& radii, gctools::Vec0<uint8_t>& ranks,
+                                 std::vector<uint32_t>& p)
+{
+  size_t numAtoms = graph.numberOfAtoms();
+  radii.assign(numAtoms,CIP_RADIUS_NOT_A_CENTER);
+  ranks.assign(numAtoms*4,0);
+  CipSplitTracker tracker(graph);
+  for ( size_t ai=0; ai<numAtoms; ++ai ) if (graph.numberOfBonds(ai)==4) tracker.add(ai);
+  graph.refine(numAtoms+1,p,std::ref(tracker));
+  for ( size_t ci=0; ci<tracker._Centers.size(); ++ci ) {
+    uint32_t center = tracker._Centers[ci];
+    cip_center_ranks(graph,center,p,tracker._LastSplit[ci],true,&ranks[center*4],radii[center]);
+  }
+}
+
+/*! Rank the neighbors of center by refining the ball of atoms within radius R of it.
+ *  The level k classes of an atom at distance d are exact if d+k<=R so the neighbors of
+ *  the center are ranked correctly by R-1 levels.  R is doubled until the ranks are known.
+ *  localIndex must be all 0xFFFFFFFF and is left that way. */
+static void cip_rank_center(const CipGraph& graph, size_t center, std::vector<uint32_t>& localIndex,
+                            uint8_t* ranks, uint32_t& radius)
+{
+  const uint32_t unset = 0xFFFFFFFF;
+  std::vector<uint32_t> ball, distance, p;
+  CipGraph local;
+  for ( size_t maxDistance=2; ; maxDistance*=2 ) {
+    ball.clear();
+    distance.clear();
+    ball.push_back(center);
+    distance.push_back(0);
+    localIndex[center] = 0;
+    bool complete = true;
+    for ( size_t bi=0; bi<ball.size(); ++bi ) {
+      uint32_t atom = ball[bi];
+      for ( uint32_t ni=graph._BondStart[atom]; ni<graph._BondStart[atom+1]; ++ni ) {
+        uint32_t neighbor = graph._BondNeighbors[ni];
+        if (localIndex[neighbor]!=unset) continue;
+        if (distance[bi]==maxDistance) {
+          complete = false;
+          continue;
+        }
+        localIndex[neighbor] = ball.size();
+        ball.push_back(neighbor);
+        distance.push_back(distance[bi]+1);
+      }
+    }
+    local._AtomicNumbers.clear();
+    local._Start.clear();
+    local._Neighbors.clear();
+    local._BondStart.clear();
+    local._BondNeighbors.clear();
+    for ( uint32_t atom : ball ) {
+      local._AtomicNumbers.push_back(graph._AtomicNumbers[atom]);
+      local._Start.push_back(local._Neighbors.size());
+      local._BondStart.push_back(local._BondNeighbors.size());
+      for ( uint32_t ni=graph._Start[atom]; ni<graph._Start[atom+1]; ++ni ) {
+        if (localIndex[graph._Neighbors[ni]]!=unset) local._Neighbors.push_back(localIndex[graph._Neighbors[ni]]);
+      }
+      for ( uint32_t ni=graph._BondStart[atom]; ni<graph._BondStart[atom+1]; ++ni ) {
+        if (localIndex[graph._BondNeighbors[ni]]!=unset) local._BondNeighbors.push_back(localIndex[graph._BondNeighbors[ni]]);
+      }
+    }
+    local._Start.push_back(local._Neighbors.size());
+    local._BondStart.push_back(local._BondNeighbors.size());
+    for ( uint32_t atom : ball ) localIndex[atom] = unset;
+    CipSplitTracker tracker(local);
+    tracker.add(0);
+    local.refine(complete ? ball.size()+1 : maxDistance-1,p,std::ref(tracker));
+    if (cip_center_ranks(local,0,p,tracker._LastSplit[0],complete,ranks,radius)) return;
+  }
+}
+
+CL_LAMBDA(matter);
+CL_LISPIFY_NAME(make_cip_engine);
+CL_DOCSTRING(R"dx(Make a CIP engine for the atoms of a molecule or aggregate and rank the neighbors of every atom
+with four bonds.  Call chem:cip-engine-update after changing the bonds of the matter.  The per atom
+results are vectors indexed like chem:cip-engine-atoms.)dx");
+DOCGROUP(cando);
+CL_DEF_CLASS_METHOD CipEngine_sp CipEngine_O::make(Matter_sp matter)
+{
+  if (!gc::IsA<Molecule_sp>(matter) && !gc::IsA<Aggregate_sp>(matter)) {
+    TYPE_ERROR(matter,core::Cons_O::createList(_sym_Aggregate_O,_sym_Molecule_O));
+  }
+  auto  me  = gctools::GC<CipEngine_O>::allocate_with_default_constructor();
+  me->_Matter = matter;
+  me->snapshot();
+  me->rankAllCenters();
+  return me;
+}
+
+void CipEngine_O::snapshot()
+{
+  this->_MatterGraph = MatterGraph_O::make(this->_Matter,false,true);
+  this->_Graph.extract(this->_MatterGraph);
+  size_t numAtoms = this->_Graph.numberOfAtoms();
+  std::vector<std::string> names(numAtoms);
+  for ( size_t ai=0; ai<numAtoms; ++ai ) names[ai] = this->_MatterGraph->_Atoms[ai]->getName()->symbolNameAsString();
+  std::vector<uint32_t> order(numAtoms);
+  std::iota(order.begin(),order.end(),0);
+  std::sort(order.begin(),order.end(),[&names] (uint32_t x, uint32_t y) { return names[x]<names[y]; });
+  this->_NameRank.assign(numAtoms,0);
+  for ( size_t oi=1; oi<numAtoms; ++oi ) {
+    this->_NameRank[order[oi]] = this->_NameRank[order[oi-1]] + (names[order[oi-1]]<names[order[oi]] ? 1 : 0);
+  }
+}
+
+void CipEngine_O::rankAllCenters()
+{
+  std::vector<uint32_t> p, classes;
+  cip_rank_all_centers(this->_Graph,this->_CenterRadius,this->_CenterRanks,p);
+  this->_Graph.classNumbers(p,classes);
+  this->_Priorities.assign(classes.begin(),classes.end());
+  this->_PrioritiesValid = true;
+}
+
+void CipEngine_O::ensurePriorities()
+{
+  if (this->_PrioritiesValid) return;
+  std::vector<uint32_t> p, classes;
+  this->_Graph.refine(this->_Graph.numberOfAtoms()+1,p);
+  this->_Graph.classNumbers(p,classes);
+  this->_Priorities.assign(classes.begin(),classes.end());
+  this->_PrioritiesValid = true;
+}
+
+CL_DOCSTRING(R"dx(Take a new snapshot of the bonds of the matter and re-rank the neighbors of the centers that
+have an atom whose element or bonds changed within their decision radius.  Return the number of centers
+that were re-ranked.)dx");
+CL_DEFMETHOD size_t CipEngine_O::update()
+{
+  const uint32_t unset = 0xFFFFFFFF;
+  // What is needed of the old snapshot
+  MatterGraph_sp oldMatterGraph = this->_MatterGraph;
+  std::vector<uint32_t> oldAtomicNumbers(this->_Graph._AtomicNumbers.begin(),this->_Graph._AtomicNumbers.end());
+  std::vector<uint32_t> oldStart(this->_Graph._Start.begin(),this->_Graph._Start.end());
+  std::vector<uint32_t> oldNeighbors(this->_Graph._Neighbors.begin(),this->_Graph._Neighbors.end());
+  std::vector<uint32_t> oldBondStart(this->_Graph._BondStart.begin(),this->_Graph._BondStart.end());
+  std::vector<uint32_t> oldBondNeighbors(this->_Graph._BondNeighbors.begin(),this->_Graph._BondNeighbors.end());
+  std::vector<uint32_t> oldRadius(this->_CenterRadius.begin(),this->_CenterRadius.end());
+  std::vector<uint8_t> oldRanks(this->_CenterRanks.begin(),this->_CenterRanks.end());
+  std::vector<uint32_t> oldPriorities(this->_Priorities.begin(),this->_Priorities.end());
+  bool oldPrioritiesValid = this->_PrioritiesValid;
+  this->snapshot();
+  const CipGraph& graph = this->_Graph;
+  size_t numAtoms = graph.numberOfAtoms();
+  // Atoms that are new or whose element or bonded atoms changed
+  std::vector<uint32_t> oldIndex(numAtoms,unset);
+  std::vector<uint32_t> dirty, mapped, previous;
+  for ( size_t ai=0; ai<numAtoms; ++ai ) {
+    core::T_sp index = oldMatterGraph->atomIndex(this->_MatterGraph->_Atoms[ai]);
+    if (index.fixnump()) oldIndex[ai] = index.unsafe_fixnum();
+  }
+  for ( size_t ai=0; ai<numAtoms; ++ai ) {
+    uint32_t old = oldIndex[ai];
+    bool changed = (old==unset || oldAtomicNumbers[old]!=graph._AtomicNumbers[ai]);
+    if (!changed) {
+      mapped.clear();
+      for ( uint32_t ni=graph._Start[ai]; ni<graph._Start[ai+1]; ++ni ) mapped.push_back(oldIndex[graph._Neighbors[ni]]);
+      previous.assign(oldNeighbors.begin()+oldStart[old],oldNeighbors.begin()+oldStart[old+1]);
+      std::sort(mapped.begin(),mapped.end());
+      std::sort(previous.begin(),previous.end());
+      changed = (mapped!=previous);
+    }
+    if (changed) dirty.push_back(ai);
+  }
+  this->_PrioritiesValid = false;
+  if (dirty.empty() && oldPrioritiesValid && numAtoms==oldPriorities.size()) {
+    for ( size_t ai=0; ai<numAtoms; ++ai ) this->_Priorities[ai] = oldPriorities[oldIndex[ai]];
+    this->_PrioritiesValid = true;
+  }
+  // Distance of every atom to the nearest dirty atom out to the largest decision radius
+  uint32_t maxRadius = 0;
+  for ( uint32_t radius : oldRadius ) if (radius!=CIP_RADIUS_UNBOUNDED) maxRadius = std::max(maxRadius,radius);
+  std::vector<uint32_t> distance(numAtoms,unset);
+  std::vector<uint32_t> queue(dirty);
+  for ( uint32_t atom : dirty ) distance[atom] = 0;
+  for ( size_t qi=0; qi<queue.size(); ++qi ) {
+    uint32_t atom = queue[qi];
+    if (distance[atom]>=maxRadius) continue;
+    for ( uint32_t ni=graph._BondStart[atom]; ni<graph._BondStart[atom+1]; ++ni ) {
+      uint32_t neighbor = graph._BondNeighbors[ni];
+      if (distance[neighbor]!=unset) continue;
+      distance[neighbor] = distance[atom]+1;
+      queue.push_back(neighbor);
+    }
+  }
+  // Molecules (connected components) that contain a dirty atom
+  std::vector<uint32_t> component(numAtoms,unset);
+  std::vector<uint8_t> dirtyComponent;
+  for ( size_t ai=0; ai<numAtoms; ++ai ) {
+    if (component[ai]!=unset) continue;
+    uint32_t id = dirtyComponent.size();
+    dirtyComponent.push_back(0);
+    queue.clear();
+    queue.push_back(ai);
+    component[ai] = id;
+    for ( size_t qi=0; qi<queue.size(); ++qi ) {
+      uint32_t atom = queue[qi];
+      if (distance[atom]==0) dirtyComponent[id] = 1;
+      for ( uint32_t ni=graph._BondStart[atom]; ni<graph._BondStart[atom+1]; ++ni ) {
+        uint32_t neighbor = graph._BondNeighbors[ni];
+        if (component[neighbor]!=unset) continue;
+        component[neighbor] = id;
+        queue.push_back(neighbor);
+      }
+    }
+  }
+  // Keep the ranks of the centers whose decision radius holds no dirty atom
+  this->_CenterRadius.assign(numAtoms,CIP_RADIUS_NOT_A_CENTER);
+  this->_CenterRanks.assign(numAtoms*4,0);
+  std::vector<uint32_t> rerank;
+  size_t numCenters = 0;
+  for ( size_t ai=0; ai<numAtoms; ++ai ) {
+    if (graph.numberOfBonds(ai)!=4) continue;
+    ++numCenters;
+    uint32_t old = oldIndex[ai];
+    uint32_t radius = (old==unset) ? CIP_RADIUS_NOT_A_CENTER : oldRadius[old];
+    bool keep = (radius!=CIP_RADIUS_NOT_A_CENTER)
+      && ((radius==CIP_RADIUS_UNBOUNDED) ? !dirtyComponent[component[ai]] : (distance[ai]==unset || distance[ai]>radius));
+    if (!keep) {
+      rerank.push_back(ai);
+      continue;
+    }
+    this->_CenterRadius[ai] = radius;
+    for ( size_t ji=0; ji<4; ++ji ) {
+      uint32_t neighbor = oldIndex[graph._BondNeighbors[graph._BondStart[ai]+ji]];
+      for ( uint32_t ki=0; ki<4; ++ki ) {
+        if (oldBondNeighbors[oldBondStart[old]+ki]==neighbor) this->_CenterRanks[ai*4+ji] = oldRanks[old*4+ki];
+      }
+    }
+  }
+  if (rerank.size()*CIP_ENGINE_LOCAL_UPDATE_FRACTION>numCenters) {
+    this->rankAllCenters();
+  } else {
+    std::vector<uint32_t> localIndex(numAtoms,unset);
+    for ( uint32_t center : rerank ) {
+      cip_rank_center(graph,center,localIndex,&this->_CenterRanks[center*4],this->_CenterRadius[center]);
+      gctools::handle_all_queued_interrupts();
+    }
+  }
+  return rerank.size();
+}
+
+void CipEngine_O::orderedNeighbors(size_t center, uint32_t order[4]) const
+{
+  if (this->_CenterRadius[center]==CIP_RADIUS_NOT_A_CENTER) {
+    SIMPLE_ERROR("Atom {} does not have four bonds", _rep_(this->_MatterGraph->_Atoms[center]));
+  }
+  uint32_t positions[4] = {0,1,2,3};
+  const uint8_t* ranks = &this->_CenterRanks[center*4];
+  const uint32_t* neighbors = &this->_Graph._BondNeighbors[this->_Graph._BondStart[center]];
+  std::sort(positions,positions+4,[&] (uint32_t x, uint32_t y) {
+    if (ranks[x]!=ranks[y]) return ranks[x]>ranks[y];
+    return this->_NameRank[neighbors[x]]>this->_NameRank[neighbors[y]];
+  });
+  for ( size_t ji=0; ji<4; ++ji ) order[ji] = neighbors[positions[ji]];
+}
+
+CL_DOCSTRING(R"dx(Return a simple-vector of the atoms in the order used by the other cip-engine vectors.)dx");
+CL_DEFMETHOD core::SimpleVector_sp CipEngine_O::atomsAsVector() const
+{
+  core::SimpleVector_sp result = core::SimpleVector_O::make(this->_Graph.numberOfAtoms());
+  for ( size_t ai=0; ai<this->_Graph.numberOfAtoms(); ++ai ) (*result)[ai] = this->_MatterGraph->_Atoms[ai];
+  return result;
+}
+
+CL_DOCSTRING(R"dx(Return the index of atom or NIL if the engine doesn't know it.)dx");
+CL_DEFMETHOD core::T_sp CipEngine_O::atomIndex(Atom_sp atom) const
+{
+  return this->_MatterGraph->atomIndex(atom);
+}
+
+CL_DOCSTRING(R"dx(Return a (signed-byte 32) vector of the CIP priority of every atom - equal for atoms that
+can't be told apart and larger for higher priority.)dx");
+CL_DEFMETHOD core::SimpleVector_int32_t_sp CipEngine_O::prioritiesAsVector()
+{
+  this->ensurePriorities();
+  core::SimpleVector_int32_t_sp result = core::SimpleVector_int32_t_O::make(this->_Priorities.size());
+  for ( size_t ai=0; ai<this->_Priorities.size(); ++ai ) (*result)[ai] = this->_Priorities[ai];
+  return result;
+}
+
+CL_DOCSTRING(R"dx(Return a simple-vector with :chiral for every atom with four neighbors of different priority,
+:prochiral for the other atoms with four bonds and :undefined-center for the rest.)dx");
+CL_DEFMETHOD core::SimpleVector_sp CipEngine_O::stereochemistryTypes() const
+{
+  core::SimpleVector_sp result = core::SimpleVector_O::make(this->_Graph.numberOfAtoms());
+  for ( size_t ai=0; ai<this->_Graph.numberOfAtoms(); ++ai ) {
+    if (this->_CenterRadius[ai]==CIP_RADIUS_NOT_A_CENTER) {
+      (*result)[ai] = chemkw::_sym_undefinedCenter;
+      continue;
+    }
+    uint8_t ranks[4];
+    std::copy(&this->_CenterRanks[ai*4],&this->_CenterRanks[ai*4]+4,ranks);
+    std::sort(ranks,ranks+4);
+    (*result)[ai] = (std::unique(ranks,ranks+4)-ranks == 4) ? chemkw::_sym_chiral : chemkw::_sym_prochiral;
+  }
+  return result;
+}
+
+CL_DOCSTRING(R"dx(Return a simple-vector with the R/S configuration of every atom calculated from the current
+coordinates - the same as chem:calculate-stereochemical-configuration but without building CIP hash tables.
+Atoms that don't have four bonds are :undefined-configuration.)dx");
+CL_DEFMETHOD core::SimpleVector_sp CipEngine_O::configurations() const
+{
+  const gctools::Vec0<Atom_sp>& atoms = this->_MatterGraph->_Atoms;
+  core::SimpleVector_sp result = core::SimpleVector_O::make(atoms.size());
+  for ( size_t ai=0; ai<atoms.size(); ++ai ) {
+    ConfigurationEnum config = undefinedConfiguration;
+    if (this->_CenterRadius[ai]!=CIP_RADIUS_NOT_A_CENTER) {
+      uint32_t order[4];
+      this->orderedNeighbors(ai,order);
+      Vector3 vme = atoms[ai]->getPosition();
+      Vector3 v1 = atoms[order[0]]->getPosition().sub(vme);
+      Vector3 v2 = atoms[order[1]]->getPosition().sub(vme);
+      Vector3 v3 = atoms[order[2]]->getPosition().sub(vme);
+      Vector3 v4 = atoms[order[3]]->getPosition().sub(vme);
+      Vector3 v43cross = v4.crossProduct(v3);
+      double dir1 = v1.dotProduct(v43cross);
+      double dir2 = v2.dotProduct(v43cross);
+      if (dir1>0.0 && dir2<0.0) config = R_Configuration;
+      else if (dir1<0.0 && dir2>0.0) config = S_Configuration;
+    }
+    (*result)[ai] = translate::to_object<ConfigurationEnum>::convert(config);
+  }
+  return result;
+}
+
+CL_DOCSTRING(R"dx(Return the four bonded neighbors of the atom with index from highest to lowest CIP priority.
+Neighbors of equal priority are ordered by name as chem:get-neighbors-by-relative-priority does.)dx");
+CL_DEFMETHOD core::List_sp CipEngine_O::neighborsByPriority(size_t index) const
+{
+  if (index>=this->_Graph.numberOfAtoms()) SIMPLE_ERROR("Atom index {} is out of range", index);
+  uint32_t order[4];
+  this->orderedNeighbors(index,order);
+  ql::list result;
+  for ( size_t ji=0; ji<4; ++ji ) result << this->_MatterGraph->_Atoms[order[ji]];
+  return result.cons();
+}
+
+CL_DOCSTRING(R"dx(Return how many bonds out from the atom with index the hierarchical digraph was expanded to rank
+its neighbors, or NIL if they are tied and depend on the whole molecule.)dx");
+CL_DEFMETHOD core::T_sp CipEngine_O::decisionRadius(size_t index) const
+{
+  if (index>=this->_Graph.numberOfAtoms()) SIMPLE_ERROR("Atom index {} is out of range", index);
+  uint32_t radius = this->_CenterRadius[index];
+  if (radius==CIP_RADIUS_NOT_A_CENTER) SIMPLE_ERROR("Atom {} does not have four bonds", _rep_(this->_MatterGraph->_Atoms[index]));
+  if (radius==CIP_RADIUS_UNBOUNDED) return nil<core::T_O>();
+  return core::make_fixnum(radius);
+}
+
+};
@@ -26,6 +26,7 @@ This is an open source license for the CANDO software from Temple University, bu
 #define	DEBUG_LEVEL_FULL
 
 #include <cando/chem/cipPrioritizer.h>
+#include <cando/chem/cipEngine.h>
 //#include "core/archiveNode.h"
 //#include "core/archive.h"
 #include <cando/chem/matter.h>
@@ -184,22 +185,36 @@ vector<int>	partition(gctools::Vec0<AtomPriority> atoms,int indexOffset, OrderBy
 }
 
 
+/*! Same priorities as assignCahnIngoldPrelogPriorityToAtomsRelativePriority but refined on
+ *  flat arrays instead of sorting AtomPriority vectors through the hash table. */
+static void assignPrioritiesFromGraph(Matter_sp matter, core::HashTable_sp cip)
+{
+  MatterGraph_sp matterGraph = MatterGraph_O::make(matter,false,true);
+  const gctools::Vec0<Atom_sp>& atoms = matterGraph->_Atoms;
+  CipGraph graph;
+  graph.extract(matterGraph);
+  std::vector<uint32_t> p, classes;
+  size_t levels = graph.refine(atoms.size()+1,p);
+  graph.classNumbers(p,classes);
+  for ( size_t ai=0; ai<atoms.size(); ++ai ) {
+    // If the first pass doesn't split any class the priorities stay the atomic numbers
+    uint32_t priority = levels ? classes[ai] : graph._AtomicNumbers[ai];
+    cip->setf_gethash(atoms[ai],core::clasp_make_fixnum(priority));
+  }
+}
+
 CL_LISPIFY_NAME(chem:assign-priorities-hash-table);
 DOCGROUP(cando);
 CL_DEFUN core::HashTable_sp CipPrioritizer_O::assignPrioritiesHashTable(Matter_sp matter)
 {
   core::HashTable_sp cip = core::HashTableEq_O::create_default();
-  CipPrioritizer_sp prior;
   if (gc::IsA<Molecule_sp>(matter)) {
-    prior = CipPrioritizer_O::create();
-    prior->assignCahnIngoldPrelogPriorityToAtomsRelativePriority(matter,cip);
+    assignPrioritiesFromGraph(gc::As_unsafe<Molecule_sp>(matter),cip);
   } else if (gc::IsA<Aggregate_sp>(matter)) {
     Loop l;
     l.loopTopGoal(matter,MOLECULES);
     while ( l.advanceLoopAndProcess() ) {
-      Molecule_sp mol = l.getMolecule();
-      prior = CipPrioritizer_O::create();
-      prior->assignCahnIngoldPrelogPriorityToAtomsRelativePriority(mol,cip);
+      assignPrioritiesFromGraph(l.getMolecule(),cip);
     }
   } else {
     TYPE_ERROR(matter,core::Cons_O::createList(_sym_Aggregate_O,_sym_Molecule_O));
@@ -544,7 +559,7 @@ CL_DEFMETHOD core::HashTable_mv CipPrioritizer_O::calculateStereochemistryTypeFo
 {
   core::HashTable_sp cip = core::HashTableEq_O::create_default();
   core::HashTable_sp stereochemistryType = core::HashTableEq_O::create_default();
-  this->assignCahnIngoldPrelogPriorityToAtomsRelativePriority( molOrAgg, cip );
+  assignPrioritiesFromGraph( molOrAgg, cip );
   Loop l;
   l.loopTopGoal( molOrAgg, ATOMS );
   while ( l.advanceLoopAndProcess() ) {
@@ -1,6 +1,8 @@
 (k:sources :libclasp
            #~"rigid_staple.cc"
            #~"chemInfo.cc"
+           #~"chemInfoMatcher.cc"
+           #~"substructureSearch.cc"
            #~"ffTypesDb.cc"
            #~"ffStretchDb.cc"
            #~"ffVdwDb.cc"
@@ -41,6 +43,7 @@
            #~"indirectAtomCoordinateReference.cc"
            #~"maxcliqueseq.cc"
            #~"energyComponent.cc"
+           #~"energyBenchmark.cc"
            #~"energyStretch.cc"
            #~"energySketchStretch.cc"
            #~"energyAngle.cc"
@@ -56,6 +59,7 @@
            #~"energyAtomTable.cc"
            #~"energyRigidBodyStaple.cc"
            #~"energyRigidBodyNonbond.cc"
+           #~"energyGeneralizedBorn.cc"
            #~"scoringFunction.cc"
            #~"energyFunction.cc"
            #~"sketchFunction.cc"
@@ -83,8 +87,14 @@
            #~"linearAlgebra.cc"
            #~"minimizerLog.cc"
            #~"iterateRestraints.cc"
+           #~"molecularDynamics.cc"
+           #~"bondConstraints.cc"
+           #~"monteCarloBarostat.cc"
            #~"pdb.cc"
            #~"ringFinder.cc"
+           #~"ringPerception.cc"
+           #~"matterGraph.cc"
+           #~"matterTemplate.cc"
            #~"iterateMatter.cc"
            #~"macroModel.cc"
            #~"alias.cc"
@@ -97,6 +107,7 @@
            #~"atomIndexer.cc"
            #~"structureList.cc"
            #~"twister.cc"
+           #~"torsionScan.cc"
            #~"largeSquareMatrix.cc"
            #~"randomGenerators.cc"
            #~"stereochemistry.cc"
@@ -105,10 +116,15 @@
            #~"representedEntityNameSet.cc"
            #~"readAmberParameters.cc"
            #~"cipPrioritizer.cc"
+           #~"cipEngine.cc"
+           #~"canonicalSmiles.cc"
            #~"chemdraw.cc"
            #~"candoScript.cc"
            #~"monomer.cc"
            #~"conformationExplorer.cc"
            #~"conformationCollection.cc"
            #~"monteCarlo.cc"
-           #~"octree.cc")
+           #~"octree.cc"
+           #~"solvate.cc"
+           #~"sdfFile.cc"
+           #~"amberFile.cc")
@@ -46,7 +46,7 @@ namespace chem {
 if (hasActiveAtomMask \
     && !(bitvectorActiveAtomMask->testBit(I1/3) \
          ) \
-    ) goto SKIP_term;
+    ) { ENERGY_COUNT_SKIPPED_TERM(); goto SKIP_term; }
 #define ANCHOR_RESTRAINT_APPLY_DEBUG_INTERACTIONS(I1) \
     if (doDebugInteractions) { \
       core::eval::funcall(debugInteractions,EnergyAnchorRestraint_O::static_classSymbol(), \
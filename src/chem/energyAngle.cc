@@ -45,6 +45,8 @@ This is an open source license for the CANDO software from Temple University, bu
 #include <cando/chem/ffAngleDb.h>
 #include <cando/chem/largeSquareMatrix.h>
 #include <clasp/core/wrappers.h>
+#include <algorithm>
+#include <tuple>
 
 
 namespace chem {
@@ -57,7 +59,7 @@ if (hasActiveAtomMask \
          && bitvectorActiveAtomMask->testBit(I2/3) \
          && bitvectorActiveAtomMask->testBit(I3/3) \
          ) \
-    ) goto SKIP_term;
+    ) { ENERGY_COUNT_SKIPPED_TERM(); goto SKIP_term; }
 
 
 //
@@ -113,6 +115,67 @@ double	_evaluateEnergyOnly_Angle(
     return Energy;
 }
 
+/*! Evaluate the energy and optionally the force of the compiled angle terms.
+ *  There is no active atom mask or Hessian so the loop body is straight line
+ *  code that reads the packed parameter and index arrays.  Real is the type the
+ *  terms are evaluated in - the energy is summed and the force accumulated in double.
+ *  If any angle is linear then illegal is set and the caller must re-evaluate the
+ *  terms with the general loop so that the error can name the atoms.
+ */
+template <typename Real>
+static double _evaluateCompiled_Angle( size_t numTerms,
+                                       const float* compiled_kt,
+                                       const float* compiled_t0,
+                                       const int32_t* compiled_I1,
+                                       const int32_t* compiled_I2,
+                                       const int32_t* compiled_I3,
+                                       const Vector_real* coords,
+                                       bool calcForce,
+                                       Vector_real* force,
+                                       bool& illegal )
+{
+  const bool hasActiveAtomMask = false;
+  core::SimpleBitVector_sp bitvectorActiveAtomMask;
+  KahanSummation totalEnergy;
+  bool anyIllegalAngle = false;
+#undef	ANGLE_SET_PARAMETER
+#define	ANGLE_SET_PARAMETER(x)	{x = compiled_##x[i];}
+#undef	ANGLE_SET_POSITION
+#define	ANGLE_SET_POSITION(x,ii,of)	{x = coords[ii+of];}
+#undef	ANGLE_ENERGY_ACCUMULATE
+#define	ANGLE_ENERGY_ACCUMULATE(e) { totalEnergy.add(e); }
+#undef	ANGLE_FORCE_ACCUMULATE
+#define	ANGLE_FORCE_ACCUMULATE(i,o,v) { force[(i)+(o)] += (v); }
+#undef	ANGLE_DIAGONAL_HESSIAN_ACCUMULATE
+#define	ANGLE_DIAGONAL_HESSIAN_ACCUMULATE(i1,o1,i2,o2,v) {}
+#undef	ANGLE_OFF_DIAGONAL_HESSIAN_ACCUMULATE
+#define	ANGLE_OFF_DIAGONAL_HESSIAN_ACCUMULATE(i1,o1,i2,o2,v) {}
+#define	ANGLE_CALC_FORCE
+#undef	ANGLE_CALC_DIAGONAL_HESSIAN  // Don't calculate the HESSIAN
+#undef	ANGLE_CALC_OFF_DIAGONAL_HESSIAN
+#undef	DECLARE_FLOAT
+#define	DECLARE_FLOAT(x) Real x = 0.0
+#pragma clang diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#include <cando/chem/energy_functions/_Angle_termDeclares.cc>
+#pragma clang diagnostic pop
+#undef	DECLARE_FLOAT
+#define	DECLARE_FLOAT(x) num_real x = 0.0
+  Real x1,y1,z1,x2,y2,z2,x3,y3,z3,kt,t0;
+  int I1, I2, I3;
+#define ANGLE_DEBUG_INTERACTIONS(I1,I2,I3)
+#pragma clang loop vectorize(enable)
+  for ( size_t i=0; i<numTerms; i++ ) {
+    bool IllegalAngle = false;
+#include <cando/chem/energy_functions/_Angle_termCode.cc>
+    anyIllegalAngle |= IllegalAngle;
+  }
+#undef ANGLE_DEBUG_INTERACTIONS
+#undef	ANGLE_CALC_FORCE
+  illegal = anyIllegalAngle;
+  return totalEnergy.getSum();
+}
+
 
 CL_LAMBDA((energy-angle chem:energy-angle) pos &optional activeAtomMask);
 CL_DEFMETHOD void	EnergyAngle_O::compareAnalyticalAndNumericalForceAndHessianTermByTerm(chem::NVector_sp 	pos, core::T_sp activeAtomMask )
@@ -340,6 +403,38 @@ num_real	angle;
 void EnergyAngle_O::addTerm(const EnergyAngle& term)
 {
     this->_Terms.push_back(term);
+    this->invalidateCompiledTerms();
+}
+
+void EnergyAngle_O::compileTerms()
+{
+  size_t num = this->_Terms.size();
+  std::vector<int32_t> order(num);
+  for ( size_t ii=0; ii<num; ++ii ) order[ii] = ii;
+  // Sort on the central coordinate index and then the outer ones so that
+  // consecutive terms touch neighbouring coordinates
+  std::stable_sort(order.begin(),order.end(),[this] (int32_t a, int32_t b) {
+    const TermAngle& ta = this->_Terms[a].term;
+    const TermAngle& tb = this->_Terms[b].term;
+    return std::make_tuple(ta.I2,std::min(ta.I1,ta.I3),std::max(ta.I1,ta.I3))
+      < std::make_tuple(tb.I2,std::min(tb.I1,tb.I3),std::max(tb.I1,tb.I3));
+  });
+  this->_CompiledKt = core::SimpleVector_float_O::make(num);
+  this->_CompiledT0 = core::SimpleVector_float_O::make(num);
+  this->_CompiledI1 = core::SimpleVector_int32_t_O::make(num);
+  this->_CompiledI2 = core::SimpleVector_int32_t_O::make(num);
+  this->_CompiledI3 = core::SimpleVector_int32_t_O::make(num);
+  this->_CompiledTermIndex = core::SimpleVector_int32_t_O::make(num);
+  for ( size_t ii=0; ii<num; ++ii ) {
+    const TermAngle& term = this->_Terms[order[ii]].term;
+    (*this->_CompiledKt)[ii] = term.kt;
+    (*this->_CompiledT0)[ii] = term.t0;
+    (*this->_CompiledI1)[ii] = term.I1;
+    (*this->_CompiledI2)[ii] = term.I2;
+    (*this->_CompiledI3)[ii] = term.I3;
+    (*this->_CompiledTermIndex)[ii] = order[ii];
+  }
+  this->_CompiledTermsValid = true;
 }
 
 
@@ -477,8 +572,46 @@ double EnergyAngle_O::evaluateAllComponent( ScoringFunction_sp score,
 #define ANGLE_CALC_FORCE
 #define ANGLE_CALC_DIAGONAL_HESSIAN
 #define ANGLE_CALC_OFF_DIAGONAL_HESSIAN
+  this->ensureCompiledTerms();
+  size_t numTerms = this->_CompiledTermIndex->length();
+  if (numTerms==0) {
+    maybeSetEnergy( componentEnergy, EnergyAngle_O::static_classSymbol(), termEnergy );
+    return termEnergy;
+  }
+  const float* compiled_kt = &(*this->_CompiledKt)[0];
+  const float* compiled_t0 = &(*this->_CompiledT0)[0];
+  const int32_t* compiled_I1 = &(*this->_CompiledI1)[0];
+  const int32_t* compiled_I2 = &(*this->_CompiledI2)[0];
+  const int32_t* compiled_I3 = &(*this->_CompiledI3)[0];
+  const int32_t* compiled_index = &(*this->_CompiledTermIndex)[0];
+  if ( !calcForce && !hasActiveAtomMask && !doDebugInteractions && !this->_DebugEnergy ) {
+    bool illegal = false;
+    termEnergy = _evaluateCompiled_Angle<double>(numTerms,compiled_kt,compiled_t0,
+                                                 compiled_I1,compiled_I2,compiled_I3,
+                                                 &(*pos)[0],false,NULL,illegal);
+    if (!illegal) {
+      maybeSetEnergy( componentEnergy, EnergyAngle_O::static_classSymbol(), termEnergy );
+      return termEnergy;
+    }
+    // Fall through to the general loop to report the linear angle
+    termEnergy = 0.0;
+  } else if ( this->_SinglePrecision && !calcDiagonalHessian && !calcOffDiagonalHessian
+              && !hasActiveAtomMask && !doDebugInteractions && !this->_DebugEnergy ) {
+    bool illegal = false;
+    termEnergy = _evaluateCompiled_Angle<float>(numTerms,compiled_kt,compiled_t0,
+                                                compiled_I1,compiled_I2,compiled_I3,
+                                                &(*pos)[0],calcForce&&hasForce,
+                                                hasForce ? &(*force)[0] : NULL,illegal);
+    if (!illegal) {
+      maybeSetEnergy( componentEnergy, EnergyAngle_O::static_classSymbol(), termEnergy );
+      return termEnergy;
+    }
+    // Fall through to the general loop which signals the linear angle error
+    // before the force it accumulates is used.
+    termEnergy = 0.0;
+  }
 #undef ANGLE_SET_PARAMETER
-#define ANGLE_SET_PARAMETER(x)	{x=ai->term.x;}
+#define ANGLE_SET_PARAMETER(x)	{x=compiled_##x[i];}
 #undef ANGLE_SET_POSITION
 #define ANGLE_SET_POSITION(x,ii,of)	{x=pos->element(ii+of);}
 #undef ANGLE_ENERGY_ACCUMULATE
@@ -502,10 +635,9 @@ double EnergyAngle_O::evaluateAllComponent( ScoringFunction_sp score,
     fx3 = 0.0; fy3 = 0.0; fz3 = 0.0;
     num_real x1,y1,z1,x2,y2,z2,x3,y3,z3,kt,t0; //,angleScale;
 //	double DotAbCb;
-    int I1, I2, I3,i;
-    gctools::Vec0<EnergyAngle>::iterator ai;
-    for ( i=0,ai=this->_Terms.begin();
-          ai!=this->_Terms.end(); ai++,i++ ) {
+    int I1, I2, I3;
+    size_t i;
+    for ( i=0; i<numTerms; i++ ) {
 #ifdef	DEBUG_CONTROL_THE_NUMBER_OF_TERMS_EVALAUTED
       if ( this->_Debug_NumberOfTermsToCalculate > 0 ) {
         if ( i>= this->_Debug_NumberOfTermsToCalculate ) {
@@ -516,22 +648,24 @@ double EnergyAngle_O::evaluateAllComponent( ScoringFunction_sp score,
       bool IllegalAngle = false;
 #include	<cando/chem/energy_functions/_Angle_termCode.cc>
                 
+      EnergyAngle& entry = this->_Terms[compiled_index[i]];
       if ( IllegalAngle ) {
-        ERROR(chem::_sym_LinearAngleError,core::Cons_O::createList(kw::_sym_atoms,core::Cons_O::createList(ai->_Atom1,ai->_Atom2,ai->_Atom3),
+        ERROR(chem::_sym_LinearAngleError,core::Cons_O::createList(kw::_sym_atoms,core::Cons_O::createList(entry._Atom1,entry._Atom2,entry._Atom3),
                                                                    kw::_sym_coordinates,pos,
                                                                    kw::_sym_indexes,core::Cons_O::createList(core::make_fixnum(I1), core::make_fixnum(I2), core::make_fixnum(I3))));
       }
 #if TURN_ENERGY_FUNCTION_DEBUG_ON //[
-      ai->_calcForce = calcForce;
-      ai->_calcDiagonalHessian = calcDiagonalHessian;
-      ai->_calcOffDiagonalHessian = calcOffDiagonalHessian;
+      entry._calcForce = calcForce;
+      entry._calcDiagonalHessian = calcDiagonalHessian;
+      entry._calcOffDiagonalHessian = calcOffDiagonalHessian;
 #undef	EVAL_SET
-#define	EVAL_SET(var,val)	{ ai->eval.var=val;};
+#define	EVAL_SET(var,val)	{ entry.eval.var=val;};
 #include	<cando/chem/energy_functions/_Angle_debugEvalSet.cc>
 #endif //]
       if ( this->_DebugEnergy ) 
       {
         LOG_ENERGY(( "MEISTER angle %d args cando\n") , (i+1) );
+        LOG_ENERGY(( "MEISTER angle %d term %d\n") , (i+1) , compiled_index[i] );
         LOG_ENERGY(( "MEISTER angle %d t0 %lf\n") , (i+1) , t0 );
         LOG_ENERGY(( "MEISTER angle %d kt %lf\n") , (i+1) , kt);
         LOG_ENERGY(( "MEISTER angle %d x1 %5.3lf %d\n") , (i+1) , x1 %(I1/3+1) );
@@ -747,6 +881,7 @@ CL_DEFMETHOD void EnergyAngle_O::fill_from_vectors_in_alist(core::List_sp vector
        entry._Atom2 = gc::As_unsafe<Atom_sp>((*atom2_vec)[i]);
        entry._Atom3 = gc::As_unsafe<Atom_sp>((*atom3_vec)[i]);
   }
+  this->invalidateCompiledTerms();
 }
 
 CL_DEFMETHOD void EnergyAngle_O::addAngleTerm(AtomTable_sp atomTable, Atom_sp a1, Atom_sp a2, Atom_sp a3, double kt, double t0) {
@@ -0,0 +1,151 @@
+/*
+    File: energyBenchmark.cc
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University
+at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+/* -^- */
+#define DEBUG_LEVEL_NONE
+
+//
+// Support for the energy-benchmarks system
+//
+// Times a single energy component in one of three modes and reports how many
+// terms it evaluates and how many bytes of term storage it streams through, so
+// the Lisp side can turn wall time into ns/term, terms/s and bytes/s.
+//
+
+#include <chrono>
+#include <clasp/core/common.h>
+#include <cando/chem/nVector.h>
+#include <cando/chem/energyFunction.h>
+#include <cando/chem/energyComponent.h>
+#include <cando/chem/energyStretch.h>
+#include <cando/chem/energyAngle.h>
+#include <cando/chem/energyDihedral.h>
+#include <cando/chem/energyNonbond.h>
+#include <cando/chem/energyAtomTable.h>
+#include <clasp/core/wrappers.h>
+
+namespace chem {
+
+SYMBOL_EXPORT_SC_(KeywordPkg,energy);
+SYMBOL_EXPORT_SC_(KeywordPkg,energy_force);
+SYMBOL_EXPORT_SC_(KeywordPkg,energy_force_hessian);
+
+static void zero_nvector(NVector_sp vec) {
+  for ( size_t ii=0, iEnd(vec->length()); ii<iEnd; ++ii ) (*vec)[ii] = 0.0;
+}
+
+CL_DOCSTRING(R"dx(Evaluate COMPONENT of ENERGY-FUNCTION at POS REPEATS times and return
+(values seconds-per-evaluation energy).  MODE is :energy, :energy-force or
+:energy-force-hessian.  The Hessian mode accumulates the Hessian times a vector of ones
+into a scratch vector rather than building the matrix, so it runs at any system size.
+The force and Hessian-vector buffers are cleared outside of the timed region.)dx");
+CL_LAMBDA(energy-function component pos &key (mode :energy) (repeats 10) energy-scale);
+DOCGROUP(cando);
+CL_DEFUN core::T_mv chem__energy_component_benchmark(EnergyFunction_sp energy_function,
+                                                     EnergyComponent_sp component,
+                                                     NVector_sp pos,
+                                                     core::Symbol_sp mode,
+                                                     size_t repeats,
+                                                     core::T_sp energyScale)
+{
+  bool calcForce = false;
+  bool calcHessian = false;
+  if (mode == kw::_sym_energy_force) {
+    calcForce = true;
+  } else if (mode == kw::_sym_energy_force_hessian) {
+    calcForce = true;
+    calcHessian = true;
+  } else if (mode != kw::_sym_energy) {
+    SIMPLE_ERROR("mode must be one of :energy, :energy-force or :energy-force-hessian - not {}", _rep_(mode));
+  }
+  if (repeats==0) SIMPLE_ERROR("repeats must be positive");
+  size_t size = pos->length();
+  gc::Nilable<NVector_sp> force = nil<core::T_O>();
+  gc::Nilable<NVector_sp> hdvec = nil<core::T_O>();
+  gc::Nilable<NVector_sp> dvec = nil<core::T_O>();
+  if (calcForce) force = NVector_O::make(size,0.0,true);
+  if (calcHessian) {
+    hdvec = NVector_O::make(size,0.0,true);
+    dvec = NVector_O::make(size,1.0,true);
+  }
+  double energy = 0.0;
+  std::chrono::duration<double> elapsed(0.0);
+  for ( size_t rr=0; rr<repeats; ++rr ) {
+    if (calcForce) zero_nvector(force);
+    if (calcHessian) zero_nvector(hdvec);
+    auto start = std::chrono::steady_clock::now();
+    energy = component->evaluateAllComponent(energy_function,
+                                             pos,
+                                             energyScale,
+                                             nil<core::T_O>(),
+                                             calcForce,force,
+                                             calcHessian,calcHessian,
+                                             nil<AbstractLargeSquareMatrix_O>(),
+                                             hdvec,
+                                             dvec,
+                                             nil<core::T_O>(),
+                                             nil<core::T_O>());
+    elapsed += std::chrono::steady_clock::now()-start;
+  }
+  return Values(core::DoubleFloat_O::create(elapsed.count()/repeats),core::DoubleFloat_O::create(energy));
+}
+
+template <typename Component>
+static bool term_stats(EnergyComponent_sp component, size_t& terms, size_t& bytes) {
+  if (!gc::IsA<gctools::smart_ptr<Component>>(component)) return false;
+  auto comp = gc::As_unsafe<gctools::smart_ptr<Component>>(component);
+  terms = comp->_Terms.size();
+  bytes = terms*sizeof(typename Component::TermType);
+  return true;
+}
+
+CL_DOCSTRING(R"dx(Return (values terms bytes) for COMPONENT - the number of interactions one
+evaluation computes and the number of bytes of term storage it reads to do so.  For a
+nonbond component that uses the excluded atom list the terms are all atom pairs that are not
+excluded and the bytes are the excluded atom lists.  Returns (values nil nil) for
+components that are not stretch, angle, dihedral or nonbond.)dx");
+DOCGROUP(cando);
+CL_DEFUN core::T_mv chem__energy_component_term_statistics(EnergyComponent_sp component)
+{
+  size_t terms = 0;
+  size_t bytes = 0;
+  if (gc::IsA<EnergyNonbond_sp>(component)) {
+    EnergyNonbond_sp nonbond = gc::As_unsafe<EnergyNonbond_sp>(component);
+    if (nonbond->_UsesExcludedAtoms) {
+      terms = nonbond->profileTermCount();
+      bytes = (nonbond->_ExcludedAtomIndexes->length()+nonbond->_NumberOfExcludedAtomIndexes->length())*sizeof(int32_t);
+    } else {
+      terms = nonbond->_Terms.size();
+      bytes = terms*sizeof(EnergyNonbond_O::TermType);
+    }
+  } else if ( !term_stats<EnergyStretch_O>(component,terms,bytes)
+              && !term_stats<EnergyAngle_O>(component,terms,bytes)
+              && !term_stats<EnergyDihedral_O>(component,terms,bytes) ) {
+    return Values(nil<core::T_O>(),nil<core::T_O>());
+  }
+  return Values(core::make_fixnum(terms),core::make_fixnum(bytes));
+}
+
+};
@@ -37,7 +37,7 @@ This is an open source license for the CANDO software from Temple University, bu
 
 namespace chem {
 
-
+thread_local EnergyTermCounters energyTermCounters = {0,0};
 
 
 
@@ -142,6 +142,63 @@ num_real chem__energy_component_evaluate_energy_force(EnergyFunction_sp energy_f
   return val;
 };
 
+void EnergyComponent_O::profileRecord(double seconds, const EnergyTermCounters& counters)
+{
+  size_t terms = this->profileTermCount();
+  size_t evaluated = (terms>counters._TermsSkipped) ? terms-counters._TermsSkipped : 0;
+  this->_ProfileCalls++;
+  this->_ProfileSeconds += seconds;
+  this->_ProfileTermsEvaluated += evaluated;
+  this->_ProfileTermsSkipped += counters._TermsSkipped;
+  this->_ProfileHessianElements += counters._HessianElements;
+  this->_ProfileLastSeconds = seconds;
+  this->_ProfileLastTermsEvaluated = evaluated;
+  this->_ProfileLastTermsSkipped = counters._TermsSkipped;
+  this->_ProfileLastHessianElements = counters._HessianElements;
+}
+
+CL_DOCSTRING(R"dx(Clear the evaluation profile of the component.)dx");
+CL_DEFMETHOD void EnergyComponent_O::profileReset()
+{
+  this->_ProfileCalls = 0;
+  this->_ProfileSeconds = 0.0;
+  this->_ProfileTermsEvaluated = 0;
+  this->_ProfileTermsSkipped = 0;
+  this->_ProfileHessianElements = 0;
+  this->_ProfileLastSeconds = 0.0;
+  this->_ProfileLastTermsEvaluated = 0;
+  this->_ProfileLastTermsSkipped = 0;
+  this->_ProfileLastHessianElements = 0;
+}
+
+SYMBOL_EXPORT_SC_(KeywordPkg,calls);
+SYMBOL_EXPORT_SC_(KeywordPkg,seconds);
+SYMBOL_EXPORT_SC_(KeywordPkg,terms_evaluated);
+SYMBOL_EXPORT_SC_(KeywordPkg,terms_skipped);
+SYMBOL_EXPORT_SC_(KeywordPkg,hessian_elements);
+SYMBOL_EXPORT_SC_(KeywordPkg,last_call);
+
+CL_DOCSTRING(R"dx(Return the evaluation profile of the component as a plist.
+The totals over every call made by the energy-function since the last reset are under
+:calls, :seconds, :terms-evaluated, :terms-skipped (by the active atom mask or cutoff)
+and :hessian-elements.  :last-call holds a plist of the same counters for the most recent call.)dx");
+CL_DEFMETHOD core::List_sp EnergyComponent_O::profileAsPlist()
+{
+  ql::list last;
+  last << kw::_sym_seconds << core::DoubleFloat_O::create(this->_ProfileLastSeconds)
+       << kw::_sym_terms_evaluated << core::make_fixnum(this->_ProfileLastTermsEvaluated)
+       << kw::_sym_terms_skipped << core::make_fixnum(this->_ProfileLastTermsSkipped)
+       << kw::_sym_hessian_elements << core::make_fixnum(this->_ProfileLastHessianElements);
+  ql::list result;
+  result << kw::_sym_calls << core::make_fixnum(this->_ProfileCalls)
+         << kw::_sym_seconds << core::DoubleFloat_O::create(this->_ProfileSeconds)
+         << kw::_sym_terms_evaluated << core::make_fixnum(this->_ProfileTermsEvaluated)
+         << kw::_sym_terms_skipped << core::make_fixnum(this->_ProfileTermsSkipped)
+         << kw::_sym_hessian_elements << core::make_fixnum(this->_ProfileHessianElements)
+         << kw::_sym_last_call << last.cons();
+  return result.cons();
+}
+
 EnergyComponent_sp EnergyComponent_O::filterCopyComponent(core::T_sp keepInteractionFactory) {
   IMPLEMENT_ME();
 }
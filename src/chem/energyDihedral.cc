@@ -45,6 +45,8 @@ This is an open source license for the CANDO software from Temple University, bu
 #include <cando/chem/largeSquareMatrix.h>
 #include <clasp/core/evaluator.h>
 #include <clasp/core/wrappers.h>
+#include <algorithm>
+#include <tuple>
 
 #define VEC8(v) {v,v,v,v,v,v,v,v}
 #define VEC4(v) {v,v,v,v}
@@ -103,6 +105,54 @@ void	sinNPhiCosNPhi(int n, Real& sinNPhi, Real& cosNPhi,
   }
 }
 
+/*! Sum the Fourier series of the compiled dihedral terms [start,end) that share one
+ *  atom quadruple.  sin(n*phi) and cos(n*phi) are built once up to the largest
+ *  multiplicity with the SinCos<N> recurrence.
+ *  energy is the energy of the series without the linear dihedral factor.
+ *  The generated term code only depends on the series through dE/dPhi and d2E/dPhi2
+ *  so they are returned in sinNPhi and cosNPhi such that evaluating the term code with
+ *  V=1, DN=1, cosPhase=1 and sinPhase=0 gives the derivatives of the whole series.
+ */
+template <typename Real>
+void	dihedralSeries(size_t start, size_t end,
+                       const float* sinPhase, const float* cosPhase,
+                       const float* V, const float* DN, const int32_t* IN,
+                       Real sinPhi, Real cosPhi,
+                       Real& energy, Real& sinNPhi, Real& cosNPhi )
+{
+  Real sinN[7];
+  Real cosN[7];
+  int maxN = 1;
+  for ( size_t k=start; k<end; k++ ) {
+    if (IN[k]<1 || IN[k]>6) SIMPLE_ERROR("N {} should always be 1-6", IN[k]);
+    maxN = std::max(maxN,(int)IN[k]);
+  }
+  SinCos<1,Real>::sinNPhiCosNPhi(sinN[1],cosN[1],sinPhi,cosPhi);
+  for ( int n=2; n<=maxN; n++ ) {
+    sinN[n] = cosPhi*sinN[n-1]+sinPhi*cosN[n-1];
+    cosN[n] = cosPhi*cosN[n-1]-sinPhi*sinN[n-1];
+  }
+  energy = 0.0;
+  sinNPhi = 0.0;
+  cosNPhi = 0.0;
+  for ( size_t k=start; k<end; k++ ) {
+    Real cosDelta = cosN[IN[k]]*cosPhase[k]+sinN[IN[k]]*sinPhase[k];
+    Real sinDelta = cosPhase[k]*sinN[IN[k]]-cosN[IN[k]]*sinPhase[k];
+    energy += V[k]*(1.0+cosDelta);
+    sinNPhi += DN[k]*V[k]*sinDelta;
+    cosNPhi += DN[k]*DN[k]*V[k]*cosDelta;
+  }
+}
+
+/*! Evaluate the dihedral geometry once for the terms of group g and replace the
+ *  single term Fourier series of the generated term code with the group's series.
+ */
+#define DIHEDRAL_GROUP_sinNPhiCosNPhi(IN,SinNPhi,CosNPhi,SinPhi,CosPhi) \
+  { dihedralSeries(groupTermStart,groupTermEnd, \
+                   compiled_sinPhase,compiled_cosPhase,compiled_V,compiled_DN,compiled_IN, \
+                   SinPhi,CosPhi,groupEnergy,SinNPhi,CosNPhi); \
+    V = 1.0; DN = 1.0; cosPhase = 1.0; sinPhase = 0.0; }
+
 #define ENERGY_FUNCTION I1, I2, I3, I4, activeAtomMask
 
 SYMBOL_EXPORT_SC_(ChemPkg,EnergyDihedralIn1);
@@ -138,7 +188,7 @@ if (hasActiveAtomMask \
          && bitvectorActiveAtomMask->testBit(I2/3) \
          && bitvectorActiveAtomMask->testBit(I3/3) \
          && bitvectorActiveAtomMask->testBit(I4/3)) \
-    ) goto SKIP_term;
+    ) { ENERGY_COUNT_SKIPPED_TERM(); goto SKIP_term; }
 
 
 
@@ -195,6 +245,83 @@ double	_evaluateEnergyOnly_Dihedral( int I1, int I2, int I3, int I4,
   return Energy;
 }
 
+/*! Evaluate the energy and optionally the force of the compiled dihedral groups.
+ *  There is no active atom mask or Hessian so the loop body is straight line
+ *  code that reads the packed parameter and index arrays.  Real is the type the
+ *  terms are evaluated in - the energy is summed and the force accumulated in double.
+ *  If any dihedral is linear then linear is set and the caller must re-evaluate the
+ *  terms with the general loop so that the error can name the atoms.
+ */
+template <typename Real>
+static double _evaluateCompiled_Dihedral( size_t groupStart,
+                                          size_t groupEnd,
+                                          const int32_t* compiled_group,
+                                          const float* compiled_sinPhase,
+                                          const float* compiled_cosPhase,
+                                          const float* compiled_V,
+                                          const float* compiled_DN,
+                                          const int32_t* compiled_IN,
+                                          const int32_t* compiled_I1,
+                                          const int32_t* compiled_I2,
+                                          const int32_t* compiled_I3,
+                                          const int32_t* compiled_I4,
+                                          const Vector_real* coords,
+                                          bool calcForce,
+                                          Vector_real* force,
+                                          bool& linear )
+{
+  KahanSummation totalEnergy;
+  bool anyLinearDihedral = false;
+#undef	DIHEDRAL_SET_PARAMETER
+#define	DIHEDRAL_SET_PARAMETER(x)	{x = compiled_##x[groupTermStart];}
+#undef	DIHEDRAL_SET_POSITION
+#define	DIHEDRAL_SET_POSITION(x,ii,of)	{x = coords[ii+of];}
+#undef	DIHEDRAL_ENERGY_ACCUMULATE
+#define	DIHEDRAL_ENERGY_ACCUMULATE(e) { e = groupEnergy*EraseLinearDihedral; totalEnergy.add(e); }
+#undef	DIHEDRAL_FORCE_ACCUMULATE
+#define	DIHEDRAL_FORCE_ACCUMULATE(i,o,v) { force[(i)+(o)] += (v); }
+#undef	DIHEDRAL_DIAGONAL_HESSIAN_ACCUMULATE
+#define	DIHEDRAL_DIAGONAL_HESSIAN_ACCUMULATE(i1,o1,i2,o2,v) {}
+#undef	DIHEDRAL_OFF_DIAGONAL_HESSIAN_ACCUMULATE
+#define	DIHEDRAL_OFF_DIAGONAL_HESSIAN_ACCUMULATE(i1,o1,i2,o2,v) {}
+#define	DIHEDRAL_CALC_FORCE
+#undef	DIHEDRAL_CALC_DIAGONAL_HESSIAN  // Don't calculate the HESSIAN
+#undef	DIHEDRAL_CALC_OFF_DIAGONAL_HESSIAN
+#undef	DIHEDRAL_APPLY_ATOM_MASK
+#define	DIHEDRAL_APPLY_ATOM_MASK(I1,I2,I3,I4) {}
+#undef	DECLARE_FLOAT
+#define	DECLARE_FLOAT(x) Real x = 0.0
+#pragma clang diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#include <cando/chem/energy_functions/_Dihedral_termDeclares.cc>
+#pragma clang diagnostic pop
+#undef	DECLARE_FLOAT
+#define	DECLARE_FLOAT(x) num_real x = 0.0
+  Real x1,y1,z1,x2,y2,z2,x3,y3,z3,x4,y4,z4,V,DN;
+  Real EraseLinearDihedral;
+  int	I1, I2, I3, I4, IN;
+  Real sinPhase, cosPhase, SinNPhi, CosNPhi, groupEnergy;
+#undef VEC_CONST
+#define VEC_CONST(x) (x)
+#undef ZERO_SMALL_LEN
+#define ZERO_SMALL_LEN(RL,L) {double fabs_ = fabs(L); int cmp = (fabs_ < TENM3); RL = cmp ? 0.0 : RL; }
+#undef DO_sinNPhiCosNPhi
+#define DO_sinNPhiCosNPhi DIHEDRAL_GROUP_sinNPhiCosNPhi
+#define DIHEDRAL_DEBUG_INTERACTIONS(I1,I2,I3,I4)
+#pragma clang loop vectorize(enable)
+  for ( size_t g=groupStart; g<groupEnd; g++ ) {
+    size_t groupTermStart = compiled_group[g];
+    size_t groupTermEnd = compiled_group[g+1];
+#include <cando/chem/energy_functions/_Dihedral_termCode.cc>
+    anyLinearDihedral |= (EraseLinearDihedral == 0.0);
+  }
+#undef DIHEDRAL_DEBUG_INTERACTIONS
+#undef DIHEDRAL_APPLY_ATOM_MASK
+#undef	DIHEDRAL_CALC_FORCE
+  linear = anyLinearDihedral;
+  return totalEnergy.getSum();
+}
+
 CL_LAMBDA((energy-dihedral chem:energy-dihedral) pos &optional active-atom-mask);
 CL_DEFMETHOD void	EnergyDihedral_O::compareAnalyticalAndNumericalForceAndHessianTermByTerm(NVector_sp 	pos,
                                                                                                  core::T_sp activeAtomMask )
@@ -330,7 +457,7 @@ if (hasActiveAtomMask \
          && bitvectorActiveAtomMask->testBit(I2/3) \
          && bitvectorActiveAtomMask->testBit(I3/3) \
          && bitvectorActiveAtomMask->testBit(I4/3)) \
-    ) goto SKIP_term;
+    ) { ENERGY_COUNT_SKIPPED_TERM(); goto SKIP_term; }
 #define DO_sinNPhiCosNPhi(IN,SinNPhi,CosNPhi,SinPhi,CosPhi) sinNPhiCosNPhi(IN,SinNPhi,CosNPhi,SinPhi,CosPhi)
 #include <cando/chem/energy_functions/_Dihedral_termCode.cc>
 #undef DIHEDRAL_DEBUG_INTERACTIONS
@@ -351,6 +478,19 @@ if (hasActiveAtomMask \
                           core::make_fixnum(I1), core::make_fixnum(I2), core::make_fixnum(I3), core::make_fixnum(I4)); \
     }
 
+// Report every term of a group with its own energy
+#define USE_DIHEDRAL_GROUP_DEBUG_INTERACTIONS(I1,I2,I3,I4) \
+    if (doDebugInteractions) { \
+      for ( size_t tk=groupTermStart; tk<groupTermEnd; tk++ ) { \
+        num_real sinNPhi_, cosNPhi_; \
+        sinNPhiCosNPhi(compiled_IN[tk],sinNPhi_,cosNPhi_,SinPhi,CosPhi); \
+        num_real termEnergy_ = EraseLinearDihedral*compiled_V[tk]*(1.0+cosNPhi_*compiled_cosPhase[tk]+sinNPhi_*compiled_sinPhase[tk]); \
+        core::eval::funcall(debugInteractions,dihedral_type(compiled_IN[tk]), \
+                            mk_double_float(termEnergy_), \
+                            core::make_fixnum(I1), core::make_fixnum(I2), core::make_fixnum(I3), core::make_fixnum(I4)); \
+      } \
+    }
+
 #define IGNORE_DIHEDRAL_DEBUG_INTERACTIONS(I1,I2,I3,I4) {}
 
 core::List_sp EnergyDihedral::encode() const {
@@ -554,6 +694,59 @@ void EnergyDihedral_O::addTerm(const EnergyDihedral& term)
     this->_Terms.reserve(this->_Terms.size()*2);
   }
   this->_Terms.push_back(term);
+  this->invalidateCompiledTerms();
+}
+
+void EnergyDihedral_O::compileTerms()
+{
+  size_t num = this->_Terms.size();
+  std::vector<int32_t> order(num);
+  for ( size_t ii=0; ii<num; ++ii ) order[ii] = ii;
+  // Sort on the coordinate indexes so that consecutive terms touch neighbouring
+  // coordinates and the multiplicities of one dihedral follow each other
+  std::stable_sort(order.begin(),order.end(),[this] (int32_t a, int32_t b) {
+    const TermDihedral& ta = this->_Terms[a].term;
+    const TermDihedral& tb = this->_Terms[b].term;
+    return std::make_tuple(ta.I2,ta.I3,ta.I1,ta.I4) < std::make_tuple(tb.I2,tb.I3,tb.I1,tb.I4);
+  });
+  this->_CompiledSinPhase = core::SimpleVector_float_O::make(num);
+  this->_CompiledCosPhase = core::SimpleVector_float_O::make(num);
+  this->_CompiledV = core::SimpleVector_float_O::make(num);
+  this->_CompiledDN = core::SimpleVector_float_O::make(num);
+  this->_CompiledIN = core::SimpleVector_int32_t_O::make(num);
+  this->_CompiledI1 = core::SimpleVector_int32_t_O::make(num);
+  this->_CompiledI2 = core::SimpleVector_int32_t_O::make(num);
+  this->_CompiledI3 = core::SimpleVector_int32_t_O::make(num);
+  this->_CompiledI4 = core::SimpleVector_int32_t_O::make(num);
+  this->_CompiledTermIndex = core::SimpleVector_int32_t_O::make(num);
+  for ( size_t ii=0; ii<num; ++ii ) {
+    const TermDihedral& term = this->_Terms[order[ii]].term;
+    (*this->_CompiledSinPhase)[ii] = term.sinPhase;
+    (*this->_CompiledCosPhase)[ii] = term.cosPhase;
+    (*this->_CompiledV)[ii] = term.V;
+    (*this->_CompiledDN)[ii] = term.DN;
+    (*this->_CompiledIN)[ii] = term.IN;
+    (*this->_CompiledI1)[ii] = term.I1;
+    (*this->_CompiledI2)[ii] = term.I2;
+    (*this->_CompiledI3)[ii] = term.I3;
+    (*this->_CompiledI4)[ii] = term.I4;
+    (*this->_CompiledTermIndex)[ii] = order[ii];
+  }
+  // Group the terms that share an atom quadruple
+  std::vector<int32_t> groupStart;
+  for ( size_t ii=0; ii<num; ++ii ) {
+    if ( ii==0
+         || (*this->_CompiledI1)[ii] != (*this->_CompiledI1)[ii-1]
+         || (*this->_CompiledI2)[ii] != (*this->_CompiledI2)[ii-1]
+         || (*this->_CompiledI3)[ii] != (*this->_CompiledI3)[ii-1]
+         || (*this->_CompiledI4)[ii] != (*this->_CompiledI4)[ii-1] ) {
+      groupStart.push_back(ii);
+    }
+  }
+  groupStart.push_back(num);
+  this->_CompiledGroupStart = core::SimpleVector_int32_t_O::make(groupStart.size());
+  for ( size_t gg=0; gg<groupStart.size(); ++gg ) (*this->_CompiledGroupStart)[gg] = groupStart[gg];
+  this->_CompiledTermsValid = true;
 }
 
 
@@ -717,7 +910,7 @@ if (hasActiveAtomMask \
          && bitvectorActiveAtomMask->testBit(I2/3) \
          && bitvectorActiveAtomMask->testBit(I3/3) \
          && bitvectorActiveAtomMask->testBit(I4/3)) \
-    ) goto SKIP_term;
+    ) { ENERGY_COUNT_SKIPPED_TERM(); goto SKIP_term; }
 #include	<cando/chem/energy_functions/_Dihedral_termCode.cc>
 #undef DIHEDRAL_DEBUG_INTERACTIONS
 #undef DIHEDRAL_APPLY_ATOM_MASK
@@ -726,8 +919,8 @@ if (hasActiveAtomMask \
 }
 
 double	EnergyDihedral_O::evaluateAllComponentSingle(
-    gctools::Vec0<EnergyDihedral>::iterator di_start,
-    gctools::Vec0<EnergyDihedral>::iterator di_end,
+    size_t groupStart,
+    size_t groupEnd,
     ScoringFunction_sp score,
     NVector_sp 	pos,
     bool 		calcForce,
@@ -747,7 +940,7 @@ if (hasActiveAtomMask \
          && bitvectorActiveAtomMask->testBit(I2/3) \
          && bitvectorActiveAtomMask->testBit(I3/3) \
          && bitvectorActiveAtomMask->testBit(I4/3)) \
-    ) goto SKIP_term_and_angle_test;
+    ) { ENERGY_COUNT_SKIPPED_TERMS(groupTermEnd-groupTermStart); goto SKIP_term_and_angle_test; }
   MAYBE_SETUP_ACTIVE_ATOM_MASK();
   MAYBE_SETUP_DEBUG_INTERACTIONS(debugInteractions.notnilp());
   if ( this->_DebugEnergy ) 
@@ -763,6 +956,58 @@ if (hasActiveAtomMask \
   bool	hasForce = force.notnilp();
   bool	hasHessian = hessian.notnilp();
   bool	hasHdAndD = (hdvec.notnilp())&&(dvec.notnilp());
+  if (groupStart>=groupEnd) return totalEnergy;
+  const float* compiled_sinPhase = &(*this->_CompiledSinPhase)[0];
+  const float* compiled_cosPhase = &(*this->_CompiledCosPhase)[0];
+  const float* compiled_V = &(*this->_CompiledV)[0];
+  const float* compiled_DN = &(*this->_CompiledDN)[0];
+  const int32_t* compiled_IN = &(*this->_CompiledIN)[0];
+  const int32_t* compiled_I1 = &(*this->_CompiledI1)[0];
+  const int32_t* compiled_I2 = &(*this->_CompiledI2)[0];
+  const int32_t* compiled_I3 = &(*this->_CompiledI3)[0];
+  const int32_t* compiled_I4 = &(*this->_CompiledI4)[0];
+  const int32_t* compiled_index = &(*this->_CompiledTermIndex)[0];
+  const int32_t* compiled_group = &(*this->_CompiledGroupStart)[0];
+  if ( !calcForce && !hasActiveAtomMask && !doDebugInteractions && !this->_DebugEnergy ) {
+    bool linear = false;
+    totalEnergy = _evaluateCompiled_Dihedral<double>(groupStart,
+                                                     groupEnd,
+                                                     compiled_group,
+                                                     compiled_sinPhase,
+                                                     compiled_cosPhase,
+                                                     compiled_V,
+                                                     compiled_DN,
+                                                     compiled_IN,
+                                                     compiled_I1,
+                                                     compiled_I2,
+                                                     compiled_I3,
+                                                     compiled_I4,
+                                                     &(*pos)[0],false,NULL,linear);
+    if (!linear) return totalEnergy;
+    // Fall through to the general loop to report the linear dihedral
+    totalEnergy = 0.0;
+  } else if ( this->_SinglePrecision && !calcDiagonalHessian && !calcOffDiagonalHessian
+              && !hasActiveAtomMask && !doDebugInteractions && !this->_DebugEnergy ) {
+    bool linear = false;
+    totalEnergy = _evaluateCompiled_Dihedral<float>(groupStart,
+                                                    groupEnd,
+                                                    compiled_group,
+                                                    compiled_sinPhase,
+                                                    compiled_cosPhase,
+                                                    compiled_V,
+                                                    compiled_DN,
+                                                    compiled_IN,
+                                                    compiled_I1,
+                                                    compiled_I2,
+                                                    compiled_I3,
+                                                    compiled_I4,
+                                                    &(*pos)[0],calcForce&&hasForce,
+                                                    hasForce ? &(*force)[0] : NULL,linear);
+    if (!linear) return totalEnergy;
+    // Fall through to the general loop which signals the linear dihedral error
+    // before the force it accumulates is used.
+    totalEnergy = 0.0;
+  }
 
 
 //
@@ -773,11 +1018,11 @@ if (hasActiveAtomMask \
 #define DIHEDRAL_CALC_DIAGONAL_HESSIAN
 #define DIHEDRAL_CALC_OFF_DIAGONAL_HESSIAN
 #undef	DIHEDRAL_SET_PARAMETER
-#define	DIHEDRAL_SET_PARAMETER(x)	{x=di->term.x;}
+#define	DIHEDRAL_SET_PARAMETER(x)	{x=compiled_##x[groupTermStart];}
 #undef	DIHEDRAL_SET_POSITION
 #define	DIHEDRAL_SET_POSITION(x,ii,of)	{x=pos->element(ii+of);}
 #undef	DIHEDRAL_ENERGY_ACCUMULATE
-#define	DIHEDRAL_ENERGY_ACCUMULATE(e) { totalEnergy += (e); }
+#define	DIHEDRAL_ENERGY_ACCUMULATE(e) { e = groupEnergy*EraseLinearDihedral; totalEnergy += (e); }
 #undef	DIHEDRAL_FORCE_ACCUMULATE
 #undef	DIHEDRAL_DIAGONAL_HESSIAN_ACCUMULATE
 #undef	DIHEDRAL_OFF_DIAGONAL_HESSIAN_ACCUMULATE
@@ -796,8 +1041,7 @@ if (hasActiveAtomMask \
   num_real x1,y1,z1,x2,y2,z2,x3,y3,z3,x4,y4,z4,V,DN;
   num_real EraseLinearDihedral;
   int	I1, I2, I3, I4, IN;
-  num_real sinPhase, cosPhase, SinNPhi, CosNPhi;
-  gctools::Vec0<EnergyDihedral>::iterator di;
+  num_real sinPhase, cosPhase, SinNPhi, CosNPhi, groupEnergy;
 
   int i = 0;
 #pragma clang diagnostic push
@@ -806,7 +1050,9 @@ if (hasActiveAtomMask \
 #pragma clang loop vectorize(enable)
 #pragma clang loop interleave(enable)
 
-  for ( di=di_start; di!= di_end; di++ ) {
+  for ( size_t g=groupStart; g<groupEnd; g++ ) {
+    size_t groupTermStart = compiled_group[g];
+    size_t groupTermEnd = compiled_group[g+1];
 #ifdef	DEBUG_CONTROL_THE_NUMBER_OF_TERMS_EVALAUTED
     if ( this->_Debug_NumberOfDihedralTermsToCalculate > 0 ) {
       if ( i>= this->_Debug_NumberOfDihedralTermsToCalculate ) {
@@ -815,30 +1061,36 @@ if (hasActiveAtomMask \
     }
 #endif
 #undef DO_sinNPhiCosNPhi
-#define DO_sinNPhiCosNPhi(IN,SinNPhi,CosNPhi,SinPhi,CosPhi) sinNPhiCosNPhi(IN,SinNPhi,CosNPhi,SinPhi,CosPhi)
-#define DIHEDRAL_DEBUG_INTERACTIONS(I1,I2,I3,I4) USE_DIHEDRAL_DEBUG_INTERACTIONS(I1,I2,I3,I4)
+#define DO_sinNPhiCosNPhi DIHEDRAL_GROUP_sinNPhiCosNPhi
+#define DIHEDRAL_DEBUG_INTERACTIONS(I1,I2,I3,I4) USE_DIHEDRAL_GROUP_DEBUG_INTERACTIONS(I1,I2,I3,I4)
 #include <cando/chem/energy_functions/_Dihedral_termCode.cc>
 #undef DIHEDRAL_DEBUG_INTERACTIONS
 #undef DIHEDRAL_APPLY_ATOM_MASK
     if ( EraseLinearDihedral == 0.0 ) {
-      ERROR(chem::_sym_LinearDihedralError,core::Cons_O::createList(kw::_sym_atoms,core::Cons_O::createList(di->_Atom1,di->_Atom2,di->_Atom3,di->_Atom4),
+      EnergyDihedral& entry = this->_Terms[compiled_index[groupTermStart]];
+      ERROR(chem::_sym_LinearDihedralError,core::Cons_O::createList(kw::_sym_atoms,core::Cons_O::createList(entry._Atom1,entry._Atom2,entry._Atom3,entry._Atom4),
                                                                     kw::_sym_coordinates,pos,
                                                                     kw::_sym_indexes,core::Cons_O::createList(core::make_fixnum(I1), core::make_fixnum(I2), core::make_fixnum(I3), core::make_fixnum(I4))));
     }
   SKIP_term_and_angle_test: (void)0;
 
 #if TURN_ENERGY_FUNCTION_DEBUG_ON //[
-    di->_calcForce = calcForce;
-    di->_calcDiagonalHessian = calcDiagonalHessian;
-    di->_calcOffDiagonalHessian = calcOffDiagonalHessian;
+    {
+    EnergyDihedral& entry = this->_Terms[compiled_index[groupTermStart]];
+    entry._calcForce = calcForce;
+    entry._calcDiagonalHessian = calcDiagonalHessian;
+    entry._calcOffDiagonalHessian = calcOffDiagonalHessian;
 #undef EVAL_SET
-#define	EVAL_SET(var,val)	{ di->eval.var=val;};
+#define	EVAL_SET(var,val)	{ entry.eval.var=val;};
 #include	<cando/chem/energy_functions/_Dihedral_debugEvalSet.cc>
+    }
 #endif //]
 
     if ( this->_DebugEnergy ) 
     {
       LOG_ENERGY(( "MEISTER dihedral %d args cando\n") , (i+1) );
+      LOG_ENERGY(( "MEISTER dihedral %d term %d\n") , (i+1) , compiled_index[groupTermStart] );
+      LOG_ENERGY(( "MEISTER dihedral %d terms in group %d\n") , (i+1) , (int)(groupTermEnd-groupTermStart) );
       LOG_ENERGY(( "MEISTER dihedral %d V %lf\n") , (i+1) , V );
       LOG_ENERGY(( "MEISTER dihedral %d DN %lf\n") , (i+1) , DN );
       LOG_ENERGY(( "MEISTER dihedral %d IN %d\n") , (i+1) , IN );
@@ -1019,6 +1271,7 @@ CL_DEFMETHOD void EnergyDihedral_O::fill_from_vectors_in_alist(core::List_sp vec
     entry._Atom3 = gc::As_unsafe<Atom_sp>((*atom3_vec)[i]);
     entry._Atom4 = gc::As_unsafe<Atom_sp>((*atom4_vec)[i]);
   }
+  this->invalidateCompiledTerms();
 }
 
 CL_DEFMETHOD void EnergyDihedral_O::addDihedralTerm(AtomTable_sp atomTable, Atom_sp a1, Atom_sp a2, Atom_sp a3, Atom_sp a4,
@@ -1057,291 +1310,158 @@ EnergyDihedral_sp EnergyDihedral_O::copyFilter(core::T_sp keepInteractionFactory
 
 
 #ifndef _TARGET_OS_DARWIN
-#define VREAL8_WIDTH 8
-typedef double real;
-typedef real real8 __attribute__((vector_size(8*VREAL8_WIDTH))) __attribute__((aligned(4)));
-typedef int64_t int8 __attribute__((vector_size(8*VREAL8_WIDTH))) __attribute__((aligned(4)));
+/*! Lane helpers for the vector extension types the SIMD dihedral loops use */
+template <typename RealV, int Width>
+inline RealV dihedral_lane_sqrt(RealV x) {
+  RealV result;
+  for ( int l=0; l<Width; ++l ) result[l] = sqrt(x[l]);
+  return result;
+}
 
-double EnergyDihedral_O::evaluateAllComponentSimd8(
-    gctools::Vec0<EnergyDihedral>::iterator di_start8,
-    gctools::Vec0<EnergyDihedral>::iterator di_end8,
-    ScoringFunction_sp          score,
-    NVector_sp 	                pos,
-    bool 		        calcForce,
-    gc::Nilable<NVector_sp> 	force,
-    bool		        calcDiagonalHessian,
-    bool		        calcOffDiagonalHessian,
-    gc::Nilable<AbstractLargeSquareMatrix_sp>	hessian,
-    gc::Nilable<NVector_sp>	hdvec,
-    gc::Nilable<NVector_sp>     dvec,
-    core::T_sp activeAtomMask )
-{
-  IMPLEMENT_ME();
-#if 0
-  MAYBE_SETUP_ACTIVE_ATOM_MASK();
-  if ( this->_DebugEnergy ) {
-    LOG_ENERGY_CLEAR();
-    LOG_ENERGY(("%s {\n") , this->className());
-  }
-  ANN(force);
-  ANN(hessian);
-  ANN(hdvec);
-  ANN(dvec);
-  bool	hasForce = force.notnilp();
-  bool	hasHessian = hessian.notnilp();
-  bool	hasHdAndD = (hdvec.notnilp())&&(dvec.notnilp());
+template <typename RealV, int Width>
+inline RealV dihedral_lane_max(double x, RealV y) {
+  RealV result;
+  for ( int l=0; l<Width; ++l ) result[l] = std::max(x,(double)y[l]);
+  return result;
+}
+
+template <typename RealV, int Width>
+inline RealV dihedral_lane_min(double x, RealV y) {
+  RealV result;
+  for ( int l=0; l<Width; ++l ) result[l] = std::min(x,(double)y[l]);
+  return result;
+}
 
+/*! Evaluate the energy and optionally the force of the compiled dihedral groups
+ *  [groupStart,groupEnd) Width groups at a time - the geometry of Width groups is
+ *  evaluated in the lanes of RealV and the Fourier series of each group is summed
+ *  per lane.  (groupEnd-groupStart) must be a multiple of Width.
+ *  If any dihedral is linear then linear is set and the caller must re-evaluate the
+ *  groups with evaluateAllComponentSingle so that the error can name the atoms.
+ */
+template <typename RealV, typename IntV, int Width>
+static double _evaluateCompiledLanes_Dihedral( size_t groupStart,
+                                               size_t groupEnd,
+                                               const int32_t* compiled_group,
+                                               const float* compiled_sinPhase,
+                                               const float* compiled_cosPhase,
+                                               const float* compiled_V,
+                                               const float* compiled_DN,
+                                               const int32_t* compiled_IN,
+                                               const int32_t* compiled_I1,
+                                               const int32_t* compiled_I2,
+                                               const int32_t* compiled_I3,
+                                               const int32_t* compiled_I4,
+                                               const Vector_real* coords,
+                                               bool calcForce,
+                                               Vector_real* force,
+                                               bool& linear )
+{
   double totalEnergy = 0.0;
-//
-// Copy from implementAmberFunction::evaluateAll
-//
-// -----------------------
+  bool anyLinearDihedral = false;
+  size_t termStart[Width];
+  size_t termEnd[Width];
+#undef VEC_CONST
+#define VEC_CONST(x) (RealV{}+(x))
+#pragma push_macro("mysqrt")
 #undef mysqrt
-#define mysqrt(xx) { sqrt(xx[0]), sqrt(xx[1]), sqrt(xx[2]), sqrt(xx[3]), sqrt(xx[4]), sqrt(xx[5]), sqrt(xx[6]), sqrt(xx[7]) }
+#define mysqrt(xx) dihedral_lane_sqrt<RealV,Width>(xx)
 #undef ZERO_SMALL_LEN
-#define ZERO_SMALL_LEN(RL,L) {real8 fabs = __builtin_elementwise_abs(L); int8 cmp = (fabs < TENM3); RL = cmp ? 0.0 : RL; }
-#define SIMD 1
-#define DIHEDRAL_CALC_FORCE
-#define DIHEDRAL_CALC_DIAGONAL_HESSIAN
-#define DIHEDRAL_CALC_OFF_DIAGONAL_HESSIAN
-
-#undef VEC_CONST
-#define VEC_CONST(x) VEC8(x)
-  int8 bmask;
-  real8 mask1 = VEC_CONST(1.0);
-  real8 mask;
-  int8 I1_;
-  int8 I2_;
-  int8 I3_;
-  int8 I4_;
-
-#undef DIHEDRAL_APPLY_ATOM_MASK
-#define DIHEDRAL_APPLY_ATOM_MASK(I1,I2,I3,I4) \
-  if (hasActiveAtomMask) { \
-    I1_ = I1/3; \
-    I2_ = I2/3; \
-    I3_ = I3/3; \
-    I4_ = I4/3; \
-    bmask = { \
-        (bitvectorActiveAtomMask->testBit(I1_[0]) \
-         && bitvectorActiveAtomMask->testBit(I2_[0]) \
-         && bitvectorActiveAtomMask->testBit(I3_[0]) \
-         && bitvectorActiveAtomMask->testBit(I4_[0])), \
-        (bitvectorActiveAtomMask->testBit(I1_[1]) \
-         && bitvectorActiveAtomMask->testBit(I2_[1]) \
-         && bitvectorActiveAtomMask->testBit(I3_[1]) \
-         && bitvectorActiveAtomMask->testBit(I4_[1])), \
-        (bitvectorActiveAtomMask->testBit(I1_[2]) \
-         && bitvectorActiveAtomMask->testBit(I2_[2]) \
-         && bitvectorActiveAtomMask->testBit(I3_[2]) \
-         && bitvectorActiveAtomMask->testBit(I4_[2])),\
-        (bitvectorActiveAtomMask->testBit(I1_[3]) \
-         && bitvectorActiveAtomMask->testBit(I2_[3]) \
-         && bitvectorActiveAtomMask->testBit(I3_[3]) \
-         && bitvectorActiveAtomMask->testBit(I4_[3])), \
-        (bitvectorActiveAtomMask->testBit(I1_[4]) \
-         && bitvectorActiveAtomMask->testBit(I2_[4]) \
-         && bitvectorActiveAtomMask->testBit(I3_[4]) \
-         && bitvectorActiveAtomMask->testBit(I4_[4])), \
-        (bitvectorActiveAtomMask->testBit(I1_[5]) \
-         && bitvectorActiveAtomMask->testBit(I2_[5]) \
-         && bitvectorActiveAtomMask->testBit(I3_[5]) \
-         && bitvectorActiveAtomMask->testBit(I4_[5])), \
-        (bitvectorActiveAtomMask->testBit(I1_[6]) \
-         && bitvectorActiveAtomMask->testBit(I2_[6]) \
-         && bitvectorActiveAtomMask->testBit(I3_[6]) \
-         && bitvectorActiveAtomMask->testBit(I4_[6])), \
-        (bitvectorActiveAtomMask->testBit(I1_[7]) \
-         && bitvectorActiveAtomMask->testBit(I2_[7]) \
-         && bitvectorActiveAtomMask->testBit(I3_[7]) \
-         && bitvectorActiveAtomMask->testBit(I4_[7])) \
-    };\
-    if (!(bmask[0]|| bmask[1]|| bmask[2]|| bmask[3]|| bmask[4]|| bmask[5]|| bmask[6]|| bmask[7])) goto SKIP_term_past_linear_dihedral_test; \
-    mask = (bmask ? 1.0 : 0.0);  \
-    /*printf("%s:%d:%s mask = %f,%f,%f,%f,%f,%f,%f,%f\n", __FILE__, __LINE__, __FUNCTION__, mask[0], mask[1], mask[2], mask[3], mask[4], mask[5], mask[6], mask[7] ); */\
-  } \
-    else { \
-      mask = { 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0 }; \
-    }
-
-
-
+#define ZERO_SMALL_LEN(RL,L) { for ( int l_=0; l_<Width; ++l_ ) if (fabs(L[l_])<TENM3) RL[l_] = 0.0; }
+#pragma push_macro("MAX")
+#pragma push_macro("MIN")
+#undef MAX
+#undef MIN
+#define MAX(a,b) dihedral_lane_max<RealV,Width>(a,b)
+#define MIN(a,b) dihedral_lane_min<RealV,Width>(a,b)
 #undef	DIHEDRAL_SET_PARAMETER
-#define	DIHEDRAL_SET_PARAMETER(x)	{x={ di[0].term.x, di[1].term.x, di[2].term.x, di[3].term.x, di[4].term.x, di[5].term.x, di[6].term.x, di[7].term.x };}
+#define	DIHEDRAL_SET_PARAMETER(x)	{ for ( int l_=0; l_<Width; ++l_ ) x[l_] = compiled_##x[termStart[l_]]; }
 #undef	DIHEDRAL_SET_POSITION
-#define	DIHEDRAL_SET_POSITION(x,ii,of)	{x={ pos->element(ii[0]+of), pos->element(ii[1]+of), pos->element(ii[2]+of), pos->element(ii[3]+of), pos->element(ii[4]+of), pos->element(ii[5]+of), pos->element(ii[6]+of), pos->element(ii[7]+of) }; }
+#define	DIHEDRAL_SET_POSITION(x,ii,of)	{ for ( int l_=0; l_<Width; ++l_ ) x[l_] = coords[ii[l_]+of]; }
 #undef	DIHEDRAL_ENERGY_ACCUMULATE
-#define	DIHEDRAL_ENERGY_ACCUMULATE(e) totalEnergy += (e[0]*mask[0]+e[1]*mask[1]+e[2]*mask[2]+e[3]*mask[3]+e[4]*mask[4]+e[5]*mask[5]+e[6]*mask[6]+e[7]*mask[7]);
+#define	DIHEDRAL_ENERGY_ACCUMULATE(e) { e = groupEnergy*EraseLinearDihedral; for ( int l_=0; l_<Width; ++l_ ) totalEnergy += e[l_]; }
 #undef	DIHEDRAL_FORCE_ACCUMULATE
+#define	DIHEDRAL_FORCE_ACCUMULATE(i,o,v) { for ( int l_=0; l_<Width; ++l_ ) force[i[l_]+(o)] += v[l_]; }
 #undef	DIHEDRAL_DIAGONAL_HESSIAN_ACCUMULATE
+#define	DIHEDRAL_DIAGONAL_HESSIAN_ACCUMULATE(i1,o1,i2,o2,v) {}
 #undef	DIHEDRAL_OFF_DIAGONAL_HESSIAN_ACCUMULATE
-#undef ONE_ForceAcc
-#define ONE_ForceAcc(IDX,i,o,v) force->setElement((i)+(o),(v)*mask[IDX]+force->getElement((i)+(o)));
-#undef DIHEDRAL_FORCE_ACCUMULATE
-#define	DIHEDRAL_FORCE_ACCUMULATE(I,O,V) { \
-    if (hasForce) { \
-      ONE_ForceAcc(0,I[0],O,V[0]); \
-      ONE_ForceAcc(1,I[1],O,V[1]); \
-      ONE_ForceAcc(2,I[2],O,V[2]); \
-      ONE_ForceAcc(3,I[3],O,V[3]); \
-      ONE_ForceAcc(4,I[4],O,V[4]); \
-      ONE_ForceAcc(5,I[5],O,V[5]); \
-      ONE_ForceAcc(6,I[6],O,V[6]); \
-      ONE_ForceAcc(7,I[7],O,V[7]); \
-    }}
-#undef ONE_OffDiagHessAcc_hasHessian
-#define ONE_OffDiagHessAcc_hasHessian(vi,i1,o1,i2,o2,v) hessian->addToElement((i1[vi])+(o1),(i2[vi])+(o2),v[vi]*mask[vi]);
-#undef ONE_OffDiagHessAcc_hasHdAndD
-#define ONE_OffDiagHessAcc_hasHdAndD(vi,i1,o1,i2,o2,v) {\
-    hdvec->addToElement((i1[vi])+(o1),v[vi]*mask[vi]*dvec->element((i2[vi])+(o2)));\
-    hdvec->addToElement((i2[vi])+(o2),v[vi]*mask[vi]*dvec->element((i1[vi])+(o1)));\
-  }
-#undef ONE_DiagHessAcc_hasHessian
-#define ONE_DiagHessAcc_hasHessian(vi,i1,o1,i2,o2,v)  hessian->addToElement((i1[vi])+(o1),(i2[vi])+(o2),v[vi]*mask[vi]);
-#undef ONE_DiagHessAcc_hasHdAndD
-#define ONE_DiagHessAcc_hasHdAndD(vi,i1,o1,i2,o2,v)   hdvec->addToElement((i1[vi])+(o1),v[vi]*mask[vi]*dvec->element((i1[vi])+(o1)));
-
-#undef DIHEDRAL_DIAGONAL_HESSIAN_ACCUMULATE
-#define	DIHEDRAL_DIAGONAL_HESSIAN_ACCUMULATE(i1,o1,i2,o2,v) { \
-    if (hasHessian) { \
-      ONE_DiagHessAcc_hasHessian(0,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHessian(1,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHessian(2,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHessian(3,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHessian(4,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHessian(5,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHessian(6,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHessian(7,i1,o1,i2,o2,v); \
-    } \
-    if (hasHdAndD) { \
-      ONE_DiagHessAcc_hasHdAndD(0,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHdAndD(1,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHdAndD(2,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHdAndD(3,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHdAndD(4,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHdAndD(5,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHdAndD(6,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHdAndD(7,i1,o1,i2,o2,v); \
-    } \
-  }
-#undef DIHEDRAL_OFF_DIAGONAL_HESSIAN_ACCUMULATE
-#define	DIHEDRAL_OFF_DIAGONAL_HESSIAN_ACCUMULATE(i1,o1,i2,o2,v) { \
-    if (hasHessian) { \
-      ONE_OffDiagHessAcc_hasHessian(0,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHessian(1,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHessian(2,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHessian(3,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHessian(4,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHessian(5,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHessian(6,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHessian(7,i1,o1,i2,o2,v); \
-    } \
-    if (hasHdAndD) { \
-      ONE_OffDiagHessAcc_hasHdAndD(0,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHdAndD(1,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHdAndD(2,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHdAndD(3,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHdAndD(4,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHdAndD(5,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHdAndD(6,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHdAndD(7,i1,o1,i2,o2,v); \
-    } \
-  }
+#define	DIHEDRAL_OFF_DIAGONAL_HESSIAN_ACCUMULATE(i1,o1,i2,o2,v) {}
+#define	DIHEDRAL_CALC_FORCE
+#undef	DIHEDRAL_CALC_DIAGONAL_HESSIAN
+#undef	DIHEDRAL_CALC_OFF_DIAGONAL_HESSIAN
+#undef	DIHEDRAL_APPLY_ATOM_MASK
+#define	DIHEDRAL_APPLY_ATOM_MASK(I1,I2,I3,I4) {}
+#undef	DECLARE_FLOAT
+#define	DECLARE_FLOAT(x) RealV x = VEC_CONST(0.0)
 #pragma clang diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-variable"
-#undef DECLARE_FLOAT
-#define DECLARE_FLOAT(xx) real8 xx
 #include <cando/chem/energy_functions/_Dihedral_termDeclares.cc>
 #pragma clang diagnostic pop
-#undef VEC_CONST
-#define VEC_CONST(x) VEC8(x)
-  
-  fx1 = VEC_CONST(0.0);
-  fy1 = VEC_CONST(0.0);
-  fz1 = VEC_CONST(0.0);
-  fx2 = VEC_CONST(0.0);
-  fy2 = VEC_CONST(0.0);
-  fz2 = VEC_CONST(0.0);
-  fx3 = VEC_CONST(0.0);
-  fy3 = VEC_CONST(0.0);
-  fz3 = VEC_CONST(0.0);
-  fx4 = VEC_CONST(0.0);
-  fy4 = VEC_CONST(0.0);
-  fz4 = VEC_CONST(0.0);
-  real8 x1,y1,z1,x2,y2,z2,x3,y3,z3,x4,y4,z4,V,DN;
-  real8 EraseLinearDihedral;
-  int8	I1, I2, I3, I4, IN;
-  real8 sinPhase, cosPhase, SinNPhi, CosNPhi;
-
-#undef ONE_sinNPhiCosNPhi
-#define ONE_sinNPhiCosNPhi(INI,IN,SinNPhi,CosNPhi,SinPhi,CosPhi) {\
-    real tSinNPhi, tCosNPhi; \
-    sinNPhiCosNPhi(IN[INI],tSinNPhi,tCosNPhi,SinPhi[INI],CosPhi[INI]); \
-    SinNPhi[INI] = tSinNPhi; CosNPhi[INI] = tCosNPhi; \
-  }
-
+#undef	DECLARE_FLOAT
+#define	DECLARE_FLOAT(x) num_real x = 0.0
+  RealV x1,y1,z1,x2,y2,z2,x3,y3,z3,x4,y4,z4,V,DN;
+  RealV EraseLinearDihedral;
+  IntV I1, I2, I3, I4, IN;
+  RealV sinPhase, cosPhase, SinNPhi, CosNPhi, groupEnergy;
 #undef DO_sinNPhiCosNPhi
-#define DO_sinNPhiCosNPhi(IN,SinNPhi,CosNPhi,SinPhi,CosPhi) { \
-    ONE_sinNPhiCosNPhi(0,IN,SinNPhi,CosNPhi,SinPhi,CosPhi); \
-    ONE_sinNPhiCosNPhi(1,IN,SinNPhi,CosNPhi,SinPhi,CosPhi); \
-    ONE_sinNPhiCosNPhi(2,IN,SinNPhi,CosNPhi,SinPhi,CosPhi); \
-    ONE_sinNPhiCosNPhi(3,IN,SinNPhi,CosNPhi,SinPhi,CosPhi); \
-    ONE_sinNPhiCosNPhi(4,IN,SinNPhi,CosNPhi,SinPhi,CosPhi); \
-    ONE_sinNPhiCosNPhi(5,IN,SinNPhi,CosNPhi,SinPhi,CosPhi); \
-    ONE_sinNPhiCosNPhi(6,IN,SinNPhi,CosNPhi,SinPhi,CosPhi); \
-    ONE_sinNPhiCosNPhi(7,IN,SinNPhi,CosNPhi,SinPhi,CosPhi); \
-  }
-
-    
-  gctools::Vec0<EnergyDihedral>::iterator di;
-  int i=0;
-  for ( di=di_start8; di<di_end8; di += VREAL8_WIDTH ) {
-#define DIHEDRAL_DEBUG_INTERACTIONS(I1,I2,I3,I4) IGNORE_DIHEDRAL_DEBUG_INTERACTIONS(I1,I2,I3,I4)
+#define DO_sinNPhiCosNPhi(IN,SinNPhi,CosNPhi,SinPhi,CosPhi) \
+  { for ( int l_=0; l_<Width; ++l_ ) { \
+      double energy_, sinNPhi_, cosNPhi_; \
+      dihedralSeries<double>(termStart[l_],termEnd[l_], \
+                             compiled_sinPhase,compiled_cosPhase,compiled_V,compiled_DN,compiled_IN, \
+                             SinPhi[l_],CosPhi[l_],energy_,sinNPhi_,cosNPhi_); \
+      groupEnergy[l_] = energy_; SinNPhi[l_] = sinNPhi_; CosNPhi[l_] = cosNPhi_; } \
+    V = VEC_CONST(1.0); DN = VEC_CONST(1.0); cosPhase = VEC_CONST(1.0); sinPhase = VEC_CONST(0.0); }
+#define DIHEDRAL_DEBUG_INTERACTIONS(I1,I2,I3,I4)
+  for ( size_t g=groupStart; g<groupEnd; g+=Width ) {
+    for ( int l=0; l<Width; ++l ) {
+      termStart[l] = compiled_group[g+l];
+      termEnd[l] = compiled_group[g+l+1];
+    }
 #include <cando/chem/energy_functions/_Dihedral_termCode.cc>
+    for ( int l=0; l<Width; ++l ) anyLinearDihedral |= (EraseLinearDihedral[l] == 0.0);
+  }
 #undef DIHEDRAL_DEBUG_INTERACTIONS
 #undef DIHEDRAL_APPLY_ATOM_MASK
-#undef SIMD
-#undef MAYBE_ERROR_LINEAR_DIHEDRAL
-#define MAYBE_ERROR_LINEAR_DIHEDRAL(IDX,di,I1,I2,I3,I4) { \
-      if ( EraseLinearDihedral[IDX] == 0.0 && bmask[IDX] ) { \
-          ERROR(chem::_sym_LinearDihedralError, \
-                core::Cons_O::createList(kw::_sym_atoms,core::Cons_O::createList(di[IDX]._Atom1,\
-                                                                                 di[IDX]._Atom2,\
-                                                                                 di[IDX]._Atom3,\
-                                                                                 di[IDX]._Atom4 ), \
-                                         kw::_sym_simd_index, core::make_fixnum(IDX), \
-                                         kw::_sym_coordinates,pos, \
-                                         kw::_sym_indexes,core::Cons_O::createList(core::make_fixnum(I1[IDX]), core::make_fixnum(I2[IDX]), core::make_fixnum(I3[IDX]), core::make_fixnum(I4[IDX])))); \
-      }}
-
-    MAYBE_ERROR_LINEAR_DIHEDRAL(0,di,I1,I2,I3,I4);
-    MAYBE_ERROR_LINEAR_DIHEDRAL(1,di,I1,I2,I3,I4);
-    MAYBE_ERROR_LINEAR_DIHEDRAL(2,di,I1,I2,I3,I4);
-    MAYBE_ERROR_LINEAR_DIHEDRAL(3,di,I1,I2,I3,I4);
-    MAYBE_ERROR_LINEAR_DIHEDRAL(4,di,I1,I2,I3,I4);
-    MAYBE_ERROR_LINEAR_DIHEDRAL(5,di,I1,I2,I3,I4);
-    MAYBE_ERROR_LINEAR_DIHEDRAL(6,di,I1,I2,I3,I4);
-    MAYBE_ERROR_LINEAR_DIHEDRAL(7,di,I1,I2,I3,I4);
-
-    // If no dihedrals were calculated then we skip all linear dihedral tests
-  SKIP_term_past_linear_dihedral_test: (void)0;
-    
-#if TURN_ENERGY_FUNCTION_DEBUG_ON //[
-    di->_calcForce = calcForce;
-    di->_calcDiagonalHessian = calcDiagonalHessian;
-    di->_calcOffDiagonalHessian = calcOffDiagonalHessian;
-#undef EVAL_SET
-#define	EVAL_SET(var,val)	{ di->eval.var=val;};
-#include	<cando/chem/energy_functions/_Dihedral_debugEvalSet.cc>
-#endif //]
-    i += VREAL8_WIDTH;
-  }
-  if ( this->_DebugEnergy ) 
-  {
-    LOG_ENERGY(("%s }\n") , this->className());
-  }
+#undef	DIHEDRAL_CALC_FORCE
+#pragma pop_macro("mysqrt")
+#pragma pop_macro("MAX")
+#pragma pop_macro("MIN")
+  linear = anyLinearDihedral;
   return totalEnergy;
-#endif
+}
+
+#define VREAL8_WIDTH 8
+typedef double real;
+typedef real real8 __attribute__((vector_size(8*VREAL8_WIDTH))) __attribute__((aligned(4)));
+typedef int64_t int8 __attribute__((vector_size(8*VREAL8_WIDTH))) __attribute__((aligned(4)));
+
+double EnergyDihedral_O::evaluateAllComponentSimd8(
+    size_t groupStart,
+    size_t groupEnd,
+    NVector_sp 	                pos,
+    bool 		        calcForce,
+    gc::Nilable<NVector_sp> 	force,
+    bool&                       linear )
+{
+  if (groupStart>=groupEnd) return 0.0;
+  bool hasForce = calcForce && force.notnilp();
+  return _evaluateCompiledLanes_Dihedral<real8,int8,VREAL8_WIDTH>(groupStart,
+                                                                    groupEnd,
+                                                                    &(*this->_CompiledGroupStart)[0],
+                                                                    &(*this->_CompiledSinPhase)[0],
+                                                                    &(*this->_CompiledCosPhase)[0],
+                                                                    &(*this->_CompiledV)[0],
+                                                                    &(*this->_CompiledDN)[0],
+                                                                    &(*this->_CompiledIN)[0],
+                                                                    &(*this->_CompiledI1)[0],
+                                                                    &(*this->_CompiledI2)[0],
+                                                                    &(*this->_CompiledI3)[0],
+                                                                    &(*this->_CompiledI4)[0],
+                                                                    &(*pos)[0],
+                                                                    hasForce,
+                                                                    hasForce ? &(*force)[0] : NULL,
+                                                                    linear);
 }
 
 //
@@ -1358,190 +1478,31 @@ typedef real real4 __attribute__((vector_size(8*VREAL4_WIDTH)));
 typedef int64_t int4 __attribute__((vector_size(8*VREAL4_WIDTH)));
 
 double EnergyDihedral_O::evaluateAllComponentSimd4(
-    gctools::Vec0<EnergyDihedral>::iterator di_start4,
-    gctools::Vec0<EnergyDihedral>::iterator di_end4,
-    ScoringFunction_sp          score,
+    size_t groupStart,
+    size_t groupEnd,
     NVector_sp 	                pos,
     bool 		        calcForce,
     gc::Nilable<NVector_sp> 	force,
-    bool		        calcDiagonalHessian,
-    bool		        calcOffDiagonalHessian,
-    gc::Nilable<AbstractLargeSquareMatrix_sp>	hessian,
-    gc::Nilable<NVector_sp>	hdvec,
-    gc::Nilable<NVector_sp>     dvec,
-    core::T_sp activeAtomMask )
+    bool&                       linear )
 {
-  IMPLEMENT_ME();
-#if 0
-  MAYBE_SETUP_ACTIVE_ATOM_MASK();
-  if ( this->_DebugEnergy ) {
-    LOG_ENERGY_CLEAR();
-    LOG_ENERGY(("%s {\n") , this->className());
-  }
-  ANN(force);
-  ANN(hessian);
-  ANN(hdvec);
-  ANN(dvec);
-  bool	hasForce = force.notnilp();
-  bool	hasHessian = hessian.notnilp();
-  bool	hasHdAndD = (hdvec.notnilp())&&(dvec.notnilp());
-
-  double totalEnergy = 0.0;
-//
-// Copy from implementAmberFunction::evaluateAll
-//
-// -----------------------
-#undef mysqrt
-#define mysqrt(xx) { sqrt(xx[0]), sqrt(xx[1]), sqrt(xx[2]), sqrt(xx[3]) }
-#undef ZERO_SMALL_LEN
-#define ZERO_SMALL_LEN(RL,L) {real4 fabs = __builtin_elementwise_abs(L); int4 cmp = (fabs < TENM3); RL = cmp ? 0.0 : RL; }
-#define SIMD 1
-#define DIHEDRAL_CALC_FORCE
-#define DIHEDRAL_CALC_DIAGONAL_HESSIAN
-#define DIHEDRAL_CALC_OFF_DIAGONAL_HESSIAN
-#undef	DIHEDRAL_SET_PARAMETER
-#define	DIHEDRAL_SET_PARAMETER(x)	{x={ di[0].term.x, di[1].term.x, di[2].term.x, di[3].term.x};}
-#undef	DIHEDRAL_SET_POSITION
-#define	DIHEDRAL_SET_POSITION(x,ii,of)	{x={ pos->element(ii[0]+of), pos->element(ii[1]+of), pos->element(ii[2]+of), pos->element(ii[3]+of)};}
-#undef	DIHEDRAL_ENERGY_ACCUMULATE
-#define	DIHEDRAL_ENERGY_ACCUMULATE(e) totalEnergy += (e[0]+e[1]+e[2]+e[3]);
-#undef	DIHEDRAL_FORCE_ACCUMULATE
-#undef	DIHEDRAL_DIAGONAL_HESSIAN_ACCUMULATE
-#undef	DIHEDRAL_OFF_DIAGONAL_HESSIAN_ACCUMULATE
-#undef ONE_ForceAcc
-#define ONE_ForceAcc(i,o,v) force->setElement((i)+(o),(v)+force->getElement((i)+(o)));
-#undef DIHEDRAL_FORCE_ACCUMULATE
-#define	DIHEDRAL_FORCE_ACCUMULATE(I,O,V) { \
-    if (hasForce) { \
-      ONE_ForceAcc(I[0],O,V[0]); \
-      ONE_ForceAcc(I[1],O,V[1]); \
-      ONE_ForceAcc(I[2],O,V[2]); \
-      ONE_ForceAcc(I[3],O,V[3]); \
-    }}
-#undef ONE_OffDiagHessAcc_hasHessian
-#define ONE_OffDiagHessAcc_hasHessian(vi,i1,o1,i2,o2,v) hessian->addToElement((i1[vi])+(o1),(i2[vi])+(o2),v[vi]);
-#undef ONE_OffDiagHessAcc_hasHdAndD
-#define ONE_OffDiagHessAcc_hasHdAndD(vi,i1,o1,i2,o2,v) {\
-    hdvec->addToElement((i1[vi])+(o1),v[vi]*dvec->element((i2[vi])+(o2)));\
-    hdvec->addToElement((i2[vi])+(o2),v[vi]*dvec->element((i1[vi])+(o1)));\
-  }
-#undef ONE_DiagHessAcc_hasHessian
-#define ONE_DiagHessAcc_hasHessian(vi,i1,o1,i2,o2,v)  hessian->addToElement((i1[vi])+(o1),(i2[vi])+(o2),v[vi]);
-#undef ONE_DiagHessAcc_hasHdAndD
-#define ONE_DiagHessAcc_hasHdAndD(vi,i1,o1,i2,o2,v)   hdvec->addToElement((i1[vi])+(o1),v[vi]*dvec->element((i1[vi])+(o1)));
-
-#undef DIHEDRAL_DIAGONAL_HESSIAN_ACCUMULATE
-#define	DIHEDRAL_DIAGONAL_HESSIAN_ACCUMULATE(i1,o1,i2,o2,v) { \
-    if (hasHessian) { \
-      ONE_DiagHessAcc_hasHessian(0,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHessian(1,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHessian(2,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHessian(3,i1,o1,i2,o2,v); \
-    } \
-    if (hasHdAndD) { \
-      ONE_DiagHessAcc_hasHdAndD(0,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHdAndD(1,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHdAndD(2,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHdAndD(3,i1,o1,i2,o2,v); \
-    } \
-  }
-#undef DIHEDRAL_OFF_DIAGONAL_HESSIAN_ACCUMULATE
-#define	DIHEDRAL_OFF_DIAGONAL_HESSIAN_ACCUMULATE(i1,o1,i2,o2,v) { \
-    if (hasHessian) { \
-      ONE_OffDiagHessAcc_hasHessian(0,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHessian(1,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHessian(2,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHessian(3,i1,o1,i2,o2,v); \
-    } \
-    if (hasHdAndD) { \
-      ONE_OffDiagHessAcc_hasHdAndD(0,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHdAndD(1,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHdAndD(2,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHdAndD(3,i1,o1,i2,o2,v); \
-    } \
-  }
-#pragma clang diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-variable"
-#undef DECLARE_FLOAT
-#define DECLARE_FLOAT(xx) real4 xx
-#include <cando/chem/energy_functions/_Dihedral_termDeclares.cc>
-#pragma clang diagnostic pop
-#undef VEC_CONST
-#define VEC_CONST(x) VEC4(x)
-  
-  fx1 = VEC_CONST(0.0);
-  fy1 = VEC_CONST(0.0);
-  fz1 = VEC_CONST(0.0);
-  fx2 = VEC_CONST(0.0);
-  fy2 = VEC_CONST(0.0);
-  fz2 = VEC_CONST(0.0);
-  fx3 = VEC_CONST(0.0);
-  fy3 = VEC_CONST(0.0);
-  fz3 = VEC_CONST(0.0);
-  fx4 = VEC_CONST(0.0);
-  fy4 = VEC_CONST(0.0);
-  fz4 = VEC_CONST(0.0);
-  real4 x1,y1,z1,x2,y2,z2,x3,y3,z3,x4,y4,z4,V,DN;
-  real4 EraseLinearDihedral;
-  int4	I1, I2, I3, I4, IN;
-  real4 sinPhase, cosPhase, SinNPhi, CosNPhi;
-
-#undef ONE_sinNPhiCosNPhi
-#define ONE_sinNPhiCosNPhi(INI,IN,SinNPhi,CosNPhi,SinPhi,CosPhi) {\
-    real tSinNPhi, tCosNPhi; \
-    sinNPhiCosNPhi(IN[INI],tSinNPhi,tCosNPhi,SinPhi[INI],CosPhi[INI]); \
-    SinNPhi[INI] = tSinNPhi; CosNPhi[INI] = tCosNPhi; \
-  }
-
-#undef DO_sinNPhiCosNPhi
-#define DO_sinNPhiCosNPhi(IN,SinNPhi,CosNPhi,SinPhi,CosPhi) { \
-    ONE_sinNPhiCosNPhi(0,IN,SinNPhi,CosNPhi,SinPhi,CosPhi); \
-    ONE_sinNPhiCosNPhi(1,IN,SinNPhi,CosNPhi,SinPhi,CosPhi); \
-    ONE_sinNPhiCosNPhi(2,IN,SinNPhi,CosNPhi,SinPhi,CosPhi); \
-    ONE_sinNPhiCosNPhi(3,IN,SinNPhi,CosNPhi,SinPhi,CosPhi); \
-  }
-
-  gctools::Vec0<EnergyDihedral>::iterator di;
-  int i = 0;
-  for ( di=di_start4; di<di_end4; di += VREAL4_WIDTH ) {
-#define DIHEDRAL_DEBUG_INTERACTIONS(I1,I2,I3,I4) IGNORE_DIHEDRAL_DEBUG_INTERACTIONS(I1,I2,I3,I4)
-#include <cando/chem/energy_functions/_Dihedral_termCode.cc>
-#undef DIHEDRAL_DEBUG_INTERACTIONS
-#undef DIHEDRAL_APPLY_ATOM_MASK
-#undef SIMD
-#undef MAYBE_ERROR_LINEAR_DIHEDRAL
-#define MAYBE_ERROR_LINEAR_DIHEDRAL(IDX,di,I1,I2,I3,I4) { \
-      if ( EraseLinearDihedral[IDX] == 0.0 ) { \
-          ERROR(chem::_sym_LinearDihedralError, \
-                core::Cons_O::createList(kw::_sym_atoms,core::Cons_O::createList(di[IDX]._Atom1,\
-                                                                                 di[IDX]._Atom2,\
-                                                                                 di[IDX]._Atom3,\
-                                                                                 di[IDX]._Atom4 ), \
-                                         kw::_sym_coordinates,pos, \
-                                         kw::_sym_indexes,core::Cons_O::createList(core::make_fixnum(I1[IDX]), core::make_fixnum(I2[IDX]), core::make_fixnum(I3[IDX]), core::make_fixnum(I4[IDX])))); \
-      }}
-
-    MAYBE_ERROR_LINEAR_DIHEDRAL(0,di,I1,I2,I3,I4);
-    MAYBE_ERROR_LINEAR_DIHEDRAL(1,di,I1,I2,I3,I4);
-    MAYBE_ERROR_LINEAR_DIHEDRAL(2,di,I1,I2,I3,I4);
-    MAYBE_ERROR_LINEAR_DIHEDRAL(3,di,I1,I2,I3,I4);
-
-#if TURN_ENERGY_FUNCTION_DEBUG_ON //[
-    di->_calcForce = calcForce;
-    di->_calcDiagonalHessian = calcDiagonalHessian;
-    di->_calcOffDiagonalHessian = calcOffDiagonalHessian;
-#undef EVAL_SET
-#define	EVAL_SET(var,val)	{ di->eval.var=val;};
-#include	<cando/chem/energy_functions/_Dihedral_debugEvalSet.cc>
-#endif //]
-    i += VREAL4_WIDTH;
-  }
-  if ( this->_DebugEnergy ) 
-  {
-    LOG_ENERGY(("%s }\n") , this->className());
-  }
-  return totalEnergy;
-#endif
+  if (groupStart>=groupEnd) return 0.0;
+  bool hasForce = calcForce && force.notnilp();
+  return _evaluateCompiledLanes_Dihedral<real4,int4,VREAL4_WIDTH>(groupStart,
+                                                                    groupEnd,
+                                                                    &(*this->_CompiledGroupStart)[0],
+                                                                    &(*this->_CompiledSinPhase)[0],
+                                                                    &(*this->_CompiledCosPhase)[0],
+                                                                    &(*this->_CompiledV)[0],
+                                                                    &(*this->_CompiledDN)[0],
+                                                                    &(*this->_CompiledIN)[0],
+                                                                    &(*this->_CompiledI1)[0],
+                                                                    &(*this->_CompiledI2)[0],
+                                                                    &(*this->_CompiledI3)[0],
+                                                                    &(*this->_CompiledI4)[0],
+                                                                    &(*pos)[0],
+                                                                    hasForce,
+                                                                    hasForce ? &(*force)[0] : NULL,
+                                                                    linear);
 }
 
 //
@@ -1558,176 +1519,31 @@ typedef real real2 __attribute__((vector_size(8*VREAL2_WIDTH)));
 typedef int64_t int2 __attribute__((vector_size(8*VREAL2_WIDTH)));
 
 double EnergyDihedral_O::evaluateAllComponentSimd2(
-    gctools::Vec0<EnergyDihedral>::iterator di_start2,
-    gctools::Vec0<EnergyDihedral>::iterator di_end2,
-    ScoringFunction_sp          score,
+    size_t groupStart,
+    size_t groupEnd,
     NVector_sp 	                pos,
     bool 		        calcForce,
     gc::Nilable<NVector_sp> 	force,
-    bool		        calcDiagonalHessian,
-    bool		        calcOffDiagonalHessian,
-    gc::Nilable<AbstractLargeSquareMatrix_sp>	hessian,
-    gc::Nilable<NVector_sp>	hdvec,
-    gc::Nilable<NVector_sp>     dvec,
-    core::T_sp activeAtomMask )
+    bool&                       linear )
 {
-  IMPLEMENT_ME();
-#if 0
-  MAYBE_SETUP_ACTIVE_ATOM_MASK();
-  if ( this->_DebugEnergy ) {
-    LOG_ENERGY_CLEAR();
-    LOG_ENERGY(("%s {\n") , this->className());
-  }
-  ANN(force);
-  ANN(hessian);
-  ANN(hdvec);
-  ANN(dvec);
-  bool	hasForce = force.notnilp();
-  bool	hasHessian = hessian.notnilp();
-  bool	hasHdAndD = (hdvec.notnilp())&&(dvec.notnilp());
-
-  double totalEnergy = 0.0;
-//
-// Copy from implementAmberFunction::evaluateAll
-//
-// -----------------------
-#undef mysqrt
-#define mysqrt(xx) { sqrt(xx[0]), sqrt(xx[1]) }
-#undef ZERO_SMALL_LEN
-#define ZERO_SMALL_LEN(RL,L) {real2 fabs = __builtin_elementwise_abs(L); int2 cmp = (fabs < TENM3); RL = cmp ? 0.0 : RL; }
-#define SIMD 1
-#define DIHEDRAL_CALC_FORCE
-#define DIHEDRAL_CALC_DIAGONAL_HESSIAN
-#define DIHEDRAL_CALC_OFF_DIAGONAL_HESSIAN
-#undef	DIHEDRAL_SET_PARAMETER
-#define	DIHEDRAL_SET_PARAMETER(x)	{x={ di[0].term.x, di[1].term.x };}
-#undef	DIHEDRAL_SET_POSITION
-#define	DIHEDRAL_SET_POSITION(x,ii,of)	{x={ pos->element(ii[0]+of), pos->element(ii[1]+of)};}
-#undef	DIHEDRAL_ENERGY_ACCUMULATE
-#define	DIHEDRAL_ENERGY_ACCUMULATE(e) totalEnergy += (e[0]+e[1])
-#undef	DIHEDRAL_FORCE_ACCUMULATE
-#undef	DIHEDRAL_DIAGONAL_HESSIAN_ACCUMULATE
-#undef	DIHEDRAL_OFF_DIAGONAL_HESSIAN_ACCUMULATE
-#undef ONE_ForceAcc
-#define ONE_ForceAcc(i,o,v) force->setElement((i)+(o),(v)+force->getElement((i)+(o)));
-#undef DIHEDRAL_FORCE_ACCUMULATE
-#define	DIHEDRAL_FORCE_ACCUMULATE(I,O,V) { \
-    if (hasForce) { \
-      ONE_ForceAcc(I[0],O,V[0]); \
-      ONE_ForceAcc(I[1],O,V[1]); \
-    }}
-#undef ONE_OffDiagHessAcc_hasHessian
-#define ONE_OffDiagHessAcc_hasHessian(vi,i1,o1,i2,o2,v) hessian->addToElement((i1[vi])+(o1),(i2[vi])+(o2),v[vi]);
-#undef ONE_OffDiagHessAcc_hasHdAndD
-#define ONE_OffDiagHessAcc_hasHdAndD(vi,i1,o1,i2,o2,v) {\
-    hdvec->addToElement((i1[vi])+(o1),v[vi]*dvec->element((i2[vi])+(o2)));\
-    hdvec->addToElement((i2[vi])+(o2),v[vi]*dvec->element((i1[vi])+(o1)));\
-  }
-#undef ONE_DiagHessAcc_hasHessian
-#define ONE_DiagHessAcc_hasHessian(vi,i1,o1,i2,o2,v)  hessian->addToElement((i1[vi])+(o1),(i2[vi])+(o2),v[vi]);
-#undef ONE_DiagHessAcc_hasHdAndD
-#define ONE_DiagHessAcc_hasHdAndD(vi,i1,o1,i2,o2,v)   hdvec->addToElement((i1[vi])+(o1),v[vi]*dvec->element((i1[vi])+(o1)));
-
-#undef DIHEDRAL_DIAGONAL_HESSIAN_ACCUMULATE
-#define	DIHEDRAL_DIAGONAL_HESSIAN_ACCUMULATE(i1,o1,i2,o2,v) { \
-    if (hasHessian) { \
-      ONE_DiagHessAcc_hasHessian(0,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHessian(1,i1,o1,i2,o2,v); \
-    } \
-    if (hasHdAndD) { \
-      ONE_DiagHessAcc_hasHdAndD(0,i1,o1,i2,o2,v); \
-      ONE_DiagHessAcc_hasHdAndD(1,i1,o1,i2,o2,v); \
-    } \
-  }
-#undef DIHEDRAL_OFF_DIAGONAL_HESSIAN_ACCUMULATE
-#define	DIHEDRAL_OFF_DIAGONAL_HESSIAN_ACCUMULATE(i1,o1,i2,o2,v) { \
-    if (hasHessian) { \
-      ONE_OffDiagHessAcc_hasHessian(0,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHessian(1,i1,o1,i2,o2,v); \
-    } \
-    if (hasHdAndD) { \
-      ONE_OffDiagHessAcc_hasHdAndD(0,i1,o1,i2,o2,v); \
-      ONE_OffDiagHessAcc_hasHdAndD(1,i1,o1,i2,o2,v); \
-    } \
-  }
-#pragma clang diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-variable"
-#undef DECLARE_FLOAT
-#define DECLARE_FLOAT(xx) real2 xx
-#include <cando/chem/energy_functions/_Dihedral_termDeclares.cc>
-#pragma clang diagnostic pop
-#undef VEC_CONST
-#define VEC_CONST(x) VEC2(x)
-  
-  fx1 = VEC_CONST(0.0);
-  fy1 = VEC_CONST(0.0);
-  fz1 = VEC_CONST(0.0);
-  fx2 = VEC_CONST(0.0);
-  fy2 = VEC_CONST(0.0);
-  fz2 = VEC_CONST(0.0);
-  fx3 = VEC_CONST(0.0);
-  fy3 = VEC_CONST(0.0);
-  fz3 = VEC_CONST(0.0);
-  fx4 = VEC_CONST(0.0);
-  fy4 = VEC_CONST(0.0);
-  fz4 = VEC_CONST(0.0);
-  real2 x1,y1,z1,x2,y2,z2,x3,y3,z3,x4,y4,z4,V,DN;
-  real2 EraseLinearDihedral;
-  int2	I1, I2, I3, I4, IN;
-  real2 sinPhase, cosPhase, SinNPhi, CosNPhi;
-
-#undef ONE_sinNPhiCosNPhi
-#define ONE_sinNPhiCosNPhi(INI,IN,SinNPhi,CosNPhi,SinPhi,CosPhi) {\
-    real tSinNPhi, tCosNPhi; \
-    sinNPhiCosNPhi(IN[INI],tSinNPhi,tCosNPhi,SinPhi[INI],CosPhi[INI]); \
-    SinNPhi[INI] = tSinNPhi; CosNPhi[INI] = tCosNPhi; \
-  }
-
-#undef DO_sinNPhiCosNPhi
-#define DO_sinNPhiCosNPhi(IN,SinNPhi,CosNPhi,SinPhi,CosPhi) { \
-    ONE_sinNPhiCosNPhi(0,IN,SinNPhi,CosNPhi,SinPhi,CosPhi); \
-    ONE_sinNPhiCosNPhi(1,IN,SinNPhi,CosNPhi,SinPhi,CosPhi); \
-  }
-
-  gctools::Vec0<EnergyDihedral>::iterator di;
-  int i = 0;
-  for ( di=di_start2; di<di_end2; di += VREAL2_WIDTH ) {
-#define DIHEDRAL_DEBUG_INTERACTIONS(I1,I2,I3,I4) IGNORE_DIHEDRAL_DEBUG_INTERACTIONS(I1,I2,I3,I4)
-#include <cando/chem/energy_functions/_Dihedral_termCode.cc>
-#undef DIHEDRAL_DEBUG_INTERACTIONS
-#undef DIHEDRAL_APPLY_ATOM_MASK
-#undef SIMD
-#undef MAYBE_ERROR_LINEAR_DIHEDRAL
-#define MAYBE_ERROR_LINEAR_DIHEDRAL(IDX,di,I1,I2,I3,I4) { \
-      if ( EraseLinearDihedral[IDX] == 0.0 ) { \
-          ERROR(chem::_sym_LinearDihedralError, \
-                core::Cons_O::createList(kw::_sym_atoms,core::Cons_O::createList(di[IDX]._Atom1,\
-                                                                                 di[IDX]._Atom2,\
-                                                                                 di[IDX]._Atom3,\
-                                                                                 di[IDX]._Atom4 ), \
-                                         kw::_sym_coordinates,pos, \
-                                         kw::_sym_indexes,core::Cons_O::createList(core::make_fixnum(I1[IDX]), core::make_fixnum(I2[IDX]), core::make_fixnum(I3[IDX]), core::make_fixnum(I4[IDX])))); \
-      }}
-
-    MAYBE_ERROR_LINEAR_DIHEDRAL(0,di,I1,I2,I3,I4);
-    MAYBE_ERROR_LINEAR_DIHEDRAL(1,di,I1,I2,I3,I4);
-
-#if TURN_ENERGY_FUNCTION_DEBUG_ON //[
-    di->_calcForce = calcForce;
-    di->_calcDiagonalHessian = calcDiagonalHessian;
-    di->_calcOffDiagonalHessian = calcOffDiagonalHessian;
-#undef EVAL_SET
-#define	EVAL_SET(var,val)	{ di->eval.var=val;};
-#include	<cando/chem/energy_functions/_Dihedral_debugEvalSet.cc>
-#endif //]
-    i += VREAL2_WIDTH;
-  }
-  if ( this->_DebugEnergy ) 
-  {
-    LOG_ENERGY(("%s }\n") , this->className());
-  }
-  return totalEnergy;
-#endif
+  if (groupStart>=groupEnd) return 0.0;
+  bool hasForce = calcForce && force.notnilp();
+  return _evaluateCompiledLanes_Dihedral<real2,int2,VREAL2_WIDTH>(groupStart,
+                                                                    groupEnd,
+                                                                    &(*this->_CompiledGroupStart)[0],
+                                                                    &(*this->_CompiledSinPhase)[0],
+                                                                    &(*this->_CompiledCosPhase)[0],
+                                                                    &(*this->_CompiledV)[0],
+                                                                    &(*this->_CompiledDN)[0],
+                                                                    &(*this->_CompiledIN)[0],
+                                                                    &(*this->_CompiledI1)[0],
+                                                                    &(*this->_CompiledI2)[0],
+                                                                    &(*this->_CompiledI3)[0],
+                                                                    &(*this->_CompiledI4)[0],
+                                                                    &(*pos)[0],
+                                                                    hasForce,
+                                                                    hasForce ? &(*force)[0] : NULL,
+                                                                    linear);
 }
 #endif // !_TARGET_OS_DARWIN
 
@@ -1747,118 +1563,51 @@ double EnergyDihedral_O::evaluateAllComponent(ScoringFunction_sp          score,
 {
   num_real  energy = 0.0;
   this->_Evaluations++;
-#ifdef _TARGET_OS_DARWIN
-    energy += this->evaluateAllComponentSingle(this->_Terms.begin(),
-                                               this->_Terms.end(),
-                                               score,
-                                               pos,
-                                               calcForce,
-                                               force,
-                                               calcDiagonalHessian,
-                                               calcOffDiagonalHessian,
-                                               hessian,
-                                               hdvec,
-                                               dvec,
-                                               activeAtomMask,
-                                               debugInteractions );
-#else
-  if (cando::global_simd_width ==1 || debugInteractions.notnilp()) {
-    energy += this->evaluateAllComponentSingle(this->_Terms.begin(),
-                                               this->_Terms.end(),
-                                               score,
-                                               pos,
-                                               calcForce,
-                                               force,
-                                               calcDiagonalHessian,
-                                               calcOffDiagonalHessian,
-                                               hessian,
-                                               hdvec,
-                                               dvec,
-                                               activeAtomMask,
-                                               debugInteractions );
-  } else if (cando::global_simd_width == 8 ) {
-    gctools::Vec0<EnergyDihedral>::iterator di_vector_end8 = this->_Terms.begin()+((int)(std::distance(this->_Terms.begin(),this->_Terms.end())/VREAL8_WIDTH))*VREAL8_WIDTH;
-    energy += this->evaluateAllComponentSimd8(this->_Terms.begin(),
-                                              di_vector_end8,
-                                              score,
-                                              pos,
-                                              calcForce,
-                                              force,
-                                              calcDiagonalHessian,
-                                              calcOffDiagonalHessian,
-                                              hessian,
-                                              hdvec,
-                                              dvec,
-                                              activeAtomMask );
-    energy += this->evaluateAllComponentSingle(di_vector_end8,
-                                               this->_Terms.end(),
-                                               score,
-                                               pos,
-                                               calcForce,
-                                               force,
-                                               calcDiagonalHessian,
-                                               calcOffDiagonalHessian,
-                                               hessian,
-                                               hdvec,
-                                               dvec,
-                                               activeAtomMask,
-                                               nil<core::T_O>());
-  } else if (cando::global_simd_width == 4 ) {
-    gctools::Vec0<EnergyDihedral>::iterator di_vector_end4 = this->_Terms.begin()+((int)(std::distance(this->_Terms.begin(),this->_Terms.end())/VREAL4_WIDTH))*VREAL4_WIDTH;
-    energy += this->evaluateAllComponentSimd4(this->_Terms.begin(),
-                                              di_vector_end4,
-                                              score,
-                                              pos,
-                                              calcForce,
-                                              force,
-                                              calcDiagonalHessian,
-                                              calcOffDiagonalHessian,
-                                              hessian,
-                                              hdvec,
-                                              dvec,
-                                              activeAtomMask );
-    energy += this->evaluateAllComponentSingle(di_vector_end4,
-                                               this->_Terms.end(),
-                                               score,
-                                               pos,
-                                               calcForce,
-                                               force,
-                                               calcDiagonalHessian,
-                                               calcOffDiagonalHessian,
-                                               hessian,
-                                               hdvec,
-                                               dvec,
-                                               activeAtomMask,
-                                               nil<core::T_O>());
-  } else if (cando::global_simd_width == 2 ) {
-    gctools::Vec0<EnergyDihedral>::iterator di_vector_end2 = this->_Terms.begin()+((int)(std::distance(this->_Terms.begin(),this->_Terms.end())/VREAL2_WIDTH))*VREAL2_WIDTH;
-    energy += this->evaluateAllComponentSimd2(this->_Terms.begin(),
-                                              di_vector_end2,
-                                              score,
-                                              pos,
-                                              calcForce,
-                                              force,
-                                              calcDiagonalHessian,
-                                              calcOffDiagonalHessian,
-                                              hessian,
-                                              hdvec,
-                                              dvec,
-                                              activeAtomMask );
-    energy += this->evaluateAllComponentSingle(di_vector_end2,
-                                               this->_Terms.end(),
-                                               score,
-                                               pos,
-                                               calcForce,
-                                               force,
-                                               calcDiagonalHessian,
-                                               calcOffDiagonalHessian,
-                                               hessian,
-                                               hdvec,
-                                               dvec,
-                                               activeAtomMask,
-                                               nil<core::T_O>() );
+  this->ensureCompiledTerms();
+  size_t numGroups = this->numberOfCompiledGroups();
+  // The SIMD loops take whole blocks of compiled groups from the front and the scalar
+  // loop takes the groups that are left so both split the one group index space.
+  // Only the energy and force have SIMD loops.
+  size_t simdGroupEnd = 0;
+#ifndef _TARGET_OS_DARWIN
+  if ( cando::global_simd_width > 1
+       && debugInteractions.nilp()
+       && activeAtomMask.nilp()
+       && hessian.nilp()
+       && (hdvec.nilp() || dvec.nilp())
+       && !this->_SinglePrecision
+       && !this->_DebugEnergy ) {
+    bool linear = false;
+    if (cando::global_simd_width == 8 ) {
+      simdGroupEnd = (numGroups/VREAL8_WIDTH)*VREAL8_WIDTH;
+      energy += this->evaluateAllComponentSimd8(0,simdGroupEnd,pos,calcForce,force,linear);
+    } else if (cando::global_simd_width == 4 ) {
+      simdGroupEnd = (numGroups/VREAL4_WIDTH)*VREAL4_WIDTH;
+      energy += this->evaluateAllComponentSimd4(0,simdGroupEnd,pos,calcForce,force,linear);
+    } else if (cando::global_simd_width == 2 ) {
+      simdGroupEnd = (numGroups/VREAL2_WIDTH)*VREAL2_WIDTH;
+      energy += this->evaluateAllComponentSimd2(0,simdGroupEnd,pos,calcForce,force,linear);
+    }
+    if (linear) {
+      // Evaluate every group with the scalar loop which signals the linear dihedral error
+      energy = 0.0;
+      simdGroupEnd = 0;
+    }
   }
 #endif
+  energy += this->evaluateAllComponentSingle(simdGroupEnd,
+                                             numGroups,
+                                             score,
+                                             pos,
+                                             calcForce,
+                                             force,
+                                             calcDiagonalHessian,
+                                             calcOffDiagonalHessian,
+                                             hessian,
+                                             hdvec,
+                                             dvec,
+                                             activeAtomMask,
+                                             debugInteractions );
   maybeSetEnergy( componentEnergy, EnergyDihedral_O::static_classSymbol(), energy );
   return energy;
 };
@@ -57,7 +57,7 @@ if (hasActiveAtomMask \
          && bitvectorActiveAtomMask->testBit(I2/3) \
          && bitvectorActiveAtomMask->testBit(I3/3) \
          && bitvectorActiveAtomMask->testBit(I4/3)) \
-    ) goto SKIP_term;
+    ) { ENERGY_COUNT_SKIPPED_TERM(); goto SKIP_term; }
 #define IMPROPER_RESTRAINT_DEBUG_INTERACTIONS(I1,I2,I3,I4) \
     if (doDebugInteractions) { \
       core::eval::funcall(debugInteractions,EnergyDihedralRestraint_O::static_classSymbol(), \
@@ -40,6 +40,7 @@ __END_DOC
  *
  */
 
+#include <chrono>
 #include <clasp/core/common.h>
 #include <clasp/core/bformat.h>
 #include <cando/chem/energyFunction.h>
@@ -139,7 +140,11 @@ void energyFunction_initializeSmarts()
 
 
 core::List_sp EnergyFunction_O::allComponents() const {
-  core::List_sp result = this->_OtherEnergyComponents;
+  ql::list others;
+  for ( auto cur : this->_OtherEnergyComponents ) {
+    others << oCdr(CONS_CAR(cur));
+  }
+  core::List_sp result = others.cons();
   result = core::Cons_O::create(this->_FixedNonbondRestraint,result);
   result = core::Cons_O::create(this->_AnchorRestraint,result);
   result = core::Cons_O::create(this->_ChiralRestraint,result);
@@ -151,6 +156,30 @@ core::List_sp EnergyFunction_O::allComponents() const {
   return result;
 }
 
+CL_DOCSTRING(R"dx(Return the alist of (name . component) of the components added with push-other-energy-component.)dx");
+CL_DEFMETHOD core::List_sp EnergyFunction_O::otherEnergyComponents() const {
+  return this->_OtherEnergyComponents;
+}
+
+CL_DOCSTRING(R"dx(Add component to the energy-function so that evaluate-all evaluates it after the standard
+components.  It is named by its class name and replaces a component of the same class that was added before.)dx");
+CL_DEFMETHOD void EnergyFunction_O::pushOtherEnergyComponent(EnergyComponent_sp component) {
+  core::T_sp name = component->_instanceClass()->_className();
+  ql::list result;
+  bool replaced = false;
+  for ( auto cur : this->_OtherEnergyComponents ) {
+    core::Cons_sp pair = gc::As<core::Cons_sp>(CONS_CAR(cur));
+    if (oCar(pair) == name) {
+      result << core::Cons_O::create(name,component);
+      replaced = true;
+    } else {
+      result << pair;
+    }
+  }
+  if (!replaced) result << core::Cons_O::create(name,component);
+  this->_OtherEnergyComponents = result.cons();
+}
+
 CL_DOCSTRING(R"doc(Create an energy-scale object for an energy-function.)doc");
 CL_LISPIFY_NAME(make_energy_scale);
 CL_DEF_CLASS_METHOD EnergyScale_sp EnergyScale_O::make()
@@ -594,128 +623,119 @@ double	EnergyFunction_O::evaluateAll( NVector_sp 	pos,
   }
 
   LOG("Starting evaluation of energy" );
-  if (this->_Stretch->isEnabled()) {
-    totalEnergy += this->_Stretch->evaluateAllComponent( this->asSmartPtr(),
-                                                         pos,
-                                                         energyScale,
-                                                         componentEnergy,
-                                                         calcForce, force,
-                                                         calcDiagonalHessian,
-                                                         calcOffDiagonalHessian,
-                                                         hessian, hdvec, dvec, activeAtomMask,
-                                                         debugInteractions );
-  }
-  if (this->_Angle->isEnabled()) {
-    totalEnergy += this->_Angle->evaluateAllComponent( this->asSmartPtr(),
-                                                       pos,
-                                                       energyScale,
-                                                       componentEnergy,
-                                                       calcForce, force,
-                                                       calcDiagonalHessian,
-                                                       calcOffDiagonalHessian,
-                                                       hessian, hdvec, dvec, activeAtomMask,
-                                                       debugInteractions);
-  }
-  if(this->_Dihedral->isEnabled()) {
-    totalEnergy += this->_Dihedral->evaluateAllComponent( this->asSmartPtr(),
-                                                          pos,
-                                                          energyScale,
-                                                          componentEnergy,
-                                                          calcForce, force,
-                                                          calcDiagonalHessian,
-                                                          calcOffDiagonalHessian,
-                                                          hessian, hdvec, dvec, activeAtomMask,
-                                                          debugInteractions );
-  }
-  if(this->_Nonbond->isEnabled()) {
-    totalEnergy += this->_Nonbond->evaluateAllComponent( this->asSmartPtr(),
-                                                         pos,
-                                                         energyScale,
-                                                         componentEnergy,
-                                                         calcForce, force,
-                                                         calcDiagonalHessian, calcOffDiagonalHessian, hessian, hdvec, dvec, activeAtomMask,
-                                                         debugInteractions );
-  }
-  if(this->_DihedralRestraint.boundp() && this->_DihedralRestraint->isEnabled()) {
-    totalEnergy += this->_DihedralRestraint->evaluateAllComponent( this->asSmartPtr(),
-                                                                   pos,
-                                                                   energyScale,
-                                                                   componentEnergy,
-                                                                   calcForce, force,
-                                                                   calcDiagonalHessian,
-                                                                   calcOffDiagonalHessian,
-                                                                   hessian,
-                                                                   hdvec,
-                                                                   dvec,
-                                                                   activeAtomMask,
-                                                                   debugInteractions );
-  }
-  if(this->_ChiralRestraint->isEnabled()) {
-    totalEnergy += this->_ChiralRestraint->evaluateAllComponent( this->asSmartPtr(),
-                                                                 pos,
-                                                                 energyScale,
-                                                                 componentEnergy,
-                                                                 calcForce,
-                                                                 force,
-                                                                 calcDiagonalHessian,
-                                                                 calcOffDiagonalHessian,
-                                                                 hessian,
-                                                                 hdvec,
-                                                                 dvec,
-                                                                 activeAtomMask,
-                                                                 debugInteractions );
-  }
-  if(this->_AnchorRestraint->isEnabled()) {
-    totalEnergy += this->_AnchorRestraint->evaluateAllComponent( this->asSmartPtr(),
-                                                                 pos,
-                                                                 energyScale,
-                                                                 componentEnergy,
-                                                                 calcForce,
-                                                                 force,
-                                                                 calcDiagonalHessian,
-                                                                 calcOffDiagonalHessian,
-                                                                 hessian,
-                                                                 hdvec,
-                                                                 dvec,
-                                                                 activeAtomMask,
-                                                                 debugInteractions );
-  }
-  if(this->_FixedNonbondRestraint->isEnabled()) {
-    totalEnergy += this->_FixedNonbondRestraint->evaluateAllComponent( this->asSmartPtr(),
-                                                                       pos,
-                                                                       energyScale,
-                                                                       componentEnergy,
-                                                                       calcForce, force,
-                                                                       calcDiagonalHessian,
-                                                                       calcOffDiagonalHessian,
-                                                                       hessian,
-                                                                       hdvec,
-                                                                       dvec,
-                                                                       activeAtomMask,
-                                                                       debugInteractions );
-  }
+#define EVALUATE_COMPONENT(component) \
+  totalEnergy += this->evaluateComponentProfiled(component, pos, energyScale, componentEnergy, \
+                                                 calcForce, force, calcDiagonalHessian, calcOffDiagonalHessian, \
+                                                 hessian, hdvec, dvec, activeAtomMask, debugInteractions )
+  if (this->_Stretch->isEnabled()) EVALUATE_COMPONENT(this->_Stretch);
+  if (this->_Angle->isEnabled()) EVALUATE_COMPONENT(this->_Angle);
+  if (this->_Dihedral->isEnabled()) EVALUATE_COMPONENT(this->_Dihedral);
+  if (this->_Nonbond->isEnabled()) EVALUATE_COMPONENT(this->_Nonbond);
+  if (this->_DihedralRestraint.boundp() && this->_DihedralRestraint->isEnabled()) EVALUATE_COMPONENT(this->_DihedralRestraint);
+  if (this->_ChiralRestraint->isEnabled()) EVALUATE_COMPONENT(this->_ChiralRestraint);
+  if (this->_AnchorRestraint->isEnabled()) EVALUATE_COMPONENT(this->_AnchorRestraint);
+  if (this->_FixedNonbondRestraint->isEnabled()) EVALUATE_COMPONENT(this->_FixedNonbondRestraint);
   for ( auto cur : this->_OtherEnergyComponents ) {
     core::Cons_sp pair = gc::As<core::Cons_sp>(CONS_CAR(cur));
     EnergyComponent_sp component = gc::As<EnergyComponent_sp>(oCdr(pair));
-    if (component->isEnabled()) {
-      totalEnergy+= component->evaluateAllComponent(this->asSmartPtr(),
-                                                    pos,
-                                                    energyScale,
-                                                    componentEnergy,
-                                                    calcForce,
-                                                    force,
-                                                    calcDiagonalHessian,
-                                                    calcOffDiagonalHessian,
-                                                    hessian,
-                                                    hdvec,
-                                                    dvec,
-                                                    activeAtomMask,
-                                                    debugInteractions );
-    }
+    if (component->isEnabled()) EVALUATE_COMPONENT(component);
   }
+#undef EVALUATE_COMPONENT
   return totalEnergy;
 }
 
+double EnergyFunction_O::evaluateComponentProfiled(EnergyComponent_sp component,
+                                                   NVector_sp pos,
+                                                   core::T_sp energyScale,
+                                                   core::T_sp componentEnergy,
+                                                   bool calcForce,
+                                                   gc::Nilable<NVector_sp> force,
+                                                   bool calcDiagonalHessian,
+                                                   bool calcOffDiagonalHessian,
+                                                   gc::Nilable<AbstractLargeSquareMatrix_sp> hessian,
+                                                   gc::Nilable<NVector_sp> hdvec,
+                                                   gc::Nilable<NVector_sp> dvec,
+                                                   core::T_sp activeAtomMask,
+                                                   core::T_sp debugInteractions )
+{
+  energyTermCounters.reset();
+  auto start = std::chrono::steady_clock::now();
+  double energy = component->evaluateAllComponent( this->asSmartPtr(),
+                                                   pos,
+                                                   energyScale,
+                                                   componentEnergy,
+                                                   calcForce,
+                                                   force,
+                                                   calcDiagonalHessian,
+                                                   calcOffDiagonalHessian,
+                                                   hessian,
+                                                   hdvec,
+                                                   dvec,
+                                                   activeAtomMask,
+                                                   debugInteractions );
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-start;
+  component->profileRecord(elapsed.count(),energyTermCounters);
+  return energy;
+}
+
+CL_LAMBDA((energy-function chem:energy-function) components pos force &optional active-atom-mask);
+CL_DOCSTRING(R"dx(Evaluate the energy of only the enabled energy components in the list components at
+pos and return it.  When force is a vector it is zeroed and filled with the force of those components.
+Multiple timestep integrators use this to evaluate cheap and expensive components at different rates.)dx");
+CL_DEFMETHOD double EnergyFunction_O::evaluateComponentsEnergyForce(core::List_sp components, NVector_sp pos, gc::Nilable<NVector_sp> force, core::T_sp activeAtomMask)
+{
+  if (force.notnilp()) force->zero();
+  double totalEnergy = 0.0;
+  for ( auto cur : components ) {
+    EnergyComponent_sp component = gc::As<EnergyComponent_sp>(CONS_CAR(cur));
+    if (!component->isEnabled()) continue;
+    totalEnergy += this->evaluateComponentProfiled(component, pos, nil<core::T_O>(), nil<core::T_O>(),
+                                                   force.notnilp(), force, false, false,
+                                                   nil<core::T_O>(), nil<core::T_O>(), nil<core::T_O>(),
+                                                   activeAtomMask, nil<core::T_O>() );
+  }
+  return totalEnergy;
+}
+
+CL_DOCSTRING(R"dx(Clear the evaluation profiles of every component of the energy-function.)dx");
+CL_DEFMETHOD void EnergyFunction_O::profileReset()
+{
+  for ( auto cur : this->allComponents() ) {
+    core::T_sp component = CONS_CAR(cur);
+    if (component.boundp()) gc::As<EnergyComponent_sp>(component)->profileReset();
+  }
+}
+
+SYMBOL_EXPORT_SC_(KeywordPkg,dihedral_restraint);
+SYMBOL_EXPORT_SC_(KeywordPkg,chiral_restraint);
+SYMBOL_EXPORT_SC_(KeywordPkg,anchor_restraint);
+SYMBOL_EXPORT_SC_(KeywordPkg,fixed_nonbond_restraint);
+
+CL_DOCSTRING(R"dx(Return an alist of (name . profile) with the evaluation profile of every component
+of the energy-function, in the order evaluate-all visits them.  Each profile is the plist
+returned by energy-component-profile and covers the calls made since the last
+energy-function-profile-reset.)dx");
+CL_DEFMETHOD core::List_sp EnergyFunction_O::profileSnapshot()
+{
+  ql::list result;
+  result << core::Cons_O::create(kw::_sym_stretch,this->_Stretch->profileAsPlist());
+  result << core::Cons_O::create(kw::_sym_angle,this->_Angle->profileAsPlist());
+  result << core::Cons_O::create(kw::_sym_dihedral,this->_Dihedral->profileAsPlist());
+  result << core::Cons_O::create(kw::_sym_nonbond,this->_Nonbond->profileAsPlist());
+  if (this->_DihedralRestraint.boundp()) {
+    result << core::Cons_O::create(kw::_sym_dihedral_restraint,this->_DihedralRestraint->profileAsPlist());
+  }
+  result << core::Cons_O::create(kw::_sym_chiral_restraint,this->_ChiralRestraint->profileAsPlist());
+  result << core::Cons_O::create(kw::_sym_anchor_restraint,this->_AnchorRestraint->profileAsPlist());
+  result << core::Cons_O::create(kw::_sym_fixed_nonbond_restraint,this->_FixedNonbondRestraint->profileAsPlist());
+  for ( auto cur : this->_OtherEnergyComponents ) {
+    core::Cons_sp pair = gc::As<core::Cons_sp>(CONS_CAR(cur));
+    EnergyComponent_sp component = gc::As<EnergyComponent_sp>(oCdr(pair));
+    result << core::Cons_O::create(oCar(pair),component->profileAsPlist());
+  }
+  return result.cons();
+}
+
 
 
 /*!
@@ -2185,6 +2205,14 @@ void EnergyFunction_O::disableDebug()
   ALL_ENERGY_COMPONENTS(disableDebug());
 }
 
+void EnergyFunction_O::setSinglePrecision(bool on)
+{
+  for ( auto cur : this->allComponents() ) {
+    core::T_sp component = CONS_CAR(cur);
+    if (component.boundp()) gc::As<EnergyComponent_sp>(component)->setSinglePrecision(on);
+  }
+}
+
 
 CL_DEFMETHOD
 EnergyFunction_sp EnergyFunction_O::copyFilter(core::T_sp keepInteractionFactory)
@@ -0,0 +1,600 @@
+/*
+    File: energyGeneralizedBorn.cc
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+       
+#define	DEBUG_LEVEL_NONE
+
+#include <clasp/core/foundation.h>
+#include <clasp/core/evaluator.h>
+#include <clasp/core/bitVector.h>
+#include <cando/chem/energyGeneralizedBorn.h>
+#include <cando/chem/energyNonbond.h>
+#include <cando/chem/energyFunction.h>
+#include <cando/chem/largeSquareMatrix.h>
+#include <cando/chem/nVector.h>
+#include <clasp/core/wrappers.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <limits>
+
+namespace chem {
+
+// The smallest number of atoms that is worth a thread of its own
+#define GENERALIZED_BORN_ATOMS_PER_THREAD 64
+
+SYMBOL_EXPORT_SC_(KeywordPkg,hct);
+SYMBOL_EXPORT_SC_(KeywordPkg,obc1);
+SYMBOL_EXPORT_SC_(KeywordPkg,obc2);
+
+double generalizedBornIntrinsicRadius(int atomicNumber)
+{
+  switch (atomicNumber) {
+  case 1: return 1.3;
+  case 6: return 1.7;
+  case 7: return 1.55;
+  case 8: return 1.5;
+  case 9: return 1.5;
+  case 14: return 2.1;
+  case 15: return 1.85;
+  case 16: return 1.8;
+  case 17: return 1.7;
+  default: return 1.5;
+  }
+}
+
+double generalizedBornScreen(int atomicNumber)
+{
+  switch (atomicNumber) {
+  case 1: return 0.85;
+  case 6: return 0.72;
+  case 7: return 0.79;
+  case 8: return 0.85;
+  case 9: return 0.88;
+  case 15: return 0.86;
+  case 16: return 0.96;
+  default: return 0.8;
+  }
+}
+
+CL_LAMBDA(energy-function &key (cutoff 0.0) (model :obc2));
+CL_DOCSTRING(R"dx(Make a generalized Born implicit solvent component for ENERGY-FUNCTION.
+Intrinsic radii and screening factors are assigned from the atomic numbers of the nonbond
+component.  MODEL is :hct, :obc1 or :obc2 and a CUTOFF of 0.0 includes every pair of atoms.
+Add the component to the energy-function with push-other-energy-component.)dx");
+CL_LISPIFY_NAME(make_energy_generalized_born);
+CL_DEF_CLASS_METHOD EnergyGeneralizedBorn_sp EnergyGeneralizedBorn_O::make(EnergyFunction_sp energyFunction, double cutoff, core::Symbol_sp model)
+{
+  EnergyNonbond_sp nonbond = energyFunction->getNonbondComponent();
+  if (!nonbond->_atomic_number_vector.boundp() || !nonbond->_charge_vector.boundp()) {
+    SIMPLE_ERROR("The generalized Born component needs an energy-function built with excluded atoms");
+  }
+  size_t numAtoms = nonbond->_atomic_number_vector->length();
+  auto me = gctools::GC<EnergyGeneralizedBorn_O>::allocate_with_default_constructor();
+  me->_IntrinsicRadii = NVector_O::make(numAtoms);
+  me->_Screen = NVector_O::make(numAtoms);
+  for ( size_t ii=0; ii<numAtoms; ++ii ) {
+    int atomicNumber = (*nonbond->_atomic_number_vector)[ii];
+    (*me->_IntrinsicRadii)[ii] = generalizedBornIntrinsicRadius(atomicNumber);
+    (*me->_Screen)[ii] = generalizedBornScreen(atomicNumber);
+  }
+  me->setModel(model);
+  me->setCutoff(cutoff);
+  return me;
+}
+
+void EnergyGeneralizedBorn_O::initialize()
+{
+  this->Base::initialize();
+  this->setErrorThreshold(1.0);
+}
+
+void EnergyGeneralizedBorn_O::fields(core::Record_sp node)
+{
+  node->field(INTERN_(kw,IntrinsicRadii),this->_IntrinsicRadii);
+  node->field(INTERN_(kw,Screen),this->_Screen);
+  node->field(INTERN_(kw,Model),this->_Model);
+  node->field(INTERN_(kw,Alpha),this->_Alpha);
+  node->field(INTERN_(kw,Beta),this->_Beta);
+  node->field(INTERN_(kw,Gamma),this->_Gamma);
+  node->field(INTERN_(kw,Offset),this->_Offset);
+  node->field(INTERN_(kw,SoluteDielectric),this->_SoluteDielectric);
+  node->field(INTERN_(kw,SolventDielectric),this->_SolventDielectric);
+  node->field(INTERN_(kw,Cutoff),this->_Cutoff);
+  this->Base::fields(node);
+}
+
+CL_DOCSTRING(R"dx(Set how the effective Born radii are calculated - :hct uses the descreening integrals
+directly and :obc1 and :obc2 rescale them with the two parameter sets of Onufriev, Bashford and Case.)dx");
+CL_DEFMETHOD void EnergyGeneralizedBorn_O::setModel(core::Symbol_sp model)
+{
+  if (model == kw::_sym_hct) {
+    this->_Alpha = 1.0; this->_Beta = 0.0; this->_Gamma = 0.0;
+  } else if (model == kw::_sym_obc1) {
+    this->_Alpha = 0.8; this->_Beta = 0.0; this->_Gamma = 2.909125;
+  } else if (model == kw::_sym_obc2) {
+    this->_Alpha = 1.0; this->_Beta = 0.8; this->_Gamma = 4.85;
+  } else {
+    SIMPLE_ERROR("Unknown generalized Born model {} - must be one of :hct :obc1 :obc2", _rep_(model));
+  }
+  this->_Model = model;
+}
+
+CL_DOCSTRING(R"dx(Only include pairs of atoms closer than cutoff in the Born radii and the energy.
+A cutoff of 0.0 includes every pair.)dx");
+CL_DEFMETHOD void EnergyGeneralizedBorn_O::setCutoff(double cutoff)
+{
+  if (cutoff < 0.0) SIMPLE_ERROR("The generalized Born cutoff must be zero or positive - it was {}", cutoff);
+  this->_Cutoff = cutoff;
+}
+
+CL_DOCSTRING(R"dx(Set the dielectric constants inside the solute and of the solvent.)dx");
+CL_DEFMETHOD void EnergyGeneralizedBorn_O::setDielectrics(double solute, double solvent)
+{
+  if (solute <= 0.0 || solvent <= 0.0) {
+    SIMPLE_ERROR("Dielectric constants must be positive - they were {} and {}", solute, solvent);
+  }
+  this->_SoluteDielectric = solute;
+  this->_SolventDielectric = solvent;
+}
+
+CL_DOCSTRING(R"dx(Replace the intrinsic radii and screening factors - one of each per atom.)dx");
+CL_DEFMETHOD void EnergyGeneralizedBorn_O::setRadiiAndScreen(NVector_sp radii, NVector_sp screen)
+{
+  if (radii->length() != this->numberOfTerms() || screen->length() != this->numberOfTerms()) {
+    SIMPLE_ERROR("There must be {} radii and screening factors - got {} and {}", this->numberOfTerms(), radii->length(), screen->length());
+  }
+  for ( size_t ii=0; ii<radii->length(); ++ii ) {
+    if ((*radii)[ii] <= this->_Offset) SIMPLE_ERROR("The radius {} of atom {} must be larger than the offset {}", (*radii)[ii], ii, this->_Offset);
+  }
+  this->_IntrinsicRadii = radii;
+  this->_Screen = screen;
+}
+
+size_t EnergyGeneralizedBorn_O::profileTermCount()
+{
+  size_t numAtoms = this->numberOfTerms();
+  return numAtoms*(numAtoms+1)/2;
+}
+
+core::List_sp EnergyGeneralizedBorn_O::extract_vectors_as_alist() const
+{
+  ql::list result;
+  result << core::Cons_O::create(INTERN_(kw,radius),this->_IntrinsicRadii);
+  result << core::Cons_O::create(INTERN_(kw,screen),this->_Screen);
+  return result.cons();
+}
+
+EnergyComponent_sp EnergyGeneralizedBorn_O::filterCopyComponent(core::T_sp keepInteractionFactory)
+{
+  // There are no terms to filter - the charges come from the nonbond component of the copy
+  auto copy = gctools::GC<EnergyGeneralizedBorn_O>::copy(*this);
+  return copy;
+}
+
+namespace {
+
+/*! Visit the atoms within the cutoff of an atom using a grid of cells at least one cutoff
+ *  wide, or every atom when there is no cutoff.  Built once per evaluation and shared by
+ *  the Born radius, energy and force passes. */
+struct GeneralizedBornNeighbors {
+  const double* _Coords;
+  size_t        _NumAtoms;
+  double        _Cutoff2;
+  bool          _UseCells;
+  size_t        _Ncx, _Ncy, _Ncz;
+  double        _Min[3];
+  double        _RWidth;
+  std::vector<size_t> _AtomCell;
+  std::vector<size_t> _CellStart;
+  std::vector<size_t> _CellAtoms;
+
+  GeneralizedBornNeighbors(const double* coords, size_t numAtoms, double cutoff) :
+      _Coords(coords), _NumAtoms(numAtoms), _Cutoff2(cutoff*cutoff), _UseCells(false),
+      _Ncx(1), _Ncy(1), _Ncz(1), _RWidth(0.0) {
+    if (cutoff<=0.0 || numAtoms==0) return;
+    double max[3];
+    for ( size_t cc=0; cc<3; ++cc ) { this->_Min[cc] = coords[cc]; max[cc] = coords[cc]; }
+    for ( size_t ii=0; ii<numAtoms; ++ii ) {
+      for ( size_t cc=0; cc<3; ++cc ) {
+        this->_Min[cc] = std::min(this->_Min[cc],coords[ii*3+cc]);
+        max[cc] = std::max(max[cc],coords[ii*3+cc]);
+      }
+    }
+    // Wider cells are still correct so keep the grid to about one atom per cell
+    double width = std::max(cutoff,std::cbrt((max[0]-this->_Min[0]+1.0)*(max[1]-this->_Min[1]+1.0)*(max[2]-this->_Min[2]+1.0)/numAtoms));
+    this->_RWidth = 1.0/width;
+    this->_Ncx = (size_t)((max[0]-this->_Min[0])*this->_RWidth)+1;
+    this->_Ncy = (size_t)((max[1]-this->_Min[1])*this->_RWidth)+1;
+    this->_Ncz = (size_t)((max[2]-this->_Min[2])*this->_RWidth)+1;
+    // Only worthwhile when most pairs are outside of the cutoff
+    this->_UseCells = (this->_Ncx*this->_Ncy*this->_Ncz >= 27);
+    if (!this->_UseCells) return;
+    this->_AtomCell.resize(numAtoms);
+    this->_CellStart.assign(this->_Ncx*this->_Ncy*this->_Ncz+1,0);
+    for ( size_t ii=0; ii<numAtoms; ++ii ) {
+      this->_AtomCell[ii] = this->cellIndex(this->cellCoordinate(ii,0),this->cellCoordinate(ii,1),this->cellCoordinate(ii,2));
+      ++this->_CellStart[this->_AtomCell[ii]+1];
+    }
+    for ( size_t cc=0; cc+1<this->_CellStart.size(); ++cc ) this->_CellStart[cc+1] += this->_CellStart[cc];
+    this->_CellAtoms.resize(numAtoms);
+    std::vector<size_t> fill(this->_CellStart.begin(),this->_CellStart.end()-1);
+    for ( size_t ii=0; ii<numAtoms; ++ii ) this->_CellAtoms[fill[this->_AtomCell[ii]]++] = ii;
+  }
+  size_t cellCoordinate(size_t atom, size_t cc) const {
+    return (size_t)((this->_Coords[atom*3+cc]-this->_Min[cc])*this->_RWidth);
+  }
+  size_t cellIndex(size_t cx, size_t cy, size_t cz) const { return (cz*this->_Ncy+cy)*this->_Ncx+cx; }
+
+  /*! Call fn(j,dx,dy,dz,r2) for every atom j != i within the cutoff of atom i,
+   *  where (dx,dy,dz) = xj-xi. */
+  template <typename Fn>
+  void forNeighbors(size_t ii, Fn&& fn) const {
+    const double* xi = this->_Coords+ii*3;
+    auto visit = [&] (size_t jj) {
+      if (jj==ii) return;
+      const double* xj = this->_Coords+jj*3;
+      double dx = xj[0]-xi[0], dy = xj[1]-xi[1], dz = xj[2]-xi[2];
+      double r2 = dx*dx+dy*dy+dz*dz;
+      if (this->_Cutoff2>0.0 && r2>this->_Cutoff2) return;
+      fn(jj,dx,dy,dz,r2);
+    };
+    if (!this->_UseCells) {
+      for ( size_t jj=0; jj<this->_NumAtoms; ++jj ) visit(jj);
+      return;
+    }
+    size_t cell = this->_AtomCell[ii];
+    size_t cx = cell%this->_Ncx, cy = (cell/this->_Ncx)%this->_Ncy, cz = cell/(this->_Ncx*this->_Ncy);
+    for ( size_t nz = (cz==0 ? 0 : cz-1); nz<=std::min(cz+1,this->_Ncz-1); ++nz ) {
+      for ( size_t ny = (cy==0 ? 0 : cy-1); ny<=std::min(cy+1,this->_Ncy-1); ++ny ) {
+        for ( size_t nx = (cx==0 ? 0 : cx-1); nx<=std::min(cx+1,this->_Ncx-1); ++nx ) {
+          size_t neighbor = this->cellIndex(nx,ny,nz);
+          for ( size_t kk=this->_CellStart[neighbor]; kk<this->_CellStart[neighbor+1]; ++kk ) visit(this->_CellAtoms[kk]);
+        }
+      }
+    }
+  }
+};
+
+size_t generalizedBornNumberOfThreads(size_t numAtoms) {
+  size_t numThreads = std::max(1U,std::thread::hardware_concurrency());
+  return std::max((size_t)1,std::min(numThreads,numAtoms/GENERALIZED_BORN_ATOMS_PER_THREAD));
+}
+
+/*! Copy a Lisp vector into a std::vector that the worker threads can read */
+std::vector<double> generalizedBornCopy(NVector_sp from) {
+  std::vector<double> to(from->length());
+  for ( size_t ii=0; ii<to.size(); ++ii ) to[ii] = (*from)[ii];
+  return to;
+}
+
+/*! Calculate the effective Born radius of every atom and the derivative of each radius
+ *  with respect to its descreening sum (divided by the radius squared) into chain. */
+void generalizedBornRadii(const GeneralizedBornNeighbors& neighbors,
+                          const std::vector<double>& intrinsicRadii, const std::vector<double>& screen,
+                          double offset, double alpha, double beta, double gamma, bool hct,
+                          std::vector<double>& radii, std::vector<double>& chain)
+{
+  size_t numAtoms = neighbors._NumAtoms;
+  radii.resize(numAtoms);
+  chain.resize(numAtoms);
+  size_t numThreads = generalizedBornNumberOfThreads(numAtoms);
+  energyTermsParallel(numThreads, [&] (size_t tid) {
+    for ( size_t ii=tid; ii<numAtoms; ii+=numThreads ) {
+      double radiusI = intrinsicRadii[ii];
+      double offsetRadiusI = radiusI-offset;
+      double sum = 0.0;
+      neighbors.forNeighbors(ii, [&] (size_t jj, double dx, double dy, double dz, double r2) {
+        double scaledRadiusJ = (intrinsicRadii[jj]-offset)*screen[jj];
+        double r = std::sqrt(r2);
+        if (offsetRadiusI >= r+scaledRadiusJ) return;
+        double l_ij = 1.0/std::max(offsetRadiusI,std::fabs(r-scaledRadiusJ));
+        double u_ij = 1.0/(r+scaledRadiusJ);
+        double l_ij2 = l_ij*l_ij;
+        double u_ij2 = u_ij*u_ij;
+        double rInverse = 1.0/r;
+        double term = l_ij - u_ij + 0.25*r*(u_ij2-l_ij2) + 0.5*rInverse*std::log(u_ij/l_ij)
+          + 0.25*scaledRadiusJ*scaledRadiusJ*rInverse*(l_ij2-u_ij2);
+        // Atom i is buried inside the descreening sphere of atom j
+        if (offsetRadiusI < scaledRadiusJ-r) term += 2.0*(1.0/offsetRadiusI-l_ij);
+        sum += term;
+      });
+      if (hct) {
+        radii[ii] = 1.0/(1.0/offsetRadiusI-0.5*sum);
+        chain[ii] = 1.0;
+      } else {
+        double psi = 0.5*sum*offsetRadiusI;
+        double tanhSum = std::tanh(psi*(alpha-psi*(beta-psi*gamma)));
+        radii[ii] = 1.0/(1.0/offsetRadiusI-tanhSum/radiusI);
+        chain[ii] = offsetRadiusI*(alpha-2.0*beta*psi+3.0*gamma*psi*psi)*(1.0-tanhSum*tanhSum)/radiusI;
+      }
+    }
+  });
+}
+
+/*! Everything an evaluation reads, copied out of the Lisp vectors so that the worker
+ *  threads never touch them.  The energy can then be evaluated at displaced coordinates
+ *  for the finite difference Hessian. */
+struct GeneralizedBornSystem {
+  size_t              _NumAtoms;
+  std::vector<double> _IntrinsicRadii;
+  std::vector<double> _Screen;
+  std::vector<double> _Charges;
+  std::vector<char>   _Active;
+  double              _PreFactor;
+  double              _Cutoff;
+  double              _Offset;
+  double              _Alpha;
+  double              _Beta;
+  double              _Gamma;
+  bool                _Hct;
+
+  /*! Return the energy at coords and if force is not NULL add the forces into it.
+   *  The number of terms that were evaluated is written into terms. */
+  double evaluate(const std::vector<double>& coords, std::vector<double>* force, size_t& terms) const
+  {
+    size_t numAtoms = this->_NumAtoms;
+    bool hasForce = (force!=NULL);
+    const std::vector<double>& atomCharges = this->_Charges;
+    const std::vector<double>& intrinsicRadii = this->_IntrinsicRadii;
+    const std::vector<double>& screen = this->_Screen;
+    double preFactor = this->_PreFactor;
+    auto active = [&] (size_t ii) { return this->_Active[ii]!=0; };
+    GeneralizedBornNeighbors neighbors(coords.data(),numAtoms,this->_Cutoff);
+    std::vector<double> radii, chain;
+    generalizedBornRadii(neighbors,intrinsicRadii,screen,this->_Offset,
+                         this->_Alpha,this->_Beta,this->_Gamma,this->_Hct,radii,chain);
+    // Energy and the forces at fixed Born radii, accumulating dE/dRi for the chain rule
+    size_t numThreads = generalizedBornNumberOfThreads(numAtoms);
+    std::vector<double> threadEnergy(numThreads,0.0);
+    std::vector<size_t> threadTerms(numThreads,0);
+    std::vector<std::vector<double>> threadForce(numThreads);
+    std::vector<std::vector<double>> threadDEdR(numThreads);
+    energyTermsParallel(numThreads, [&] (size_t tid) {
+      std::vector<double>& localForce = threadForce[tid];
+      std::vector<double>& localDEdR = threadDEdR[tid];
+      if (hasForce) {
+        localForce.assign(numAtoms*3,0.0);
+        localDEdR.assign(numAtoms,0.0);
+      }
+      double energy = 0.0;
+      size_t localTerms = 0;
+      for ( size_t ii=tid; ii<numAtoms; ii+=numThreads ) {
+        if (!active(ii)) continue;
+        double chargeI = atomCharges[ii];
+        double radiusI = radii[ii];
+        energy += 0.5*preFactor*chargeI*chargeI/radiusI;
+        if (hasForce) localDEdR[ii] -= 0.5*preFactor*chargeI*chargeI/(radiusI*radiusI);
+        ++localTerms;
+        neighbors.forNeighbors(ii, [&] (size_t jj, double dx, double dy, double dz, double r2) {
+          if (jj<ii || !active(jj)) return;
+          double radiusJ = radii[jj];
+          double alpha2 = radiusI*radiusJ;
+          double D = r2/(4.0*alpha2);
+          double expTerm = std::exp(-D);
+          double denominator2 = r2+alpha2*expTerm;
+          double denominator = std::sqrt(denominator2);
+          double Gpol = preFactor*chargeI*atomCharges[jj]/denominator;
+          energy += Gpol;
+          ++localTerms;
+          if (hasForce) {
+            double dGpol_dr = -Gpol*(1.0-0.25*expTerm)/denominator2;
+            double dGpol_dalpha2 = -0.5*Gpol*expTerm*(1.0+D)/denominator2;
+            localDEdR[ii] += dGpol_dalpha2*radiusJ;
+            localDEdR[jj] += dGpol_dalpha2*radiusI;
+            localForce[ii*3+0] += dx*dGpol_dr;
+            localForce[ii*3+1] += dy*dGpol_dr;
+            localForce[ii*3+2] += dz*dGpol_dr;
+            localForce[jj*3+0] -= dx*dGpol_dr;
+            localForce[jj*3+1] -= dy*dGpol_dr;
+            localForce[jj*3+2] -= dz*dGpol_dr;
+          }
+        });
+      }
+      threadEnergy[tid] = energy;
+      threadTerms[tid] = localTerms;
+    });
+    double totalEnergy = 0.0;
+    terms = 0;
+    for ( size_t tid=0; tid<numThreads; ++tid ) {
+      totalEnergy += threadEnergy[tid];
+      terms += threadTerms[tid];
+    }
+    if (!hasForce) return totalEnergy;
+    // Forces through the dependence of every Born radius on the positions of its neighbors
+    double offset = this->_Offset;
+    std::vector<double> bornForce(numAtoms,0.0);
+    for ( size_t tid=0; tid<numThreads; ++tid ) {
+      for ( size_t ii=0; ii<numAtoms; ++ii ) bornForce[ii] += threadDEdR[tid][ii];
+    }
+    for ( size_t ii=0; ii<numAtoms; ++ii ) bornForce[ii] *= radii[ii]*radii[ii]*chain[ii];
+    energyTermsParallel(numThreads, [&] (size_t tid) {
+      std::vector<double>& localForce = threadForce[tid];
+      for ( size_t ii=tid; ii<numAtoms; ii+=numThreads ) {
+        if (bornForce[ii]==0.0) continue;
+        double offsetRadiusI = intrinsicRadii[ii]-offset;
+        neighbors.forNeighbors(ii, [&] (size_t jj, double dx, double dy, double dz, double r2) {
+          double scaledRadiusJ = (intrinsicRadii[jj]-offset)*screen[jj];
+          double r = std::sqrt(r2);
+          if (offsetRadiusI >= r+scaledRadiusJ) return;
+          double l_ij = 1.0/std::max(offsetRadiusI,std::fabs(r-scaledRadiusJ));
+          double u_ij = 1.0/(r+scaledRadiusJ);
+          double rInverse = 1.0/r;
+          double rInverse2 = rInverse*rInverse;
+          double t3 = 0.125*(1.0+scaledRadiusJ*scaledRadiusJ*rInverse2)*(l_ij*l_ij-u_ij*u_ij)
+            + 0.25*std::log(u_ij/l_ij)*rInverse2;
+          double de = bornForce[ii]*t3*rInverse;
+          localForce[ii*3+0] -= dx*de;
+          localForce[ii*3+1] -= dy*de;
+          localForce[ii*3+2] -= dz*de;
+          localForce[jj*3+0] += dx*de;
+          localForce[jj*3+1] += dy*de;
+          localForce[jj*3+2] += dz*de;
+        });
+      }
+    });
+    for ( size_t tid=0; tid<numThreads; ++tid ) {
+      for ( size_t ii=0; ii<numAtoms*3; ++ii ) (*force)[ii] += threadForce[tid][ii];
+    }
+    return totalEnergy;
+  }
+
+  /*! The step for differencing the forces along dir from coords - the same step
+   *  that Minimizer_O::_hessianVectorProduct uses. Returns 0.0 if dir is zero. */
+  static double differenceStep(const std::vector<double>& coords, const std::vector<double>& dir)
+  {
+    double coordsMag2 = 0.0, dirMag2 = 0.0;
+    for ( size_t ii=0; ii<coords.size(); ++ii ) {
+      coordsMag2 += coords[ii]*coords[ii];
+      dirMag2 += dir[ii]*dir[ii];
+    }
+    if (dirMag2==0.0) return 0.0;
+    return std::sqrt(std::numeric_limits<double>::epsilon())*(1.0+std::sqrt(coordsMag2))/std::sqrt(dirMag2);
+  }
+
+  /*! Return the difference of the forces at coords+h*dir and coords, divided by h,
+   *  which is the product of the Hessian and dir. */
+  std::vector<double> hessianTimes(const std::vector<double>& coords, const std::vector<double>& force,
+                                   const std::vector<double>& dir) const
+  {
+    std::vector<double> product(coords.size(),0.0);
+    double hh = differenceStep(coords,dir);
+    if (hh==0.0) return product;
+    std::vector<double> displaced(coords);
+    for ( size_t ii=0; ii<coords.size(); ++ii ) displaced[ii] += hh*dir[ii];
+    std::vector<double> displacedForce(coords.size(),0.0);
+    size_t terms;
+    this->evaluate(displaced,&displacedForce,terms);
+    double rh = 1.0/hh;
+    for ( size_t ii=0; ii<coords.size(); ++ii ) product[ii] = (force[ii]-displacedForce[ii])*rh;
+    return product;
+  }
+};
+
+};
+
+CL_DOCSTRING(R"dx(Return a vector of the effective Born radius of every atom at the coordinates in pos.)dx");
+CL_DEFMETHOD NVector_sp EnergyGeneralizedBorn_O::bornRadii(NVector_sp pos)
+{
+  size_t numAtoms = this->numberOfTerms();
+  if (pos->length() != numAtoms*3) {
+    SIMPLE_ERROR("The coordinate vector has length {} but there are {} atoms", pos->length(), numAtoms);
+  }
+  NVector_sp result = NVector_O::make(numAtoms);
+  if (numAtoms==0) return result;
+  std::vector<double> coords = generalizedBornCopy(pos);
+  std::vector<double> intrinsicRadii = generalizedBornCopy(this->_IntrinsicRadii);
+  std::vector<double> screen = generalizedBornCopy(this->_Screen);
+  GeneralizedBornNeighbors neighbors(coords.data(),numAtoms,this->_Cutoff);
+  std::vector<double> radii, chain;
+  generalizedBornRadii(neighbors,intrinsicRadii,screen,this->_Offset,
+                       this->_Alpha,this->_Beta,this->_Gamma,this->_Model==kw::_sym_hct,radii,chain);
+  for ( size_t ii=0; ii<numAtoms; ++ii ) (*result)[ii] = radii[ii];
+  return result;
+}
+
+double EnergyGeneralizedBorn_O::evaluateAllComponent( ScoringFunction_sp score,
+                                                      NVector_sp 	pos,
+                                                      core::T_sp energyScale,
+                                                      core::T_sp componentEnergy,
+                                                      bool 		calcForce,
+                                                      gc::Nilable<NVector_sp> 	force,
+                                                      bool		calcDiagonalHessian,
+                                                      bool		calcOffDiagonalHessian,
+                                                      gc::Nilable<AbstractLargeSquareMatrix_sp>	hessian,
+                                                      gc::Nilable<NVector_sp>	hdvec,
+                                                      gc::Nilable<NVector_sp> dvec,
+                                                      core::T_sp activeAtomMask,
+                                                      core::T_sp debugInteractions )
+{
+  MAYBE_SETUP_ACTIVE_ATOM_MASK();
+  this->_Evaluations++;
+  bool hasForce = force.notnilp();
+  bool hasHessian = hessian.notnilp() && (calcDiagonalHessian || calcOffDiagonalHessian);
+  bool hasHdAndD = hdvec.notnilp() && dvec.notnilp();
+  double dielectricConstant, dQ1Q2Scale, nonbondCutoff;
+  EnergyFunction_sp energyFunction = energyFunctionNonbondParameters(score,energyScale,dielectricConstant,dQ1Q2Scale,nonbondCutoff);
+  NVector_sp charges = energyFunction->getNonbondComponent()->_charge_vector;
+  size_t numAtoms = this->numberOfTerms();
+  if (!charges.boundp() || charges->length() != numAtoms) {
+    SIMPLE_ERROR("The generalized Born component has {} atoms but the nonbond component of the energy-function does not", numAtoms);
+  }
+  if (numAtoms==0) return 0.0;
+  GeneralizedBornSystem system;
+  system._NumAtoms = numAtoms;
+  system._IntrinsicRadii = generalizedBornCopy(this->_IntrinsicRadii);
+  system._Screen = generalizedBornCopy(this->_Screen);
+  system._Charges = generalizedBornCopy(charges);
+  system._Active.assign(numAtoms,1);
+  if (hasActiveAtomMask) {
+    for ( size_t ii=0; ii<numAtoms; ++ii ) system._Active[ii] = bitvectorActiveAtomMask->testBit(ii);
+  }
+  // -1/2 (1/eps_solute - 1/eps_solvent) in kcal/mol with charges in electrons
+  system._PreFactor = -dQ1Q2Scale*energyScaleElectrostaticScale(energyScale)
+    *(1.0/this->_SoluteDielectric-1.0/this->_SolventDielectric);
+  system._Cutoff = this->_Cutoff;
+  system._Offset = this->_Offset;
+  system._Alpha = this->_Alpha;
+  system._Beta = this->_Beta;
+  system._Gamma = this->_Gamma;
+  system._Hct = (this->_Model==kw::_sym_hct);
+  std::vector<double> coords = generalizedBornCopy(pos);
+  std::vector<double> gbForce;
+  bool needForce = hasForce || hasHessian || hasHdAndD;
+  if (needForce) gbForce.assign(numAtoms*3,0.0);
+  size_t termsEvaluated = 0;
+  double totalEnergy = system.evaluate(coords,needForce ? &gbForce : NULL,termsEvaluated);
+  ENERGY_COUNT_SKIPPED_TERMS(this->profileTermCount()-termsEvaluated);
+  if (hasForce) {
+    for ( size_t ii=0; ii<numAtoms*3; ++ii ) {
+      force->setElement(ii,force->getElement(ii)+gbForce[ii]);
+    }
+  }
+  // Every Born radius depends on all of its neighbors so the second derivatives
+  // are differences of the analytic forces.
+  if (hasHdAndD) {
+    std::vector<double> product = system.hessianTimes(coords,gbForce,generalizedBornCopy(dvec));
+    for ( size_t ii=0; ii<numAtoms*3; ++ii ) hdvec->addToElement(ii,product[ii]);
+  }
+  if (hasHessian) {
+    // One column at a time - each off diagonal element gets half of Hij and half of Hji
+    std::vector<double> unit(numAtoms*3,0.0);
+    for ( size_t jj=0; jj<numAtoms*3; ++jj ) {
+      unit[jj] = 1.0;
+      std::vector<double> column = system.hessianTimes(coords,gbForce,unit);
+      unit[jj] = 0.0;
+      for ( size_t ii=0; ii<numAtoms*3; ++ii ) {
+        if (ii==jj) {
+          if (calcDiagonalHessian) hessian->addToElement(ii,jj,column[ii]);
+        } else if (calcOffDiagonalHessian && column[ii]!=0.0) {
+          hessian->addToElement(ii,jj,0.5*column[ii]);
+        }
+      }
+    }
+  }
+  maybeSetEnergy(componentEnergy,EnergyGeneralizedBorn_O::static_classSymbol(),totalEnergy);
+  return totalEnergy;
+}
+
+};
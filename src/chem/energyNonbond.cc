@@ -38,6 +38,7 @@ at mailto:techtransfer@temple.edu if you would like a different license.
 #include <cando/geom/ovector3.h>
 #include <clasp/core/symbolTable.h>
 #include <clasp/core/nativeVector.h>
+#include <clasp/core/record.h>
 #include <clasp/core/symbolTable.h>
 #include <cando/chem/matter.h>
 #include <cando/chem/bond.h>
@@ -138,7 +139,7 @@ core::T_sp nonbond_type(bool is14) {
 }
 #define NONBOND_APPLY_ATOM_MASK(I1, I2)                                                                                            \
   if (hasActiveAtomMask && !(bitvectorActiveAtomMask->testBit(I1 / 3) && bitvectorActiveAtomMask->testBit(I2 / 3)))                \
-    goto SKIP_term;
+    { ENERGY_COUNT_SKIPPED_TERM(); goto SKIP_term; }
 
 /* No periodic boundary conditons/bounding-box is used in this code.
    So make these macros do nothing.
@@ -1044,6 +1045,24 @@ void EnergyNonbond_O::initialize() {
 
 void EnergyNonbond_O::addTerm(const EnergyNonbond &term) { this->_Terms.push_back(term); }
 
+/*! Count the pairs in the excluded atom list once so that profiling doesn't walk it on
+ *  every evaluation - entries < 0 are the placeholders amber uses for atoms that exclude nothing */
+void EnergyNonbond_O::countExcludedPairs() {
+  size_t excluded = 0;
+  for (size_t ii = 0; ii < this->_ExcludedAtomIndexes->length(); ++ii) {
+    if ((*this->_ExcludedAtomIndexes)[ii] >= 0) ++excluded;
+  }
+  this->_ExcludedPairs = excluded;
+}
+
+size_t EnergyNonbond_O::profileTermCount() {
+  if (!this->_UsesExcludedAtoms) return this->_Terms.size();
+  // Every pair of atoms that is not in the excluded atom list
+  size_t atoms = this->_AtomTable->getNumberOfAtoms();
+  size_t pairs = atoms * (atoms - 1) / 2;
+  return (pairs > this->_ExcludedPairs) ? pairs - this->_ExcludedPairs : 0;
+}
+
 void EnergyNonbond_O::fields(core::Record_sp node) {
   node->field(INTERN_(kw, terms), this->_Terms);
   node->field(INTERN_(kw, InteractionsKept), this->_InteractionsKept );
@@ -1065,6 +1084,10 @@ void EnergyNonbond_O::fields(core::Record_sp node) {
   node->field(INTERN_(kw, ExcludedAtomIndexes), this->_ExcludedAtomIndexes);
   node->field(INTERN_(kw, UsesExcludedAtoms), this->_UsesExcludedAtoms);
   this->Base::fields(node);
+  if ((node->stage() == core::Record_O::initializing || node->stage() == core::Record_O::loading)
+      && this->_UsesExcludedAtoms) {
+    this->countExcludedPairs();
+  }
 }
 
 string EnergyNonbond_O::beyondThresholdInteractionsAsString() {
@@ -1213,6 +1236,7 @@ void EnergyNonbond_O::constructExcludedAtomListFromAtomTable(AtomTable_sp atomTa
       gc::As<core::SimpleVector_int32_t_sp>(values.second(values_mv.number_of_values()));
   this->_NumberOfExcludedAtomIndexes = number_of_excluded_atoms;
   this->_ExcludedAtomIndexes = excluded_atoms_list;
+  this->countExcludedPairs();
 }
 
 /* Construct nonbond terms between two molecules or two residues or a residue and a molecule that are not
@@ -1359,6 +1383,7 @@ CL_DEFMETHOD void EnergyNonbond_O::setNonbondExcludedAtomInfo(AtomTable_sp atom_
   this->_AtomTable = atom_table;
   this->_ExcludedAtomIndexes = excluded_atoms_list;
   this->_NumberOfExcludedAtomIndexes = number_excluded_atoms;
+  this->countExcludedPairs();
 }
 
 EnergyNonbond_sp EnergyNonbond_O::copyFilter(core::T_sp keepInteractionFactory) {
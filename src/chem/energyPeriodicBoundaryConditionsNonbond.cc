@@ -54,7 +54,7 @@ This is an open source license for the CANDO software from Temple University, bu
 #include <cando/chem/largeSquareMatrix.h>
 #include <clasp/core/wrappers.h>
 
-#define BAIL_OUT_IF_CUTOFF(deltaSquared) if (deltaSquared>CUTOFF_SQUARED) goto SKIP_term;
+#define BAIL_OUT_IF_CUTOFF(deltaSquared) if (deltaSquared>CUTOFF_SQUARED) { ENERGY_COUNT_SKIPPED_TERM(); goto SKIP_term; }
 
 //#define DEBUG_NONBOND_TERM 1
 #define LOG_ENERGY(x)
@@ -73,7 +73,7 @@ if (hasActiveAtomMask \
     && !(bitvectorActiveAtomMask->testBit(I1/3) \
          && bitvectorActiveAtomMask->testBit(I2/3) \
          ) \
-    ) goto SKIP_term;
+    ) { ENERGY_COUNT_SKIPPED_TERM(); goto SKIP_term; }
 
 #define NONBOND_DEBUG_INTERACTIONS(I1,I2) \
     if (doDebugInteractions) { \
@@ -48,6 +48,7 @@ This is an open source license for the CANDO software from Temple University, bu
 #include <cando/chem/energyNonbond.h>
 #include <cando/chem/largeSquareMatrix.h>
 #include <clasp/core/wrappers.h>
+#include <thread>
 
 #if 0
 #define DEBUG_NONBOND_TERM 1
@@ -473,6 +474,11 @@ double EnergyRigidBodyNonbond_O::evaluateAllComponent( ScoringFunction_sp score,
   num_real half_x_size = x_size/2.0;
   num_real half_y_size = y_size/2.0;
   num_real half_z_size = z_size/2.0;
+  if (this->_SpatialCutoff > 0.0) {
+    totalEnergy = this->evaluateSpatiallyPruned(pos,widths,rwidths,electrostaticScale,calcForce,force);
+    maybeSetEnergy( componentEnergy, EnergyRigidBodyNonbond_O::static_classSymbol(), totalEnergy );
+    return totalEnergy;
+  }
   
 #define NONBONDRB_CALC_FORCE
 #define NONBONDRB_CALC_DIAGONAL_HESSIAN
@@ -625,6 +631,228 @@ double EnergyRigidBodyNonbond_O::evaluateAllComponent( ScoringFunction_sp score,
   return totalEnergy;
 }
     
+// Below this many candidate body pairs per thread the pruned search stays on one thread
+#define RIGID_BODY_PAIRS_PER_THREAD 16
+
+/*! Evaluate only the sphere pairs that are within _SpatialCutoff of each other.
+The search has two levels.  Every rigid body gets a bounding sphere around its
+lab frame sphere centers and body pairs whose bounding spheres (minimum image)
+are further apart than the cutoff are dropped.  The sphere pairs of the
+remaining body pairs are found with a cell list over the periodic box, falling
+back to a distance check of every sphere pair when the box is less than three
+cutoffs across.  Body pairs are dealt out to threads; each thread sums its own
+energy and rigid body force/torque vector and they are added together here. */
+double EnergyRigidBodyNonbond_O::evaluateSpatiallyPruned( NVector_sp pos,
+                                                          const Vector3& widths,
+                                                          const Vector3& rwidths,
+                                                          num_real electrostaticScale,
+                                                          bool calcForce,
+                                                          gc::Nilable<NVector_sp> force )
+{
+  bool hasForce = force.notnilp();
+  num_real x_rsize = rwidths.getX();
+  num_real y_rsize = rwidths.getY();
+  num_real z_rsize = rwidths.getZ();
+  num_real x_size = widths.getX();
+  num_real y_size = widths.getY();
+  num_real z_size = widths.getZ();
+  num_real half_x_size = x_size/2.0;
+  num_real half_y_size = y_size/2.0;
+  num_real half_z_size = z_size/2.0;
+  num_real cutoff = this->_SpatialCutoff;
+  num_real cutoff2 = cutoff*cutoff;
+  size_t numBodies = this->_RigidBodyEndAtom->length();
+  size_t numSpheres = this->_AtomInfoTable.size();
+  // The worker threads read this copy rather than the NVector
+  std::vector<num_real> coords(numBodies*7);
+  for ( size_t ii=0; ii<coords.size(); ++ii ) coords[ii] = pos->element(ii);
+  std::vector<Vector3> lab(numSpheres);
+  std::vector<size_t> sphereBody(numSpheres);
+  {
+#undef	NONBOND_POSITION_RB_SET_PARAMETER
+#define	NONBOND_POSITION_RB_SET_PARAMETER(x)	{}
+#undef	NONBOND_POSITION_RB_SET_POSITION
+#define	NONBOND_POSITION_RB_SET_POSITION(x,ii,of)	{x=coords[ii+of];}
+#undef	NONBOND_POSITION_RB_SET_POINT
+#define	NONBOND_POSITION_RB_SET_POINT(x,ii,of)	{x=ii._Position.of;}
+#pragma clang diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#include <cando/chem/energy_functions/_NONBONDRBPB_POSITIONS_termDeclares.cc>
+#pragma clang diagnostic pop
+    num_real am, bm, cm, dm, xm, ym, zm;
+    num_real pxm, pym, pzm;
+    int	I1;
+    size_t I1start = 0;
+    for ( size_t iI1 = 0; iI1<numBodies; ++iI1 ) {
+      size_t I1end = (*this->_RigidBodyEndAtom)[iI1];
+      for ( size_t I1cur = I1start; I1cur<I1end; ++I1cur ) {
+        RigidBodyAtomInfo& ea1 = this->_AtomInfoTable[I1cur];
+        I1 = iI1*7;
+#include <cando/chem/energy_functions/_NONBONDRBPB_POSITIONS_termCode.cc>
+        lab[I1cur] = Vector3(plabmx,plabmy,plabmz);
+        sphereBody[I1cur] = iI1;
+      }
+      I1start = I1end;
+    }
+  }
+  auto bodyStart = [this] (size_t body) -> size_t { return body==0 ? 0 : (*this->_RigidBodyEndAtom)[body-1]; };
+  auto bodyEnd = [this] (size_t body) -> size_t { return (*this->_RigidBodyEndAtom)[body]; };
+  auto minimumImage = [&] (const Vector3& delta) {
+    return Vector3(periodic_boundary_adjust(delta.getX(),x_rsize,x_size),
+                   periodic_boundary_adjust(delta.getY(),y_rsize,y_size),
+                   periodic_boundary_adjust(delta.getZ(),z_rsize,z_size));
+  };
+  // Level one - bounding sphere of every body
+  std::vector<Vector3> center(numBodies);
+  std::vector<num_real> radius(numBodies,0.0);
+  for ( size_t body=0; body<numBodies; ++body ) {
+    size_t start = bodyStart(body), end = bodyEnd(body);
+    if (start==end) continue;
+    Vector3 sum(0.0,0.0,0.0);
+    for ( size_t ii=start; ii<end; ++ii ) sum = sum + lab[ii];
+    center[body] = sum*(1.0/(end-start));
+    num_real r2 = 0.0;
+    for ( size_t ii=start; ii<end; ++ii ) {
+      Vector3 delta = lab[ii]-center[body];
+      r2 = std::max(r2,(num_real)delta.dotProduct(delta));
+    }
+    radius[body] = std::sqrt(r2);
+  }
+  std::vector<std::pair<size_t,size_t>> bodyPairs;
+  for ( size_t body1=0; body1<numBodies; ++body1 ) {
+    if (bodyStart(body1)==bodyEnd(body1)) continue;
+    for ( size_t body2=body1+1; body2<numBodies; ++body2 ) {
+      if (bodyStart(body2)==bodyEnd(body2)) continue;
+      Vector3 delta = minimumImage(center[body1]-center[body2]);
+      num_real reach = cutoff+radius[body1]+radius[body2];
+      if (delta.dotProduct(delta)<=reach*reach) bodyPairs.emplace_back(body1,body2);
+    }
+  }
+  // Level two - cell list of all spheres in the periodic box, cells at least one cutoff wide
+  // Wider cells are still correct so keep the grid to about one sphere per cell
+  size_t maxCellsPerSide = std::max((size_t)3,(size_t)std::cbrt((double)numSpheres)+1);
+  size_t ncx = std::min(maxCellsPerSide,(size_t)std::floor(x_size/cutoff));
+  size_t ncy = std::min(maxCellsPerSide,(size_t)std::floor(y_size/cutoff));
+  size_t ncz = std::min(maxCellsPerSide,(size_t)std::floor(z_size/cutoff));
+  bool useCells = (ncx>=3 && ncy>=3 && ncz>=3);
+  std::vector<size_t> sphereCell;
+  std::vector<size_t> cellStart;
+  std::vector<size_t> cellSpheres;
+  auto cellIndex = [&] (size_t cx, size_t cy, size_t cz) { return (cz*ncy+cy)*ncx+cx; };
+  auto cellCoordinate = [] (num_real x, num_real size, num_real rsize, size_t ncells) {
+    num_real wrapped = x-size*std::floor(x*rsize);
+    return std::min(ncells-1,(size_t)(wrapped*rsize*ncells));
+  };
+  if (useCells) {
+    sphereCell.resize(numSpheres);
+    cellStart.assign(ncx*ncy*ncz+1,0);
+    for ( size_t ii=0; ii<numSpheres; ++ii ) {
+      sphereCell[ii] = cellIndex(cellCoordinate(lab[ii].getX(),x_size,x_rsize,ncx),
+                                 cellCoordinate(lab[ii].getY(),y_size,y_rsize,ncy),
+                                 cellCoordinate(lab[ii].getZ(),z_size,z_rsize,ncz));
+      ++cellStart[sphereCell[ii]+1];
+    }
+    for ( size_t cc=0; cc<ncx*ncy*ncz; ++cc ) cellStart[cc+1] += cellStart[cc];
+    cellSpheres.resize(numSpheres);
+    std::vector<size_t> fill(cellStart.begin(),cellStart.end()-1);
+    for ( size_t ii=0; ii<numSpheres; ++ii ) cellSpheres[fill[sphereCell[ii]]++] = ii;
+  }
+  auto withinCutoff = [&] (size_t i1, size_t i2) {
+    Vector3 delta = minimumImage(lab[i1]-lab[i2]);
+    return delta.dotProduct(delta)<=cutoff2;
+  };
+  size_t numThreads = std::max(1U,std::thread::hardware_concurrency());
+  numThreads = std::max((size_t)1,std::min(numThreads,bodyPairs.size()/RIGID_BODY_PAIRS_PER_THREAD));
+  std::vector<double> threadEnergy(numThreads,0.0);
+  std::vector<std::vector<num_real>> threadForce(numThreads);
+  auto evaluateBodyPairs = [&] (size_t tid) {
+    std::vector<num_real>& localForce = threadForce[tid];
+    if (hasForce) localForce.assign(numBodies*7,0.0);
+    double totalEnergy = 0.0;
+    std::vector<std::pair<size_t,size_t>> spherePairs;
+#undef	NONBONDRB_SET_PARAMETER
+#define	NONBONDRB_SET_PARAMETER(x)	{}
+#undef	NONBONDRB_SET_POSITION
+#define	NONBONDRB_SET_POSITION(x,ii,of)	{x=coords[ii+of];}
+#undef	NONBONDRB_SET_POINT
+#define	NONBONDRB_SET_POINT(x,ii,of)	{x=ii._Position.of;}
+#undef	NONBONDRB_ENERGY_ACCUMULATE
+#define	NONBONDRB_ENERGY_ACCUMULATE(e) {totalEnergy += e;};
+#undef	NONBONDRB_FORCE_ACCUMULATE
+#define	NONBONDRB_FORCE_ACCUMULATE(i,o,v) { if (hasForce) localForce[(i)+(o)] += (v); }
+#pragma clang diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#include <cando/chem/energy_functions/_NONBONDRBPB_termDeclares.cc>
+#pragma clang diagnostic pop
+    num_real dA,dC,dQ1Q2;
+    num_real am, bm, cm, dm, xm, ym, zm;
+    num_real pxm, pym, pzm;
+    num_real an, bn, cn, dn, xn, yn, zn;
+    num_real pxn, pyn, pzn;
+    int	I1, I2;
+    for ( size_t ip=tid; ip<bodyPairs.size(); ip+=numThreads ) {
+      size_t iHelix1 = bodyPairs[ip].first;
+      size_t iHelix2 = bodyPairs[ip].second;
+      spherePairs.clear();
+      if (useCells) {
+        // Walk the smaller body and look for the other body's spheres in the 27 surrounding cells
+        bool swapped = (bodyEnd(iHelix1)-bodyStart(iHelix1)) > (bodyEnd(iHelix2)-bodyStart(iHelix2));
+        size_t walk = swapped ? iHelix2 : iHelix1;
+        size_t other = swapped ? iHelix1 : iHelix2;
+        for ( size_t ii=bodyStart(walk); ii<bodyEnd(walk); ++ii ) {
+          size_t cell = sphereCell[ii];
+          size_t cx = cell%ncx, cy = (cell/ncx)%ncy, cz = cell/(ncx*ncy);
+          for ( size_t dz=0; dz<3; ++dz ) {
+            size_t nz = (cz+ncz+dz-1)%ncz;
+            for ( size_t dy=0; dy<3; ++dy ) {
+              size_t ny = (cy+ncy+dy-1)%ncy;
+              for ( size_t dx=0; dx<3; ++dx ) {
+                size_t nx = (cx+ncx+dx-1)%ncx;
+                size_t neighbor = cellIndex(nx,ny,nz);
+                for ( size_t kk=cellStart[neighbor]; kk<cellStart[neighbor+1]; ++kk ) {
+                  size_t jj = cellSpheres[kk];
+                  if (sphereBody[jj]!=other || !withinCutoff(ii,jj)) continue;
+                  if (swapped) spherePairs.emplace_back(jj,ii);
+                  else spherePairs.emplace_back(ii,jj);
+                }
+              }
+            }
+          }
+        }
+      } else {
+        for ( size_t ii=bodyStart(iHelix1); ii<bodyEnd(iHelix1); ++ii ) {
+          for ( size_t jj=bodyStart(iHelix2); jj<bodyEnd(iHelix2); ++jj ) {
+            if (withinCutoff(ii,jj)) spherePairs.emplace_back(ii,jj);
+          }
+        }
+      }
+      I1 = iHelix1*7;
+      I2 = iHelix2*7;
+      for ( auto& spherePair : spherePairs ) {
+        RigidBodyAtomInfo& ea1 = this->_AtomInfoTable[spherePair.first];
+        RigidBodyAtomInfo& ea2 = this->_AtomInfoTable[spherePair.second];
+        RigidBodyNonbondCrossTerm& crossTerm = this->crossTerm(ea1._TypeIndex,ea2._TypeIndex);
+        dA = crossTerm.dA;
+        dC = crossTerm.dC;
+        dQ1Q2 = ea1._Charge*electrostaticScale*ea2._Charge;
+#include <cando/chem/energy_functions/_NONBONDRBPB_termCode.cc>
+      }
+    }
+    threadEnergy[tid] = totalEnergy;
+  };
+  energyTermsParallel(numThreads,evaluateBodyPairs);
+  double totalEnergy = 0.0;
+  for ( size_t tid=0; tid<numThreads; ++tid ) {
+    totalEnergy += threadEnergy[tid];
+    if (hasForce) {
+      for ( size_t ii=0; ii<numBodies*7; ++ii ) {
+        force->setElement(ii,force->getElement(ii)+threadForce[tid][ii]);
+      }
+    }
+  }
+  return totalEnergy;
+}
+    
 void	EnergyRigidBodyNonbond_O::compareAnalyticalAndNumericalForceAndHessianTermByTerm(
                                                                                 NVector_sp 	pos)
 {
@@ -693,6 +921,7 @@ void EnergyRigidBodyNonbond_O::initialize()
   this->setDielectricConstant(80.0);
   this->setVdwScale(1.0);
   this->setElectrostaticScale(1.0);
+  this->setSpatialCutoff(0.0);
 }
 
 
@@ -703,6 +932,7 @@ void EnergyRigidBodyNonbond_O::fields(core::Record_sp node)
   node->field( INTERN_(kw,scaleElectrostatic), this->_ScaleElectrostatic );
   node->field( INTERN_(kw,energyVdw), this->_EnergyVdw );
   node->field( INTERN_(kw,energyElectrostatic), this->_EnergyElectrostatic);
+  node->field_if_not_default( INTERN_(kw,spatialCutoff), this->_SpatialCutoff, 0.0 );
   node->field( INTERN_(kw,rigidBodyEndAtom), this->_RigidBodyEndAtom );
   node->field( INTERN_(kw,atomInfoTable), this->_AtomInfoTable );
   node->field( INTERN_(kw,numberOfTypes), this->_NumberOfTypes );
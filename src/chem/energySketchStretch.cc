@@ -51,7 +51,7 @@ if (hasActiveAtomMask \
     && !(bitvectorActiveAtomMask->testBit(I1/3) \
          && bitvectorActiveAtomMask->testBit(I2/3) \
          ) \
-    ) goto SKIP_term;
+    ) { ENERGY_COUNT_SKIPPED_TERM(); goto SKIP_term; }
 #define STRETCH_DEBUG_INTERACTIONS(I1,I2) \
     if (doDebugInteractions) { \
       core::eval::funcall(debugInteractions,EnergySketchStretch_O::static_classSymbol(), \
@@ -27,6 +27,7 @@ This is an open source license for the CANDO software from Temple University, bu
 
 #define ENERGY_FUNCTION I1, I2, activeAtomMask
 
+#include <algorithm>
 #include <cando/chem/energyStretch.h>
 #include <clasp/core/numerics.h>
 #include <clasp/core/ql.h>
@@ -54,7 +55,7 @@ namespace chem {
 #define STRETCH_APPLY_ATOM_MASK(I1,I2) \
 if (hasActiveAtomMask \
     && !(bitvectorActiveAtomMask->testBit(I1/3) \
-         && bitvectorActiveAtomMask->testBit(I2/3))) goto SKIP_term;
+         && bitvectorActiveAtomMask->testBit(I2/3))) { ENERGY_COUNT_SKIPPED_TERM(); goto SKIP_term; }
 
 double _evaluateEnergyOnly_Stretch ( int I1,
                                      int I2,
@@ -108,6 +109,59 @@ double _evaluateEnergyOnly_Stretch ( int I1,
   return Energy;
 }
 
+/*! Evaluate the energy and optionally the force of the compiled stretch terms.
+ *  There is no active atom mask or Hessian so the loop body is straight line
+ *  code that reads the packed parameter and index arrays.  Real is the type the
+ *  terms are evaluated in - the energy is summed and the force accumulated in double.
+ */
+template <typename Real>
+static double _evaluateCompiled_Stretch( size_t numTerms,
+                                         const float* compiled_kb,
+                                         const float* compiled_r0,
+                                         const int32_t* compiled_I1,
+                                         const int32_t* compiled_I2,
+                                         const Vector_real* coords,
+                                         bool calcForce,
+                                         Vector_real* force )
+{
+  const bool hasActiveAtomMask = false;
+  core::SimpleBitVector_sp bitvectorActiveAtomMask;
+  KahanSummation totalEnergy;
+#undef	STRETCH_SET_PARAMETER
+#define	STRETCH_SET_PARAMETER(x)	{x = compiled_##x[i];}
+#undef	STRETCH_SET_POSITION
+#define	STRETCH_SET_POSITION(x,ii,of)	{x = coords[ii+of];}
+#undef	STRETCH_ENERGY_ACCUMULATE
+#define	STRETCH_ENERGY_ACCUMULATE(e) { totalEnergy.add(e); }
+#undef	STRETCH_FORCE_ACCUMULATE
+#define	STRETCH_FORCE_ACCUMULATE(i,o,v) { force[(i)+(o)] += (v); }
+#undef	STRETCH_DIAGONAL_HESSIAN_ACCUMULATE
+#define	STRETCH_DIAGONAL_HESSIAN_ACCUMULATE(i1,o1,i2,o2,v) {}
+#undef	STRETCH_OFF_DIAGONAL_HESSIAN_ACCUMULATE
+#define	STRETCH_OFF_DIAGONAL_HESSIAN_ACCUMULATE(i1,o1,i2,o2,v) {}
+#define	STRETCH_CALC_FORCE
+#undef	STRETCH_CALC_DIAGONAL_HESSIAN  // Don't calculate the HESSIAN
+#undef	STRETCH_CALC_OFF_DIAGONAL_HESSIAN
+#undef	DECLARE_FLOAT
+#define	DECLARE_FLOAT(x) Real x = 0.0
+#pragma clang diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#include <cando/chem/energy_functions/_Stretch_termDeclares.cc>
+#pragma clang diagnostic pop
+#undef	DECLARE_FLOAT
+#define	DECLARE_FLOAT(x) num_real x = 0.0
+  Real x1,y1,z1,x2,y2,z2,kb,r0;
+  int I1, I2;
+#define STRETCH_DEBUG_INTERACTIONS(i1,i2)
+#pragma clang loop vectorize(enable)
+  for ( size_t i=0; i<numTerms; i++ ) {
+#include <cando/chem/energy_functions/_Stretch_termCode.cc>
+  }
+#undef STRETCH_DEBUG_INTERACTIONS
+#undef	STRETCH_CALC_FORCE
+  return totalEnergy.getSum();
+}
+
 CL_LAMBDA((energy-stretch chem:energy-stretch) pos &optional active-atom-mask);
 CL_DEFMETHOD void	EnergyStretch_O::compareAnalyticalAndNumericalForceAndHessianTermByTerm( NVector_sp 	pos, core::T_sp activeAtomMask )
 {
@@ -390,8 +444,31 @@ double EnergyStretch_O::evaluateAllComponent( ScoringFunction_sp score,
 #define STRETCH_CALC_FORCE
 #define STRETCH_CALC_DIAGONAL_HESSIAN
 #define STRETCH_CALC_OFF_DIAGONAL_HESSIAN
+  this->ensureCompiledTerms();
+  size_t numTerms = this->_CompiledTermIndex->length();
+  if (numTerms==0) {
+    maybeSetEnergy( componentEnergy, EnergyStretch_O::static_classSymbol(), totalEnergy );
+    return totalEnergy;
+  }
+  const float* compiled_kb = &(*this->_CompiledKb)[0];
+  const float* compiled_r0 = &(*this->_CompiledR0)[0];
+  const int32_t* compiled_I1 = &(*this->_CompiledI1)[0];
+  const int32_t* compiled_I2 = &(*this->_CompiledI2)[0];
+  const int32_t* compiled_index = &(*this->_CompiledTermIndex)[0];
+  if ( !calcForce && !hasActiveAtomMask && !doDebugInteractions && !this->_DebugEnergy ) {
+    totalEnergy = _evaluateCompiled_Stretch<double>(numTerms,compiled_kb,compiled_r0,compiled_I1,compiled_I2,&(*pos)[0],false,NULL);
+    maybeSetEnergy( componentEnergy, EnergyStretch_O::static_classSymbol(), totalEnergy );
+    return totalEnergy;
+  }
+  if ( this->_SinglePrecision && !calcDiagonalHessian && !calcOffDiagonalHessian
+       && !hasActiveAtomMask && !doDebugInteractions && !this->_DebugEnergy ) {
+    totalEnergy = _evaluateCompiled_Stretch<float>(numTerms,compiled_kb,compiled_r0,compiled_I1,compiled_I2,&(*pos)[0],
+                                                   calcForce&&hasForce, hasForce ? &(*force)[0] : NULL);
+    maybeSetEnergy( componentEnergy, EnergyStretch_O::static_classSymbol(), totalEnergy );
+    return totalEnergy;
+  }
 #undef	STRETCH_SET_PARAMETER
-#define	STRETCH_SET_PARAMETER(x)	{x = si->term.x;}
+#define	STRETCH_SET_PARAMETER(x)	{x = compiled_##x[i];}
 #undef	STRETCH_SET_POSITION
 #define	STRETCH_SET_POSITION(x,ii,of)	{x = pos->getElement(ii+of);}
 #undef	STRETCH_ENERGY_ACCUMULATE
@@ -410,10 +487,9 @@ double EnergyStretch_O::evaluateAllComponent( ScoringFunction_sp score,
   fx1 = 0.0; fy1 = 0.0; fz1 = 0.0;
   fx2 = 0.0; fy2 = 0.0; fz2 = 0.0;
   num_real x1,y1,z1,x2,y2,z2,kb,r0;
-  int I1, I2,i;
-  gctools::Vec0<EnergyStretch>::iterator si;
-  for ( i=0,si=this->_Terms.begin();
-        si!=this->_Terms.end(); si++,i++ ) {
+  int I1, I2;
+  size_t i;
+  for ( i=0; i<numTerms; i++ ) {
 #ifdef DEBUG_CONTROL_THE_NUMBER_OF_TERMS_EVALAUTED
     if ( this->_Debug_NumberOfTermsToCalculate > 0 ) {
       if ( i>= this->_Debug_NumberOfTermsToCalculate ) {
@@ -427,16 +503,17 @@ double EnergyStretch_O::evaluateAllComponent( ScoringFunction_sp score,
 #include <cando/chem/energy_functions/_Stretch_termCode.cc>
 
 #if TURN_ENERGY_FUNCTION_DEBUG_ON //[
-    si->_calcForce = calcForce;
-    si->_calcDiagonalHessian = calcDiagonalHessian;
-    si->_calcOffDiagonalHessian = calcOffDiagonalHessian;
+    EnergyStretch& entry = this->_Terms[compiled_index[i]];
+    entry._calcForce = calcForce;
+    entry._calcDiagonalHessian = calcDiagonalHessian;
+    entry._calcOffDiagonalHessian = calcOffDiagonalHessian;
 #undef EVAL_SET
-#define EVAL_SET(var,val) {si->eval.var=val;}
+#define EVAL_SET(var,val) {entry.eval.var=val;}
 #include <cando/chem/energy_functions/_Stretch_debugEvalSet.cc>
 #endif //]
     if ( this->_DebugEnergy ) {
       LOG_ENERGY(( "MEISTER stretch %d args cando\n") , (i+1) );
-      LOG_ENERGY(( "MEISTER stretch %d address %x \n") , (i+1) , (&(*si)) );
+      LOG_ENERGY(( "MEISTER stretch %d term %d \n") , (i+1) , compiled_index[i] );
       LOG_ENERGY(( "MEISTER stretch %d r0 %5.3lf\n") , (i+1) , r0 );
       LOG_ENERGY(( "MEISTER stretch %d kb %5.1lf\n") , (i+1) , kb );
       LOG_ENERGY(( "MEISTER stretch %d x1 %5.3lf %d\n") , (i+1) , x1 , (I1/3+1) );
@@ -597,6 +674,36 @@ void EnergyStretch_O::fields(core::Record_sp node)
 void EnergyStretch_O::addTerm(const EnergyStretch& term)
 {
   this->_Terms.push_back(term);
+  this->invalidateCompiledTerms();
+}
+
+void EnergyStretch_O::compileTerms()
+{
+  size_t num = this->_Terms.size();
+  std::vector<int32_t> order(num);
+  for ( size_t ii=0; ii<num; ++ii ) order[ii] = ii;
+  // Sort on the lower then the higher coordinate index so that consecutive terms
+  // touch neighbouring coordinates
+  std::stable_sort(order.begin(),order.end(),[this] (int32_t a, int32_t b) {
+    const TermStretch& ta = this->_Terms[a].term;
+    const TermStretch& tb = this->_Terms[b].term;
+    return std::make_pair(std::min(ta.I1,ta.I2),std::max(ta.I1,ta.I2))
+      < std::make_pair(std::min(tb.I1,tb.I2),std::max(tb.I1,tb.I2));
+  });
+  this->_CompiledKb = core::SimpleVector_float_O::make(num);
+  this->_CompiledR0 = core::SimpleVector_float_O::make(num);
+  this->_CompiledI1 = core::SimpleVector_int32_t_O::make(num);
+  this->_CompiledI2 = core::SimpleVector_int32_t_O::make(num);
+  this->_CompiledTermIndex = core::SimpleVector_int32_t_O::make(num);
+  for ( size_t ii=0; ii<num; ++ii ) {
+    const TermStretch& term = this->_Terms[order[ii]].term;
+    (*this->_CompiledKb)[ii] = term.kb;
+    (*this->_CompiledR0)[ii] = term.r0;
+    (*this->_CompiledI1)[ii] = term.I1;
+    (*this->_CompiledI2)[ii] = term.I2;
+    (*this->_CompiledTermIndex)[ii] = order[ii];
+  }
+  this->_CompiledTermsValid = true;
 }
 
 string EnergyStretch_O::beyondThresholdInteractionsAsString()
@@ -656,6 +763,7 @@ CL_DEFMETHOD void EnergyStretch_O::fill_from_vectors_in_alist(core::List_sp vect
     entry._Atom1 = gc::As_unsafe<Atom_sp>((*atom1_vec)[i]);
     entry._Atom2 = gc::As_unsafe<Atom_sp>((*atom2_vec)[i]);
   }
+  this->invalidateCompiledTerms();
 }
 
 CL_DEFMETHOD void EnergyStretch_O::addStretchTerm(AtomTable_sp atomTable, Atom_sp a1, Atom_sp a2, double kb, double r0) {
@@ -687,6 +795,7 @@ CL_DEFMETHOD void EnergyStretch_O::modifyStretchTermKb(size_t index, float kb) {
   if (index<this->_Terms.size()) {
     EnergyStretch& entry = this->_Terms[index];
     entry.term.kb = kb;
+    this->invalidateCompiledTerms();
     return;
   }
   SIMPLE_ERROR("index {} is out of bounds as a energy-stretch term index (#entries {})" , index , this->_Terms.size() );
@@ -696,6 +805,7 @@ CL_DEFMETHOD void EnergyStretch_O::modifyStretchTermR0(size_t index, float r0) {
   if (index<this->_Terms.size()) {
     EnergyStretch& entry = this->_Terms[index];
     entry.term.r0 = r0;
+    this->invalidateCompiledTerms();
     return;
   }
   SIMPLE_ERROR("index {} is out of bounds as a energy-stretch term index (#entries {})" , index , this->_Terms.size() );
@@ -704,6 +814,7 @@ CL_DEFMETHOD void EnergyStretch_O::modifyStretchTermR0(size_t index, float r0) {
 void EnergyStretch_O::reset()
 {
   this->_Terms.clear();
+  this->invalidateCompiledTerms();
 }
 
 CL_DEFMETHOD
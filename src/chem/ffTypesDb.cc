@@ -87,6 +87,14 @@ Root_sp FFTypeRule_O::getTest() const
   return this->_Test;
 }
 
+bool FFTypeRule_O::matches(Atom_sp atom, MoleculeInvariants_sp invariants)
+{
+  if (this->_Compiled.unboundp()) {
+    this->_Compiled = CompiledChemInfo_O::compileRoot(this->_Test);
+  }
+  return CompiledChemInfo_O::matchesAtom(this->_Test, this->_Compiled, invariants, atom);
+}
+
 
 SYMBOL_EXPORT_SC_(ChemPkg,assignType);
 
@@ -120,6 +128,18 @@ CL_DEFMETHOD core::Symbol_sp FFTypesDb_O::assignType(chem::Atom_sp atom) {
 }
 
 
+core::T_sp FFTypesDb_O::assignTypeUsingInvariants(chem::Atom_sp atom, MoleculeInvariants_sp invariants) {
+  for ( auto it=this->_TypeAssignmentRules.begin();
+        it!=this->_TypeAssignmentRules.end(); it++ ) {
+    if ((*it)->matches(atom,invariants)) {
+      if (chem__verbose(2)) core::clasp_write_string(fmt::format("Matched {} type-> {}\n" , _rep_((*it)->_Test) , _rep_((*it)->_Type)));
+      return (*it)->_Type;
+    }
+  }
+  return nil<core::T_O>();
+}
+
+
 CL_LISPIFY_NAME("assignTypes");
 CL_DEFMETHOD core::HashTable_sp FFTypesDb_O::assignTypes(chem::Matter_sp matter, core::HashTable_sp atom_types )
 { 
@@ -133,6 +153,7 @@ CL_DEFMETHOD core::HashTable_sp FFTypesDb_O::assignTypes(chem::Matter_sp matter,
   core::HashTable_sp                            atomTypes;
   size_t missing_types = 0;
   size_t total_atoms = 0;
+  core::T_sp invariants = nil<core::T_O>();
 
   // first clear out old atom types
   lAtoms.loopTopGoal(matter,ATOMS);
@@ -196,7 +217,10 @@ CL_DEFMETHOD core::HashTable_sp FFTypesDb_O::assignTypes(chem::Matter_sp matter,
       atom = lAtoms.getAtom();
       if (atom->getType(atom_types).nilp()) {
         if (this->_TypeAssignmentRules.size()!=0) {
-          core::T_sp type = this->assignType(atom);
+          if (invariants.nilp()) {
+            invariants = MoleculeInvariants_O::make(chem__make_molecule_graph_from_molecule(matter,false));
+          }
+          core::T_sp type = this->assignTypeUsingInvariants(atom,gc::As_unsafe<MoleculeInvariants_sp>(invariants));
           if (chem__verbose(2)) {
             core::clasp_write_string(fmt::format("Assigned atom type {} using type rules\n" , _rep_(type)));
           }
@@ -229,12 +253,13 @@ CL_DEFMETHOD core::HashTableEq_sp    FFTypesDb_O::atomTypes(chem::Matter_sp matt
   chem::Atom_sp  				atom;
   core::HashTableEq_sp atomTypes = core::HashTableEq_O::create_default();
   if (this->_TypeAssignmentRules.size()==0)  return atomTypes;
+  MoleculeInvariants_sp invariants = MoleculeInvariants_O::make(chem__make_molecule_graph_from_molecule(matter,false));
   lAtoms.loopTopGoal(matter,ATOMS);
   LOG("defined loop" );
   while ( lAtoms.advanceLoopAndProcess() ) {
     LOG("Getting container" );
     atom = lAtoms.getAtom();
-    core::Symbol_sp type = this->assignType(atom);
+    core::T_sp type = this->assignTypeUsingInvariants(atom,invariants);
     atomTypes->setf_gethash(atom,type);
   }
   return atomTypes;
@@ -0,0 +1,230 @@
+/*
+    File: matterGraph.cc
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+#define	DEBUG_LEVEL_NONE
+
+#include <clasp/core/foundation.h>
+#include <clasp/core/array.h>
+#include <clasp/core/evaluator.h>
+#include <clasp/core/hashTableEq.h>
+#include <cando/chem/matterGraph.h>
+#include <cando/chem/ringPerception.h>
+#include <cando/chem/atom.h>
+#include <cando/chem/virtualAtom.h>
+#include <cando/chem/bond.h>
+#include <cando/chem/loop.h>
+#include <clasp/core/wrappers.h>
+
+namespace chem {
+
+CL_LAMBDA(matter &key exclude-hydrogens exclude-virtual-atoms);
+CL_DOCSTRING(R"dx(Take an immutable snapshot of the bonds of the molecule or aggregate matter as a
+compressed sparse row graph with dense atom indices.  When exclude-hydrogens is true the hydrogens
+and their bonds are left out and when exclude-virtual-atoms is true so are the virtual atoms.
+The snapshot does not change when bonds are added or removed later.)dx");
+CL_LISPIFY_NAME(make_matter_graph);
+CL_DEF_CLASS_METHOD MatterGraph_sp MatterGraph_O::make(Matter_sp matter, bool excludeHydrogens, bool excludeVirtualAtoms)
+{
+  auto me = gctools::GC<MatterGraph_O>::allocate_with_default_constructor();
+  me->_AtomToIndex = core::HashTableEq_O::create_default();
+  {
+    Loop loop;
+    loop.loopTopGoal(matter,ATOMS);
+    while ( loop.advance() ) {
+      Atom_sp atom = loop.getAtom();
+      if (excludeHydrogens && atom->getElement() == element_H) continue;
+      if (excludeVirtualAtoms && atom.isA<VirtualAtom_O>()) continue;
+      me->_AtomToIndex->setf_gethash(atom,core::make_fixnum(me->_Atoms.size()));
+      me->_Atoms.push_back(atom);
+      me->_AtomicNumbers.push_back(atom->getAtomicNumber());
+    }
+  }
+  me->_NeighborStart.push_back(0);
+  for ( size_t ai=0; ai<me->_Atoms.size(); ++ai ) {
+    Atom_sp atom = me->_Atoms[ai];
+    for ( int bi=0; bi<atom->numberOfBonds(); ++bi ) {
+      core::T_sp other = me->_AtomToIndex->gethash(atom->bondedNeighbor(bi));
+      if (!other.fixnump()) continue;
+      me->_Neighbors.push_back(other.unsafe_fixnum());
+      me->_BondOrders.push_back(atom->bondedOrder(bi));
+    }
+    me->_NeighborStart.push_back(me->_Neighbors.size());
+  }
+  return me;
+}
+
+CL_DOCSTRING(R"dx(Return the atom with the index.)dx");
+CL_DEFMETHOD Atom_sp MatterGraph_O::atom(size_t index) const
+{
+  if (index >= this->_Atoms.size()) SIMPLE_ERROR("Atom index {} is out of range - there are {} atoms", index, this->_Atoms.size());
+  return this->_Atoms[index];
+}
+
+CL_DOCSTRING(R"dx(Return the index of atom or NIL if it isn't in the graph.)dx");
+CL_DEFMETHOD core::T_sp MatterGraph_O::atomIndex(Atom_sp atom) const
+{
+  return this->_AtomToIndex->gethash(atom);
+}
+
+CL_DEFMETHOD int MatterGraph_O::atomicNumber(size_t index) const
+{
+  if (index >= this->_Atoms.size()) SIMPLE_ERROR("Atom index {} is out of range - there are {} atoms", index, this->_Atoms.size());
+  return this->_AtomicNumbers[index];
+}
+
+CL_DOCSTRING(R"dx(Return the indices of the atoms bonded to the atom with the index.)dx");
+CL_DEFMETHOD core::List_sp MatterGraph_O::neighborsAsList(size_t index) const
+{
+  if (index >= this->_Atoms.size()) SIMPLE_ERROR("Atom index {} is out of range - there are {} atoms", index, this->_Atoms.size());
+  ql::list result;
+  for ( const uint32_t* cur=this->neighborsBegin(index); cur!=this->neighborsEnd(index); ++cur ) result << core::make_fixnum(*cur);
+  return result.cons();
+}
+
+CL_DOCSTRING(R"dx(Call function with (atom1 atom2 bond-order) once for every bond of the graph.)dx");
+CL_DEFMETHOD void MatterGraph_O::mapBonds(core::T_sp function) const
+{
+  core::Function_sp func = core::coerce::functionDesignator(function);
+  for ( size_t ai=0; ai<this->_Atoms.size(); ++ai ) {
+    for ( size_t edge=this->_NeighborStart[ai]; edge<this->_NeighborStart[ai+1]; ++edge ) {
+      size_t other = this->_Neighbors[edge];
+      if (other < ai) continue;
+      core::eval::funcall(func,this->_Atoms[ai],this->_Atoms[other],
+                          translate::to_object<BondOrder>::convert(this->bondOrder(edge)));
+    }
+  }
+}
+
+size_t MatterGraph_O::connectedComponents(std::vector<uint32_t>& component) const
+{
+  size_t numAtoms = this->_Atoms.size();
+  const uint32_t unvisited = ~(uint32_t)0;
+  component.assign(numAtoms,unvisited);
+  std::vector<uint32_t> stack;
+  size_t numComponents = 0;
+  for ( size_t start=0; start<numAtoms; ++start ) {
+    if (component[start] != unvisited) continue;
+    component[start] = numComponents;
+    stack.push_back(start);
+    while (!stack.empty()) {
+      uint32_t ai = stack.back();
+      stack.pop_back();
+      for ( const uint32_t* cur=this->neighborsBegin(ai); cur!=this->neighborsEnd(ai); ++cur ) {
+        if (component[*cur] != unvisited) continue;
+        component[*cur] = numComponents;
+        stack.push_back(*cur);
+      }
+    }
+    ++numComponents;
+  }
+  return numComponents;
+}
+
+CL_DOCSTRING(R"dx(Return (values components count) - a vector of the connected component of every atom
+and the number of connected components.)dx");
+CL_DEFMETHOD core::T_mv MatterGraph_O::connectedComponentsAsVector() const
+{
+  std::vector<uint32_t> component;
+  size_t count = this->connectedComponents(component);
+  core::SimpleVector_int32_t_sp result = core::SimpleVector_int32_t_O::make(component.size());
+  for ( size_t ii=0; ii<component.size(); ++ii ) (*result)[ii] = component[ii];
+  return Values(result,core::make_fixnum(count));
+}
+
+void MatterGraph_O::breadthFirst(size_t root, size_t maxDepth, std::vector<int32_t>& distance,
+                                 std::vector<uint32_t>& order, std::vector<uint32_t>& parent) const
+{
+  if (root >= this->_Atoms.size()) SIMPLE_ERROR("Atom index {} is out of range - there are {} atoms", root, this->_Atoms.size());
+  distance.assign(this->_Atoms.size(),-1);
+  parent.assign(this->_Atoms.size(),root);
+  order.clear();
+  distance[root] = 0;
+  order.push_back(root);
+  for ( size_t head=0; head<order.size(); ++head ) {
+    uint32_t ai = order[head];
+    if ((size_t)distance[ai] >= maxDepth) continue;
+    for ( const uint32_t* cur=this->neighborsBegin(ai); cur!=this->neighborsEnd(ai); ++cur ) {
+      if (distance[*cur] >= 0) continue;
+      distance[*cur] = distance[ai]+1;
+      parent[*cur] = ai;
+      order.push_back(*cur);
+    }
+  }
+}
+
+CL_DOCSTRING(R"dx(Return a vector of the number of bonds between the atom with index root and every atom.
+Atoms that can't be reached from root get -1.)dx");
+CL_DEFMETHOD core::SimpleVector_int32_t_sp MatterGraph_O::distancesAsVector(size_t root) const
+{
+  std::vector<int32_t> distance;
+  std::vector<uint32_t> order, parent;
+  this->breadthFirst(root,this->_Atoms.size(),distance,order,parent);
+  core::SimpleVector_int32_t_sp result = core::SimpleVector_int32_t_O::make(distance.size());
+  for ( size_t ii=0; ii<distance.size(); ++ii ) (*result)[ii] = distance[ii];
+  return result;
+}
+
+CL_LAMBDA((matter-graph chem:matter-graph) root &optional max-depth);
+CL_DOCSTRING(R"dx(Return (values atoms parents) for a breadth first spanning tree from the atom with index root
+like chem:spanning-loop.  atoms is a list of the atoms in the order they are reached and parents is a
+list of the atom each was reached from (root is its own parent).  When max-depth is given atoms more than
+max-depth bonds from root are left out.)dx");
+CL_DEFMETHOD core::T_mv MatterGraph_O::spanningTree(size_t root, core::T_sp maxDepth) const
+{
+  std::vector<int32_t> distance;
+  std::vector<uint32_t> order, parent;
+  size_t depth = maxDepth.notnilp() ? core::clasp_to_size(maxDepth) : this->_Atoms.size();
+  this->breadthFirst(root,depth,distance,order,parent);
+  ql::list atoms;
+  ql::list parents;
+  for ( uint32_t ai : order ) {
+    atoms << this->_Atoms[ai];
+    parents << this->_Atoms[parent[ai]];
+  }
+  return Values(atoms.cons(),parents.cons());
+}
+
+CL_LAMBDA((matter-graph chem:matter-graph) &optional relevant);
+CL_DOCSTRING(R"dx(Return the smallest set of smallest rings or, when relevant is true, the relevant cycles
+of the graph as a list of lists of atoms in ring order.)dx");
+CL_DEFMETHOD core::List_sp MatterGraph_O::rings(bool relevant) const
+{
+  RingPerception perception(this->_Atoms.size());
+  for ( size_t ai=0; ai<this->_Atoms.size(); ++ai ) {
+    for ( const uint32_t* cur=this->neighborsBegin(ai); cur!=this->neighborsEnd(ai); ++cur ) {
+      if (*cur > ai) perception.addEdge(ai,*cur);
+    }
+  }
+  perception.perceive(relevant);
+  const std::vector<RingPerception::Cycle>& cycles = relevant ? perception.relevantCycles() : perception.sssr();
+  core::List_sp rings = nil<core::T_O>();
+  for ( auto& cycle : cycles ) {
+    ql::list ring;
+    for ( size_t index : cycle ) ring << this->_Atoms[index];
+    rings = core::Cons_O::create(ring.cons(),rings);
+  }
+  return rings;
+}
+
+};
@@ -0,0 +1,215 @@
+/*
+    File: matterTemplate.cc
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+/* -^- */
+#define	DEBUG_LEVEL_NONE
+
+#include <clasp/core/foundation.h>
+#include <clasp/core/common.h>
+#include <clasp/core/array.h>
+#include <clasp/core/hashTableEq.h>
+#include <cando/chem/matterTemplate.h>
+#include <cando/chem/aggregate.h>
+#include <cando/chem/molecule.h>
+#include <cando/chem/residue.h>
+#include <cando/chem/atom.h>
+#include <cando/chem/bond.h>
+#include <cando/chem/nVector.h>
+#include <cando/geom/omatrix.h>
+#include <clasp/core/wrappers.h>
+
+namespace chem {
+
+CL_LAMBDA(molecule);
+CL_DOCSTRING(R"dx(Capture molecule as a template that matter-template-instantiate and
+matter-template-instantiate-into can copy many times quickly.  The template keeps its own copy of
+molecule so later changes to molecule are not seen by the template.)dx");
+CL_LISPIFY_NAME(make_matter_template);
+CL_DEF_CLASS_METHOD MatterTemplate_sp MatterTemplate_O::make(Molecule_sp molecule)
+{
+  auto me = gctools::GC<MatterTemplate_O>::allocate_with_default_constructor();
+  me->_Molecule = gc::As<Molecule_sp>(molecule->copy(nil<core::T_O>()));
+  me->_HasRestraints = me->_Molecule->allRestraints().notnilp();
+  core::HashTableEq_sp atomToIndex = core::HashTableEq_O::create_default();
+  me->_ResidueStart.push_back(0);
+  for ( size_t resi=0, endResi(me->_Molecule->contentSize()); resi<endResi; ++resi ) {
+    Residue_sp res = gc::As<Residue_sp>(me->_Molecule->contentAt(resi));
+    me->_Residues.push_back(res);
+    for ( size_t ati=0, endAti(res->contentSize()); ati<endAti; ++ati ) {
+      Atom_sp atom = gc::As<Atom_sp>(res->contentAt(ati));
+      // Instances are shallow copies of the prototype atoms - don't let them keep old copies alive
+      atom->_CopyAtom = unbound<Atom_O>();
+      atomToIndex->setf_gethash(atom,core::make_fixnum(me->_Atoms.size()));
+      me->_Atoms.push_back(atom);
+      const Vector3& pos = atom->getPosition();
+      me->_Coordinates.push_back(pos.getX());
+      me->_Coordinates.push_back(pos.getY());
+      me->_Coordinates.push_back(pos.getZ());
+    }
+    me->_ResidueStart.push_back(me->_Atoms.size());
+  }
+  core::HashTableEq_sp bondToIndex = core::HashTableEq_O::create_default();
+  me->_AtomBondStart.push_back(0);
+  for ( size_t ai=0; ai<me->_Atoms.size(); ++ai ) {
+    Atom_sp atom = me->_Atoms[ai];
+    for ( auto bond : atom->_Bonds ) {
+      core::T_sp index = bondToIndex->gethash(bond);
+      if (!index.fixnump()) {
+        core::T_sp index1 = atomToIndex->gethash(bond->_Atom1);
+        core::T_sp index2 = atomToIndex->gethash(bond->_Atom2);
+        if (!index1.fixnump() || !index2.fixnump()) {
+          SIMPLE_ERROR("The bond {} of {} leaves the molecule {}", _rep_(bond), _rep_(atom), _rep_(molecule));
+        }
+        index = core::make_fixnum(me->_Bonds.size());
+        bondToIndex->setf_gethash(bond,index);
+        me->_Bonds.push_back(bond);
+        me->_BondAtoms.push_back(index1.unsafe_fixnum());
+        me->_BondAtoms.push_back(index2.unsafe_fixnum());
+      }
+      me->_AtomBonds.push_back(index.unsafe_fixnum());
+    }
+    me->_AtomBondStart.push_back(me->_AtomBonds.size());
+  }
+  return me;
+}
+
+Molecule_sp MatterTemplate_O::instantiate(const Matrix* transform, const Vector_real* coordinates) const
+{
+  auto place = [&] (Atom_sp atom, size_t ai) {
+    if (coordinates) {
+      atom->setPosition(Vector3(coordinates[ai*3],coordinates[ai*3+1],coordinates[ai*3+2]));
+    } else if (transform) {
+      Vector3 pos(this->_Coordinates[ai*3],this->_Coordinates[ai*3+1],this->_Coordinates[ai*3+2]);
+      if (pos.isDefined()) atom->setPosition((*transform)*pos);
+    }
+  };
+  if (this->_HasRestraints) {
+    Molecule_sp mol = gc::As<Molecule_sp>(this->_Molecule->copy(nil<core::T_O>()));
+    if (coordinates || transform) {
+      size_t ai = 0;
+      for ( size_t resi=0, endResi(mol->contentSize()); resi<endResi; ++resi ) {
+        Residue_sp res = gc::As_unsafe<Residue_sp>(mol->contentAt(resi));
+        for ( size_t ati=0, endAti(res->contentSize()); ati<endAti; ++ati ) {
+          place(gc::As_unsafe<Atom_sp>(res->contentAt(ati)),ai++);
+        }
+      }
+    }
+    return mol;
+  }
+  auto mol = gctools::GC<Molecule_O>::copy(*this->_Molecule);
+  mol->eraseContents();
+  mol->reserveContents(this->_Residues.size());
+  gctools::Vec0<Atom_sp> atoms;
+  atoms.reserve(this->_Atoms.size());
+  for ( size_t resi=0; resi<this->_Residues.size(); ++resi ) {
+    auto res = gctools::GC<Residue_O>::copy(*this->_Residues[resi]);
+    res->eraseContents();
+    res->reserveContents(this->_ResidueStart[resi+1]-this->_ResidueStart[resi]);
+    for ( size_t ai=this->_ResidueStart[resi]; ai<this->_ResidueStart[resi+1]; ++ai ) {
+      const Atom_sp& proto = this->_Atoms[ai];
+      auto atom = gctools::GC<Atom_O>::copy(*proto);
+      atom->_Bonds.clear();
+      atom->_Bonds.reserve(this->_AtomBondStart[ai+1]-this->_AtomBondStart[ai]);
+      if (proto->getProperties().notnilp()) {
+        atom->setProperties(core::cl__copy_seq(proto->getProperties()));
+      }
+      place(atom,ai);
+      res->addMatter(atom);
+      atoms.push_back(atom);
+    }
+    mol->addMatter(res);
+  }
+  gctools::Vec0<Bond_sp> bonds;
+  bonds.reserve(this->_Bonds.size());
+  for ( size_t bi=0; bi<this->_Bonds.size(); ++bi ) {
+    auto bond = gctools::GC<Bond_O>::copy(*this->_Bonds[bi]);
+    bond->_Atom1 = atoms[this->_BondAtoms[bi*2]];
+    bond->_Atom2 = atoms[this->_BondAtoms[bi*2+1]];
+    bonds.push_back(bond);
+  }
+  for ( size_t ai=0; ai<atoms.size(); ++ai ) {
+    for ( size_t cur=this->_AtomBondStart[ai]; cur<this->_AtomBondStart[ai+1]; ++cur ) {
+      atoms[ai]->addBond(bonds[this->_AtomBonds[cur]]);
+    }
+  }
+  return mol;
+}
+
+Molecule_sp MatterTemplate_O::instantiateTranslated(const Vector3& offset) const
+{
+  Matrix transform;
+  transform.translate(offset);
+  return this->instantiate(&transform,NULL);
+}
+
+CL_LAMBDA((template chem:matter-template) &optional transform);
+CL_DOCSTRING(R"dx(Return a new copy of the template molecule.  If transform (a geom:m4) is given the
+atoms are moved by it, otherwise they keep the positions of the template.)dx");
+CL_DEFMETHOD Molecule_sp MatterTemplate_O::instantiateWithTransform(core::T_sp transform) const
+{
+  if (transform.nilp()) return this->instantiate(NULL,NULL);
+  geom::OMatrix_sp mtransform = gc::As<geom::OMatrix_sp>(transform);
+  return this->instantiate(&mtransform->ref(),NULL);
+}
+
+CL_LAMBDA((template chem:matter-template) aggregate placements);
+CL_DOCSTRING(R"dx(Add copies of the template molecule to aggregate and return a list of them.
+placements is either a list of geom:m4 transforms, one copy is made for every transform, or an
+nvector holding x,y,z for every template atom of one or more copies back to back.)dx");
+CL_DEFMETHOD core::List_sp MatterTemplate_O::instantiateInto(Aggregate_sp aggregate, core::T_sp placements) const
+{
+  ql::list result;
+  if (gc::IsA<NVector_sp>(placements)) {
+    NVector_sp coordinates = gc::As_unsafe<NVector_sp>(placements);
+    size_t stride = this->_Atoms.size()*3;
+    if (stride == 0 || coordinates->length()%stride != 0) {
+      SIMPLE_ERROR("The length of the coordinates {} must be a multiple of three times the number of template atoms {}",
+                   coordinates->length(), this->_Atoms.size());
+    }
+    size_t instances = coordinates->length()/stride;
+    aggregate->reserveContents(aggregate->contentSize()+instances);
+    for ( size_t ii=0; ii<instances; ++ii ) {
+      Molecule_sp mol = this->instantiate(NULL,&(*coordinates)[ii*stride]);
+      aggregate->addMatter(mol);
+      result << mol;
+      gctools::handle_all_queued_interrupts();
+    }
+    return result.cons();
+  }
+  if (!placements.consp()) {
+    SIMPLE_ERROR("placements must be a list of transforms or an nvector of coordinates - got {}", _rep_(placements));
+  }
+  core::List_sp transforms = gc::As<core::List_sp>(placements);
+  aggregate->reserveContents(aggregate->contentSize()+core::cl__length(transforms));
+  for ( auto cur : transforms ) {
+    geom::OMatrix_sp transform = gc::As<geom::OMatrix_sp>(CONS_CAR(cur));
+    Molecule_sp mol = this->instantiate(&transform->ref(),NULL);
+    aggregate->addMatter(mol);
+    result << mol;
+    gctools::handle_all_queued_interrupts();
+  }
+  return result.cons();
+}
+
+};
@@ -966,8 +966,10 @@ REGISTER_CLASS_NAME(char, "char");
 #define HEADER_DEFAAFC421A53A4F
 
 #include <thread>
+#include <atomic>
+#include <limits>
 #include <memory>
-#include <deque> // TODO: test deque vs. vector for storing a queue of jobs
+#include <deque>
 
 
 using std::swap;
@@ -1006,21 +1008,12 @@ public:
     typedef InitialSort_t<Sort_t> InitialSorter;
     typedef typename Sorter::NumberedSet NumberedSet;
     
-    struct Job {
-        VertexSet c;            // current clique
-        VertexSet vertices;     // available vertices
-        NumberedSet numbers;    // available vertices
-        unsigned int estimatedMax;       // used to queue jobs from the most perspective down to the least perspective
-        
-        Job()  {}
-        Job(const VertexSet& cin, const VertexSet& vin, const NumberedSet& nin, int estimate) : c(cin), vertices(vin), numbers(nin), estimatedMax(estimate)  {}
-        void set(const VertexSet& cin, const VertexSet& vin, const NumberedSet& nin, int estimate) {c = cin; vertices = vin; numbers = nin; estimatedMax = estimate;}
-        friend void swap(Job& a, Job& b) {
-            std::swap(a.c, b.c); 
-            std::swap(a.vertices, b.vertices);
-            std::swap(a.numbers, b.numbers);
-            std::swap(a.estimatedMax, b.estimatedMax);
-        }
+    // A top-level branch of the search tree: the vertex that seeds the clique and the colour bound
+    // the root loop had when that vertex was taken.  Branches are numbered in the order the serial
+    // search would visit them; that index is also used to break ties between equally large cliques.
+    struct Branch {
+        VertexId vertex;
+        unsigned int bound;
     };
 
     struct Worker : Sorter {
@@ -1033,10 +1026,9 @@ public:
         Graph* graph;
         // id of the worker (helps with the end-time statistics)
         int id;
-        // copy of parent maxSize (size of the active maximumClique)
-        unsigned int localMaxSize;
-        // break the work on a job when going below the specified level (size of a clique); search will not continue on a level lower than jobLevelBreak
-        unsigned int jobLevelBreak;
+        // branches waiting to be searched; the owner takes from the front, other workers steal from the back
+        std::deque<size_t> branches;
+        std::mutex mutexBranches;
         
         using Sorter::notEmpty;
         using Sorter::topNumber;
@@ -1054,74 +1046,37 @@ public:
             steps = 0;
         }
         
+        bool takeOwn(size_t& branch) {
+            std::lock_guard<std::mutex> lk(mutexBranches);
+            if (branches.empty()) return false;
+            branch = branches.front();
+            branches.pop_front();
+            return true;
+        }
+        
+        bool steal(size_t& branch) {
+            std::lock_guard<std::mutex> lk(mutexBranches);
+            if (branches.empty()) return false;
+            branch = branches.back();
+            branches.pop_back();
+            return true;
+        }
+        
         void threadFunc() {
-            localMaxSize = parent->maxSize;
             TRACE("threadFunc start", TRACE_MASK_THREAD, 1);
-            [[maybe_unused]]int jobsDone = 0;
             try {
                 { // this scope is for the scope timer in the next line: the scope must end before the function sends the results to the parent thread
                     ScopeTimer t(timer);
-                    // work while there are jobs available
-                    TRACE("threadFunc: getting a job", TRACE_MASK_THREAD, 1);
-                    while (true) {
-                        Job job;
-                        // grab a job from the queue
-                        {  
-                            std::lock_guard<std::mutex> lk(parent->mutexJobs); 
-                            TRACEVAR(parent->activeJobs, TRACE_MASK_THREAD, 2);
-                            // if there is no queued jobs then wait; if there is also no active jobs (that would be adding to the queue) then quit
-                            if (parent->jobs.size() == 0) {
-                                /*
-                                // when dynamic tree splitting is used, try the following:
-                                if (parent->activeJobs == 0)
-                                    break;
-                                else
-                                    continue;
-                                    */
-                                break;
-                            }
-                            
-                            // take a job from the top of the queue, check if a new job can be added to the queue immediately 
-                            if ((parent->jobs.size() > parent->maxJobs) || (parent->jobs.back().estimatedMax <= localMaxSize + 5)) {
-                                // job on the queue is a small one; do not split it further (5 - the number to check against - is arbitrary)
-                                // (swap is the fastest operation, job is empty now)
-                                swap(job, parent->jobs.back());
-                                parent->jobs.pop_back();
-                                parent->requireMoreJobs = true;
-                                // mark where to end execution
-                                jobLevelBreak = job.c.size();
-                            } else {
-                                // copy the job out of the queue
-                                job = parent->jobs.back();
-                                // change the job in the queue to make it available for another worker
-                                this->popTop(parent->jobs.back().numbers, parent->jobs.back().vertices);
-                                parent->jobs.back().estimatedMax = topNumber(parent->jobs.back().numbers) + parent->jobs.back().c.size();
-                                // mark where to end execution
-                                jobLevelBreak = job.c.size()+1;
-                            }
-                            // mark that another job has been activated
-                            ++parent->activeJobs;
-                        }
-                        TRACE("threadFunc: calling expand", TRACE_MASK_THREAD, 1);
-                        // work on the job
-                        {
-                            TRACEVAR(jobLevelBreak, TRACE_MASK_THREAD, 1);
-                            // dig in
-                            expand(job);
-                            ++jobsDone;
-                        }
-                        TRACE("threadFunc: job completed", TRACE_MASK_THREAD, 1);
-                        // deactivate the completed job
-                        {
-                            std::lock_guard<std::mutex> lk(parent->mutexJobs);
-                            --parent->activeJobs;
-                        }
+                    size_t branch;
+                    while (parent->nextBranch(id, branch)) {
+                        TRACEVAR(branch, TRACE_MASK_THREAD, 2);
+                        searchBranch(branch);
                     }
                 } // timer scope end           
                 // send statistics to the parent
                 {
                     TRACE("threadFunc: reposting stats", TRACE_MASK_THREAD, 1);
-                    std::lock_guard<std::mutex> lk(parent->mutexJobs); 
+                    std::lock_guard<std::mutex> lk(parent->mutexQ); 
                     parent->workerActiveTimes.push_back(timer.totalSeconds());
                     parent->workerSteps.push_back(steps);
                 }
@@ -1130,71 +1085,48 @@ public:
             }
         }
         
-        // main recursive function (parallel)
-        void expand(Job& job) {
+        void searchBranch(size_t branch) {
+            const Branch& b = parent->branches[branch];
+            if (parent->killTimer.timedOut || !parent->improves(b.bound, branch)) return;
+            VertexSet c;
+            c.reserve(parent->n);
+            c.add(b.vertex);
+            VertexSet p1;
+            parent->branchCandidates(branch, p1);
+            if (p1.size() == 0) {
+                if (parent->improves(c.size(), branch))
+                    parent->saveSolution(c, branch);
+            } else {
+                NumberedSet np1;
+                numberSort(c, p1, np1, parent->colorBound(branch));
+                expand(c, p1, np1, branch);
+            }
+        }
+        
+        // main recursive function (parallel); same as MaximumCliqueProblem::expand except that the
+        // bound is checked against the shared incumbent, so every worker prunes with the best clique found so far
+        void expand(VertexSet& c, VertexSet& p, NumberedSet& np, size_t branch) {
             ++steps;
-            TRACE("expand start", TRACE_MASK_CLIQUE, 2);
-            
-            localMaxSize = parent->maxSize;
-            TRACEVAR(localMaxSize, TRACE_MASK_CLIQUE, 2);
-            while (notEmpty(job.numbers)) {
-                TRACEVAR(job.numbers.size(), TRACE_MASK_CLIQUE, 2);
-                if (job.estimatedMax <= localMaxSize || parent->killTimer.timedOut) {return;}
-                Job newJob;
-                auto v = topVertex(job.numbers, job.vertices);
-                popTop(job.numbers, job.vertices);
-                job.estimatedMax = job.c.size() + topNumber(job.numbers);
-                graph->intersectWithNeighbours(v, job.vertices, newJob.vertices);
+            while (notEmpty(np)) {
+                if (parent->killTimer.timedOut || !parent->improves(c.size() + topNumber(np), branch)) {return;}
+                auto v = topVertex(np, p);
+                c.add(v);
+                VertexSet p1;
+                graph->intersectWithNeighbours(v, p, p1);
                 
-                newJob.c = job.c;
-                newJob.c.add(v);
-                if (newJob.c.size() > localMaxSize) { // condition (newJob.vertices.size() == 0) is left out to make maxSize up to date at all times
-                    localMaxSize = parent->saveSolution(newJob.c);
+                if (p1.size() == 0) {
+                    if (parent->improves(c.size(), branch))
+                        parent->saveSolution(c, branch);
+                } else {
+                    NumberedSet np1;
+                    numberSort(c, p1, np1, parent->colorBound(branch));
+                    // numberSort drops every vertex that cannot beat the incumbent, so np1 may be empty
+                    expand(c, p1, np1, branch);
                 }
                 
-                TRACEVAR(newJob.vertices.size(), TRACE_MASK_CLIQUE, 2);
-                if (newJob.vertices.size() > 0) {
-                    // number vertices
-//                    std::cout << "DBG " << std::flush;
-                    newJob.numbers.resize(newJob.vertices.size());
-//                    std::cout << "DBG " << newJob.c.size() << " " << newJob.vertices.size() << " " << newJob.numbers.size() << " " << localMaxSize << "\n";
-                    numberSort(newJob.c, newJob.vertices, newJob.numbers, localMaxSize);
-                    newJob.estimatedMax = newJob.c.size() + topNumber(newJob.numbers);
-                    TRACEVAR(newJob.estimatedMax, TRACE_MASK_CLIQUE, 2);
-                    
-                    /*
-                    // quick and dirty (not protected by mutex but should be atomic) check weather new job should be pushed to the queue
-                    //bool jobQueueFull = (jobToFork == nullptr) || (!parent->requireMoreJobs);
-                    if (parent->requireMoreJobs) { 
-                        ScopeTimer tm(timers[timer_job_management]);
-                        std::lock_guard<std::mutex> lk(parent->mutexJobs); 
-                        // check the number of jobs in queue again (now protected by mutex)
-                        if (parent->jobs.size() < parent->maxJobs) {
-                            TRACE("expand adding a job to the queue");
-                            TRACEVAR(parent->jobs.size());
-                            // fork the pre-prepared job (far more appropriate than forking current job)
-                            parent->addJob(*jobToFork);
-                            // mark the forked job as off-limits to this worker
-                            jobLevelBreak = jobToFork->c.size()+1;
-                            TRACEVAR(jobLevelBreak);
-                            // disable further forks; better alternative would be to allow further forks on a higher level
-                            // it would be harder to implement and would introduce additional overhead (unless the main recursion was transformed to iteration)
-                            jobToFork = nullptr;
-                        }
-                    }
-                    */
-                    
-                    // continue exploration of the search tree within this job
-                    TRACE("expand calling expand", TRACE_MASK_CLIQUE, 2);
-                    expand(newJob);
-                    if (job.c.size() < jobLevelBreak) {
-                        TRACE("breaking worker search tree", TRACE_MASK_CLIQUE, 2);
-                        TRACEVAR(jobLevelBreak, TRACE_MASK_CLIQUE, 2); 
-                        return;
-                    }
-                }
+                c.remove(v);
+                popTop(np, p);
             }
-            TRACE("expand end", TRACE_MASK_CLIQUE, 2);
         }
     };
 
@@ -1208,19 +1140,21 @@ protected:
     unsigned int maxSize;               // size of max clique
     unsigned int numThreads;            // stores the number of threads used in the last search (where this number a parameter to the function)
     VertexSet maxClique;
-    std::deque<Job> jobs;
-    bool requireMoreJobs;
-    size_t maxJobs, activeJobs;
+    // incumbent as (size << 32 | rank); a larger key is a better solution, see rank()
+    std::atomic<uint64_t> incumbent;
+    VertexSet rootVertices;             // candidate set at the root of the search tree
+    std::vector<Branch> branches;       // top-level branches in serial visiting order
+    std::vector<std::unique_ptr<Worker>> workers;
     PrecisionTimer timer;
     std::vector<double> workerActiveTimes;
     std::vector<unsigned long long> workerSteps;
-    std::mutex mutexJobs, mutexQ;
+    std::mutex mutexQ;
     KillTimer1 killTimer;
     
 public:
     VertexSet knownC;
 
-    ParallelMaximumCliqueProblem(Graph& graph) : graph(&graph), n(graph.getNumVertices()), maxSize(0) {}
+    ParallelMaximumCliqueProblem(Graph& graph) : graph(&graph), n(graph.getNumVertices()), maxSize(0), numThreads(0), incumbent(0) {}
     
     // get the result of the search - maximal clique of the provided graph
     const VertexSet& getClique() const {return maxClique;}
@@ -1231,7 +1165,7 @@ public:
             std::ostringstream algorithmName;
             auto basefmt = std::cout.flags();
             auto baseFill = std::cout.fill();
-            algorithmName << "pMC[" << numThreads << " threads, " << maxJobs << " jobs](" << ClassName<VertexId>::getValue() << ","
+            algorithmName << "pMC[" << numThreads << " threads, " << branches.size() << " branches](" << ClassName<VertexId>::getValue() << ","
                           << ClassName<VertexSet>::getValue() << "," << ClassName<Graph>::getValue() << "," << ClassName<InitialSorter>::getValue() << ") ";
             std::cout << "-- " << std::setw(80-3) << std::setfill('-') << std::left << algorithmName.str();
             std::cout.flags(basefmt);
@@ -1265,53 +1199,22 @@ public:
         return eff / (maxTime*workerActiveTimes.size());
     }
     
-    void sortLastJob() {
-        if (jobs.size() > 1) {
-            for (auto j = jobs.end()-1; (j != jobs.begin()) && ((j-1)->vertices.size() > j->vertices.size()); --j)
-                swap(*j, *(j-1));
-        }
-    }
-    
-    void addJob(Job& job) {
-        // LIFO queue, less copying
-        jobs.push_front(Job());
-        swap(jobs.front(), job);
-        requireMoreJobs = jobs.size() == maxJobs;
-        
-        /*
-        // Jobs queue is of LIFO type
-        jobs.push_front(job);
-        requireMoreJobs = jobs.size() == maxJobs;
-        */
-        
-        // Job sorting, it works better without one :(
-        //jobs.push_back(job);
-        //sortLastJob();
-    }
-    
-    void swapJob(Job& job) {
-        if (jobs.size() > 0 && job.estimatedMax < jobs.back().estimatedMax) {
-            //swap(job, jobs.back());
-            //sortLastJob();
-        }
-        /* // DEBUG
-        static int cnt = 1;
-        if (cnt > 0) {
-            --cnt;
-            for (auto& j: jobs)
-                std::cout << j.estimatedMax << " ";
-            std::cout << "\n";
-        }*/
-    }
-    
     // run the search for max clique
+    //  The root of the search tree is expanded here, on the calling thread, into one branch per vertex
+    //  the serial search would take at its top level.  Branches are dealt round-robin to the workers,
+    //  which steal from each other once their own queue runs dry.  numJobs is kept for compatibility;
+    //  the top-level branch is the unit of work.
     void search(unsigned int numThreads, unsigned int numJobs, std::vector<int>& affinities) {
         killTimer.start(10000);
         ScopeTimer t(timer);
         VertexSet c; // clique
         VertexSet p; // working set of vertices
         NumberedSet numbers;       // ordered set of colors
+        if (numThreads == 0) numThreads = 1;
         this->numThreads = numThreads;
+        incumbent = 0;
+        maxSize = 0;
+        maxClique.clear();
         
         {
             // setting the order of vertices (initial sort that renumbers vertices in the input graph)
@@ -1324,9 +1227,9 @@ public:
             TRACE(typeid(InitialSorter).name(), TRACE_MASK_CLIQUE, 1);
             initialSort(c, p, numbers);
             
-            // some initial sorts (e.g. MCR) also find a clique
+            // some initial sorts (e.g. MCR) also find a clique; it outranks any clique of the same size found later
             if (c.size() > 0) {
-                saveSolution(c);
+                storeSolution(c, std::numeric_limits<uint32_t>::max());
                 c.clear();
             }
         }
@@ -1338,25 +1241,38 @@ public:
         
         c.clear();
         
-        // Generate root job
-        maxJobs = std::min(numJobs, numThreads*1000);
-        //jobs.reserve(maxJobs+1);
-        jobs.push_back(Job(c, p, numbers, c.size() + this->topNumber(numbers)));
-        activeJobs = 0;
-        requireMoreJobs = jobs.size() < maxJobs;
+        // Expand the root: walk the top-level loop of the serial search without descending
+        rootVertices = p;
+        branches.clear();
+        {
+            VertexSet ps = p;
+            while (this->notEmpty(numbers)) {
+                Branch b;
+                b.bound = this->topNumber(numbers);
+                b.vertex = this->topVertex(numbers, ps);
+                branches.push_back(b);
+                this->popTop(numbers, ps);
+            }
+        }
         
         // Create threads and workers
         std::vector<std::unique_ptr<std::thread> > threads;
-        std::vector<Worker> workers;
         threads.resize(numThreads);
-        workers.resize(numThreads);
+        workers.clear();
+        for (unsigned int i = 0; i < numThreads; ++i) {
+            workers.emplace_back(new Worker());
+            workers[i]->setup(this, i);
+        }
+        for (size_t b = 0; b < branches.size(); ++b) {
+            workers[b % numThreads]->branches.push_back(b);
+        }
         
         // associate thread & worker pairs
         for (unsigned int i = 0; i < numThreads; ++i) {
             TRACE("setting up thread", TRACE_MASK_THREAD, 1);
             TRACEVAR(i, TRACE_MASK_THREAD, 1);
-            workers[i].setup(this, i);
-            threads[i] = std::unique_ptr<std::thread>(new std::thread([&workers, i](){workers[i].threadFunc();}));
+            Worker* worker = workers[i].get();
+            threads[i] = std::unique_ptr<std::thread>(new std::thread([worker](){worker->threadFunc();}));
         }
         TRACE("Done building threads, waiting for join", TRACE_MASK_THREAD, 1);
         // wait for all the workers to finish
@@ -1365,7 +1281,7 @@ public:
             TRACE("Thread joined to main thread", TRACE_MASK_THREAD, 1);
         }
         killTimer.cancel();
-        jobs.clear();
+        workers.clear();
         TRACE("search: end", TRACE_MASK_THREAD, 1)
     }
     
@@ -1379,26 +1295,68 @@ public:
         std::cout << "   maxSize " << maxSize << "\n";               // size of max clique
         std::cout << "   numThreads " << numThreads << "\n";            // stores the number of threads used in the last search (where this number a parameter to the function)
         std::cout << "   maxClique " << maxClique.size() << "\n";
-        std::cout << "   numJobs " << jobs.size() << "\n";
-        std::cout << "   requireMoreJobs " << requireMoreJobs << "\n";
-        std::cout << "   maxJobs/activeJobs " << maxJobs << "/" << activeJobs << "\n";
+        std::cout << "   numBranches " << branches.size() << "\n";
         std::cout << "   numWorkerStatsTimes " << workerActiveTimes.size() << "\n";
         std::cout << "   numWorkerStatsSteps " << workerSteps.size() << "\n";
         std::cout << "DEBUG END\n";
     }
     
 protected:
+    // Cliques of equal size are ranked by the branch that found them, earlier branches first, so the
+    // result is the one the serial search would report whatever the number of threads or their timing.
+    static uint32_t rank(size_t branch) {return std::numeric_limits<uint32_t>::max() - 1 - (uint32_t)branch;}
+    static uint64_t key(unsigned int size, uint32_t rank) {return ((uint64_t)size << 32) | rank;}
+    
+    // true if a clique of the given size found in branch would replace the incumbent
+    bool improves(unsigned int size, size_t branch) const {
+        return key(size, rank(branch)) > incumbent.load(std::memory_order_relaxed);
+    }
+    
+    // maxSize argument for numberSort: vertices coloured at or below it cannot produce a clique that
+    // improves on the incumbent.  An incumbent from a later branch still has to be matched, not beaten.
+    unsigned int colorBound(size_t branch) const {
+        uint64_t inc = incumbent.load(std::memory_order_relaxed);
+        unsigned int size = (unsigned int)(inc >> 32);
+        if (size > 0 && rank(branch) > (uint32_t)(inc & 0xFFFFFFFFu)) return size - 1;
+        return size;
+    }
+    
+    // candidates of a top-level branch: neighbours of its vertex among the root vertices that the
+    // serial search had not yet popped when it reached this branch
+    void branchCandidates(size_t branch, VertexSet& p1) const {
+        graph->intersectWithNeighbours(branches[branch].vertex, rootVertices, p1);
+        const VertexSet& cp1 = p1;
+        for (size_t j = 0; j < branch; ++j) {
+            auto u = branches[j].vertex;
+            if (cp1[u]) p1.remove(u);
+        }
+    }
+    
+    bool nextBranch(int id, size_t& branch) {
+        if (workers[id]->takeOwn(branch)) return true;
+        for (unsigned int k = 1; k < numThreads; ++k) {
+            if (workers[(id + k) % numThreads]->steal(branch)) return true;
+        }
+        return false;
+    }
+    
     // when a clique, larger than its predecessor is found, call this function to store it
-    unsigned int saveSolution(const VertexSet& c) {
+    unsigned int saveSolution(const VertexSet& c, size_t branch) {
+        return storeSolution(c, rank(branch));
+    }
+    
+    unsigned int storeSolution(const VertexSet& c, uint32_t rank) {
         unsigned int ret;
         // make a copy of clique
         TRACE("Saving solution", TRACE_MASK_CLIQUE, 2);
         TRACEVAR(c.size(), TRACE_MASK_CLIQUE, 2);
         {
             std::lock_guard<std::mutex> lk(mutexQ); 
-            if (maxSize < c.size()) {
+            uint64_t k = key(c.size(), rank);
+            if (k > incumbent.load(std::memory_order_relaxed)) {
                 maxSize = c.size();
                 maxClique = c;
+                incumbent.store(k, std::memory_order_relaxed);
             }
             ret = maxSize;
         }
@@ -2501,10 +2459,6 @@ gctools::Vec0<gctools::Vec0<char> > Dimacs_O::getAdjacencyMatrix() const {
 DOCGROUP(cando);
 CL_DEFUN
     core::T_sp chem__find_maximum_clique_search(Dimacs_sp dimacsGraph, int numThreads, int numJobs) {
-        if (numThreads>0) {
-            printf("%s:%d Parallel maximum-clique-search is broken - it calls back() with empty vectors\n", __FILE__, __LINE__ );
-            numThreads = 0;
-        }
         bool coloredOut = false;
 #ifdef __linux
         coloredOut = true;
@@ -43,6 +43,7 @@ This is an open source license for the CANDO software from Temple University, bu
 #include <cando/chem/largeSquareMatrix.h>
 #include <cando/chem/minimizer.h>
 #include <iostream>
+#include <limits>
 #include <cando/geom/vector3.fwd.h>
 #include <cando/chem/bond.h>
 #include <cando/chem/atom.h>
@@ -248,6 +249,9 @@ void Minimizer_O::fields(core::Record_sp node)
   node->field(INTERN_(kw,ConjugateGradientTolerance),this->_ConjugateGradientTolerance);
   node->field(INTERN_(kw,NumberOfTruncatedNewtonSteps),this->_NumberOfTruncatedNewtonSteps);
   node->field(INTERN_(kw,TruncatedNewtonTolerance),this->_TruncatedNewtonTolerance);
+  node->field_if_not_default(INTERN_(kw,NumberOfSinglePrecisionSteps),this->_NumberOfSinglePrecisionSteps,0);
+  node->field_if_not_default(INTERN_(kw,SinglePrecisionTolerance),this->_SinglePrecisionTolerance,100.0);
+  node->field_if_not_default(INTERN_(kw,FiniteDifferenceHessianVectorProduct),this->_FiniteDifferenceHessianVectorProduct,false);
   node->field(INTERN_(kw,ScoringFunction),this->_ScoringFunction );
   node->field(INTERN_(kw,PrintIntermediateResults),this->_PrintIntermediateResults);
 }
@@ -1295,6 +1299,7 @@ void	Minimizer_O::_conjugateGradient(int numSteps,
 	// Lets save the current conformation
 	// before throwing this higher
 	//
+          if ( this->_QuietlyStopConjugateGradient ) break;
           fp = dTotalEnergyForce( x, energyScale, force, activeAtomMask );
           this->_ScoringFunction->saveCoordinatesAndForcesFromVectors(x,force);
           ERROR(_sym_MinimizerExceededCG_MaxSteps, (ql::list() 
@@ -1315,6 +1320,7 @@ void	Minimizer_O::_conjugateGradient(int numSteps,
 	// Lets save the current conformation
 	// before throwing this higher
 	//
+          if ( this->_QuietlyStopConjugateGradient ) break;
           fp = dTotalEnergyForce( x, energyScale, force, activeAtomMask );
           this->_ScoringFunction->saveCoordinatesAndForcesFromVectors(x,force);
           MINIMIZER_STUCK_ERROR("Stuck in conjugate gradients");
@@ -1469,6 +1475,47 @@ void	Minimizer_O::_conjugateGradient(int numSteps,
   }
 }
 
+/*! Compute qj = H(xk).dj
+ *  Analytically the second derivatives of every term are contracted with dj as they
+ *  are evaluated so the Hessian is never stored.
+ *  With finite differences the gradient is differenced along dj
+ *     H.dj ~= (force(xk) - force(xk+h*dj))/h
+ *  with h = sqrt(epsilon)*(1+|xk|)/|dj| and costs one energy/force evaluation.
+ */
+void Minimizer_O::_hessianVectorProduct( NVector_sp xk,
+                                         core::T_sp energyScale,
+                                         NVector_sp force,
+                                         NVector_sp dj,
+                                         NVector_sp qj,
+                                         NVector_sp xTemp,
+                                         NVector_sp forceTemp,
+                                         core::T_sp activeAtomMask )
+{
+  if ( !this->_FiniteDifferenceHessianVectorProduct ) {
+    gc::Nilable<NVector_sp>			nvDummy = nil<T_O>();
+    gc::Nilable<SparseLargeSquareMatrix_sp>	nmDummy = nil<T_O>();
+    this->_ScoringFunction->evaluateAll( xk,
+                                         energyScale,
+                                         nil<core::T_O>(),
+                                         true, nvDummy,
+                                         true, true, nmDummy,
+                                         qj, dj, activeAtomMask);
+    return;
+  }
+  double djMag = magnitudeWithActiveAtomMask(dj,activeAtomMask);
+  if ( djMag == 0.0 ) {
+    qj->zero();
+    return;
+  }
+  double h = sqrt(std::numeric_limits<double>::epsilon())*(1.0+magnitudeWithActiveAtomMask(xk,activeAtomMask))/djMag;
+  XPlusYTimesScalarWithActiveAtomMask(xTemp,xk,dj,h,activeAtomMask);
+  this->dTotalEnergyForce(xTemp,energyScale,forceTemp,activeAtomMask);
+  double rh = 1.0/h;
+  for ( size_t i=0, iEnd=qj->length(); i<iEnd; i++ ) {
+    (*qj)[i] = ((*force)[i]-(*forceTemp)[i])*rh;
+  }
+}
+
 void	Minimizer_O::_truncatedNewtonInnerLoop(int				kk,
                                                NVector_sp			xk,
                                                core::T_sp                       energyScale,
@@ -1482,6 +1529,8 @@ void	Minimizer_O::_truncatedNewtonInnerLoop(int				kk,
                                                NVector_sp			dj,
                                                NVector_sp			zj,
                                                NVector_sp			qj,
+                                               NVector_sp			xTemp,
+                                               NVector_sp			forceTemp,
                                                bool&                            innerLoopDeltaJ1,
                                                core::T_sp activeAtomMask )
 {
@@ -1490,13 +1539,8 @@ void	Minimizer_O::_truncatedNewtonInnerLoop(int				kk,
   double	nkTimesRmsForceMag, rjDotzj;
   double				djDotqj, forceDotpjNext;
   double				rmsRjMag, rjDotzjNext, betaj;
-  gc::Nilable<NVector_sp>			nvDummy;
-  gc::Nilable<SparseLargeSquareMatrix_sp>	nmDummy;
 
   ASSERTNOTNULL(this->_EnergyFunction);
-  LOG("Resetting dummy vector and matrix" );
-  nvDummy = nil<T_O>();
-  nmDummy = nil<T_O>();
 
   if ( this->_DebugOn )
   {
@@ -1546,12 +1590,7 @@ void	Minimizer_O::_truncatedNewtonInnerLoop(int				kk,
     // exit PCG loop with pk=pj ( for j=1, set pk=force)
     //
 
-    this->_ScoringFunction->evaluateAll( xk,
-                                         energyScale,
-                                         nil<core::T_O>(),
-                                         true, nvDummy,
-                                         true, true, nmDummy,
-                                         qj, dj, activeAtomMask);
+    this->_hessianVectorProduct(xk,energyScale,force,dj,qj,xTemp,forceTemp,activeAtomMask);
     // MOVE rjDotzj calculation above this loop because
     // 	its calculated in step 6
     // rjDotzj = rj->dotProduct(zj);
@@ -1668,6 +1707,7 @@ void	Minimizer_O::_truncatedNewton(int numSteps,
   int	iDimensions;
   double			fp;
   NVector_sp	forceK, dirVec, dirVecNext, rj, dj, zj, qj, xKNext, kSum;
+  NVector_sp	xTemp, forceTemp;
   SparseLargeSquareMatrix_sp	mprecon;
   SparseLargeSquareMatrix_sp    opt_mprecon;
   SparseLargeSquareMatrix_sp    ldlt, opt_ldlt;
@@ -1710,6 +1750,10 @@ void	Minimizer_O::_truncatedNewton(int numSteps,
   zj = NVector_O::create(iDimensions);
   qj = NVector_O::create(iDimensions);
   kSum = NVector_O::create(iDimensions);
+  if ( this->_FiniteDifferenceHessianVectorProduct ) {
+    xTemp = NVector_O::create(iDimensions);
+    forceTemp = NVector_O::create(iDimensions);
+  }
   mprecon = SparseLargeSquareMatrix_O::create(iDimensions,SymmetricDiagonalLower);
   ldlt = SparseLargeSquareMatrix_O::create(iDimensions,SymmetricDiagonalLower);
     //
@@ -1765,6 +1809,7 @@ void	Minimizer_O::_truncatedNewton(int numSteps,
       _truncatedNewtonInnerLoop( kk, xK, energyScale, opt_mprecon, opt_ldlt,
                                  forceK, rmsForceMag, dirVec,
                                  dirVecNext, rj, dj, zj, qj,
+                                 xTemp, forceTemp,
                                  innerLoopDeltaJ1,
                                  activeAtomMask );
 
@@ -2020,6 +2065,10 @@ CL_DEFMETHOD     void	Minimizer_O::useDefaultSettings()
   this->_NumberOfTruncatedNewtonSteps = MAXTRUNCATEDNEWTONSTEPS;
   this->_TruncatedNewtonTolerance = 0.00000001;
   this->_TruncatedNewtonPreconditioner = hessianPreconditioner;
+  this->_NumberOfSinglePrecisionSteps = 0;
+  this->_SinglePrecisionTolerance = 100.0;
+  this->_FiniteDifferenceHessianVectorProduct = false;
+  this->_QuietlyStopConjugateGradient = false;
   this->_PrintIntermediateResults = 0;
   LOG("_PrintIntermediateResults = {}" , this->_PrintIntermediateResults  );
   this->_ReportEveryNSteps = 100;
@@ -2098,6 +2147,36 @@ CL_DEFMETHOD     void	Minimizer_O::resetAndMinimize(core::T_sp energyScale, core
 }
 
 
+/*! Restore double precision evaluation and the usual conjugate gradient
+ *  error reporting when the single precision stage ends or unwinds.
+ */
+struct SinglePrecisionStage {
+  ScoringFunction_sp _ScoringFunction;
+  bool& _Quiet;
+  SinglePrecisionStage(ScoringFunction_sp scoringFunction, bool& quiet) : _ScoringFunction(scoringFunction), _Quiet(quiet) {
+    this->_ScoringFunction->setSinglePrecision(true);
+    this->_Quiet = true;
+  }
+  ~SinglePrecisionStage() {
+    this->_ScoringFunction->setSinglePrecision(false);
+    this->_Quiet = false;
+  }
+};
+
+void Minimizer_O::_singlePrecisionConjugateGradient(int numSteps,
+                                                    NVector_sp x,
+                                                    core::T_sp energyScale,
+                                                    double forceTolerance,
+                                                    core::T_sp activeAtomMask,
+                                                    core::T_sp callback )
+{
+  if ( this->_PrintIntermediateResults ) {
+    core::clasp_writeln_string("======= Single precision conjugate gradients");
+  }
+  SinglePrecisionStage stage(this->_ScoringFunction,this->_QuietlyStopConjugateGradient);
+  this->_conjugateGradient(numSteps,x,energyScale,forceTolerance,activeAtomMask,callback);
+}
+
 CL_LISPIFY_NAME("minimize");
 CL_LAMBDA((minimizer chem:minimizer) &key energy-scale active-atom-mask callback);
 CL_DEFMETHOD core::T_mv Minimizer_O::minimize(core::T_sp energyScale, core::T_sp activeAtomMask, core::T_sp callback)
@@ -2118,6 +2197,10 @@ CL_DEFMETHOD core::T_mv Minimizer_O::minimize(core::T_sp energyScale, core::T_sp
           core::clasp_write_string(fmt::format("Starting pos[{}] -> {}\n" , idx , (*pos)[idx]));
         }
       }
+      if ( this->_NumberOfSinglePrecisionSteps > 0 ) {
+        this->_singlePrecisionConjugateGradient( this->_NumberOfSinglePrecisionSteps,
+                                                 pos, energyScale, this->_SinglePrecisionTolerance, activeAtomMask, callback );
+      }
       if ( this->_NumberOfSteepestDescentSteps > 0 ) {
         this->_steepestDescent( this->_NumberOfSteepestDescentSteps,
                                 pos, energyScale, this->_SteepestDescentTolerance, activeAtomMask, callback );
@@ -2206,6 +2289,9 @@ CL_DEFMETHOD     string	Minimizer_O::configurationAsString()
   ss << "MaximumNumberOfTruncatedNewtonSteps: "<<this->_NumberOfTruncatedNewtonSteps << std::endl;
   ss << "TruncatedNewtonTolerance:            "<<this->_TruncatedNewtonTolerance << std::endl;
   ss << "TruncatedNewtonPreconditioner:       "<<stringForPreconditionerType(this->_TruncatedNewtonPreconditioner)<<std::endl;
+  ss << "MaximumNumberOfSinglePrecisionSteps: "<<this->_NumberOfSinglePrecisionSteps << std::endl;
+  ss << "SinglePrecisionTolerance:            "<<this->_SinglePrecisionTolerance << std::endl;
+  ss << "FiniteDifferenceHessianVectorProduct: "<<(this->_FiniteDifferenceHessianVectorProduct ? "true" : "false") << std::endl;
   return ss.str();
 }
 
@@ -0,0 +1,663 @@
+/*
+    File: molecularDynamics.cc
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+#define	DEBUG_LEVEL_NONE
+
+#include <clasp/core/foundation.h>
+#include <clasp/core/evaluator.h>
+#include <clasp/core/array.h>
+#include <clasp/core/bitVector.h>
+#include <cando/chem/molecularDynamics.h>
+#include <cando/chem/energyFunction.h>
+#include <cando/chem/energyAtomTable.h>
+#include <cando/chem/elements.h>
+#include <clasp/core/wrappers.h>
+#include <algorithm>
+#include <cmath>
+
+namespace chem {
+
+// Converts kcal/mol/A/amu to A/ps^2 and kcal/mol/amu to A^2/ps^2
+#define MD_KCAL_PER_AMU_TO_A2_PER_PS2 418.4
+// Boltzmann's constant in kcal/mol/K
+#define MD_BOLTZMANN_KCAL 0.0019872041
+
+SYMBOL_EXPORT_SC_(KeywordPkg,langevin);
+SYMBOL_EXPORT_SC_(KeywordPkg,andersen);
+SYMBOL_EXPORT_SC_(KeywordPkg,none);
+SYMBOL_EXPORT_SC_(KeywordPkg,step);
+SYMBOL_EXPORT_SC_(KeywordPkg,time);
+SYMBOL_EXPORT_SC_(KeywordPkg,potential);
+SYMBOL_EXPORT_SC_(KeywordPkg,kinetic);
+SYMBOL_EXPORT_SC_(KeywordPkg,temperature);
+
+CL_LAMBDA(scoring-function &key masses (timestep 0.001) (temperature 300.0) (thermostat :langevin) (friction 1.0) (collision-frequency 10.0) (seed 0) unfrozen);
+CL_DOCSTRING(R"dx(Make a molecular dynamics engine for the atoms of scoring-function starting from
+the coordinates of its matter with zero velocities.
+: masses - a vector of the mass of every atom in amu.  When NIL the masses of the elements
+in the atom table of an energy-function are used.
+: timestep - in picoseconds.
+: temperature - in kelvin, used by the :langevin and :andersen thermostats and initialize-velocities.
+: thermostat - :langevin (BAOAB), :andersen or :none (constant energy velocity verlet).
+: friction - the Langevin friction coefficient in 1/ps.
+: collision-frequency - the Andersen collision frequency in 1/ps.
+: seed - seeds the random number generator so that runs can be repeated.
+: unfrozen - NIL or a simple-bit-vector with a bit set for every atom that is allowed to move.)dx");
+CL_LISPIFY_NAME(make_molecular_dynamics);
+CL_DEF_CLASS_METHOD MolecularDynamics_sp MolecularDynamics_O::make(ScoringFunction_sp scoringFunction,
+                                                                   core::T_sp masses,
+                                                                   double timestep,
+                                                                   double temperature,
+                                                                   core::Symbol_sp thermostat,
+                                                                   double friction,
+                                                                   double collisionFrequency,
+                                                                   size_t seed,
+                                                                   core::T_sp unfrozen)
+{
+  auto me = gctools::GC<MolecularDynamics_O>::allocate_with_default_constructor();
+  size_t size = scoringFunction->getNVectorSize();
+  size_t numAtoms = size/3;
+  me->_ScoringFunction = scoringFunction;
+  me->_Position = NVector_O::make(size);
+  me->_Velocity = NVector_O::make(size);
+  me->_Force = NVector_O::make(size);
+  me->_Masses = NVector_O::make(numAtoms);
+  me->_InverseMasses = NVector_O::make(numAtoms);
+  if (masses.notnilp()) {
+    NVector_sp given = gc::As<NVector_sp>(masses);
+    if (given->length() != numAtoms) {
+      SIMPLE_ERROR("There must be {} masses - got {}", numAtoms, given->length());
+    }
+    for ( size_t ii=0; ii<numAtoms; ++ii ) (*me->_Masses)[ii] = (*given)[ii];
+  } else if (gc::IsA<EnergyFunction_sp>(scoringFunction)) {
+    AtomTable_sp atomTable = gc::As_unsafe<EnergyFunction_sp>(scoringFunction)->atomTable();
+    for ( size_t ii=0; ii<numAtoms; ++ii ) {
+      double mass = atomicWeightForElement(elementForAtomicNumber(atomTable->elt_atomic_number(ii)));
+      // Same fallback as dynamics:make-atomic-simulation for elements without a weight
+      (*me->_Masses)[ii] = (mass < 0.1) ? 1.0 : mass;
+    }
+  } else {
+    SIMPLE_ERROR("Masses must be provided for a scoring-function that is not an energy-function");
+  }
+  for ( size_t ii=0; ii<numAtoms; ++ii ) {
+    if ((*me->_Masses)[ii] <= 0.0) SIMPLE_ERROR("The mass of atom {} must be positive - it is {}", ii, (*me->_Masses)[ii]);
+  }
+  if (timestep <= 0.0) SIMPLE_ERROR("The timestep must be positive - it is {}", timestep);
+  me->_Timestep = timestep;
+  me->_Friction = friction;
+  me->_CollisionFrequency = collisionFrequency;
+  me->setTemperature(temperature);
+  me->setThermostat(thermostat);
+  me->setSeed(seed);
+  me->setUnfrozen(unfrozen);
+  scoringFunction->loadCoordinatesIntoVector(me->_Position);
+  me->_PotentialEnergy = me->evaluateForce();
+  return me;
+}
+
+void MolecularDynamics_O::fields(core::Record_sp node)
+{
+  node->field(INTERN_(kw,ScoringFunction),this->_ScoringFunction);
+  node->field(INTERN_(kw,Position),this->_Position);
+  node->field(INTERN_(kw,Velocity),this->_Velocity);
+  node->field(INTERN_(kw,Force),this->_Force);
+  node->field(INTERN_(kw,Masses),this->_Masses);
+  node->field(INTERN_(kw,InverseMasses),this->_InverseMasses);
+  node->field(INTERN_(kw,Unfrozen),this->_Unfrozen);
+  node->field(INTERN_(kw,Thermostat),this->_Thermostat);
+  node->field(INTERN_(kw,Timestep),this->_Timestep);
+  node->field(INTERN_(kw,Temperature),this->_Temperature);
+  node->field(INTERN_(kw,Friction),this->_Friction);
+  node->field(INTERN_(kw,CollisionFrequency),this->_CollisionFrequency);
+  node->field(INTERN_(kw,Seed),this->_Seed);
+  node->field(INTERN_(kw,Step),this->_Step);
+  node->field(INTERN_(kw,PotentialEnergy),this->_PotentialEnergy);
+  node->field(INTERN_(kw,Reporters),this->_Reporters);
+  node->field(INTERN_(kw,TrajectoryStride),this->_TrajectoryStride);
+  node->field(INTERN_(kw,CoordinateSink),this->_CoordinateSink);
+  node->field(INTERN_(kw,EnergySink),this->_EnergySink);
+  node->field_if_not_default(INTERN_(kw,Constraints),this->_Constraints,nil<core::T_O>());
+  node->field_if_not_default(INTERN_(kw,RespaLevels),this->_RespaLevels,nil<core::T_O>());
+  node->field_if_not_default(INTERN_(kw,RespaSubsteps),this->_RespaSubsteps,nil<core::T_O>());
+  node->field_if_not_default(INTERN_(kw,RespaForces),this->_RespaForces,nil<core::T_O>());
+  node->field_if_not_default(INTERN_(kw,Barostat),this->_Barostat,nil<core::T_O>());
+  if (node->stage() == core::Record_O::initializing || node->stage() == core::Record_O::loading) {
+    this->_Rng._value.seed(this->_Seed);
+    if (this->_Constraints.notnilp()) this->_Reference = NVector_O::make(this->_Position->length());
+  }
+}
+
+/*! Check the unfrozen mask once and fold it into the inverse masses so that the
+ *  integrators never move a frozen atom. */
+void MolecularDynamics_O::setUnfrozen(core::T_sp unfrozen)
+{
+  size_t numAtoms = this->_Masses->length();
+  if (gc::IsA<core::SimpleBitVector_sp>(unfrozen)) {
+    if (gc::As_unsafe<core::SimpleBitVector_sp>(unfrozen)->length() != numAtoms) {
+      SIMPLE_ERROR("unfrozen must be a simple-bit-vector of length {} or NIL - got {}", numAtoms, _rep_(unfrozen));
+    }
+  } else if (unfrozen.notnilp()) {
+    SIMPLE_ERROR("unfrozen must be a simple-bit-vector or NIL");
+  }
+  this->_Unfrozen = unfrozen;
+  for ( size_t ii=0; ii<numAtoms; ++ii ) {
+    bool moves = unfrozen.nilp() || gc::As_unsafe<core::SimpleBitVector_sp>(unfrozen)->testBit(ii);
+    (*this->_InverseMasses)[ii] = moves ? 1.0/(*this->_Masses)[ii] : 0.0;
+    if (!moves) {
+      (*this->_Velocity)[ii*3+0] = 0.0;
+      (*this->_Velocity)[ii*3+1] = 0.0;
+      (*this->_Velocity)[ii*3+2] = 0.0;
+    }
+  }
+}
+
+void MolecularDynamics_O::setThermostat(core::Symbol_sp thermostat)
+{
+  if (thermostat != kw::_sym_langevin && thermostat != kw::_sym_andersen && thermostat != kw::_sym_none) {
+    SIMPLE_ERROR("Unknown thermostat {} - must be one of :langevin :andersen :none", _rep_(thermostat));
+  }
+  this->_Thermostat = thermostat;
+}
+
+CL_DOCSTRING(R"dx(Set the temperature in kelvin that the thermostat drives the system towards.)dx");
+CL_DEFMETHOD void MolecularDynamics_O::setTemperature(double temperature)
+{
+  if (temperature < 0.0) SIMPLE_ERROR("The temperature must not be negative - it is {}", temperature);
+  this->_Temperature = temperature;
+}
+
+CL_DOCSTRING(R"dx(Reseed the random number generator used by the thermostat and initialize-velocities.)dx");
+CL_DEFMETHOD void MolecularDynamics_O::setSeed(size_t seed)
+{
+  this->_Seed = seed;
+  this->_Rng._value.seed(seed);
+}
+
+/*! True when nothing acts on the center of mass - no atoms are frozen and there is no
+ *  thermostat whose random forces or collisions change the total momentum. */
+bool MolecularDynamics_O::conservesMomentum() const
+{
+  if (this->_Thermostat != kw::_sym_none) return false;
+  for ( size_t ii=0; ii<this->_InverseMasses->length(); ++ii ) {
+    if ((*this->_InverseMasses)[ii] == 0.0) return false;
+  }
+  return true;
+}
+
+CL_LAMBDA((molecular-dynamics chem:molecular-dynamics) &optional temperature);
+CL_DOCSTRING(R"dx(Draw the velocities of the unfrozen atoms from the Maxwell-Boltzmann distribution at
+temperature (or the temperature of the engine).  With the :none thermostat and no frozen atoms the
+motion of the center of mass is removed, and then stays zero.)dx");
+CL_DEFMETHOD void MolecularDynamics_O::initializeVelocities(core::T_sp temperature)
+{
+  double kT = MD_BOLTZMANN_KCAL*(temperature.notnilp() ? core::clasp_to_double(temperature) : this->_Temperature);
+  std::normal_distribution<double> normal;
+  size_t numAtoms = this->_Masses->length();
+  double momentum[3] = {0.0,0.0,0.0};
+  double totalMass = 0.0;
+  for ( size_t ii=0; ii<numAtoms; ++ii ) {
+    double sigma = std::sqrt(kT*MD_KCAL_PER_AMU_TO_A2_PER_PS2*(*this->_InverseMasses)[ii]);
+    for ( size_t cc=0; cc<3; ++cc ) {
+      (*this->_Velocity)[ii*3+cc] = sigma*normal(this->_Rng._value);
+      if ((*this->_InverseMasses)[ii] != 0.0) momentum[cc] += (*this->_Masses)[ii]*(*this->_Velocity)[ii*3+cc];
+    }
+    if ((*this->_InverseMasses)[ii] != 0.0) totalMass += (*this->_Masses)[ii];
+  }
+  // Under a thermostat the center of mass exchanges energy with the bath like every other
+  // degree of freedom so its motion is only removed when nothing will put it back
+  if (this->conservesMomentum() && this->degreesOfFreedom() > 0) {
+    for ( size_t ii=0; ii<numAtoms; ++ii ) {
+      if ((*this->_InverseMasses)[ii] == 0.0) continue;
+      for ( size_t cc=0; cc<3; ++cc ) (*this->_Velocity)[ii*3+cc] -= momentum[cc]/totalMass;
+    }
+  }
+  this->constrainVelocities();
+}
+
+CL_DOCSTRING(R"dx(Call function with the molecular-dynamics engine after every stride steps of run.)dx");
+CL_DEFMETHOD void MolecularDynamics_O::addReporter(size_t stride, core::T_sp function)
+{
+  if (stride == 0) SIMPLE_ERROR("The reporter stride must be positive");
+  ql::list reporters;
+  for ( auto cur : this->_Reporters ) reporters << CONS_CAR(cur);
+  reporters << core::Cons_O::create(core::make_fixnum(stride),function);
+  this->_Reporters = reporters.cons();
+}
+
+CL_LAMBDA((molecular-dynamics chem:molecular-dynamics) stride coordinates &optional energies);
+CL_DOCSTRING(R"dx(Every stride steps of run push a single-float copy of the coordinates onto the vector
+coordinates and a plist (:step :time :potential :kinetic :temperature) onto the vector energies.
+Both must have fill pointers and either can be NIL.  A stride of 0 turns the trajectory off.)dx");
+CL_DEFMETHOD void MolecularDynamics_O::setTrajectory(size_t stride, core::T_sp coordinates, core::T_sp energies)
+{
+  if (coordinates.notnilp() && !gc::IsA<core::Vector_sp>(coordinates)) SIMPLE_ERROR("coordinates must be a vector with a fill pointer or NIL");
+  if (energies.notnilp() && !gc::IsA<core::Vector_sp>(energies)) SIMPLE_ERROR("energies must be a vector with a fill pointer or NIL");
+  this->_TrajectoryStride = stride;
+  this->_CoordinateSink = coordinates;
+  this->_EnergySink = energies;
+}
+
+CL_DOCSTRING(R"dx(Hold bonds fixed during dynamics with constraints, a bond-constraints built from the
+same energy-function, or NIL to remove them.  The current positions and velocities are constrained
+immediately.  The timestep can usually be doubled when the bonds to hydrogen are constrained.)dx");
+CL_DEFMETHOD void MolecularDynamics_O::setConstraints(core::T_sp constraints)
+{
+  if (constraints.nilp()) {
+    this->_Constraints = constraints;
+    return;
+  }
+  BondConstraints_sp bondConstraints = gc::As<BondConstraints_sp>(constraints);
+  size_t numAtoms = this->_Masses->length();
+  for ( size_t ii=0; ii<bondConstraints->_Atom1->length(); ++ii ) {
+    if ((size_t)(*bondConstraints->_Atom1)[ii] >= numAtoms || (size_t)(*bondConstraints->_Atom2)[ii] >= numAtoms) {
+      SIMPLE_ERROR("The constraints refer to atoms beyond the {} atoms of the dynamics", numAtoms);
+    }
+  }
+  for ( size_t ii=0; ii<bondConstraints->_Waters->length(); ++ii ) {
+    if ((size_t)(*bondConstraints->_Waters)[ii] >= numAtoms) {
+      SIMPLE_ERROR("The constraints refer to atoms beyond the {} atoms of the dynamics", numAtoms);
+    }
+  }
+  this->_Constraints = bondConstraints;
+  this->_Reference = NVector_O::make(this->_Position->length());
+  for ( size_t ii=0; ii<this->_Position->length(); ++ii ) (*this->_Reference)[ii] = (*this->_Position)[ii];
+  bondConstraints->applyToPositions(this->_Reference,this->_Position,this->_InverseMasses);
+  this->_PotentialEnergy = this->_RespaLevels.nilp() ? this->evaluateForce() : this->evaluateRespaLevels();
+  this->constrainVelocities();
+}
+
+CL_DOCSTRING(R"dx(Attempt a Monte Carlo volume move of barostat, made with make-monte-carlo-barostat for the
+energy-function of the dynamics, every frequency steps of run at the temperature of the engine.
+NIL removes the barostat.  Velocities are not changed by volume moves.)dx");
+CL_DEFMETHOD void MolecularDynamics_O::setBarostat(core::T_sp barostat)
+{
+  if (barostat.notnilp()) {
+    MonteCarloBarostat_sp monteCarlo = gc::As<MonteCarloBarostat_sp>(barostat);
+    core::T_sp energyFunction = monteCarlo->_EnergyFunction;
+    core::T_sp scoringFunction = this->_ScoringFunction;
+    if (energyFunction != scoringFunction) {
+      SIMPLE_ERROR("The barostat must be made for the energy-function of the dynamics");
+    }
+    if (this->_Unfrozen.notnilp()) {
+      SIMPLE_ERROR("A barostat moves every molecule and cannot be used with frozen atoms");
+    }
+  }
+  this->_Barostat = barostat;
+}
+
+/*! Attempt a volume move and recalculate the forces when it is accepted */
+void MolecularDynamics_O::barostatStep()
+{
+  MonteCarloBarostat_sp barostat = gc::As_unsafe<MonteCarloBarostat_sp>(this->_Barostat);
+  if (this->_Step%barostat->_Frequency != 0) return;
+  double kT = MD_BOLTZMANN_KCAL*this->_Temperature;
+  if (barostat->attempt(this->_Position,this->_Unfrozen,kT,this->_Rng._value)) {
+    this->_PotentialEnergy = this->_RespaLevels.nilp() ? this->evaluateForce() : this->evaluateRespaLevels();
+  }
+}
+
+double MolecularDynamics_O::evaluateForce()
+{
+  return this->_ScoringFunction->evaluateEnergyForce(this->_Position,nil<core::T_O>(),true,this->_Force,this->_Unfrozen);
+}
+
+CL_DEFMETHOD double MolecularDynamics_O::kineticEnergy() const
+{
+  double twiceKinetic = 0.0;
+  for ( size_t ii=0; ii<this->_Masses->length(); ++ii ) {
+    if ((*this->_InverseMasses)[ii] == 0.0) continue;
+    double vx = (*this->_Velocity)[ii*3+0], vy = (*this->_Velocity)[ii*3+1], vz = (*this->_Velocity)[ii*3+2];
+    twiceKinetic += (*this->_Masses)[ii]*(vx*vx+vy*vy+vz*vz);
+  }
+  return 0.5*twiceKinetic/MD_KCAL_PER_AMU_TO_A2_PER_PS2;
+}
+
+CL_DOCSTRING(R"dx(Return the number of degrees of freedom of the unfrozen atoms less the constraints, and less
+the three of the center of mass motion when initialize-velocities removes it - with the :none thermostat
+and no frozen atoms.)dx");
+CL_DEFMETHOD size_t MolecularDynamics_O::degreesOfFreedom() const
+{
+  size_t moving = 0;
+  for ( size_t ii=0; ii<this->_InverseMasses->length(); ++ii ) {
+    if ((*this->_InverseMasses)[ii] != 0.0) ++moving;
+  }
+  size_t constrained = 0;
+  if (this->_Constraints.notnilp()) {
+    constrained = gc::As_unsafe<BondConstraints_sp>(this->_Constraints)->numberOfActiveConstraints(this->_InverseMasses);
+  }
+  size_t dof = (moving*3 > constrained) ? moving*3-constrained : 0;
+  if (this->conservesMomentum()) dof = (dof > 3) ? dof-3 : 0;
+  return dof;
+}
+
+CL_DOCSTRING(R"dx(Return the instantaneous temperature in kelvin from the kinetic energy of the unfrozen atoms.)dx");
+CL_DEFMETHOD double MolecularDynamics_O::temperature() const
+{
+  size_t dof = this->degreesOfFreedom();
+  if (dof == 0) return 0.0;
+  return 2.0*this->kineticEnergy()/(dof*MD_BOLTZMANN_KCAL);
+}
+
+/*! Move the atoms by dt along their velocities.  With constraints the new positions are
+ *  SHAKEn back onto the constraints and the velocities are replaced by the constrained displacement. */
+void MolecularDynamics_O::drift(double dt)
+{
+  NVector_O& pos = *this->_Position;
+  NVector_O& vel = *this->_Velocity;
+  size_t size = pos.length();
+  if (this->_Constraints.nilp()) {
+    for ( size_t idx=0; idx<size; ++idx ) pos[idx] += dt*vel[idx];
+    return;
+  }
+  NVector_O& reference = *this->_Reference;
+  for ( size_t idx=0; idx<size; ++idx ) {
+    reference[idx] = pos[idx];
+    pos[idx] += dt*vel[idx];
+  }
+  gc::As_unsafe<BondConstraints_sp>(this->_Constraints)->applyToPositions(this->_Reference,this->_Position,this->_InverseMasses);
+  double invDt = 1.0/dt;
+  for ( size_t idx=0; idx<size; ++idx ) vel[idx] = (pos[idx]-reference[idx])*invDt;
+}
+
+/*! RATTLE the velocities if there are constraints */
+void MolecularDynamics_O::constrainVelocities()
+{
+  if (this->_Constraints.nilp()) return;
+  gc::As_unsafe<BondConstraints_sp>(this->_Constraints)->applyToVelocities(this->_Position,this->_Velocity,this->_InverseMasses);
+}
+
+/*! Change the velocities by the accelerations from force over dt */
+void MolecularDynamics_O::kick(NVector_sp force, double dt)
+{
+  NVector_O& vel = *this->_Velocity;
+  NVector_O& forceRef = *force;
+  NVector_O& inverseMasses = *this->_InverseMasses;
+  for ( size_t ii=0; ii<inverseMasses.length(); ++ii ) {
+    double scale = dt*MD_KCAL_PER_AMU_TO_A2_PER_PS2*inverseMasses[ii];
+    for ( size_t idx=ii*3; idx<ii*3+3; ++idx ) vel[idx] += scale*forceRef[idx];
+  }
+}
+
+/*! The exact Ornstein-Uhlenbeck update of the Langevin friction and noise over dt */
+void MolecularDynamics_O::ornsteinUhlenbeck(double dt)
+{
+  NVector_O& vel = *this->_Velocity;
+  NVector_O& inverseMasses = *this->_InverseMasses;
+  double c1 = std::exp(-this->_Friction*dt);
+  double c2 = std::sqrt(1.0-c1*c1);
+  double kT = MD_BOLTZMANN_KCAL*this->_Temperature*MD_KCAL_PER_AMU_TO_A2_PER_PS2;
+  std::normal_distribution<double> normal;
+  for ( size_t ii=0; ii<inverseMasses.length(); ++ii ) {
+    double sigma = c2*std::sqrt(kT*inverseMasses[ii]);
+    for ( size_t idx=ii*3; idx<ii*3+3; ++idx ) vel[idx] = c1*vel[idx]+sigma*normal(this->_Rng._value);
+  }
+}
+
+/*! One BAOAB step - half kick, half drift, Ornstein-Uhlenbeck velocity update, half drift,
+ *  force evaluation and half kick.  Configurational sampling is accurate to second order.
+ *  The velocities are constrained after every B and O update and the positions after every A. */
+void MolecularDynamics_O::langevinStep()
+{
+  double halfDt = 0.5*this->_Timestep;
+  this->kick(this->_Force,halfDt);
+  this->constrainVelocities();
+  this->drift(halfDt);
+  this->ornsteinUhlenbeck(this->_Timestep);
+  this->constrainVelocities();
+  this->drift(halfDt);
+  this->_PotentialEnergy = this->evaluateForce();
+  this->kick(this->_Force,halfDt);
+  this->constrainVelocities();
+}
+
+/*! One velocity verlet step - RATTLE when there are constraints */
+void MolecularDynamics_O::verletStep()
+{
+  double halfDt = 0.5*this->_Timestep;
+  this->kick(this->_Force,halfDt);
+  this->drift(this->_Timestep);
+  this->_PotentialEnergy = this->evaluateForce();
+  this->kick(this->_Force,halfDt);
+  this->constrainVelocities();
+}
+
+/*! One r-RESPA step of level over dt - a half kick with the force of level, substeps steps
+ *  of the level inside it (or a drift for the innermost level), a new force for level and a
+ *  second half kick.  With Langevin dynamics the innermost drift is split around an
+ *  Ornstein-Uhlenbeck update so that the innermost level is a BAOAB step. */
+void MolecularDynamics_O::respaStep(std::vector<RespaLevel>& levels, size_t level, double dt, bool langevin)
+{
+  RespaLevel& current = levels[level];
+  this->kick(current._Force,0.5*dt);
+  this->constrainVelocities();
+  if (level == 0) {
+    if (langevin) {
+      this->drift(0.5*dt);
+      this->ornsteinUhlenbeck(dt);
+      this->constrainVelocities();
+      this->drift(0.5*dt);
+    } else {
+      this->drift(dt);
+    }
+  } else {
+    double innerDt = dt/current._Substeps;
+    for ( size_t ii=0; ii<current._Substeps; ++ii ) this->respaStep(levels,level-1,innerDt,langevin);
+  }
+  EnergyFunction_sp energyFunction = gc::As_unsafe<EnergyFunction_sp>(this->_ScoringFunction);
+  current._Energy = energyFunction->evaluateComponentsEnergyForce(current._Components,this->_Position,current._Force,this->_Unfrozen);
+  this->kick(current._Force,0.5*dt);
+  this->constrainVelocities();
+}
+
+/*! Evaluate the force of every RESPA level at the current positions and return the total energy */
+double MolecularDynamics_O::evaluateRespaLevels()
+{
+  EnergyFunction_sp energyFunction = gc::As_unsafe<EnergyFunction_sp>(this->_ScoringFunction);
+  double energy = 0.0;
+  core::List_sp forces = this->_RespaForces;
+  for ( auto cur : this->_RespaLevels ) {
+    energy += energyFunction->evaluateComponentsEnergyForce(gc::As<core::List_sp>(CONS_CAR(cur)),this->_Position,gc::As<NVector_sp>(oCar(forces)),this->_Unfrozen);
+    forces = oCdr(forces);
+  }
+  return energy;
+}
+
+CL_LAMBDA((molecular-dynamics chem:molecular-dynamics) levels &optional (substeps 2));
+CL_DOCSTRING(R"dx(Integrate with the r-RESPA multiple timestep method.  levels is a list of lists of the
+energy components of the energy-function, from the cheapest (evaluated every inner step) to the
+most expensive.  Components that are not in any level are added to the outermost level.
+substeps is the number of steps of each level for one step of the level outside it - an integer
+for every level or a list with one fewer entries than levels.  The timestep of the engine is the
+outer timestep and the innermost timestep is it divided by the product of the substeps.
+For example, with ef the energy-function of the engine,
+  (list (list (chem:get-stretch-component ef) (chem:get-angle-component ef) (chem:get-dihedral-component ef))
+        (list (chem:get-nonbond-component ef)))
+with 4 substeps and a 4 fs timestep evaluates the bonded terms every 1 fs and the nonbond term every 4 fs.  NIL levels turns RESPA off.)dx");
+CL_DEFMETHOD void MolecularDynamics_O::setRespa(core::List_sp levels, core::T_sp substeps)
+{
+  if (levels.nilp()) {
+    this->_RespaLevels = nil<core::T_O>();
+    this->_RespaSubsteps = nil<core::T_O>();
+    this->_RespaForces = nil<core::T_O>();
+    this->_PotentialEnergy = this->evaluateForce();
+    return;
+  }
+  if (!gc::IsA<EnergyFunction_sp>(this->_ScoringFunction)) {
+    SIMPLE_ERROR("RESPA needs the components of an energy-function - the scoring-function is {}", _rep_(this->_ScoringFunction));
+  }
+  EnergyFunction_sp energyFunction = gc::As_unsafe<EnergyFunction_sp>(this->_ScoringFunction);
+  size_t numLevels = core::cl__length(levels);
+  if (numLevels < 2) SIMPLE_ERROR("RESPA needs at least two levels - got {}", numLevels);
+  // Every component of the energy-function must be in exactly one level
+  core::List_sp components = energyFunction->allComponents();
+  std::vector<std::vector<core::T_sp>> assigned(numLevels);
+  auto levelOf = [&assigned] (core::T_sp component) -> int {
+    for ( size_t ll=0; ll<assigned.size(); ++ll ) {
+      if (std::find(assigned[ll].begin(),assigned[ll].end(),component) != assigned[ll].end()) return ll;
+    }
+    return -1;
+  };
+  size_t levelIndex = 0;
+  for ( auto cur : levels ) {
+    for ( auto comp : gc::As<core::List_sp>(CONS_CAR(cur)) ) {
+      core::T_sp component = CONS_CAR(comp);
+      bool found = false;
+      for ( auto other : components ) {
+        if (CONS_CAR(other) == component) found = true;
+      }
+      if (!found) SIMPLE_ERROR("{} is not a component of the energy-function", _rep_(component));
+      if (levelOf(component) >= 0) SIMPLE_ERROR("{} is in more than one RESPA level", _rep_(component));
+      assigned[levelIndex].push_back(component);
+    }
+    ++levelIndex;
+  }
+  for ( auto cur : components ) {
+    core::T_sp component = CONS_CAR(cur);
+    if (component.boundp() && levelOf(component) < 0) assigned[numLevels-1].push_back(component);
+  }
+  ql::list steps;
+  if (substeps.fixnump()) {
+    if (substeps.unsafe_fixnum() < 1) SIMPLE_ERROR("substeps must be positive - got {}", _rep_(substeps));
+    for ( size_t ll=1; ll<numLevels; ++ll ) steps << substeps;
+  } else {
+    if (core::cl__length(substeps) != numLevels-1) {
+      SIMPLE_ERROR("There must be {} substeps for {} levels - got {}", numLevels-1, numLevels, _rep_(substeps));
+    }
+    for ( auto cur : gc::As<core::List_sp>(substeps) ) {
+      core::T_sp step = CONS_CAR(cur);
+      if (!step.fixnump() || step.unsafe_fixnum() < 1) SIMPLE_ERROR("substeps must be positive integers - got {}", _rep_(substeps));
+      steps << step;
+    }
+  }
+  ql::list levelLists;
+  ql::list forces;
+  for ( size_t ll=0; ll<numLevels; ++ll ) {
+    ql::list level;
+    for ( auto component : assigned[ll] ) level << component;
+    levelLists << level.cons();
+    forces << NVector_O::make(this->_Position->length());
+  }
+  this->_RespaLevels = levelLists.cons();
+  this->_RespaSubsteps = steps.cons();
+  this->_RespaForces = forces.cons();
+  this->_PotentialEnergy = this->evaluateRespaLevels();
+}
+
+/*! Give each unfrozen atom a new Maxwell-Boltzmann velocity with probability 1-exp(-nu*dt) */
+void MolecularDynamics_O::andersenCollisions()
+{
+  NVector_O& vel = *this->_Velocity;
+  NVector_O& inverseMasses = *this->_InverseMasses;
+  double probability = 1.0-std::exp(-this->_CollisionFrequency*this->_Timestep);
+  double kT = MD_BOLTZMANN_KCAL*this->_Temperature*MD_KCAL_PER_AMU_TO_A2_PER_PS2;
+  std::uniform_real_distribution<double> uniform(0.0,1.0);
+  std::normal_distribution<double> normal;
+  for ( size_t ii=0; ii<inverseMasses.length(); ++ii ) {
+    if (inverseMasses[ii] == 0.0 || uniform(this->_Rng._value) >= probability) continue;
+    double sigma = std::sqrt(kT*inverseMasses[ii]);
+    for ( size_t idx=ii*3; idx<ii*3+3; ++idx ) vel[idx] = sigma*normal(this->_Rng._value);
+  }
+}
+
+void MolecularDynamics_O::report()
+{
+  if (this->_TrajectoryStride && this->_Step%this->_TrajectoryStride == 0) {
+    if (this->_CoordinateSink.notnilp()) {
+      size_t size = this->_Position->length();
+      core::SimpleVector_float_sp frame = core::SimpleVector_float_O::make(size);
+      for ( size_t ii=0; ii<size; ++ii ) (*frame)[ii] = (*this->_Position)[ii];
+      gc::As_unsafe<core::Vector_sp>(this->_CoordinateSink)->vectorPushExtend(frame);
+    }
+    if (this->_EnergySink.notnilp()) {
+      ql::list plist;
+      plist << kw::_sym_step << core::make_fixnum(this->_Step)
+            << kw::_sym_time << core::clasp_make_double_float(this->time())
+            << kw::_sym_potential << core::clasp_make_double_float(this->_PotentialEnergy)
+            << kw::_sym_kinetic << core::clasp_make_double_float(this->kineticEnergy())
+            << kw::_sym_temperature << core::clasp_make_double_float(this->temperature());
+      gc::As_unsafe<core::Vector_sp>(this->_EnergySink)->vectorPushExtend(plist.cons());
+    }
+  }
+  for ( auto cur : this->_Reporters ) {
+    core::Cons_sp reporter = gc::As_unsafe<core::Cons_sp>(CONS_CAR(cur));
+    size_t stride = core::clasp_to_size(oCar(reporter));
+    if (this->_Step%stride == 0) core::eval::funcall(oCdr(reporter),this->asSmartPtr());
+  }
+}
+
+CL_DOCSTRING(R"dx(Advance the dynamics by steps timesteps, calling the reporters and filling the
+trajectory as it goes.  Return the potential energy after the last step.)dx");
+CL_DEFMETHOD double MolecularDynamics_O::run(size_t steps)
+{
+  bool langevin = (this->_Thermostat == kw::_sym_langevin);
+  bool andersen = (this->_Thermostat == kw::_sym_andersen);
+  // The RESPA levels from innermost to outermost - the substeps of level 0 are never used
+  std::vector<RespaLevel> levels;
+  {
+    core::List_sp substeps = this->_RespaSubsteps;
+    core::List_sp forces = this->_RespaForces;
+    for ( auto cur : this->_RespaLevels ) {
+      size_t substep = 1;
+      if (!levels.empty()) {
+        substep = core::clasp_to_size(oCar(substeps));
+        substeps = oCdr(substeps);
+      }
+      levels.push_back(RespaLevel{gc::As<core::List_sp>(CONS_CAR(cur)),substep,gc::As<NVector_sp>(oCar(forces)),0.0});
+      forces = oCdr(forces);
+    }
+  }
+  for ( size_t step=0; step<steps; ++step ) {
+    if (!levels.empty()) {
+      this->respaStep(levels,levels.size()-1,this->_Timestep,langevin);
+      this->_PotentialEnergy = 0.0;
+      for ( auto& level : levels ) this->_PotentialEnergy += level._Energy;
+      if (andersen) {
+        this->andersenCollisions();
+        this->constrainVelocities();
+      }
+    } else if (langevin) {
+      this->langevinStep();
+    } else {
+      this->verletStep();
+      if (andersen) {
+        this->andersenCollisions();
+        this->constrainVelocities();
+      }
+    }
+    ++this->_Step;
+    if (this->_Barostat.notnilp()) this->barostatStep();
+    this->report();
+    // Handle queued interrupts
+    gctools::handle_all_queued_interrupts();
+  }
+  return this->_PotentialEnergy;
+}
+
+CL_DOCSTRING(R"dx(Write the current coordinates back into the atoms of the scoring-function.)dx");
+CL_DEFMETHOD void MolecularDynamics_O::saveCoordinates()
+{
+  this->_ScoringFunction->saveCoordinatesFromVector(this->_Position);
+}
+
+};
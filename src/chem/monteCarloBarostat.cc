@@ -0,0 +1,260 @@
+/*
+    File: monteCarloBarostat.cc
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+#define	DEBUG_LEVEL_NONE
+
+#include <clasp/core/foundation.h>
+#include <clasp/core/array.h>
+#include <cando/chem/monteCarloBarostat.h>
+#include <cando/chem/energyFunction.h>
+#include <cando/chem/energyAtomTable.h>
+#include <cando/chem/energyStretch.h>
+#include <cando/chem/aggregate.h>
+#include <clasp/core/wrappers.h>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace chem {
+
+// Converts bar*A^3 to kcal/mol
+#define MC_BAR_A3_TO_KCAL 1.4393264e-5
+// Boltzmann's constant in kcal/mol/K
+#define MC_BOLTZMANN_KCAL 0.0019872041
+
+SYMBOL_EXPORT_SC_(KeywordPkg,isotropic);
+SYMBOL_EXPORT_SC_(KeywordPkg,anisotropic);
+
+void MonteCarloBarostat_O::fields(core::Record_sp node)
+{
+  node->field(INTERN_(kw,EnergyFunction),this->_EnergyFunction);
+  node->field(INTERN_(kw,Components),this->_Components);
+  node->field(INTERN_(kw,MoleculeStart),this->_MoleculeStart);
+  node->field(INTERN_(kw,MoleculeAtoms),this->_MoleculeAtoms);
+  node->field(INTERN_(kw,Pressure),this->_Pressure);
+  node->field(INTERN_(kw,Frequency),this->_Frequency);
+  node->field(INTERN_(kw,Mode),this->_Mode);
+  node->field(INTERN_(kw,VolumeScale),this->_VolumeScale);
+  node->field(INTERN_(kw,Cutoff),this->_Cutoff);
+  node->field(INTERN_(kw,Attempts),this->_Attempts);
+  node->field(INTERN_(kw,Accepted),this->_Accepted);
+  node->field(INTERN_(kw,TotalAttempts),this->_TotalAttempts);
+  node->field(INTERN_(kw,TotalAccepted),this->_TotalAccepted);
+}
+
+CL_LAMBDA(energy-function &key (pressure 1.0) (frequency 25) (mode :isotropic) volume-scale cutoff);
+CL_DOCSTRING(R"dx(Make a Monte Carlo barostat for energy-function, which must have a cuboid bounding-box.
+Attach it to a molecular-dynamics engine with molecular-dynamics-set-barostat.
+: pressure - in bar.
+: frequency - the number of dynamics steps between volume moves.
+: mode - :isotropic scales the whole box and :anisotropic scales one random axis at a time.
+: volume-scale - the largest volume change in cubic angstroms.  When NIL it starts at 1% of
+the volume.  It adapts to keep about half of the moves accepted.
+: cutoff - the nonbond cutoff in angstroms.  Moves that would make a width of the box no more than
+twice the cutoff are rejected so the minimum image convention holds.  When NIL it is the cutoff
+that is used without an energy-scale, which is what molecular-dynamics evaluates with.
+Molecules are the groups of atoms connected by stretch terms.)dx");
+CL_LISPIFY_NAME(make_monte_carlo_barostat);
+CL_DEF_CLASS_METHOD MonteCarloBarostat_sp MonteCarloBarostat_O::make(EnergyFunction_sp energyFunction, double pressure, size_t frequency, core::Symbol_sp mode, core::T_sp volumeScale, core::T_sp cutoff)
+{
+  if (!energyFunction->boundingBoxBoundP()) {
+    SIMPLE_ERROR("A barostat needs an energy-function with a bounding-box");
+  }
+  if (!energyFunction->boundingBox()->cuboidp()) {
+    SIMPLE_ERROR("A barostat needs a cuboid bounding-box - got {}", _rep_(energyFunction->boundingBox()));
+  }
+  if (mode != kw::_sym_isotropic && mode != kw::_sym_anisotropic) {
+    SIMPLE_ERROR("Unknown mode {} - must be one of :isotropic :anisotropic", _rep_(mode));
+  }
+  if (frequency == 0) SIMPLE_ERROR("The barostat frequency must be positive");
+  auto me = gctools::GC<MonteCarloBarostat_O>::allocate_with_default_constructor();
+  me->_EnergyFunction = energyFunction;
+  me->_Mode = mode;
+  me->_Frequency = frequency;
+  me->setPressure(pressure);
+  me->_VolumeScale = volumeScale.notnilp() ? core::clasp_to_double(volumeScale) : 0.01*me->volume();
+  if (me->_VolumeScale <= 0.0) SIMPLE_ERROR("The volume-scale must be positive - it is {}", me->_VolumeScale);
+  me->_Cutoff = cutoff.notnilp() ? core::clasp_to_double(cutoff) : energyScaleNonbondCutoff(nil<core::T_O>());
+  BoundingBox_sp box = energyFunction->boundingBox();
+  if (!me->minimumImage(box->get_x_width(),box->get_y_width(),box->get_z_width())) {
+    SIMPLE_ERROR("Every width of the bounding-box {} must be more than twice the cutoff {}", _rep_(box), me->_Cutoff);
+  }
+  // Stretch, angle and dihedral terms are within a molecule and don't change when it moves rigidly
+  core::T_sp stretch = energyFunction->getStretchComponent();
+  core::T_sp angle = energyFunction->getAngleComponent();
+  core::T_sp dihedral = energyFunction->getDihedralComponent();
+  ql::list components;
+  for ( auto cur : energyFunction->allComponents() ) {
+    core::T_sp component = CONS_CAR(cur);
+    if (!component.boundp()) continue;
+    if (component == stretch || component == angle || component == dihedral) continue;
+    components << component;
+  }
+  me->_Components = components.cons();
+  // Molecules are the connected components of the stretch terms
+  size_t numAtoms = energyFunction->getNVectorSize()/3;
+  std::vector<size_t> parent(numAtoms);
+  std::iota(parent.begin(),parent.end(),0);
+  auto find = [&parent] (size_t ii) {
+    while (parent[ii] != ii) ii = parent[ii] = parent[parent[ii]];
+    return ii;
+  };
+  for ( auto& term : energyFunction->getStretchComponent()->_Terms ) {
+    parent[find(term.term.I1/3)] = find(term.term.I2/3);
+  }
+  std::vector<size_t> atoms(numAtoms);
+  std::iota(atoms.begin(),atoms.end(),0);
+  std::vector<size_t> root(numAtoms);
+  for ( size_t ii=0; ii<numAtoms; ++ii ) root[ii] = find(ii);
+  std::stable_sort(atoms.begin(),atoms.end(), [&root] (size_t aa, size_t bb) { return root[aa] < root[bb]; });
+  std::vector<int32_t> starts;
+  for ( size_t ii=0; ii<numAtoms; ++ii ) {
+    if (ii == 0 || root[atoms[ii]] != root[atoms[ii-1]]) starts.push_back(ii);
+  }
+  starts.push_back(numAtoms);
+  me->_MoleculeStart = core::SimpleVector_int32_t_O::make(starts.size());
+  for ( size_t ii=0; ii<starts.size(); ++ii ) (*me->_MoleculeStart)[ii] = starts[ii];
+  me->_MoleculeAtoms = core::SimpleVector_int32_t_O::make(numAtoms);
+  for ( size_t ii=0; ii<numAtoms; ++ii ) (*me->_MoleculeAtoms)[ii] = atoms[ii];
+  return me;
+}
+
+CL_DOCSTRING(R"dx(Set the pressure in bar that the barostat drives the system towards.)dx");
+CL_DEFMETHOD void MonteCarloBarostat_O::setPressure(double pressure)
+{
+  this->_Pressure = pressure;
+}
+
+CL_DOCSTRING(R"dx(Return the volume of the bounding-box of the energy-function in cubic angstroms.)dx");
+CL_DEFMETHOD double MonteCarloBarostat_O::volume() const
+{
+  BoundingBox_sp box = this->_EnergyFunction->boundingBox();
+  return box->get_x_width()*box->get_y_width()*box->get_z_width();
+}
+
+CL_DOCSTRING(R"dx(Return (values accepted attempted volume-scale) - the number of volume moves accepted and
+attempted and the current largest volume change.)dx");
+CL_DEFMETHOD core::T_mv MonteCarloBarostat_O::acceptance() const
+{
+  return Values(core::make_fixnum(this->_TotalAccepted),
+                core::make_fixnum(this->_TotalAttempts),
+                core::clasp_make_double_float(this->_VolumeScale));
+}
+
+/*! Scale the widths of the bounding box by sx, sy and sz about its center and move the
+ *  center of every molecule with it. */
+void MonteCarloBarostat_O::scaleBox(NVector_sp pos, double sx, double sy, double sz)
+{
+  BoundingBox_sp box = this->_EnergyFunction->boundingBox();
+  Vector3 center = box->get_bounding_box_center();
+  double scale[3] = {sx-1.0,sy-1.0,sz-1.0};
+  double origin[3] = {center.getX(),center.getY(),center.getZ()};
+  NVector_O& coords = *pos;
+  for ( size_t mm=0; mm<this->numberOfMolecules(); ++mm ) {
+    size_t start = (*this->_MoleculeStart)[mm], end = (*this->_MoleculeStart)[mm+1];
+    double moleculeCenter[3] = {0.0,0.0,0.0};
+    for ( size_t ii=start; ii<end; ++ii ) {
+      size_t idx = (*this->_MoleculeAtoms)[ii]*3;
+      for ( size_t cc=0; cc<3; ++cc ) moleculeCenter[cc] += coords[idx+cc];
+    }
+    double shift[3];
+    for ( size_t cc=0; cc<3; ++cc ) shift[cc] = scale[cc]*(moleculeCenter[cc]/(end-start)-origin[cc]);
+    for ( size_t ii=start; ii<end; ++ii ) {
+      size_t idx = (*this->_MoleculeAtoms)[ii]*3;
+      for ( size_t cc=0; cc<3; ++cc ) coords[idx+cc] += shift[cc];
+    }
+  }
+  Vector3 widths(box->get_x_width()*sx,box->get_y_width()*sy,box->get_z_width()*sz);
+  BoundingBox_sp scaled = gctools::GC<BoundingBox_O>::allocate(widths,box->get_bounding_box_angles_degrees(),center);
+  this->_EnergyFunction->setBoundingBox(scaled);
+}
+
+bool MonteCarloBarostat_O::minimumImage(double xWidth, double yWidth, double zWidth) const
+{
+  double smallest = 2.0*this->_Cutoff;
+  return xWidth > smallest && yWidth > smallest && zWidth > smallest;
+}
+
+bool MonteCarloBarostat_O::attempt(NVector_sp pos, core::T_sp activeAtomMask, double kT, std::mt19937_64& rng)
+{
+  std::uniform_real_distribution<double> uniform(0.0,1.0);
+  BoundingBox_sp box = this->_EnergyFunction->boundingBox();
+  double volume = this->volume();
+  double deltaVolume = this->_VolumeScale*2.0*(uniform(rng)-0.5);
+  double newVolume = volume+deltaVolume;
+  bool accepted = false;
+  double ratio = newVolume/volume;
+  double scale[3] = {1.0,1.0,1.0};
+  if (this->_Mode == kw::_sym_isotropic) {
+    scale[0] = scale[1] = scale[2] = std::cbrt(ratio);
+  } else {
+    std::uniform_int_distribution<int> axis(0,2);
+    scale[axis(rng)] = ratio;
+  }
+  if (newVolume > 0.0 && this->minimumImage(box->get_x_width()*scale[0],box->get_y_width()*scale[1],box->get_z_width()*scale[2])) {
+    double oldEnergy = this->_EnergyFunction->evaluateComponentsEnergyForce(this->_Components,pos,nil<core::T_O>(),activeAtomMask);
+    NVector_sp saved = NVector_O::make(pos->length());
+    for ( size_t ii=0; ii<pos->length(); ++ii ) (*saved)[ii] = (*pos)[ii];
+    this->scaleBox(pos,scale[0],scale[1],scale[2]);
+    double newEnergy = this->_EnergyFunction->evaluateComponentsEnergyForce(this->_Components,pos,nil<core::T_O>(),activeAtomMask);
+    double work = (newEnergy-oldEnergy)
+      + this->_Pressure*MC_BAR_A3_TO_KCAL*deltaVolume
+      - this->numberOfMolecules()*kT*std::log(ratio);
+    accepted = (work <= 0.0 || uniform(rng) < std::exp(-work/kT));
+    if (accepted) {
+      AtomTable_sp atomTable = this->_EnergyFunction->atomTable();
+      if (atomTable->boundingBoxBoundP()) atomTable->setBoundingBox(this->_EnergyFunction->boundingBox());
+    } else {
+      for ( size_t ii=0; ii<pos->length(); ++ii ) (*pos)[ii] = (*saved)[ii];
+      this->_EnergyFunction->setBoundingBox(box);
+    }
+  }
+  ++this->_Attempts;
+  ++this->_TotalAttempts;
+  if (accepted) {
+    ++this->_Accepted;
+    ++this->_TotalAccepted;
+  }
+  // Adapt the largest volume change to the acceptance rate
+  if (this->_Attempts >= 10) {
+    double rate = (double)this->_Accepted/this->_Attempts;
+    if (rate < 0.25) this->_VolumeScale /= 1.1;
+    else if (rate > 0.75) this->_VolumeScale = std::min(this->_VolumeScale*1.1,0.3*this->volume());
+    this->_Attempts = 0;
+    this->_Accepted = 0;
+  }
+  return accepted;
+}
+
+CL_LAMBDA((barostat chem:monte-carlo-barostat) pos temperature &key (seed 0) active-atom-mask);
+CL_DOCSTRING(R"dx(Attempt one volume move of the coordinates pos at temperature (kelvin) with a random number
+generator seeded with seed.  Return T if it was accepted and pos and the bounding-box of the energy-function
+were changed - a rejected move leaves both exactly as they were.)dx");
+CL_DEFMETHOD bool MonteCarloBarostat_O::attemptWithSeed(NVector_sp pos, double temperature, size_t seed, core::T_sp activeAtomMask)
+{
+  std::mt19937_64 rng(seed);
+  return this->attempt(pos,activeAtomMask,MC_BOLTZMANN_KCAL*temperature,rng);
+}
+
+};
@@ -53,6 +53,8 @@
 #include <clasp/core/hashTableEq.h>
 #include <clasp/core/evaluator.h>
 #include <cando/chem/aggregate.h>
+#include <algorithm>
+#include <thread>
 
 
 
@@ -195,6 +197,15 @@ void AddIonOctree_O::setBoundingBox(BoundingBox_sp bounding_box)
   this->_BoundingBox_z_rsize = (1.0 / bounding_box->get_z_width());
 }
 
+CL_DOCSTRING(R"dx(Set the opening angle THETA used to approximate distant groups of solute atoms when the grid charges are calculated. The default is 0.5 - smaller values are more accurate and 0 gives the exact sum over atoms.)dx");
+CL_LISPIFY_NAME("octree-set-charge-tree-theta");
+CL_DEFMETHOD
+void AddIonOctree_O::setChargeTreeTheta(double theta)
+{
+  if (theta<0.0) SIMPLE_ERROR("The charge tree theta must be >= 0.0 - it was {}", theta);
+  this->_dChargeTreeTheta = theta;
+}
+
 double AddIonOctree_O::dDistanceSq( Vector3 Pv1, Vector3 Pv2 )
 {
   if (this->_BoundingBox.unboundp()) {
@@ -1313,95 +1324,194 @@ void AddIonOctree_O::OctreeDestroy()// AddIonOctree_sp PoctTree )
 /*************************************************************************
  *************************************************************************/
 
-//static void AddIonOctree_O::OctNodeInitCharges( OctNode_sp PonNode )
-void AddIonOctree_O::OctNodeInitCharges( OctNode_sp PonNode, int iDistanceCharge)
-{
-  int	i, j, k, l, pfccount;
-  int 	ct = this->_iMaxDepth - PonNode->iDepth + 1;
-  int	iCompCharge;
-  Vector3	vPoint;
-  Atom_sp	PaAtom;
-  double	d;
-  
-  if ( PonNode->iStatus == OCT_PARTIAL ) {
-    for (i=0; i<8; i++)
-      this->OctNodeInitCharges( PonNode->PonChildren[i], iDistanceCharge);
-    return;
+// Below this many grid points the grid charges are calculated on one thread
+#define OCTREE_POINTS_PER_THREAD 4096
+// Maximum number of atoms in a leaf of the CoulombTree
+#define COULOMB_TREE_LEAF_ATOMS 8
+// Number of cut distances whose solute exclusion tests are kept in each node
+#define OCTREE_COMP_OK_CUT_DISTS 4
+
+/*! A Barnes-Hut tree over the solute charges used by OctreeInitCharges.
+ *  Every node keeps the total charge and the dipole of its atoms about
+ *  its center so a distant node contributes q/r + p.dx/r^3
+ *  (q/r^2 + 2p.dx/r^4 for the distance dependent dielectric) rather
+ *  than a sum over its atoms.
+ *  A node is only approximated if the point is further from all of its atoms
+ *  than the largest _dAtomTemp exclusion distance, so the exclusion test
+ *  is the same as the full sum. With theta = 0 the sum is exact.
+ */
+struct CoulombTree {
+  struct Charge {
+    Vector3 _Pos;
+    double  _Charge;
+    double  _Temp;
+  };
+  struct Node {
+    Vector3 _Center;
+    double  _Radius;
+    double  _Charge;
+    Vector3 _Dipole;
+    double  _MaxExclusion;
+    size_t  _Begin, _End;
+    int     _NumChildren;
+    size_t  _Children[8];
+  };
+  std::vector<Charge> _Charges;
+  std::vector<Node>   _Nodes;
+  int    _DistanceCharge;
+  double _Theta;
+
+  CoulombTree(gctools::Vec0<Atom_sp>& vaAtoms, int iDistanceCharge, double theta)
+      : _DistanceCharge(iDistanceCharge), _Theta(theta) {
+    this->_Charges.reserve(vaAtoms.size());
+    for ( size_t ii=0; ii<vaAtoms.size(); ii++ ) {
+      Charge charge;
+      charge._Pos = vaAtoms[ii]->getPosition();
+      charge._Charge = vaAtoms[ii]->_Charge;
+      charge._Temp = vaAtoms[ii]->_dAtomTemp;
+      this->_Charges.push_back(charge);
+    }
+    if (this->_Charges.size()>0) this->build(0,this->_Charges.size());
   }
 
-  if ( PonNode->iStatus == OCT_EXCLUDED )
-    return;
-  
-	/*
-	 *  Node is included: calculate charges.
-	 * 	Set node pointer into master charge array 
-	 */
-//  PonNode->_PfCharges = PfCharges;
-	/* 
-	 *  For each point x,y,z in this quadrant, 
-	 *	loop over atoms, accumulating charge 
-	 */
-  vPoint.getX() = PonNode->vCorner.getX();
+  size_t partition(size_t begin, size_t end, int axis, double value) {
+    return std::partition(this->_Charges.begin()+begin,this->_Charges.begin()+end,
+                          [axis,value] (const Charge& charge) { return charge._Pos[axis] < value; })
+        - this->_Charges.begin();
+  }
 
-  pfccount = 0;
-  for (i=0; i<ct; i++, vPoint.getX()+=this->dGridSize) {
+  size_t build(size_t begin, size_t end) {
+    size_t index = this->_Nodes.size();
+    this->_Nodes.emplace_back();
+    Node node;
+    Vector3 vMin = this->_Charges[begin]._Pos;
+    Vector3 vMax = vMin;
+    for ( size_t ii=begin+1; ii<end; ii++ ) {
+      for ( int axis=0; axis<3; axis++ ) {
+        vMin[axis] = std::min(vMin[axis],this->_Charges[ii]._Pos[axis]);
+        vMax[axis] = std::max(vMax[axis],this->_Charges[ii]._Pos[axis]);
+      }
+    }
+    node._Center = (vMin+vMax)*0.5;
+    node._Charge = 0.0;
+    node._Dipole = Vector3(0.0,0.0,0.0);
+    node._MaxExclusion = 0.0;
+    node._Begin = begin;
+    node._End = end;
+    node._NumChildren = 0;
+    double radius2 = 0.0;
+    for ( size_t ii=begin; ii<end; ii++ ) {
+      const Charge& charge = this->_Charges[ii];
+      Vector3 delta = charge._Pos-node._Center;
+      radius2 = std::max(radius2,delta.dotProduct(delta));
+      node._Charge += charge._Charge;
+      node._Dipole = node._Dipole+delta*charge._Charge;
+      double exclusion = this->_DistanceCharge ? charge._Temp : sqrt(std::max(0.0,charge._Temp));
+      node._MaxExclusion = std::max(node._MaxExclusion,exclusion);
+    }
+    node._Radius = sqrt(radius2);
+    if ( end-begin > COULOMB_TREE_LEAF_ATOMS && radius2 > 0.0 ) {
+      // Split into octants about the center - any axis with extent puts atoms on both sides
+      size_t bounds[9];
+      bounds[0] = begin;
+      bounds[8] = end;
+      bounds[4] = this->partition(bounds[0],bounds[8],0,node._Center.getX());
+      bounds[2] = this->partition(bounds[0],bounds[4],1,node._Center.getY());
+      bounds[6] = this->partition(bounds[4],bounds[8],1,node._Center.getY());
+      for ( int oct=1; oct<8; oct+=2 )
+        bounds[oct] = this->partition(bounds[oct-1],bounds[oct+1],2,node._Center.getZ());
+      for ( int oct=0; oct<8; oct++ ) {
+        if ( bounds[oct+1] > bounds[oct] )
+          node._Children[node._NumChildren++] = this->build(bounds[oct],bounds[oct+1]);
+      }
+    }
+    this->_Nodes[index] = node;
+    return index;
+  }
+
+  void accumulate(size_t index, const Vector3& vPoint, double& dCharge, bool& bCompOk) const {
+    const Node& node = this->_Nodes[index];
+    if ( node._NumChildren > 0 ) {
+      Vector3 delta = vPoint-node._Center;
+      double r2 = delta.dotProduct(delta);
+      double r = sqrt(r2);
+      if ( r-node._Radius > node._MaxExclusion && node._Radius < this->_Theta*r ) {
+        if ( this->_DistanceCharge )
+          dCharge += node._Charge/r + node._Dipole.dotProduct(delta)/(r2*r);
+        else
+          dCharge += node._Charge/r2 + 2.0*node._Dipole.dotProduct(delta)/(r2*r2);
+        return;
+      }
+      for ( int child=0; child<node._NumChildren; child++ )
+        this->accumulate(node._Children[child],vPoint,dCharge,bCompOk);
+      return;
+    }
+    for ( size_t ii=node._Begin; ii<node._End; ii++ ) {
+      const Charge& charge = this->_Charges[ii];
+      double dX = vPoint.getX() - charge._Pos.getX();
+      double dY = vPoint.getY() - charge._Pos.getY();
+      double dZ = vPoint.getZ() - charge._Pos.getZ();
+      double d = dX*dX + dY*dY + dZ*dZ;
+      if ( this->_DistanceCharge )
+        d = sqrt(d);
+      dCharge += charge._Charge / d;
+      if ( d < charge._Temp )
+        bCompOk = false;
+    }
+  }
+
+  float charge(const Vector3& vPoint, bool& bCompOk) const {
+    double dCharge = 0.0;
+    bCompOk = true;
+    if (this->_Nodes.size()>0) this->accumulate(0,vPoint,dCharge,bCompOk);
+    return dCharge;
+  }
+};
+
+/*! Append the grid points of an included node in the order of its _PfCharges */
+static void octNodeGridPoints(OctNode_sp PonNode, int ct, double dGridSize, std::vector<Vector3>& vPoints)
+{
+  Vector3 vPoint;
+  int i, j, k;
+  vPoint.getX() = PonNode->vCorner.getX();
+  for (i=0; i<ct; i++, vPoint.getX()+=dGridSize) {
     vPoint.getY() = PonNode->vCorner.getY();
-    for (j=0; j<ct; j++, vPoint.getY()+=this->dGridSize) {
+    for (j=0; j<ct; j++, vPoint.getY()+=dGridSize) {
       vPoint.getZ() = PonNode->vCorner.getZ();
-      for (k=0; k<ct; k++, vPoint.getZ()+=this->dGridSize) {
-			/*
-			 *  Got point: loop over atoms, accumulating charge.
-			 */
-        PonNode->_PfCharges.push_back(0.0);
-        iCompCharge = 1;
-        for (l=0; l< this->vaAtoms.size(); l++){ //iChargeAtoms; l++) {
-          //printf("In the loop i= %d j= %d k= %d l= %d \n", i, j, k, l);
-          PaAtom = this->vaAtoms[l] ;//PaChargeAtoms[l];
-          double 	dX, dY, dZ;
-          
-				//dX = vPoint.getX() - vAtomPosition(*PaAtom).getX();
-          dX = vPoint.getX() - PaAtom->getPosition().getX();
-          dX = dX * dX;
-				//dY = vPoint.getY() - vAtomPosition(*PaAtom).getY();
-          dY = vPoint.getY() - PaAtom->getPosition().getY();
-          dY = dY * dY;
-				//dZ = vPoint.getZ() - vAtomPosition(*PaAtom).getZ();
-          dZ = vPoint.getZ() - PaAtom->getPosition().getZ();
-          dZ = dZ * dZ;
-          d = dX + dY + dZ;
-          if ( iDistanceCharge )
-            d = sqrt(d);
-          PonNode->_PfCharges[pfccount] += PaAtom->_Charge / d;
-				//if ( d < dAtomTemp(PaAtom) )
-          if ( d < PaAtom->_dAtomTemp )
-            iCompCharge = 0;
-        }
-//	printf("%s:%d:%s vPoint -> %d, %d, %d, %f\n", __FILE__, __LINE__, __FUNCTION__, PonNode->iStatus, PonNode->iNodeNum, PonNode->iDepth, PonNode->_PfCharges[pfccount]);
-        if ( iCompCharge ) {
-				/*
-				 *  Keep track of max, min charges and 
-				 *	their locations.
-				 */
-          if ( PonNode->_PfCharges[pfccount] > this->fMaxCharge ) {
-            this->fMaxCharge =  PonNode->_PfCharges[pfccount];
-            this->vMaxCharge = vPoint;
-          } else if (  PonNode->_PfCharges[pfccount] < this->fMinCharge ) {
-            this->fMinCharge =  PonNode->_PfCharges[pfccount];
-            this->vMinCharge = vPoint;
-          }
-        }
-        pfccount++;
-      }
+      for (k=0; k<ct; k++, vPoint.getZ()+=dGridSize)
+        vPoints.push_back(vPoint);
     }
   }
+}
 
-  for (l=0; l< PonNode->_PfCharges.size(); l++) {
-    this->_PfCharges.push_back(PonNode->_PfCharges[l]);
-    this->iNodeNumCharges.push_back(PonNode->iNodeNum);
+/*! Run work(begin,end) over [0,numPoints) split between threads */
+template <typename Work>
+static void octreeParallelPoints(size_t numPoints, Work work)
+{
+  size_t numThreads = std::max(1U,std::thread::hardware_concurrency());
+  numThreads = std::max((size_t)1,std::min(numThreads,numPoints/OCTREE_POINTS_PER_THREAD));
+  size_t block = (numPoints+numThreads-1)/numThreads;
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads-1);
+  for ( size_t tid=1; tid<numThreads; ++tid )
+    threads.emplace_back(work,std::min(numPoints,tid*block),std::min(numPoints,(tid+1)*block));
+  work(0,std::min(numPoints,block));
+  for ( auto& thread : threads ) thread.join();
+}
+
+//static void AddIonOctree_O::OctNodeInitCharges( OctNode_sp PonNode )
+void AddIonOctree_O::OctNodeCollectIncluded( OctNode_sp PonNode, gctools::Vec0<OctNode_sp>& vaLeaves)
+{
+  int	i;
+  if ( PonNode->iStatus == OCT_PARTIAL ) {
+    for (i=0; i<8; i++)
+      this->OctNodeCollectIncluded( PonNode->PonChildren[i], vaLeaves);
+    return;
   }
 
-  
-  return;
+  if ( PonNode->iStatus == OCT_EXCLUDED )
+    return;
+  vaLeaves.push_back(PonNode);
 }
 //CL_DEFMETHOD void AddIonOctree_O::AddIonOctreeInitCharges( AddIonOctree_sp octTree, int iAtomOption, int iDielectric, double dCutDist,
 //                         Vector3& vMin, Vector3& vMax )
@@ -1470,9 +1580,48 @@ CL_DEFMETHOD core::T_mv AddIonOctree_O::OctreeInitCharges( /*AddIonOctree_sp oct
 
 
 	/*
-	 *  Descend the octree.
+	 *  Collect the included nodes and calculate the charge at
+	 *	their grid points from the charge tree in parallel.
 	 */
-  this->OctNodeInitCharges( this->onHead, iDistanceCharge);
+  CoulombTree chargeTree(this->vaAtoms,iDistanceCharge,this->_dChargeTreeTheta);
+  gctools::Vec0<OctNode_sp> vaLeaves;
+  this->OctNodeCollectIncluded( this->onHead, vaLeaves);
+  std::vector<Vector3> vPoints;
+  for (i=0; i<vaLeaves.size(); i++)
+    octNodeGridPoints(vaLeaves[i],this->_iMaxDepth - vaLeaves[i]->iDepth + 1,this->dGridSize,vPoints);
+  std::vector<float> fCharges(vPoints.size());
+  std::vector<char> cCompOk(vPoints.size());
+  octreeParallelPoints(vPoints.size(), [&chargeTree,&vPoints,&fCharges,&cCompOk] (size_t begin, size_t end) {
+    for ( size_t ii=begin; ii<end; ii++ ) {
+      bool bCompOk;
+      fCharges[ii] = chargeTree.charge(vPoints[ii],bCompOk);
+      cCompOk[ii] = bCompOk;
+    }
+  });
+	/*
+	 *  Store the charges in the nodes and keep track of
+	 *	max, min charges and their locations.
+	 */
+  size_t iPoint = 0;
+  for (i=0; i<vaLeaves.size(); i++) {
+    OctNode_sp PonNode = vaLeaves[i];
+    int ct = this->_iMaxDepth - PonNode->iDepth + 1;
+    PonNode->_PfCharges.clear();
+    for (int l=0; l<ct*ct*ct; l++, iPoint++) {
+      PonNode->_PfCharges.push_back(fCharges[iPoint]);
+      if ( cCompOk[iPoint] ) {
+        if ( fCharges[iPoint] > this->fMaxCharge ) {
+          this->fMaxCharge = fCharges[iPoint];
+          this->vMaxCharge = vPoints[iPoint];
+        } else if ( fCharges[iPoint] < this->fMinCharge ) {
+          this->fMinCharge = fCharges[iPoint];
+          this->vMinCharge = vPoints[iPoint];
+        }
+      }
+      this->_PfCharges.push_back(fCharges[iPoint]);
+      this->iNodeNumCharges.push_back(PonNode->iNodeNum);
+    }
+  }
 // vMin = vMinCharge;
 // vMax = vMaxCharge;
 
@@ -2047,6 +2196,35 @@ CL_DEFMETHOD void AddIonOctree_O::OctNodeUpdateCharge( OctNode_sp PonNode, int i
   }
 
 }
+/*! Collect the included nodes below PonNode along with the atoms used to
+ *  check their points - the node's own atom list or else its parent's.
+ *  The atoms of vaLeaves[i] are vAtomPositions[iLeafAtomStart[i]] .. vAtomPositions[iLeafAtomStart[i+1]-1]
+ */
+void AddIonOctree_O::OctNodeCollectIncludedWithAtoms( OctNode_sp PonNode, int iParentAtoms, gctools::Vec0<Atom_sp>& PaParentAtoms,
+                                                      gctools::Vec0<OctNode_sp>& vaLeaves, std::vector<Vector3>& vAtomPositions,
+                                                      std::vector<double>& dAtomTemps, std::vector<size_t>& iLeafAtomStart )
+{
+  int i;
+  if ( PonNode->iStatus == OCT_PARTIAL ) {
+    for (i=0; i<8; i++)
+      this->OctNodeCollectIncludedWithAtoms( PonNode->PonChildren[i], PonNode->iAtoms, PonNode->PaAtomList,
+                                             vaLeaves, vAtomPositions, dAtomTemps, iLeafAtomStart );
+    return;
+  }
+  if ( PonNode->iStatus == OCT_EXCLUDED )
+    return;
+  gctools::Vec0<Atom_sp>& PaAtoms = ( PonNode->PaAtomList.size() > 0 ) ? PonNode->PaAtomList : PaParentAtoms;
+  int iAtoms = ( PonNode->PaAtomList.size() > 0 ) ? PonNode->iAtoms : iParentAtoms;
+  iAtoms = std::min(iAtoms,(int)PaAtoms.size());
+  if (iLeafAtomStart.size()==0) iLeafAtomStart.push_back(0);
+  for (i=0; i<iAtoms; i++) {
+    vAtomPositions.push_back(PaAtoms[i]->getPosition());
+    dAtomTemps.push_back(PaAtoms[i]->_dAtomTemp);
+  }
+  vaLeaves.push_back(PonNode);
+  iLeafAtomStart.push_back(vAtomPositions.size());
+}
+
 //CL_DEFMETHOD void AddIonOctree_O::AddIonOctreeUpdateCharge( AddIonOctree_sp octTree, Vector3 vNewPoint, float fCharge, double dCutDist,
 //                          Vector3 vMax, Vector3 vMin )
 CL_DEFMETHOD core::T_mv AddIonOctree_O::OctreeUpdateCharge( /*AddIonOctree_sp octTree,*/ Vector3 vNewPoint, float fCharge, double dCutDist)
@@ -2088,10 +2266,111 @@ CL_DEFMETHOD core::T_mv AddIonOctree_O::OctreeUpdateCharge( /*AddIonOctree_sp oc
   this->iNodeNumCharges.clear();
 
 	/*
-	 *  Descend octree.
-	 */
-  this->OctNodeUpdateCharge( this->onHead, iChargeAtoms, 
-                             this->vaAtoms, iDistanceCharge) ; //PVAI( octTree->vaAtoms, ATOM, 0 ) );
+	 *  Collect the included nodes, add the new charge at every
+	 *	point and check the points against the neighboring atoms
+	 *	in parallel. The checks only depend on dCutDist so they are
+	 *	kept in the nodes for each cut distance - add-ions alternates
+	 *	between the cut distances of its ions.
+	 */
+  gctools::Vec0<OctNode_sp> vaLeaves;
+  std::vector<Vector3> vAtomPositions;
+  std::vector<double> dAtomTemps;
+  std::vector<size_t> iLeafAtomStart;
+  this->OctNodeCollectIncludedWithAtoms( this->onHead, iChargeAtoms, this->vaAtoms,
+                                         vaLeaves, vAtomPositions, dAtomTemps, iLeafAtomStart );
+  std::vector<Vector3> vPoints;
+  std::vector<size_t> iPointLeaf;
+  std::vector<float> fCharges;
+  std::vector<char> cCompOk;
+  std::vector<char> cCompCached;
+  std::vector<size_t> iLeafCacheSlot;
+  for (i=0; i<vaLeaves.size(); i++) {
+    OctNode_sp PonNode = vaLeaves[i];
+    int ct = this->_iMaxDepth - PonNode->iDepth + 1;
+    size_t iStart = vPoints.size();
+    octNodeGridPoints(PonNode,ct,this->dGridSize,vPoints);
+    size_t iNum = vPoints.size()-iStart;
+    size_t iSlots = PonNode->_PdCompOkCutDists.size();
+    if ( PonNode->_PcCompOk.size() != iSlots*iNum ) {
+      PonNode->_PdCompOkCutDists.clear();
+      PonNode->_PcCompOk.clear();
+      iSlots = 0;
+    }
+    size_t iSlot = 0;
+    while ( iSlot<iSlots && PonNode->_PdCompOkCutDists[iSlot] != dCutDist ) iSlot++;
+    bool bCached = ( iSlot<iSlots );
+    for (size_t l=0; l<iNum; l++) {
+      iPointLeaf.push_back(i);
+      fCharges.push_back(PonNode->_PfCharges[l]);
+      cCompOk.push_back(bCached ? PonNode->_PcCompOk[iSlot*iNum+l] : 1);
+      cCompCached.push_back(bCached);
+    }
+    if ( !bCached ) {
+      if ( iSlots == OCTREE_COMP_OK_CUT_DISTS ) {
+        PonNode->_PdCompOkCutDists.clear();
+        PonNode->_PcCompOk.clear();
+        iSlot = 0;
+      }
+      PonNode->_PdCompOkCutDists.push_back(dCutDist);
+      PonNode->_PcCompOk.resize(PonNode->_PdCompOkCutDists.size()*iNum,0);
+    }
+    iLeafCacheSlot.push_back(iSlot);
+  }
+  Vector3 vNew = this->vNewPoint;
+  float fNew = this->fNewCharge;
+  octreeParallelPoints(vPoints.size(), [&,vNew,fNew,iDistanceCharge] (size_t begin, size_t end) {
+    for ( size_t ii=begin; ii<end; ii++ ) {
+      const Vector3& vPoint = vPoints[ii];
+      double dX = vNew.getX() - vPoint.getX();
+      double dY = vNew.getY() - vPoint.getY();
+      double dZ = vNew.getZ() - vPoint.getZ();
+      double d = dX*dX + dY*dY + dZ*dZ;
+      if ( iDistanceCharge )
+        d = sqrt(d);
+      fCharges[ii] += fNew / d;
+      if ( cCompCached[ii] ) continue;
+      size_t leaf = iPointLeaf[ii];
+      for ( size_t l=iLeafAtomStart[leaf]; l<iLeafAtomStart[leaf+1]; l++ ) {
+        dX = vAtomPositions[l].getX() - vPoint.getX();
+        dY = vAtomPositions[l].getY() - vPoint.getY();
+        dZ = vAtomPositions[l].getZ() - vPoint.getZ();
+        if ( dX*dX + dY*dY + dZ*dZ < dAtomTemps[l] ) {
+          cCompOk[ii] = 0;
+          break;
+        }
+      }
+    }
+  });
+	/*
+	 *  Store the charges and checks in the nodes and keep track of
+	 *	max, min charges and their locations.
+	 */
+  size_t iPoint = 0;
+  for (i=0; i<vaLeaves.size(); i++) {
+    OctNode_sp PonNode = vaLeaves[i];
+    int ct = this->_iMaxDepth - PonNode->iDepth + 1;
+    size_t iNum = ct*ct*ct;
+    size_t iSlot = iLeafCacheSlot[i];
+    for (size_t l=0; l<iNum; l++, iPoint++) {
+      float PfCharge = fCharges[iPoint];
+      if ( cCompOk[iPoint] ) {
+        if (PfCharge > this->fMaxCharge ) {
+          this->fMaxCharge = PfCharge;
+          this->vMaxCharge = vPoints[iPoint];
+        } else if (PfCharge < this->fMinCharge ) {
+          this->fMinCharge = PfCharge;
+          this->vMinCharge = vPoints[iPoint];
+        }
+      } else {
+				/* HACK to ensure printgrid coloring ok */
+        PfCharge = 0.0;
+      }
+      PonNode->_PfCharges[l] = PfCharge;
+      PonNode->_PcCompOk[iSlot*iNum+l] = cCompOk[iPoint];
+      this->_PfCharges.push_back(PfCharge);
+      this->iNodeNumCharges.push_back(PonNode->iNodeNum);
+    }
+  }
 //  vMin = vMinCharge;
 //  vMax = vMaxCharge;
 	/*
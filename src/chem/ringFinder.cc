@@ -33,6 +33,8 @@ This is an open source license for the CANDO software from Temple University, bu
    by Balducci and Pearlman in  J. Chem. Inf. Comput. Sci. Vol 34, No. 4, 1994
 
    It works well for small molecules <2048 atoms but not for very large systems.
+   identifyRings now uses RingPerception (ringPerception.cc) - the message passing
+   RingFinder_O is kept for findRings.
 */
 
 /*
@@ -50,6 +52,7 @@ __END_DOC
 #include <clasp/core/hashTableEql.h>
 #include <clasp/core/hashTableEq.h>
 #include <cando/chem/ringFinder.h>
+#include <cando/chem/matterGraph.h>
 #include <clasp/core/array.h>
 #include <cando/chem/atom.h>
 #include <cando/chem/residue.h>
@@ -62,6 +65,7 @@ __END_DOC
 #include <clasp/core/lispDefinitions.h>
 #include <clasp/core/wrappers.h>
 #include <clasp/core/evaluator.h>
+#include <clasp/core/ql.h>
 
 namespace chem {
 
@@ -939,6 +943,14 @@ CL_DEFMETHOD core::List_sp RingFinder_O::getAllRingsAsListsOfAtoms()
 
 
 
+/*! Run RingPerception over a MatterGraph snapshot of the molecule.
+ * Return the SSSR or, if relevant is true, the relevant cycles as lists of atoms in ring order.
+ */
+static core::List_sp perceive_rings_in_molecule(Molecule_sp molecule, bool relevant)
+{
+  return MatterGraph_O::make(molecule,false,false)->rings(relevant);
+}
+
 core::List_sp RingFinder_O::identifyRingsInMolecule(Molecule_sp molecule)
 {
      	//
@@ -965,27 +977,41 @@ core::List_sp RingFinder_O::identifyRingsInMolecule(Molecule_sp molecule)
 	}
     }
     if (numAtoms<3) return nil<core::T_O>();
-    RingFinder_sp atomGraph = RingFinder_O::make(molecule);
-    {
-      atomGraph->findRings(numAtoms);
-    }
-    core::List_sp rings = nil<core::T_O>();
-    {
-	rings = atomGraph->getAllRingsAsListsOfAtoms();
-	for ( auto curRing : rings ) {
-          core::List_sp atoms = oCar(curRing);
-          uint ringSize = core::cl__length(atoms);
-	    for ( auto atomCons : atoms ) {
-              Atom_sp atom = oCar(atomCons).as<Atom_O>();
-		atom->setInRingOfSize(ringSize);
-		atom->incrementRingMembershipCount();
-		LOG("Set {} as part of ring[{}]" , atom->description() , ringSize);
-	    }
-	}
+    core::List_sp rings = perceive_rings_in_molecule(molecule,false);
+    for ( auto curRing : rings ) {
+      core::List_sp atoms = oCar(curRing);
+      uint ringSize = core::cl__length(atoms);
+      for ( auto atomCons : atoms ) {
+        Atom_sp atom = oCar(atomCons).as<Atom_O>();
+        atom->setInRingOfSize(ringSize);
+        atom->incrementRingMembershipCount();
+        LOG("Set {} as part of ring[{}]" , atom->description() , ringSize);
+      }
     }
     return rings;
 }
 
+CL_DOCSTRING(R"dx(Return the relevant cycles (the union of all smallest sets of smallest rings) of the molecule or aggregate
+as a list of lists of atoms in ring order.  Unlike chem:identify-rings the ring membership flags of the atoms are not changed.)dx");
+DOCGROUP(cando);
+CL_DEFUN core::List_sp chem__relevant_cycles(Matter_sp matter)
+{
+  if ( matter.isA<Molecule_O>() ) {
+    return perceive_rings_in_molecule(matter.as<Molecule_O>(),true);
+  }
+  if ( matter.isA<Aggregate_O>() ) {
+    core::List_sp allRings = nil<core::T_O>();
+    Loop molecules;
+    molecules.loopTopGoal(matter,MOLECULES);
+    while ( molecules.advance() ) {
+      core::List_sp rings = perceive_rings_in_molecule(molecules.getMolecule(),true);
+      for ( auto cur : rings ) allRings = core::Cons_O::create(oCar(cur),allRings);
+    }
+    return allRings;
+  }
+  SIMPLE_ERROR("You can only find rings in aggregates or molecules");
+}
+
 
 
 
@@ -0,0 +1,404 @@
+/*
+    File: ringPerception.cc
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University
+at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+/* -^- */
+
+/* Smallest set of smallest rings and relevant cycles.
+
+   The candidate cycles are generated as described by
+   P. Vismara, "Union of all the minimum cycle bases of a graph",
+   Electronic Journal of Combinatorics 4 (1997) #R9
+   and selected by Gaussian elimination over GF(2) on packed edge bitsets
+   as in J.D. Horton's minimum cycle basis algorithm.
+
+   This file is plain C++ - it knows nothing about atoms.
+*/
+
+#include <algorithm>
+#include <set>
+#include <map>
+#include <unordered_map>
+#include <cando/chem/ringPerception.h>
+
+namespace chem {
+
+static constexpr size_t NoVertex = ~(size_t)0;
+
+namespace {
+
+struct PackedBits {
+  std::vector<uint64_t> _Words;
+  PackedBits(size_t bits) : _Words((bits + 63) / 64, 0) {};
+  void set(size_t bit) { this->_Words[bit / 64] |= (1ull << (bit % 64)); };
+  void xorWith(const PackedBits& other) {
+    for (size_t ii = 0; ii < this->_Words.size(); ++ii) this->_Words[ii] ^= other._Words[ii];
+  }
+  size_t lowest() const {
+    for (size_t ii = 0; ii < this->_Words.size(); ++ii) {
+      if (this->_Words[ii]) return ii * 64 + __builtin_ctzll(this->_Words[ii]);
+    }
+    return NoVertex;
+  }
+};
+
+/*! Rows in echelon form - every row has a distinct lowest bit (pivot) */
+struct CycleBasis {
+  std::vector<PackedBits> _Rows;
+  std::vector<int>        _PivotRow;
+  CycleBasis(size_t bits) : _PivotRow(bits, -1) {};
+  size_t rank() const { return this->_Rows.size(); };
+  // Reduce bits against the rows, return the pivot of what is left or NoVertex if it reduced to zero
+  size_t reduce(PackedBits& bits) const {
+    while (true) {
+      size_t pivot = bits.lowest();
+      if (pivot == NoVertex) return NoVertex;
+      int row = this->_PivotRow[pivot];
+      if (row < 0) return pivot;
+      bits.xorWith(this->_Rows[row]);
+    }
+  }
+  bool independent(const PackedBits& bits) const {
+    PackedBits copy(bits);
+    return this->reduce(copy) != NoVertex;
+  }
+  bool add(const PackedBits& bits) {
+    PackedBits copy(bits);
+    size_t pivot = this->reduce(copy);
+    if (pivot == NoVertex) return false;
+    this->_PivotRow[pivot] = this->_Rows.size();
+    this->_Rows.push_back(copy);
+    return true;
+  }
+};
+
+/*! Shortest paths out of one root restricted to lower numbered vertices - Vismara's V_r */
+struct RootPaths {
+  std::vector<size_t>              _Distance;
+  std::vector<bool>                _InVr;
+  std::vector<std::vector<size_t>> _Pred;
+  std::vector<size_t>              _BfsOrder;
+};
+
+struct Candidate {
+  size_t     _Length;
+  size_t     _Root;
+  size_t     _Y;
+  size_t     _Z;      // odd cycles: y-z is the closing edge
+  size_t     _P;      // even cycles: p-y-q closes the ring
+  size_t     _Q;
+  bool       _Even;
+  PackedBits _Bits;
+  std::vector<size_t> _Vertices;
+  Candidate(size_t numEdges) : _Length(0), _Root(0), _Y(0), _Z(0), _P(0), _Q(0), _Even(false), _Bits(numEdges) {};
+};
+
+struct Component {
+  size_t                                           _NumVertices;
+  size_t                                           _NumEdges;
+  std::vector<size_t>                              _Global;    // local -> global vertex
+  std::vector<std::vector<std::pair<size_t,size_t>>> _Adjacency; // (neighbor, edge id)
+
+  size_t edgeId(size_t v1, size_t v2) const {
+    for (auto& nb : this->_Adjacency[v1]) if (nb.first == v2) return nb.second;
+    return NoVertex;
+  }
+
+  RootPaths rootPaths(size_t root) const {
+    RootPaths rp;
+    rp._Distance.assign(this->_NumVertices, NoVertex);
+    rp._InVr.assign(this->_NumVertices, false);
+    rp._Pred.resize(this->_NumVertices);
+    rp._Distance[root] = 0;
+    rp._BfsOrder.push_back(root);
+    for (size_t head = 0; head < rp._BfsOrder.size(); ++head) {
+      size_t v = rp._BfsOrder[head];
+      for (auto& nb : this->_Adjacency[v]) {
+        if (rp._Distance[nb.first] == NoVertex) {
+          rp._Distance[nb.first] = rp._Distance[v] + 1;
+          rp._BfsOrder.push_back(nb.first);
+        }
+      }
+    }
+    rp._InVr[root] = true;
+    for (size_t y : rp._BfsOrder) {
+      if (y >= root) continue;
+      for (auto& nb : this->_Adjacency[y]) {
+        size_t p = nb.first;
+        if (rp._Distance[p] + 1 == rp._Distance[y] && rp._InVr[p]) rp._Pred[y].push_back(p);
+      }
+      rp._InVr[y] = !rp._Pred[y].empty();
+    }
+    return rp;
+  }
+
+  // The path root...v following the first predecessor
+  static std::vector<size_t> firstPath(const RootPaths& rp, size_t root, size_t v) {
+    std::vector<size_t> path;
+    for (size_t cur = v; cur != root; cur = rp._Pred[cur][0]) path.push_back(cur);
+    path.push_back(root);
+    std::reverse(path.begin(), path.end());
+    return path;
+  }
+
+  // Every shortest path root...v through V_r, at most limit of them
+  static void allPaths(const RootPaths& rp, size_t root, size_t v, size_t limit, std::vector<size_t>& tail,
+                       std::vector<std::vector<size_t>>& paths) {
+    if (paths.size() >= limit) return;
+    tail.push_back(v);
+    if (v == root) {
+      paths.emplace_back(tail.rbegin(), tail.rend());
+    } else {
+      for (size_t p : rp._Pred[v]) allPaths(rp, root, p, limit, tail, paths);
+    }
+    tail.pop_back();
+  }
+
+  // Two paths from root that only share the root
+  static bool disjoint(const std::vector<size_t>& path1, const std::vector<size_t>& path2) {
+    for (size_t ii = 1; ii < path1.size(); ++ii)
+      for (size_t jj = 1; jj < path2.size(); ++jj)
+        if (path1[ii] == path2[jj]) return false;
+    return true;
+  }
+
+  // Close the ring root..path1..[apex]..reverse(path2) and fill in the vertices and edge bits
+  bool makeCycle(const std::vector<size_t>& path1, size_t apex, const std::vector<size_t>& path2, Candidate& cand) const {
+    if (!disjoint(path1, path2)) return false;
+    cand._Vertices = path1;
+    if (apex != NoVertex) cand._Vertices.push_back(apex);
+    for (size_t jj = path2.size() - 1; jj >= 1; --jj) cand._Vertices.push_back(path2[jj]);
+    cand._Length = cand._Vertices.size();
+    cand._Bits = PackedBits(this->_NumEdges);
+    for (size_t ii = 0; ii < cand._Length; ++ii) {
+      size_t edge = this->edgeId(cand._Vertices[ii], cand._Vertices[(ii + 1) % cand._Length]);
+      if (edge == NoVertex) return false;
+      cand._Bits.set(edge);
+    }
+    return true;
+  }
+};
+
+};
+
+void RingPerception::addEdge(size_t v1, size_t v2) {
+  if (v1 == v2) return;
+  for (size_t nb : this->_Adjacency[v1]) if (nb == v2) return;
+  this->_Adjacency[v1].push_back(v2);
+  this->_Adjacency[v2].push_back(v1);
+}
+
+void RingPerception::stripAcyclic_(std::vector<bool>& alive) const {
+  std::vector<size_t> degree(this->_NumVertices);
+  std::vector<size_t> queue;
+  for (size_t v = 0; v < this->_NumVertices; ++v) {
+    degree[v] = this->_Adjacency[v].size();
+    if (degree[v] <= 1) queue.push_back(v);
+  }
+  while (!queue.empty()) {
+    size_t v = queue.back();
+    queue.pop_back();
+    if (!alive[v]) continue;
+    alive[v] = false;
+    for (size_t w : this->_Adjacency[v]) {
+      if (alive[w] && --degree[w] == 1) queue.push_back(w);
+    }
+  }
+}
+
+void RingPerception::biconnectedComponents_(const std::vector<bool>& alive,
+                                            std::vector<std::vector<std::pair<size_t,size_t>>>& components) const {
+  // Iterative Tarjan - deep recursion on long chains of rings would blow the stack
+  struct Frame { size_t _Vertex; size_t _Parent; size_t _Next; };
+  std::vector<size_t> disc(this->_NumVertices, NoVertex);
+  std::vector<size_t> low(this->_NumVertices, 0);
+  std::vector<std::pair<size_t,size_t>> edgeStack;
+  std::vector<Frame> stack;
+  size_t time = 0;
+  for (size_t start = 0; start < this->_NumVertices; ++start) {
+    if (!alive[start] || disc[start] != NoVertex) continue;
+    disc[start] = low[start] = time++;
+    stack.push_back(Frame{start, NoVertex, 0});
+    while (!stack.empty()) {
+      Frame& frame = stack.back();
+      size_t v = frame._Vertex;
+      if (frame._Next < this->_Adjacency[v].size()) {
+        size_t w = this->_Adjacency[v][frame._Next++];
+        if (!alive[w]) continue;
+        if (disc[w] == NoVertex) {
+          edgeStack.emplace_back(v, w);
+          disc[w] = low[w] = time++;
+          stack.push_back(Frame{w, v, 0});
+        } else if (w != frame._Parent && disc[w] < disc[v]) {
+          edgeStack.emplace_back(v, w);
+          low[v] = std::min(low[v], disc[w]);
+        }
+      } else {
+        size_t parent = frame._Parent;
+        stack.pop_back();
+        if (parent == NoVertex) continue;
+        low[parent] = std::min(low[parent], low[v]);
+        if (low[v] >= disc[parent]) {
+          std::vector<std::pair<size_t,size_t>> component;
+          while (!edgeStack.empty()) {
+            std::pair<size_t,size_t> edge = edgeStack.back();
+            edgeStack.pop_back();
+            component.push_back(edge);
+            if (edge.first == parent && edge.second == v) break;
+          }
+          components.push_back(component);
+        }
+      }
+    }
+  }
+}
+
+void RingPerception::perceiveComponent_(const std::vector<std::pair<size_t,size_t>>& edges, bool relevant) {
+  Component comp;
+  std::unordered_map<size_t, size_t> local;
+  auto localIndex = [&comp, &local](size_t global) {
+    auto it = local.find(global);
+    if (it != local.end()) return it->second;
+    size_t index = comp._Global.size();
+    local[global] = index;
+    comp._Global.push_back(global);
+    comp._Adjacency.emplace_back();
+    return index;
+  };
+  for (size_t ei = 0; ei < edges.size(); ++ei) {
+    size_t v1 = localIndex(edges[ei].first);
+    size_t v2 = localIndex(edges[ei].second);
+    comp._Adjacency[v1].emplace_back(v2, ei);
+    comp._Adjacency[v2].emplace_back(v1, ei);
+  }
+  comp._NumVertices = comp._Global.size();
+  comp._NumEdges = edges.size();
+  if (comp._NumEdges < comp._NumVertices) return; // a bridge
+  size_t nu = comp._NumEdges - comp._NumVertices + 1;
+  auto toGlobal = [&comp](const std::vector<size_t>& vertices) {
+    Cycle cycle;
+    for (size_t v : vertices) cycle.push_back(comp._Global[v]);
+    return cycle;
+  };
+  if (nu == 1) {
+    // A simple ring - every vertex has two neighbors, just walk around it
+    std::vector<size_t> ring;
+    size_t prev = NoVertex;
+    size_t cur = 0;
+    do {
+      ring.push_back(cur);
+      size_t next = (comp._Adjacency[cur][0].first != prev) ? comp._Adjacency[cur][0].first : comp._Adjacency[cur][1].first;
+      prev = cur;
+      cur = next;
+    } while (cur != 0);
+    this->_SSSR.push_back(toGlobal(ring));
+    if (relevant) this->_RelevantCycles.push_back(toGlobal(ring));
+    return;
+  }
+  // Generate the prototype candidates for every root
+  std::vector<Candidate> candidates;
+  for (size_t r = 0; r < comp._NumVertices; ++r) {
+    RootPaths rp = comp.rootPaths(r);
+    for (size_t y : rp._BfsOrder) {
+      if (y == r || !rp._InVr[y]) continue;
+      std::vector<size_t> pathY = Component::firstPath(rp, r, y);
+      // Odd cycles close with an edge between two vertices at the same distance
+      for (auto& nb : comp._Adjacency[y]) {
+        size_t z = nb.first;
+        if (z < y && rp._InVr[z] && rp._Distance[z] == rp._Distance[y]) {
+          Candidate cand(comp._NumEdges);
+          if (comp.makeCycle(pathY, NoVertex, Component::firstPath(rp, r, z), cand)) {
+            cand._Root = r; cand._Y = y; cand._Z = z; cand._Even = false;
+            candidates.push_back(cand);
+          }
+        }
+      }
+      // Even cycles close through y from two of its predecessors
+      const std::vector<size_t>& preds = rp._Pred[y];
+      for (size_t ii = 0; ii < preds.size(); ++ii) {
+        for (size_t jj = ii + 1; jj < preds.size(); ++jj) {
+          Candidate cand(comp._NumEdges);
+          if (comp.makeCycle(Component::firstPath(rp, r, preds[ii]), y, Component::firstPath(rp, r, preds[jj]), cand)) {
+            cand._Root = r; cand._Y = y; cand._P = preds[ii]; cand._Q = preds[jj]; cand._Even = true;
+            candidates.push_back(cand);
+          }
+        }
+      }
+    }
+  }
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [](const Candidate& a, const Candidate& b) { return a._Length < b._Length; });
+  CycleBasis basis(comp._NumEdges);
+  std::set<std::vector<uint64_t>> seenRelevant;
+  std::map<size_t, RootPaths> rootCache;
+  size_t ci = 0;
+  while (ci < candidates.size() && basis.rank() < nu) {
+    size_t length = candidates[ci]._Length;
+    size_t cend = ci;
+    while (cend < candidates.size() && candidates[cend]._Length == length) ++cend;
+    // The relevant cycles of this length are those independent of all strictly shorter cycles
+    CycleBasis shorter = relevant ? basis : CycleBasis(0);
+    for (; ci < cend; ++ci) {
+      const Candidate& cand = candidates[ci];
+      if (basis.rank() < nu && basis.add(cand._Bits)) {
+        this->_SSSR.push_back(toGlobal(cand._Vertices));
+      }
+      if (!relevant || !shorter.independent(cand._Bits)) continue;
+      // Every member of the family of a relevant prototype is relevant
+      auto found = rootCache.find(cand._Root);
+      if (found == rootCache.end()) found = rootCache.emplace(cand._Root, comp.rootPaths(cand._Root)).first;
+      const RootPaths& rp = found->second;
+      std::vector<std::vector<size_t>> paths1, paths2;
+      std::vector<size_t> tail;
+      size_t limit = this->_MaximumFamilySize;
+      Component::allPaths(rp, cand._Root, cand._Even ? cand._P : cand._Y, limit, tail, paths1);
+      Component::allPaths(rp, cand._Root, cand._Even ? cand._Q : cand._Z, limit, tail, paths2);
+      size_t members = 0;
+      for (auto& path1 : paths1) {
+        for (auto& path2 : paths2) {
+          if (members >= limit) break;
+          Candidate member(comp._NumEdges);
+          if (!comp.makeCycle(path1, cand._Even ? cand._Y : NoVertex, path2, member)) continue;
+          if (!seenRelevant.insert(member._Bits._Words).second) continue;
+          this->_RelevantCycles.push_back(toGlobal(member._Vertices));
+          members++;
+        }
+      }
+    }
+  }
+}
+
+void RingPerception::perceive(bool relevant) {
+  this->_SSSR.clear();
+  this->_RelevantCycles.clear();
+  std::vector<bool> alive(this->_NumVertices, true);
+  this->stripAcyclic_(alive);
+  std::vector<std::vector<std::pair<size_t,size_t>>> components;
+  this->biconnectedComponents_(alive, components);
+  for (auto& component : components) {
+    this->perceiveComponent_(component, relevant);
+  }
+}
+
+};
@@ -0,0 +1,772 @@
+/*
+    File: sdfFile.cc
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+/* -^- */
+#define	DEBUG_LEVEL_NONE
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <clasp/core/foundation.h>
+#include <clasp/core/common.h>
+#include <clasp/core/array.h>
+#include <clasp/core/lispStream.h>
+#include <clasp/core/numbers.h>
+#include <clasp/core/hashTableEq.h>
+#include <cando/chem/sdfFile.h>
+#include <cando/chem/aggregate.h>
+#include <cando/chem/molecule.h>
+#include <cando/chem/residue.h>
+#include <cando/chem/atom.h>
+#include <cando/chem/elements.h>
+#include <cando/chem/loop.h>
+#include <cando/chem/nVector.h>
+#include <clasp/core/wrappers.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+
+namespace chem {
+
+// Below this many bytes per thread the record separators are found on fewer threads
+#define SDF_INDEX_BYTES_PER_THREAD (1<<24)
+// Below this many records per thread the records are parsed on fewer threads
+#define SDF_RECORDS_PER_THREAD 64
+// Bytes of SD file text accumulated before it is written to the stream
+#define SDF_WRITE_CHUNK (1<<20)
+
+static const char* sdf_element_symbols[] = {
+  "H","He","Li","Be","B","C","N","O","F","Ne","Na","Mg","Al","Si","P","S","Cl","Ar","K","Ca",
+  "Sc","Ti","V","Cr","Mn","Fe","Co","Ni","Cu","Zn","Ga","Ge","As","Se","Br","Kr","Rb","Sr","Y","Zr",
+  "Nb","Mo","Tc","Ru","Rh","Pd","Ag","Cd","In","Sn","Sb","Te","I","Xe","Cs","Ba","La","Ce","Pr","Nd",
+  "Pm","Sm","Eu","Gd","Tb","Dy","Ho","Er","Tm","Yb","Lu","Hf","Ta","W","Re","Os","Ir","Pt","Au","Hg",
+  "Tl","Pb","Bi","Po","At","Rn","Fr","Ra","Ac","Th","Pa","U","Np","Pu","Am","Cm","Bk","Cf","Es","Fm",
+  "Md","No","Lr","Rf","Db","Sg","Bh","Hs","Mt","Ds","Rg","Cn","Nh","Fl","Mc","Lv","Ts","Og" };
+
+/*! Atomic number of an MDL atom symbol or 0 if it isn't an element.
+ *  This doesn't touch the Lisp element tables so it can be called by the parsing threads. */
+static uint8_t sdf_atomic_number(const std::string& symbol)
+{
+  static const std::unordered_map<std::string,uint8_t> table = [] () {
+    std::unordered_map<std::string,uint8_t> result;
+    for ( size_t zi=0; zi<sizeof(sdf_element_symbols)/sizeof(sdf_element_symbols[0]); ++zi ) result[sdf_element_symbols[zi]] = zi+1;
+    return result;
+  }();
+  auto found = table.find(symbol);
+  if (found == table.end()) return 0;
+  return found->second;
+}
+
+namespace {
+/*! Walk the lines of [begin,end) without copying them. */
+struct SdfLines {
+  const char* _Cur;
+  const char* _End;
+  SdfLines(const char* begin, const char* end) : _Cur(begin), _End(end) {};
+  bool next(std::string& line) {
+    if (this->_Cur >= this->_End) return false;
+    const char* eol = (const char*)memchr(this->_Cur,'\n',this->_End-this->_Cur);
+    const char* stop = eol ? eol : this->_End;
+    const char* last = stop;
+    if (last>this->_Cur && last[-1]=='\r') --last;
+    line.assign(this->_Cur,last);
+    this->_Cur = eol ? eol+1 : this->_End;
+    return true;
+  }
+};
+};
+
+static std::string sdf_field(const std::string& line, size_t start, size_t width)
+{
+  if (start>=line.size()) return "";
+  std::string field = line.substr(start,width);
+  size_t first = field.find_first_not_of(" \t");
+  if (first == std::string::npos) return "";
+  size_t last = field.find_last_not_of(" \t");
+  return field.substr(first,last-first+1);
+}
+
+static bool sdf_int(const std::string& text, long& value)
+{
+  if (text.empty()) return false;
+  char* endp;
+  value = strtol(text.c_str(),&endp,10);
+  return *endp == '\0';
+}
+
+static bool sdf_real(const std::string& text, double& value)
+{
+  if (text.empty()) return false;
+  char* endp;
+  value = strtod(text.c_str(),&endp);
+  return *endp == '\0';
+}
+
+static std::vector<std::string> sdf_tokens(const std::string& line, size_t start=0)
+{
+  std::vector<std::string> tokens;
+  size_t pos = start;
+  while (pos<line.size()) {
+    pos = line.find_first_not_of(" \t",pos);
+    if (pos == std::string::npos) break;
+    size_t stop = line.find_first_of(" \t",pos);
+    if (stop == std::string::npos) stop = line.size();
+    tokens.push_back(line.substr(pos,stop-pos));
+    pos = stop;
+  }
+  return tokens;
+}
+
+static void sdf_add_atom(SdfRecord& record, const std::string& symbol, double x, double y, double z, int charge)
+{
+  record._Symbols.push_back(symbol);
+  record._AtomicNumbers.push_back(sdf_atomic_number(symbol));
+  record._Coordinates.push_back(x);
+  record._Coordinates.push_back(y);
+  record._Coordinates.push_back(z);
+  record._Charges.push_back(charge);
+}
+
+static bool sdf_add_bond(SdfRecord& record, long a1, long a2, long order)
+{
+  long numAtoms = record._Symbols.size();
+  if (a1<1 || a1>numAtoms || a2<1 || a2>numAtoms || a1==a2) {
+    record._Error = fmt::format("bond between atoms {} and {} with only {} atoms", a1, a2, numAtoms);
+    return false;
+  }
+  if (order<1 || order>4) order = 1;
+  record._Bonds.push_back(a1-1);
+  record._Bonds.push_back(a2-1);
+  record._BondOrders.push_back(order);
+  return true;
+}
+
+/*! The M  CHG lines replace every charge given in the V2000 atom block */
+static bool sdf_parse_v2000_properties(SdfLines& lines, SdfRecord& record)
+{
+  std::string line;
+  bool sawCharge = false;
+  while (lines.next(line)) {
+    if (line.compare(0,6,"M  END")==0) return true;
+    if (line.compare(0,6,"M  CHG")==0) {
+      if (!sawCharge) {
+        std::fill(record._Charges.begin(),record._Charges.end(),0);
+        sawCharge = true;
+      }
+      std::vector<std::string> tokens = sdf_tokens(line,6);
+      long count, index, charge;
+      if (tokens.empty() || !sdf_int(tokens[0],count) || tokens.size()<(size_t)(1+2*count)) {
+        record._Error = fmt::format("bad M  CHG line: {}", line);
+        return false;
+      }
+      for ( long ci=0; ci<count; ++ci ) {
+        if (!sdf_int(tokens[1+2*ci],index) || !sdf_int(tokens[2+2*ci],charge)
+            || index<1 || index>(long)record._Charges.size()) {
+          record._Error = fmt::format("bad M  CHG line: {}", line);
+          return false;
+        }
+        record._Charges[index-1] = charge;
+      }
+    }
+  }
+  record._Error = "missing M  END";
+  return false;
+}
+
+static bool sdf_parse_v2000(SdfLines& lines, const std::string& counts, SdfRecord& record)
+{
+  long numAtoms, numBonds;
+  if (!sdf_int(sdf_field(counts,0,3),numAtoms) || !sdf_int(sdf_field(counts,3,3),numBonds)) {
+    record._Error = fmt::format("bad counts line: {}", counts);
+    return false;
+  }
+  record._Symbols.reserve(numAtoms);
+  record._Coordinates.reserve(numAtoms*3);
+  std::string line;
+  for ( long ai=0; ai<numAtoms; ++ai ) {
+    double x, y, z;
+    if (!lines.next(line)
+        || !sdf_real(sdf_field(line,0,10),x)
+        || !sdf_real(sdf_field(line,10,10),y)
+        || !sdf_real(sdf_field(line,20,10),z)) {
+      record._Error = fmt::format("bad atom line {}: {}", ai+1, line);
+      return false;
+    }
+    long code = 0;
+    sdf_int(sdf_field(line,36,3),code);
+    int charge = (code>=1 && code<=7 && code!=4) ? 4-code : 0;
+    sdf_add_atom(record,sdf_field(line,31,3),x,y,z,charge);
+  }
+  for ( long bi=0; bi<numBonds; ++bi ) {
+    long a1, a2, order;
+    if (!lines.next(line)
+        || !sdf_int(sdf_field(line,0,3),a1)
+        || !sdf_int(sdf_field(line,3,3),a2)
+        || !sdf_int(sdf_field(line,6,3),order)) {
+      record._Error = fmt::format("bad bond line {}: {}", bi+1, line);
+      return false;
+    }
+    if (!sdf_add_bond(record,a1,a2,order)) return false;
+  }
+  return sdf_parse_v2000_properties(lines,record);
+}
+
+/*! Return the next V3000 line with the "M  V30 " prefix removed and continuation lines joined */
+static bool sdf_v3000_line(SdfLines& lines, std::string& result)
+{
+  std::string line;
+  result.clear();
+  while (lines.next(line)) {
+    if (line.compare(0,6,"M  END")==0) return false;
+    if (line.compare(0,6,"M  V30")!=0) continue;
+    std::string body = line.size()>7 ? line.substr(7) : "";
+    if (!body.empty() && body.back()=='-') {
+      body.pop_back();
+      result += body;
+      continue;
+    }
+    result += body;
+    return true;
+  }
+  return false;
+}
+
+static bool sdf_parse_v3000(SdfLines& lines, SdfRecord& record)
+{
+  std::string line;
+  std::unordered_map<long,long> atomIndex;  // V3000 atom numbers needn't be 1..n
+  enum { outside, inAtoms, inBonds } state = outside;
+  while (sdf_v3000_line(lines,line)) {
+    std::vector<std::string> tokens = sdf_tokens(line);
+    if (tokens.empty()) continue;
+    if (tokens[0]=="BEGIN" && tokens.size()>1) {
+      if (tokens[1]=="ATOM") state = inAtoms;
+      else if (tokens[1]=="BOND") state = inBonds;
+      continue;
+    }
+    if (tokens[0]=="END") {
+      if (tokens.size()>1 && tokens[1]=="CTAB") break;
+      state = outside;
+      continue;
+    }
+    if (state == inAtoms) {
+      long index;
+      double x, y, z;
+      if (tokens.size()<5 || !sdf_int(tokens[0],index)
+          || !sdf_real(tokens[2],x) || !sdf_real(tokens[3],y) || !sdf_real(tokens[4],z)) {
+        record._Error = fmt::format("bad V3000 atom line: {}", line);
+        return false;
+      }
+      int charge = 0;
+      for ( size_t ti=5; ti<tokens.size(); ++ti ) {
+        long value;
+        if (tokens[ti].compare(0,4,"CHG=")==0 && sdf_int(tokens[ti].substr(4),value)) charge = value;
+      }
+      atomIndex[index] = record._Symbols.size()+1;
+      std::string symbol = tokens[1];
+      symbol.erase(std::remove(symbol.begin(),symbol.end(),'"'),symbol.end());
+      sdf_add_atom(record,symbol,x,y,z,charge);
+    } else if (state == inBonds) {
+      long index, order, a1, a2;
+      if (tokens.size()<4 || !sdf_int(tokens[0],index) || !sdf_int(tokens[1],order)
+          || !sdf_int(tokens[2],a1) || !sdf_int(tokens[3],a2)
+          || atomIndex.count(a1)==0 || atomIndex.count(a2)==0) {
+        record._Error = fmt::format("bad V3000 bond line: {}", line);
+        return false;
+      }
+      if (!sdf_add_bond(record,atomIndex[a1],atomIndex[a2],order)) return false;
+    }
+  }
+  while (lines.next(line)) {
+    if (line.compare(0,6,"M  END")==0) return true;
+  }
+  record._Error = "missing M  END";
+  return false;
+}
+
+/*! Data items are "> <NAME>" followed by lines of text up to a blank line */
+static void sdf_parse_data(SdfLines& lines, SdfRecord& record)
+{
+  std::string line;
+  while (lines.next(line)) {
+    if (line.compare(0,4,"$$$$")==0) return;
+    if (line.empty() || line[0]!='>') continue;
+    size_t open = line.find('<');
+    size_t close = open==std::string::npos ? open : line.find('>',open);
+    if (close == std::string::npos) continue;
+    std::string name = line.substr(open+1,close-open-1);
+    std::string value;
+    while (lines.next(line) && !line.empty()) {
+      if (!value.empty()) value += '\n';
+      value += line;
+    }
+    record._Data.emplace_back(name,value);
+  }
+}
+
+void parse_sdf_record(const char* begin, const char* end, SdfRecord& record)
+{
+  SdfLines lines(begin,end);
+  std::string line, counts;
+  if (!lines.next(record._Name) || !lines.next(line) || !lines.next(line) || !lines.next(counts)) {
+    record._Error = "the record has fewer than four lines";
+    return;
+  }
+  size_t last = record._Name.find_last_not_of(" \t");
+  record._Name.erase(last==std::string::npos ? 0 : last+1);
+  bool ok = (counts.find("V3000")!=std::string::npos)
+    ? sdf_parse_v3000(lines,record)
+    : sdf_parse_v2000(lines,counts,record);
+  if (ok) sdf_parse_data(lines,record);
+}
+
+/*! Return true if [pos,end) starts a $$$$ line */
+static bool sdf_separator_at(const char* data, size_t pos, size_t size)
+{
+  if (pos+4>size || memcmp(data+pos,"$$$$",4)!=0) return false;
+  if (pos>0 && data[pos-1]!='\n') return false;
+  return pos+4==size || data[pos+4]=='\n' || data[pos+4]=='\r' || data[pos+4]==' ';
+}
+
+CL_LAMBDA(filename);
+CL_LISPIFY_NAME(make_sdf_file);
+CL_DOCSTRING(R"dx(Open the SD file filename for reading.  The file is mapped into memory and the records
+(terminated by $$$$ lines) are indexed in parallel so that any record can be read by number with
+chem:sdf-file-read-molecule or read in bulk with chem:sdf-file-read-molecules.  Use chem:sdf-file-close
+to release the mapping.)dx");
+DOCGROUP(cando);
+CL_DEF_CLASS_METHOD SdfFile_sp SdfFile_O::make(const std::string& filename)
+{
+  auto  me  = gctools::GC<SdfFile_O>::allocate_with_default_constructor();
+  me->_Filename = filename;
+  int fd = open(filename.c_str(),O_RDONLY);
+  if (fd<0) SIMPLE_ERROR("Could not open {} - {}", filename, strerror(errno));
+  struct stat info;
+  if (fstat(fd,&info)!=0) {
+    int err = errno;
+    ::close(fd);
+    SIMPLE_ERROR("Could not stat {} - {}", filename, strerror(err));
+  }
+  me->_FileDescriptor = fd;
+  me->_Size = info.st_size;
+  if (me->_Size>0) {
+    void* data = mmap(NULL,me->_Size,PROT_READ,MAP_PRIVATE,fd,0);
+    if (data == MAP_FAILED) {
+      int err = errno;
+      me->close();
+      SIMPLE_ERROR("Could not map {} into memory - {}", filename, strerror(err));
+    }
+    // The advice values are not flags - give each one separately
+    madvise(data,me->_Size,MADV_SEQUENTIAL);
+    madvise(data,me->_Size,MADV_WILLNEED);
+    me->_Data = (const char*)data;
+  }
+  // Find the $$$$ lines - each thread owns the separators that start in its range of bytes
+  const char* data = me->_Data;
+  size_t size = me->_Size;
+  size_t numThreads = std::max(1U,std::thread::hardware_concurrency());
+  numThreads = std::max((size_t)1,std::min(numThreads,size/SDF_INDEX_BYTES_PER_THREAD));
+  size_t chunk = (size+numThreads-1)/numThreads;
+  std::vector<std::vector<uint64_t>> ends(numThreads);
+  auto worker = [&] (size_t tid) {
+    size_t pos = tid*chunk;
+    size_t stop = std::min(size,pos+chunk);
+    while (pos<stop) {
+      const char* found = (const char*)memchr(data+pos,'$',stop-pos);
+      if (!found) break;
+      pos = found-data;
+      if (sdf_separator_at(data,pos,size)) {
+        const char* eol = (const char*)memchr(data+pos,'\n',size-pos);
+        pos = eol ? eol-data+1 : size;
+        ends[tid].push_back(pos);
+      } else {
+        ++pos;
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads-1);
+  for ( size_t tid=1; tid<numThreads; ++tid ) threads.emplace_back(worker,tid);
+  worker(0);
+  for ( auto& thread : threads ) thread.join();
+  me->_RecordStart.push_back(0);
+  for ( auto& chunkEnds : ends ) {
+    for ( uint64_t end : chunkEnds ) me->_RecordStart.push_back(end);
+  }
+  // A last record without a $$$$ line is kept unless it's only whitespace
+  uint64_t tail = me->_RecordStart.back();
+  for ( size_t pos=tail; pos<size; ++pos ) {
+    if (!isspace((unsigned char)data[pos])) {
+      me->_RecordStart.push_back(size);
+      break;
+    }
+  }
+  return me;
+}
+
+SdfFile_O::~SdfFile_O()
+{
+  this->close();
+}
+
+CL_DOCSTRING(R"dx(Release the memory mapping of the SD file.  No records can be read after this.)dx");
+CL_DEFMETHOD void SdfFile_O::close()
+{
+  if (this->_Data) munmap((void*)this->_Data,this->_Size);
+  if (this->_FileDescriptor>=0) ::close(this->_FileDescriptor);
+  this->_Data = NULL;
+  this->_FileDescriptor = -1;
+}
+
+size_t SdfFile_O::recordEnd(core::T_sp end) const
+{
+  if (end.nilp()) return this->numberOfRecords();
+  if (!end.fixnump() || end.unsafe_fixnum()<0) SIMPLE_ERROR("end must be nil or a non-negative fixnum - got {}", _rep_(end));
+  return std::min((size_t)end.unsafe_fixnum(),this->numberOfRecords());
+}
+
+CL_DOCSTRING(R"dx(Return the text of record index of the SD file including its $$$$ line.)dx");
+CL_DEFMETHOD std::string SdfFile_O::recordText(size_t index) const
+{
+  if (index>=this->numberOfRecords()) SIMPLE_ERROR("Record {} is out of range - {} has {} records", index, this->_Filename, this->numberOfRecords());
+  if (!this->_Data) SIMPLE_ERROR("The SD file {} has been closed", this->_Filename);
+  return std::string(this->_Data+this->_RecordStart[index],this->_RecordStart[index+1]-this->_RecordStart[index]);
+}
+
+void SdfFile_O::parseRecords(size_t start, size_t end, std::vector<SdfRecord>& records) const
+{
+  if (start>end || end>this->numberOfRecords()) SIMPLE_ERROR("Records {} to {} are out of range - {} has {} records", start, end, this->_Filename, this->numberOfRecords());
+  if (!this->_Data && end>start) SIMPLE_ERROR("The SD file {} has been closed", this->_Filename);
+  size_t numRecords = end-start;
+  records.clear();
+  records.resize(numRecords);
+  std::atomic<size_t> next(0);
+  auto worker = [&] () {
+    for ( size_t ri=next++; ri<numRecords; ri=next++ ) {
+      parse_sdf_record(this->_Data+this->_RecordStart[start+ri],this->_Data+this->_RecordStart[start+ri+1],records[ri]);
+    }
+  };
+  size_t numThreads = std::max(1U,std::thread::hardware_concurrency());
+  numThreads = std::max((size_t)1,std::min(numThreads,numRecords/SDF_RECORDS_PER_THREAD));
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads-1);
+  for ( size_t tid=1; tid<numThreads; ++tid ) threads.emplace_back(worker);
+  worker();
+  for ( auto& thread : threads ) thread.join();
+  for ( size_t ri=0; ri<numRecords; ++ri ) {
+    if (!records[ri]._Error.empty()) {
+      SIMPLE_ERROR("Could not parse record {} of {} - {}", start+ri, this->_Filename, records[ri]._Error);
+    }
+  }
+}
+
+/*! Build a molecule with one residue from a record the way sdf:parse-sdf-file does.
+ *  The molecule and its residue are both called name, atoms are named by element and index
+ *  (unique within the molecule) and labels that aren't elements become carbons with a
+ *  :label property.  Unlike sdf:parse-sdf-file the data items become string properties
+ *  of the molecule rather than being read as Lisp objects. */
+static Molecule_sp sdf_build_molecule(const SdfRecord& record, const std::string& name)
+{
+  MatterName matterName = name.empty() ? nil<core::Symbol_O>() : chemkw_intern(name);
+  Molecule_sp molecule = Molecule_O::make(matterName);
+  Residue_sp residue = Residue_O::make(matterName);
+  molecule->addMatter(residue);
+  size_t numAtoms = record._Symbols.size();
+  residue->reserveContents(numAtoms);
+  gctools::Vec0<Atom_sp> atoms;
+  atoms.reserve(numAtoms);
+  for ( size_t ai=0; ai<numAtoms; ++ai ) {
+    uint8_t atomicNumber = record._AtomicNumbers[ai];
+    Element element = atomicNumber ? elementForAtomicNumber(atomicNumber) : element_C;
+    std::string elementName = atomicNumber ? sdf_element_symbols[atomicNumber-1] : "C";
+    Atom_sp atom = Atom_O::make(chemkw_intern(fmt::format("{}{}",elementName,ai)),element);
+    atom->setPosition(Vector3(record._Coordinates[ai*3],record._Coordinates[ai*3+1],record._Coordinates[ai*3+2]));
+    if (record._Charges[ai]!=0) {
+      atom->setCharge(record._Charges[ai]);
+      atom->setIonization(record._Charges[ai]);
+    }
+    if (!atomicNumber) atom->setProperty(chemkw_intern("LABEL"),chemkw_intern(record._Symbols[ai]));
+    residue->addMatter(atom);
+    atoms.push_back(atom);
+  }
+  static const BondOrder orders[] = { singleBond, singleBond, doubleBond, tripleBond, aromaticBond };
+  for ( size_t bi=0; bi<record._BondOrders.size(); ++bi ) {
+    atoms[record._Bonds[bi*2]]->bondTo(atoms[record._Bonds[bi*2+1]],orders[record._BondOrders[bi]],false,false);
+  }
+  for ( auto& item : record._Data ) {
+    molecule->setProperty(chemkw_intern(item.first),core::SimpleBaseString_O::make(item.second));
+  }
+  return molecule;
+}
+
+CL_DOCSTRING(R"dx(Parse record index of the SD file and return it as a molecule with one residue.)dx");
+CL_DEFMETHOD Molecule_sp SdfFile_O::readMolecule(size_t index) const
+{
+  std::vector<SdfRecord> records;
+  this->parseRecords(index,index+1,records);
+  return sdf_build_molecule(records[0],records[0]._Name);
+}
+
+CL_LAMBDA((sdf-file chem:sdf-file) &optional (start 0) end);
+CL_DOCSTRING(R"dx(Return a simple-vector of molecules for records start up to end (default all) of the SD file.
+The records are parsed in parallel and then turned into molecules.  Data items become molecule properties
+whose values are strings.  As in sdf:parse-sdf-file repeated record names get the suffixes _2, _3 ...
+so that every molecule has a unique name.)dx");
+CL_DEFMETHOD core::SimpleVector_sp SdfFile_O::readMolecules(size_t start, core::T_sp end) const
+{
+  std::vector<SdfRecord> records;
+  this->parseRecords(start,this->recordEnd(end),records);
+  core::SimpleVector_sp result = core::SimpleVector_O::make(records.size());
+  std::unordered_map<std::string,size_t> nameCounts;
+  for ( size_t ri=0; ri<records.size(); ++ri ) {
+    std::string name = records[ri]._Name;
+    size_t count = ++nameCounts[name];
+    if (count>1 && !name.empty()) name = fmt::format("{}_{}",name,count);
+    (*result)[ri] = sdf_build_molecule(records[ri],name);
+    records[ri] = SdfRecord();
+    gctools::handle_all_queued_interrupts();
+  }
+  return result;
+}
+
+CL_LAMBDA((sdf-file chem:sdf-file) &optional (start 0) end);
+CL_DOCSTRING(R"dx(Parse records start up to end (default all) of the SD file in parallel and return them as flat arrays
+without building molecules.  Returns (values names atom-start atomic-numbers coordinates charges bond-start bonds data-items)
+ - names: simple-vector of record names
+ - atom-start: (signed-byte 32) vector; the atoms of record i are atom-start[i] up to atom-start[i+1]
+ - atomic-numbers: (signed-byte 32) vector, 0 for atom labels that aren't elements
+ - coordinates: nvector of x,y,z for every atom
+ - charges: (signed-byte 32) vector of formal charges
+ - bond-start: (signed-byte 32) vector; the bonds of record i are bond-start[i] up to bond-start[i+1]
+ - bonds: (signed-byte 32) vector of atom1,atom2,order triples; atom indices are into the record's atoms
+ - data-items: simple-vector of alists of (name . string) for every record.)dx");
+CL_DEFMETHOD core::T_mv SdfFile_O::readArrays(size_t start, core::T_sp end) const
+{
+  std::vector<SdfRecord> records;
+  this->parseRecords(start,this->recordEnd(end),records);
+  size_t numRecords = records.size();
+  size_t numAtoms = 0, numBonds = 0;
+  for ( auto& record : records ) {
+    numAtoms += record._Symbols.size();
+    numBonds += record._BondOrders.size();
+  }
+  core::SimpleVector_sp names = core::SimpleVector_O::make(numRecords);
+  core::SimpleVector_int32_t_sp atomStart = core::SimpleVector_int32_t_O::make(numRecords+1);
+  core::SimpleVector_int32_t_sp atomicNumbers = core::SimpleVector_int32_t_O::make(numAtoms);
+  NVector_sp coordinates = NVector_O::make(numAtoms*3);
+  core::SimpleVector_int32_t_sp charges = core::SimpleVector_int32_t_O::make(numAtoms);
+  core::SimpleVector_int32_t_sp bondStart = core::SimpleVector_int32_t_O::make(numRecords+1);
+  core::SimpleVector_int32_t_sp bonds = core::SimpleVector_int32_t_O::make(numBonds*3);
+  core::SimpleVector_sp dataItems = core::SimpleVector_O::make(numRecords);
+  size_t atomIndex = 0, bondIndex = 0;
+  for ( size_t ri=0; ri<numRecords; ++ri ) {
+    const SdfRecord& record = records[ri];
+    (*names)[ri] = core::SimpleBaseString_O::make(record._Name);
+    (*atomStart)[ri] = atomIndex;
+    (*bondStart)[ri] = bondIndex;
+    for ( size_t ai=0; ai<record._Symbols.size(); ++ai ) {
+      (*atomicNumbers)[atomIndex+ai] = record._AtomicNumbers[ai];
+      (*charges)[atomIndex+ai] = record._Charges[ai];
+      for ( size_t ci=0; ci<3; ++ci ) (*coordinates)[(atomIndex+ai)*3+ci] = record._Coordinates[ai*3+ci];
+    }
+    for ( size_t bi=0; bi<record._BondOrders.size(); ++bi ) {
+      (*bonds)[(bondIndex+bi)*3] = record._Bonds[bi*2];
+      (*bonds)[(bondIndex+bi)*3+1] = record._Bonds[bi*2+1];
+      (*bonds)[(bondIndex+bi)*3+2] = record._BondOrders[bi];
+    }
+    ql::list items;
+    for ( auto& item : record._Data ) {
+      items << core::Cons_O::create(chemkw_intern(item.first),core::SimpleBaseString_O::make(item.second));
+    }
+    (*dataItems)[ri] = items.cons();
+    atomIndex += record._Symbols.size();
+    bondIndex += record._BondOrders.size();
+  }
+  (*atomStart)[numRecords] = atomIndex;
+  (*bondStart)[numRecords] = bondIndex;
+  return Values(names,atomStart,atomicNumbers,coordinates,charges,bondStart,bonds,dataItems);
+}
+
+static int sdf_bond_type(BondOrder order)
+{
+  switch (order) {
+  case doubleBond:
+  case dashedDoubleBond:
+      return 2;
+  case tripleBond:
+      return 3;
+  case aromaticBond:
+      return 4;
+  default:
+      return 1;
+  }
+}
+
+static std::string sdf_property_text(core::T_sp value)
+{
+  if (gc::IsA<core::String_sp>(value)) return gc::As_unsafe<core::String_sp>(value)->get_std_string();
+  return _rep_(value);
+}
+
+/*! Append one molecule as an SD file record to out */
+static void sdf_write_molecule(std::string& out, Molecule_sp molecule, core::T_sp properties)
+{
+  gctools::Vec0<Atom_sp> atoms;
+  core::HashTableEq_sp atomToIndex = core::HashTableEq_O::create_default();
+  {
+    Loop loop;
+    loop.loopTopGoal(molecule,ATOMS);
+    while ( loop.advance() ) {
+      Atom_sp atom = loop.getAtom();
+      atomToIndex->setf_gethash(atom,core::make_fixnum(atoms.size()));
+      atoms.push_back(atom);
+    }
+  }
+  std::vector<int> bonds;
+  {
+    Loop loop;
+    loop.loopTopGoal(molecule,BONDS);
+    while ( loop.advance() ) {
+      bonds.push_back(atomToIndex->gethash(loop.getBondA1()).unsafe_fixnum()+1);
+      bonds.push_back(atomToIndex->gethash(loop.getBondA2()).unsafe_fixnum()+1);
+      bonds.push_back(sdf_bond_type(loop.getBondOrder()));
+    }
+  }
+  size_t numAtoms = atoms.size();
+  size_t numBonds = bonds.size()/3;
+  std::string name = molecule->getName().nilp() ? "" : molecule->getName()->symbolNameAsString();
+  out += name;
+  out += '\n';
+  out += name;
+  out += "\nSource - Cando.\n";
+  if (numAtoms<=999 && numBonds<=999) {
+    out += fmt::format("{:3d}{:3d}  0  0  0  0            999 V2000\n", numAtoms, numBonds);
+    std::vector<std::pair<size_t,int>> charged;
+    for ( size_t ai=0; ai<numAtoms; ++ai ) {
+      Atom_sp atom = atoms[ai];
+      Vector3 pos = atom->getPosition();
+      int charge = atom->getIonization();
+      int code = (charge>=-3 && charge<=3 && charge!=0) ? 4-charge : 0;
+      if (charge!=0) charged.emplace_back(ai+1,charge);
+      out += fmt::format("{:10.4f}{:10.4f}{:10.4f} {:<3}{:2d}{:3d}  0  0  0  0  0  0  0  0  0  0\n",
+                         pos.getX(), pos.getY(), pos.getZ(),
+                         atomicSymbolFromElement(atom->getElement())->symbolNameAsString(), 0, code);
+    }
+    for ( size_t bi=0; bi<numBonds; ++bi ) {
+      out += fmt::format("{:3d}{:3d}{:3d}  0  0  0  0\n", bonds[bi*3], bonds[bi*3+1], bonds[bi*3+2]);
+    }
+    for ( size_t ci=0; ci<charged.size(); ci+=8 ) {
+      size_t count = std::min((size_t)8,charged.size()-ci);
+      out += fmt::format("M  CHG{:3d}", count);
+      for ( size_t ki=ci; ki<ci+count; ++ki ) out += fmt::format(" {:3d} {:3d}", charged[ki].first, charged[ki].second);
+      out += '\n';
+    }
+  } else {
+    out += "  0  0  0     0  0            999 V3000\n";
+    out += "M  V30 BEGIN CTAB\n";
+    out += fmt::format("M  V30 COUNTS {} {} 0 0 0\n", numAtoms, numBonds);
+    out += "M  V30 BEGIN ATOM\n";
+    for ( size_t ai=0; ai<numAtoms; ++ai ) {
+      Atom_sp atom = atoms[ai];
+      Vector3 pos = atom->getPosition();
+      out += fmt::format("M  V30 {} {} {:.4f} {:.4f} {:.4f} 0", ai+1,
+                         atomicSymbolFromElement(atom->getElement())->symbolNameAsString(),
+                         pos.getX(), pos.getY(), pos.getZ());
+      if (atom->getIonization()!=0) out += fmt::format(" CHG={}", atom->getIonization());
+      out += '\n';
+    }
+    out += "M  V30 END ATOM\n";
+    if (numBonds>0) {
+      out += "M  V30 BEGIN BOND\n";
+      for ( size_t bi=0; bi<numBonds; ++bi ) {
+        out += fmt::format("M  V30 {} {} {} {}\n", bi+1, bonds[bi*3+2], bonds[bi*3], bonds[bi*3+1]);
+      }
+      out += "M  V30 END BOND\n";
+    }
+    out += "M  V30 END CTAB\n";
+  }
+  out += "M  END\n";
+  if (properties.notnilp()) {
+    core::List_sp plist = molecule->getProperties();
+    for ( core::T_sp cur = plist; cur.consp(); cur = core::oCddr(cur) ) {
+      core::T_sp key = core::oCar(cur);
+      if (properties != _lisp->_true()) {
+        bool wanted = false;
+        for ( auto pcur : gc::As<core::List_sp>(properties) ) {
+          if (CONS_CAR(pcur) == key) {
+            wanted = true;
+            break;
+          }
+        }
+        if (!wanted) continue;
+      }
+      std::string keyName = gc::IsA<core::Symbol_sp>(key) ? gc::As_unsafe<core::Symbol_sp>(key)->symbolNameAsString() : _rep_(key);
+      out += fmt::format("> <{}>\n{}\n\n", keyName, sdf_property_text(core::oCadr(cur)));
+    }
+  }
+  out += "$$$$\n";
+}
+
+CL_LAMBDA(stream molecules &key properties);
+CL_DOCSTRING(R"dx(Write molecules as SD file records to stream.  molecules is a molecule, an aggregate or a list or
+simple-vector of molecules.  Records are written in the V2000 format unless a molecule has more than 999 atoms or
+bonds, in which case the V3000 format is used.  Formal charges are taken from the atom ionization.
+If properties is T every molecule property is written as a data item, if it is a list only those properties are
+written.  String values are written as is and other values are printed.  The text is built in large chunks so
+that writing big libraries doesn't go through the stream one line at a time.)dx");
+DOCGROUP(cando);
+CL_DEFUN void chem__write_sdf(core::T_sp stream, core::T_sp molecules, core::T_sp properties)
+{
+  gctools::Vec0<Molecule_sp> mols;
+  if (gc::IsA<Molecule_sp>(molecules)) {
+    mols.push_back(gc::As_unsafe<Molecule_sp>(molecules));
+  } else if (gc::IsA<Aggregate_sp>(molecules)) {
+    Aggregate_sp agg = gc::As_unsafe<Aggregate_sp>(molecules);
+    for ( size_t mi=0, endMi(agg->contentSize()); mi<endMi; ++mi ) mols.push_back(gc::As<Molecule_sp>(agg->contentAt(mi)));
+  } else if (gc::IsA<core::SimpleVector_sp>(molecules)) {
+    core::SimpleVector_sp vec = gc::As_unsafe<core::SimpleVector_sp>(molecules);
+    for ( size_t mi=0; mi<vec->length(); ++mi ) mols.push_back(gc::As<Molecule_sp>((*vec)[mi]));
+  } else if (molecules.consp() || molecules.nilp()) {
+    for ( auto cur : gc::As<core::List_sp>(molecules) ) mols.push_back(gc::As<Molecule_sp>(CONS_CAR(cur)));
+  } else {
+    SIMPLE_ERROR("molecules must be a molecule, an aggregate or a list or simple-vector of molecules - got {}", _rep_(molecules));
+  }
+  std::string out;
+  out.reserve(SDF_WRITE_CHUNK+4096);
+  for ( size_t mi=0; mi<mols.size(); ++mi ) {
+    sdf_write_molecule(out,mols[mi],properties);
+    if (out.size()>=SDF_WRITE_CHUNK) {
+      core::clasp_write_string(out,stream);
+      out.clear();
+      gctools::handle_all_queued_interrupts();
+    }
+  }
+  core::clasp_write_string(out,stream);
+}
+
+};
@@ -0,0 +1,300 @@
+/*
+    File: solvate.cc
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+/* -^- */
+#define	DEBUG_LEVEL_NONE
+
+#include <clasp/core/common.h>
+#include <clasp/core/array.h>
+#include <clasp/core/symbolTable.h>
+#include <cando/chem/aggregate.h>
+#include <cando/chem/molecule.h>
+#include <cando/chem/residue.h>
+#include <cando/chem/atom.h>
+#include <cando/chem/nVector.h>
+#include <cando/chem/matterTemplate.h>
+#include <clasp/core/wrappers.h>
+#include <algorithm>
+#include <thread>
+
+namespace chem {
+
+SYMBOL_EXPORT_SC_(KeywordPkg,rectangular);
+SYMBOL_EXPORT_SC_(KeywordPkg,octahedron);
+SYMBOL_EXPORT_SC_(KeywordPkg,shell);
+SYMBOL_EXPORT_SC_(KeywordPkg,sphere);
+
+// Below this many solvent boxes the boxes are tested on one thread
+#define SOLVATE_BOXES_PER_THREAD 8
+
+/*! The solute atoms binned into a uniform grid of cubic cells.
+ *  Atoms are sorted by cell so the atoms of cell c are
+ *  _X[_CellStart[c]] .. _X[_CellStart[c+1]-1]
+ */
+struct SoluteCellGrid {
+  double _MinX, _MinY, _MinZ;
+  double _CellSize;
+  int    _NX, _NY, _NZ;
+  std::vector<size_t> _CellStart;
+  std::vector<double> _X, _Y, _Z;
+
+  size_t cellIndex(int ix, int iy, int iz) const { return ((size_t)ix*this->_NY+iy)*this->_NZ+iz; };
+  int clampCell(double delta, int n) const {
+    int ii = (int)floor(delta/this->_CellSize);
+    return std::max(0,std::min(n-1,ii));
+  }
+
+  SoluteCellGrid(NVector_sp xvec, NVector_sp yvec, NVector_sp zvec, double cellSize) {
+    size_t num = xvec->length();
+    this->_MinX = this->_MinY = this->_MinZ = 0.0;
+    double maxX = 0.0, maxY = 0.0, maxZ = 0.0;
+    for ( size_t ii=0; ii<num; ii++ ) {
+      double x = (*xvec)[ii], y = (*yvec)[ii], z = (*zvec)[ii];
+      if (ii==0 || x<this->_MinX) this->_MinX = x;
+      if (ii==0 || y<this->_MinY) this->_MinY = y;
+      if (ii==0 || z<this->_MinZ) this->_MinZ = z;
+      if (ii==0 || x>maxX) maxX = x;
+      if (ii==0 || y>maxY) maxY = y;
+      if (ii==0 || z>maxZ) maxZ = z;
+    }
+    // Grow the cells until there are no more than a few per atom so that a
+    // sparse solute spread over a large volume doesn't allocate a huge grid
+    size_t maxCells = std::max((size_t)1024,4*num);
+    this->_CellSize = std::max(cellSize,0.1);
+    while (1) {
+      this->_NX = (int)floor((maxX-this->_MinX)/this->_CellSize)+1;
+      this->_NY = (int)floor((maxY-this->_MinY)/this->_CellSize)+1;
+      this->_NZ = (int)floor((maxZ-this->_MinZ)/this->_CellSize)+1;
+      if ((size_t)this->_NX*this->_NY*this->_NZ <= maxCells) break;
+      this->_CellSize *= 1.26;
+    }
+    size_t numCells = (size_t)this->_NX*this->_NY*this->_NZ;
+    std::vector<size_t> atomCell(num);
+    this->_CellStart.assign(numCells+1,0);
+    for ( size_t ii=0; ii<num; ii++ ) {
+      atomCell[ii] = this->cellIndex(this->clampCell((*xvec)[ii]-this->_MinX,this->_NX),
+                                     this->clampCell((*yvec)[ii]-this->_MinY,this->_NY),
+                                     this->clampCell((*zvec)[ii]-this->_MinZ,this->_NZ));
+      this->_CellStart[atomCell[ii]+1]++;
+    }
+    for ( size_t cc=0; cc<numCells; cc++ ) this->_CellStart[cc+1] += this->_CellStart[cc];
+    std::vector<size_t> fill(this->_CellStart.begin(),this->_CellStart.end()-1);
+    this->_X.resize(num);
+    this->_Y.resize(num);
+    this->_Z.resize(num);
+    for ( size_t ii=0; ii<num; ii++ ) {
+      size_t slot = fill[atomCell[ii]]++;
+      this->_X[slot] = (*xvec)[ii];
+      this->_Y[slot] = (*yvec)[ii];
+      this->_Z[slot] = (*zvec)[ii];
+    }
+  }
+
+  /*! Return true if any solute atom is closer than sqrt(distanceSquared) to (x,y,z) */
+  bool anyWithin(double x, double y, double z, double distanceSquared) const {
+    if (this->_X.size()==0) return false;
+    double distance = sqrt(distanceSquared);
+    int xlo = this->clampCell(x-distance-this->_MinX,this->_NX);
+    int xhi = this->clampCell(x+distance-this->_MinX,this->_NX);
+    int ylo = this->clampCell(y-distance-this->_MinY,this->_NY);
+    int yhi = this->clampCell(y+distance-this->_MinY,this->_NY);
+    int zlo = this->clampCell(z-distance-this->_MinZ,this->_NZ);
+    int zhi = this->clampCell(z+distance-this->_MinZ,this->_NZ);
+    for ( int ix=xlo; ix<=xhi; ix++ ) {
+      for ( int iy=ylo; iy<=yhi; iy++ ) {
+        for ( int iz=zlo; iz<=zhi; iz++ ) {
+          size_t cell = this->cellIndex(ix,iy,iz);
+          for ( size_t ii=this->_CellStart[cell], iEnd=this->_CellStart[cell+1]; ii<iEnd; ii++ ) {
+            double dx = this->_X[ii]-x;
+            double dy = this->_Y[ii]-y;
+            double dz = this->_Z[ii]-z;
+            if (dx*dx+dy*dy+dz*dz < distanceSquared) return true;
+          }
+        }
+      }
+    }
+    return false;
+  }
+};
+
+/*! Return true if (x,y,z) is inside the truncated octahedron used by leap's solvateOct
+ *  with average half width halfWidth.  This follows invalid-solvent-octahedron in solvate.lisp.
+ */
+static bool insideTruncatedOctahedron(double x, double y, double z, double halfWidth)
+{
+  double sqrt2 = sqrt(2.0);
+  double s2h = sqrt2*halfWidth;
+  double fourThirdsH = 4.0/3.0*halfWidth;
+  if (!(-(s2h*2.0/3.0) <= z && (s2h*2.0/3.0) >= z)) return false;
+  if (x >= 0.0) {
+    if (!(sqrt2*x-s2h <= z && -sqrt2*x+s2h >= z)) return false;
+  } else {
+    if (!(-sqrt2*x-s2h <= z && sqrt2*x+s2h >= z)) return false;
+  }
+  if (y >= 0.0) {
+    if (!(sqrt2*y-s2h <= z && -sqrt2*y+s2h >= z)) return false;
+    return (x >= 0.0) ? (-x+fourThirdsH >= y) : (x+fourThirdsH >= y);
+  }
+  if (!(-sqrt2*y-s2h <= z && sqrt2*y+s2h >= z)) return false;
+  return (x >= 0.0) ? (x-fourThirdsH <= y) : (-x-fourThirdsH <= y);
+}
+
+CL_DOCSTRING(R"dx(Tile the solvent box SOLVENT ix*iy*iz times and add to SOLUTE every solvent
+molecule that does not overlap the solute and satisfies MODE.  The solute atoms
+(solute-xvec/yvec/zvec) are binned into a cell grid once and the solvent molecules of each box
+image are tested in place, in parallel, before only the surviving molecules are copied.
+
+START is the center of the first box and SOLVENT-WIDTHS the step between boxes - boxes are
+placed at start - (i,j,k)*solvent-widths.  A solvent molecule overlaps the solute if any of its
+atoms is closer than sqrt(overlap-squared) to a solute atom.
+
+MODE is one of
+:rectangular - every atom must be inside the box of WIDTHS centered at the origin.
+:octahedron  - some atom must be inside the truncated octahedron with the average of WIDTHS.
+:shell       - some atom must be within FARNESS of a solute atom.
+:sphere      - every atom must be within RADIUS of CENTER.
+
+Surviving molecules are named WAT_n where n counts every solvent molecule visited starting
+after START-COUNT, and are typed :solvent.  Return the number of molecules added.)dx");
+CL_LAMBDA(solute solvent solute-xvec solute-yvec solute-zvec ix iy iz start solvent-widths overlap-squared mode widths farness center radius &optional (start-count 0));
+DOCGROUP(cando);
+CL_DEFUN size_t chem__solvate_boxes(Aggregate_sp solute,
+                                    Aggregate_sp solvent,
+                                    NVector_sp solute_xvec,
+                                    NVector_sp solute_yvec,
+                                    NVector_sp solute_zvec,
+                                    size_t ix, size_t iy, size_t iz,
+                                    const Vector3& start,
+                                    const Vector3& solventWidths,
+                                    double overlapSquared,
+                                    core::Symbol_sp mode,
+                                    const Vector3& widths,
+                                    double farness,
+                                    const Vector3& center,
+                                    double radius,
+                                    size_t startCount)
+{
+  if (!(mode == kw::_sym_rectangular || mode == kw::_sym_octahedron
+        || mode == kw::_sym_shell || mode == kw::_sym_sphere)) {
+    SIMPLE_ERROR("mode {} must be one of :rectangular, :octahedron, :shell or :sphere", _rep_(mode));
+  }
+  // Pull the solvent box template coordinates out of the atoms once
+  size_t numMolecules = solvent->contentSize();
+  std::vector<size_t> moleculeStart(numMolecules+1,0);
+  std::vector<double> templateX, templateY, templateZ;
+  for ( size_t moli=0; moli<numMolecules; moli++ ) {
+    Molecule_sp mol = gc::As<Molecule_sp>(solvent->contentAt(moli));
+    for ( size_t resi=0, endResi(mol->contentSize()); resi<endResi; resi++ ) {
+      Residue_sp res = gc::As_unsafe<Residue_sp>(mol->contentAt(resi));
+      for ( size_t ati=0, endAti(res->contentSize()); ati<endAti; ati++ ) {
+        Vector3 pos = gc::As_unsafe<Atom_sp>(res->contentAt(ati))->getPosition();
+        templateX.push_back(pos.getX());
+        templateY.push_back(pos.getY());
+        templateZ.push_back(pos.getZ());
+      }
+    }
+    moleculeStart[moli+1] = templateX.size();
+  }
+  double cellSize = sqrt(overlapSquared);
+  double farnessSquared = farness*farness;
+  if (mode == kw::_sym_shell) cellSize = std::max(cellSize,farness);
+  SoluteCellGrid grid(solute_xvec,solute_yvec,solute_zvec,cellSize);
+  double halfWidth = (widths.getX()+widths.getY()+widths.getZ())/6.0;
+  double radiusSquared = radius*radius;
+  size_t numBoxes = ix*iy*iz;
+  std::vector<char> keep(numBoxes*numMolecules,0);
+  auto testBoxes = [&] (size_t tid, size_t numThreads) {
+    for ( size_t box=tid; box<numBoxes; box+=numThreads ) {
+      size_t ii = box/(iy*iz);
+      size_t jj = (box/iz)%iy;
+      size_t kk = box%iz;
+      double dx = start.getX()-ii*solventWidths.getX();
+      double dy = start.getY()-jj*solventWidths.getY();
+      double dz = start.getZ()-kk*solventWidths.getZ();
+      for ( size_t moli=0; moli<numMolecules; moli++ ) {
+        bool overlaps = false;
+        bool anyInside = false;
+        bool allInside = true;
+        for ( size_t ai=moleculeStart[moli]; ai<moleculeStart[moli+1]; ai++ ) {
+          double x = templateX[ai]+dx;
+          double y = templateY[ai]+dy;
+          double z = templateZ[ai]+dz;
+          if (grid.anyWithin(x,y,z,overlapSquared)) {
+            overlaps = true;
+            break;
+          }
+          if (mode == kw::_sym_rectangular) {
+            allInside &= (widths.getX()/2.0 > fabs(x) && widths.getY()/2.0 > fabs(y) && widths.getZ()/2.0 > fabs(z));
+          } else if (mode == kw::_sym_octahedron) {
+            anyInside |= insideTruncatedOctahedron(x,y,z,halfWidth);
+          } else if (mode == kw::_sym_shell) {
+            anyInside |= (!anyInside && grid.anyWithin(x,y,z,farnessSquared));
+          } else {
+            double cx = center.getX()-x, cy = center.getY()-y, cz = center.getZ()-z;
+            allInside &= (radiusSquared > cx*cx+cy*cy+cz*cz);
+          }
+        }
+        if (overlaps) continue;
+        bool accept = (mode == kw::_sym_rectangular || mode == kw::_sym_sphere) ? allInside : anyInside;
+        keep[box*numMolecules+moli] = accept;
+      }
+    }
+  };
+  size_t numThreads = std::max(1U,std::thread::hardware_concurrency());
+  numThreads = std::max((size_t)1,std::min(numThreads,numBoxes/SOLVATE_BOXES_PER_THREAD));
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads-1);
+  for ( size_t tid=1; tid<numThreads; ++tid ) threads.emplace_back(testBoxes,tid,numThreads);
+  testBoxes(0,numThreads);
+  for ( auto& thread : threads ) thread.join();
+  // Copy the survivors in box order so that the names match what tool-add-all-boxes gave them
+  // Each solvent molecule is captured once and stamped out for every box it survives in
+  gctools::Vec0<MatterTemplate_sp> templates;
+  for ( size_t moli=0; moli<numMolecules; moli++ ) {
+    templates.push_back(MatterTemplate_O::make(gc::As<Molecule_sp>(solvent->contentAt(moli))));
+  }
+  solute->reserveContents(solute->contentSize()+std::count(keep.begin(),keep.end(),1));
+  size_t counter = startCount;
+  size_t added = 0;
+  for ( size_t box=0; box<numBoxes; box++ ) {
+    size_t ii = box/(iy*iz);
+    size_t jj = (box/iz)%iy;
+    size_t kk = box%iz;
+    Vector3 offset(start.getX()-ii*solventWidths.getX(),
+                   start.getY()-jj*solventWidths.getY(),
+                   start.getZ()-kk*solventWidths.getZ());
+    for ( size_t moli=0; moli<numMolecules; moli++ ) {
+      counter++;
+      if (!keep[box*numMolecules+moli]) continue;
+      Molecule_sp copy = templates[moli]->instantiateTranslated(offset);
+      copy->setName(chemkw_intern(fmt::format("WAT_{}",counter)));
+      copy->setf_molecule_type(kw::_sym_solvent);
+      solute->addMatter(copy);
+      added++;
+    }
+  }
+  return added;
+}
+
+};
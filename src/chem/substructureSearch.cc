@@ -0,0 +1,262 @@
+/*
+    File: substructureSearch.cc
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University
+at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+/* -^- */
+#define DEBUG_LEVEL_NONE
+
+//
+// Batch substructure search
+//
+// The molecule fingerprints, the subset screen and the full match of patterns
+// whose tests are all decided by the MoleculeInvariants are pure C++ and run on
+// worker threads.  Only the pairs with a pattern that can evaluate Lisp
+// predicates are verified on the calling thread.
+//
+
+#include <thread>
+#include <clasp/core/common.h>
+#include <cando/chem/chemInfo.h>
+#include <cando/chem/chemInfoMatcher.h>
+#include <cando/chem/substructureSearch.h>
+#include <cando/chem/bond.h>
+#include <clasp/core/wrappers.h>
+
+namespace chem {
+
+namespace fingerprint {
+  enum Feature { AtomType=1, AtomElement, ElementCount, BondType, BondElements, Path2, RingSize };
+  // Bond classes - 0 means that the pattern doesn't say
+  enum BondClass { AnyBondClass=0, SingleBondClass, DoubleBondClass, TripleBondClass, AromaticBondClass };
+  // What happened to a molecule/pattern pair
+  enum PairState : uint8_t { Screened=0, Unverified, Hit, Miss };
+
+  inline uint64_t mix(uint64_t h, uint64_t v) {
+    // splitmix64 finalizer applied to the running hash
+    uint64_t z = h ^ (v + 0x9e3779b97f4a7c15ull + (h<<6) + (h>>2));
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+  inline uint64_t feature(uint64_t a, uint64_t b = 0, uint64_t c = 0, uint64_t d = 0) {
+    return mix(mix(mix(mix(0, a), b), c), d);
+  }
+  inline uint64_t ordered(uint64_t x, uint64_t y) { return x < y ? x : y; };
+  inline uint64_t other(uint64_t x, uint64_t y) { return x < y ? y : x; };
+
+  // Same classification that _matchBondTypesImpl uses for the simple BondEnums
+  inline int bondClass(const InvariantEdge& edge) {
+    if (edge._InAromaticBond || edge._Order == aromaticBond) return AromaticBondClass;
+    if (Bond_O::singleBondP(edge._Order)) return SingleBondClass;
+    if (edge._Order == doubleBond) return DoubleBondClass;
+    if (edge._Order == tripleBond) return TripleBondClass;
+    return AnyBondClass;
+  }
+  inline int bondClass(BondEnum be) {
+    switch (be) {
+    case SABSingleBond: return SingleBondClass;
+    case SABDoubleBond: return DoubleBondClass;
+    case SABTripleBond: return TripleBondClass;
+    case SABAromaticBond: return AromaticBondClass;
+    default: return AnyBondClass;
+    }
+  }
+};
+
+Fingerprint moleculeFingerprint(const MoleculeInvariants_O& inv) {
+  using namespace fingerprint;
+  Fingerprint fp;
+  size_t numAtoms = inv._Atoms.size();
+  std::vector<int> elementCounts(element_MAX, 0);
+  for (size_t ai = 0; ai < numAtoms; ++ai) {
+    const AtomInvariants& atom = inv._Atoms[ai];
+    uint64_t el = atom._ElementEnum;
+    bool aromatic = (atom._Bits & invariant::Aromatic);
+    fp.setFeature(feature(AtomType, el, aromatic));
+    fp.setFeature(feature(AtomElement, el));
+    int count = ++elementCounts[atom._ElementEnum];
+    if (count <= 4) fp.setFeature(feature(ElementCount, el, count));
+    for (int size = invariant::RingSizeMin; size <= invariant::RingSizeMax; ++size) {
+      if (atom._RingSizes & (1ull << size)) {
+        fp.setFeature(feature(RingSize, el, size));
+        fp.setFeature(feature(RingSize, element_MAX, size));
+      }
+    }
+    for (size_t ei = inv._NeighborStart[ai]; ei < inv._NeighborStart[ai + 1]; ++ei) {
+      const InvariantEdge& edge = inv._Neighbors[ei];
+      uint64_t nel = inv._Atoms[edge._Neighbor]._ElementEnum;
+      if (ai < edge._Neighbor) {
+        fp.setFeature(feature(BondType, ordered(el, nel), other(el, nel), bondClass(edge)));
+        fp.setFeature(feature(BondElements, ordered(el, nel), other(el, nel)));
+      }
+      // Paths of two bonds centered on this atom
+      for (size_t ej = ei + 1; ej < inv._NeighborStart[ai + 1]; ++ej) {
+        uint64_t oel = inv._Atoms[inv._Neighbors[ej]._Neighbor]._ElementEnum;
+        fp.setFeature(feature(Path2, ordered(nel, oel), el, other(nel, oel)));
+      }
+    }
+  }
+  return fp;
+}
+
+Fingerprint patternFingerprint(const CompiledChemInfo_O& compiled) {
+  using namespace fingerprint;
+  Fingerprint fp;
+  size_t nv = compiled.numberOfVertices();
+  std::vector<int> elements(nv, -1);
+  std::vector<int> elementCounts(element_MAX, 0);
+  for (size_t vi = 0; vi < nv; ++vi) {
+    const CompiledChemInfoVertex& vertex = compiled._Vertices[vi];
+    if (vertex._Element.notnilp()) {
+      elements[vi] = elementForSymbol(vertex._Element);
+      uint64_t el = elements[vi];
+      if (vertex._Required & invariant::Aromatic) {
+        fp.setFeature(feature(AtomType, el, true));
+      } else if (vertex._Forbidden & invariant::Aromatic) {
+        fp.setFeature(feature(AtomType, el, false));
+      } else {
+        fp.setFeature(feature(AtomElement, el));
+      }
+      int count = ++elementCounts[elements[vi]];
+      if (count <= 4) fp.setFeature(feature(ElementCount, el, count));
+    }
+    for (int size = invariant::RingSizeMin; size <= invariant::RingSizeMax; ++size) {
+      if (vertex._Required & invariant::ringSize(size)) {
+        fp.setFeature(feature(RingSize, elements[vi] >= 0 ? elements[vi] : element_MAX, size));
+      }
+    }
+  }
+  for (size_t ei = 0; ei < compiled._Edges.size(); ++ei) {
+    const CompiledChemInfoEdge& edge = compiled._Edges[ei];
+    int e1 = elements[edge._Vertex1];
+    int e2 = elements[edge._Vertex2];
+    if (e1 < 0 || e2 < 0 || edge._Vertex1 == edge._Vertex2) continue;
+    int bc = bondClass(edge._Bond->_Bond);
+    if (bc == AnyBondClass) {
+      fp.setFeature(feature(BondElements, ordered(e1, e2), other(e1, e2)));
+    } else {
+      fp.setFeature(feature(BondType, ordered(e1, e2), other(e1, e2), bc));
+    }
+  }
+  // Paths of two edges through a vertex with three distinct vertices that all have definite elements
+  for (size_t vi = 0; vi < nv; ++vi) {
+    if (elements[vi] < 0) continue;
+    for (size_t ii = compiled._EdgeStart[vi]; ii < compiled._EdgeStart[vi + 1]; ++ii) {
+      const CompiledChemInfoEdge& edge1 = compiled._Edges[compiled._VertexEdges[ii]];
+      size_t n1 = (edge1._Vertex1 == vi) ? edge1._Vertex2 : edge1._Vertex1;
+      for (size_t jj = ii + 1; jj < compiled._EdgeStart[vi + 1]; ++jj) {
+        const CompiledChemInfoEdge& edge2 = compiled._Edges[compiled._VertexEdges[jj]];
+        size_t n2 = (edge2._Vertex1 == vi) ? edge2._Vertex2 : edge2._Vertex1;
+        if (n1 == n2 || n1 == vi || n2 == vi || elements[n1] < 0 || elements[n2] < 0) continue;
+        fp.setFeature(feature(Path2, ordered(elements[n1], elements[n2]), elements[vi], other(elements[n1], elements[n2])));
+      }
+    }
+  }
+  return fp;
+}
+
+/*! Run fn(index) for index in [0,count) spread over numThreads threads */
+template <typename Fn>
+static void parallel_for(size_t count, size_t numThreads, Fn fn) {
+  if (numThreads <= 1 || count < 2) {
+    for (size_t ii = 0; ii < count; ++ii) fn(ii);
+    return;
+  }
+  numThreads = std::min(numThreads, count);
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads);
+  for (size_t tt = 0; tt < numThreads; ++tt) {
+    threads.emplace_back([tt, numThreads, count, &fn]() {
+      for (size_t ii = tt; ii < count; ii += numThreads) fn(ii);
+    });
+  }
+  for (auto& thread : threads) thread.join();
+}
+
+CL_DOCSTRING(R"dx(Return the number of bits set in the fingerprint of the molecule-invariants or compiled-chem-info.)dx");
+DOCGROUP(cando);
+CL_DEFUN size_t chem__fingerprint_bit_count(core::T_sp object) {
+  if (gc::IsA<MoleculeInvariants_sp>(object)) {
+    return moleculeFingerprint(*gc::As_unsafe<MoleculeInvariants_sp>(object)).count();
+  } else if (gc::IsA<CompiledChemInfo_sp>(object)) {
+    return patternFingerprint(*gc::As_unsafe<CompiledChemInfo_sp>(object)).count();
+  }
+  SIMPLE_ERROR("Cannot fingerprint {}", _rep_(object));
+}
+
+CL_DOCSTRING(R"dx(Search every molecule in molecule-invariants-list for every pattern in compiled-chem-info-list.
+Pairs whose fingerprints rule out a match are skipped and the rest are checked with the compiled matcher.
+Returns (values hits number-of-pairs-verified) where hits is a vector with one simple-bit-vector per molecule
+and (sbit (aref hits molecule-index) pattern-index) is 1 if the pattern matches the molecule.
+If threads is 0 then one thread per hardware thread is used.  Patterns that evaluate lisp predicates
+(or need rings that the molecule-invariants don't have) are matched on the calling thread.)dx");
+CL_LAMBDA(molecule-invariants-list compiled-chem-info-list &key (threads 0) induced);
+DOCGROUP(cando);
+CL_DEFUN core::T_mv chem__substructure_search(core::List_sp moleculeInvariantsList, core::List_sp compiledList, size_t numThreads, bool induced) {
+  using namespace fingerprint;
+  std::vector<MoleculeInvariants_sp> molecules;
+  for (auto cur : moleculeInvariantsList) molecules.push_back(gc::As<MoleculeInvariants_sp>(CONS_CAR(cur)));
+  std::vector<CompiledChemInfo_sp> patterns;
+  for (auto cur : compiledList) patterns.push_back(gc::As<CompiledChemInfo_sp>(CONS_CAR(cur)));
+  if (numThreads == 0) numThreads = std::max(1U, std::thread::hardware_concurrency());
+  size_t numMolecules = molecules.size();
+  size_t numPatterns = patterns.size();
+  std::vector<Fingerprint> patternFingerprints;
+  patternFingerprints.reserve(numPatterns);
+  for (auto& pattern : patterns) patternFingerprints.push_back(patternFingerprint(*pattern));
+  // Screening and matching pure patterns only read the invariants so they are safe off the lisp thread
+  std::vector<uint8_t> pairs(numMolecules * numPatterns, Screened);
+  parallel_for(numMolecules, numThreads, [&](size_t mi) {
+    const MoleculeInvariants_O& inv = *molecules[mi];
+    Fingerprint fp = moleculeFingerprint(inv);
+    for (size_t pi = 0; pi < numPatterns; ++pi) {
+      uint8_t& pair = pairs[mi * numPatterns + pi];
+      if (patterns[pi]->numberOfVertices() > inv.numberOfAtoms() || !patternFingerprints[pi].subsetOf(fp)) continue;
+      if (patterns[pi]->pureFor(inv)) {
+        pair = patterns[pi]->matchExists(molecules[mi], induced) ? Hit : Miss;
+      } else {
+        pair = Unverified;
+      }
+    }
+  });
+  core::SimpleVector_sp hits = core::SimpleVector_O::make(numMolecules);
+  size_t verified = 0;
+  for (size_t mi = 0; mi < numMolecules; ++mi) {
+    core::SimpleBitVector_sp row = core::SimpleBitVector_O::make(numPatterns, 0, true);
+    for (size_t pi = 0; pi < numPatterns; ++pi) {
+      uint8_t pair = pairs[mi * numPatterns + pi];
+      if (pair == Screened) continue;
+      verified++;
+      if (pair == Unverified) {
+        // The pattern may call lisp so it is matched here
+        pair = patterns[pi]->search(molecules[mi], -1, induced, true).notnilp() ? Hit : Miss;
+      }
+      if (pair == Hit) row->setBit(pi, 1);
+    }
+    hits->rowMajorAset(mi, row);
+  }
+  return Values(hits, core::make_fixnum(verified));
+}
+
+};
@@ -0,0 +1,647 @@
+/*
+    File: torsionScan.cc
+*/
+/*
+Open Source License
+Copyright (c) 2016, Christian E. Schafmeister
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+This is an open source license for the CANDO software from Temple University, but it is not the only one. Contact Temple University at mailto:techtransfer@temple.edu if you would like a different license.
+*/
+/* -^- */
+#define	DEBUG_LEVEL_NONE
+
+#include <clasp/core/foundation.h>
+#include <clasp/core/common.h>
+#include <clasp/core/array.h>
+#include <clasp/core/hashTableEq.h>
+#include <clasp/core/numbers.h>
+#include <clasp/core/evaluator.h>
+#include <cando/chem/torsionScan.h>
+#include <cando/chem/matter.h>
+#include <cando/chem/aggregate.h>
+#include <cando/chem/molecule.h>
+#include <cando/chem/atom.h>
+#include <cando/chem/nVector.h>
+#include <clasp/core/wrappers.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <thread>
+
+namespace chem {
+
+// The first torsions are split into about this many prefixes per thread
+#define TORSION_SCAN_TASKS_PER_THREAD 8
+// When streaming, each prefix walks ahead by at most this many blocks
+#define TORSION_SCAN_BATCHES_PER_TASK 2
+
+/*! out = a*b for transforms stored as 3x3 rotation (row major) then translation */
+static void torsion_transform_multiply(const double* a, const double* b, double* out)
+{
+  for ( int ri=0; ri<3; ++ri ) {
+    for ( int ci=0; ci<3; ++ci ) {
+      out[ri*3+ci] = a[ri*3]*b[ci] + a[ri*3+1]*b[3+ci] + a[ri*3+2]*b[6+ci];
+    }
+    out[9+ri] = a[ri*3]*b[9] + a[ri*3+1]*b[10] + a[ri*3+2]*b[11] + a[9+ri];
+  }
+}
+
+static void torsion_transform_apply(const double* transform, const double* in, double* out)
+{
+  for ( int ri=0; ri<3; ++ri ) {
+    out[ri] = transform[ri*3]*in[0] + transform[ri*3+1]*in[1] + transform[ri*3+2]*in[2] + transform[9+ri];
+  }
+}
+
+/*! The transform that rotates by angle (right handed) about the axis from point from to point to */
+static void torsion_rotation(const double* from, const double* to, double angle, double* out)
+{
+  double axis[3] = { to[0]-from[0], to[1]-from[1], to[2]-from[2] };
+  double len = std::sqrt(axis[0]*axis[0]+axis[1]*axis[1]+axis[2]*axis[2]);
+  for ( int ii=0; ii<3; ++ii ) axis[ii] /= len;
+  double cs = std::cos(angle), sn = std::sin(angle), cm = 1.0-cs;
+  double x = axis[0], y = axis[1], z = axis[2];
+  out[0] = cs+x*x*cm;   out[1] = x*y*cm-z*sn; out[2] = x*z*cm+y*sn;
+  out[3] = y*x*cm+z*sn; out[4] = cs+y*y*cm;   out[5] = y*z*cm-x*sn;
+  out[6] = z*x*cm-y*sn; out[7] = z*y*cm+x*sn; out[8] = cs+z*z*cm;
+  for ( int ri=0; ri<3; ++ri ) {
+    out[9+ri] = from[ri] - (out[ri*3]*from[0] + out[ri*3+1]*from[1] + out[ri*3+2]*from[2]);
+  }
+}
+
+static double torsion_dihedral(const double* a, const double* b, const double* c, const double* d)
+{
+  double b1[3], b2[3], b3[3], n1[3], n2[3], m1[3];
+  for ( int ii=0; ii<3; ++ii ) {
+    b1[ii] = b[ii]-a[ii];
+    b2[ii] = c[ii]-b[ii];
+    b3[ii] = d[ii]-c[ii];
+  }
+  auto cross = [] (const double* u, const double* v, double* w) {
+    w[0] = u[1]*v[2]-u[2]*v[1];
+    w[1] = u[2]*v[0]-u[0]*v[2];
+    w[2] = u[0]*v[1]-u[1]*v[0];
+  };
+  cross(b1,b2,n1);
+  cross(b2,b3,n2);
+  double len2 = std::sqrt(b2[0]*b2[0]+b2[1]*b2[1]+b2[2]*b2[2]);
+  double u2[3] = { b2[0]/len2, b2[1]/len2, b2[2]/len2 };
+  // The same sign as geom:calculate-dihedral
+  cross(u2,n1,m1);
+  double x = n1[0]*n2[0]+n1[1]*n2[1]+n1[2]*n2[2];
+  double y = m1[0]*n2[0]+m1[1]*n2[1]+m1[2]*n2[2];
+  return std::atan2(y,x);
+}
+
+void TorsionScanPlan::buildGrid(const std::vector<uint32_t>& fixedAtoms)
+{
+  double lo[3] = {0.0,0.0,0.0}, hi[3] = {0.0,0.0,0.0};
+  for ( size_t fi=0; fi<fixedAtoms.size(); ++fi ) {
+    const double* pos = &this->_Coordinates[fixedAtoms[fi]*3];
+    for ( int ii=0; ii<3; ++ii ) {
+      if (fi==0 || pos[ii]<lo[ii]) lo[ii] = pos[ii];
+      if (fi==0 || pos[ii]>hi[ii]) hi[ii] = pos[ii];
+    }
+  }
+  size_t numCells = 1;
+  for ( int ii=0; ii<3; ++ii ) {
+    this->_GridOrigin[ii] = lo[ii];
+    this->_GridDimensions[ii] = (int32_t)std::floor((hi[ii]-lo[ii])/this->_ClashDistance)+1;
+    numCells *= this->_GridDimensions[ii];
+  }
+  std::vector<uint32_t> cellOf(fixedAtoms.size());
+  std::vector<uint32_t> counts(numCells+1,0);
+  for ( size_t fi=0; fi<fixedAtoms.size(); ++fi ) {
+    const double* pos = &this->_Coordinates[fixedAtoms[fi]*3];
+    size_t cell = 0;
+    for ( int ii=2; ii>=0; --ii ) {
+      int32_t index = std::min(this->_GridDimensions[ii]-1,(int32_t)std::floor((pos[ii]-lo[ii])/this->_ClashDistance));
+      cell = cell*this->_GridDimensions[ii] + index;
+    }
+    cellOf[fi] = cell;
+    ++counts[cell+1];
+  }
+  for ( size_t ci=0; ci<numCells; ++ci ) counts[ci+1] += counts[ci];
+  this->_GridCellStart.assign(counts.begin(),counts.end());
+  this->_GridAtoms.assign(fixedAtoms.size(),0);
+  for ( size_t fi=0; fi<fixedAtoms.size(); ++fi ) this->_GridAtoms[counts[cellOf[fi]]++] = fixedAtoms[fi];
+}
+
+namespace {
+/*! Depth first walk over the angles of the torsions for one prefix */
+struct TorsionScanWalker {
+  const TorsionScanPlan&        _Plan;
+  const std::vector<uint32_t>&  _Prefix;
+  const std::vector<int32_t>*   _Resume;
+  bool                          _Resuming;     // still walking down to the combination in _Resume
+  size_t                        _Limit;
+  std::vector<double>&          _OutCoordinates;
+  std::vector<int32_t>&         _OutIndices;
+  std::vector<double>           _Positions;
+  std::vector<double>           _Transforms;
+  std::vector<int32_t>          _Choice;
+  size_t                        _Count;
+  TorsionScanWalker(const TorsionScanPlan& plan, const std::vector<uint32_t>& prefix, const std::vector<int32_t>* resume,
+                    size_t limit, std::vector<double>& coordinates, std::vector<int32_t>& indices)
+    : _Plan(plan), _Prefix(prefix), _Resume(resume), _Resuming(resume!=NULL), _Limit(limit), _OutCoordinates(coordinates), _OutIndices(indices),
+      _Positions(plan._Coordinates.begin(),plan._Coordinates.end()),
+      _Transforms(plan.numberOfTorsions()*12), _Choice(plan.numberOfTorsions()), _Count(0) {};
+
+  bool excluded(uint32_t atom, uint32_t other) const {
+    auto begin = this->_Plan._Excluded.begin();
+    return std::binary_search(begin+this->_Plan._ExcludedStart[atom],begin+this->_Plan._ExcludedStart[atom+1],other);
+  }
+
+  bool tooClose(uint32_t atom, uint32_t other) const {
+    const double* pa = &this->_Positions[atom*3];
+    const double* pb = &this->_Positions[other*3];
+    double dx = pa[0]-pb[0], dy = pa[1]-pb[1], dz = pa[2]-pb[2];
+    double limit = this->_Plan._ClashDistance;
+    return (dx*dx+dy*dy+dz*dz<limit*limit) && !this->excluded(atom,other);
+  }
+
+  /*! Does the fragment of torsion clash with the fixed atoms or the fragments placed before it? */
+  bool clashes(size_t torsion) const {
+    const TorsionScanPlan& plan = this->_Plan;
+    for ( uint32_t fi=plan._FragmentStart[torsion]; fi<plan._FragmentStart[torsion+1]; ++fi ) {
+      uint32_t atom = plan._FragmentAtoms[fi];
+      if (!plan._ClashAtom[atom]) continue;
+      const double* pos = &this->_Positions[atom*3];
+      int32_t cell[3];
+      for ( int ii=0; ii<3; ++ii ) cell[ii] = (int32_t)std::floor((pos[ii]-plan._GridOrigin[ii])/plan._ClashDistance);
+      for ( int32_t zi=std::max(0,cell[2]-1); zi<=std::min(plan._GridDimensions[2]-1,cell[2]+1); ++zi ) {
+        for ( int32_t yi=std::max(0,cell[1]-1); yi<=std::min(plan._GridDimensions[1]-1,cell[1]+1); ++yi ) {
+          for ( int32_t xi=std::max(0,cell[0]-1); xi<=std::min(plan._GridDimensions[0]-1,cell[0]+1); ++xi ) {
+            size_t index = ((size_t)zi*plan._GridDimensions[1]+yi)*plan._GridDimensions[0]+xi;
+            for ( uint32_t gi=plan._GridCellStart[index]; gi<plan._GridCellStart[index+1]; ++gi ) {
+              if (this->tooClose(atom,plan._GridAtoms[gi])) return true;
+            }
+          }
+        }
+      }
+      for ( uint32_t pi=0; pi<plan._FragmentStart[torsion]; ++pi ) {
+        uint32_t other = plan._FragmentAtoms[pi];
+        if (plan._ClashAtom[other] && this->tooClose(atom,other)) return true;
+      }
+    }
+    return false;
+  }
+
+  void visit(size_t depth) {
+    const TorsionScanPlan& plan = this->_Plan;
+    size_t numTorsions = plan.numberOfTorsions();
+    if (depth==numTorsions) {
+      // The combination in _Resume was handed out by the previous walk
+      if (this->_Resuming) {
+        this->_Resuming = false;
+        return;
+      }
+      this->_OutCoordinates.insert(this->_OutCoordinates.end(),this->_Positions.begin(),this->_Positions.end());
+      this->_OutIndices.insert(this->_OutIndices.end(),this->_Choice.begin(),this->_Choice.end());
+      ++this->_Count;
+      return;
+    }
+    size_t first = 0, last = plan.numberOfAngles(depth);
+    if (depth<this->_Prefix.size()) {
+      first = this->_Prefix[depth];
+      last = first+1;
+    }
+    if (this->_Resuming) first = (*this->_Resume)[depth];
+    double* transform = &this->_Transforms[depth*12];
+    int32_t parent = plan._TorsionParent[depth];
+    for ( size_t ai=first; ai<last && this->_Count<this->_Limit; ++ai ) {
+      const double* rotation = &plan._AngleTransforms[(plan._AngleStart[depth]+ai)*12];
+      if (parent<0) std::copy(rotation,rotation+12,transform);
+      else torsion_transform_multiply(&this->_Transforms[parent*12],rotation,transform);
+      for ( uint32_t fi=plan._FragmentStart[depth]; fi<plan._FragmentStart[depth+1]; ++fi ) {
+        uint32_t atom = plan._FragmentAtoms[fi];
+        torsion_transform_apply(transform,&plan._Coordinates[atom*3],&this->_Positions[atom*3]);
+      }
+      if (this->clashes(depth)) continue;
+      this->_Choice[depth] = ai;
+      this->visit(depth+1);
+    }
+  }
+};
+};
+
+size_t TorsionScanPlan::enumerate(const std::vector<uint32_t>& prefix, const std::vector<int32_t>* resume, size_t limit,
+                                  std::vector<double>& coordinates, std::vector<int32_t>& indices) const
+{
+  TorsionScanWalker walker(*this,prefix,resume,limit,coordinates,indices);
+  if (limit>0) walker.visit(0);
+  return walker._Count;
+}
+
+CL_LAMBDA(matter torsions &key (clash-distance 2.2) (bond-separation 3) hydrogens);
+CL_LISPIFY_NAME(make_torsion_scan);
+CL_DOCSTRING(R"dx(Make a systematic scan over the rotatable bonds of matter (a molecule or aggregate).
+Each element of torsions is either (atom1 atom2 atom3 atom4 angles), which sets the dihedral atom1-atom2-atom3-atom4
+to each of angles, or (atom2 atom3 angles), which rotates about the atom2-atom3 bond by each of angles relative to the
+starting coordinates.  angles is a list of radians or an integer n for n angles evenly spaced around the circle.
+Atoms that are closer than clash-distance and more than bond-separation bonds apart clash and prune every combination
+that places them (only atoms heavier than hydrogen unless hydrogens is true).  The driven bonds may not be in rings.
+The coordinates of the matter are copied when the scan is made - see chem:torsion-scan-enumerate.)dx");
+DOCGROUP(cando);
+CL_DEF_CLASS_METHOD TorsionScan_sp TorsionScan_O::make(Matter_sp matter, core::List_sp torsions, double clashDistance, size_t bondSeparation, bool hydrogens)
+{
+  if (!gc::IsA<Molecule_sp>(matter) && !gc::IsA<Aggregate_sp>(matter)) {
+    TYPE_ERROR(matter,core::Cons_O::createList(_sym_Aggregate_O,_sym_Molecule_O));
+  }
+  if (clashDistance<=0.0) SIMPLE_ERROR("clash-distance must be positive - got {}", clashDistance);
+  auto  me  = gctools::GC<TorsionScan_O>::allocate_with_default_constructor();
+  me->_Matter = matter;
+  TorsionScanPlan& plan = me->_Plan;
+  plan._ClashDistance = clashDistance;
+  me->_Graph = MatterGraph_O::make(matter,false,false);
+  const MatterGraph_O& graph = *me->_Graph;
+  size_t numAtoms = graph.numberOfAtoms();
+  for ( size_t ai=0; ai<numAtoms; ++ai ) {
+    Vector3 pos = graph._Atoms[ai]->getPosition();
+    plan._Coordinates.push_back(pos.getX());
+    plan._Coordinates.push_back(pos.getY());
+    plan._Coordinates.push_back(pos.getZ());
+    plan._ClashAtom.push_back((hydrogens || graph._AtomicNumbers[ai]>1) ? 1 : 0);
+  }
+  auto indexOf = [&] (core::T_sp atom) -> uint32_t {
+    core::T_sp index = graph._AtomToIndex->gethash(atom);
+    if (!index.fixnump()) SIMPLE_ERROR("{} is not an atom of {}", _rep_(atom), _rep_(matter));
+    return index.unsafe_fixnum();
+  };
+  auto bonded = [&] (uint32_t a1, uint32_t a2) {
+    return std::find(graph.neighborsBegin(a1),graph.neighborsEnd(a1),a2)!=graph.neighborsEnd(a1);
+  };
+  // Parse the torsions: b-c is the bond, a and d the reference atoms of absolute dihedrals
+  struct Spec {
+    uint32_t _A, _B, _C, _D;
+    bool _Absolute;
+    std::vector<double> _Angles;
+  };
+  std::vector<Spec> specs;
+  for ( auto cur : torsions ) {
+    core::List_sp entry = gc::As<core::List_sp>(CONS_CAR(cur));
+    std::vector<core::T_sp> items;
+    for ( auto icur : entry ) items.push_back(CONS_CAR(icur));
+    size_t length = items.size();
+    Spec spec;
+    core::T_sp angles;
+    if (length==5) {
+      spec._Absolute = true;
+      spec._A = indexOf(items[0]);
+      spec._B = indexOf(items[1]);
+      spec._C = indexOf(items[2]);
+      spec._D = indexOf(items[3]);
+      angles = items[4];
+      if (!bonded(spec._A,spec._B) || !bonded(spec._C,spec._D)) {
+        SIMPLE_ERROR("The atoms of the dihedral {} must be bonded in sequence", _rep_(entry));
+      }
+    } else if (length==3) {
+      spec._Absolute = false;
+      spec._B = indexOf(items[0]);
+      spec._C = indexOf(items[1]);
+      spec._A = spec._D = 0;
+      angles = items[2];
+    } else {
+      SIMPLE_ERROR("Each torsion must be (atom1 atom2 atom3 atom4 angles) or (atom2 atom3 angles) - got {}", _rep_(entry));
+    }
+    if (!bonded(spec._B,spec._C)) SIMPLE_ERROR("The atoms of the driven bond in {} are not bonded", _rep_(entry));
+    if (angles.fixnump()) {
+      Fixnum count = angles.unsafe_fixnum();
+      if (count<=0) SIMPLE_ERROR("The number of angles must be positive in {}", _rep_(entry));
+      for ( Fixnum ai=0; ai<count; ++ai ) spec._Angles.push_back(2.0*M_PI*ai/count);
+    } else {
+      for ( auto acur : gc::As<core::List_sp>(angles) ) spec._Angles.push_back(core::clasp_to_double(gc::As<core::Number_sp>(CONS_CAR(acur))));
+      if (spec._Angles.empty()) SIMPLE_ERROR("No angles given in {}", _rep_(entry));
+    }
+    specs.push_back(spec);
+  }
+  // Rigid fragments are what is left connected after cutting the driven bonds
+  auto driven = [&] (uint32_t a1, uint32_t a2) {
+    for ( auto& spec : specs ) {
+      if ((spec._B==a1 && spec._C==a2) || (spec._B==a2 && spec._C==a1)) return true;
+    }
+    return false;
+  };
+  const uint32_t unset = 0xFFFFFFFF;
+  std::vector<uint32_t> fragment(numAtoms,unset);
+  std::vector<std::vector<uint32_t>> fragmentAtoms;
+  for ( size_t ai=0; ai<numAtoms; ++ai ) {
+    if (fragment[ai]!=unset) continue;
+    uint32_t id = fragmentAtoms.size();
+    fragmentAtoms.emplace_back();
+    std::vector<uint32_t>& members = fragmentAtoms.back();
+    members.push_back(ai);
+    fragment[ai] = id;
+    for ( size_t mi=0; mi<members.size(); ++mi ) {
+      uint32_t atom = members[mi];
+      for ( const uint32_t* cur=graph.neighborsBegin(atom); cur!=graph.neighborsEnd(atom); ++cur ) {
+        uint32_t other = *cur;
+        if (fragment[other]!=unset || driven(atom,other)) continue;
+        fragment[other] = id;
+        members.push_back(other);
+      }
+    }
+  }
+  size_t numFragments = fragmentAtoms.size();
+  std::vector<std::vector<uint32_t>> fragmentTorsions(numFragments);
+  for ( size_t si=0; si<specs.size(); ++si ) {
+    if (fragment[specs[si]._B]==fragment[specs[si]._C]) {
+      SIMPLE_ERROR("The bond between {} and {} is in a ring or driven twice", _rep_(graph._Atoms[specs[si]._B]), _rep_(graph._Atoms[specs[si]._C]));
+    }
+    fragmentTorsions[fragment[specs[si]._B]].push_back(si);
+    fragmentTorsions[fragment[specs[si]._C]].push_back(si);
+  }
+  // Walk the tree of fragments from the largest fragment of each tree, laying the torsions out depth first
+  std::vector<uint32_t> tree(numFragments,unset);
+  for ( size_t fi=0; fi<numFragments; ++fi ) {
+    if (tree[fi]!=unset) continue;
+    std::vector<uint32_t> stack(1,fi);
+    tree[fi] = fi;
+    for ( size_t si=0; si<stack.size(); ++si ) {
+      for ( uint32_t ti : fragmentTorsions[stack[si]] ) {
+        uint32_t other = fragment[specs[ti]._B]==stack[si] ? fragment[specs[ti]._C] : fragment[specs[ti]._B];
+        if (tree[other]==unset) {
+          tree[other] = fi;
+          stack.push_back(other);
+        }
+      }
+    }
+  }
+  std::vector<uint32_t> root(numFragments,unset);
+  for ( size_t fi=0; fi<numFragments; ++fi ) {
+    uint32_t id = tree[fi];
+    if (root[id]==unset || fragmentAtoms[fi].size()>fragmentAtoms[root[id]].size()) root[id] = fi;
+  }
+  std::vector<uint8_t> visited(numFragments,0);
+  std::vector<uint32_t> fixedAtoms;
+  plan._FragmentStart.push_back(0);
+  plan._AngleStart.push_back(0);
+  std::function<void(uint32_t,int32_t,uint32_t)> layout = [&] (uint32_t frag, int32_t parentTorsion, uint32_t enteredBy) {
+    visited[frag] = 1;
+    for ( uint32_t ti : fragmentTorsions[frag] ) {
+      if (ti==enteredBy) continue;
+      const Spec& spec = specs[ti];
+      bool forward = (fragment[spec._B]==frag);
+      uint32_t fixed = forward ? spec._B : spec._C;
+      uint32_t moving = forward ? spec._C : spec._B;
+      uint32_t child = fragment[moving];
+      if (visited[child]) {
+        SIMPLE_ERROR("The bond between {} and {} is in a ring", _rep_(graph._Atoms[spec._B]), _rep_(graph._Atoms[spec._C]));
+      }
+      int32_t torsion = plan._TorsionFixed.size();
+      plan._TorsionFixed.push_back(fixed);
+      plan._TorsionMoving.push_back(moving);
+      plan._TorsionParent.push_back(parentTorsion);
+      const double* from = &plan._Coordinates[fixed*3];
+      const double* to = &plan._Coordinates[moving*3];
+      double sign = 1.0, start = 0.0;
+      if (spec._Absolute) {
+        // Find which way a positive rotation of the moving side turns the dihedral
+        const double* pa = &plan._Coordinates[spec._A*3];
+        const double* pb = &plan._Coordinates[spec._B*3];
+        const double* pc = &plan._Coordinates[spec._C*3];
+        const double* pd = &plan._Coordinates[spec._D*3];
+        start = torsion_dihedral(pa,pb,pc,pd);
+        double test[12], moved[3];
+        torsion_rotation(from,to,0.1,test);
+        double turned;
+        if (forward) {
+          torsion_transform_apply(test,pd,moved);
+          turned = torsion_dihedral(pa,pb,pc,moved);
+        } else {
+          torsion_transform_apply(test,pa,moved);
+          turned = torsion_dihedral(moved,pb,pc,pd);
+        }
+        sign = (std::sin(turned-start)>0.0) ? 1.0 : -1.0;
+      }
+      for ( double angle : spec._Angles ) {
+        double transform[12];
+        torsion_rotation(from,to,spec._Absolute ? sign*(angle-start) : angle,transform);
+        plan._AngleTransforms.insert(plan._AngleTransforms.end(),transform,transform+12);
+      }
+      plan._AngleStart.push_back(plan._AngleTransforms.size()/12);
+      for ( uint32_t atom : fragmentAtoms[child] ) plan._FragmentAtoms.push_back(atom);
+      plan._FragmentStart.push_back(plan._FragmentAtoms.size());
+      layout(child,torsion,ti);
+    }
+  };
+  for ( size_t fi=0; fi<numFragments; ++fi ) {
+    if (root[fi]==unset) continue;
+    for ( uint32_t atom : fragmentAtoms[root[fi]] ) if (plan._ClashAtom[atom]) fixedAtoms.push_back(atom);
+    layout(root[fi],-1,unset);
+  }
+  // Clash atoms within bondSeparation bonds of each other never clash
+  std::vector<uint32_t> distance(numAtoms,unset), reached;
+  plan._ExcludedStart.push_back(0);
+  for ( size_t ai=0; ai<numAtoms; ++ai ) {
+    if (plan._ClashAtom[ai]) {
+      reached.assign(1,ai);
+      distance[ai] = 0;
+      for ( size_t ri=0; ri<reached.size(); ++ri ) {
+        uint32_t atom = reached[ri];
+        if (distance[atom]>=bondSeparation) continue;
+        for ( const uint32_t* cur=graph.neighborsBegin(atom); cur!=graph.neighborsEnd(atom); ++cur ) {
+          uint32_t other = *cur;
+          if (distance[other]!=unset) continue;
+          distance[other] = distance[atom]+1;
+          reached.push_back(other);
+        }
+      }
+      std::vector<uint32_t> excluded;
+      for ( uint32_t atom : reached ) {
+        distance[atom] = unset;
+        if (atom!=ai && plan._ClashAtom[atom]) excluded.push_back(atom);
+      }
+      std::sort(excluded.begin(),excluded.end());
+      for ( uint32_t atom : excluded ) plan._Excluded.push_back(atom);
+    }
+    plan._ExcludedStart.push_back(plan._Excluded.size());
+  }
+  plan.buildGrid(fixedAtoms);
+  return me;
+}
+
+CL_DOCSTRING(R"dx(Return the number of angle combinations the scan would try without pruning.)dx");
+CL_DEFMETHOD core::Integer_sp TorsionScan_O::numberOfCombinations() const
+{
+  uint64_t result = 1;
+  for ( size_t ti=0; ti<this->_Plan.numberOfTorsions(); ++ti ) {
+    if (__builtin_mul_overflow(result,(uint64_t)this->_Plan.numberOfAngles(ti),&result)) {
+      SIMPLE_ERROR("The number of combinations of the {} torsions does not fit in 64 bits", this->_Plan.numberOfTorsions());
+    }
+  }
+  return core::Integer_O::create(result);
+}
+
+CL_DOCSTRING(R"dx(Return a simple-vector of the atoms in the order of the coordinates of every conformation.)dx");
+CL_DEFMETHOD core::SimpleVector_sp TorsionScan_O::atomsAsVector() const
+{
+  core::SimpleVector_sp result = core::SimpleVector_O::make(this->numberOfAtoms());
+  for ( size_t ai=0; ai<this->numberOfAtoms(); ++ai ) (*result)[ai] = this->_Graph->_Atoms[ai];
+  return result;
+}
+
+namespace {
+/*! Conformations walked from one prefix that have not been handed out yet */
+struct TorsionScanBatch {
+  std::vector<double>   _Coordinates;
+  std::vector<int32_t>  _Indices;
+  size_t                _Count;
+  bool                  _Last;          // the batch ends the prefix
+};
+
+/*! One prefix of the first torsions, walked in batches that resume after the last
+ *  combination of the batch before */
+struct TorsionScanTask {
+  std::vector<uint32_t>        _Prefix;
+  std::vector<int32_t>         _Resume;
+  bool                         _Started;
+  bool                         _Done;    // the last batch has been walked
+  std::deque<TorsionScanBatch> _Batches;
+  TorsionScanTask() : _Started(false), _Done(false) {};
+};
+};
+
+CL_LAMBDA((scan chem:torsion-scan) &key callback (block-size 4096) max-conformations);
+CL_DOCSTRING(R"dx(Enumerate every combination of the angles of the scan whose atoms don't clash, in the order of
+the angle indices (the first torsion changes slowest).  Each conformation is the x,y,z of all of the atoms
+(see chem:torsion-scan-atoms) and its angle indices are one (signed-byte 32) per torsion.
+The prefixes of the first torsions are divided among threads and each is walked depth first, placing the
+fragment moved by each torsion once for all of the combinations below it and skipping them all if it clashes.
+If callback is NIL return (values coordinates indices count) where coordinates is an nvector holding the
+conformations back to back.  Otherwise call (funcall callback coordinates indices count) with blocks of up to
+block-size conformations and return the total count - each prefix is then walked block-size conformations
+at a time and at most two blocks ahead so the memory used is bounded by a few blocks per thread.  Stop after max-conformations if it is given.)dx");
+CL_DEFMETHOD core::T_mv TorsionScan_O::enumerate(core::T_sp callback, size_t blockSize, core::T_sp maxConformations) const
+{
+  const TorsionScanPlan& plan = this->_Plan;
+  size_t numTorsions = plan.numberOfTorsions();
+  size_t numAtoms = plan.numberOfAtoms();
+  size_t limit = ~(size_t)0;
+  if (maxConformations.notnilp()) {
+    if (!maxConformations.fixnump() || maxConformations.unsafe_fixnum()<0) {
+      SIMPLE_ERROR("max-conformations must be NIL or a non-negative fixnum - got {}", _rep_(maxConformations));
+    }
+    limit = maxConformations.unsafe_fixnum();
+  }
+  if (blockSize==0) SIMPLE_ERROR("block-size must be positive");
+  size_t numThreads = std::max(1U,std::thread::hardware_concurrency());
+  // Split on enough of the first torsions to give every thread several prefixes
+  size_t depth = 0, numTasks = 1;
+  while (depth<numTorsions && numTasks<numThreads*TORSION_SCAN_TASKS_PER_THREAD) numTasks *= plan.numberOfAngles(depth++);
+  std::vector<TorsionScanTask> tasks(numTasks);
+  std::vector<uint32_t> prefix(depth,0);
+  for ( size_t ti=0; ti<numTasks; ++ti ) {
+    tasks[ti]._Prefix = prefix;
+    for ( size_t di=depth; di-->0; ) {
+      if (++prefix[di]<plan.numberOfAngles(di)) break;
+      prefix[di] = 0;
+    }
+  }
+  // With a callback each task walks at most a block at a time, queues a few of them and
+  // only a window of tasks is walked, otherwise every task walks to the end at once
+  size_t batchLimit = callback.notnilp() ? blockSize : ~(size_t)0;
+  size_t window = callback.notnilp() ? numThreads*TORSION_SCAN_TASKS_PER_THREAD : numTasks;
+  std::vector<double> pendingCoordinates;
+  std::vector<int32_t> pendingIndices;
+  size_t pending = 0, emitted = 0;
+  auto flush = [&] (size_t count) {
+    NVector_sp coordinates = NVector_O::make(count*numAtoms*3);
+    core::SimpleVector_int32_t_sp indices = core::SimpleVector_int32_t_O::make(count*numTorsions);
+    for ( size_t ci=0; ci<count*numAtoms*3; ++ci ) (*coordinates)[ci] = pendingCoordinates[ci];
+    for ( size_t ci=0; ci<count*numTorsions; ++ci ) (*indices)[ci] = pendingIndices[ci];
+    pendingCoordinates.erase(pendingCoordinates.begin(),pendingCoordinates.begin()+count*numAtoms*3);
+    pendingIndices.erase(pendingIndices.begin(),pendingIndices.begin()+count*numTorsions);
+    pending -= count;
+    if (callback.notnilp()) core::eval::funcall(callback,coordinates,indices,core::make_fixnum(count));
+    return Values(coordinates,indices,core::make_fixnum(count));
+  };
+  size_t head = 0;
+  while (head<numTasks && emitted<limit) {
+    size_t windowEnd = std::min(numTasks,head+window);
+    size_t taskLimit = std::min(batchLimit,limit-emitted);
+    // Every task in the window with room in its queue walks one more batch, so the tasks
+    // behind the head keep the threads busy while the head is handed out
+    std::vector<size_t> run;
+    for ( size_t ti=head; ti<windowEnd; ++ti ) {
+      if (!tasks[ti]._Done && tasks[ti]._Batches.size()<TORSION_SCAN_BATCHES_PER_TASK) run.push_back(ti);
+    }
+    std::atomic<size_t> next(0);
+    auto worker = [&] () {
+      for ( size_t ri=next++; ri<run.size(); ri=next++ ) {
+        TorsionScanTask& task = tasks[run[ri]];
+        TorsionScanBatch batch;
+        batch._Count = plan.enumerate(task._Prefix,task._Started ? &task._Resume : NULL,taskLimit,batch._Coordinates,batch._Indices);
+        batch._Last = (batch._Count<taskLimit);
+        if (!batch._Last) {
+          task._Resume.assign(batch._Indices.end()-numTorsions,batch._Indices.end());
+          task._Started = true;
+        }
+        task._Done = batch._Last;
+        task._Batches.push_back(std::move(batch));
+      }
+    };
+    size_t runThreads = std::max((size_t)1,std::min(numThreads,run.size()));
+    std::vector<std::thread> threads;
+    threads.reserve(runThreads-1);
+    for ( size_t tid=1; tid<runThreads; ++tid ) threads.emplace_back(worker);
+    worker();
+    for ( auto& thread : threads ) thread.join();
+    // Batches are handed out in order so the batches of a task wait until the tasks before it are done
+    while (head<windowEnd && !tasks[head]._Batches.empty() && emitted<limit) {
+      TorsionScanTask& task = tasks[head];
+      TorsionScanBatch& batch = task._Batches.front();
+      size_t count = std::min(batch._Count,limit-emitted);
+      pendingCoordinates.insert(pendingCoordinates.end(),batch._Coordinates.begin(),batch._Coordinates.begin()+count*numAtoms*3);
+      pendingIndices.insert(pendingIndices.end(),batch._Indices.begin(),batch._Indices.begin()+count*numTorsions);
+      pending += count;
+      emitted += count;
+      bool last = batch._Last;
+      task._Batches.pop_front();
+      if (last) {
+        task = TorsionScanTask();
+        ++head;
+      }
+      while (callback.notnilp() && pending>=blockSize) flush(blockSize);
+    }
+    gctools::handle_all_queued_interrupts();
+  }
+  if (callback.nilp()) return flush(pending);
+  if (pending>0) flush(pending);
+  return Values(core::make_fixnum(emitted));
+}
+
+CL_LAMBDA((scan chem:torsion-scan) coordinates index);
+CL_DOCSTRING(R"dx(Set the positions of the atoms of the scan to conformation index of the coordinates
+returned by chem:torsion-scan-enumerate.)dx");
+CL_DEFMETHOD void TorsionScan_O::setPositions(core::T_sp coordinates, size_t index) const
+{
+  NVector_sp vec = gc::As<NVector_sp>(coordinates);
+  size_t numAtoms = this->numberOfAtoms();
+  if ((index+1)*numAtoms*3>vec->length()) {
+    SIMPLE_ERROR("Conformation {} is out of range - the coordinates hold {} conformations", index, vec->length()/(numAtoms*3));
+  }
+  for ( size_t ai=0; ai<numAtoms; ++ai ) {
+    size_t offset = (index*numAtoms+ai)*3;
+    this->_Graph->_Atoms[ai]->setPosition(Vector3((*vec)[offset],(*vec)[offset+1],(*vec)[offset+2]));
+  }
+}
+
+};
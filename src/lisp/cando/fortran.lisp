@@ -44,6 +44,18 @@
     (terpri (fof-stream ff))
     (setf (fof-number-on-line ff) 0)))
 
+(defun fwrite-columns (columns &optional (ff *fortran-file*))
+  "Write the vectors in _columns_ interleaved using the current format.
+Row i of every column is written before row i+1. The formatting is done in C++."
+  (when (and columns (> (length (first columns)) 0))
+    (setf (fof-number-on-line ff) (chem:fortran-write-columns (fof-stream ff) (fof-per-line ff) (fof-format ff)
+                                                              columns (fof-number-on-line ff))
+          (fof-wrote-nothing ff) nil)))
+
+(defun fwrite-vector (vals &optional (ff *fortran-file*))
+  "Write every element of the vector _vals_ using the current format"
+  (fwrite-columns (list vals) ff))
+
 (defun end-line (&optional (ff *fortran-file*))
   (when (or (fof-wrote-nothing ff) (/= (fof-number-on-line ff) 0))
     (terpri (fof-stream ff)))
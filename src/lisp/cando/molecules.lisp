@@ -230,7 +230,12 @@ Example:  (set-stereoisomer-mapping *agg* '((:C1 :R) (:C2 :S))"
                               (sd-tolerance 2000.0)
                               (cg-tolerance 0.5)
                               (tn-tolerance 0.0001)
+                              (max-single-precision-steps 0)
+                              (single-precision-tolerance 100.0)
+                              (finite-difference-hessian nil)
                               )
+  (chem:minimizer-set-single-precision minimizer max-single-precision-steps single-precision-tolerance)
+  (chem:minimizer-set-finite-difference-hessian-vector-product minimizer finite-difference-hessian)
   (chem:set-maximum-number-of-steepest-descent-steps minimizer max-sd-steps)
   (chem:set-maximum-number-of-conjugate-gradient-steps minimizer max-cg-steps)
   (chem:set-maximum-number-of-truncated-newton-steps minimizer max-tn-steps)
@@ -71,6 +71,8 @@
            #:with-fortran-input-file
            #:fformat
            #:fwrite
+           #:fwrite-vector
+           #:fwrite-columns
            #:end-line
            #:debug-on
            #:debug
@@ -65,21 +65,22 @@ The first rule that matches is used to assign the type."
 (defmethod chem:assign-force-field-types ((combined-smirnoff-force-field combined-smirnoff-force-field) molecule atom-types)
   "The first rule that matches is used to assign the types.
 The chem:force-field-type-rules-merged generic function was used to organize the rules."
-  (chem:do-atoms (atom molecule)
-    (let ((type (loop named assign-type
-                      for field in (chem:force-fields-as-list combined-smirnoff-force-field)
-                      for vdw-force = (vdw-force field)
-                      for terms = (terms vdw-force)
-                      do (loop for index from (1- (length terms)) downto 0
-                               for term = (aref terms index)
-                               for compiled-smirks = (compiled-smirks term)
-                               for type = (ttype term)
-                               for match = (chem:matches compiled-smirks atom)
-                               when match
-                                 do (return-from assign-type type)))))
-      (if type
-          (setf (gethash atom atom-types) type)
-          (error "Could not set type of atom ~s in force-field ~s" atom :smirnoff)))))
+  (let ((molecule-invariants (chem:make-molecule-invariants (chem:make-molecule-graph-from-molecule molecule))))
+    (chem:do-atoms (atom molecule)
+      (let ((type (loop named assign-type
+                        for field in (chem:force-fields-as-list combined-smirnoff-force-field)
+                        for vdw-force = (vdw-force field)
+                        for terms = (terms vdw-force)
+                        do (loop for index from (1- (length terms)) downto 0
+                                 for term = (aref terms index)
+                                 for type = (ttype term)
+                                 for match = (chem:chem-info-graph-match (maybe-cached-smirnoff-term term)
+                                                                         molecule-invariants atom)
+                                 when match
+                                   do (return-from assign-type type)))))
+        (if type
+            (setf (gethash atom atom-types) type)
+            (error "Could not set type of atom ~s in force-field ~s" atom :smirnoff))))))
 
 (defmethod chem:force-field-component-merge ((dest chem:ffnonbond-db) (source vdw-force))
   (loop with terms = (terms source)
@@ -182,6 +183,7 @@ The chem:force-field-type-rules-merged generic function was used to organize the
 (defmethod chem:generate-molecule-energy-function-tables (energy-function molecule (combined-smirnoff-force-field combined-smirnoff-force-field) keep-interaction-factory)
   (when keep-interaction-factory
     (let* ((molecule-graph (chem:make-molecule-graph-from-molecule molecule))
+           (molecule-invariants (chem:make-molecule-invariants molecule-graph))
            (atom-table (chem:atom-table energy-function))
            (bonds (bonds-hash-table molecule))
            (angles (make-hash-table :test #'equal))
@@ -197,7 +199,7 @@ The chem:force-field-type-rules-merged generic function was used to organize the
               for bonds-force = (bonds-force force-field)
               do (loop for term across (terms bonds-force)
                        for smirks-graph = (maybe-cached-smirnoff-term term)
-                       for hits = (chem:boost-graph-vf2 smirks-graph molecule-graph)
+                       for hits = (chem:boost-graph-vf2 smirks-graph molecule-graph molecule-invariants)
                        do (loop for hit in hits
                                 for a1 = (aref hit 1)
                                 for a2 = (aref hit 2)
@@ -244,7 +246,7 @@ The chem:force-field-type-rules-merged generic function was used to organize the
                                       (smirks term))
                        for smirks-graph = (maybe-cached-smirnoff-term term)
                        for hits = (progn
-                                    (chem:boost-graph-vf2 smirks-graph molecule-graph))
+                                    (chem:boost-graph-vf2 smirks-graph molecule-graph molecule-invariants))
                        do (loop for hit in hits
                                 for a1 = (aref hit 1)
                                 for a2 = (aref hit 2)
@@ -293,7 +295,7 @@ The chem:force-field-type-rules-merged generic function was used to organize the
               do (when proper-torsion-force
                    (loop for term across (terms proper-torsion-force)
                          for smirks-graph = (maybe-cached-smirnoff-term term)
-                         for hits = (chem:boost-graph-vf2 smirks-graph molecule-graph)
+                         for hits = (chem:boost-graph-vf2 smirks-graph molecule-graph molecule-invariants)
                          do (loop for hit in hits
                                   for a1 = (aref hit 1)
                                   for a2 = (aref hit 2)
@@ -340,7 +342,7 @@ The chem:force-field-type-rules-merged generic function was used to organize the
               do (when improper-torsion-force
                    (loop for term across (terms improper-torsion-force)
                          for smirks-graph = (maybe-cached-smirnoff-term term)
-                         for hits = (chem:boost-graph-vf2 smirks-graph molecule-graph)
+                         for hits = (chem:boost-graph-vf2 smirks-graph molecule-graph molecule-invariants)
                          do (loop for hit in hits
                                   for a1 = (aref hit 1)
                                   for a2 = (aref hit 2)
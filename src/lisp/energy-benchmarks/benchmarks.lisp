@@ -0,0 +1,131 @@
+(in-package :energy-benchmarks)
+
+(defparameter *system-sizes* '(100 1000 10000 50000 200000)
+  "Target atom counts used by run-benchmarks for every kind of system.")
+
+(defparameter *modes* '(:energy :energy-force :energy-force-hessian)
+  "Evaluation modes timed for every energy component.")
+
+(defparameter *target-seconds* 1.0
+  "Roughly how long each component is timed in each mode.  The number of repeats is
+chosen from the time of a single evaluation.")
+
+(defparameter *max-repeats* 1000)
+
+(defparameter *csv-columns*
+  '("system" "atoms" "component" "mode" "terms" "repeats" "seconds"
+    "ns-per-term" "terms-per-second" "bytes" "bytes-per-second"))
+
+(defvar *force-field-loaded* nil)
+
+(defun ensure-force-field ()
+  (unless *force-field-loaded*
+    (leap:load-smirnoff-params (probe-file *force-field-file*))
+    (setf *force-field-loaded* t)))
+
+(defun component-name (component)
+  (string-downcase (class-name (class-of component))))
+
+(defun vector-bytes (mode size)
+  "Bytes of coordinate, force and Hessian-vector traffic for one evaluation in MODE.
+Coordinates are read; forces and the Hessian-vector product are read and written and the
+vector the Hessian is multiplied by is read."
+  (* 8 size (ecase mode
+              (:energy 1)
+              (:energy-force 3)
+              (:energy-force-hessian 6))))
+
+(defun csv-field (value &optional (digits 3))
+  (typecase value
+    (null "")
+    (integer (format nil "~d" value))
+    (real (format nil "~,vf" digits value))
+    (t (format nil "~a" value))))
+
+(defun write-row (stream system atoms component mode terms repeats seconds bytes)
+  (let* ((ns-per-term (when (and terms seconds (> terms 0)) (/ (* seconds 1d9) terms)))
+         (terms-per-second (when (and terms seconds (> seconds 0)) (/ terms seconds)))
+         (bytes-per-second (when (and bytes seconds (> seconds 0)) (/ bytes seconds))))
+    (format stream "~{~a~^,~}~%"
+            (list (csv-field system)
+                  (csv-field atoms)
+                  (csv-field component)
+                  (csv-field (string-downcase mode))
+                  (csv-field terms)
+                  (csv-field repeats)
+                  (csv-field seconds 9)
+                  (csv-field ns-per-term)
+                  (csv-field terms-per-second 1)
+                  (csv-field bytes)
+                  (csv-field bytes-per-second 1)))
+    (finish-output stream)))
+
+(defun time-component (energy-function component pos mode)
+  "Return (values seconds-per-evaluation repeats) for COMPONENT in MODE."
+  (let* ((single (chem:energy-component-benchmark energy-function component pos :mode mode :repeats 1))
+         (repeats (max 1 (min *max-repeats* (ceiling *target-seconds* (max single 1d-9))))))
+    (values (chem:energy-component-benchmark energy-function component pos :mode mode :repeats repeats)
+            repeats)))
+
+(defun benchmark-energy-function (energy-function pos &key (system "") (stream *standard-output*) (modes *modes*))
+  "Time every enabled component of ENERGY-FUNCTION at POS in each of MODES and write one CSV row per
+component and mode to STREAM.  A mode that a component does not support is reported with empty timings."
+  (let ((atoms (/ (length pos) 3)))
+    (loop for component in (chem:all-components energy-function)
+          when (chem:is-enabled component)
+            do (multiple-value-bind (terms term-bytes)
+                   (chem:energy-component-term-statistics component)
+                 (loop for mode in modes
+                       for bytes = (when term-bytes (+ term-bytes (vector-bytes mode (length pos))))
+                       do (handler-case
+                              (multiple-value-bind (seconds repeats)
+                                  (time-component energy-function component pos mode)
+                                (write-row stream system atoms (component-name component) mode
+                                           terms repeats seconds bytes))
+                            (error (err)
+                              (format *error-output* "~a ~a ~a failed: ~a~%"
+                                      system (component-name component) mode err)
+                              (write-row stream system atoms (component-name component) mode
+                                         terms nil nil nil))))))))
+
+(defun benchmark-minimizer (energy-function &key (system "") (stream *standard-output*) (steps 20))
+  "Run STEPS conjugate gradient steps on ENERGY-FUNCTION and write one CSV row with the time per step.
+The terms column holds the number of steps."
+  (let ((minimizer (chem:make-minimizer energy-function))
+        (atoms (/ (chem:get-nvector-size energy-function) 3)))
+    (cando:configure-minimizer minimizer
+                               :max-sd-steps 0
+                               :max-cg-steps steps
+                               :max-tn-steps 0
+                               :sd-tolerance 0.0
+                               :cg-tolerance 0.0
+                               :tn-tolerance 0.0)
+    (let ((start (get-internal-real-time)))
+      (cando:minimize-no-fail minimizer)
+      (let ((seconds (/ (float (- (get-internal-real-time) start) 1d0) internal-time-units-per-second)))
+        (write-row stream system atoms "minimizer" :conjugate-gradient steps 1 (/ seconds steps) nil)))))
+
+(defun run-benchmarks (&key (systems '(:water-box :polymer-chains :macrocycle))
+                         (sizes *system-sizes*)
+                         (modes *modes*)
+                         (stream *standard-output*)
+                         (minimizer t)
+                         (minimizer-steps 20)
+                         (use-excluded-atoms t))
+  "Build every system in SYSTEMS at every atom count in SIZES and write CSV benchmark results to STREAM.
+Each row is one energy component in one mode:
+  system, atoms, component, mode, terms, repeats, seconds (per evaluation),
+  ns-per-term, terms-per-second, bytes (term storage plus vector traffic), bytes-per-second.
+If MINIMIZER is true a row timing MINIMIZER-STEPS conjugate gradient steps follows each system."
+  (ensure-force-field)
+  (format stream "~{~a~^,~}~%" *csv-columns*)
+  (loop for kind in systems
+        do (loop for size in sizes
+                 for agg = (build-system kind size)
+                 for system = (string-downcase kind)
+                 for energy-function = (chem:make-energy-function :matter agg :use-excluded-atoms use-excluded-atoms)
+                 for pos = (chem:make-nvector (chem:get-nvector-size energy-function))
+                 do (chem:load-coordinates-into-vector energy-function pos)
+                    (benchmark-energy-function energy-function pos :system system :stream stream :modes modes)
+                    (when minimizer
+                      (benchmark-minimizer energy-function :system system :stream stream :steps minimizer-steps)))))
@@ -0,0 +1,18 @@
+;; -^-
+(cl:in-package #:common-lisp-user)
+
+(defpackage #:energy-benchmarks
+  (:use #:cl )
+  (:export
+   #:*force-field-file*
+   #:*system-sizes*
+   #:water-box
+   #:polymer-chains
+   #:macrocycle-lattice
+   #:build-system
+   #:benchmark-energy-function
+   #:benchmark-minimizer
+   #:run-benchmarks
+   )
+  (:documentation
+   "Time energy components and the minimizer on reproducible systems and report the results as CSV"))
@@ -0,0 +1,133 @@
+(in-package :energy-benchmarks)
+
+;;; Every system is built from fixed geometry with no randomness so that the
+;;; same size always gives the same atoms, terms and coordinates.
+
+(defparameter *force-field-file* "sys:extensions;cando;src;lisp;regression-tests;data;force-field.offxml"
+  "SMIRNOFF force field used to type and parameterize the benchmark systems.")
+
+(defparameter *water-spacing* 3.1
+  "Distance in angstroms between the oxygens of neighbouring waters in a water box.")
+
+(defparameter *chain-carbons* 50
+  "Number of carbons in each polyethylene chain built by polymer-chains.")
+
+(defparameter *chain-spacing* 5.0
+  "Distance in angstroms between neighbouring polymer chains.")
+
+(defparameter *macrocycle-spacing* 35.0
+  "Distance in angstroms between the copies of the sample macrocycle.")
+
+(defun element (name)
+  (chem:element-from-atom-name-string name))
+
+(defun add-atom (residue name element-name x y z)
+  (let ((atom (chem:make-atom name (element element-name))))
+    (chem:set-position atom (geom:vec x y z))
+    (chem:setf-needs-build atom nil)
+    (chem:add-matter residue atom)
+    atom))
+
+(defun cube-side (count)
+  "Smallest n such that n^3 >= count."
+  (loop for side from 1
+        when (>= (* side side side) count)
+          return side))
+
+(defun water-box (atoms)
+  "Build a periodic box of at least ATOMS/3 waters on a cubic lattice."
+  (let* ((waters (max 1 (ceiling atoms 3)))
+         (side (cube-side waters))
+         (width (* side *water-spacing*))
+         (agg (chem:make-aggregate :water-box))
+         (angle (* 104.52 0.0174533))
+         (hx (* 0.9572 (cos angle)))
+         (hy (* 0.9572 (sin angle))))
+    (loop for index below waters
+          for ix = (mod index side)
+          for iy = (mod (floor index side) side)
+          for iz = (floor index (* side side))
+          for x = (* ix *water-spacing*)
+          for y = (* iy *water-spacing*)
+          for z = (* iz *water-spacing*)
+          do (let* ((mol (chem:make-molecule :wat))
+                    (res (chem:make-residue :wat))
+                    (o (add-atom res :o "O" x y z))
+                    (h1 (add-atom res :h1 "H" (+ x 0.9572) y z))
+                    (h2 (add-atom res :h2 "H" (+ x hx) (+ y hy) z)))
+               (chem:bond-to o h1 :single-bond)
+               (chem:bond-to o h2 :single-bond)
+               (chem:add-matter mol res)
+               (chem:setf-molecule-type mol :solvent)
+               (chem:setf-force-field-name mol :smirnoff)
+               (chem:add-matter agg mol)))
+    (setf (chem:bounding-box agg) (chem:make-bounding-box (list width width width)))
+    agg))
+
+(defun polyethylene-chain (name y z)
+  "Build an all-trans polyethylene chain of *chain-carbons* carbons running along x."
+  (let ((mol (chem:make-molecule name))
+        (res (chem:make-residue name))
+        (previous nil))
+    (loop for index below *chain-carbons*
+          for side = (if (evenp index) -1.0 1.0)
+          for x = (* index 1.27)
+          for cy = (+ y (* side 0.435))
+          for carbon = (add-atom res (intern (format nil "C~a" index) :keyword) "C" x cy z)
+          do (when previous (chem:bond-to previous carbon :single-bond))
+             (loop for hz in '(0.89 -0.89)
+                   for suffix in '("A" "B")
+                   do (chem:bond-to carbon
+                                    (add-atom res (intern (format nil "H~a~a" index suffix) :keyword) "H"
+                                              x (+ cy (* side 0.51)) (+ z hz))
+                                    :single-bond))
+             (when (or (= index 0) (= index (1- *chain-carbons*)))
+               (chem:bond-to carbon
+                             (add-atom res (intern (format nil "H~aC" index) :keyword) "H"
+                                       (+ x (if (= index 0) -1.03 1.03)) cy z)
+                             :single-bond))
+             (setf previous carbon))
+    (chem:add-matter mol res)
+    (chem:setf-force-field-name mol :smirnoff)
+    mol))
+
+(defun polymer-chains (atoms)
+  "Build enough parallel polyethylene chains to hold at least ATOMS atoms."
+  (let* ((atoms-per-chain (+ (* 3 *chain-carbons*) 2))
+         (chains (max 1 (ceiling atoms atoms-per-chain)))
+         (side (ceiling (sqrt chains)))
+         (agg (chem:make-aggregate :polymer-chains)))
+    (loop for index below chains
+          for y = (* (mod index side) *chain-spacing*)
+          for z = (* (floor index side) *chain-spacing*)
+          do (chem:add-matter agg (polyethylene-chain (intern (format nil "PE~a" index) :keyword) y z)))
+    agg))
+
+(defun macrocycle-lattice (atoms)
+  "Build a cubic lattice of copies of the macrocycle from chem:sample-aggregate holding at least ATOMS atoms."
+  (let* ((template (cando:mol (chem:sample-aggregate :macrocycle) 0))
+         (copies (max 1 (ceiling atoms (chem:number-of-atoms template))))
+         (side (cube-side copies))
+         (agg (chem:make-aggregate :macrocycles)))
+    (loop for index below copies
+          for copy = (chem:matter-copy template)
+          for offset = (geom:vec (* (mod index side) *macrocycle-spacing*)
+                                 (* (mod (floor index side) side) *macrocycle-spacing*)
+                                 (* (floor index (* side side)) *macrocycle-spacing*))
+          do (chem:apply-transform-to-atoms copy (geom:make-m4-translate offset))
+             (chem:setf-force-field-name copy :smirnoff)
+             (chem:add-matter agg copy))
+    agg))
+
+(defparameter *system-builders*
+  (list (cons :water-box 'water-box)
+        (cons :polymer-chains 'polymer-chains)
+        (cons :macrocycle 'macrocycle-lattice))
+  "Map from system kind to the function that builds it for a target atom count.")
+
+(defun build-system (kind atoms)
+  "Build the system of KIND (:water-box, :polymer-chains or :macrocycle) with at least ATOMS atoms."
+  (let ((builder (cdr (assoc kind *system-builders*))))
+    (unless builder
+      (error "Unknown benchmark system ~s - must be one of ~s" kind (mapcar #'car *system-builders*)))
+    (funcall builder atoms)))
@@ -100,6 +100,25 @@
     (cando:progress-done progress-bar)))
 
 
+;;; Same boxes and acceptance tests as tool-add-all-boxes with the overlap, octahedron, shell,
+;;; rectangular and sphere tests below, but done in C++ against a cell grid of the solute
+;;; and only the surviving solvent molecules are copied.
+(defun tool-solvate-boxes (solute solvent solute-xvec solute-yvec solute-zvec ix iy iz xstart ystart zstart
+                           xsolvent ysolvent zsolvent 2xatom-max-r-squared mode
+                           &key (widths '(0.0 0.0 0.0)) (farness 10.0) (center (geom:vec 0.0 0.0 0.0)) (radius 0.0) verbose)
+  (let ((solvent-count (* (chem:content-size solvent) ix iy iz)))
+    (format t "There are ~d solvent molecules and ~d solute atoms~%" solvent-count (chem:number-of-atoms solute))
+    (finish-output)
+    (let ((added (chem:solvate-boxes solute solvent solute-xvec solute-yvec solute-zvec ix iy iz
+                                     (geom:vec xstart ystart zstart)
+                                     (geom:vec xsolvent ysolvent zsolvent)
+                                     2xatom-max-r-squared mode
+                                     (geom:vec (first widths) (second widths) (third widths))
+                                     farness center radius)))
+      (when verbose
+        (format t "Added ~d solvent molecules~%" added))
+      added)))
+
 ;;Closeness controls how close solvent can get to solute before they are considered to be overlapping.
 ;;Farness defines shell's range.
 (defun tool-solvate-and-shell (solute solvent width-list &key (closeness 0.0) (farness 10.0) shell oct isotropic (verbose t) resolvate)
@@ -154,15 +173,15 @@
      xstart (* 0.5 solvent-x-width (- ix 1))
      ystart (* 0.5 solvent-y-width (- iy 1))
      zstart (* 0.5 solvent-z-width (- iz 1)))
-    (let ((test-function (lambda (solvent-molecule)
-                           (and (overlap-solvent solute-xvec solute-yvec solute-zvec solvent-molecule 2xatom-max-r-squared)
-                                (if oct
-                                    (invalid-solvent-octahedron xwidth ywidth zwidth solvent-molecule)
-                                    (if shell
-                                        (invalid-solvent-shell solute-xvec solute-yvec solute-zvec solvent-molecule farness)
-                                        (invalid-solvent-rectangular xwidth ywidth zwidth solvent-molecule)))))))
-      (tool-add-all-boxes solute test-function solvent ix iy iz xstart ystart zstart solvent-x-width solvent-y-width solvent-z-width :verbose verbose)
-      solute)
+    (tool-solvate-boxes solute solvent solute-xvec solute-yvec solute-zvec
+                        ix iy iz xstart ystart zstart solvent-x-width solvent-y-width solvent-z-width
+                        2xatom-max-r-squared
+                        (cond (oct :octahedron)
+                              (shell :shell)
+                              (t :rectangular))
+                        :widths (list xwidth ywidth zwidth)
+                        :farness farness
+                        :verbose verbose)
     (unless shell
       (setf (chem:bounding-box solute) (chem:make-bounding-box (list xwidth ywidth zwidth))))))
 
@@ -190,11 +209,13 @@
      xstart (+ (* 0.5 solvent-x-width (- ix 1)) (geom:get-x center))
      ystart (+ (* 0.5 solvent-y-width (- iy 1)) (geom:get-y center))
      zstart (+ (* 0.5 solvent-z-width (- iz 1)) (geom:get-z center)))
-    (let ((test-function (lambda (solvent-molecule)
-                           (and (overlap-solvent solute-xvec solute-yvec solute-zvec solvent-molecule 2xatom-max-r-squared)
-                                (invalid-solvent-sphere radius center solvent-molecule)))))
-      (tool-add-all-boxes solute test-function solvent ix iy iz xstart ystart zstart solvent-x-width solvent-y-width solvent-z-width :verbose verbose)
-      solute)))
+    (tool-solvate-boxes solute solvent solute-xvec solute-yvec solute-zvec
+                        ix iy iz xstart ystart zstart solvent-x-width solvent-y-width solvent-z-width
+                        2xatom-max-r-squared :sphere
+                        :center center
+                        :radius radius
+                        :verbose verbose)
+    solute))
 
 (defun overlap-solvent (solute-xvec solute-yvec solute-zvec mol 2xatom-max-r-squared)
 ;;  #+(or)
@@ -914,11 +914,14 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fformat 20 "{:<4s}")
          (multiple-value-bind (compressed-atom-names max-name-length)
              (compress-atom-names atom-name)
-           (loop for name across atom-name
-                 for compressed-name = (gethash name compressed-atom-names)
-                 when (> (length compressed-name) 4)
-                   do (error "There is an atom name ~a that cannot be made unique and less than 4 characters we generated ~a !!!" name compressed-name)
-                 do (fortran:fwrite compressed-name)))
+           (fortran:fwrite-vector
+            (map 'vector
+                 (lambda (name)
+                   (let ((compressed-name (gethash name compressed-atom-names)))
+                     (when (> (length compressed-name) 4)
+                       (error "There is an atom name ~a that cannot be made unique and less than 4 characters we generated ~a !!!" name compressed-name))
+                     compressed-name))
+                 atom-name)))
          (fortran:end-line))
         ;; write the atom names
 
@@ -930,8 +933,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(5E16.8)")
          (fortran:debug "-4-")
          (fortran:fformat 5 "{:16.8e}")
-         (loop for ch across charge
-               do (fortran:fwrite (* ch chem:*amber-charge-conversion-18.2223*)))
+         (fortran:fwrite-vector (map 'vector (lambda (ch) (* ch chem:*amber-charge-conversion-18.2223*)) charge))
          (fortran:end-line))
         ;; write the atom charges
 
@@ -943,8 +945,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(10I8)")
          (fortran:debug "-5-")
          (fortran:fformat 10 "{:8d}")
-         (loop for number across atomic-number
-               do (fortran:fwrite number))
+         (fortran:fwrite-vector atomic-number)
          (fortran:end-line))
         ;; write the atomic number of each atom
 
@@ -956,8 +957,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(5E16.8)")
          (fortran:debug "-6-")
          (fortran:fformat 5 "{:16.8e}")
-         (loop for ma across mass
-               do (fortran:fwrite ma))
+         (fortran:fwrite-vector mass)
          (fortran:end-line))
         ;; write the atom masses
 
@@ -969,8 +969,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(10I8)")
          (fortran:debug "-7-")
          (fortran:fformat 10 "{:8d}")
-         (loop for ia across iac
-               do (fortran:fwrite ia))
+         (fortran:fwrite-vector iac)
          (fortran:end-line))
         ;; write the index fot the atom types
 
@@ -983,8 +982,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(10I8)")
          (fortran:debug "-8-")
          (fortran:fformat 10 "{:8d}")
-         (loop for na across number-excluded-atoms
-               do (fortran:fwrite na))
+         (fortran:fwrite-vector number-excluded-atoms)
          (fortran:end-line))
         ;; write the total number of excluded atoms for atom "i"
 
@@ -996,8 +994,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(10I8)")
          (fortran:debug "-9-")
          (fortran:fformat 10 "{:8d}")
-         (loop for ic across ico
-               do (fortran:fwrite ic))
+         (fortran:fwrite-vector ico)
          (fortran:end-line))
         ;; provides the index to the nobon parameter arrays CN1, CN2 and ASOL, BSOL.
 
@@ -1009,8 +1006,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(20A4)")
          (fortran:debug "-10-")
          (fortran:fformat 20 "{:<4s}")
-         (loop for ren across residue-name-vec
-               do (fortran:fwrite (string ren)))
+         (fortran:fwrite-vector (map 'vector #'string residue-name-vec))
          (fortran:end-line))
         ;; write the name of each of the residues
 
@@ -1022,8 +1018,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(10I8)")
          (fortran:debug "-11-")
          (fortran:fformat 10 "{:8d}")
-         (loop for re from 0 below (- (length residue-pointer-vec) 1)
-               do (fortran:fwrite (aref residue-pointer-vec re)))
+         (fortran:fwrite-vector (subseq residue-pointer-vec 0 (- (length residue-pointer-vec) 1)))
          (fortran:end-line))
         ;; write the atoms in each residue are listed for atom "1" in IPRES(i) to IPRES(i+1)-1
 
@@ -1035,8 +1030,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(5E16.8)")
          (fortran:debug "-12-")
          (fortran:fformat 5 "{:16.8e}")
-         (loop for kb across kbj-vec
-               do (fortran:fwrite kb))
+         (fortran:fwrite-vector kbj-vec)
          (fortran:end-line))
 
         ;; write the force constant for the bonds of each type
@@ -1049,8 +1043,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(5E16.8)")
          (fortran:debug "-13-")
          (fortran:fformat 5 "{:16.8e}")
-         (loop for r0 across r0j-vec
-               do (fortran:fwrite r0))
+         (fortran:fwrite-vector r0j-vec)
          (fortran:end-line))
         ;; write the equilibrium bond length for the bonds of each type
 
@@ -1062,8 +1055,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(5E16.8)")
          (fortran:debug "-14-")
          (fortran:fformat 5 "{:16.8e}")
-         (loop for kt across ktj-vec
-               do (fortran:fwrite kt))
+         (fortran:fwrite-vector ktj-vec)
          (fortran:end-line))
         ;; write the force constant for the angles of each type
 
@@ -1075,8 +1067,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(5E16.8)")
          (fortran:debug "-15-")
          (fortran:fformat 5 "{:16.8e}")
-         (loop for t0 across t0j-vec
-               do (fortran:fwrite t0))
+         (fortran:fwrite-vector t0j-vec)
          (fortran:end-line))
         ;; write the equilibrium angle for the angles of each type
 
@@ -1088,8 +1079,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(5E16.8)")
          (fortran:debug "-16-")
          (fortran:fformat 5 "{:16.8e}")
-         (loop for v0 across vj-vec
-               do (fortran:fwrite v0))
+         (fortran:fwrite-vector vj-vec)
          (fortran:end-line))
         ;; write the force constant for the dihedral of a given type
 
@@ -1101,8 +1091,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(5E16.8)")
          (fortran:debug "-17-")
          (fortran:fformat 5 "{:16.8e}")
-         (loop for in0 across inj-vec
-               do (fortran:fwrite (float in0)))
+         (fortran:fwrite-vector (map 'vector #'float inj-vec))
          (fortran:end-line))
         ;; write the periodicity of the dihedral of a given type
 
@@ -1114,8 +1103,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(5E16.8)")
          (fortran:debug "-18-")
          (fortran:fformat 5 "{:16.8e}")
-         (loop for p0 across phasej-vec
-               do (fortran:fwrite p0))
+         (fortran:fwrite-vector phasej-vec)
          (fortran:end-line))
         ;; write the phase of the dihedral of a given type
 
@@ -1127,10 +1115,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(5E16.8)")
          (fortran:debug "-19-")
          (fortran:fformat 5 "{:16.8e}")
-         (loop for pr0 across properj-vec
-               do (if pr0
-                      (fortran:fwrite 1.2)
-                      (fortran:fwrite 0.0)))
+         (fortran:fwrite-vector (map 'vector (lambda (pr0) (if pr0 1.2 0.0)) properj-vec))
          (fortran:end-line))
         ;; write the 1-4 electrostatic scaling constant
 
@@ -1142,10 +1127,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(5E16.8)")
          (fortran:debug "-20-")
          (fortran:fformat 5 "{:16.8e}")
-         (loop for pr0 across properj-vec
-               do (if pr0
-                      (fortran:fwrite 2.0)
-                      (fortran:fwrite 0.0)))
+         (fortran:fwrite-vector (map 'vector (lambda (pr0) (if pr0 2.0 0.0)) properj-vec))
          (fortran:end-line))
         ;; write the 1-4 vdw scaling constant
 
@@ -1157,8 +1139,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(5E16.8)")
          (fortran:debug "-21-")
          (fortran:fformat 5 "{:16.8e}")
-         (loop repeat natyp
-               do (fortran:fwrite 0.0))
+         (fortran:fwrite-vector (make-array natyp :initial-element 0.0))
          (fortran:end-line))
         ;; currently unused
 
@@ -1170,8 +1151,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(5E16.8)")
          (fortran:debug "-22-")
          (fortran:fformat 5 "{:16.8e}")
-         (loop for cn1 across cn1-vec
-               do (fortran:fwrite cn1))
+         (fortran:fwrite-vector cn1-vec)
          (fortran:end-line))
         ;; write the Lennard Jones r**12 terms for all possible atom type interactions
 
@@ -1183,8 +1163,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(5E16.8)")
          (fortran:debug "-23-")
          (fortran:fformat 5 "{:16.8e}")
-         (loop for cn2 across cn2-vec
-               do (fortran:fwrite cn2))
+         (fortran:fwrite-vector cn2-vec)
          (fortran:end-line))
         ;; write the Lennard Jones r**6 terms for all possible atom type interactions
 
@@ -1196,13 +1175,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(10I8)")
          (fortran:debug "-24-")
          (fortran:fformat 10 "{:8d}")
-         (loop for i below (length ibh)
-               for ibhi = (aref ibh i)
-               for jbhi = (aref jbh i)
-               for icbhi = (aref icbh i)
-               do (fortran:fwrite ibhi)
-               do (fortran:fwrite jbhi)
-               do (fortran:fwrite icbhi))
+         (fortran:fwrite-columns (list ibh jbh icbh))
          (fortran:end-line))
 
         ;; write IBH, JBH, ICBH
@@ -1215,13 +1188,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(10I8)")
          (fortran:debug "-25-")
          (fortran:fformat 10 "{:8d}")
-         (loop for i below (length ib)
-               for ibi = (aref ib i)
-               for jbi = (aref jb i)
-               for icbi = (aref icb i)
-               do (fortran:fwrite ibi)
-               do (fortran:fwrite jbi)
-               do (fortran:fwrite icbi))
+         (fortran:fwrite-columns (list ib jb icb))
          (fortran:end-line))
         ;; write IB, JB, ICB
 
@@ -1233,15 +1200,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(10I8)")
          (fortran:debug "-26-")
          (fortran:fformat 10 "{:8d}")
-         (loop for i below (length ith)
-               for ithi = (aref ith i)
-               for jthi = (aref jth i)
-               for kthi = (aref kth i)
-               for icthi = (aref icth i)
-               do (fortran:fwrite ithi)
-               do (fortran:fwrite jthi)
-               do (fortran:fwrite kthi)
-               do (fortran:fwrite icthi))
+         (fortran:fwrite-columns (list ith jth kth icth))
          (fortran:end-line))
         ;; write ITH, JTH, KTH, ICTH
 
@@ -1253,15 +1212,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(10I8)")
          (fortran:debug "-27-")
          (fortran:fformat 10 "{:8d}")
-         (loop for i below (length it)
-               for iti = (aref it i)
-               for jti = (aref jt i)
-               for kti = (aref kt1 i)
-               for icti = (aref ict i)
-               do (fortran:fwrite iti)
-               do (fortran:fwrite jti)
-               do (fortran:fwrite kti)
-               do (fortran:fwrite icti))
+         (fortran:fwrite-columns (list it jt kt1 ict))
          (fortran:end-line))
         ;; write IT, JT, KT, ICT
 
@@ -1273,17 +1224,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(10I8)")
          (fortran:debug "-28-")
          (fortran:fformat 10 "{:8d}")
-         (loop for i below (length iph)
-               for iphi = (aref iph i)
-               for jphi = (aref jph i)
-               for kphi = (aref kph i)
-               for lphi = (aref lph i)
-               for icphi = (aref icph i)
-               do (fortran:fwrite iphi)
-               do (fortran:fwrite jphi)
-               do (fortran:fwrite kphi)
-               do (fortran:fwrite lphi)
-               do (fortran:fwrite icphi))
+         (fortran:fwrite-columns (list iph jph kph lph icph))
          (fortran:end-line))
         ;; write IPH, JPH, KPH, LPH, ICPH
 
@@ -1295,17 +1236,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(10I8)")
          (fortran:debug "-29-")
          (fortran:fformat 10 "{:8d}")
-         (loop for i below (length ip)
-               for ipi = (aref ip i)
-               for jpi = (aref jp i)
-               for kpi = (aref kp i)
-               for lpi = (aref lp i)
-               for icpi = (aref icp i)
-               do (fortran:fwrite ipi)
-               do (fortran:fwrite jpi)
-               do (fortran:fwrite kpi)
-               do (fortran:fwrite lpi)
-               do (fortran:fwrite icpi))
+         (fortran:fwrite-columns (list ip jp kp lp icp))
          (fortran:end-line))
         ;; write IP, JP, KP, LP, ICP
 
@@ -1317,8 +1248,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(10I8)")
          (fortran:debug "-30-")
          (fortran:fformat 10 "{:8d}")
-         (loop for atom across excluded-atom-list
-               do (fortran:fwrite (+ atom 1)))
+         (fortran:fwrite-vector (map 'vector #'1+ excluded-atom-list))
          (fortran:end-line))
         ;; write excluded atoms list
 
@@ -1365,8 +1295,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(20A4)")
          (fortran:debug "-34-")
          (fortran:fformat 20 "{:<4s}")
-         (loop for type across atom-type
-               do (fortran:fwrite (string type)))
+         (fortran:fwrite-vector (map 'vector #'string atom-type))
          (fortran:end-line))
 
         ;;next
@@ -1377,8 +1306,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(20A4)")
          (fortran:debug "-35-")
          (fortran:fformat 20 "{:<4s}")
-         (loop repeat natom
-               do (fortran:fwrite "M"))
+         (fortran:fwrite-vector (make-array natom :initial-element "M"))
          (fortran:end-line))
         ;; We are not considering protein/DNA thing, so just put "main chain" for all atoms.
 
@@ -1390,8 +1318,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(10I8)")
          (fortran:debug "-36-")
          (fortran:fformat 10 "{:8d}")
-         (loop repeat natom
-               do (fortran:fwrite 0))
+         (fortran:fwrite-vector (make-array natom :initial-element 0))
          (fortran:end-line))
         ;;This section is no longer used and is currently just filled with zeros.
 
@@ -1403,8 +1330,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(10I8)")
          (fortran:debug "-37-")
          (fortran:fformat 10 "{:8d}")
-         (loop repeat natom
-               do (fortran:fwrite 0))
+         (fortran:fwrite-vector (make-array natom :initial-element 0))
          (fortran:end-line))
         ;;This section is not used and is currently just filled with zeros.
 
@@ -1439,8 +1365,7 @@ cando-extensions               : T if you want cando-extensions written to the t
                (fortran:fwrite "%FORMAT(10I8)")
                (fortran:debug "-39-")
                (fortran:fformat 10 "{:8d}")
-               (loop for natom across atoms-per-molecule
-                     do (fortran:fwrite natom))
+               (fortran:fwrite-vector atoms-per-molecule)
                (fortran:end-line)
                ;; number of atoms per molecule
 
@@ -1477,8 +1402,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(5E16.8)")
          (fortran:debug "-42-")
          (fortran:fformat 5 "{:16.8e}")
-         (loop for radius across generalized-born-radius
-               do (fortran:fwrite radius))
+         (fortran:fwrite-vector generalized-born-radius)
          (fortran:end-line))
         ;;Generalized Born intrinsic dielectric radii
 
@@ -1490,8 +1414,7 @@ cando-extensions               : T if you want cando-extensions written to the t
          (fortran:fwrite "%FORMAT(5E16.8)")
          (fortran:debug "-43-")
          (fortran:fformat 5 "{:16.8e}")
-         (loop for screen across generalized-born-screen
-               do (fortran:fwrite screen))
+         (fortran:fwrite-vector generalized-born-screen)
          (fortran:end-line))
         (when cando-extensions
           (outline-progn
@@ -1501,8 +1424,7 @@ cando-extensions               : T if you want cando-extensions written to the t
            (fortran:fwrite "%FORMAT(40I2)")
            (fortran:debug "-44-")
            (fortran:fformat 40 "{:2d}")
-           (loop for orderi across non-h-bond-orders
-                 do (fortran:fwrite orderi))
+           (fortran:fwrite-vector non-h-bond-orders)
            (fortran:end-line))
           ;; If there is more than one force field or the only force-field is not
           ;; :DEFAULT - then write out the per-molecule force-field name
@@ -1519,8 +1441,7 @@ cando-extensions               : T if you want cando-extensions written to the t
                (fortran:fwrite (format nil "%FORMAT(1a~d)" (1+ max-force-field-name-len)))
                (fortran:debug "-45-")
                (fortran:fformat 1 (format nil "{:<~ds}" (1+ max-force-field-name-len)))
-               (loop for name across force-field-names-vec
-                     do (fortran:fwrite (string name)))
+               (fortran:fwrite-vector (map 'vector #'string force-field-names-vec))
                (fortran:end-line)))
             (outline-progn
              (fortran:fformat 1 "{:<80s}")
@@ -1529,8 +1450,7 @@ cando-extensions               : T if you want cando-extensions written to the t
              (fortran:fwrite (format nil "%FORMAT(20I3)"))
              (fortran:debug "-46-")
              (fortran:fformat 20 "{:3d}")
-             (loop for index across molecule-force-field-name-indices
-                   do (fortran:fwrite (1+ index)))
+             (fortran:fwrite-vector (map 'vector #'1+ molecule-force-field-name-indices))
              (fortran:end-line))))
         ))
 ;;;    (format *debug-io* "coordinate-pathname -> ~s~%" coordinate-pathname)
@@ -1553,15 +1473,14 @@ cando-extensions               : T if you want cando-extensions written to the t
             (setf ox (/ (float (chem:get-x-width solvent-box)) 2.0)
                   oy (/ (float (chem:get-y-width solvent-box)) 2.0)
                   oz (/ (float (chem:get-z-width solvent-box)) 2.0))))
-        (loop for i from 0 below natom
-              for atom = (chem:elt-atom atom-table i)
-              for atom-coordinate-index-times3 = (chem:elt-atom-coordinate-index-times3 atom-table i)
-              for pos = (chem:get-position atom)
-;;;           do (format t "atom-coordinate-index-times3 -> ~a~%" atom-coordinate-index-times3)
-              do (progn
-                   (fortran:fwrite (+ (geom:get-x pos) ox))
-                   (fortran:fwrite (+ (geom:get-y pos) oy))
-                   (fortran:fwrite (+ (geom:get-z pos) oz))))
+        (let ((coordinates (make-array (* 3 natom) :element-type 'double-float)))
+          (loop for i from 0 below natom
+                for atom = (chem:elt-atom atom-table i)
+                for pos = (chem:get-position atom)
+                do (setf (aref coordinates (* 3 i)) (float (+ (geom:get-x pos) ox) 1d0)
+                         (aref coordinates (+ 1 (* 3 i))) (float (+ (geom:get-y pos) oy) 1d0)
+                         (aref coordinates (+ 2 (* 3 i))) (float (+ (geom:get-z pos) oz) 1d0)))
+          (fortran:fwrite-vector coordinates))
         (fortran:end-line))
       ;; write out the solvent box
       (if (chem:bounding-box-bound-p atom-table)
@@ -1656,7 +1575,7 @@ cando-extensions               : T if you want cando-extensions written to the t
 ;  (let ((fif (fortran:make-fortran-input-file :stream stream))
 (defun read-amber-parm-format (topology-pathname)
   "Return (values energy-function) - use generate-aggregate-for-energy-function to get an aggregate"
-  (fortran:with-fortran-input-file (fif topology-pathname :direction :input)
+  (let ((sections (chem:read-fortran-sections (namestring (translate-logical-pathname (merge-pathnames topology-pathname))))))
     (let (natom ntypes nbonh mbona ntheth mtheta nphih mphia nhparm nparm
           nnb nres nbona ntheta nphia numbnd numang nptra
           natyp nphb ifpert nbper ngper ndper
@@ -1676,287 +1595,98 @@ cando-extensions               : T if you want cando-extensions written to the t
           molecules-vec residues-vec
           force-field-names molecule-force-field-index
           )
-      (rlog "Starting read-amber-parm-format fif: ~s~%" fif)
-      (fortran:fread-line fif)   ; Skip the version and timestamp line
-      (fortran:fread-line fif)   ; read the first %FLAG line
-      ;; From here on down - read the input file
+      (rlog "Starting read-amber-parm-format sections: ~s~%" sections)
+      ;; The sections were read and parsed by chem:read-fortran-sections - pull out the ones we use
       (outline-progn
-       (loop for line = (fortran:fortran-input-file-look-ahead fif)
-             while line
-             do (rlog "line ~a~%" line)
-             do (verify-%flag-line line)
-             do (cond
-                  ((string-equal %flag-title line :end2 (length %flag-title))
-                   (fortran:fread-line-or-error fif) ; read %FORMAT(20a4)...
-                   (fortran:fread-line-or-error fif) ; read ITITL : title
-                   (fortran:fread-line-or-error fif)) ; Read the next %flag line or eof
-                  ((string-equal %flag-pointers line :end2 (length %flag-pointers)) ; line is %FLAG POINTERS
-                   (fortran:fread-line-or-error fif) ; read %FORMAT(10i8) NATOM ...
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif) ; read first line of data
-                     (let ((pointers (fortran:fread-vector fif per-line format-char width)))
-                       (setf natom (aref pointers 0) ; natom
-                             ntypes (aref pointers 1)
-                             nbonh (aref pointers 2)
-                             mbona (aref pointers 3)
-                             ntheth (aref pointers 4)
-                             mtheta (aref pointers 5)
-                             nphih (aref pointers 6)
-                             mphia (aref pointers 7)
-                             nhparm (aref pointers 8)
-                             nparm  (aref pointers 9)
-                             nnb  (aref pointers 10)
-                             nres  (aref pointers 11)
-                             nbona  (aref pointers 12)
-                             ntheta  (aref pointers 13)
-                             nphia  (aref pointers 14)
-                             numbnd  (aref pointers 15)
-                             numang  (aref pointers 16)
-                             nptra (aref pointers 17)
-                             natyp  (aref pointers 18)
-                             nphb  (aref pointers 19)
-                             ifpert (aref pointers 20)
-                             nbper (aref pointers 21)
-                             ngper  (aref pointers 22)
-                             ndper  (aref pointers 23)
-                             mbper  (aref pointers 24)
-                             mgper (aref pointers 25)
-                             mdper (aref pointers 26)
-                             ifbox (aref pointers 27)
-                             nmxrs (aref pointers 28)
-                             ifcap (aref pointers 29)
-                             numextra (aref pointers 30)
-                             ncopy (aref pointers 31))))
-                   )
-                  ((string-equal %flag-atom-name line :end2 (length %flag-atom-name))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf atom-name
-                           (map 'vector
-                                (lambda (string)
-                                  (intern (string-trim " " string) "KEYWORD"))
-                                (fortran:fread-vector fif per-line format-char width)))))
-                  ((string-equal %flag-charge line :end2 (length %flag-charge))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf charge (fortran:fread-vector fif per-line format-char width))
-                     (loop for chargei from 0 below (length charge)
-                           do (setf (aref charge chargei) (/ (aref charge chargei) chem:*amber-charge-conversion-18.2223*)))))
-                  ((string-equal %flag-atomic-number line :end2 (length %flag-atomic-number))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf atomic-number (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-mass line :end2 (length %flag-mass))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf mass (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-atom-type-index line :end2 (length %flag-atom-type-index))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf atom-type-index (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-number-excluded-atoms line :end2 (length %flag-number-excluded-atoms))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf number-excluded-atoms (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-nonbonded-parm-index line :end2 (length %flag-nonbonded-parm-index))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf nonbonded-parm-index (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-residue-label line :end2 (length %flag-residue-label))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf residue-label
-                           (map 'vector
-                                (lambda (string)
-                                  (intern (string-trim " " string) "KEYWORD"))
-                                (fortran:fread-vector fif per-line format-char width)))))
-                  ((string-equal %flag-residue-pointer line :end2 (length %flag-residue-pointer))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf residue-pointer (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-bond-force-constant line :end2 (length %flag-bond-force-constant))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf bond-force-constant (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-bond-equil-value line :end2 (length %flag-bond-equil-value))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf bond-equil-value (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-angle-force-constant line :end2 (length %flag-angle-force-constant))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf angle-force-constant (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-angle-equil-value line :end2 (length %flag-angle-equil-value))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf angle-equil-value (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-dihedral-force-constant line :end2 (length %flag-dihedral-force-constant))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf dihedral-force-constant (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-dihedral-periodicity line :end2 (length %flag-dihedral-periodicity))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf dihedral-periodicity (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-dihedral-phase line :end2 (length %flag-dihedral-phase))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf dihedral-phase (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-scee-scale-factor line :end2 (length %flag-scee-scale-factor))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf scee-scale-factor (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-scnb-scale-factor line :end2 (length %flag-scnb-scale-factor))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf scnb-scale-factor (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-solty line :end2 (length %flag-solty))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf solty (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-lennard-jones-acoef line :end2 (length %flag-lennard-jones-acoef))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf lennard-jones-acoef (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-lennard-jones-bcoef line :end2 (length %flag-lennard-jones-bcoef))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf lennard-jones-bcoef (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-bonds-inc-hydrogen line :end2 (length %flag-bonds-inc-hydrogen))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf bonds-inc-hydrogen (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-bonds-without-hydrogen line :end2 (length %flag-bonds-without-hydrogen))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf bonds-without-hydrogen (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-angles-inc-hydrogen line :end2 (length %flag-angles-inc-hydrogen))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf angles-inc-hydrogen (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-angles-without-hydrogen line :end2 (length %flag-angles-without-hydrogen))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf angles-without-hydrogen (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-dihedrals-inc-hydrogen line :end2 (length %flag-dihedrals-inc-hydrogen))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf dihedrals-inc-hydrogen (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-dihedrals-without-hydrogen line :end2 (length %flag-dihedrals-without-hydrogen))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf dihedrals-without-hydrogen (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-excluded-atoms-list line :end2 (length %flag-excluded-atoms-list))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf excluded-atoms-list (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-amber-atom-type line :end2 (length %flag-amber-atom-type))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (let ((type-strings (fortran:fread-vector fif per-line format-char width)))
-                       (setf amber-atom-type (make-array (length type-strings) :adjustable nil))
-                       (loop for index from 0 below (length type-strings)
-                             for type-string = (string-trim " " (elt type-strings index))
-                             do (setf (elt amber-atom-type index) (intern type-string :keyword))))))
-                  ((string-equal %flag-solvent-pointers line :end2 (length %flag-solvent-pointers))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf solvent-pointers (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-atoms-per-molecule line :end2 (length %flag-atoms-per-molecule))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf atoms-per-molecule (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-bond-orders line :end2 (length %flag-bond-orders))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf non-h-bond-orders (fortran:fread-vector fif per-line format-char width))))
-                  ((string-equal %flag-force-field-names line :end2 (length %flag-force-field-names))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf force-field-names (fortran:fread-vector fif per-line format-char width))
-                     (loop for index from 0
-                           for ffname across force-field-names
-                           do (setf (elt force-field-names index) (intern (string-trim " " ffname) :keyword)))))
-                  ((string-equal %flag-molecule-force-field-index line :end2 (length %flag-molecule-force-field-index))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (setf molecule-force-field-index (fortran:fread-vector fif per-line format-char width))))
-                  (t
-                   (if chem:*verbose* (cl:format t "Unknown flag ~a~%" line))
-                   (fortran:fread-line-or-error fif)
-                   (multiple-value-bind (per-line format-char width decimal)
-                       (fortran:parse-fortran-format-line (fortran:fortran-input-file-look-ahead fif))
-                     (fortran:fread-line-or-error fif)
-                     (fortran:fread-vector fif per-line format-char width)))))
+       (flet ((section (flag) (gethash flag sections))
+              (keywords (strings)
+                (when strings
+                  (map 'vector (lambda (string) (intern (string-trim " " string) :keyword)) strings))))
+         (when chem:*verbose*
+           (loop for flag being the hash-keys in sections
+                 unless (member flag '("TITLE" "POINTERS" "ATOM_NAME" "CHARGE" "ATOMIC_NUMBER" "MASS"
+                                       "ATOM_TYPE_INDEX" "NUMBER_EXCLUDED_ATOMS" "NONBONDED_PARM_INDEX"
+                                       "RESIDUE_LABEL" "RESIDUE_POINTER" "BOND_FORCE_CONSTANT" "BOND_EQUIL_VALUE"
+                                       "ANGLE_FORCE_CONSTANT" "ANGLE_EQUIL_VALUE" "DIHEDRAL_FORCE_CONSTANT"
+                                       "DIHEDRAL_PERIODICITY" "DIHEDRAL_PHASE" "SCEE_SCALE_FACTOR" "SCNB_SCALE_FACTOR"
+                                       "SOLTY" "LENNARD_JONES_ACOEF" "LENNARD_JONES_BCOEF"
+                                       "BONDS_INC_HYDROGEN" "BONDS_WITHOUT_HYDROGEN"
+                                       "ANGLES_INC_HYDROGEN" "ANGLES_WITHOUT_HYDROGEN"
+                                       "DIHEDRALS_INC_HYDROGEN" "DIHEDRALS_WITHOUT_HYDROGEN"
+                                       "EXCLUDED_ATOMS_LIST" "AMBER_ATOM_TYPE" "SOLVENT_POINTERS" "ATOMS_PER_MOLECULE"
+                                       "BOND_ORDERS" "FORCE_FIELD_NAMES" "MOLECULE_FORCE_FIELD_INDEX")
+                                :test #'string=)
+                   do (cl:format t "Unknown flag %FLAG ~a~%" flag)))
+         (let ((pointers (or (section "POINTERS") (error "There is no %FLAG POINTERS in ~a" topology-pathname))))
+           (setf natom (aref pointers 0) ; natom
+                 ntypes (aref pointers 1)
+                 nbonh (aref pointers 2)
+                 mbona (aref pointers 3)
+                 ntheth (aref pointers 4)
+                 mtheta (aref pointers 5)
+                 nphih (aref pointers 6)
+                 mphia (aref pointers 7)
+                 nhparm (aref pointers 8)
+                 nparm  (aref pointers 9)
+                 nnb  (aref pointers 10)
+                 nres  (aref pointers 11)
+                 nbona  (aref pointers 12)
+                 ntheta  (aref pointers 13)
+                 nphia  (aref pointers 14)
+                 numbnd  (aref pointers 15)
+                 numang  (aref pointers 16)
+                 nptra (aref pointers 17)
+                 natyp  (aref pointers 18)
+                 nphb  (aref pointers 19)
+                 ifpert (aref pointers 20)
+                 nbper (aref pointers 21)
+                 ngper  (aref pointers 22)
+                 ndper  (aref pointers 23)
+                 mbper  (aref pointers 24)
+                 mgper (aref pointers 25)
+                 mdper  (aref pointers 26)
+                 ifbox (aref pointers 27)
+                 nmxrs (aref pointers 28)
+                 ifcap (aref pointers 29)
+                 numextra (aref pointers 30)
+                 ncopy (aref pointers 31)))
+         (setf atom-name (keywords (section "ATOM_NAME")))
+         (setf charge (section "CHARGE"))
+         (loop for chargei from 0 below (length charge)
+               do (setf (aref charge chargei) (/ (aref charge chargei) chem:*amber-charge-conversion-18.2223*)))
+         (setf atomic-number (section "ATOMIC_NUMBER")
+               mass (section "MASS")
+               atom-type-index (section "ATOM_TYPE_INDEX")
+               number-excluded-atoms (section "NUMBER_EXCLUDED_ATOMS")
+               nonbonded-parm-index (section "NONBONDED_PARM_INDEX")
+               residue-label (keywords (section "RESIDUE_LABEL"))
+               residue-pointer (section "RESIDUE_POINTER")
+               bond-force-constant (section "BOND_FORCE_CONSTANT")
+               bond-equil-value (section "BOND_EQUIL_VALUE")
+               angle-force-constant (section "ANGLE_FORCE_CONSTANT")
+               angle-equil-value (section "ANGLE_EQUIL_VALUE")
+               dihedral-force-constant (section "DIHEDRAL_FORCE_CONSTANT")
+               dihedral-periodicity (section "DIHEDRAL_PERIODICITY")
+               dihedral-phase (section "DIHEDRAL_PHASE")
+               scee-scale-factor (section "SCEE_SCALE_FACTOR")
+               scnb-scale-factor (section "SCNB_SCALE_FACTOR")
+               solty (section "SOLTY")
+               lennard-jones-acoef (section "LENNARD_JONES_ACOEF")
+               lennard-jones-bcoef (section "LENNARD_JONES_BCOEF")
+               bonds-inc-hydrogen (section "BONDS_INC_HYDROGEN")
+               bonds-without-hydrogen (section "BONDS_WITHOUT_HYDROGEN")
+               angles-inc-hydrogen (section "ANGLES_INC_HYDROGEN")
+               angles-without-hydrogen (section "ANGLES_WITHOUT_HYDROGEN")
+               dihedrals-inc-hydrogen (section "DIHEDRALS_INC_HYDROGEN")
+               dihedrals-without-hydrogen (section "DIHEDRALS_WITHOUT_HYDROGEN")
+               excluded-atoms-list (section "EXCLUDED_ATOMS_LIST")
+               amber-atom-type (keywords (section "AMBER_ATOM_TYPE"))
+               solvent-pointers (section "SOLVENT_POINTERS")
+               atoms-per-molecule (section "ATOMS_PER_MOLECULE")
+               non-h-bond-orders (section "BOND_ORDERS"))
+         (when (section "FORCE_FIELD_NAMES")
+           (setf force-field-names (keywords (section "FORCE_FIELD_NAMES"))))
+         (setf molecule-force-field-index (section "MOLECULE_FORCE_FIELD_INDEX")))
        )
       ;;(rlog "natom -> ~s~%" natom)
       ;;(rlog "ntypes -> ~s~%" ntypes)
@@ -2064,7 +1794,7 @@ cando-extensions               : T if you want cando-extensions written to the t
               for atom-element = (chem:element-for-atomic-number (aref atomic-number i))
               do (setf (aref atoms i)  (chem:make-atom name atom-element))
               )
-        (setf (aref residue-pointer (length residue-pointer)) (+ 1 natom))
+        (setf residue-pointer (concatenate '(vector (signed-byte 32)) residue-pointer (list (+ 1 natom))))
         ;;(format t "residue-pointer ~s~%" residue-pointer)
 	(setf residues-vec (make-array (length residue-label) :element-type t :adjustable nil))
         (setf molecules-vec (make-array 256 :element-type t :fill-pointer 0 :adjustable t))
@@ -2345,25 +2075,9 @@ cando-extensions               : T if you want cando-extensions written to the t
 
 (defun read-amber-ascii-restart-file (coordinate-filename &key read-velocities (read-bounding-box t))
   "Return (values number-of-atoms coordinates bounding-box-or-nil velocities-or-nil)"
-  (fortran:with-fortran-input-file (fif coordinate-filename :direction :input)
-    (fortran:fread-line fif)     ; Skip the version and timestamp line
-    (let* ((line (fortran:fread-line fif))
-           (results (make-array 3 :element-type 't :adjustable t :fill-pointer 0))
-           ;; Read format FORMAT(I5,5E15.7) NATOM,TIME,TEMP
-           (natoms (parse-integer line :start 0 :end 5))
-           (time (if (>= (length line) 15)
-                     (fortran::parse-vecreal (subseq line 5 nil) :start 0 :end 15)
-                     nil))
-           (temp (if (>= (length line) 35)
-                     (fortran::parse-vecreal (subseq line (+ 5 15) nil) :start 0 :end 15)
-                     nil)))
-      (fortran:fread-line fif)
-      (let* ((coordinates (copy-seq (fortran:fread-vecreal-vector fif 6 12 (* natoms 3))))
-             (velocities (when read-velocities
-                           (copy-seq (fortran:fread-vecreal-vector fif 6 12 (* natoms 3)))))
-             (bounding-box (when read-bounding-box
-                             (copy-seq (fortran:fread-vecreal-vector fif 6 12 6)))))
-        (values natoms coordinates (coerce bounding-box 'list) velocities)))))
+  (chem:read-amber-ascii-restart (namestring (translate-logical-pathname (merge-pathnames coordinate-filename)))
+                                 :read-velocities read-velocities
+                                 :read-bounding-box read-bounding-box))
 
 ;;; The following code is to generate a human readable representation of an energy-function
 ;;; with everything sorted so that the terms can be compared side-by-side using something like
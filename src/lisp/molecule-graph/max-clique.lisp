@@ -231,7 +231,7 @@ The last constraint abs(T(v1,v1')-T(v2,v2'))<=theta is the topological constrain
                     (chem:set-name atm new-name))))
 
 
-(defparameter *clique-search-threads* 0 ) ;; use serial - parallel is broken  (core:num-logical-processors))
+(defparameter *clique-search-threads* (core:num-logical-processors))
 
 (defun dothing (dimacs)
   (chem:find-maximum-clique-search dimacs *clique-search-threads* 1))
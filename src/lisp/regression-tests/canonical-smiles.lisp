@@ -0,0 +1,51 @@
+(in-package #:clasp-tests)
+
+;;; chem:canonical-smiles must write the E/Z configuration of double bonds from the coordinates
+;;; with / and \ whatever order the atoms were added in, and warn when it can't.
+
+(defun canonical-smiles-molecule (atoms bonds)
+  "ATOMS is a list of (name element-name x y z) and BONDS a list of (name1 name2 order)."
+  (let* ((molecule (chem:make-molecule :mol))
+         (residue (chem:make-residue :res))
+         (by-name (make-hash-table)))
+    (loop for (name element-name x y z) in atoms
+          for atm = (chem:make-atom name (chem:element-from-atom-name-string element-name))
+          do (chem:set-position atm (geom:vec x y z))
+             (chem:add-matter residue atm)
+             (setf (gethash name by-name) atm))
+    (loop for (name1 name2 order) in bonds
+          do (chem:bond-to (gethash name1 by-name) (gethash name2 by-name) order))
+    (chem:add-matter molecule residue)
+    molecule))
+
+(defun canonical-smiles-butene (y4 &key reverse)
+  "2-butene with the last methyl at height Y4 - the same side as the first methyl (Z) when Y4 is positive."
+  (let ((atoms `((:c1 "C" -0.70 1.20 0.0) (:c2 "C" 0.0 0.0 0.0) (:c3 "C" 1.34 0.0 0.0) (:c4 "C" 2.04 ,y4 0.0))))
+    (canonical-smiles-molecule (if reverse (reverse atoms) atoms)
+                               '((:c1 :c2 :single-bond) (:c2 :c3 :double-bond) (:c3 :c4 :single-bond)))))
+
+(let ((z-butene (chem:canonical-smiles (canonical-smiles-butene 1.2)))
+      (e-butene (chem:canonical-smiles (canonical-smiles-butene -1.2))))
+  (format t "Z-2-butene ~a  E-2-butene ~a~%" z-butene e-butene)
+  (test-true canonical-smiles-e-z-differ (and (string/= z-butene e-butene)
+                                              (find #\/ z-butene)
+                                              (find #\/ e-butene)))
+  (test-true canonical-smiles-e-z-atom-order
+             (and (string= z-butene (chem:canonical-smiles (canonical-smiles-butene 1.2 :reverse t)))
+                  (string= e-butene (chem:canonical-smiles (canonical-smiles-butene -1.2 :reverse t)))))
+  (test-true canonical-smiles-without-stereo
+             (string= (chem:canonical-smiles (canonical-smiles-butene 1.2) :stereo nil)
+                      (chem:canonical-smiles (canonical-smiles-butene -1.2) :stereo nil))))
+
+;;; The hydrogen on the nitrogen of an imine is folded into the nitrogen so there is no bond to mark
+(test-true canonical-smiles-unwritten-e-z-warns
+           (let ((warned nil))
+             (handler-bind ((warning (lambda (condition)
+                                       (setf warned t)
+                                       (muffle-warning condition))))
+               (chem:canonical-smiles
+                (canonical-smiles-molecule '((:c1 "C" -0.70 1.20 0.0) (:c2 "C" 0.0 0.0 0.0) (:h2 "H" -0.55 -0.95 0.0)
+                                             (:n3 "N" 1.28 0.0 0.0) (:h3 "H" 1.80 0.87 0.0))
+                                           '((:c1 :c2 :single-bond) (:c2 :h2 :single-bond) (:c2 :n3 :double-bond)
+                                             (:n3 :h3 :single-bond)))))
+             warned))
@@ -0,0 +1,93 @@
+(in-package #:clasp-tests)
+
+;;; The compiled matcher behind chem:boost-graph-vf2, chem:chem-info-graph-match and atom typing
+;;; must find the same matches as the original matchers.
+
+(defparameter *chem-info-smarts* '("[#6:1]-[#8:2]"
+                                   "[#6:1]=[#8:2]"
+                                   "[#6X4:1]-[#1:2]"
+                                   "[#7:1]-[#6:2]-[#6:3]=[#8:4]"
+                                   "[*:1]~[*:2]~[*:3]"
+                                   "[#6:1](-[#1:2])(-[#1:3])-[#6:4]"))
+
+(defparameter *chem-info-antechamber-rules* '("ATD  hc  *  1  1  *  *  *  (C4)  &"
+                                              "ATD  hn  *  1  1  *  *  *  (N)  &"
+                                              "ATD  ha  *  1  1  &"
+                                              "ATD  c3  *  6  4  &"
+                                              "ATD  c   *  6  3  *  *  *  (O1)  &"
+                                              "ATD  c2  *  6  3  &"
+                                              "ATD  o   *  8  1  &"
+                                              "ATD  n   *  7  3  &"
+                                              "ATD  n2  *  7  2  &"))
+
+(defun chem-info-fixture (name)
+  (cando:mol (chem:load-mol2 (format nil "sys:extensions;cando;src;lisp;regression-tests;data;~a.mol2" name)) 0))
+
+(defun chem-info-same-hits-p (hits1 hits2)
+  (let ((lists1 (mapcar (lambda (hit) (coerce hit 'list)) hits1))
+        (lists2 (mapcar (lambda (hit) (coerce hit 'list)) hits2)))
+    (and (= (length lists1) (length lists2))
+         (subsetp lists1 lists2 :test #'equal)
+         (subsetp lists2 lists1 :test #'equal))))
+
+(defun chem-info-vf2-matches-uncompiled (molecule)
+  "Every pattern must give the same embeddings with and without the compiled matcher."
+  (let* ((molecule-graph (chem:make-molecule-graph-from-molecule molecule))
+         (molecule-invariants (chem:make-molecule-invariants molecule-graph)))
+    (loop for smarts in *chem-info-smarts*
+          for graph = (chem:make-chem-info-graph (chem:compile-smarts smarts))
+          for uncompiled = (chem:boost-graph-vf2-uncompiled graph molecule-graph)
+          always (and uncompiled
+                      (chem-info-same-hits-p (chem:boost-graph-vf2 graph molecule-graph) uncompiled)
+                      (chem-info-same-hits-p (chem:boost-graph-vf2 graph molecule-graph molecule-invariants) uncompiled)))))
+
+(defun chem-info-atom-match-matches-uncompiled (molecule)
+  "Matching the first atom of every pattern on every atom must agree with chem:chem-info-match."
+  (let ((molecule-invariants (chem:make-molecule-invariants (chem:make-molecule-graph-from-molecule molecule))))
+    (loop for smarts in *chem-info-smarts*
+          for root = (chem:compile-smarts smarts)
+          for graph = (chem:make-chem-info-graph root)
+          always (let ((matched 0))
+                   (chem:do-atoms (atm molecule)
+                     (let ((compiled (chem:chem-info-graph-match graph molecule-invariants atm)))
+                       (unless (eq (not compiled) (not (chem:chem-info-match root atm)))
+                         (return-from chem-info-atom-match-matches-uncompiled nil))
+                       (when compiled (incf matched))))
+                   (> matched 0)))))
+
+(defun chem-info-typing-matches-uncompiled (molecule)
+  "Typing with the compiled antechamber rules must give the types of the rules matched one at a time."
+  (let ((types-db (core:make-cxx-object 'chem:fftypes-db))
+        (typed 0))
+    (dolist (rule *chem-info-antechamber-rules*)
+      (chem:fftypes-db-add types-db (chem:compile-antechamber-type-rule nil rule)))
+    (let ((atom-types (chem:assign-types types-db molecule (make-hash-table))))
+      (chem:do-atoms (atm molecule)
+        (let ((type (gethash atm atom-types)))
+          (unless (eq type (chem:assign-type types-db atm))
+            (return-from chem-info-typing-matches-uncompiled nil))
+          (when type (incf typed)))))
+    (> typed 0)))
+
+(test-true chem-info-vf2-hexapeptide (chem-info-vf2-matches-uncompiled (chem-info-fixture "hexapeptide")))
+(test-true chem-info-vf2-struct-0000 (chem-info-vf2-matches-uncompiled (chem-info-fixture "struct-0000")))
+(test-true chem-info-atom-match-hexapeptide (chem-info-atom-match-matches-uncompiled (chem-info-fixture "hexapeptide")))
+(test-true chem-info-atom-match-struct-0000 (chem-info-atom-match-matches-uncompiled (chem-info-fixture "struct-0000")))
+(test-true chem-info-typing-struct-0000 (chem-info-typing-matches-uncompiled (chem-info-fixture "struct-0000")))
+
+(defun chem-info-substructure-search-matches-vf2 (molecules)
+  "chem:substructure-search matches the patterns on worker threads and must agree with chem:boost-graph-vf2."
+  (let* ((molecule-graphs (mapcar #'chem:make-molecule-graph-from-molecule molecules))
+         (graphs (mapcar (lambda (smarts) (chem:make-chem-info-graph (chem:compile-smarts smarts))) *chem-info-smarts*))
+         (hits (chem:substructure-search (mapcar #'chem:make-molecule-invariants molecule-graphs)
+                                         (mapcar #'chem:compile-chem-info-graph graphs)
+                                         :threads 2 :induced t)))
+    (loop for molecule-graph in molecule-graphs
+          for molecule-index from 0
+          always (loop for graph in graphs
+                       for pattern-index from 0
+                       always (eq (= (sbit (aref hits molecule-index) pattern-index) 1)
+                                  (not (null (chem:boost-graph-vf2-uncompiled graph molecule-graph))))))))
+
+(test-true chem-info-substructure-search
+           (chem-info-substructure-search-matches-vf2 (list (chem-info-fixture "hexapeptide") (chem-info-fixture "struct-0000"))))
@@ -0,0 +1,58 @@
+(in-package #:clasp-tests)
+
+;;; The CIP engine must give the priorities and R/S of the hash table prioritizer
+;;; and cip-engine-update must leave it in the same state as a freshly made engine.
+
+(defun cip-fixture (name)
+  (cando:mol (chem:load-mol2 (format nil "sys:extensions;cando;src;lisp;regression-tests;data;~a.mol2" name)) 0))
+
+(defun cip-results (engine)
+  (list (coerce (chem:cip-engine-priorities engine) 'list)
+        (coerce (chem:cip-engine-configurations engine) 'list)))
+
+(defun cip-matches-prioritizer (molecule)
+  (let ((engine (chem:make-cip-engine molecule))
+        (cip-ht (make-hash-table)))
+    (chem:assign-cahn-ingold-prelog-priority-to-atoms-relative-priority (chem:make-cip-prioritizer) molecule cip-ht)
+    (let ((atoms (coerce (chem:cip-engine-atoms engine) 'list))
+          (priorities (coerce (chem:cip-engine-priorities engine) 'list)))
+      (and (equal (coerce (chem:cip-engine-configurations engine) 'list)
+                  (mapcar (lambda (atm) (chem:calculate-stereochemical-configuration atm cip-ht)) atoms))
+           ;; The numbering may differ but every pair of atoms must be ordered the same way
+           (loop for atom1 in atoms
+                 for priority1 in priorities
+                 always (loop for atom2 in atoms
+                              for priority2 in priorities
+                              always (eq (< priority1 priority2)
+                                         (< (gethash atom1 cip-ht) (gethash atom2 cip-ht)))))))))
+
+(defun cip-first-center-hydrogen (molecule)
+  "Return a center with four bonds and a hydrogen bonded to it"
+  (chem:do-atoms (atm molecule)
+    (when (= (chem:number-of-bonds atm) 4)
+      (dotimes (index 4)
+        (let ((neighbor (chem:bonded-neighbor atm index)))
+          (when (= (chem:get-atomic-number neighbor) 1)
+            (return-from cip-first-center-hydrogen (values atm neighbor)))))))
+  (error "No center with a hydrogen in ~a" molecule))
+
+(defun cip-update-matches-fresh (molecule)
+  (let* ((engine (chem:make-cip-engine molecule))
+         (before (cip-results engine)))
+    (multiple-value-bind (center hydrogen)
+        (cip-first-center-hydrogen molecule)
+      (and (= (chem:cip-engine-update engine) 0)
+           (equal (cip-results engine) before)
+           (progn
+             (chem:remove-bond-to center hydrogen)
+             (chem:cip-engine-update engine)
+             (equal (cip-results engine) (cip-results (chem:make-cip-engine molecule))))
+           (progn
+             (chem:bond-to center hydrogen :single-bond)
+             (chem:cip-engine-update engine)
+             (equal (cip-results engine) before))))))
+
+(test-true cip-prioritizer-hexapeptide (cip-matches-prioritizer (cip-fixture "hexapeptide")))
+(test-true cip-prioritizer-struct-0000 (cip-matches-prioritizer (cip-fixture "struct-0000")))
+(test-true cip-update-hexapeptide (cip-update-matches-fresh (cip-fixture "hexapeptide")))
+(test-true cip-update-struct-0000 (cip-update-matches-fresh (cip-fixture "struct-0000")))
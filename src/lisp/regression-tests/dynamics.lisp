@@ -0,0 +1,200 @@
+(in-package #:clasp-tests)
+
+;;; Velocity Verlet without a thermostat must conserve the total energy and the Langevin
+;;; thermostat must hold the average temperature at its target.  The Monte Carlo barostat
+;;; must never shrink the box below twice the cutoff and a rejected move must change nothing.
+;;; Bond constraints must hold a peptide in a box of water with SETTLE and with the SHAKE
+;;; fallback for a partially frozen water.
+
+(defun dynamics-hexapeptide ()
+  "Return the hexapeptide aggregate and a minimized energy-function for it."
+  (let ((agg (chem:load-mol2 "sys:extensions;cando;src;lisp;regression-tests;data;hexapeptide.mol2")))
+    (chem:setf-force-field-name (cando:mol agg 0) :smirnoff)
+    (let ((energy-function (chem:make-energy-function :matter agg)))
+      (cando:minimize-no-fail (chem:make-minimizer energy-function))
+      (values agg energy-function))))
+
+(defun dynamics-energies (dynamics steps stride)
+  "Run STEPS of DYNAMICS and return the energy plists recorded every STRIDE steps."
+  (let ((energies (make-array 16 :adjustable t :fill-pointer 0)))
+    (chem:molecular-dynamics-set-trajectory dynamics stride nil energies)
+    (chem:molecular-dynamics-run dynamics steps)
+    (coerce energies 'list)))
+
+(defun dynamics-nve-energy-drift ()
+  "Return the largest change of the total energy over 1 ps of velocity Verlet."
+  (let* ((energy-function (nth-value 1 (dynamics-hexapeptide)))
+         (dynamics (chem:make-molecular-dynamics energy-function :thermostat :none :timestep 0.0005 :seed 1)))
+    (chem:molecular-dynamics-initialize-velocities dynamics)
+    (let* ((totals (mapcar (lambda (energies)
+                             (+ (getf energies :potential) (getf energies :kinetic)))
+                           (dynamics-energies dynamics 2000 10)))
+           (start (first totals)))
+      (format t "NVE total energy start = ~f  end = ~f~%" start (car (last totals)))
+      (loop for total in totals
+            maximize (abs (- total start))))))
+
+(defun dynamics-langevin-average-temperature ()
+  "Return the average temperature over 8 ps of Langevin dynamics at 300 K after 2 ps to settle."
+  (let* ((energy-function (nth-value 1 (dynamics-hexapeptide)))
+         (dynamics (chem:make-molecular-dynamics energy-function :thermostat :langevin :temperature 300.0
+                                                                 :friction 5.0 :timestep 0.001 :seed 1)))
+    (chem:molecular-dynamics-initialize-velocities dynamics)
+    (chem:molecular-dynamics-run dynamics 2000)
+    (let* ((temperatures (mapcar (lambda (energies) (getf energies :temperature))
+                                 (dynamics-energies dynamics 8000 10)))
+           (average (/ (reduce #'+ temperatures) (length temperatures))))
+      (format t "Langevin average temperature = ~f~%" average)
+      average)))
+
+(test-true dynamics-nve-energy-conservation (< (dynamics-nve-energy-drift) 1.0))
+(test-true dynamics-langevin-temperature (< (abs (- (dynamics-langevin-average-temperature) 300.0)) 15.0))
+
+(defun barostat-attempts (seeds)
+  "Attempt one volume move of the hexapeptide in a 40 angstrom box for every seed in SEEDS with a
+pressure so high that every growing move is rejected.  Return (values rejected accepted) - the
+number of rejected moves that left the coordinates and box exactly as they were and the number of
+accepted moves that kept every width above twice the cutoff."
+  (let ((energy-function (nth-value 1 (dynamics-hexapeptide)))
+        (rejected 0)
+        (accepted 0))
+    (dolist (seed seeds)
+      (chem:energy-function-set-bounding-box energy-function (chem:make-bounding-box '(40.0 40.0 40.0)))
+      (let* ((box (chem:energy-function-bounding-box energy-function))
+             (barostat (chem:make-monte-carlo-barostat energy-function :pressure 1.0e9 :volume-scale 1000.0
+                                                                       :cutoff 19.99))
+             (pos (chem:make-nvector (chem:get-nvector-size energy-function)))
+             (saved (chem:make-nvector (chem:get-nvector-size energy-function))))
+        (chem:load-coordinates-into-vector energy-function pos)
+        (chem:load-coordinates-into-vector energy-function saved)
+        (if (chem:monte-carlo-barostat-attempt barostat pos 300.0 :seed seed)
+            (let ((scaled (chem:energy-function-bounding-box energy-function)))
+              (when (and (> (chem:get-x-width scaled) 39.98)
+                         (> (chem:get-y-width scaled) 39.98)
+                         (> (chem:get-z-width scaled) 39.98))
+                (incf accepted)))
+            (when (and (eq (chem:energy-function-bounding-box energy-function) box)
+                       (every #'= pos saved)
+                       (= (chem:monte-carlo-barostat-volume barostat) 64000.0))
+              (incf rejected)))))
+    (format t "barostat rejected = ~a  accepted = ~a~%" rejected accepted)
+    (values rejected accepted)))
+
+(test-true barostat-cutoff-too-large
+           (let ((energy-function (nth-value 1 (dynamics-hexapeptide))))
+             (chem:energy-function-set-bounding-box energy-function (chem:make-bounding-box '(40.0 40.0 40.0)))
+             (handler-case (progn
+                             (chem:make-monte-carlo-barostat energy-function :cutoff 20.0)
+                             nil)
+               (error () t))))
+
+(multiple-value-bind (rejected accepted)
+    (barostat-attempts (loop for seed below 20 collect seed))
+  (test-true barostat-moves (= (+ rejected accepted) 20))
+  (test-true barostat-rejects-moves (> rejected 0)))
+
+(defun constraints-peptide-in-water ()
+  "Return an energy-function for the hexapeptide next to a 3x3x3 grid of waters."
+  (let* ((agg (chem:load-mol2 "sys:extensions;cando;src;lisp;regression-tests;data;hexapeptide.mol2"))
+         (oxygen-element (chem:element-from-atom-name-string "O"))
+         (hydrogen-element (chem:element-from-atom-name-string "H"))
+         (xmax nil))
+    (chem:setf-force-field-name (cando:mol agg 0) :smirnoff)
+    (chem:do-atoms (atm agg)
+      (let ((x (geom:vx (chem:get-position atm))))
+        (when (or (null xmax) (> x xmax)) (setf xmax x))))
+    (dotimes (index 27)
+      (multiple-value-bind (rest ix) (floor index 3)
+        (multiple-value-bind (iz iy) (floor rest 3)
+          (let* ((x (+ xmax 5.0 (* 3.1 ix)))
+                 (y (* 3.1 iy))
+                 (z (* 3.1 iz))
+                 (molecule (chem:make-molecule :wat))
+                 (residue (chem:make-residue :wat))
+                 (o (chem:make-atom :o oxygen-element))
+                 (h1 (chem:make-atom :h1 hydrogen-element))
+                 (h2 (chem:make-atom :h2 hydrogen-element)))
+            (chem:set-position o (geom:vec x y z))
+            (chem:set-position h1 (geom:vec (+ x 0.9572) y z))
+            (chem:set-position h2 (geom:vec (- x 0.2400) (+ y 0.9266) z))
+            (chem:bond-to o h1 :single-bond)
+            (chem:bond-to o h2 :single-bond)
+            (chem:add-matter residue o)
+            (chem:add-matter residue h1)
+            (chem:add-matter residue h2)
+            (chem:add-matter molecule residue)
+            (chem:setf-force-field-name molecule :smirnoff)
+            (chem:add-matter agg molecule)))))
+    (chem:make-energy-function :matter agg)))
+
+(defun constraints-inverse-masses (energy-function frozen)
+  "Return the inverse mass of every atom of ENERGY-FUNCTION - zero for the atom indices in FROZEN."
+  (let* ((atom-table (chem:atom-table energy-function))
+         (num-atoms (/ (chem:get-nvector-size energy-function) 3))
+         (inverse-masses (chem:make-nvector num-atoms)))
+    (dotimes (index num-atoms)
+      (setf (aref inverse-masses index)
+            (if (member index frozen)
+                0.0
+                (/ 1.0 (case (chem:elt-atomic-number atom-table index)
+                         (1 1.008) (6 12.011) (7 14.007) (8 15.999) (16 32.06) (t 1.0))))))
+    inverse-masses))
+
+(defun constraints-deviations (rigid-water frozen)
+  "Perturb the peptide in water, apply the constraints to the positions and then to random
+velocities.  Return (values deviation-after-positions deviation-after-a-short-drift number-of-waters
+frozen-atoms-moved-p)."
+  (let* ((energy-function (constraints-peptide-in-water))
+         (constraints (chem:make-bond-constraints energy-function :bonds :hydrogens :rigid-water rigid-water))
+         (size (chem:get-nvector-size energy-function))
+         (inverse-masses (constraints-inverse-masses energy-function frozen))
+         (reference (chem:make-nvector size))
+         (pos (chem:make-nvector size))
+         (vel (chem:make-nvector size))
+         (drift (chem:make-nvector size)))
+    (chem:load-coordinates-into-vector energy-function reference)
+    ;; Start from exactly constrained coordinates and then displace every atom
+    (chem:bond-constraints-apply-to-positions constraints (copy-seq reference) reference inverse-masses)
+    (dotimes (index size)
+      (setf (aref pos index) (+ (aref reference index) (* 0.05 (sin (* 1.7 index))))
+            (aref vel index) (if (zerop (aref inverse-masses (floor index 3))) 0.0 (cos (* 2.3 index)))))
+    (chem:bond-constraints-apply-to-positions constraints reference pos inverse-masses)
+    (chem:bond-constraints-apply-to-velocities constraints pos vel inverse-masses)
+    (dotimes (index size)
+      (setf (aref drift index) (+ (aref pos index) (* 1.0e-4 (aref vel index)))))
+    (values (chem:bond-constraints-maximum-deviation constraints pos)
+            (chem:bond-constraints-maximum-deviation constraints drift)
+            (chem:bond-constraints-number-of-waters constraints)
+            (loop for atom in frozen
+                  thereis (loop for cc below 3
+                                for index = (+ (* atom 3) cc)
+                                thereis (/= (aref pos index) (aref reference index))))))))
+
+(defun constraints-water-oxygen (energy-function)
+  "Return the index of the first water oxygen of the peptide in water."
+  (let ((atom-table (chem:atom-table energy-function)))
+    (loop for index from (1- (/ (chem:get-nvector-size energy-function) 3)) downto 0
+          when (= (chem:elt-atomic-number atom-table index) 8)
+            do (return index))))
+
+(multiple-value-bind (after-positions after-drift waters)
+    (constraints-deviations t nil)
+  (format t "SETTLE deviation = ~e  after drift = ~e  waters = ~a~%" after-positions after-drift waters)
+  (test-true constraints-settle-waters (= waters 27))
+  (test-true constraints-settle-positions (< after-positions 1.0e-6))
+  (test-true constraints-settle-velocities (< after-drift 1.0e-6)))
+
+(multiple-value-bind (after-positions after-drift waters)
+    (constraints-deviations nil nil)
+  (format t "SHAKE water deviation = ~e  after drift = ~e~%" after-positions after-drift)
+  (test-true constraints-shake-waters (= waters 0))
+  (test-true constraints-shake-positions (< after-positions 1.0e-6))
+  (test-true constraints-shake-velocities (< after-drift 1.0e-6)))
+
+(multiple-value-bind (after-positions after-drift waters frozen-moved)
+    (constraints-deviations t (list (constraints-water-oxygen (constraints-peptide-in-water))))
+  (format t "Partially frozen water deviation = ~e  after drift = ~e~%" after-positions after-drift)
+  (test-true constraints-frozen-water-waters (= waters 27))
+  (test-true constraints-frozen-water-positions (< after-positions 1.0e-6))
+  (test-true constraints-frozen-water-velocities (< after-drift 1.0e-6))
+  (test-true constraints-frozen-water-stays (not frozen-moved)))
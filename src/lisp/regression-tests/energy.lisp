@@ -106,6 +106,83 @@
 
 (test-true force-acos (< force-acos 0.01))
 
+;;; The dihedral SIMD loops take blocks of compiled groups and the scalar loop takes the
+;;; groups left over - every width must give the energy and force of the scalar loop alone.
+(defun dihedral-energy-force (energy-function pos width)
+  (let ((dihedral (find 'chem:energy-dihedral (chem:all-components energy-function)
+                        :key (lambda (comp) (class-name (class-of comp)))))
+        (dihedral-force (chem:make-nvector (length pos))))
+    (core:set-simd-width width)
+    (unwind-protect
+         (values (chem:energy-function-evaluate-components energy-function (list dihedral) pos dihedral-force)
+                 dihedral-force)
+      (core:set-simd-width 1))))
+
+(defun dihedral-simd-deviation (energy-function pos width)
+  "Return the largest difference in the dihedral energy or force between simd WIDTH and simd 1."
+  (multiple-value-bind (energy1 force1)
+      (dihedral-energy-force energy-function pos 1)
+    (multiple-value-bind (energy force)
+        (dihedral-energy-force energy-function pos width)
+      (format t "simd ~d dihedral energy = ~f  simd 1 = ~f~%" width energy energy1)
+      (max (abs (- energy energy1))
+           (loop for index below (length force1)
+                 maximize (abs (- (aref force index) (aref force1 index))))))))
+
+(test-true dihedral-simd2 (< (dihedral-simd-deviation ef pos 2) 1.0e-6))
+(test-true dihedral-simd4 (< (dihedral-simd-deviation ef pos 4) 1.0e-6))
+(test-true dihedral-simd8 (< (dihedral-simd-deviation ef pos 8) 1.0e-6))
+
+;;; The generalized Born forces must be the derivative of the generalized Born energy
+;;; for the HCT descreening and for both OBC rescalings of the Born radii.
+(defun generalized-born-force-deviation (energy-function pos model)
+  "Return the largest difference between the analytic and the central difference GB force."
+  (let* ((components (list (chem:make-energy-generalized-born energy-function :model model)))
+         (gb-force (chem:make-nvector (length pos)))
+         (displaced (copy-seq pos))
+         (delta 1.0e-5))
+    (chem:energy-function-evaluate-components energy-function components pos gb-force)
+    (flet ((displaced-energy (index coordinate)
+             (setf (aref displaced index) coordinate)
+             (chem:energy-function-evaluate-components energy-function components displaced nil)))
+      (loop for index below (length pos)
+            for coordinate = (aref pos index)
+            for plus = (displaced-energy index (+ coordinate delta))
+            for minus = (displaced-energy index (- coordinate delta))
+            do (setf (aref displaced index) coordinate)
+            maximize (abs (- (aref gb-force index) (/ (- minus plus) (* 2.0 delta))))))))
+
+(test-true generalized-born-force-hct (< (generalized-born-force-deviation ef pos :hct) 1.0e-3))
+(test-true generalized-born-force-obc1 (< (generalized-born-force-deviation ef pos :obc1) 1.0e-3))
+(test-true generalized-born-force-obc2 (< (generalized-born-force-deviation ef pos :obc2) 1.0e-3))
+
+;;; Truncated Newton needs Hessian-vector products from every component so a
+;;; minimization with generalized Born solvent must run it to the end.
+(defun generalized-born-minimize ()
+  "Minimize the hexapeptide in GB solvent with truncated Newton alone and return the
+energies before and after."
+  (let* ((gb-agg (chem:load-mol2 "sys:extensions;cando;src;lisp;regression-tests;data;hexapeptide.mol2"))
+         (energy-function (progn
+                            (chem:setf-force-field-name (cando:mol gb-agg 0) :smirnoff)
+                            (chem:make-energy-function :matter gb-agg)))
+         (gb-pos (chem:make-nvector (chem:get-nvector-size energy-function)))
+         (minimizer (chem:make-minimizer energy-function)))
+    (chem:push-other-energy-component energy-function
+                                      (chem:make-energy-generalized-born energy-function :model :obc2))
+    (chem:load-coordinates-into-vector energy-function gb-pos)
+    (let ((before (chem:evaluate-energy energy-function gb-pos)))
+      (chem:set-maximum-number-of-steepest-descent-steps minimizer 0)
+      (chem:set-maximum-number-of-conjugate-gradient-steps minimizer 0)
+      (chem:set-maximum-number-of-truncated-newton-steps minimizer 50)
+      (cando:minimize-no-fail minimizer)
+      (chem:load-coordinates-into-vector energy-function gb-pos)
+      (values before (chem:evaluate-energy energy-function gb-pos)))))
+
+(multiple-value-bind (before after)
+    (generalized-born-minimize)
+  (format t "generalized Born minimize energy before = ~f  after = ~f~%" before after)
+  (test-true generalized-born-minimize (< after before)))
+
 
 (defparameter minimizer (chem:make-minimizer ef))
 #+(or)(time (dotimes (i 10)
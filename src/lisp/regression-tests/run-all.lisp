@@ -11,4 +11,10 @@
 (load-if-compiled-correctly "sys:extensions;cando;src;lisp;regression-tests;leap.lisp")
 (load-if-compiled-correctly "sys:extensions;cando;src;lisp;regression-tests;spanning-tree.lisp")
 (load-if-compiled-correctly "sys:extensions;cando;src;lisp;regression-tests;energy.lisp")
+(load-if-compiled-correctly "sys:extensions;cando;src;lisp;regression-tests;cip.lisp")
+(load-if-compiled-correctly "sys:extensions;cando;src;lisp;regression-tests;dynamics.lisp")
+(load-if-compiled-correctly "sys:extensions;cando;src;lisp;regression-tests;sdf.lisp")
+(load-if-compiled-correctly "sys:extensions;cando;src;lisp;regression-tests;torsion-scan.lisp")
+(load-if-compiled-correctly "sys:extensions;cando;src;lisp;regression-tests;chem-info.lisp")
+(load-if-compiled-correctly "sys:extensions;cando;src;lisp;regression-tests;canonical-smiles.lisp")
 ;;;(ext:quit (if (show-test-summary) 0 1))
@@ -0,0 +1,146 @@
+(in-package #:clasp-tests)
+
+;;; chem:make-sdf-file and chem:write-sdf must round trip V2000 and V3000 records with formal
+;;; charges and data items, and read the same molecules as sdf:load-sdf-as-list-of-molecules.
+
+(defun sdf-test-pathname (name)
+  (format nil "/tmp/cando-regression-~a.sdf" name))
+
+(defun sdf-write-v2000-record (stream name atoms bonds charges data &key (separator t))
+  "Write a V2000 record.  ATOMS is a list of (symbol x y z), BONDS a list of (atom1 atom2 order),
+CHARGES a list of (atom charge) and DATA a list of (name value) - atoms are numbered from 1."
+  (format stream "~a~%  test~%~%~3d~3d  0  0  0  0            999 V2000~%" name (length atoms) (length bonds))
+  (loop for (symbol x y z) in atoms
+        do (format stream "~10,4f~10,4f~10,4f ~3a 0  0  0  0  0  0  0  0  0  0  0  0~%" x y z symbol))
+  (loop for (atom1 atom2 order) in bonds
+        do (format stream "~3d~3d~3d  0  0  0  0~%" atom1 atom2 order))
+  (when charges
+    (format stream "M  CHG~3d~{~{ ~3d ~3d~}~}~%" (length charges) charges))
+  (format stream "M  END~%")
+  (loop for (item value) in data
+        do (format stream "> <~a>~%~a~%~%" item value))
+  (when separator (format stream "$$$$~%")))
+
+(defun sdf-write-test-file (pathname &key (last-separator t))
+  "Write acetate, ammonium and ethanol as V2000 records with charges and data items."
+  (with-open-file (stream pathname :direction :output :if-exists :supersede)
+    (sdf-write-v2000-record stream "acetate"
+                            '(("C" 0.0 0.0 0.0) ("C" 1.52 0.0 0.0) ("O" 2.15 1.07 0.0) ("O" 2.15 -1.07 0.0))
+                            '((1 2 1) (2 3 2) (2 4 1))
+                            '((4 -1))
+                            '(("ID" 1) ("SOURCE" "VINEGAR")))
+    (sdf-write-v2000-record stream "ammonium"
+                            '(("N" 0.0 0.0 0.0) ("H" 0.59 0.59 0.59) ("H" -0.59 -0.59 0.59)
+                              ("H" -0.59 0.59 -0.59) ("H" 0.59 -0.59 -0.59))
+                            '((1 2 1) (1 3 1) (1 4 1) (1 5 1))
+                            '((1 1))
+                            '(("ID" 2)))
+    (sdf-write-v2000-record stream "ethanol"
+                            '(("C" 0.0 0.0 0.0) ("C" 1.52 0.0 0.0) ("O" 2.0 1.35 0.0))
+                            '((1 2 1) (2 3 1))
+                            nil
+                            '(("ID" 3))
+                            :separator last-separator)))
+
+(defun sdf-write-v3000-chain (pathname length)
+  "Write a V3000 record of a chain of LENGTH carbons that ends in a charged nitrogen."
+  (with-open-file (stream pathname :direction :output :if-exists :supersede)
+    (format stream "chain~%  test~%~%  0  0  0     0  0            999 V3000~%")
+    (format stream "M  V30 BEGIN CTAB~%M  V30 COUNTS ~d ~d 0 0 0~%M  V30 BEGIN ATOM~%" (1+ length) length)
+    (dotimes (index length)
+      (format stream "M  V30 ~d C ~,4f ~,4f 0.0000 0~%" (1+ index) (* 1.25 index) (if (evenp index) 0.0 0.85)))
+    (format stream "M  V30 ~d N ~,4f 0.0000 0.0000 0 CHG=1~%" (1+ length) (* 1.25 length))
+    (format stream "M  V30 END ATOM~%M  V30 BEGIN BOND~%")
+    (dotimes (index length)
+      (format stream "M  V30 ~d 1 ~d ~d~%" (1+ index) (1+ index) (+ index 2)))
+    (format stream "M  V30 END BOND~%M  V30 END CTAB~%M  END~%$$$$~%")))
+
+(defun sdf-atom-signature (atm charge)
+  (let ((pos (chem:get-position atm)))
+    (list (chem:get-atomic-number atm)
+          (round (* 1000 (geom:vx pos)))
+          (round (* 1000 (geom:vy pos)))
+          (round (* 1000 (geom:vz pos)))
+          (round charge)
+          (sort (loop for index below (chem:number-of-bonds atm)
+                      collect (format nil "~a ~a"
+                                      (chem:get-atomic-number (chem:bonded-neighbor atm index))
+                                      (chem:bonded-order atm index)))
+                #'string<))))
+
+(defun sdf-molecule-signature (molecule &key sorted)
+  "Return the name, atoms and bonds of MOLECULE - the atoms in order unless SORTED."
+  (let ((atoms nil))
+    (chem:do-atoms (atm molecule)
+      (push (sdf-atom-signature atm (chem:get-charge atm)) atoms))
+    (setf atoms (nreverse atoms))
+    (list (string (chem:get-name molecule))
+          (if sorted
+              (sort atoms #'string< :key #'prin1-to-string)
+              atoms))))
+
+(defun sdf-molecule-data (molecule)
+  "Return the data items of MOLECULE as a sorted list of (name text)."
+  (sort (loop for (key value) on (chem:properties molecule) by #'cddr
+              collect (list (string key) (if (stringp value) value (princ-to-string value))))
+        #'string< :key #'first))
+
+(defun sdf-read-all (pathname)
+  (let* ((sdf-file (chem:make-sdf-file pathname))
+         (molecules (coerce (chem:sdf-file-read-molecules sdf-file) 'list)))
+    (values molecules (chem:sdf-file-number-of-records sdf-file) sdf-file)))
+
+(defun sdf-round-trip (from to)
+  "Read FROM, write its molecules with their data items to TO and return (values before after)."
+  (let ((before (sdf-read-all from)))
+    (with-open-file (stream to :direction :output :if-exists :supersede)
+      (chem:write-sdf stream before :properties t))
+    (values before (sdf-read-all to))))
+
+(defun sdf-same-molecules-p (molecules1 molecules2 &key sorted)
+  (and (= (length molecules1) (length molecules2))
+       (every (lambda (molecule1 molecule2)
+                (and (equal (sdf-molecule-signature molecule1 :sorted sorted)
+                            (sdf-molecule-signature molecule2 :sorted sorted))
+                     (equal (sdf-molecule-data molecule1) (sdf-molecule-data molecule2))))
+              molecules1 molecules2)))
+
+(let ((original (sdf-test-pathname "v2000"))
+      (copy (sdf-test-pathname "v2000-copy")))
+  (sdf-write-test-file original :last-separator nil)
+  (test-true sdf-record-without-separator (= (nth-value 1 (sdf-read-all original)) 3))
+  (multiple-value-bind (before after)
+      (sdf-round-trip original copy)
+    (test-true sdf-v2000-round-trip (sdf-same-molecules-p before after))
+    (test-true sdf-v2000-charges (equal (mapcar (lambda (molecule)
+                                                  (let (charges)
+                                                    (chem:do-atoms (atm molecule)
+                                                      (push (chem:get-ionization atm) charges))
+                                                    (nreverse charges)))
+                                                after)
+                                        '((0 0 0 -1) (1 0 0 0 0) (0 0 0))))
+    (test-true sdf-v2000-data (equal (sdf-molecule-data (first after))
+                                     '(("ID" "1") ("SOURCE" "VINEGAR")))))
+  (delete-file original)
+  (delete-file copy))
+
+(let ((original (sdf-test-pathname "v3000"))
+      (copy (sdf-test-pathname "v3000-copy")))
+  (sdf-write-v3000-chain original 1200)
+  (multiple-value-bind (before after)
+      (sdf-round-trip original copy)
+    (test-true sdf-v3000-round-trip (sdf-same-molecules-p before after))
+    (test-true sdf-v3000-written (search "V3000" (chem:sdf-file-record-text (nth-value 2 (sdf-read-all copy)) 0))))
+  (delete-file original)
+  (delete-file copy))
+
+;;; sdf:load-sdf-as-list-of-molecules sorts the molecules by name and adds the atoms of a record
+;;; in the order of a spanning tree so the atoms are compared as sets
+(let ((pathname (sdf-test-pathname "compare")))
+  (sdf-write-test-file pathname)
+  (test-true sdf-matches-sdf-package
+             (sdf-same-molecules-p (sort (sdf-read-all pathname) #'string<
+                                         :key (lambda (molecule) (string (chem:get-name molecule))))
+                                   (sdf:load-sdf-as-list-of-molecules pathname)
+                                   :sorted t))
+  (delete-file pathname))
@@ -0,0 +1,92 @@
+(in-package #:clasp-tests)
+
+;;; A torsion scan of a carbon chain must try every combination when nothing clashes, set the
+;;; dihedrals it was asked for and give the same conformations with and without a callback.
+
+(defun torsion-scan-chain (length)
+  "Return (values molecule atoms) for an all trans zig-zag chain of LENGTH carbons."
+  (let* ((molecule (chem:make-molecule :chain))
+         (residue (chem:make-residue :chain))
+         (carbon (chem:element-from-atom-name-string "C"))
+         (atoms (loop for index below length
+                      for atm = (chem:make-atom (intern (format nil "C~a" index) :keyword) carbon)
+                      do (chem:set-position atm (geom:vec (* 1.26 index) (if (evenp index) 0.0 0.89) 0.0))
+                         (chem:add-matter residue atm)
+                      collect atm)))
+    (loop for (atom1 atom2) on atoms
+          while atom2
+          do (chem:bond-to atom1 atom2 :single-bond))
+    (chem:add-matter molecule residue)
+    (values molecule atoms)))
+
+(defun torsion-scan-chain-scan (clash-distance)
+  "Return (values scan dihedrals) for a scan of six angles for each of the four dihedrals of heptane."
+  (multiple-value-bind (molecule atoms)
+      (torsion-scan-chain 7)
+    (let ((dihedrals (loop for (atom1 atom2 atom3 atom4) on atoms
+                           while atom4
+                           collect (list atom1 atom2 atom3 atom4))))
+      (values (chem:make-torsion-scan molecule
+                                      (mapcar (lambda (dihedral) (append dihedral (list 6))) dihedrals)
+                                      :clash-distance clash-distance)
+              dihedrals))))
+
+(defun torsion-scan-position (coordinates conformation index num-atoms)
+  (let ((offset (* 3 (+ index (* conformation num-atoms)))))
+    (geom:vec (aref coordinates offset) (aref coordinates (+ offset 1)) (aref coordinates (+ offset 2)))))
+
+(defun torsion-scan-dihedral-error (scan dihedrals coordinates indices count)
+  "Return the largest difference between a measured dihedral and the angle that was asked for."
+  (let* ((atoms (coerce (chem:torsion-scan-atoms scan) 'list))
+         (num-atoms (length atoms))
+         (num-torsions (length dihedrals)))
+    (loop for conformation below count
+          maximize (loop for dihedral in dihedrals
+                         for torsion from 0
+                         for wanted = (/ (* 2.0 pi (aref indices (+ torsion (* conformation num-torsions)))) 6)
+                         for measured = (apply #'geom:calculate-dihedral
+                                               (mapcar (lambda (atm)
+                                                         (torsion-scan-position coordinates conformation
+                                                                                (position atm atoms) num-atoms))
+                                                       dihedral))
+                         maximize (abs (sin (/ (- measured wanted) 2.0)))))))
+
+(defun torsion-scan-callback-conformations (scan block-size)
+  "Return (values coordinates indices count) gathered from the callback of the scan."
+  (let ((coordinates nil)
+        (indices nil))
+    (let ((count (chem:torsion-scan-enumerate scan :block-size block-size
+                                                   :callback (lambda (block-coordinates block-indices block-count)
+                                                               (declare (ignore block-count))
+                                                               (push (copy-seq block-coordinates) coordinates)
+                                                               (push (copy-seq block-indices) indices)))))
+      (values (apply #'concatenate 'list (nreverse coordinates))
+              (apply #'concatenate 'list (nreverse indices))
+              count))))
+
+(let ((scan (torsion-scan-chain-scan 0.01)))
+  (test-true torsion-scan-unpruned-count
+             (= (nth-value 2 (chem:torsion-scan-enumerate scan))
+                (chem:torsion-scan-number-of-combinations scan)
+                1296)))
+
+(multiple-value-bind (scan dihedrals)
+    (torsion-scan-chain-scan 0.01)
+  (multiple-value-bind (coordinates indices count)
+      (chem:torsion-scan-enumerate scan)
+    (let ((deviation (torsion-scan-dihedral-error scan dihedrals coordinates indices count)))
+      (format t "torsion scan largest dihedral deviation = ~e~%" deviation)
+      (test-true torsion-scan-dihedrals (< deviation 1.0e-6)))))
+
+(let ((scan (torsion-scan-chain-scan 2.2)))
+  (multiple-value-bind (coordinates indices count)
+      (chem:torsion-scan-enumerate scan)
+    (multiple-value-bind (callback-coordinates callback-indices callback-count)
+        (torsion-scan-callback-conformations scan 7)
+      (format t "torsion scan with clashes kept ~a of ~a~%" count (chem:torsion-scan-number-of-combinations scan))
+      (test-true torsion-scan-callback-count (and (= count callback-count)
+                                                  (< count (chem:torsion-scan-number-of-combinations scan))))
+      (test-true torsion-scan-callback-conformations
+                 (and (= (length coordinates) (length callback-coordinates))
+                      (every #'= coordinates callback-coordinates)
+                      (every #'= indices callback-indices))))))
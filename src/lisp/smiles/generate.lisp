@@ -244,3 +244,20 @@
         (format nil "~a" (apply 'concatenate 'string (coerce (depth-first-smiles dfs) 'list)))
         ))))
 
+
+(defun canonical-smiles (molecules &key (aromaticity :am1bcc) (stereo t))
+  "Return the canonical SMILES and 64-bit canonical hash of MOLECULES (a molecule, an aggregate or
+a sequence of molecules) using chem:canonical-smiles.  Aromatic atoms are found with the AROMATICITY
+model (see chem:identify-aromatic-rings) - use NIL to write the bond orders as they are."
+  (let ((aromatic-atoms (make-hash-table)))
+    (when aromaticity
+      (flet ((perceive (mol)
+               (let ((chem:*current-rings* (chem:identify-rings mol)))
+                 (maphash (lambda (atm info) (setf (gethash atm aromatic-atoms) info))
+                          (chem:identify-aromatic-rings mol aromaticity)))))
+        (etypecase molecules
+          (chem:molecule (perceive molecules))
+          (chem:aggregate (chem:map-molecules nil #'perceive molecules))
+          (sequence (map nil #'perceive molecules)))))
+    (let ((chem:*current-aromaticity-information* aromatic-atoms))
+      (chem:canonical-smiles molecules :stereo stereo))))
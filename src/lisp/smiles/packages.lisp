@@ -31,4 +31,5 @@
    #:parse-smiles-string
    #:chem-molecule
    #:cangen
-   #:generate))
+   #:generate
+   #:canonical-smiles))